@@ -0,0 +1,166 @@
+﻿#include "AngleTracker.h"
+
+// For exp and sqrt
+#include <math.h>
+
+// Standard deviation, in degrees, of a measurement made with full confidence. Lower confidence
+// widens it, so measurement variance is this squared, divided by confidence.
+static const double cMeasurementDeviationDegrees = 4.0;
+
+// Confidence below which a measurement carries no information. Localizer reports about half
+// of this for frames holding only background noise.
+static const double cMinConfidence = 0.1;
+
+// Spectral density of random acceleration, in square degrees per cubed second: how quickly
+// the filter believes a source can change course.
+static const double cAccelerationDensity = 400.0;
+
+// Gap, in seconds, after last measurement from which velocity decays toward zero with a time
+// constant, so a track coasting through silence comes to rest instead of running off past
+// where the talker stopped. Decaying between regular measurements would make track lag.
+static const double cCoastSeconds = 0.1;
+static const double cVelocityDecaySeconds = 0.5;
+
+// Squared normalized distance from prediction past which a measurement is an outlier (3 sigma).
+static const double cOutlierGate = 9.0;
+
+// Standard deviation, in degrees per second, of a new track's unknown velocity.
+static const double cInitialVelocityDeviation = 20.0;
+
+// Uncertainty, in degrees, past which a track receiving no measurements is dropped.
+static const double cMaxUncertaintyDegrees = 60.0;
+
+/// Constructor
+/// <param name="sampleRate">sample rate of stream measurements are positioned in, in Hz.</param>
+AngleTracker::AngleTracker(UINT sampleRate) :
+    m_samplePeriod(1.0 / sampleRate),
+    m_coastSamples(static_cast<UINT64>(cCoastSeconds * sampleRate)) {
+    Reset();
+}
+
+/// Forget track. Next usable measurement starts a new one.
+void AngleTracker::Reset() {
+    m_bTracking = false;
+    m_samplePosition = 0;
+    m_measurementPosition = 0;
+    m_angle = 0.0;
+    m_velocity = 0.0;
+    m_angleVariance = cMaxUncertaintyDegrees * cMaxUncertaintyDegrees;
+    m_covariance = 0.0;
+    m_velocityVariance = 0.0;
+    m_consecutiveOutliers = 0;
+    m_outlierCount = 0;
+}
+
+/// Standard deviation of smoothed angle, in degrees. Largest uncertainty a track may have when not tracking.
+float AngleTracker::GetUncertaintyDegrees() const {
+    return static_cast<float>(sqrt(m_angleVariance));
+}
+
+/// Advance track to a later point in stream without measuring, so uncertainty grows.
+/// A track left uncertain over most of the field of view is dropped.
+/// <param name="samplePosition">index, since start of stream, of sample to advance to. Earlier positions are ignored.</param>
+void AngleTracker::Predict(UINT64 samplePosition) {
+    if (!m_bTracking || samplePosition <= m_samplePosition) {
+        return;
+    }
+
+    UINT64 coastStart = m_measurementPosition + m_coastSamples;
+    if (m_samplePosition < coastStart) {
+        Advance(((samplePosition < coastStart) ? samplePosition : coastStart) - m_samplePosition, false);
+    }
+    if (m_samplePosition < samplePosition) {
+        Advance(samplePosition - m_samplePosition, true);
+    }
+
+    if (m_angleVariance > cMaxUncertaintyDegrees * cMaxUncertaintyDegrees) {
+        m_bTracking = false;
+        m_velocity = 0.0;
+        m_angleVariance = cMaxUncertaintyDegrees * cMaxUncertaintyDegrees;
+        m_covariance = 0.0;
+        m_velocityVariance = 0.0;
+    }
+}
+
+/// Fold a measurement into track, advancing it to measurement's position first.
+/// <param name="samplePosition">index, since start of stream, of sample at which angle was measured.</param>
+/// <param name="angleDegrees">measured angle, in degrees.</param>
+/// <param name="confidence">confidence in measurement, in [0.0,1.0] interval. Measurements with
+/// next to no confidence are ignored.</param>
+/// <returns>true if measurement was used, false if it was ignored or rejected as an outlier.</returns>
+bool AngleTracker::Update(UINT64 samplePosition, float angleDegrees, float confidence) {
+    if (confidence < cMinConfidence) {
+        return false;
+    }
+
+    double measurementVariance = cMeasurementDeviationDegrees * cMeasurementDeviationDegrees / ((confidence < 1.0f) ? confidence : 1.0);
+    if (!m_bTracking) {
+        Start(samplePosition, angleDegrees, measurementVariance);
+        return true;
+    }
+
+    Predict(samplePosition);
+
+    double innovation = angleDegrees - m_angle;
+    double innovationVariance = m_angleVariance + measurementVariance;
+
+    // A lone measurement far from prediction is a reflection or a misfire; a run of them is the source moving
+    if (innovation * innovation > cOutlierGate * innovationVariance) {
+        ++m_outlierCount;
+        if (++m_consecutiveOutliers < cMaxConsecutiveOutliers) {
+            return false;
+        }
+
+        Start(samplePosition, angleDegrees, measurementVariance);
+        return true;
+    }
+
+    m_consecutiveOutliers = 0;
+    m_measurementPosition = samplePosition;
+
+    double angleGain = m_angleVariance / innovationVariance;
+    double velocityGain = m_covariance / innovationVariance;
+
+    m_angle += angleGain * innovation;
+    m_velocity += velocityGain * innovation;
+    m_velocityVariance -= velocityGain * m_covariance;
+    m_covariance -= angleGain * m_covariance;
+    m_angleVariance -= angleGain * m_angleVariance;
+
+    return true;
+}
+
+/// Move state and covariance forward in time.
+/// <param name="sampleCount">number of samples to advance by.</param>
+/// <param name="bDecay">whether velocity decays over interval.</param>
+void AngleTracker::Advance(UINT64 sampleCount, bool bDecay) {
+    double dt = static_cast<double>(sampleCount) * m_samplePeriod;
+    m_samplePosition += sampleCount;
+
+    // Constant velocity motion driven by white acceleration noise. Decay scales velocity down
+    // and shortens the time it moves the angle for, from dt to travel
+    double decay = bDecay ? exp(-dt / cVelocityDecaySeconds) : 1.0;
+    double travel = bDecay ? cVelocityDecaySeconds * (1.0 - decay) : dt;
+
+    m_angle += m_velocity * travel;
+    m_velocity *= decay;
+    m_angleVariance += travel * (2.0 * m_covariance + travel * m_velocityVariance) + cAccelerationDensity * dt * dt * dt / 3.0;
+    m_covariance = decay * (m_covariance + travel * m_velocityVariance) + cAccelerationDensity * dt * dt / 2.0;
+    m_velocityVariance = decay * decay * m_velocityVariance + cAccelerationDensity * dt;
+}
+
+/// Start a new track at a measurement.
+/// <param name="samplePosition">position of measurement.</param>
+/// <param name="angleDegrees">measured angle.</param>
+/// <param name="measurementVariance">variance of measurement, in square degrees.</param>
+void AngleTracker::Start(UINT64 samplePosition, double angleDegrees, double measurementVariance) {
+    m_bTracking = true;
+    m_samplePosition = samplePosition;
+    m_measurementPosition = samplePosition;
+    m_angle = angleDegrees;
+    m_velocity = 0.0;
+    m_angleVariance = measurementVariance;
+    m_covariance = 0.0;
+    m_velocityVariance = cInitialVelocityDeviation * cInitialVelocityDeviation;
+    m_consecutiveOutliers = 0;
+}
@@ -0,0 +1,83 @@
+﻿#pragma once
+
+#include "Platform.h"
+
+/// Smooths a stream of noisy direction measurements into a steady angle.
+/// A constant velocity Kalman filter in degrees: each measurement is weighted by its
+/// confidence, and one too far from the prediction to be believed is rejected, unless
+/// several in a row agree the source has moved, when the track restarts there. Once
+/// measurements stop, velocity decays, so the angle comes to rest where the source fell silent.
+/// Time is counted in samples, so results don't depend on when measurements are processed.
+/// Every call is O(1) and nothing is allocated.
+class AngleTracker {
+public:
+    // Number of consecutive rejected measurements after which track restarts at the latest one.
+    static const UINT       cMaxConsecutiveOutliers = 4;
+
+    /// Constructor
+    /// <param name="sampleRate">sample rate of stream measurements are positioned in, in Hz.</param>
+    explicit AngleTracker(UINT sampleRate);
+
+    /// Forget track. Next usable measurement starts a new one.
+    void                    Reset();
+
+    /// Advance track to a later point in stream without measuring, so uncertainty grows.
+    /// A track left uncertain over most of the field of view is dropped.
+    /// <param name="samplePosition">index, since start of stream, of sample to advance to. Earlier positions are ignored.</param>
+    void                    Predict(UINT64 samplePosition);
+
+    /// Fold a measurement into track, advancing it to measurement's position first.
+    /// <param name="samplePosition">index, since start of stream, of sample at which angle was measured.</param>
+    /// <param name="angleDegrees">measured angle, in degrees.</param>
+    /// <param name="confidence">confidence in measurement, in [0.0,1.0] interval. Measurements with
+    /// next to no confidence are ignored.</param>
+    /// <returns>true if measurement was used, false if it was ignored or rejected as an outlier.</returns>
+    bool                    Update(UINT64 samplePosition, float angleDegrees, float confidence);
+
+    /// Whether a track has been started and not dropped since.
+    bool                    IsTracking() const { return m_bTracking; }
+
+    /// Smoothed angle, in degrees, at last position track was advanced to. A dropped track keeps its
+    /// last angle; 0 before first measurement.
+    float                   GetAngleDegrees() const { return static_cast<float>(m_angle); }
+
+    /// Estimated rate of change of angle, in degrees per second.
+    float                   GetVelocityDegreesPerSecond() const { return static_cast<float>(m_velocity); }
+
+    /// Standard deviation of smoothed angle, in degrees. Largest uncertainty a track may have when not tracking.
+    float                   GetUncertaintyDegrees() const;
+
+    /// Number of measurements rejected as outliers since construction or last Reset.
+    UINT64                  GetOutlierCount() const { return m_outlierCount; }
+
+private:
+    double                  m_samplePeriod;
+
+    // Gap, in samples, after last used measurement beyond which velocity decays.
+    UINT64                  m_coastSamples;
+
+    bool                    m_bTracking;
+    UINT64                  m_samplePosition;
+    UINT64                  m_measurementPosition;
+
+    // State estimate, and its covariance: angle variance, cross term and velocity variance.
+    double                  m_angle;
+    double                  m_velocity;
+    double                  m_angleVariance;
+    double                  m_covariance;
+    double                  m_velocityVariance;
+
+    UINT                    m_consecutiveOutliers;
+    UINT64                  m_outlierCount;
+
+    /// Move state and covariance forward in time.
+    /// <param name="sampleCount">number of samples to advance by.</param>
+    /// <param name="bDecay">whether velocity decays over interval.</param>
+    void                    Advance(UINT64 sampleCount, bool bDecay);
+
+    /// Start a new track at a measurement.
+    /// <param name="samplePosition">position of measurement.</param>
+    /// <param name="angleDegrees">measured angle.</param>
+    /// <param name="measurementVariance">variance of measurement, in square degrees.</param>
+    void                    Start(UINT64 samplePosition, double angleDegrees, double measurementVariance);
+};
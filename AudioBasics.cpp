@@ -1,7 +1,15 @@
 ﻿#include "stdafx.h"
 #include "AudioBasics.h"
+#include "Clock.h"
+#include "EchoCancellingAudioSource.h"
+#include "SessionAudioSource.h"
+#include "SyntheticAudioSource.h"
+#include "WavAudioSource.h"
 #include "resource.h"
 
+// For CommandLineToArgvW
+#include <shellapi.h>
+
 // For StringCch* and such
 #include <strsafe.h>
 
@@ -14,15 +22,8 @@
 
 #include <stdio.h>
 
-#include <Windows.h>
-#include <iostream>
-#include <sstream>
-#define DBOUT( s )            \
-{                             \
-   std::wostringstream os_;    \
-   os_ << s;                   \
-   OutputDebugString( os_.str().c_str() );  \
-}
+// Energy values computed per second of audio, which is the rate timeline history advances at.
+static const UINT cEnergyValuesPerSecond = AudioSamplesPerSecond / EnergyCalculator::cAudioSamplesPerEnergySample;
 
 /// Entry point for the application
 /// <param name="hInstance">handle to the application instance</param>
@@ -36,6 +37,7 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
     if (SUCCEEDED(hr)) {
         {
             CAudioBasics application;
+            application.ParseCommandLine(lpCmdLine);
             application.Run(hInstance, nCmdShow);
         }
 
@@ -47,19 +49,47 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
 
 /// Constructor
 CAudioBasics::CAudioBasics() :
+    m_hWnd(NULL),
+    m_refreshEventId(0),
     m_pD2DFactory(NULL),
     m_pAudioPanel(NULL),
-    m_pNuiSensor(NULL),
-    m_pNuiAudioSource(NULL),
-    m_pDMO(NULL),
-    m_pPropertyStore(NULL) {
+    m_nuiSensorCount(0),
+    m_sensorMask(~0u),
+    m_syntheticSourceCount(0),
+    m_bMicrophoneArray(false),
+    m_enhancements(AudioEnhancementNone),
+    m_nReportedOverruns(0),
+    m_reportedFailures(0),
+    m_bEnergyHistoryChanged(true),
+    m_timelineZoom(iDefaultTimelineZoom),
+    m_bTimelineChanged(true) {
+    m_szReplayFile[0] = '\0';
+    m_szSessionFile[0] = '\0';
+    m_szTraceFile[0] = '\0';
+    m_szRecordFile[0] = '\0';
+    m_szClipPrefix[0] = '\0';
+    m_szPublishChannel[0] = '\0';
+    m_szReferenceFile[0] = '\0';
+
+    for (UINT i = 0; i < CaptureEngine::cMaxSensors; ++i) {
+        m_pNuiSensors[i] = NULL;
+        m_lastBlocksProcessed[i] = 0;
+    }
 }
 
  /// Destructor
  CAudioBasics::~CAudioBasics() {
-    if (m_pNuiSensor) {
-        m_pNuiSensor->NuiShutdown();
+    // Capture threads use the audio sources, so they must be gone before anything is released
+    StopCapture();
+
+    // Audio sources hold sensor interfaces, so delete them before shutting sensors down
+    m_captureEngine.RemoveAllSensors();
+
+    for (UINT i = 0; i < m_nuiSensorCount; ++i) {
+        m_pNuiSensors[i]->NuiShutdown();
+        SafeRelease(m_pNuiSensors[i]);
     }
+    m_nuiSensorCount = 0;
 
     // clean up Direct2D renderer
     delete m_pAudioPanel;
@@ -67,20 +97,120 @@ CAudioBasics::CAudioBasics() :
 
     // clean up Direct2D
     SafeRelease(m_pD2DFactory);
+}
+
+/// Select where audio comes from, based on command line arguments.
+/// "-wav <file>" replays a WAV file, "-session <file>" replays a session file with its
+/// captured angles, "-synthetic [count]" generates moving tones for count simulated
+/// sensors, and no arguments captures from every ready Kinect.
+/// "-sensors 0,2" restricts capture to the Kinects with those indices. "-array" asks
+/// for raw microphone array channels, beamformed in software, from any of these.
+/// "-ns" and "-agc" run software noise suppression and automatic gain control on the signal shown.
+/// "-vad" skips localization and spectrogram of blocks in which no voice is detected.
+/// "-reference <file>" cancels echo of a mono WAV file, time aligned with capture, played through speakers.
+/// "-trace <file>" records a binary trace of captured and processed blocks.
+/// "-record <file>" saves audio and angles of the sensor shown to a recording file.
+/// "-clips <prefix>" saves clips of the sensor shown around loud events, voice onsets and,
+/// with "-array", source angle changes, each with seconds of audio from before the event.
+/// "-publish <name>" publishes audio and angles of the sensor shown on a shared memory channel,
+/// so other processes, such as a speech recognizer, can consume it while this one owns the sensor.
+/// <param name="lpCmdLine">command line arguments.</param>
+void CAudioBasics::ParseCommandLine(LPCWSTR lpCmdLine) {
+    if (NULL == lpCmdLine || L'\0' == lpCmdLine[0]) {
+        return;
+    }
+
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(lpCmdLine, &argc);
+    if (NULL == argv) {
+        return;
+    }
+
+    for (int i = 0; i < argc; ++i) {
+        if (0 == _wcsicmp(argv[i], L"-synthetic")) {
+            m_syntheticSourceCount = 1;
+
+            // Count is optional, so only a numeric next argument is taken as one
+            if (i + 1 < argc && iswdigit(argv[i + 1][0])) {
+                ++i;
+                UINT count = static_cast<UINT>(_wtoi(argv[i]));
+                m_syntheticSourceCount = (0 == count) ? 1 : ((count > CaptureEngine::cMaxSensors) ? CaptureEngine::cMaxSensors : count);
+            }
+        }
+        else if (0 == _wcsicmp(argv[i], L"-sensors") && i + 1 < argc) {
+            ++i;
+            m_sensorMask = 0;
+
+            // Comma separated list of sensor indices
+            for (LPCWSTR pIndex = argv[i]; L'\0' != *pIndex; ) {
+                int index = _wtoi(pIndex);
+                if (index >= 0 && index < 32) {
+                    m_sensorMask |= 1u << index;
+                }
+
+                LPCWSTR pComma = wcschr(pIndex, L',');
+                if (NULL == pComma) {
+                    break;
+                }
+                pIndex = pComma + 1;
+            }
+        }
+        else if (0 == _wcsicmp(argv[i], L"-array")) {
+            m_bMicrophoneArray = true;
+        }
+        else if (0 == _wcsicmp(argv[i], L"-ns")) {
+            m_enhancements |= AudioEnhancementNoiseSuppression;
+        }
+        else if (0 == _wcsicmp(argv[i], L"-agc")) {
+            m_enhancements |= AudioEnhancementAutomaticGain;
+        }
+        else if (0 == _wcsicmp(argv[i], L"-vad")) {
+            m_enhancements |= AudioEnhancementVoiceGate;
+        }
+        else if (0 == _wcsicmp(argv[i], L"-wav") && i + 1 < argc) {
+            ++i;
+            WideCharToMultiByte(CP_ACP, 0, argv[i], -1, m_szReplayFile, _countof(m_szReplayFile), NULL, NULL);
+        }
+        else if (0 == _wcsicmp(argv[i], L"-session") && i + 1 < argc) {
+            ++i;
+            WideCharToMultiByte(CP_ACP, 0, argv[i], -1, m_szSessionFile, _countof(m_szSessionFile), NULL, NULL);
+        }
+        else if (0 == _wcsicmp(argv[i], L"-reference") && i + 1 < argc) {
+            ++i;
+            WideCharToMultiByte(CP_ACP, 0, argv[i], -1, m_szReferenceFile, _countof(m_szReferenceFile), NULL, NULL);
+        }
+        else if (0 == _wcsicmp(argv[i], L"-trace") && i + 1 < argc) {
+            ++i;
+            WideCharToMultiByte(CP_ACP, 0, argv[i], -1, m_szTraceFile, _countof(m_szTraceFile), NULL, NULL);
+        }
+        else if (0 == _wcsicmp(argv[i], L"-record") && i + 1 < argc) {
+            ++i;
+            WideCharToMultiByte(CP_ACP, 0, argv[i], -1, m_szRecordFile, _countof(m_szRecordFile), NULL, NULL);
+        }
+        else if (0 == _wcsicmp(argv[i], L"-clips") && i + 1 < argc) {
+            ++i;
+            WideCharToMultiByte(CP_ACP, 0, argv[i], -1, m_szClipPrefix, _countof(m_szClipPrefix), NULL, NULL);
+        }
+        else if (0 == _wcsicmp(argv[i], L"-publish") && i + 1 < argc) {
+            ++i;
+            WideCharToMultiByte(CP_ACP, 0, argv[i], -1, m_szPublishChannel, _countof(m_szPublishChannel), NULL, NULL);
+        }
+    }
 
-    SafeRelease(m_pNuiSensor);
-    SafeRelease(m_pNuiAudioSource);
-    SafeRelease(m_pDMO);
-    SafeRelease(m_pPropertyStore);
+    LocalFree(argv);
 }
 
 /// Creates the main window and begins processing
 /// <param name="hInstance">handle to the application instance</param>
 /// <param name="nCmdShow">whether to display minimized, maximized, or normally</param>
 int CAudioBasics::Run(HINSTANCE hInstance, int nCmdShow) {
-    MSG       msg = {0};
     WNDCLASS  wc;
 
+    // Capture thread starts while dialog initializes and signals loop as soon as it has audio
+    if (FAILED(m_eventLoop.Initialize()) || FAILED(m_eventLoop.AddEvent(RefreshProc, this, &m_refreshEventId))) {
+        return 0;
+    }
+
     // Dialog custom window class
     ZeroMemory(&wc, sizeof(wc));
     wc.style         = CS_HREDRAW | CS_VREDRAW;
@@ -106,20 +236,11 @@ int CAudioBasics::Run(HINSTANCE hInstance, int nCmdShow) {
     // Show window
     ShowWindow(hWndApp, nCmdShow);
 
-    // Main message loop
-    while (WM_QUIT != msg.message) {
-        if (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE)) {
-            // If a dialog message will be taken care of by the dialog proc
-            if ((hWndApp != NULL) && IsDialogMessageW(hWndApp, &msg)) {
-                continue;
-            }
+    // Main message loop. Blocks until a message arrives or capture thread queues audio.
+    m_eventLoop.SetDialogWindow(hWndApp);
+    m_eventLoop.Run();
 
-            TranslateMessage(&msg);
-            DispatchMessageW(&msg);
-        }
-    }
-
-    return static_cast<int>(msg.wParam);
+    return m_eventLoop.GetExitCode();
 }
 
 /// Handles window messages, passes most to the class instance to handle
@@ -170,31 +291,63 @@ LRESULT CALLBACK CAudioBasics::DlgProc(HWND hWnd, UINT message, WPARAM wParam, L
                 break;
             }
 
-            // Look for a connected Kinect, and create it if found
-            hr = CreateFirstConnected();
+            // Timeline keeps energy and beam angle of displayed sensor for as long as it can be zoomed out over
+            hr = m_history.Open(2, iHistoryBucketsPerLevel, static_cast<UINT64>(iHistoryRetentionHours) * 3600 * cEnergyValuesPerSecond);
             if (FAILED(hr)) {
+                SetStatusMessage(L"Failed to allocate timeline history.");
                 break;
             }
 
-            SetTimer(m_hWnd, iAudioReadTimerId, iAudioReadTimerInterval, NULL);
-            SetTimer(m_hWnd, iEnergyRefreshTimerId, iEnergyRefreshTimerInterval, NULL);
+            // Open every ready Kinect, or the replay sources selected on command line
+            hr = CreateAudioSources();
+            if (FAILED(hr)) {
+                break;
+            }
+
+            // Start draining each DMO on its own thread so UI work can't stall capture
+            hr = StartCapture();
+            if (FAILED(hr)) {
+                SetStatusMessage(L"Failed to start audio capture threads.");
+                break;
+            }
+
+            // Failures and per-sensor throughput are reported once a second, rather than per block
+            m_eventLoop.AddTimer(iSensorStatusInterval, SensorStatusProc, this);
+
+            // Offer latency report from system menu, since dialog has no menu bar of its own
+            HMENU hSystemMenu = GetSystemMenu(m_hWnd, FALSE);
+            if (NULL != hSystemMenu) {
+                AppendMenuW(hSystemMenu, MF_SEPARATOR, 0, NULL);
+                AppendMenuW(hSystemMenu, MF_STRING, iDumpLatencyCommandId, L"Show &Latency");
+            }
+
+            m_pAudioPanel->SetLatencyHistograms(&m_captureToDisplayLatency, &m_drawLatency);
         }
         break;
 
-        // Capture all available audio or update audio panel each time timer fires
-        case WM_TIMER:
-          if (wParam == iAudioReadTimerId) {
-              ProcessAudio();
-          }
-          else if(wParam == iEnergyRefreshTimerId) {
-              Update();
-          }
-          break;
+          // Window was exposed, so panel can no longer assume its last frame is on screen
+          case WM_PAINT:
+              if (NULL != m_pAudioPanel) {
+                  m_pAudioPanel->Invalidate();
+                  m_eventLoop.Signal(m_refreshEventId);
+              }
+              break;
+
+          // Wheel zooms timeline, in towards latest audio or out over more history
+          case WM_MOUSEWHEEL:
+              ZoomTimeline(GET_WHEEL_DELTA_WPARAM(wParam) > 0);
+              return TRUE;
+
+          case WM_SYSCOMMAND:
+              if ((wParam & 0xFFF0) == iDumpLatencyCommandId) {
+                  DumpLatency();
+                  return TRUE;
+              }
+              break;
 
           // If the titlebar X is clicked, destroy app
           case WM_CLOSE:
-              KillTimer(m_hWnd, iAudioReadTimerId);
-              KillTimer(m_hWnd, iEnergyRefreshTimerId);
+              StopCapture();
               DestroyWindow(hWnd);
               break;
 
@@ -207,9 +360,9 @@ LRESULT CALLBACK CAudioBasics::DlgProc(HWND hWnd, UINT message, WPARAM wParam, L
     return FALSE;
 }
 
-/// Create the first connected Kinect found.
-/// <returns>S_OK on success, otherwise failure code.</returns>
-HRESULT CAudioBasics::CreateFirstConnected() {
+/// Open every ready Kinect selected on command line and add it to capture engine.
+/// <returns>S_OK if at least one sensor was added, otherwise failure code.</returns>
+HRESULT CAudioBasics::CreateConnectedSensors() {
     INuiSensor * pNuiSensor;
     HRESULT hr;
 
@@ -220,7 +373,11 @@ HRESULT CAudioBasics::CreateFirstConnected() {
     }
 
     // Look at each Kinect sensor
-    for (int i = 0; i < iSensorCount; ++i) {
+    for (int i = 0; i < iSensorCount && m_nuiSensorCount < CaptureEngine::cMaxSensors; ++i) {
+        if (i >= 32 || 0 == (m_sensorMask & (1u << i))) {
+            continue;
+        }
+
         // Create the sensor so we can check status, if we can't create it, move on to the next
         hr = NuiCreateSensorByIndex(i, &pNuiSensor);
         if (FAILED(hr)) {
@@ -230,141 +387,513 @@ HRESULT CAudioBasics::CreateFirstConnected() {
         // Get the status of the sensor, and if connected, then we can initialize it
         hr = pNuiSensor->NuiStatus();
         if (S_OK == hr) {
-            m_pNuiSensor = pNuiSensor;
-            break;
+            // Initialize the Kinect and specify that we'll be using audio signal
+            hr = pNuiSensor->NuiInitialize(NUI_INITIALIZE_FLAG_USES_AUDIO);
         }
 
-        // This sensor wasn't OK, so release it since we're not using it
-        pNuiSensor->Release();
-    }
+        // This sensor wasn't OK, or some other application is streaming from it, so move on
+        if (S_OK != hr) {
+            pNuiSensor->Release();
+            continue;
+        }
 
-    if (NULL != m_pNuiSensor) {
-        // Initialize the Kinect and specify that we'll be using audio signal
-        hr = m_pNuiSensor->NuiInitialize(NUI_INITIALIZE_FLAG_USES_AUDIO); 
-        if (FAILED(hr)) {
-            // Some other application is streaming from the same Kinect sensor
-            SafeRelease(m_pNuiSensor);
+        // Sensor is kept until destructor even if its audio source fails, since NuiShutdown must still be called
+        m_pNuiSensors[m_nuiSensorCount++] = pNuiSensor;
+
+        AudioSource* pSource = NULL;
+        hr = InitializeAudioSource(pNuiSensor, &pSource);
+
+        if (SUCCEEDED(hr)) {
+            hr = AddSensor(pSource);
+        }
+        else {
+            delete pSource;
         }
     }
 
-    if (NULL == m_pNuiSensor || FAILED(hr)) {
+    if (0 == m_captureEngine.GetSensorCount()) {
         SetStatusMessage(L"No ready Kinect found!");
         return E_FAIL;
     }
 
-    return  InitializeAudioSource();
+    return S_OK;
 }
 
 /// Initialize Kinect audio capture/control objects.
+/// <param name="pNuiSensor">sensor initialized for audio.</param>
+/// <param name="ppSource">receives audio source of sensor.</param>
 /// <returns>
 /// <para>S_OK on success, otherwise failure code.</para>
 /// </returns>
-HRESULT CAudioBasics::InitializeAudioSource() {
-    // Get the audio source
-    HRESULT hr = m_pNuiSensor->NuiGetAudioSource(&m_pNuiAudioSource);
-    if (FAILED(hr)) {
-        return hr;
+HRESULT CAudioBasics::InitializeAudioSource(INuiSensor* pNuiSensor, AudioSource** ppSource) {
+    if (m_bMicrophoneArray) {
+        KinectRawAudioSource* pRawSource = new KinectRawAudioSource();
+        *ppSource = pRawSource;
+
+        return pRawSource->Initialize(pNuiSensor);
     }
 
-    hr = m_pNuiAudioSource->QueryInterface(IID_IMediaObject, (void**)&m_pDMO);
-    if (FAILED(hr)) {
-        return hr;
+    KinectAudioSource* pKinectSource = new KinectAudioSource();
+    *ppSource = pKinectSource;
+
+    return pKinectSource->Initialize(pNuiSensor);
+}
+
+/// Add a sensor's source to capture engine, cancelling echo of reference file if one was given.
+/// <param name="pSource">audio source of sensor. Ownership passes to capture engine, even on failure.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT CAudioBasics::AddSensor(AudioSource* pSource) {
+    UINT sensorIndex = 0;
+
+    if ('\0' == m_szReferenceFile[0]) {
+        return m_captureEngine.AddSensor(pSource, m_enhancements, &sensorIndex);
     }
 
-    hr = m_pNuiAudioSource->QueryInterface(IID_IPropertyStore, (void**)&m_pPropertyStore);
-    if (FAILED(hr)) {
-        return hr;
+    // Every sensor reads its own copy of reference, as fast as its capture demands
+    WavAudioSource* pReferenceSource = new WavAudioSource(false, false);
+    HRESULT hr = pReferenceSource->Open(m_szReferenceFile);
+
+    EchoCancellingAudioSource* pEchoSource = new EchoCancellingAudioSource(pSource, pReferenceSource);
+    if (SUCCEEDED(hr)) {
+        hr = pEchoSource->Initialize(EchoCanceller::cDefaultBlockSize, EchoCanceller::cDefaultTailLength, GetSimdLevel());
     }
 
-    // Set AEC-MicArray DMO system mode. This must be set for the DMO to work properly.
-    // Possible values are:
-    //   SINGLE_CHANNEL_AEC = 0
-    //   OPTIBEAM_ARRAY_ONLY = 2
-    //   OPTIBEAM_ARRAY_AND_AEC = 4
-    //   SINGLE_CHANNEL_NSAGC = 5
-    PROPVARIANT pvSysMode;
-    PropVariantInit(&pvSysMode);
-    pvSysMode.vt = VT_I4;
-    pvSysMode.lVal = (LONG)(2); // Use OPTIBEAM_ARRAY_ONLY setting. Set OPTIBEAM_ARRAY_AND_AEC instead if you expect to have sound playing from speakers.
-    m_pPropertyStore->SetValue(MFPKEY_WMAAECMA_SYSTEM_MODE, pvSysMode);
-    PropVariantClear(&pvSysMode);
-
-    // Set DMO output format
-    WAVEFORMATEX wfxOut = {AudioFormat, AudioChannels, AudioSamplesPerSecond, AudioAverageBytesPerSecond, AudioBlockAlign, AudioBitsPerSample, 0};
-    DMO_MEDIA_TYPE mt = {0};
-    hr = MoInitMediaType(&mt, sizeof(WAVEFORMATEX));
     if (FAILED(hr)) {
+        delete pEchoSource;
+        SetStatusMessage(L"Failed to open echo reference. File must hold 16 kHz 16-bit PCM.");
         return hr;
     }
 
-    mt.majortype = MEDIATYPE_Audio;
-    mt.subtype = MEDIASUBTYPE_PCM;
-    mt.lSampleSize = 0;
-    mt.bFixedSizeSamples = TRUE;
-    mt.bTemporalCompression = FALSE;
-    mt.formattype = FORMAT_WaveFormatEx;	
-    memcpy_s(mt.pbFormat, sizeof(WAVEFORMATEX), &wfxOut, sizeof(WAVEFORMATEX));
+    return m_captureEngine.AddSensor(pEchoSource, m_enhancements, &sensorIndex);
+}
+
+/// Create audio sources selected on command line.
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT CAudioBasics::CreateAudioSources() {
+    if (m_syntheticSourceCount > 0) {
+        MicrophoneArrayGeometry geometry = GetKinectArrayGeometry();
+        for (UINT i = 0; i < m_syntheticSourceCount; ++i) {
+            HRESULT hr = AddSensor(new SyntheticAudioSource(true, 0, m_bMicrophoneArray ? &geometry : NULL));
+            if (FAILED(hr)) {
+                return hr;
+            }
+        }
+        return S_OK;
+    }
+
+    if ('\0' != m_szReplayFile[0]) {
+        WavAudioSource* pWavSource = new WavAudioSource(true, m_bMicrophoneArray);
+
+        HRESULT hr = pWavSource->Open(m_szReplayFile);
+        if (FAILED(hr)) {
+            delete pWavSource;
+            SetStatusMessage(L"Failed to open WAV file. File must hold 16 kHz 16-bit PCM.");
+            return hr;
+        }
+
+        return AddSensor(pWavSource);
+    }
+
+    if ('\0' != m_szSessionFile[0]) {
+        SessionAudioSource* pSessionSource = new SessionAudioSource(1.0);
+
+        HRESULT hr = pSessionSource->Open(m_szSessionFile);
+        if (FAILED(hr)) {
+            delete pSessionSource;
+            SetStatusMessage(L"Failed to open session file. File must be a 16 kHz session file.");
+            return hr;
+        }
 
-    hr = m_pDMO->SetOutputType(0, &mt, 0); 
-    MoFreeMediaType(&mt);
+        return AddSensor(pSessionSource);
+    }
 
-    return hr;
+    return CreateConnectedSensors();
 }
 
-/// Capture new audio data.
-void CAudioBasics::ProcessAudio() {
-    // Bottom portion of computed energy signal that will be discarded as noise.
-    // Only portion of signal above noise floor will be displayed.
-    const float cEnergyNoiseFloor = 0.2f;
-
-    ULONG cbProduced = 0;
-    BYTE *pProduced = NULL;
-    DWORD dwStatus = 0;
-    DMO_OUTPUT_DATA_BUFFER outputBuffer = {0};
-    outputBuffer.pBuffer = &m_csmCaptureBuffer;
-
-    HRESULT hr = S_OK;
-
-    do {
-        m_csmCaptureBuffer.Init(0);
-        outputBuffer.dwStatus = 0;
-        hr = m_pDMO->ProcessOutput(0, 1, &outputBuffer, &dwStatus);
+/// Start capture engine's capture threads and workers.
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT CAudioBasics::StartCapture() {
+    // Tracing is optional, so failing to create trace file does not stop capture
+    if ('\0' != m_szTraceFile[0] && FAILED(m_traceLog.Open(m_szTraceFile))) {
+        SetStatusMessage(L"Failed to create trace file.");
+    }
+
+    // Likewise recording; a live sensor drops blocks rather than wait when disk falls behind
+    if ('\0' != m_szRecordFile[0] && m_captureEngine.GetSensorCount() > iDisplayedSensor) {
+        HRESULT hr = m_recorder.Open(m_szRecordFile, m_captureEngine.GetSensorChannelCount(iDisplayedSensor), AudioSamplesPerSecond,
+            AudioRecorder::cDefaultBatchMilliseconds, false);
+        if (SUCCEEDED(hr)) {
+            hr = m_captureEngine.SetRecorder(iDisplayedSensor, &m_recorder);
+        }
+
         if (FAILED(hr)) {
-            SetStatusMessage(L"Failed to process audio output.");
-            break;
+            m_recorder.Close();
+            SetStatusMessage(L"Failed to create recording file.");
         }
+    }
 
-        if (hr == S_FALSE) {
-            cbProduced = 0;
+    // Likewise clips; voice onsets only trigger when voice gate runs, and angles only mean much from the array
+    if ('\0' != m_szClipPrefix[0] && m_captureEngine.GetSensorCount() > iDisplayedSensor) {
+        ClipCaptureSettings settings = ClipCapture::GetDefaultSettings();
+        if (m_bMicrophoneArray) {
+            settings.triggers |= ClipTriggerAngleChange;
         }
-        else {
-            m_csmCaptureBuffer.GetBufferAndLength(&pProduced, &cbProduced);
+
+        HRESULT hr = m_clipCapture.Open(m_szClipPrefix, m_captureEngine.GetSensorChannelCount(iDisplayedSensor), AudioSamplesPerSecond, settings, false);
+        if (SUCCEEDED(hr)) {
+            hr = m_captureEngine.SetClipCapture(iDisplayedSensor, &m_clipCapture);
+        }
+
+        if (FAILED(hr)) {
+            m_clipCapture.Close();
+            SetStatusMessage(L"Failed to start clip capture.");
+        }
+    }
+
+    // And the broadcast channel, which readers attach to whenever they like
+    if ('\0' != m_szPublishChannel[0] && m_captureEngine.GetSensorCount() > iDisplayedSensor) {
+        HRESULT hr = m_publisher.Open(m_szPublishChannel, m_captureEngine.GetSensorChannelCount(iDisplayedSensor), AudioSamplesPerSecond,
+            BroadcastPublisher::cDefaultSlotCount);
+        if (SUCCEEDED(hr)) {
+            hr = m_captureEngine.SetPublisher(iDisplayedSensor, &m_publisher);
+        }
+
+        if (FAILED(hr)) {
+            m_publisher.Close();
+            SetStatusMessage(L"Failed to open broadcast channel. Name may already be in use.");
         }
+    }
+
+    return m_captureEngine.Start(0, this, &m_traceLog);
+}
+
+/// Stop capture engine and drop results not yet displayed.
+void CAudioBasics::StopCapture() {
+    m_captureEngine.Stop();
+
+    for (AudioPipelineResult* pResult = m_resultRing.BeginRead(); NULL != pResult; pResult = m_resultRing.BeginRead()) {
+        m_resultRing.EndRead();
+    }
+
+    // Capture threads and workers are gone and this is the UI thread, so no writer is left
+    m_traceLog.Close();
+    m_recorder.Close();
+    m_clipCapture.Close();
+    m_publisher.Close();
+}
+
+/// Queue results of sensor shown in audio panel for UI thread. Called on capture engine's worker threads.
+/// <param name="sensorIndex">index of sensor in capture engine.</param>
+/// <param name="result">processing results for block.</param>
+void CAudioBasics::OnBlockProcessed(UINT sensorIndex, const AudioPipelineResult& result) {
+    // Other sensors only show up in merged status, which reads capture engine's snapshot
+    if (iDisplayedSensor != sensorIndex) {
+        return;
+    }
+
+    m_traceLog.Write(TraceEventBlockProcessed, result.sequence,
+        result.beamAngleDegrees, result.sourceAngleDegrees, result.sourceConfidence, result.energyPeak);
+
+    for (UINT i = 0; i < result.sourceEstimateCount; ++i) {
+        m_traceLog.Write(TraceEventSourceEstimate, static_cast<uint32_t>(result.sourceEstimates[i].samplePosition),
+            result.sourceEstimates[i].angleDegrees, result.sourceEstimates[i].confidence);
+    }
+
+    m_traceLog.Write(TraceEventSourceTracked, result.sequence,
+        result.trackedAngleDegrees, result.trackedVelocityDegreesPerSecond, result.trackedUncertaintyDegrees);
 
-        if (cbProduced > 0) {
-            double beamAngle, sourceAngle, sourceConfidence;
+    for (UINT i = 0; i < result.trackCount; ++i) {
+        m_traceLog.Write(TraceEventSourceTrack, result.tracks[i].id, result.tracks[i].angleDegrees,
+            result.tracks[i].velocityDegreesPerSecond, result.tracks[i].uncertaintyDegrees, result.tracks[i].strength);
+    }
 
-            // Obtain beam angle from INuiAudioBeam afforded by microphone array
-            m_pNuiAudioSource->GetBeam(&beamAngle);
-            m_pNuiAudioSource->GetPosition(&sourceAngle, &sourceConfidence);
+    // Calls for one sensor never overlap, so this is the ring's only writer
+    AudioPipelineResult* pSlot = m_resultRing.BeginWrite();
+    if (NULL == pSlot) {
+        m_resultRing.NoteOverrun();
+        return;
+    }
+
+    *pSlot = result;
+    m_resultRing.EndWrite();
+
+    m_eventLoop.Signal(m_refreshEventId);
+}
 
-            // Convert angles to degrees and set values in audio panel
-            float beamAngleDegrees = static_cast<float>((180.0 * beamAngle) / M_PI);
-            float sourceAngleDegrees = static_cast<float>((180.0 * sourceAngle) / M_PI);
-            m_pAudioPanel->SetBeam(beamAngleDegrees);
+/// Wake UI thread so it can report why capture stopped. Called on sensor's capture thread.
+/// <param name="sensorIndex">index of sensor in capture engine.</param>
+/// <param name="hr">S_OK if source finished, otherwise failure that stopped capture.</param>
+void CAudioBasics::OnCaptureStopped(UINT sensorIndex, HRESULT hr) {
+    if (FAILED(hr)) {
+        m_eventLoop.Signal(m_refreshEventId);
+    }
+}
+
+/// Consume results queued by capture engine for displayed sensor.
+void CAudioBasics::ProcessAudio() {
+    AudioPipelineResult* pResult = m_resultRing.BeginRead();
+    if (NULL == pResult) {
+        m_resultRing.NoteUnderrun();
+    }
 
-            DBOUT("Beam Angle: " << beamAngleDegrees << "\n");
-            DBOUT("Source Angle: " << sourceAngleDegrees << "\n");
+    for (; NULL != pResult; pResult = m_resultRing.BeginRead()) {
+        // Needles follow tracked sources, which hold steady through noisy and low confidence angles
+        float angles[MultiSourceTracker::cMaxTracks];
+        UINT ids[MultiSourceTracker::cMaxTracks];
+        for (UINT i = 0; i < pResult->trackCount; ++i) {
+            angles[i] = pResult->tracks[i].angleDegrees;
+            ids[i] = pResult->tracks[i].id;
         }
+        m_pAudioPanel->SetSources(angles, ids, pResult->trackCount, pResult->captureTimestamp);
+        m_pAudioPanel->SetSourceMap(pResult->angularMap, pResult->mapAngleCount);
+        m_energyHistory.Append(pResult->energy, pResult->energyCount);
+        m_bEnergyHistoryChanged = true;
+
+        // Timeline history advances at energy's fixed rate, with block's beam angle alongside each value
+        for (UINT i = 0; i < pResult->energyCount; ++i) {
+            float values[2] = {pResult->energy[i], pResult->beamAngleDegrees};
+            m_history.Append(values);
+        }
+        m_bTimelineChanged = m_bTimelineChanged || (pResult->energyCount > 0);
+
+        // Panel keeps its own column ring, so only new columns are handed over
+        m_pAudioPanel->AppendSpectra(&pResult->spectra[0][0], pResult->spectrumCount, AudioPipelineResult::cSpectrumBins);
 
-    } while (outputBuffer.dwStatus & DMO_OUTPUT_DATA_BUFFERF_INCOMPLETE);
+        m_resultRing.EndRead();
+    }
+}
+
+/// Show capture failures, dropped audio, and with several sensors their angles and throughput.
+void CAudioBasics::UpdateSensorStatus() {
+    UINT sensorCount = m_captureEngine.GetSensorCount();
+    SensorStatus statuses[CaptureEngine::cMaxSensors];
+    for (UINT i = 0; i < sensorCount; ++i) {
+        m_captureEngine.GetSensorStatus(i, &statuses[i]);
+    }
+
+    // A failure stays in status bar, so it is only reported the first time it is seen
+    for (UINT i = 0; i < sensorCount; ++i) {
+        if (FAILED(statuses[i].captureResult) && 0 == (m_reportedFailures & (1u << i))) {
+            m_reportedFailures |= 1u << i;
+
+            WCHAR szMessage[128];
+            StringCchPrintfW(szMessage, _countof(szMessage), L"Failed to process audio output of sensor %u (0x%08X).", i, statuses[i].captureResult);
+            SetStatusMessage(szMessage);
+            return;
+        }
+    }
+
+    // Let the user know when capture rings are too small for current load
+    uint32_t overruns = GetCaptureOverrunCount();
+    if (overruns != m_nReportedOverruns) {
+        m_nReportedOverruns = overruns;
+
+        WCHAR szMessage[128];
+        StringCchPrintfW(szMessage, _countof(szMessage), L"Audio capture dropped data (%u overruns, %u underruns).", overruns, GetCaptureUnderrunCount());
+        SetStatusMessage(szMessage);
+        return;
+    }
+
+    // With one sensor, audio panel already shows everything there is
+    if (sensorCount < 2) {
+        return;
+    }
+
+    WCHAR szMessage[512];
+    STRSAFE_LPWSTR pEnd = szMessage;
+    size_t cchRemaining = _countof(szMessage);
+    szMessage[0] = L'\0';
+
+    for (UINT i = 0; i < sensorCount; ++i) {
+        UINT64 blocksPerInterval = statuses[i].blocksProcessed - m_lastBlocksProcessed[i];
+        m_lastBlocksProcessed[i] = statuses[i].blocksProcessed;
+
+        StringCchPrintfExW(pEnd, cchRemaining, &pEnd, &cchRemaining, 0,
+            L"%s#%u beam %.0f\u00B0 source %.0f\u00B0\u00B1%.0f\u00B0 %u blk/s", (0 == i) ? L"" : L"  |  ", i,
+            statuses[i].beamAngleDegrees, statuses[i].trackedAngleDegrees, statuses[i].trackedUncertaintyDegrees,
+            static_cast<UINT>(blocksPerInterval * 1000 / iSensorStatusInterval));
+
+        if (0 != (m_enhancements & AudioEnhancementVoiceGate) && statuses[i].blocksProcessed > 0) {
+            StringCchPrintfExW(pEnd, cchRemaining, &pEnd, &cchRemaining, 0, L" %u%% idle",
+                static_cast<UINT>(statuses[i].blocksSkipped * 100 / statuses[i].blocksProcessed));
+        }
+    }
+
+    SetStatusMessage(szMessage);
+}
+
+/// Event loop timer callback that updates per-sensor status.
+/// <param name="pContext">CAudioBasics instance that owns event loop.</param>
+void CAudioBasics::SensorStatusProc(void* pContext) {
+    CAudioBasics* pThis = reinterpret_cast<CAudioBasics*>(pContext);
+    pThis->UpdateSensorStatus();
+}
+
+/// Event loop callback that consumes queued audio and redraws audio panel.
+/// <param name="pContext">CAudioBasics instance that owns event loop.</param>
+void CAudioBasics::RefreshProc(void* pContext) {
+    CAudioBasics* pThis = reinterpret_cast<CAudioBasics*>(pContext);
+
+    // Capture thread can signal before dialog finished initializing
+    if (NULL == pThis->m_pAudioPanel) {
+        return;
+    }
+
+    pThis->ProcessAudio();
+    pThis->Update();
+
+    // Once every capture thread has stopped, say why now rather than on next status tick
+    if (pThis->m_captureEngine.IsIdle()) {
+        pThis->UpdateSensorStatus();
+    }
 }
 
 /// Display latest audio data.
 void CAudioBasics::Update() {
+    // Oscilloscope only scrolls when new audio was processed, so most refreshes have nothing to redraw
+    if (m_bEnergyHistoryChanged) {
+        m_energyHistory.CopyLatest(m_fEnergyDisplay, AudioPanel::cEnergySamplesToDisplay);
+        m_pAudioPanel->UpdateEnergy(m_fEnergyDisplay, AudioPanel::cEnergySamplesToDisplay);
+        m_bEnergyHistoryChanged = false;
+    }
+
+    if (m_bTimelineChanged) {
+        UpdateTimeline();
+        m_bTimelineChanged = false;
+    }
+
     m_pAudioPanel->Draw();
 }
 
+/// Summarise latest history at current zoom into timeline columns and hand them to audio panel.
+void CAudioBasics::UpdateTimeline() {
+    // Columns end on a multiple of their length, so they stay put as history grows and only newest one changes
+    UINT64 columnEntries = static_cast<UINT64>(1) << m_timelineZoom;
+    UINT64 end = ((m_history.GetEntryCount() + columnEntries - 1) >> m_timelineZoom) << m_timelineZoom;
+    UINT columnCount = static_cast<UINT>(((end >> m_timelineZoom) < AudioPanel::cTimelineColumns) ? (end >> m_timelineZoom) : AudioPanel::cTimelineColumns);
+    if (0 == columnCount) {
+        return;
+    }
+
+    UINT64 entryCount = static_cast<UINT64>(columnCount) << m_timelineZoom;
+    HRESULT hr = m_history.Query(0, end - entryCount, entryCount, m_energyTimeline, columnCount);
+    if (SUCCEEDED(hr)) {
+        hr = m_history.Query(1, end - entryCount, entryCount, m_angleTimeline, columnCount);
+    }
+
+    if (SUCCEEDED(hr)) {
+        m_pAudioPanel->UpdateTimeline(m_energyTimeline, m_angleTimeline, columnCount);
+    }
+}
+
+/// Show more or less history across timeline, within what history retains.
+/// <param name="bZoomIn">true to halve, false to double, history shown.</param>
+void CAudioBasics::ZoomTimeline(bool bZoomIn) {
+    if (bZoomIn) {
+        if (0 == m_timelineZoom) {
+            return;
+        }
+        --m_timelineZoom;
+    } else {
+        // Widest zoom is first one whose columns span all of retention
+        UINT64 retainedEntries = static_cast<UINT64>(iHistoryRetentionHours) * 3600 * cEnergyValuesPerSecond;
+        if ((static_cast<UINT64>(AudioPanel::cTimelineColumns) << m_timelineZoom) >= retainedEntries) {
+            return;
+        }
+        ++m_timelineZoom;
+    }
+
+    m_bTimelineChanged = true;
+    m_eventLoop.Signal(m_refreshEventId);
+
+    WCHAR szMessage[64];
+    double seconds = static_cast<double>(static_cast<UINT64>(AudioPanel::cTimelineColumns) << m_timelineZoom) / cEnergyValuesPerSecond;
+    if (seconds < 120.0) {
+        StringCchPrintfW(szMessage, _countof(szMessage), L"Timeline shows last %.1f seconds.", seconds);
+    } else if (seconds < 7200.0) {
+        StringCchPrintfW(szMessage, _countof(szMessage), L"Timeline shows last %.0f minutes.", seconds / 60.0);
+    } else {
+        StringCchPrintfW(szMessage, _countof(szMessage), L"Timeline shows last %.1f hours.", seconds / 3600.0);
+    }
+    SetStatusMessage(szMessage);
+}
+
+/// Number of captured blocks dropped, across all sensors, because processing fell behind.
+uint32_t CAudioBasics::GetCaptureOverrunCount() const {
+    uint32_t overruns = m_resultRing.GetOverrunCount();
+
+    for (UINT i = 0; i < m_captureEngine.GetSensorCount(); ++i) {
+        SensorStatus status;
+        m_captureEngine.GetSensorStatus(i, &status);
+        overruns += status.overrunCount;
+    }
+
+    return overruns;
+}
+
+/// Report p50/p99/max of latency histograms, and frames drawn/skipped, in status bar and debugger output.
+void CAudioBasics::DumpLatency() {
+    // Capture call latency is that of displayed sensor, which exists only once a source was opened
+    static const LatencyHistogram emptyHistogram;
+    const LatencyHistogram& captureCallLatency = (m_captureEngine.GetSensorCount() > iDisplayedSensor) ?
+        m_captureEngine.GetCaptureCallLatency(iDisplayedSensor) : emptyHistogram;
+
+    WCHAR szMessage[256];
+    StringCchPrintfW(szMessage, _countof(szMessage),
+        L"Capture to display: p50 %.1f ms, p99 %.1f ms, max %.1f ms. Draw p99 %.2f ms. Capture call p99 %.2f ms.",
+        m_captureToDisplayLatency.GetPercentile(50.0) / 1e6,
+        m_captureToDisplayLatency.GetPercentile(99.0) / 1e6,
+        m_captureToDisplayLatency.GetMax() / 1e6,
+        m_drawLatency.GetPercentile(99.0) / 1e6,
+        captureCallLatency.GetPercentile(99.0) / 1e6);
+    SetStatusMessage(szMessage);
+
+    // Full summary, including sample counts, for a debugger or DebugView
+    char szLine[160];
+    m_captureToDisplayLatency.Format("Capture to display", szLine, sizeof(szLine));
+    OutputDebugStringA(szLine);
+    OutputDebugStringA("\n");
+    captureCallLatency.Format("Capture call", szLine, sizeof(szLine));
+    OutputDebugStringA(szLine);
+    OutputDebugStringA("\n");
+    m_drawLatency.Format("Draw", szLine, sizeof(szLine));
+    OutputDebugStringA(szLine);
+    OutputDebugStringA("\n");
+    if (m_recorder.IsOpen()) {
+        m_recorder.GetAppendLatency().Format("Record append", szLine, sizeof(szLine));
+        OutputDebugStringA(szLine);
+        OutputDebugStringA("\n");
+        m_recorder.GetWriteLatency().Format("Record write", szLine, sizeof(szLine));
+        OutputDebugStringA(szLine);
+        OutputDebugStringA("\n");
+        StringCchPrintfA(szLine, _countof(szLine), "Record: bytes=%llu dropped=%u\n", static_cast<unsigned long long>(m_recorder.GetBytesWritten()), m_recorder.GetDroppedCount());
+        OutputDebugStringA(szLine);
+    }
+    if (m_clipCapture.IsOpen()) {
+        m_clipCapture.GetAppendLatency().Format("Clip append", szLine, sizeof(szLine));
+        OutputDebugStringA(szLine);
+        OutputDebugStringA("\n");
+        m_clipCapture.GetWriteLatency().Format("Clip write", szLine, sizeof(szLine));
+        OutputDebugStringA(szLine);
+        OutputDebugStringA("\n");
+        StringCchPrintfA(szLine, _countof(szLine), "Clips: written=%u missed=%u dropped=%u\n", m_clipCapture.GetClipCount(), m_clipCapture.GetMissedCount(), m_clipCapture.GetDroppedCount());
+        OutputDebugStringA(szLine);
+    }
+    if (m_publisher.IsOpen()) {
+        m_publisher.GetPublishLatency().Format("Broadcast publish", szLine, sizeof(szLine));
+        OutputDebugStringA(szLine);
+        OutputDebugStringA("\n");
+        StringCchPrintfA(szLine, _countof(szLine), "Broadcast: published=%llu readers=%u overruns=%llu\n", static_cast<unsigned long long>(m_publisher.GetPublishedCount()),
+            m_publisher.GetReaderCount(), static_cast<unsigned long long>(m_publisher.GetOverrunCount()));
+        OutputDebugStringA(szLine);
+    }
+    StringCchPrintfA(szLine, _countof(szLine), "Timeline: entries=%llu levels=%u memory=%u KB\n", static_cast<unsigned long long>(m_history.GetEntryCount()),
+        m_history.GetLevelCount(), static_cast<UINT>(m_history.GetMemorySize() / 1024));
+    OutputDebugStringA(szLine);
+    StringCchPrintfA(szLine, _countof(szLine), "Frames: drawn=%u skipped=%u\n", m_pAudioPanel->GetFramesDrawn(), m_pAudioPanel->GetFramesSkipped());
+    OutputDebugStringA(szLine);
+}
+
 /// Set the status bar message
 /// <param name="szMessage">message to display</param>
 void CAudioBasics::SetStatusMessage(WCHAR * szMessage) {
@@ -1,93 +1,28 @@
 ﻿#pragma once
 
 #include "AudioPanel.h"
+#include "AudioBlock.h"
+#include "AudioPipeline.h"
+#include "AudioRecorder.h"
+#include "AudioRingBuffer.h"
+#include "AudioSource.h"
+#include "CaptureEngine.h"
+#include "ClipCapture.h"
+#include "AudioBroadcast.h"
+#include "EventLoop.h"
+#include "HistoryPyramid.h"
+#include "KinectAudioSource.h"
+#include "KinectRawAudioSource.h"
+#include "LatencyHistogram.h"
+#include "MediaBuffer.h"
+#include "MediaBufferPool.h"
+#include "TraceLog.h"
 #include "resource.h"
 
-// For IMediaObject and related interfaces
-#include <dmo.h>
-
-// For configuring DMO properties
-#include <wmcodecdsp.h>
-
-// For WAVEFORMATEX
-#include <mmreg.h>
-
-// For FORMAT_WaveFormatEx and such
-#include <uuids.h>
-
-// For Kinect SDK APIs
-#include <NuiApi.h>
-
-// Format of Kinect audio stream
-static const WORD       AudioFormat = WAVE_FORMAT_PCM;
-
-// Number of channels in Kinect audio stream
-static const WORD       AudioChannels = 1;
-
-// Samples per second in Kinect audio stream
-static const DWORD      AudioSamplesPerSecond = 16000;
-
-// Average bytes per second in Kinect audio stream
-static const DWORD      AudioAverageBytesPerSecond = 32000;
-
-// Block alignment in Kinect audio stream
-static const WORD       AudioBlockAlign = 2;
-
-// Bits per audio sample in Kinect audio stream
-static const WORD       AudioBitsPerSample = 16;
-
-/// IMediaBuffer implementation for a statically allocated buffer.
-class CStaticMediaBuffer : public IMediaBuffer {
-public:
-    // Constructor
-    CStaticMediaBuffer() : m_dataLength(0) {}
-
-    // IUnknown methods
-    STDMETHODIMP_(ULONG) AddRef() { return 2; }
-    STDMETHODIMP_(ULONG) Release() { return 1; }
-    STDMETHODIMP QueryInterface(REFIID riid, void **ppv)
-    {
-        if (riid == IID_IUnknown) {
-            AddRef();
-            *ppv = (IUnknown*)this;
-            return NOERROR;
-        }
-        else if (riid == IID_IMediaBuffer) {
-            AddRef();
-            *ppv = (IMediaBuffer*)this;
-            return NOERROR;
-        }
-        else {
-            return E_NOINTERFACE;
-        }
-    }
-
-    // IMediaBuffer methods
-    STDMETHODIMP SetLength(DWORD length) {m_dataLength = length; return NOERROR;}
-    STDMETHODIMP GetMaxLength(DWORD *pMaxLength) {*pMaxLength = sizeof(m_pData); return NOERROR;}
-    STDMETHODIMP GetBufferAndLength(BYTE **ppBuffer, DWORD *pLength) {
-        if (ppBuffer) {
-            *ppBuffer = m_pData;
-        }
-        if (pLength) {
-            *pLength = m_dataLength;
-        }
-        return NOERROR;
-    }
-    void Init(ULONG ulData) {
-        m_dataLength = ulData;
-    }
-
-protected:
-    // Statically allocated buffer used to hold audio data returned by IMediaObject
-    BYTE m_pData[AudioSamplesPerSecond * AudioBlockAlign];
-
-    // Amount of data currently being held in m_pData
-    ULONG m_dataLength;
-};
-
 /// Main application class for AudioBasics sample.
-class CAudioBasics {
+/// Captures from every ready Kinect (or a subset selected on command line) through a
+/// CaptureEngine. Audio panel shows first sensor; status bar shows all of them.
+class CAudioBasics : public CaptureResultSink {
 public:
     
     /// Constructor
@@ -117,57 +52,209 @@ public:
     /// <param name="nCmdShow">whether to display minimized, maximized, or normally</param>
     int                     Run(HINSTANCE hInstance, int nCmdShow);
 
+    /// Select where audio comes from, based on command line arguments.
+    /// "-wav <file>" replays a WAV file, "-synthetic [count]" generates moving tones,
+    /// and no arguments captures from every ready Kinect. "-ns" and "-agc" select
+    /// software enhancement stages.
+    /// <param name="lpCmdLine">command line arguments.</param>
+    void                    ParseCommandLine(LPCWSTR lpCmdLine);
+
+    /// Number of captured blocks dropped, across all sensors, because processing fell behind.
+    uint32_t                GetCaptureOverrunCount() const;
+
+    /// Number of times UI was woken to display results and found none.
+    uint32_t                GetCaptureUnderrunCount() const { return m_resultRing.GetUnderrunCount(); }
+
+    /// Queue results of sensor shown in audio panel for UI thread. Called on capture engine's worker threads.
+    /// <param name="sensorIndex">index of sensor in capture engine.</param>
+    /// <param name="result">processing results for block.</param>
+    virtual void            OnBlockProcessed(UINT sensorIndex, const AudioPipelineResult& result);
+
+    /// Wake UI thread so it can report why capture stopped. Called on sensor's capture thread.
+    /// <param name="sensorIndex">index of sensor in capture engine.</param>
+    /// <param name="hr">S_OK if source finished, otherwise failure that stopped capture.</param>
+    virtual void            OnCaptureStopped(UINT sensorIndex, HRESULT hr);
+
 private:
-    // ID of timer that drives audio capture.
-    static const int        iAudioReadTimerId = 1;
+    // Number of results of displayed sensor that can wait for UI thread (about 2 seconds of audio).
+    static const int        iResultRingCapacity = 64;
+
+    // Index, in capture engine, of sensor shown in audio panel.
+    static const UINT       iDisplayedSensor = 0;
 
-    // Time interval, in milliseconds, for timer that drives audio capture.
-    static const int        iAudioReadTimerInterval = 50;
+    // Time interval, in milliseconds, between updates of per-sensor status.
+    static const UINT       iSensorStatusInterval = 1000;
 
-    // ID of timer that drives energy stream display.
-    static const int        iEnergyRefreshTimerId = 2;
+    // ID of system menu command that reports latency statistics. System menu IDs
+    // must keep their low four bits clear and stay below SC_SIZE.
+    static const UINT       iDumpLatencyCommandId = 0x0010;
 
-    // Time interval, in milliseconds, for timer that drives energy stream display.
-    static const int        iEnergyRefreshTimerInterval = 10;
+    // Hours of energy and beam angle timeline can be zoomed out over, and buckets kept at each level of its history.
+    static const UINT       iHistoryRetentionHours = 12;
+    static const UINT       iHistoryBucketsPerLevel = 2048;
+
+    // Timeline zoom shown at start, as power of two of energy values per column (about a minute across).
+    static const UINT       iDefaultTimelineZoom = 6;
 
     // Main application dialog window.
     HWND                    m_hWnd;
 
+    // Loop that dispatches window messages and runs UI work when capture thread signals it.
+    EventLoop               m_eventLoop;
+
+    // Event signaled when results are queued for display, and when panel needs repainting.
+    UINT                    m_refreshEventId;
+
     // Factory used to create Direct2D objects.
     ID2D1Factory*           m_pD2DFactory;
 
     // Object that controls displaying Kinect audio data.
     AudioPanel*             m_pAudioPanel;    
 
-    // Current Kinect sensor.
-    INuiSensor*             m_pNuiSensor;
+    // Kinect sensors being captured from.
+    INuiSensor*             m_pNuiSensors[CaptureEngine::cMaxSensors];
+    UINT                    m_nuiSensorCount;
 
-    // Audio source used to query Kinect audio beam and sound source angles.
-    INuiAudioBeam*          m_pNuiAudioSource;
+    // Kinect sensor indices to capture from, one bit per index.
+    UINT                    m_sensorMask;
 
-    // Media object from which Kinect audio stream is captured.
-    IMediaObject*           m_pDMO;
+    // Number of simulated sensors to generate synthetic audio for, instead of capturing from Kinects.
+    UINT                    m_syntheticSourceCount;
 
-    // Property store used to configure Kinect audio properties.
-    IPropertyStore*         m_pPropertyStore;
+    // WAV file to replay instead of capturing from a sensor, if not empty.
+    char                    m_szReplayFile[MAX_PATH];
 
-    // Buffer to hold captured audio data.
-    CStaticMediaBuffer      m_csmCaptureBuffer;
+    // Session file to replay, with its captured angles, instead of capturing from a sensor, if not empty.
+    char                    m_szSessionFile[MAX_PATH];
 
-    /// Create the first connected Kinect found.
-    /// <returns>S_OK on success, otherwise failure code.</returns>
-    HRESULT                 CreateFirstConnected();
+    // Binary trace file to record per-block events into, if not empty.
+    char                    m_szTraceFile[MAX_PATH];
+
+    // Recording file to save displayed sensor's audio and angles into, if not empty.
+    char                    m_szRecordFile[MAX_PATH];
+
+    // Path prefix of clip files to save around loud events and voice onsets of displayed sensor, if not empty.
+    char                    m_szClipPrefix[MAX_PATH];
+
+    // Shared memory channel to publish displayed sensor's audio and angles on for other processes, if not empty.
+    char                    m_szPublishChannel[BroadcastPublisher::cMaxNameLength];
+
+    // Mono WAV file of audio played through speakers, whose echo is cancelled from every sensor, if not empty.
+    char                    m_szReferenceFile[MAX_PATH];
+
+    // Whether to capture raw microphone array channels and beamform them in software.
+    bool                    m_bMicrophoneArray;
+
+    // AudioEnhancement flags selecting software stages every sensor's pipeline runs.
+    UINT                    m_enhancements;
+
+    // Captures and processes audio of every sensor on its own threads.
+    CaptureEngine           m_captureEngine;
+
+    // Results of displayed sensor handed from capture engine's workers to UI thread.
+    AudioRingBuffer<AudioPipelineResult, iResultRingCapacity> m_resultRing;
+
+    // Overrun count last shown in status bar. UI thread only.
+    uint32_t                m_nReportedOverruns;
+
+    // Bit set for each sensor whose capture failure was already shown in status bar. UI thread only.
+    UINT                    m_reportedFailures;
+
+    // Blocks processed by each sensor at last status update, for throughput. UI thread only.
+    UINT64                  m_lastBlocksProcessed[CaptureEngine::cMaxSensors];
+
+    // Lock-free event log written by capture, worker and UI threads.
+    TraceLog                m_traceLog;
+
+    // Saves displayed sensor's audio and angles from worker threads, writing on its own I/O thread.
+    AudioRecorder           m_recorder;
+
+    // Keeps pre-roll of displayed sensor's audio and angles, saving clips around trigger events on its own writer thread.
+    ClipCapture             m_clipCapture;
+
+    // Publishes displayed sensor's audio and angles from worker threads to local processes through shared memory.
+    BroadcastPublisher      m_publisher;
+
+    // Time from audio source returning a block to EndDraw presenting the beam angle computed from it.
+    // Recorded by UI thread only.
+    LatencyHistogram        m_captureToDisplayLatency;
+
+    // Duration of each audio panel Draw. Recorded by UI thread only.
+    LatencyHistogram        m_drawLatency;
+
+    // Recent energy values shown by oscilloscope. UI thread only.
+    EnergyHistory           m_energyHistory;
+
+    // Whether energy values were appended since oscilloscope was last updated. UI thread only.
+    bool                    m_bEnergyHistoryChanged;
+
+    // Energy values handed to audio panel on each refresh.
+    float                   m_fEnergyDisplay[AudioPanel::cEnergySamplesToDisplay];
+
+    // Energy and beam angle of every energy value since start, summarised at every zoom of timeline. UI thread only.
+    HistoryPyramid          m_history;
+
+    // Timeline zoom, as power of two of energy values per column, and whether timeline needs querying again. UI thread only.
+    UINT                    m_timelineZoom;
+    bool                    m_bTimelineChanged;
+
+    // Timeline columns handed to audio panel when history or zoom changes.
+    HistoryColumn           m_energyTimeline[AudioPanel::cTimelineColumns];
+    HistoryColumn           m_angleTimeline[AudioPanel::cTimelineColumns];
+
+    /// Open every ready Kinect selected on command line and add it to capture engine.
+    /// <returns>S_OK if at least one sensor was added, otherwise failure code.</returns>
+    HRESULT                 CreateConnectedSensors();
     
     /// Initialize Kinect audio capture/control objects.
+    /// <param name="pNuiSensor">sensor initialized for audio.</param>
+    /// <param name="ppSource">receives audio source of sensor.</param>
     /// <returns> S_OK on success, otherwise failure code.</returns>
-    HRESULT                 InitializeAudioSource();
+    HRESULT                 InitializeAudioSource(INuiSensor* pNuiSensor, AudioSource** ppSource);
+
+    /// Add a sensor's source to capture engine, cancelling echo of reference file if one was given.
+    /// <param name="pSource">audio source of sensor. Ownership passes to capture engine, even on failure.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 AddSensor(AudioSource* pSource);
+
+    /// Create audio sources selected on command line.
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 CreateAudioSources();
+
+    /// Start capture engine's capture threads and workers.
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 StartCapture();
 
-    /// Capture new audio data.
+    /// Stop capture engine and drop results not yet displayed.
+    void                    StopCapture();
+
+    /// Consume results queued by capture engine for displayed sensor.
     void                    ProcessAudio();
 
+    /// Show capture failures, dropped audio, and with several sensors their angles and throughput.
+    void                    UpdateSensorStatus();
+
+    /// Event loop timer callback that updates per-sensor status.
+    /// <param name="pContext">CAudioBasics instance that owns event loop.</param>
+    static void             SensorStatusProc(void* pContext);
+
+    /// Event loop callback that consumes queued audio and redraws audio panel.
+    /// <param name="pContext">CAudioBasics instance that owns event loop.</param>
+    static void             RefreshProc(void* pContext);
+
     /// Display latest audio data.
     void                    Update();
 
+    /// Summarise latest history at current zoom into timeline columns and hand them to audio panel.
+    void                    UpdateTimeline();
+
+    /// Show more or less history across timeline, within what history retains.
+    /// <param name="bZoomIn">true to halve, false to double, history shown.</param>
+    void                    ZoomTimeline(bool bZoomIn);
+
+    /// Report p50/p99/max of latency histograms, and frames drawn/skipped, in status bar and debugger output.
+    void                    DumpLatency();
+
     /// Set the status bar message.
     /// <param name="szMessage">message to display.</param>
     void                    SetStatusMessage(WCHAR* szMessage);
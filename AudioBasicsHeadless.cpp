@@ -0,0 +1,958 @@
+﻿// Headless batch processing entry point. Runs recorded or synthetic audio through
+// the same AudioPipeline used by the interactive application, as fast as the CPU
+// allows, and writes per-block results as CSV. Needs no display or Kinect sensor.
+//
+// Also hosts micro-benchmarks of the processing stages (-bench).
+//
+// Builds from AudioBasics-Headless.vcxproj on Windows. On Linux:
+//   g++ -O2 -std=c++11 -pthread -o AudioBasics-Headless AudioBasicsHeadless.cpp
+//       AudioBenchmarks.cpp AudioBroadcast.cpp AudioEnergy.cpp AudioPipeline.cpp AudioRecorder.cpp Beamformer.cpp
+//       BroadcastAudioSource.cpp CaptureEngine.cpp AngleTracker.cpp ClipCapture.cpp EchoCanceller.cpp
+//       EchoCancellingAudioSource.cpp EventLoop.cpp Fft.cpp HistoryPyramid.cpp LatencyHistogram.cpp MappedFile.cpp
+//       MediaBufferPool.cpp MultiSourceTracker.cpp NoiseSuppressor.cpp Resampler.cpp SampleConverter.cpp SessionAudioSource.cpp
+//       SessionFile.cpp Simd.cpp SourceLocalizer.cpp SrpPhatMap.cpp Stft.cpp SyntheticAudioSource.cpp
+//       TraceLog.cpp VoiceActivityDetector.cpp WavAudioSource.cpp WavFileWriter.cpp -lrt
+
+#include "AudioBenchmarks.h"
+#include "AudioBroadcast.h"
+#include "AudioPipeline.h"
+#include "AudioRecorder.h"
+#include "BroadcastAudioSource.h"
+#include "ClipCapture.h"
+#include "Clock.h"
+#include "EchoCancellingAudioSource.h"
+#include "EventLoop.h"
+#include "LatencyHistogram.h"
+#include "MediaBuffer.h"
+#include "Resampler.h"
+#include "SessionAudioSource.h"
+#include "SessionFile.h"
+#include "SyntheticAudioSource.h"
+#include "TraceLog.h"
+#include "WavAudioSource.h"
+#include "WavFileWriter.h"
+
+// For printf and file output
+#include <stdio.h>
+
+// For atof, atoi, strtoul and EXIT_SUCCESS
+#include <stdlib.h>
+
+// For measuring processing speed
+#include <chrono>
+
+// For resampled output buffers
+#include <vector>
+
+// Time interval, in milliseconds, between polls of a source replayed in real time.
+static const UINT cPacedPollInterval = 10;
+
+/// Print command line usage.
+static void PrintUsage() {
+    fprintf(stderr,
+        "Usage: AudioBasics-Headless (-wav <file> | -synthetic <seconds> | -session <file> [-seek <seconds>] | -subscribe <name>)\n"
+        "                            [-array] [-reference <file>] [-ns] [-agc] [-vad] [-map-threads <n>] [-resample <rates>]\n"
+        "                            [-realtime | -speed <x>] [-out <file>] [-trace <file>] [-record <file>]\n"
+        "                            [-write-session <file>] [-clips <prefix>] [-publish <name>]\n"
+        "       AudioBasics-Headless -decode-trace <file> [-out <file>]\n"
+        "       AudioBasics-Headless -decode-recording <file> [-out <file>]\n"
+        "       AudioBasics-Headless -bench <name>|all\n"
+        "  -wav <file>          process 16 kHz WAV file of 16-bit PCM, 32-bit PCM or 32-bit float samples\n"
+        "  -synthetic <seconds> process generated moving tone of given length\n"
+        "  -session <file>      replay session file, with angles captured alongside its audio\n"
+        "  -seek <seconds>      start session replay at given time\n"
+        "  -subscribe <name>    process live audio another process publishes on broadcast channel,\n"
+        "                       until it closes channel\n"
+        "  -array               treat input as raw 4-channel Kinect microphone array audio,\n"
+        "                       beamform and localize it in software\n"
+        "  -reference <file>    cancel echo of mono 16 kHz WAV file played through speakers,\n"
+        "                       time aligned with input\n"
+        "  -aec-block <samples> echo canceller block size, a power of two (default 128)\n"
+        "  -aec-tail <samples>  longest echo path echo canceller models (default 2048)\n"
+        "  -ns                  suppress noise before energy and spectrum are measured\n"
+        "  -agc                 apply automatic gain control before energy and spectrum are measured\n"
+        "  -vad                 skip localization and spectrum of blocks in which no voice is detected\n"
+        "  -map-threads <n>     split angular map of array audio across 1 to 8 threads (default 1)\n"
+        "  -resample <rates>    also resample first input channel to up to 4 comma separated rates,\n"
+        "                       such as 8000,44100,48000, each written to <prefix><rate>.wav\n"
+        "  -resample-prefix <p> path prefix of resampled WAV files (default resampled_)\n"
+        "  -resample-quality <low|medium|high>\n"
+        "                       resampling filter length, traded against CPU (default medium)\n"
+        "  -realtime            replay input at real-time rate, polled from an event loop\n"
+        "  -speed <x>           replay session at x times real time, polled from an event loop\n"
+        "  -out <file>          write CSV to file instead of stdout\n"
+        "  -trace <file>        record binary trace of per-block results and source estimates\n"
+        "  -decode-trace <file> convert binary trace file to CSV\n"
+        "  -record <file>       save input audio with beam, source and tracked angles to recording file\n"
+        "  -record-batch <ms>   span of audio recorder writes at once (default 1000)\n"
+        "  -write-session <file>\n"
+        "                       save input audio and angles to session file, for replay with -session\n"
+        "  -clips <prefix>      save clips around trigger events to session files <prefix>0000.ses,\n"
+        "                       <prefix>0001.ses and so on\n"
+        "  -clip-triggers <list>\n"
+        "                       comma separated events that trigger clips: energy, voice (needs -vad)\n"
+        "                       and angle (default energy,voice)\n"
+        "  -clip-energy <level> energy peak, 0 to 1, that triggers a clip (default 0.6)\n"
+        "  -clip-angle <deg>    tracked angle change that triggers a clip (default 20)\n"
+        "  -clip-roll <ms>,<ms> audio kept before first and after last trigger of a clip (default 3000,2000)\n"
+        "  -publish <name>      publish input audio and angles on shared memory broadcast channel for\n"
+        "                       other processes; readers keep up best with -realtime\n"
+        "  -decode-recording <file>\n"
+        "                       convert angle tracks of recording file to CSV\n"
+        "  -bench <name>        run micro-benchmark; available benchmarks:\n");
+    ListBenchmarks(stderr);
+}
+
+/// Resampler fed alongside pipeline, and the files its outputs are written to.
+struct ResampledOutputs {
+    MultiRateResampler      resampler;
+    WavFileWriter           files[MultiRateResampler::cMaxOutputs];
+    std::vector<int16_t>    samples[MultiRateResampler::cMaxOutputs];
+};
+
+/// State shared by the steps that pull audio from a source and process it.
+struct ProcessingSession {
+    AudioSource*            pSource;
+    FILE*                   pOutput;
+    TraceLog*               pTraceLog;
+
+    // Receive duration of every source Read call, and time from Read returning each block to its result being written.
+    LatencyHistogram*       pReadLatency;
+    LatencyHistogram*       pResultLatency;
+
+    // Resampled copies of input to write, or NULL.
+    ResampledOutputs*       pResampled;
+
+    // Recorder that saves input and its angles, or NULL.
+    AudioRecorder*          pRecorder;
+
+    // Clip capture that saves input around trigger events, or NULL.
+    ClipCapture*            pClipCapture;
+
+    // Publisher that broadcasts input and its angles to other processes, or NULL.
+    BroadcastPublisher*     pPublisher;
+
+    // Session file input is saved to, or NULL.
+    SessionFileWriter*      pSessionWriter;
+
+    // Source when it replays a session, whose blocks are then processed in place; otherwise NULL.
+    SessionAudioSource*     pSessionSource;
+
+    // Position in stream of first sample read, which is not 0 when replay starts part way through a session.
+    UINT64                  startPosition;
+
+    // Whether last read left more audio that can be read immediately.
+    bool                    bMoreAvailable;
+
+    CStaticMediaBuffer      captureBuffer;
+    AudioPipeline           pipeline;
+    WORD                    channelCount;
+    uint32_t                sequence;
+
+    // Loop driving session when source is paced, otherwise NULL.
+    EventLoop*              pEventLoop;
+
+    // First failure encountered, reported once session finishes.
+    HRESULT                 hr;
+};
+
+/// Resample first channel of a block to every output rate and append it to that rate's file.
+/// <param name="pResampled">resampler and files.</param>
+/// <param name="block">captured audio block.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+static HRESULT WriteResampled(ResampledOutputs* pResampled, const AudioBlock& block) {
+    int16_t* pOutputs[MultiRateResampler::cMaxOutputs];
+    UINT outputCounts[MultiRateResampler::cMaxOutputs];
+    for (UINT o = 0; o < pResampled->resampler.GetOutputCount(); ++o) {
+        pOutputs[o] = &pResampled->samples[o][0];
+    }
+
+    HRESULT hr = pResampled->resampler.Process(block.pSamples, block.sampleCount, block.channelCount, pOutputs, outputCounts);
+    for (UINT o = 0; o < pResampled->resampler.GetOutputCount() && SUCCEEDED(hr); ++o) {
+        hr = pResampled->files[o].Write(pOutputs[o], outputCounts[o]);
+    }
+
+    return hr;
+}
+
+/// Parse a list of clip trigger names.
+/// <param name="szTriggers">comma separated names: energy, voice and angle.</param>
+/// <param name="pTriggers">receives combination of ClipTrigger flags.</param>
+/// <returns>S_OK on success, E_INVALIDARG if a name is not recognized.</returns>
+static HRESULT ParseClipTriggers(const char* szTriggers, UINT* pTriggers) {
+    const char* names[] = {"energy", "voice", "angle"};
+    const UINT flags[] = {ClipTriggerEnergy, ClipTriggerVoiceOnset, ClipTriggerAngleChange};
+    *pTriggers = ClipTriggerNone;
+
+    for (const char* pNext = szTriggers; ; ++pNext) {
+        size_t length = strcspn(pNext, ",");
+        UINT n = 0;
+        while (n < sizeof(names) / sizeof(names[0]) && (strlen(names[n]) != length || 0 != strncmp(pNext, names[n], length))) {
+            ++n;
+        }
+        if (n == sizeof(names) / sizeof(names[0])) {
+            return E_INVALIDARG;
+        }
+
+        *pTriggers |= flags[n];
+        pNext += length;
+        if ('\0' == *pNext) {
+            break;
+        }
+    }
+
+    return S_OK;
+}
+
+/// Set up resampler for a list of output rates and create a WAV file for each rate.
+/// <param name="szRates">comma separated output rates, in Hz.</param>
+/// <param name="szPrefix">path prefix of files, to which rate and extension are appended.</param>
+/// <param name="quality">filter length preset.</param>
+/// <param name="pResampled">receives resampler and open files.</param>
+/// <returns>S_OK on success, E_INVALIDARG if rates are malformed or unsupported, otherwise failure code.</returns>
+static HRESULT OpenResampledOutputs(const char* szRates, const char* szPrefix, ResamplerQuality quality, ResampledOutputs* pResampled) {
+    UINT rates[MultiRateResampler::cMaxOutputs];
+    UINT rateCount = 0;
+
+    for (const char* pNext = szRates; ; ++pNext) {
+        char* pEnd = NULL;
+        unsigned long rate = strtoul(pNext, &pEnd, 10);
+        if (pEnd == pNext || rateCount == MultiRateResampler::cMaxOutputs) {
+            return E_INVALIDARG;
+        }
+
+        rates[rateCount++] = static_cast<UINT>(rate);
+        pNext = pEnd;
+        if ('\0' == *pNext) {
+            break;
+        }
+        if (',' != *pNext) {
+            return E_INVALIDARG;
+        }
+    }
+
+    HRESULT hr = pResampled->resampler.Initialize(AudioSamplesPerSecond, rates, rateCount, quality, AudioBlock::MaxSamples, GetSimdLevel());
+    for (UINT o = 0; o < rateCount && SUCCEEDED(hr); ++o) {
+        pResampled->samples[o].resize(pResampled->resampler.GetMaxOutputCount(o));
+
+        char szPath[1024];
+        snprintf(szPath, sizeof(szPath), "%s%u.wav", szPrefix, rates[o]);
+        hr = pResampled->files[o].Open(szPath, 1, rates[o]);
+        if (FAILED(hr)) {
+            fprintf(stderr, "Failed to create %s.\n", szPath);
+        }
+    }
+
+    return hr;
+}
+
+/// Read one chunk of audio from source, run it through pipeline and write one CSV line per block.
+/// <param name="pSession">session to advance.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+static HRESULT ProcessAvailableAudio(ProcessingSession* pSession) {
+    AudioAngles angles;
+    const int16_t* pSamples = NULL;
+    DWORD cSamples = 0;
+    WORD channelCount = pSession->channelCount;
+    pSession->bMoreAvailable = false;
+
+    // A session's blocks are processed straight out of its mapping; other sources read into capture buffer
+    UINT64 readStart = GetClockNanoseconds();
+    HRESULT hr = S_OK;
+    if (NULL != pSession->pSessionSource) {
+        AudioBlock view;
+        UINT64 samplePosition = 0;
+        hr = pSession->pSessionSource->ReadBlock(&view, &samplePosition, &pSession->bMoreAvailable);
+        if (S_OK == hr) {
+            angles = view.angles;
+            pSamples = view.pSamples;
+            cSamples = view.sampleCount;
+        }
+    }
+    else {
+        hr = pSession->pSource->Read(&pSession->captureBuffer, &angles, &pSession->bMoreAvailable);
+        if (S_OK == hr) {
+            BYTE* pProduced = NULL;
+            DWORD cbProduced = 0;
+            pSession->captureBuffer.GetBufferAndLength(&pProduced, &cbProduced);
+            pSamples = reinterpret_cast<const int16_t*>(pProduced);
+            cSamples = cbProduced / (AudioBlockAlign * channelCount);
+        }
+    }
+    UINT64 captureTimestamp = GetClockNanoseconds();
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    pSession->pReadLatency->Record(captureTimestamp - readStart);
+
+    if (S_FALSE == hr) {
+        return S_OK;
+    }
+
+    if (NULL != pSession->pSessionWriter) {
+        hr = pSession->pSessionWriter->Write(pSamples, cSamples, angles, captureTimestamp);
+        if (FAILED(hr)) {
+            return hr;
+        }
+    }
+
+    // Split produced audio into blocks exactly as the capture thread does
+    AudioPipelineResult result;
+    AudioBlock block;
+
+    while (cSamples > 0) {
+        DWORD cBlockSamples = (cSamples < AudioBlock::MaxSamples) ? cSamples : AudioBlock::MaxSamples;
+
+        // Blocks only borrow capture buffer for the duration of the call, so no reference is taken
+        block.sampleCount = cBlockSamples;
+        block.channelCount = channelCount;
+        block.sequence = pSession->sequence++;
+        block.angles = angles;
+        block.captureTimestamp = captureTimestamp;
+        block.pSamples = pSamples;
+        block.pBuffer = NULL;
+
+        hr = pSession->pipeline.ProcessBlock(block, &result);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        if (NULL != pSession->pResampled) {
+            hr = WriteResampled(pSession->pResampled, block);
+            if (FAILED(hr)) {
+                return hr;
+            }
+        }
+
+        if (NULL != pSession->pRecorder) {
+            hr = pSession->pRecorder->Append(block, result);
+            if (FAILED(hr)) {
+                return hr;
+            }
+        }
+
+        if (NULL != pSession->pClipCapture) {
+            hr = pSession->pClipCapture->Append(block, result);
+            if (FAILED(hr)) {
+                return hr;
+            }
+        }
+
+        if (NULL != pSession->pPublisher) {
+            hr = pSession->pPublisher->Publish(block, result);
+            if (FAILED(hr)) {
+                return hr;
+            }
+        }
+
+        pSession->pTraceLog->Write(TraceEventBlockProcessed, result.sequence,
+            result.beamAngleDegrees, result.sourceAngleDegrees, result.sourceConfidence, result.energyPeak);
+
+        for (UINT i = 0; i < result.sourceEstimateCount; ++i) {
+            pSession->pTraceLog->Write(TraceEventSourceEstimate, static_cast<uint32_t>(result.sourceEstimates[i].samplePosition),
+                result.sourceEstimates[i].angleDegrees, result.sourceEstimates[i].confidence);
+        }
+
+        pSession->pTraceLog->Write(TraceEventSourceTracked, result.sequence,
+            result.trackedAngleDegrees, result.trackedVelocityDegreesPerSecond, result.trackedUncertaintyDegrees);
+
+        for (UINT i = 0; i < result.trackCount; ++i) {
+            pSession->pTraceLog->Write(TraceEventSourceTrack, result.tracks[i].id, result.tracks[i].angleDegrees,
+                result.tracks[i].velocityDegreesPerSecond, result.tracks[i].uncertaintyDegrees, result.tracks[i].strength);
+        }
+
+        fprintf(pSession->pOutput, "%u,%.4f,%u,%.2f,%.2f,%.3f,%.3f,%.2f,%.2f,%.2f,%u",
+            result.sequence,
+            static_cast<double>(pSession->startPosition + result.samplePosition) / AudioSamplesPerSecond,
+            result.sampleCount,
+            result.beamAngleDegrees,
+            result.sourceAngleDegrees,
+            result.sourceConfidence,
+            result.energyPeak,
+            result.trackedAngleDegrees,
+            result.trackedVelocityDegreesPerSecond,
+            result.trackedUncertaintyDegrees,
+            result.trackCount);
+
+        // One angle column per possible track, oldest track first, left empty beyond track count
+        for (UINT i = 0; i < MultiSourceTracker::cMaxTracks; ++i) {
+            if (i < result.trackCount) {
+                fprintf(pSession->pOutput, ",%.2f", result.tracks[i].angleDegrees);
+            }
+            else {
+                fprintf(pSession->pOutput, ",");
+            }
+        }
+        fprintf(pSession->pOutput, "\n");
+
+        pSession->pResultLatency->Record(GetClockNanoseconds() - result.captureTimestamp);
+
+        pSamples += cBlockSamples * channelCount;
+        cSamples -= cBlockSamples;
+    }
+
+    // Source's angles are only worth querying while voice gate lets blocks through
+    pSession->pSource->SetAngleQueriesEnabled(result.bVoiceActive);
+
+    return S_OK;
+}
+
+/// Timer callback that drains audio which became due since last tick, the way the
+/// interactive application's capture thread does, and ends loop when source finishes.
+/// <param name="pContext">ProcessingSession being run.</param>
+static void ProcessingTimerProc(void* pContext) {
+    ProcessingSession* pSession = reinterpret_cast<ProcessingSession*>(pContext);
+
+    // Replay faster than real time has several blocks due every tick
+    do {
+        pSession->hr = ProcessAvailableAudio(pSession);
+    } while (SUCCEEDED(pSession->hr) && pSession->bMoreAvailable);
+
+    if (FAILED(pSession->hr) || pSession->pSource->IsFinished()) {
+        pSession->pEventLoop->Quit();
+    }
+}
+
+/// Pull all audio from source, run it through pipeline and write one CSV line per block.
+/// <param name="pSource">source to drain until it finishes.</param>
+/// <param name="bPaced">whether source produces audio in real time and must be polled from an event loop.</param>
+/// <param name="enhancements">combination of AudioEnhancement flags selecting pipeline stages to run.</param>
+/// <param name="mapThreadCount">number of threads pipeline splits angular map of array audio across.</param>
+/// <param name="pResampled">resampler whose outputs are written alongside CSV results, or NULL.</param>
+/// <param name="pRecorder">recorder that saves input and its angles, or NULL.</param>
+/// <param name="pClipCapture">clip capture that saves input around trigger events, or NULL.</param>
+/// <param name="pPublisher">publisher that broadcasts input and its angles to other processes, or NULL.</param>
+/// <param name="pSessionWriter">session file input is saved to, or NULL.</param>
+/// <param name="pSessionSource">pSource when it replays a session, whose blocks are then processed without copying; otherwise NULL.</param>
+/// <param name="pOutput">stream that receives CSV results.</param>
+/// <param name="pTraceLog">log that receives per-block trace records, if open.</param>
+/// <param name="pReadLatency">receives duration of every source Read call.</param>
+/// <param name="pResultLatency">receives time from Read returning each block to its result being written.</param>
+/// <param name="pSamplesProcessed">receives number of samples processed.</param>
+/// <param name="pGateStatistics">receives blocks voice gate skipped and time spent in gated stages.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+static HRESULT ProcessSource(AudioSource* pSource, bool bPaced, UINT enhancements, UINT mapThreadCount, ResampledOutputs* pResampled, AudioRecorder* pRecorder,
+    ClipCapture* pClipCapture, BroadcastPublisher* pPublisher, SessionFileWriter* pSessionWriter, SessionAudioSource* pSessionSource, FILE* pOutput, TraceLog* pTraceLog, LatencyHistogram* pReadLatency, LatencyHistogram* pResultLatency, UINT64* pSamplesProcessed, AudioGateStatistics* pGateStatistics) {
+    ProcessingSession session;
+    session.pSource = pSource;
+    session.pOutput = pOutput;
+    session.pTraceLog = pTraceLog;
+    session.pReadLatency = pReadLatency;
+    session.pResultLatency = pResultLatency;
+    session.pResampled = pResampled;
+    session.pRecorder = pRecorder;
+    session.pClipCapture = pClipCapture;
+    session.pPublisher = pPublisher;
+    session.pSessionWriter = pSessionWriter;
+    session.pSessionSource = pSessionSource;
+    session.startPosition = (NULL != pSessionSource) ? pSessionSource->GetPosition() : 0;
+    session.bMoreAvailable = false;
+    session.channelCount = pSource->GetChannelCount();
+    session.sequence = 0;
+    session.pEventLoop = NULL;
+    session.hr = S_OK;
+
+    HRESULT hr = session.pipeline.Initialize(session.channelCount, enhancements, mapThreadCount);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    fprintf(pOutput, "sequence,time_s,samples,beam_deg,source_deg,confidence,energy_max,tracked_deg,tracked_deg_per_s,tracked_uncertainty_deg,source_count,source1_deg,source2_deg,source3_deg\n");
+
+    if (bPaced) {
+        // Paced source must be polled; sleeping in the event loop between polls keeps process idle
+        EventLoop eventLoop;
+        session.pEventLoop = &eventLoop;
+        hr = eventLoop.Initialize();
+        if (SUCCEEDED(hr)) {
+            hr = eventLoop.AddTimer(cPacedPollInterval, ProcessingTimerProc, &session);
+        }
+        if (SUCCEEDED(hr)) {
+            hr = eventLoop.Run();
+        }
+        if (SUCCEEDED(hr)) {
+            hr = session.hr;
+        }
+    }
+    else {
+        while (SUCCEEDED(hr) && !pSource->IsFinished()) {
+            hr = ProcessAvailableAudio(&session);
+        }
+    }
+
+    *pSamplesProcessed = session.pipeline.GetSamplesProcessed();
+    *pGateStatistics = session.pipeline.GetGateStatistics();
+
+    return hr;
+}
+
+/// Entry point for headless batch processing.
+/// <param name="argc">number of command line arguments.</param>
+/// <param name="argv">command line arguments.</param>
+/// <returns>EXIT_SUCCESS on success, otherwise EXIT_FAILURE.</returns>
+int main(int argc, char* argv[]) {
+    const char* szWavFile = NULL;
+    const char* szSessionFile = NULL;
+    const char* szWriteSessionFile = NULL;
+    double seekSeconds = 0.0;
+    double speed = 0.0;
+    const char* szOutputFile = NULL;
+    const char* szBenchmark = NULL;
+    const char* szTraceFile = NULL;
+    const char* szDecodeTraceFile = NULL;
+    const char* szRecordFile = NULL;
+    const char* szDecodeRecordingFile = NULL;
+    UINT recordBatchMilliseconds = AudioRecorder::cDefaultBatchMilliseconds;
+    const char* szReferenceFile = NULL;
+    UINT echoBlockSize = EchoCanceller::cDefaultBlockSize;
+    UINT echoTailLength = EchoCanceller::cDefaultTailLength;
+    double syntheticSeconds = 0.0;
+    bool bArray = false;
+    bool bRealTime = false;
+    UINT enhancements = AudioEnhancementNone;
+    UINT mapThreadCount = 1;
+    const char* szResampleRates = NULL;
+    const char* szResamplePrefix = "resampled_";
+    ResamplerQuality resampleQuality = ResamplerQualityMedium;
+    const char* szClipPrefix = NULL;
+    ClipCaptureSettings clipSettings = ClipCapture::GetDefaultSettings();
+    const char* szSubscribeChannel = NULL;
+    const char* szPublishChannel = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (0 == strcmp(argv[i], "-wav") && i + 1 < argc) {
+            szWavFile = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-synthetic") && i + 1 < argc) {
+            syntheticSeconds = atof(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "-session") && i + 1 < argc) {
+            szSessionFile = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-seek") && i + 1 < argc) {
+            seekSeconds = atof(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "-speed") && i + 1 < argc) {
+            speed = atof(argv[++i]);
+        }
+        else if (0 == strcmp(argv[i], "-write-session") && i + 1 < argc) {
+            szWriteSessionFile = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-subscribe") && i + 1 < argc) {
+            szSubscribeChannel = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-publish") && i + 1 < argc) {
+            szPublishChannel = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-array")) {
+            bArray = true;
+        }
+        else if (0 == strcmp(argv[i], "-reference") && i + 1 < argc) {
+            szReferenceFile = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-aec-block") && i + 1 < argc) {
+            echoBlockSize = static_cast<UINT>(atoi(argv[++i]));
+        }
+        else if (0 == strcmp(argv[i], "-aec-tail") && i + 1 < argc) {
+            echoTailLength = static_cast<UINT>(atoi(argv[++i]));
+        }
+        else if (0 == strcmp(argv[i], "-ns")) {
+            enhancements |= AudioEnhancementNoiseSuppression;
+        }
+        else if (0 == strcmp(argv[i], "-agc")) {
+            enhancements |= AudioEnhancementAutomaticGain;
+        }
+        else if (0 == strcmp(argv[i], "-vad")) {
+            enhancements |= AudioEnhancementVoiceGate;
+        }
+        else if (0 == strcmp(argv[i], "-map-threads") && i + 1 < argc) {
+            mapThreadCount = static_cast<UINT>(atoi(argv[++i]));
+        }
+        else if (0 == strcmp(argv[i], "-resample") && i + 1 < argc) {
+            szResampleRates = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-resample-prefix") && i + 1 < argc) {
+            szResamplePrefix = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-resample-quality") && i + 1 < argc) {
+            const char* szQuality = argv[++i];
+            if (0 == strcmp(szQuality, "low")) {
+                resampleQuality = ResamplerQualityLow;
+            }
+            else if (0 == strcmp(szQuality, "high")) {
+                resampleQuality = ResamplerQualityHigh;
+            }
+            else if (0 == strcmp(szQuality, "medium")) {
+                resampleQuality = ResamplerQualityMedium;
+            }
+            else {
+                PrintUsage();
+                return EXIT_FAILURE;
+            }
+        }
+        else if (0 == strcmp(argv[i], "-realtime")) {
+            bRealTime = true;
+        }
+        else if (0 == strcmp(argv[i], "-out") && i + 1 < argc) {
+            szOutputFile = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-trace") && i + 1 < argc) {
+            szTraceFile = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-decode-trace") && i + 1 < argc) {
+            szDecodeTraceFile = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-record") && i + 1 < argc) {
+            szRecordFile = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-record-batch") && i + 1 < argc) {
+            recordBatchMilliseconds = static_cast<UINT>(atoi(argv[++i]));
+        }
+        else if (0 == strcmp(argv[i], "-clips") && i + 1 < argc) {
+            szClipPrefix = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-clip-triggers") && i + 1 < argc) {
+            if (FAILED(ParseClipTriggers(argv[++i], &clipSettings.triggers))) {
+                PrintUsage();
+                return EXIT_FAILURE;
+            }
+        }
+        else if (0 == strcmp(argv[i], "-clip-energy") && i + 1 < argc) {
+            clipSettings.energyThreshold = static_cast<float>(atof(argv[++i]));
+        }
+        else if (0 == strcmp(argv[i], "-clip-angle") && i + 1 < argc) {
+            clipSettings.angleChangeDegrees = static_cast<float>(atof(argv[++i]));
+        }
+        else if (0 == strcmp(argv[i], "-clip-roll") && i + 1 < argc) {
+            unsigned int preRoll = 0;
+            unsigned int postRoll = 0;
+            if (2 != sscanf(argv[++i], "%u,%u", &preRoll, &postRoll)) {
+                PrintUsage();
+                return EXIT_FAILURE;
+            }
+            clipSettings.preRollMilliseconds = preRoll;
+            clipSettings.postRollMilliseconds = postRoll;
+        }
+        else if (0 == strcmp(argv[i], "-decode-recording") && i + 1 < argc) {
+            szDecodeRecordingFile = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-bench") && i + 1 < argc) {
+            szBenchmark = argv[++i];
+        }
+        else {
+            PrintUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (NULL != szBenchmark) {
+        HRESULT hr = RunBenchmark(szBenchmark, stdout);
+        if (E_INVALIDARG == hr) {
+            PrintUsage();
+        }
+        return SUCCEEDED(hr) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (NULL != szDecodeTraceFile || NULL != szDecodeRecordingFile) {
+        FILE* pOutput = (NULL != szOutputFile) ? fopen(szOutputFile, "w") : stdout;
+        if (NULL == pOutput) {
+            fprintf(stderr, "Failed to create %s.\n", szOutputFile);
+            return EXIT_FAILURE;
+        }
+
+        const char* szDecodeFile = (NULL != szDecodeTraceFile) ? szDecodeTraceFile : szDecodeRecordingFile;
+        HRESULT hr = (NULL != szDecodeTraceFile) ? DecodeTraceFile(szDecodeFile, pOutput) : DecodeRecordingFile(szDecodeFile, pOutput);
+        if (stdout != pOutput) {
+            fclose(pOutput);
+        }
+
+        if (FAILED(hr)) {
+            fprintf(stderr, "Failed to decode %s.\n", szDecodeFile);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    // Exactly one input; seeking and replay speed only apply to sessions
+    int inputCount = (NULL != szWavFile) + (syntheticSeconds > 0.0) + (NULL != szSessionFile) + (NULL != szSubscribeChannel);
+    if (1 != inputCount || (NULL == szSessionFile && (0.0 != seekSeconds || 0.0 != speed)) || seekSeconds < 0.0 || speed < 0.0 || (bRealTime && 0.0 != speed)) {
+        PrintUsage();
+        return EXIT_FAILURE;
+    }
+
+    // Broadcast channel is live, so is polled like any paced source
+    bool bPaced = bRealTime || speed > 0.0 || NULL != szSubscribeChannel;
+
+    // Replay sources run unpaced so processing goes as fast as the CPU allows, unless asked otherwise
+    AudioSource* pSource = NULL;
+    SessionAudioSource* pSessionSource = NULL;
+    BroadcastAudioSource* pBroadcastSource = NULL;
+    if (NULL != szSubscribeChannel) {
+        pBroadcastSource = new BroadcastAudioSource();
+        pSource = pBroadcastSource;
+        if (FAILED(pBroadcastSource->Open(szSubscribeChannel))) {
+            fprintf(stderr, "Failed to attach to broadcast channel %s. A 16 kHz channel of that name must be open, with a reader slot free.\n", szSubscribeChannel);
+            delete pSource;
+            return EXIT_FAILURE;
+        }
+    }
+    else if (NULL != szSessionFile) {
+        pSessionSource = new SessionAudioSource(bRealTime ? 1.0 : speed);
+        pSource = pSessionSource;
+        if (FAILED(pSessionSource->Open(szSessionFile))) {
+            fprintf(stderr, "Failed to open %s. File must be a 16 kHz session file.\n", szSessionFile);
+            delete pSource;
+            return EXIT_FAILURE;
+        }
+        pSessionSource->Seek(static_cast<UINT64>(seekSeconds * AudioSamplesPerSecond));
+    }
+    else if (NULL != szWavFile) {
+        WavAudioSource* pWavSource = new WavAudioSource(bRealTime, bArray);
+        pSource = pWavSource;
+        if (FAILED(pWavSource->Open(szWavFile))) {
+            fprintf(stderr, "Failed to open %s. File must hold 16 kHz 16-bit PCM.\n", szWavFile);
+            delete pSource;
+            return EXIT_FAILURE;
+        }
+    }
+    else {
+        MicrophoneArrayGeometry geometry = GetKinectArrayGeometry();
+        pSource = new SyntheticAudioSource(bRealTime, static_cast<UINT64>(syntheticSeconds * AudioSamplesPerSecond), bArray ? &geometry : NULL);
+    }
+
+    // Reference is read as fast as input demands, so it stays aligned however input is paced
+    EchoCancellingAudioSource* pEchoSource = NULL;
+    if (NULL != szReferenceFile) {
+        WavAudioSource* pReferenceSource = new WavAudioSource(false, false);
+        HRESULT hr = pReferenceSource->Open(szReferenceFile);
+
+        pEchoSource = new EchoCancellingAudioSource(pSource, pReferenceSource);
+        pSource = pEchoSource;
+
+        // Session's blocks now reach pipeline through echo canceller, so they can't be processed in place
+        pSessionSource = NULL;
+        if (SUCCEEDED(hr)) {
+            hr = pEchoSource->Initialize(echoBlockSize, echoTailLength, GetSimdLevel());
+        }
+
+        if (FAILED(hr)) {
+            fprintf(stderr, "Failed to set up echo cancellation with %s. File must hold 16 kHz 16-bit PCM, and block and tail sizes must be supported.\n", szReferenceFile);
+            delete pSource;
+            return EXIT_FAILURE;
+        }
+    }
+
+    FILE* pOutput = stdout;
+    if (NULL != szOutputFile) {
+        pOutput = fopen(szOutputFile, "w");
+        if (NULL == pOutput) {
+            fprintf(stderr, "Failed to create %s.\n", szOutputFile);
+            delete pSource;
+            return EXIT_FAILURE;
+        }
+    }
+
+    TraceLog traceLog;
+    if (NULL != szTraceFile && FAILED(traceLog.Open(szTraceFile))) {
+        fprintf(stderr, "Failed to create %s.\n", szTraceFile);
+        if (stdout != pOutput) {
+            fclose(pOutput);
+        }
+        delete pSource;
+        return EXIT_FAILURE;
+    }
+
+    ResampledOutputs* pResampled = NULL;
+    if (NULL != szResampleRates) {
+        pResampled = new ResampledOutputs();
+        if (FAILED(OpenResampledOutputs(szResampleRates, szResamplePrefix, resampleQuality, pResampled))) {
+            fprintf(stderr, "Failed to set up resampling to %s. Rates must be %u to %u Hz, differ from one another, and number at most %u.\n",
+                szResampleRates, PolyphaseResampler::cMinSampleRate, PolyphaseResampler::cMaxSampleRate, MultiRateResampler::cMaxOutputs);
+            delete pResampled;
+            traceLog.Close();
+            if (stdout != pOutput) {
+                fclose(pOutput);
+            }
+            delete pSource;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Offline input must not lose blocks, so recorder waits for disk instead of dropping, unless paced
+    AudioRecorder recorder;
+    if (NULL != szRecordFile && FAILED(recorder.Open(szRecordFile, pSource->GetChannelCount(), AudioSamplesPerSecond, recordBatchMilliseconds, !bPaced))) {
+        fprintf(stderr, "Failed to create %s. Batch must be %u to %u ms.\n", szRecordFile,
+            AudioRecorder::cMinBatchMilliseconds, AudioRecorder::cMaxBatchMilliseconds);
+        delete pResampled;
+        traceLog.Close();
+        if (stdout != pOutput) {
+            fclose(pOutput);
+        }
+        delete pSource;
+        return EXIT_FAILURE;
+    }
+
+    SessionFileWriter sessionWriter;
+    if (NULL != szWriteSessionFile && FAILED(sessionWriter.Open(szWriteSessionFile, pSource->GetChannelCount(), AudioSamplesPerSecond))) {
+        fprintf(stderr, "Failed to create %s.\n", szWriteSessionFile);
+        recorder.Close();
+        delete pResampled;
+        traceLog.Close();
+        if (stdout != pOutput) {
+            fclose(pOutput);
+        }
+        delete pSource;
+        return EXIT_FAILURE;
+    }
+
+    // Like recorder, clip capture waits for its writer on offline input rather than lose blocks
+    ClipCapture clipCapture;
+    if (NULL != szClipPrefix && FAILED(clipCapture.Open(szClipPrefix, pSource->GetChannelCount(), AudioSamplesPerSecond, clipSettings, !bPaced))) {
+        fprintf(stderr, "Failed to start clip capture to %s. Pre-roll must be at most %u ms.\n", szClipPrefix, ClipCapture::cMaxPreRollMilliseconds);
+        sessionWriter.Close();
+        recorder.Close();
+        delete pResampled;
+        traceLog.Close();
+        if (stdout != pOutput) {
+            fclose(pOutput);
+        }
+        delete pSource;
+        return EXIT_FAILURE;
+    }
+
+    // Publisher never waits for readers: offline input outruns any that do not keep up, and they skip ahead
+    BroadcastPublisher publisher;
+    if (NULL != szPublishChannel && FAILED(publisher.Open(szPublishChannel, pSource->GetChannelCount(), AudioSamplesPerSecond, BroadcastPublisher::cDefaultSlotCount))) {
+        fprintf(stderr, "Failed to open broadcast channel %s. Name must be at most %u letters, digits, '-', '_' or '.', and not in use.\n",
+            szPublishChannel, BroadcastPublisher::cMaxNameLength - 1);
+        clipCapture.Close();
+        sessionWriter.Close();
+        recorder.Close();
+        delete pResampled;
+        traceLog.Close();
+        if (stdout != pOutput) {
+            fclose(pOutput);
+        }
+        delete pSource;
+        return EXIT_FAILURE;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    UINT64 samplesProcessed = 0;
+    LatencyHistogram readLatency;
+    LatencyHistogram resultLatency;
+    AudioGateStatistics gateStatistics;
+    memset(&gateStatistics, 0, sizeof(gateStatistics));
+    HRESULT hr = ProcessSource(pSource, bPaced, enhancements, mapThreadCount, pResampled, recorder.IsOpen() ? &recorder : NULL,
+        clipCapture.IsOpen() ? &clipCapture : NULL, publisher.IsOpen() ? &publisher : NULL, (NULL != szWriteSessionFile) ? &sessionWriter : NULL, pSessionSource, pOutput, &traceLog, &readLatency, &resultLatency, &samplesProcessed, &gateStatistics);
+
+    traceLog.Close();
+    HRESULT hrRecord = recorder.Close();
+    hr = SUCCEEDED(hr) ? hrRecord : hr;
+    HRESULT hrSession = sessionWriter.Close();
+    hr = SUCCEEDED(hr) ? hrSession : hr;
+    HRESULT hrClips = clipCapture.Close();
+    hr = SUCCEEDED(hr) ? hrClips : hr;
+
+    // Reader table goes away with channel, so it is read first
+    UINT publishReaderCount = publisher.GetReaderCount();
+    UINT64 publishOverruns = publisher.GetOverrunCount();
+    publisher.Close();
+    for (UINT o = 0; NULL != pResampled && o < pResampled->resampler.GetOutputCount(); ++o) {
+        HRESULT hrClose = pResampled->files[o].Close();
+        hr = SUCCEEDED(hr) ? hrClose : hr;
+    }
+
+    if (traceLog.GetDroppedCount() > 0) {
+        fprintf(stderr, "Trace log dropped %u records.\n", traceLog.GetDroppedCount());
+    }
+
+    double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double audioSeconds = static_cast<double>(samplesProcessed) / AudioSamplesPerSecond;
+    float echoReductionDb = (NULL != pEchoSource) ? pEchoSource->GetEchoReturnLossEnhancementDb() : 0.0f;
+
+    // Subscription's figures go with its source
+    char szDeliveryLatency[160];
+    UINT64 subscribeOverruns = 0;
+    if (NULL != pBroadcastSource) {
+        pBroadcastSource->GetReader().GetDeliveryLatency().Format("Broadcast delivery", szDeliveryLatency, sizeof(szDeliveryLatency));
+        subscribeOverruns = pBroadcastSource->GetReader().GetOverrunCount();
+    }
+
+    if (stdout != pOutput) {
+        fclose(pOutput);
+    }
+    delete pSource;
+
+    if (FAILED(hr)) {
+        fprintf(stderr, "Processing failed (0x%08X).\n", static_cast<unsigned int>(hr));
+        delete pResampled;
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "Processed %.1f s of audio in %.3f s (%.0fx real time).\n",
+        audioSeconds, elapsedSeconds, (elapsedSeconds > 0.0) ? audioSeconds / elapsedSeconds : 0.0);
+
+    char szLatency[160];
+    readLatency.Format("Source read", szLatency, sizeof(szLatency));
+    fprintf(stderr, "%s\n", szLatency);
+    resultLatency.Format("Read to result", szLatency, sizeof(szLatency));
+    fprintf(stderr, "%s\n", szLatency);
+
+    if (NULL != pEchoSource) {
+        fprintf(stderr, "Echo return loss enhancement %.1f dB.\n", echoReductionDb);
+    }
+
+    if (0 != (enhancements & AudioEnhancementVoiceGate) && gateStatistics.blockCount > 0) {
+        fprintf(stderr, "Voice gate skipped %llu of %llu blocks (%.1f%%), saving about %.1f ms of localization and analysis.\n",
+            static_cast<unsigned long long>(gateStatistics.skippedCount), static_cast<unsigned long long>(gateStatistics.blockCount),
+            100.0 * gateStatistics.skippedCount / gateStatistics.blockCount, gateStatistics.GetSavedNanoseconds() / 1e6);
+    }
+
+    for (UINT o = 0; NULL != pResampled && o < pResampled->resampler.GetOutputCount(); ++o) {
+        const PolyphaseResampler& resampler = pResampled->resampler.GetResampler(o);
+        fprintf(stderr, "Resampled to %u Hz: %llu samples, %u taps per output, latency %u samples.\n", resampler.GetOutputRate(),
+            static_cast<unsigned long long>(pResampled->files[o].GetFramesWritten()), resampler.GetTapCount(), resampler.GetLatency());
+    }
+    delete pResampled;
+
+    if (NULL != szRecordFile) {
+        fprintf(stderr, "Recorded %.1f MB to %s, %u blocks dropped.\n", recorder.GetBytesWritten() / 1e6, szRecordFile, recorder.GetDroppedCount());
+        recorder.GetAppendLatency().Format("Record append", szLatency, sizeof(szLatency));
+        fprintf(stderr, "%s\n", szLatency);
+        recorder.GetWriteLatency().Format("Record write", szLatency, sizeof(szLatency));
+        fprintf(stderr, "%s\n", szLatency);
+    }
+
+    if (NULL != szClipPrefix) {
+        const std::vector<ClipInfo>& clips = clipCapture.GetClips();
+        for (size_t c = 0; c < clips.size(); ++c) {
+            fprintf(stderr, "Clip %s%04u.ses: %.2f s from %.2f s, triggered at %.2f s by%s%s%s, %u blocks dropped.\n", szClipPrefix, clips[c].number,
+                static_cast<double>(clips[c].frameCount) / AudioSamplesPerSecond, static_cast<double>(clips[c].firstSample) / AudioSamplesPerSecond,
+                static_cast<double>(clips[c].triggerSample) / AudioSamplesPerSecond,
+                (clips[c].triggers & ClipTriggerEnergy) ? " energy" : "", (clips[c].triggers & ClipTriggerVoiceOnset) ? " voice" : "",
+                (clips[c].triggers & ClipTriggerAngleChange) ? " angle" : "", clips[c].droppedBlocks);
+        }
+        fprintf(stderr, "Saved %u clips, %u triggers missed.\n", clipCapture.GetClipCount(), clipCapture.GetMissedCount());
+        clipCapture.GetAppendLatency().Format("Clip append", szLatency, sizeof(szLatency));
+        fprintf(stderr, "%s\n", szLatency);
+        clipCapture.GetWriteLatency().Format("Clip write", szLatency, sizeof(szLatency));
+        fprintf(stderr, "%s\n", szLatency);
+    }
+
+    if (NULL != szSubscribeChannel) {
+        fprintf(stderr, "Subscribed to %s, %llu blocks lost to overruns.\n", szSubscribeChannel, static_cast<unsigned long long>(subscribeOverruns));
+        fprintf(stderr, "%s\n", szDeliveryLatency);
+    }
+
+    if (NULL != szPublishChannel) {
+        fprintf(stderr, "Published %llu blocks to %s. Readers attached at end: %u, blocks they lost to overruns: %llu.\n",
+            static_cast<unsigned long long>(publisher.GetPublishedCount()), szPublishChannel, publishReaderCount, static_cast<unsigned long long>(publishOverruns));
+        publisher.GetPublishLatency().Format("Broadcast publish", szLatency, sizeof(szLatency));
+        fprintf(stderr, "%s\n", szLatency);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,3357 @@
+﻿#include "AudioBenchmarks.h"
+#include "AngleTracker.h"
+#include "AudioBroadcast.h"
+#include "AudioEnergy.h"
+#include "AudioPipeline.h"
+#include "AudioRecorder.h"
+#include "Beamformer.h"
+#include "CaptureEngine.h"
+#include "ClipCapture.h"
+#include "Clock.h"
+#include "EchoCanceller.h"
+#include "EventLoop.h"
+#include "Fft.h"
+#include "HistoryPyramid.h"
+#include "LatencyHistogram.h"
+#include "MediaBuffer.h"
+#include "NoiseSuppressor.h"
+#include "Resampler.h"
+#include "SampleConverter.h"
+#include "SessionAudioSource.h"
+#include "SourceLocalizer.h"
+#include "SrpPhatMap.h"
+#include "Stft.h"
+#include "SyntheticAudioSource.h"
+#include "TraceLog.h"
+#include "VoiceActivityDetector.h"
+
+// For timing benchmark loops
+#include <chrono>
+
+// For sample storage
+#include <vector>
+
+// For event loop signaling thread
+#include <atomic>
+#include <thread>
+
+// For formatting comparison in trace benchmark
+#include <sstream>
+
+// For abs
+#include <stdlib.h>
+
+// For fabs, log10 and M_PI
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#ifndef _WIN32
+// For errno
+#include <errno.h>
+
+// For fork, _exit and waitpid in broadcast benchmark
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Length, in seconds, of synthetic audio benchmarks run over.
+static const UINT cBenchmarkAudioSeconds = 60;
+
+/// Measures wall-clock time of a benchmark loop.
+class BenchmarkTimer {
+public:
+    BenchmarkTimer() : m_start(std::chrono::steady_clock::now()) {}
+
+    /// Seconds elapsed since construction.
+    double GetElapsedSeconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+};
+
+/// Fill vector with synthetic moving-tone audio.
+/// <param name="seconds">length of audio to generate.</param>
+/// <param name="pGeometry">microphone array to simulate, or NULL for mono audio.</param>
+/// <param name="samples">receives generated samples, interleaved if there is more than one microphone.</param>
+static void GenerateBenchmarkAudio(UINT seconds, const MicrophoneArrayGeometry* pGeometry, std::vector<int16_t>& samples) {
+    SyntheticAudioSource source(false, static_cast<UINT64>(seconds) * AudioSamplesPerSecond, pGeometry);
+    CStaticMediaBuffer buffer;
+
+    samples.clear();
+    samples.reserve(seconds * AudioSamplesPerSecond * source.GetChannelCount());
+
+    while (!source.IsFinished()) {
+        AudioAngles angles;
+        bool bMoreAvailable = false;
+        if (S_OK != source.Read(&buffer, &angles, &bMoreAvailable)) {
+            break;
+        }
+
+        BYTE* pData = NULL;
+        DWORD cbData = 0;
+        buffer.GetBufferAndLength(&pData, &cbData);
+
+        const int16_t* pSamples = reinterpret_cast<const int16_t*>(pData);
+        samples.insert(samples.end(), pSamples, pSamples + cbData / AudioBlockAlign);
+    }
+}
+
+/// Compare SIMD sum-of-squares kernels with scalar version, then measure complete
+/// energy calculation at 16 kHz.
+static HRESULT BenchmarkEnergy(FILE* pOutput) {
+    const UINT windowSize = EnergyCalculator::cAudioSamplesPerEnergySample;
+    const UINT repetitions = 20;
+
+    std::vector<int16_t> samples;
+    GenerateBenchmarkAudio(cBenchmarkAudioSeconds, NULL, samples);
+
+    UINT windowCount = static_cast<UINT>(samples.size() / windowSize);
+    std::vector<UINT64> sums(windowCount);
+    std::vector<UINT64> referenceSums(windowCount);
+    double totalSamples = static_cast<double>(windowCount) * windowSize * repetitions;
+
+    fprintf(pOutput, "energy: %u s of 16 kHz audio x %u, window %u samples, cpu supports %s\n",
+        cBenchmarkAudioSeconds, repetitions, windowSize, GetSimdLevelName(GetSimdLevel()));
+
+    double scalarSeconds = 0.0;
+    for (int level = SimdLevelScalar; level <= GetSimdLevel(); ++level) {
+        BenchmarkTimer timer;
+        for (UINT r = 0; r < repetitions; ++r) {
+            SumSquaresWindows(static_cast<SimdLevel>(level), &samples[0], windowSize, windowCount, &sums[0]);
+        }
+        double seconds = timer.GetElapsedSeconds();
+
+        if (SimdLevelScalar == level) {
+            scalarSeconds = seconds;
+            referenceSums = sums;
+        }
+
+        bool bMatches = (sums == referenceSums);
+        fprintf(pOutput, "  sum-of-squares %-6s %8.1f Msamples/s  %5.2fx scalar  %s\n",
+            GetSimdLevelName(static_cast<SimdLevel>(level)),
+            totalSamples / seconds / 1e6,
+            scalarSeconds / seconds,
+            bMatches ? "matches scalar" : "MISMATCH");
+
+        if (!bMatches) {
+            return E_FAIL;
+        }
+    }
+
+    // Complete energy calculation, including log and noise floor, fed in capture-sized blocks
+    EnergyCalculator calculator(0.2f, GetSimdLevel());
+    float energy[AudioBlock::MaxSamples / EnergyCalculator::cAudioSamplesPerEnergySample + 1];
+    BenchmarkTimer timer;
+    for (UINT r = 0; r < repetitions; ++r) {
+        for (size_t i = 0; i + AudioBlock::MaxSamples <= samples.size(); i += AudioBlock::MaxSamples) {
+            calculator.Process(&samples[i], AudioBlock::MaxSamples, energy);
+        }
+    }
+    double seconds = timer.GetElapsedSeconds();
+    double audioSeconds = static_cast<double>(cBenchmarkAudioSeconds) * repetitions;
+
+    fprintf(pOutput, "  log-energy     %-6s %8.1f Msamples/s  %.0fx real time per channel\n",
+        GetSimdLevelName(GetSimdLevel()),
+        audioSeconds * AudioSamplesPerSecond / seconds / 1e6,
+        audioSeconds / seconds);
+
+    return S_OK;
+}
+
+/// Measure delay-and-sum beamformer speed at each instruction set level, check SIMD
+/// kernels against scalar version, and check that loudest beam tracks the simulated
+/// source in synthetic 4-channel Kinect array audio.
+static HRESULT BenchmarkBeamformer(FILE* pOutput) {
+    const UINT beamCount = 11;
+    const float beamExtent = 50.0f;
+    const UINT frameCount = AudioBlock::MaxSamples;
+
+    MicrophoneArrayGeometry geometry = GetKinectArrayGeometry();
+    const UINT channels = geometry.microphoneCount;
+
+    std::vector<int16_t> samples;
+    GenerateBenchmarkAudio(cBenchmarkAudioSeconds, &geometry, samples);
+    UINT blockCount = static_cast<UINT>(samples.size() / (channels * frameCount));
+
+    float beamAngles[beamCount];
+    for (UINT b = 0; b < beamCount; ++b) {
+        beamAngles[b] = -beamExtent + 2.0f * beamExtent * b / (beamCount - 1);
+    }
+    const float beamStep = beamAngles[1] - beamAngles[0];
+
+    std::vector<float> beamOutput(beamCount * frameCount);
+    float* pBeamOutputs[beamCount];
+    for (UINT b = 0; b < beamCount; ++b) {
+        pBeamOutputs[b] = &beamOutput[b * frameCount];
+    }
+
+    // Beam outputs of every block from scalar run, used to check SIMD runs
+    std::vector<float> referenceOutput(static_cast<size_t>(blockCount) * beamCount * frameCount);
+
+    fprintf(pOutput, "beamformer: %u s of 16 kHz %u-channel audio, %u beams, %u-tap fractional delay, cpu supports %s\n",
+        cBenchmarkAudioSeconds, channels, beamCount, DelayAndSumBeamformer::cFilterTaps, GetSimdLevelName(GetSimdLevel()));
+
+    for (int level = SimdLevelScalar; level <= GetSimdLevel(); ++level) {
+        DelayAndSumBeamformer beamformer;
+        HRESULT hr = beamformer.Initialize(geometry, AudioSamplesPerSecond, beamAngles, beamCount, frameCount, static_cast<SimdLevel>(level));
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        // Time beamformer alone, then replay to check outputs and direction finding
+        BenchmarkTimer timer;
+        for (UINT block = 0; block < blockCount; ++block) {
+            beamformer.Process(&samples[static_cast<size_t>(block) * channels * frameCount], frameCount, pBeamOutputs);
+        }
+        double seconds = timer.GetElapsedSeconds();
+
+        beamformer.Reset();
+        float maxError = 0.0f;
+        UINT toneBlocks = 0;
+        UINT correctBlocks = 0;
+
+        for (UINT block = 0; block < blockCount; ++block) {
+            beamformer.Process(&samples[static_cast<size_t>(block) * channels * frameCount], frameCount, pBeamOutputs);
+
+            float* pReference = &referenceOutput[static_cast<size_t>(block) * beamCount * frameCount];
+            for (UINT i = 0; i < beamCount * frameCount; ++i) {
+                if (SimdLevelScalar == level) {
+                    pReference[i] = beamOutput[i];
+                }
+                float error = static_cast<float>(fabs(beamOutput[i] - pReference[i]));
+                maxError = (error > maxError) ? error : maxError;
+            }
+
+            UINT64 position = static_cast<UINT64>(block) * frameCount;
+            if (!SyntheticAudioSource::IsToneOn(position)) {
+                continue;
+            }
+
+            UINT loudestBeam = 0;
+            double loudestPower = 0.0;
+            for (UINT b = 0; b < beamCount; ++b) {
+                double power = 0.0;
+                for (UINT i = 0; i < frameCount; ++i) {
+                    power += pBeamOutputs[b][i] * pBeamOutputs[b][i];
+                }
+                if (power > loudestPower) {
+                    loudestPower = power;
+                    loudestBeam = b;
+                }
+            }
+
+            // Correct when loudest beam is the one nearest the simulated source
+            double sourceDegrees = SyntheticAudioSource::GetSourceAngle(position) * 180.0 / M_PI;
+            ++toneBlocks;
+            if (fabs(beamAngles[loudestBeam] - sourceDegrees) <= 0.5 * beamStep + 0.01) {
+                ++correctBlocks;
+            }
+        }
+
+        // Tolerate rounding differences from FMA and summation order, far below one PCM step
+        bool bMatches = (maxError < 0.01f);
+        double audioSeconds = static_cast<double>(blockCount) * frameCount / AudioSamplesPerSecond;
+        fprintf(pOutput, "  delay-and-sum  %-6s %8.0fx real time  loudest beam correct %5.1f%%  %s\n",
+            GetSimdLevelName(static_cast<SimdLevel>(level)),
+            audioSeconds / seconds,
+            (toneBlocks > 0) ? 100.0 * correctBlocks / toneBlocks : 0.0,
+            bMatches ? "matches scalar" : "MISMATCH");
+
+        if (!bMatches) {
+            return E_FAIL;
+        }
+    }
+
+    return S_OK;
+}
+
+/// Measure GCC-PHAT localizer speed, and its accuracy and confidence on synthetic
+/// 4-channel Kinect array audio whose source angle is known.
+static HRESULT BenchmarkLocalizer(FILE* pOutput) {
+    const UINT frameCount = AudioBlock::MaxSamples;
+
+    MicrophoneArrayGeometry geometry = GetKinectArrayGeometry();
+    const UINT channels = geometry.microphoneCount;
+
+    std::vector<int16_t> samples;
+    GenerateBenchmarkAudio(cBenchmarkAudioSeconds, &geometry, samples);
+    UINT blockCount = static_cast<UINT>(samples.size() / (channels * frameCount));
+
+    GccPhatLocalizer localizer;
+    HRESULT hr = localizer.Initialize(geometry, AudioSamplesPerSecond);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    std::vector<SourceEstimate> estimates(blockCount * GccPhatLocalizer::cMaxEstimatesPerBlock);
+    UINT estimateCount = 0;
+
+    BenchmarkTimer timer;
+    for (UINT block = 0; block < blockCount; ++block) {
+        estimateCount += localizer.Process(&samples[static_cast<size_t>(block) * channels * frameCount], frameCount,
+            &estimates[estimateCount], NULL, GccPhatLocalizer::cMaxEstimatesPerBlock);
+    }
+    double seconds = timer.GetElapsedSeconds();
+    double audioSeconds = static_cast<double>(blockCount) * frameCount / AudioSamplesPerSecond;
+
+    // Score estimates whose whole analysis frame lies within one tone burst against angle at frame center
+    double errorSum = 0.0;
+    double maxError = 0.0;
+    double toneConfidenceSum = 0.0;
+    double silenceConfidenceSum = 0.0;
+    UINT toneCount = 0;
+    UINT silenceCount = 0;
+
+    for (UINT i = 0; i < estimateCount; ++i) {
+        UINT64 end = estimates[i].samplePosition;
+        UINT64 start = end - GccPhatLocalizer::cFrameSize;
+        bool bToneOn = SyntheticAudioSource::IsToneOn(start) && SyntheticAudioSource::IsToneOn(end - 1);
+
+        if (bToneOn) {
+            double expected = SyntheticAudioSource::GetSourceAngle((start + end) / 2) * 180.0 / M_PI;
+            double error = fabs(estimates[i].angleDegrees - expected);
+            errorSum += error;
+            maxError = (error > maxError) ? error : maxError;
+            toneConfidenceSum += estimates[i].confidence;
+            ++toneCount;
+        }
+        else if (!SyntheticAudioSource::IsToneOn(start) && !SyntheticAudioSource::IsToneOn(end - 1)) {
+            silenceConfidenceSum += estimates[i].confidence;
+            ++silenceCount;
+        }
+    }
+
+    fprintf(pOutput, "localizer: %u s of 16 kHz %u-channel audio, GCC-PHAT, frame %u, hop %u, FFT %u\n",
+        cBenchmarkAudioSeconds, channels, GccPhatLocalizer::cFrameSize, GccPhatLocalizer::cHopSize, GccPhatLocalizer::cFftSize);
+    fprintf(pOutput, "  speed          %8.0fx real time  %.1f estimates/s\n",
+        audioSeconds / seconds, estimateCount / audioSeconds);
+    fprintf(pOutput, "  tone           mean error %5.2f deg  max error %5.2f deg  mean confidence %.2f\n",
+        (toneCount > 0) ? errorSum / toneCount : 0.0, maxError, (toneCount > 0) ? toneConfidenceSum / toneCount : 0.0);
+    fprintf(pOutput, "  silence        mean confidence %.2f\n",
+        (silenceCount > 0) ? silenceConfidenceSum / silenceCount : 0.0);
+
+    return S_OK;
+}
+
+/// Check real FFT kernels against a double precision DFT and measure their speed, then
+/// measure streaming STFT throughput over many channels and check that the loudest bin of
+/// synthetic audio is the tone's fundamental.
+static HRESULT BenchmarkStft(FILE* pOutput) {
+    const UINT fftSize = 256;
+    const UINT fftRepetitions = 200000;
+    const UINT frameCount = AudioBlock::MaxSamples;
+    const UINT channelCounts[] = {1, 4, 16};
+    const UINT windowSizes[] = {256, 512, 1024};
+    const UINT hopSizes[] = {128, 128, 256};
+
+    // Fundamental of synthetic tone, in Hz
+    const double toneFrequency = 440.0;
+
+    std::vector<int16_t> mono;
+    GenerateBenchmarkAudio(cBenchmarkAudioSeconds, NULL, mono);
+
+    // One window from the middle of first tone burst, and its spectrum by direct DFT
+    const int16_t* pWindow = &mono[AudioSamplesPerSecond / 2];
+    std::vector<double> reference(fftSize + 2);
+    double referencePeak = 0.0;
+    for (UINT k = 0; k <= fftSize / 2; ++k) {
+        double re = 0.0;
+        double im = 0.0;
+        for (UINT n = 0; n < fftSize; ++n) {
+            double angle = -2.0 * M_PI * k * n / fftSize;
+            re += pWindow[n] * cos(angle);
+            im += pWindow[n] * sin(angle);
+        }
+        reference[2 * k] = re;
+        reference[2 * k + 1] = im;
+        double magnitude = sqrt(re * re + im * im);
+        referencePeak = (magnitude > referencePeak) ? magnitude : referencePeak;
+    }
+
+    fprintf(pOutput, "stft: real FFT of %u samples x %u, cpu supports %s\n", fftSize, fftRepetitions, GetSimdLevelName(GetSimdLevel()));
+
+    std::vector<float> input(fftSize);
+    for (UINT n = 0; n < fftSize; ++n) {
+        input[n] = pWindow[n];
+    }
+    std::vector<float> data(fftSize + 2);
+
+    double scalarSeconds = 0.0;
+    for (int level = SimdLevelScalar; level <= GetSimdLevel(); ++level) {
+        RealFftPlan plan;
+        HRESULT hr = plan.Initialize(fftSize, static_cast<SimdLevel>(level));
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        // Transform is in place, so every repetition starts from a fresh copy of input
+        BenchmarkTimer timer;
+        for (UINT r = 0; r < fftRepetitions; ++r) {
+            memcpy(&data[0], &input[0], fftSize * sizeof(float));
+            plan.Forward(&data[0]);
+        }
+        double seconds = timer.GetElapsedSeconds();
+
+        if (SimdLevelScalar == level) {
+            scalarSeconds = seconds;
+        }
+
+        double maxError = 0.0;
+        for (UINT i = 0; i < fftSize + 2; ++i) {
+            double error = fabs(data[i] - reference[i]);
+            maxError = (error > maxError) ? error : maxError;
+        }
+
+        // Single precision over 8 passes stays within a few parts per million of peak bin
+        bool bMatches = (maxError < 1e-5 * referencePeak);
+        fprintf(pOutput, "  real-fft       %-6s %8.1f ns/transform  %5.2fx scalar  max error %.1e of peak  %s\n",
+            GetSimdLevelName(static_cast<SimdLevel>(level)),
+            seconds * 1e9 / fftRepetitions,
+            scalarSeconds / seconds,
+            maxError / referencePeak,
+            bMatches ? "matches DFT" : "MISMATCH");
+
+        if (!bMatches) {
+            return E_FAIL;
+        }
+    }
+
+    // Same audio on every channel; only throughput is measured across channels
+    std::vector<int16_t> interleaved;
+    UINT maxChannels = channelCounts[sizeof(channelCounts) / sizeof(channelCounts[0]) - 1];
+    interleaved.reserve(mono.size() * maxChannels);
+    for (size_t i = 0; i < mono.size(); ++i) {
+        interleaved.insert(interleaved.end(), maxChannels, mono[i]);
+    }
+    UINT blockCount = static_cast<UINT>(mono.size() / frameCount);
+    double audioSeconds = static_cast<double>(blockCount) * frameCount / AudioSamplesPerSecond;
+
+    std::vector<int16_t> samples;
+    std::vector<float> spectra;
+
+    for (size_t w = 0; w < sizeof(windowSizes) / sizeof(windowSizes[0]); ++w) {
+        for (size_t c = 0; c < sizeof(channelCounts) / sizeof(channelCounts[0]); ++c) {
+            UINT channels = channelCounts[c];
+            StftAnalyzer analyzer;
+            HRESULT hr = analyzer.Initialize(windowSizes[w], hopSizes[w], channels, GetSimdLevel());
+            if (FAILED(hr)) {
+                return hr;
+            }
+
+            UINT maxHops = frameCount / hopSizes[w] + 1;
+            spectra.resize(static_cast<size_t>(maxHops) * channels * analyzer.GetBinCount());
+
+            samples.resize(mono.size() * channels);
+            for (size_t i = 0; i < mono.size(); ++i) {
+                memcpy(&samples[i * channels], &interleaved[i * maxChannels], channels * sizeof(int16_t));
+            }
+
+            UINT64 hopCount = 0;
+            BenchmarkTimer timer;
+            for (UINT block = 0; block < blockCount; ++block) {
+                hopCount += analyzer.Process(&samples[static_cast<size_t>(block) * frameCount * channels], frameCount, &spectra[0], maxHops);
+            }
+            double seconds = timer.GetElapsedSeconds();
+
+            fprintf(pOutput, "  stft %-6s window %4u hop %3u %2u ch %8.0fx real time  %6.1f channels at 16 kHz per core  %9.0f spectra/s\n",
+                GetSimdLevelName(GetSimdLevel()), windowSizes[w], hopSizes[w], channels,
+                audioSeconds / seconds,
+                audioSeconds * channels / seconds,
+                hopCount * channels / seconds);
+        }
+    }
+
+    // Replay mono audio with first configuration and find loudest bin of windows lying wholly inside a tone burst
+    StftAnalyzer analyzer;
+    HRESULT hr = analyzer.Initialize(windowSizes[0], hopSizes[0], 1, GetSimdLevel());
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    UINT binCount = analyzer.GetBinCount();
+    UINT maxHops = frameCount / hopSizes[0] + 1;
+    UINT expectedBin = static_cast<UINT>(toneFrequency * windowSizes[0] / AudioSamplesPerSecond + 0.5);
+    spectra.resize(static_cast<size_t>(maxHops) * binCount);
+
+    UINT64 windowEnd = 0;
+    UINT toneWindows = 0;
+    UINT correctWindows = 0;
+    for (UINT block = 0; block < blockCount; ++block) {
+        UINT hops = analyzer.Process(&mono[static_cast<size_t>(block) * frameCount], frameCount, &spectra[0], maxHops);
+
+        for (UINT h = 0; h < hops; ++h) {
+            windowEnd += hopSizes[0];
+            if (windowEnd < windowSizes[0] || !SyntheticAudioSource::IsToneOn(windowEnd - windowSizes[0]) || !SyntheticAudioSource::IsToneOn(windowEnd - 1)) {
+                continue;
+            }
+
+            const float* pSpectrum = &spectra[static_cast<size_t>(h) * binCount];
+            UINT loudestBin = 0;
+            for (UINT k = 1; k < binCount; ++k) {
+                loudestBin = (pSpectrum[k] > pSpectrum[loudestBin]) ? k : loudestBin;
+            }
+
+            ++toneWindows;
+            correctWindows += (expectedBin == loudestBin) ? 1 : 0;
+        }
+    }
+
+    double correctPercent = (toneWindows > 0) ? 100.0 * correctWindows / toneWindows : 0.0;
+    fprintf(pOutput, "  tone           loudest bin is %.0f Hz fundamental in %5.1f%% of %u windows\n",
+        toneFrequency, correctPercent, toneWindows);
+
+    return (correctPercent > 99.0) ? S_OK : E_FAIL;
+}
+
+/// Mean square of samples in [begin, end) whose tone state, delay samples earlier, matches bToneOn.
+static double MeanSquareWhereTone(const std::vector<int16_t>& samples, size_t begin, size_t end, UINT delay, bool bToneOn) {
+    double sum = 0.0;
+    UINT64 count = 0;
+    for (size_t i = begin; i < end; ++i) {
+        if (i >= delay && bToneOn == SyntheticAudioSource::IsToneOn(i - delay)) {
+            sum += static_cast<double>(samples[i]) * samples[i];
+            ++count;
+        }
+    }
+    return (count > 0) ? sum / count : 0.0;
+}
+
+/// Level, in dB relative to a full scale square wave, of a mean square.
+static double LevelDb(double meanSquare) {
+    return 10.0 * log10(meanSquare / (32768.0 * 32768.0) + 1e-20);
+}
+
+/// Measure per-block cost of noise suppression across frame sizes and instruction sets,
+/// check SIMD output against scalar output, and measure how far noise added to synthetic
+/// audio is pushed down while the tone is kept. Then check automatic gain control brings
+/// quiet and loud tones to its target level.
+static HRESULT BenchmarkEnhancement(FILE* pOutput) {
+    const UINT frameCount = AudioBlock::MaxSamples;
+    const UINT frameSizes[] = {128, 256, 512, 1024};
+
+    // Peak amplitude of white noise added to synthetic audio, about 6 dB below the tone
+    const int noiseAmplitude = 4000;
+
+    // Audio before this is left out of quality measurements while noise floors settle
+    const size_t settleSamples = 2 * AudioSamplesPerSecond;
+
+    std::vector<int16_t> clean;
+    GenerateBenchmarkAudio(cBenchmarkAudioSeconds, NULL, clean);
+    UINT blockCount = static_cast<UINT>(clean.size() / frameCount);
+    size_t sampleCount = static_cast<size_t>(blockCount) * frameCount;
+    double audioSeconds = static_cast<double>(sampleCount) / AudioSamplesPerSecond;
+
+    std::vector<int16_t> noisy(sampleCount);
+    uint32_t noiseState = 1;
+    for (size_t i = 0; i < sampleCount; ++i) {
+        noiseState = noiseState * 1664525u + 1013904223u;
+        int noise = static_cast<int>(noiseState >> 16) % (2 * noiseAmplitude + 1) - noiseAmplitude;
+        int sample = clean[i] + noise;
+        noisy[i] = static_cast<int16_t>((sample > 32767) ? 32767 : ((sample < -32768) ? -32768 : sample));
+    }
+
+    double inputNoise = MeanSquareWhereTone(noisy, settleSamples, sampleCount, 0, false);
+    double cleanTone = MeanSquareWhereTone(clean, settleSamples, sampleCount, 0, true);
+
+    fprintf(pOutput, "enhance: %.0f s of 16 kHz audio in %u-sample blocks, noise at %.1f dB, tone at %.1f dB, cpu supports %s\n",
+        audioSeconds, frameCount, LevelDb(inputNoise), LevelDb(cleanTone), GetSimdLevelName(GetSimdLevel()));
+
+    std::vector<int16_t> samples(sampleCount);
+    std::vector<int16_t> scalarSamples(sampleCount);
+    HRESULT hr = S_OK;
+
+    for (size_t f = 0; f < sizeof(frameSizes) / sizeof(frameSizes[0]); ++f) {
+        double scalarSeconds = 0.0;
+
+        for (int level = SimdLevelScalar; level <= GetSimdLevel(); ++level) {
+            NoiseSuppressor suppressor;
+            hr = suppressor.Initialize(frameSizes[f], AudioSamplesPerSecond, static_cast<SimdLevel>(level));
+            if (FAILED(hr)) {
+                return hr;
+            }
+
+            samples = noisy;
+            LatencyHistogram blockLatency;
+            BenchmarkTimer timer;
+            for (UINT block = 0; block < blockCount; ++block) {
+                UINT64 start = GetClockNanoseconds();
+                suppressor.Process(&samples[static_cast<size_t>(block) * frameCount], frameCount);
+                blockLatency.Record(GetClockNanoseconds() - start);
+            }
+            double seconds = timer.GetElapsedSeconds();
+
+            if (SimdLevelScalar == level) {
+                scalarSeconds = seconds;
+                scalarSamples = samples;
+            }
+
+            // FMA and reassociated sums round differently, which may move a sample by a step or two
+            int maxDifference = 0;
+            for (size_t i = 0; i < sampleCount; ++i) {
+                int difference = abs(samples[i] - scalarSamples[i]);
+                maxDifference = (difference > maxDifference) ? difference : maxDifference;
+            }
+
+            // Output lags by suppressor's latency, so tone state is looked up that far back
+            UINT latency = suppressor.GetLatency();
+            double outputNoise = MeanSquareWhereTone(samples, settleSamples, sampleCount, latency, false);
+            double outputTone = MeanSquareWhereTone(samples, settleSamples, sampleCount, latency, true);
+            double noiseReductionDb = LevelDb(inputNoise) - LevelDb(outputNoise);
+            double toneChangeDb = LevelDb(outputTone) - LevelDb(cleanTone);
+
+            bool bMatches = (maxDifference <= 2);
+            bool bSuppresses = (noiseReductionDb > 10.0 && fabs(toneChangeDb) < 3.0);
+            fprintf(pOutput, "  suppress %-6s frame %4u latency %5.1f ms  block p50 %6.1f us p99 %6.1f us  %6.0fx real time  %5.2fx scalar  noise -%4.1f dB  tone %+4.1f dB  %s\n",
+                GetSimdLevelName(static_cast<SimdLevel>(level)), frameSizes[f],
+                1000.0 * latency / AudioSamplesPerSecond,
+                blockLatency.GetPercentile(50.0) / 1e3,
+                blockLatency.GetPercentile(99.0) / 1e3,
+                audioSeconds / seconds,
+                scalarSeconds / seconds,
+                noiseReductionDb,
+                toneChangeDb,
+                !bMatches ? "MISMATCH" : (bSuppresses ? "ok" : "WEAK"));
+
+            if (!bMatches || !bSuppresses) {
+                hr = E_FAIL;
+            }
+        }
+    }
+
+    // Same clean audio at several levels; gain control should bring every one close to its target
+    const double inputScales[] = {0.05, 0.3, 1.0};
+    const double targetLevelDb = -20.0;
+
+    for (size_t s = 0; s < sizeof(inputScales) / sizeof(inputScales[0]); ++s) {
+        std::vector<int16_t> scaled(sampleCount);
+        for (size_t i = 0; i < sampleCount; ++i) {
+            scaled[i] = static_cast<int16_t>(clean[i] * inputScales[s]);
+        }
+
+        double inputLevelDb = LevelDb(MeanSquareWhereTone(scaled, settleSamples, sampleCount, 0, true));
+
+        for (int level = SimdLevelScalar; level <= GetSimdLevel(); ++level) {
+            AutomaticGainControl gainControl(AudioSamplesPerSecond, static_cast<SimdLevel>(level));
+
+            samples = scaled;
+            LatencyHistogram blockLatency;
+            for (UINT block = 0; block < blockCount; ++block) {
+                UINT64 start = GetClockNanoseconds();
+                gainControl.Process(&samples[static_cast<size_t>(block) * frameCount], frameCount);
+                blockLatency.Record(GetClockNanoseconds() - start);
+            }
+
+            if (SimdLevelScalar == level) {
+                scalarSamples = samples;
+            }
+
+            int maxDifference = 0;
+            for (size_t i = 0; i < sampleCount; ++i) {
+                int difference = abs(samples[i] - scalarSamples[i]);
+                maxDifference = (difference > maxDifference) ? difference : maxDifference;
+            }
+
+            double outputLevelDb = LevelDb(MeanSquareWhereTone(samples, settleSamples, sampleCount, 0, true));
+            bool bMatches = (maxDifference <= 1);
+            bool bOnTarget = (fabs(outputLevelDb - targetLevelDb) < 3.0);
+            fprintf(pOutput, "  agc      %-6s input %5.1f dB  output %5.1f dB  final gain %+5.1f dB  block p50 %6.2f us p99 %6.2f us  %s\n",
+                GetSimdLevelName(static_cast<SimdLevel>(level)),
+                inputLevelDb, outputLevelDb, gainControl.GetGainDb(),
+                blockLatency.GetPercentile(50.0) / 1e3,
+                blockLatency.GetPercentile(99.0) / 1e3,
+                !bMatches ? "MISMATCH" : (bOnTarget ? "ok" : "OFF TARGET"));
+
+            if (!bMatches || !bOnTarget) {
+                hr = E_FAIL;
+            }
+        }
+    }
+
+    return hr;
+}
+
+/// Fraction of samples after start in which detector state, sampled at end of every block, was as expected.
+/// Blocks within hangover after a burst ends expect nothing, since detector is meant to hold on there.
+/// <param name="active">detector state at end of each block.</param>
+/// <param name="blockSize">samples per block.</param>
+/// <param name="firstBlock">first block to score.</param>
+/// <param name="pVoiceScore">receives fraction of scored tone blocks detected as voice.</param>
+/// <param name="pSilenceScore">receives fraction of scored silent blocks detected as silence.</param>
+static void ScoreVoiceActivity(const std::vector<bool>& active, UINT blockSize, size_t firstBlock, double* pVoiceScore, double* pSilenceScore) {
+    const UINT64 hangoverSamples = AudioSamplesPerSecond * 4 / 10;
+    UINT voiceBlocks = 0;
+    UINT voiceHits = 0;
+    UINT silentBlocks = 0;
+    UINT silentHits = 0;
+
+    for (size_t b = firstBlock; b < active.size(); ++b) {
+        UINT64 end = static_cast<UINT64>(b + 1) * blockSize - 1;
+        if (SyntheticAudioSource::IsToneOn(end)) {
+            ++voiceBlocks;
+            voiceHits += active[b] ? 1 : 0;
+        }
+        else if (end >= hangoverSamples && !SyntheticAudioSource::IsToneOn(end - hangoverSamples)) {
+            ++silentBlocks;
+            silentHits += active[b] ? 0 : 1;
+        }
+    }
+
+    *pVoiceScore = (voiceBlocks > 0) ? static_cast<double>(voiceHits) / voiceBlocks : 0.0;
+    *pSilenceScore = (silentBlocks > 0) ? static_cast<double>(silentHits) / silentBlocks : 0.0;
+}
+
+/// Check voice activity detector follows synthetic tone bursts through increasing noise, and
+/// measure its per-block cost. Then run raw microphone array audio that is mostly silent through
+/// the processing pipeline with and without voice gate, and compare the time gating saved with
+/// the saving the pipeline's own counters estimate.
+static HRESULT BenchmarkVoiceActivity(FILE* pOutput) {
+    const UINT frameCount = AudioBlock::MaxSamples;
+
+    // Peak amplitude of white noise added to tone bursts; the tone itself peaks near 8000
+    const int noiseAmplitudes[] = {0, 1000, 3000};
+
+    // Detector misses the first burst, which it takes for its noise floor, so scoring starts after it
+    const size_t settleBlocks = 2 * AudioSamplesPerSecond / frameCount;
+
+    std::vector<int16_t> clean;
+    GenerateBenchmarkAudio(cBenchmarkAudioSeconds, NULL, clean);
+    UINT blockCount = static_cast<UINT>(clean.size() / frameCount);
+    size_t sampleCount = static_cast<size_t>(blockCount) * frameCount;
+    double audioSeconds = static_cast<double>(sampleCount) / AudioSamplesPerSecond;
+
+    fprintf(pOutput, "vad: %.0f s of 16 kHz audio in %u-sample blocks, %u-sample frames, cpu supports %s\n",
+        audioSeconds, frameCount, VoiceActivityDetector::cFrameSize, GetSimdLevelName(GetSimdLevel()));
+
+    HRESULT hr = S_OK;
+    std::vector<int16_t> noisy(sampleCount);
+    std::vector<bool> active(blockCount);
+
+    for (size_t n = 0; n < sizeof(noiseAmplitudes) / sizeof(noiseAmplitudes[0]); ++n) {
+        uint32_t noiseState = 1;
+        for (size_t i = 0; i < sampleCount; ++i) {
+            noiseState = noiseState * 1664525u + 1013904223u;
+            int noise = static_cast<int>(noiseState >> 16) % (2 * noiseAmplitudes[n] + 1) - noiseAmplitudes[n];
+            int sample = clean[i] + noise;
+            noisy[i] = static_cast<int16_t>((sample > 32767) ? 32767 : ((sample < -32768) ? -32768 : sample));
+        }
+
+        double snrDb = LevelDb(MeanSquareWhereTone(clean, 0, sampleCount, 0, true)) - LevelDb(MeanSquareWhereTone(noisy, 0, sampleCount, 0, false));
+
+        for (int level = SimdLevelScalar; level <= GetSimdLevel(); ++level) {
+            VoiceActivityDetector detector;
+            hr = detector.Initialize(AudioSamplesPerSecond, static_cast<SimdLevel>(level));
+            if (FAILED(hr)) {
+                return hr;
+            }
+
+            LatencyHistogram blockLatency;
+            for (UINT block = 0; block < blockCount; ++block) {
+                UINT64 start = GetClockNanoseconds();
+                active[block] = detector.Process(&noisy[static_cast<size_t>(block) * frameCount], frameCount, 1);
+                blockLatency.Record(GetClockNanoseconds() - start);
+            }
+
+            double voiceScore = 0.0;
+            double silenceScore = 0.0;
+            ScoreVoiceActivity(active, frameCount, settleBlocks, &voiceScore, &silenceScore);
+
+            // Bursts barely above the noise are picked up a frame or two late
+            bool bAccurate = (voiceScore > 0.9 && silenceScore > 0.95);
+            fprintf(pOutput, "  detect   %-6s snr %5.1f dB  voice found %5.1f%%  silence found %5.1f%%  block p50 %5.2f us p99 %5.2f us  %s\n",
+                GetSimdLevelName(static_cast<SimdLevel>(level)), snrDb,
+                100.0 * voiceScore, 100.0 * silenceScore,
+                blockLatency.GetPercentile(50.0) / 1e3,
+                blockLatency.GetPercentile(99.0) / 1e3,
+                bAccurate ? "ok" : "MISSED");
+
+            if (!bAccurate) {
+                hr = E_FAIL;
+            }
+        }
+    }
+
+    // Array audio in which only one burst in three is kept and the rest is replaced by
+    // microphone noise, so the room is quiet most of the time
+    MicrophoneArrayGeometry geometry = GetKinectArrayGeometry();
+    const UINT channels = geometry.microphoneCount;
+    const UINT keptBurstInterval = 3;
+    const double burstPeriod = 2.0;
+
+    std::vector<int16_t> array;
+    GenerateBenchmarkAudio(cBenchmarkAudioSeconds, &geometry, array);
+    uint32_t noiseState = 1;
+    for (size_t i = 0; i < array.size(); ++i) {
+        UINT burst = static_cast<UINT>(static_cast<double>(i / channels) / AudioSamplesPerSecond / burstPeriod);
+        if (0 != burst % keptBurstInterval) {
+            noiseState = noiseState * 1664525u + 1013904223u;
+            array[i] = static_cast<int16_t>(static_cast<int>(noiseState >> 16) % 401 - 200);
+        }
+    }
+
+    // Pipeline holds several blocks of workspace, so it is kept off the stack
+    AudioPipeline* pPipeline = new AudioPipeline();
+    AudioPipelineResult* pResult = new AudioPipelineResult();
+    const UINT gates[] = {AudioEnhancementNone, AudioEnhancementVoiceGate};
+    double seconds[2] = {0.0, 0.0};
+    HRESULT hrPipeline = S_OK;
+
+    for (size_t g = 0; g < 2 && SUCCEEDED(hrPipeline); ++g) {
+        hrPipeline = pPipeline->Initialize(static_cast<WORD>(channels), gates[g], 1);
+        if (FAILED(hrPipeline)) {
+            break;
+        }
+
+        AudioBlock block;
+        memset(&block, 0, sizeof(block));
+        block.channelCount = static_cast<WORD>(channels);
+        block.sampleCount = frameCount;
+
+        BenchmarkTimer timer;
+        for (UINT b = 0; b < blockCount && SUCCEEDED(hrPipeline); ++b) {
+            block.sequence = b;
+            block.pSamples = &array[static_cast<size_t>(b) * frameCount * channels];
+            hrPipeline = pPipeline->ProcessBlock(block, pResult);
+        }
+        seconds[g] = timer.GetElapsedSeconds();
+
+        const AudioGateStatistics& statistics = pPipeline->GetGateStatistics();
+        double skippedPercent = 100.0 * statistics.skippedCount / statistics.blockCount;
+        fprintf(pOutput, "  pipeline %u ch  gate %-3s  %6.0fx real time  skipped %5.1f%% of blocks  gated stages %7.1f ms",
+            channels, (0 == g) ? "off" : "on", audioSeconds / seconds[g], skippedPercent,
+            (statistics.analysisNanoseconds + statistics.skippedNanoseconds) / 1e6);
+
+        if (0 == g) {
+            fprintf(pOutput, "\n");
+        }
+        else {
+            // Measured saving includes the detector's own cost, which the estimate leaves out
+            bool bSkips = (skippedPercent > 50.0 && skippedPercent < 80.0);
+            fprintf(pOutput, "  saved %6.1f ms measured, %6.1f ms estimated  %s\n",
+                (seconds[0] - seconds[1]) * 1e3, statistics.GetSavedNanoseconds() / 1e6,
+                bSkips ? "ok" : "WRONG SKIP RATE");
+
+            if (!bSkips) {
+                hr = E_FAIL;
+            }
+        }
+    }
+
+    delete pResult;
+    delete pPipeline;
+
+    return FAILED(hrPipeline) ? hrPipeline : hr;
+}
+
+/// Error statistics of an angle stream against ground truth.
+struct AngleErrorStatistics {
+    double          squaredErrorSum;
+    double          squaredStepSum;
+    UINT            count;
+
+    AngleErrorStatistics() : squaredErrorSum(0.0), squaredStepSum(0.0), count(0) {}
+
+    /// Add one angle, its true value, and how far it and truth moved since previous one.
+    void Add(double angle, double expected, double step, double expectedStep) {
+        squaredErrorSum += (angle - expected) * (angle - expected);
+        squaredStepSum += (step - expectedStep) * (step - expectedStep);
+        ++count;
+    }
+
+    /// Root mean square distance from truth.
+    double GetRmsError() const { return (count > 0) ? sqrt(squaredErrorSum / count) : 0.0; }
+
+    /// Root mean square of movement truth didn't make.
+    double GetRmsJitter() const { return (count > 0) ? sqrt(squaredStepSum / count) : 0.0; }
+};
+
+/// Next standard normal value from a linear congruential generator, by Box-Muller transform.
+static double NextGaussian(uint32_t* pState) {
+    *pState = *pState * 1664525u + 1013904223u;
+    double u1 = ((*pState >> 8) + 1.0) / 16777217.0;
+    *pState = *pState * 1664525u + 1013904223u;
+    double u2 = (*pState >> 8) / 16777216.0;
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/// Run angle tracker over a long simulated trace of confidence-weighted measurements, then over
+/// estimates the pipeline's localizer makes of synthetic microphone array audio. Compare raw and
+/// tracked angles with the true source angle, and measure cost per measurement.
+static HRESULT BenchmarkTracker(FILE* pOutput) {
+    // Simulated trace: one measurement per localizer hop, for an hour
+    const UINT traceSeconds = 3600;
+    const UINT hop = GccPhatLocalizer::cHopSize;
+    const UINT measurementCount = traceSeconds * AudioSamplesPerSecond / hop;
+
+    // Talker sweeps as the synthetic source does, around a center that moves to a new talker every so often
+    const double talkerSeconds = 15.0;
+    const double talkerOffsets[] = {0.0, -20.0, 25.0, 10.0, -30.0};
+    const size_t talkerCount = sizeof(talkerOffsets) / sizeof(talkerOffsets[0]);
+
+    // Probability a measurement is silence with no confidence, or a reflection anywhere in view
+    const double silenceProbability = 0.1;
+    const double outlierProbability = 0.05;
+
+    // Error after a talker change is left out of scoring until tracker has had time to restart
+    const double settleSeconds = 0.5;
+
+    std::vector<double> truth(measurementCount);
+    std::vector<float> angles(measurementCount);
+    std::vector<float> confidences(measurementCount);
+    uint32_t state = 1;
+
+    for (UINT i = 0; i < measurementCount; ++i) {
+        UINT64 position = static_cast<UINT64>(i + 1) * hop;
+        double seconds = static_cast<double>(position) / AudioSamplesPerSecond;
+        size_t talker = static_cast<size_t>(seconds / talkerSeconds) % talkerCount;
+        truth[i] = 0.5 * SyntheticAudioSource::GetSourceAngle(position) * 180.0 / M_PI + talkerOffsets[talker];
+
+        state = state * 1664525u + 1013904223u;
+        double roll = (state >> 8) / 16777216.0;
+        state = state * 1664525u + 1013904223u;
+        double confidence = 0.1 + 0.9 * (state >> 8) / 16777216.0;
+
+        if (roll < silenceProbability) {
+            confidences[i] = 0.0f;
+            angles[i] = 0.0f;
+        }
+        else if (roll < silenceProbability + outlierProbability) {
+            state = state * 1664525u + 1013904223u;
+            confidences[i] = static_cast<float>(confidence);
+            angles[i] = static_cast<float>(-60.0 + 120.0 * (state >> 8) / 16777216.0);
+        }
+        else {
+            // Measurement spread widens as confidence drops, matching tracker's model of it
+            confidences[i] = static_cast<float>(confidence);
+            angles[i] = static_cast<float>(truth[i] + 4.0 * NextGaussian(&state) / sqrt(confidence));
+        }
+    }
+
+    fprintf(pOutput, "tracker: %u s simulated trace, %u measurements, %.0f%% silent, %.0f%% outliers, talker moves every %.0f s\n",
+        traceSeconds, measurementCount, 100.0 * silenceProbability, 100.0 * outlierProbability, talkerSeconds);
+
+    AngleTracker tracker(AudioSamplesPerSecond);
+    AngleErrorStatistics raw;
+    AngleErrorStatistics tracked;
+    UINT withinTwoDeviations = 0;
+    double previousRaw = 0.0;
+    double previousTracked = 0.0;
+    double previousTruth = 0.0;
+    UINT64 settleSamples = static_cast<UINT64>(settleSeconds * AudioSamplesPerSecond);
+
+    LatencyHistogram updateLatency;
+    BenchmarkTimer timer;
+    for (UINT i = 0; i < measurementCount; ++i) {
+        UINT64 position = static_cast<UINT64>(i + 1) * hop;
+        UINT64 start = GetClockNanoseconds();
+        tracker.Update(position, angles[i], confidences[i]);
+        updateLatency.Record(GetClockNanoseconds() - start);
+
+        // Confident raw measurements are what a consumer without tracker would show
+        double angle = tracker.GetAngleDegrees();
+        double talkerPosition = fmod(static_cast<double>(position) / AudioSamplesPerSecond, talkerSeconds) * AudioSamplesPerSecond;
+        if (i > 0 && talkerPosition >= settleSamples && confidences[i] >= 0.1f) {
+            raw.Add(angles[i], truth[i], angles[i] - previousRaw, truth[i] - previousTruth);
+            tracked.Add(angle, truth[i], angle - previousTracked, truth[i] - previousTruth);
+            withinTwoDeviations += (fabs(angle - truth[i]) <= 2.0 * tracker.GetUncertaintyDegrees()) ? 1 : 0;
+        }
+
+        if (confidences[i] >= 0.1f) {
+            previousRaw = angles[i];
+        }
+        previousTracked = angle;
+        previousTruth = truth[i];
+    }
+    double seconds = timer.GetElapsedSeconds();
+
+    double coveragePercent = (tracked.count > 0) ? 100.0 * withinTwoDeviations / tracked.count : 0.0;
+    bool bSmooths = (tracked.GetRmsError() < 0.5 * raw.GetRmsError() && tracked.GetRmsJitter() < 0.25 * raw.GetRmsJitter());
+    bool bCalibrated = (coveragePercent > 85.0);
+    fprintf(pOutput, "  simulated  raw     rms error %5.2f deg  rms jitter %5.2f deg\n", raw.GetRmsError(), raw.GetRmsJitter());
+    fprintf(pOutput, "  simulated  tracked rms error %5.2f deg  rms jitter %5.2f deg  within 2 sigma %5.1f%%  outliers rejected %llu  update p50 %.0f ns p99 %.0f ns  %.1f M updates/s  %s\n",
+        tracked.GetRmsError(), tracked.GetRmsJitter(), coveragePercent,
+        static_cast<unsigned long long>(tracker.GetOutlierCount()),
+        static_cast<double>(updateLatency.GetPercentile(50.0)), static_cast<double>(updateLatency.GetPercentile(99.0)),
+        measurementCount / seconds / 1e6,
+        !bSmooths ? "ROUGH" : (bCalibrated ? "ok" : "OVERCONFIDENT"));
+
+    HRESULT hr = (bSmooths && bCalibrated) ? S_OK : E_FAIL;
+
+    // Localizer's own estimates of synthetic array audio, scored while tone sounds
+    MicrophoneArrayGeometry geometry = GetKinectArrayGeometry();
+    const UINT channels = geometry.microphoneCount;
+    const UINT frameCount = AudioBlock::MaxSamples;
+
+    std::vector<int16_t> samples;
+    GenerateBenchmarkAudio(cBenchmarkAudioSeconds, &geometry, samples);
+    UINT blockCount = static_cast<UINT>(samples.size() / (channels * frameCount));
+
+    // Pipeline holds several blocks of workspace, so it is kept off the stack
+    AudioPipeline* pPipeline = new AudioPipeline();
+    AudioPipelineResult* pResult = new AudioPipelineResult();
+    HRESULT hrPipeline = pPipeline->Initialize(static_cast<WORD>(channels), AudioEnhancementNone, 1);
+
+    AngleErrorStatistics localized;
+    AngleErrorStatistics smoothed;
+    double previousLocalized = 0.0;
+    double previousSmoothed = 0.0;
+    previousTruth = 0.0;
+
+    AudioBlock block;
+    memset(&block, 0, sizeof(block));
+    block.channelCount = static_cast<WORD>(channels);
+    block.sampleCount = frameCount;
+
+    for (UINT b = 0; b < blockCount && SUCCEEDED(hrPipeline); ++b) {
+        block.sequence = b;
+        block.pSamples = &samples[static_cast<size_t>(b) * frameCount * channels];
+        hrPipeline = pPipeline->ProcessBlock(block, pResult);
+        if (FAILED(hrPipeline) || 0 == pResult->sourceEstimateCount) {
+            continue;
+        }
+
+        // Block's last estimate and tracked angle at end of block are compared with truth at end of block
+        const SourceEstimate& estimate = pResult->sourceEstimates[pResult->sourceEstimateCount - 1];
+        UINT64 end = pResult->samplePosition + pResult->sampleCount;
+        double expected = SyntheticAudioSource::GetSourceAngle(end) * 180.0 / M_PI;
+        if (b > 0 && SyntheticAudioSource::IsToneOn(end - GccPhatLocalizer::cFrameSize) && SyntheticAudioSource::IsToneOn(end)) {
+            localized.Add(estimate.angleDegrees, expected, estimate.angleDegrees - previousLocalized, expected - previousTruth);
+            smoothed.Add(pResult->trackedAngleDegrees, expected, pResult->trackedAngleDegrees - previousSmoothed, expected - previousTruth);
+        }
+
+        previousLocalized = estimate.angleDegrees;
+        previousSmoothed = pResult->trackedAngleDegrees;
+        previousTruth = expected;
+    }
+
+    delete pResult;
+    delete pPipeline;
+
+    if (FAILED(hrPipeline)) {
+        return hrPipeline;
+    }
+
+    // Tracker lags a sweeping source slightly, so it may trade a little error for much less jitter
+    bool bSteadier = (smoothed.GetRmsJitter() < 0.5 * localized.GetRmsJitter() && smoothed.GetRmsError() < localized.GetRmsError() + 1.0);
+    fprintf(pOutput, "  localizer  raw     rms error %5.2f deg  rms jitter %5.2f deg  (%u s of %u-channel audio)\n",
+        localized.GetRmsError(), localized.GetRmsJitter(), cBenchmarkAudioSeconds, channels);
+    fprintf(pOutput, "  localizer  tracked rms error %5.2f deg  rms jitter %5.2f deg  %s\n",
+        smoothed.GetRmsError(), smoothed.GetRmsJitter(), bSteadier ? "ok" : "ROUGH");
+
+    return bSteadier ? hr : E_FAIL;
+}
+
+/// Whether one of two synthetic talkers is talking. Each talks for 3 of every 4 seconds, half a
+/// cycle after the other, so one talks alone for a second, then both do for a second.
+/// <param name="talker">0 or 1.</param>
+/// <param name="seconds">time since start of audio.</param>
+static bool IsTalkerOn(UINT talker, double seconds) {
+    return seconds >= 0.0 && fmod(seconds + 2.0 * talker, 4.0) < 3.0;
+}
+
+/// Direction, in degrees, of one of two synthetic talkers. First sits to the left; second walks
+/// back and forth in front of array, coming no closer than 20 degrees to the first.
+/// <param name="talker">0 or 1.</param>
+/// <param name="seconds">time since start of audio.</param>
+static double GetTalkerAngle(UINT talker, double seconds) {
+    return (0 == talker) ? -30.0 : 10.0 + 20.0 * sin(2.0 * M_PI * seconds / 20.0);
+}
+
+/// Fill vector with 4-channel Kinect array audio of two harmonic talkers taking turns and
+/// sometimes talking at once: one sits still, the other walks slowly across the room.
+/// <param name="seconds">length of audio to generate.</param>
+/// <param name="geometry">microphone array to simulate.</param>
+/// <param name="samples">receives interleaved samples.</param>
+static void GenerateTalkerPairAudio(UINT seconds, const MicrophoneArrayGeometry& geometry, std::vector<int16_t>& samples) {
+    const UINT channels = geometry.microphoneCount;
+    const size_t sampleCount = static_cast<size_t>(seconds) * AudioSamplesPerSecond;
+    const double fundamentals[] = {170.0, 230.0};
+    const int harmonics = 16;
+    const double amplitude = 4000.0;
+    const int noiseAmplitude = 100;
+
+    samples.assign(sampleCount * channels, 0);
+    uint32_t state = 7;
+
+    for (size_t i = 0; i < sampleCount; ++i) {
+        double seconds = static_cast<double>(i) / AudioSamplesPerSecond;
+        double sum[MicrophoneArrayGeometry::MaxMicrophones] = {0.0};
+
+        for (UINT s = 0; s < 2; ++s) {
+            if (!IsTalkerOn(s, seconds)) {
+                continue;
+            }
+
+            double angle = GetTalkerAngle(s, seconds) * M_PI / 180.0;
+            for (UINT c = 0; c < channels; ++c) {
+                // Each microphone hears talker positions[c] * sin(angle) / SpeedOfSound seconds early
+                double t = seconds + geometry.positions[c] * sin(angle) / SpeedOfSound;
+                for (int h = 1; h <= harmonics; ++h) {
+                    sum[c] += amplitude / harmonics * sin(2.0 * M_PI * h * fundamentals[s] * t + h);
+                }
+            }
+        }
+
+        for (UINT c = 0; c < channels; ++c) {
+            state = state * 1664525u + 1013904223u;
+            int noise = static_cast<int>(state >> 16) % (2 * noiseAmplitude + 1) - noiseAmplitude;
+            samples[i * channels + c] = static_cast<int16_t>(floor(sum[c] + noise + 0.5));
+        }
+    }
+}
+
+/// Check SRP-PHAT map kernels and threads against the scalar single-threaded map and measure
+/// their speed on grids of several sizes. Then follow two synthetic talkers through the
+/// pipeline's map, scoring how often each has a track on it, against the single angle the
+/// localizer settles on, and how often a track sits where no talker is.
+static HRESULT BenchmarkSrpMap(FILE* pOutput) {
+    const UINT angleCounts[] = {181, 721, 1441};
+    const UINT threadCounts[] = {1, 2, 4};
+    const UINT repetitions = 2000;
+    const float tolerance = 1e-3f;
+
+    // Whitened cross-spectra of Kinect pairs hearing two sources of unequal strength
+    MicrophoneArrayGeometry geometry = GetKinectArrayGeometry();
+    const UINT fftSize = GccPhatLocalizer::cFftSize;
+    const UINT bins = fftSize / 2 + 1;
+    const UINT firstBin = 7;
+    const UINT lastBin = 448;
+    float pairDelays[MicrophoneArrayGeometry::MaxMicrophones * MicrophoneArrayGeometry::MaxMicrophones];
+    UINT pairCount = 0;
+    for (UINT i = 0; i < geometry.microphoneCount; ++i) {
+        for (UINT j = i + 1; j < geometry.microphoneCount; ++j) {
+            pairDelays[pairCount++] = (geometry.positions[j] - geometry.positions[i]) * AudioSamplesPerSecond / SpeedOfSound;
+        }
+    }
+
+    std::vector<float> crossSpectra(2 * bins * pairCount, 0.0f);
+    for (UINT p = 0; p < pairCount; ++p) {
+        for (UINT k = firstBin; k <= lastBin; ++k) {
+            double first = -2.0 * M_PI * k * pairDelays[p] * sin(-30.0 * M_PI / 180.0) / fftSize;
+            double second = -2.0 * M_PI * k * pairDelays[p] * sin(20.0 * M_PI / 180.0) / fftSize;
+            double real = 0.6 * cos(first) + 0.4 * cos(second);
+            double imag = 0.6 * sin(first) + 0.4 * sin(second);
+            double magnitude = sqrt(real * real + imag * imag) + 1e-9;
+            crossSpectra[2 * (p * bins + k)] = static_cast<float>(real / magnitude);
+            crossSpectra[2 * (p * bins + k) + 1] = static_cast<float>(imag / magnitude);
+        }
+    }
+
+    fprintf(pOutput, "srp: SRP-PHAT map of %u Kinect microphone pairs, bins %u..%u of %u, %u maps per grid\n",
+        pairCount, firstBin, lastBin, fftSize, repetitions);
+
+    bool bAllMatch = true;
+    for (size_t g = 0; g < sizeof(angleCounts) / sizeof(angleCounts[0]); ++g) {
+        std::vector<float> reference(angleCounts[g]);
+        std::vector<float> map(angleCounts[g]);
+
+        SrpPhatMap scalar;
+        HRESULT hr = scalar.Initialize(pairDelays, pairCount, fftSize, firstBin, lastBin, angleCounts[g], 1, SimdLevelScalar);
+        if (FAILED(hr)) {
+            return hr;
+        }
+        scalar.Compute(&crossSpectra[0], &reference[0]);
+
+        for (int level = SimdLevelScalar; level <= GetSimdLevel(); ++level) {
+            for (size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); ++t) {
+                SrpPhatMap srp;
+                hr = srp.Initialize(pairDelays, pairCount, fftSize, firstBin, lastBin, angleCounts[g], threadCounts[t], static_cast<SimdLevel>(level));
+                if (FAILED(hr)) {
+                    return hr;
+                }
+
+                LatencyHistogram latency;
+                BenchmarkTimer timer;
+                for (UINT r = 0; r < repetitions; ++r) {
+                    UINT64 start = GetClockNanoseconds();
+                    srp.Compute(&crossSpectra[0], &map[0]);
+                    latency.Record(GetClockNanoseconds() - start);
+                }
+                double seconds = timer.GetElapsedSeconds();
+
+                float maxDifference = 0.0f;
+                for (UINT a = 0; a < angleCounts[g]; ++a) {
+                    float difference = fabsf(map[a] - reference[a]);
+                    maxDifference = (difference > maxDifference) ? difference : maxDifference;
+                }
+                bool bMatches = (maxDifference <= tolerance);
+                bAllMatch = bAllMatch && bMatches;
+
+                AngularPeak peaks[4];
+                UINT peakCount = srp.FindPeaks(&map[0], peaks, 4);
+
+                fprintf(pOutput, "  %4u angles  %-6s %u thread%s  p50 %7.1f us  p99 %7.1f us  %8.0f maps/s  %u peaks (%.1f, %.1f deg)  %s\n",
+                    angleCounts[g], GetSimdLevelName(static_cast<SimdLevel>(level)), threadCounts[t], (1 == threadCounts[t]) ? " " : "s",
+                    static_cast<double>(latency.GetPercentile(50.0)) / 1000.0, static_cast<double>(latency.GetPercentile(99.0)) / 1000.0,
+                    repetitions / seconds, peakCount, (peakCount > 0) ? peaks[0].angleDegrees : 0.0f, (peakCount > 1) ? peaks[1].angleDegrees : 0.0f,
+                    bMatches ? "matches scalar" : "MISMATCH");
+            }
+        }
+    }
+
+    if (!bAllMatch) {
+        return E_FAIL;
+    }
+
+    // Two talkers through pipeline, scored once a talker has been on long enough for a track to be confirmed
+    const UINT channels = geometry.microphoneCount;
+    const UINT frameCount = AudioBlock::MaxSamples;
+    const double settleSeconds = 0.5;
+    const double hitDegrees = 5.0;
+    const double falseDegrees = 10.0;
+
+    std::vector<int16_t> samples;
+    GenerateTalkerPairAudio(cBenchmarkAudioSeconds, geometry, samples);
+    UINT blockCount = static_cast<UINT>(samples.size() / (channels * frameCount));
+
+    AudioPipeline* pPipeline = new AudioPipeline();
+    AudioPipelineResult* pResult = new AudioPipelineResult();
+
+    AudioBlock block;
+    memset(&block, 0, sizeof(block));
+    block.channelCount = static_cast<WORD>(channels);
+    block.sampleCount = frameCount;
+
+    HRESULT hrPipeline = S_OK;
+    for (size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]) && SUCCEEDED(hrPipeline); ++t) {
+        hrPipeline = pPipeline->Initialize(static_cast<WORD>(channels), AudioEnhancementNone, threadCounts[t]);
+
+        UINT talkerBlocks[2] = {0, 0};
+        UINT trackedBlocks[2] = {0, 0};
+        UINT localizedBlocks[2] = {0, 0};
+        UINT bothBlocks = 0;
+        UINT bothTrackedBlocks = 0;
+        UINT trackBlocks = 0;
+        UINT falseTrackBlocks = 0;
+        double errorSquares = 0.0;
+        UINT errorCount = 0;
+        LatencyHistogram blockLatency;
+
+        BenchmarkTimer timer;
+        for (UINT b = 0; b < blockCount && SUCCEEDED(hrPipeline); ++b) {
+            block.sequence = b;
+            block.pSamples = &samples[static_cast<size_t>(b) * frameCount * channels];
+            UINT64 start = GetClockNanoseconds();
+            hrPipeline = pPipeline->ProcessBlock(block, pResult);
+            blockLatency.Record(GetClockNanoseconds() - start);
+            if (FAILED(hrPipeline)) {
+                break;
+            }
+
+            double seconds = static_cast<double>(pResult->samplePosition + pResult->sampleCount) / AudioSamplesPerSecond;
+            bool bSettled[2];
+            for (UINT s = 0; s < 2; ++s) {
+                bSettled[s] = IsTalkerOn(s, seconds) && IsTalkerOn(s, seconds - settleSeconds);
+                if (!bSettled[s]) {
+                    continue;
+                }
+
+                double expected = GetTalkerAngle(s, seconds);
+                ++talkerBlocks[s];
+
+                bool bTracked = false;
+                for (UINT i = 0; i < pResult->trackCount; ++i) {
+                    double error = pResult->tracks[i].angleDegrees - expected;
+                    if (fabs(error) <= hitDegrees) {
+                        errorSquares += error * error;
+                        ++errorCount;
+                        bTracked = true;
+                        break;
+                    }
+                }
+                trackedBlocks[s] += bTracked ? 1 : 0;
+                localizedBlocks[s] += (fabs(pResult->sourceAngleDegrees - expected) <= hitDegrees) ? 1 : 0;
+            }
+
+            if (bSettled[0] && bSettled[1]) {
+                ++bothBlocks;
+                bool bBoth = true;
+                for (UINT s = 0; s < 2 && bBoth; ++s) {
+                    bool bTracked = false;
+                    for (UINT i = 0; i < pResult->trackCount; ++i) {
+                        bTracked = bTracked || fabs(pResult->tracks[i].angleDegrees - GetTalkerAngle(s, seconds)) <= hitDegrees;
+                    }
+                    bBoth = bTracked;
+                }
+                bothTrackedBlocks += bBoth ? 1 : 0;
+            }
+
+            // A track far from both talkers, wherever they are, follows nothing
+            for (UINT i = 0; i < pResult->trackCount; ++i) {
+                ++trackBlocks;
+                if (fabs(pResult->tracks[i].angleDegrees - GetTalkerAngle(0, seconds)) > falseDegrees &&
+                    fabs(pResult->tracks[i].angleDegrees - GetTalkerAngle(1, seconds)) > falseDegrees) {
+                    ++falseTrackBlocks;
+                }
+            }
+        }
+        double seconds = timer.GetElapsedSeconds();
+
+        if (FAILED(hrPipeline)) {
+            break;
+        }
+
+        double audioSeconds = static_cast<double>(blockCount) * frameCount / AudioSamplesPerSecond;
+        double tracked[2];
+        double localized[2];
+        for (UINT s = 0; s < 2; ++s) {
+            tracked[s] = (talkerBlocks[s] > 0) ? 100.0 * trackedBlocks[s] / talkerBlocks[s] : 0.0;
+            localized[s] = (talkerBlocks[s] > 0) ? 100.0 * localizedBlocks[s] / talkerBlocks[s] : 0.0;
+        }
+        double both = (bothBlocks > 0) ? 100.0 * bothTrackedBlocks / bothBlocks : 0.0;
+        double falsePercent = (trackBlocks > 0) ? 100.0 * falseTrackBlocks / trackBlocks : 0.0;
+
+        if (0 == t) {
+            fprintf(pOutput, "  two talkers (%u s of %u-channel audio, scored %.1f s after each starts):\n", cBenchmarkAudioSeconds, channels, settleSeconds);
+            fprintf(pOutput, "    localizer angle within %.0f deg of talker  still %5.1f%%  walking %5.1f%%\n", hitDegrees, localized[0], localized[1]);
+            fprintf(pOutput, "    a track within %.0f deg of talker          still %5.1f%%  walking %5.1f%%  both while both talk %5.1f%%\n",
+                hitDegrees, tracked[0], tracked[1], both);
+            fprintf(pOutput, "    track rms error %.2f deg  tracks far from any talker %.1f%%\n",
+                (errorCount > 0) ? sqrt(errorSquares / errorCount) : 0.0, falsePercent);
+        }
+
+        bool bFollows = (tracked[0] > 90.0 && tracked[1] > 90.0 && both > 80.0 && falsePercent < 5.0);
+        fprintf(pOutput, "    pipeline, map on %u thread%s  %6.0fx real time  block p50 %6.1f us  p99 %6.1f us  %s\n",
+            threadCounts[t], (1 == threadCounts[t]) ? " " : "s", audioSeconds / seconds,
+            static_cast<double>(blockLatency.GetPercentile(50.0)) / 1000.0, static_cast<double>(blockLatency.GetPercentile(99.0)) / 1000.0,
+            bFollows ? "ok" : "LOST");
+
+        if (!bFollows) {
+            hrPipeline = E_FAIL;
+        }
+    }
+
+    delete pResult;
+    delete pPipeline;
+
+    return hrPipeline;
+}
+
+/// Simulate echo of a reference through a random room response onto each captured channel.
+/// Response starts after a delay and decays exponentially; each channel gets its own.
+/// <param name="reference">mono playback reference.</param>
+/// <param name="channelCount">number of captured channels.</param>
+/// <param name="pathLength">length of each response, in samples, including delay.</param>
+/// <param name="nearNoiseAmplitude">peak amplitude of white noise added at each microphone.</param>
+/// <param name="capture">receives interleaved captured samples.</param>
+/// <param name="echo">receives interleaved echo without noise, before conversion to 16 bits.</param>
+static void GenerateEcho(const std::vector<int16_t>& reference, UINT channelCount, UINT pathLength, int nearNoiseAmplitude,
+    std::vector<int16_t>& capture, std::vector<float>& echo) {
+    // Direct path from speaker to microphones arrives after 5 ms
+    const UINT delay = 80;
+
+    // Energy decays by 60 dB over a quarter of a second, a small damped room
+    const double decaySamples = 0.25 * AudioSamplesPerSecond / 6.9;
+
+    // Echo is about 6 dB below reference, as when speakers sit near the sensor
+    const double echoGain = 0.5;
+
+    size_t sampleCount = reference.size();
+    capture.assign(sampleCount * channelCount, 0);
+    echo.assign(sampleCount * channelCount, 0.0f);
+
+    uint32_t state = 12345;
+    std::vector<float> response(pathLength);
+    for (UINT c = 0; c < channelCount; ++c) {
+        double energy = 0.0;
+        for (UINT t = 0; t < pathLength; ++t) {
+            state = state * 1664525u + 1013904223u;
+            double tap = (t < delay) ? 0.0 : (static_cast<double>(state >> 8) / (1 << 24) - 0.5) * exp(-static_cast<double>(t - delay) / decaySamples);
+            response[t] = static_cast<float>(tap);
+            energy += tap * tap;
+        }
+        for (UINT t = 0; t < pathLength; ++t) {
+            response[t] = static_cast<float>(response[t] * echoGain / sqrt(energy));
+        }
+
+        for (size_t i = 0; i < sampleCount; ++i) {
+            float sum = 0.0f;
+            UINT taps = (i + 1 < pathLength) ? static_cast<UINT>(i + 1) : pathLength;
+            for (UINT t = delay; t < taps; ++t) {
+                sum += response[t] * reference[i - t];
+            }
+
+            state = state * 1664525u + 1013904223u;
+            int noise = static_cast<int>(state >> 16) % (2 * nearNoiseAmplitude + 1) - nearNoiseAmplitude;
+            float sample = sum + noise;
+            sample = (sample > 32767.0f) ? 32767.0f : ((sample < -32768.0f) ? -32768.0f : sample);
+
+            echo[i * channelCount + c] = sum;
+            capture[i * channelCount + c] = static_cast<int16_t>(floorf(sample + 0.5f));
+        }
+    }
+}
+
+/// Echo return loss enhancement, in dB, of output over [begin, end) frames of capture, all channels together.
+/// Output lags capture by latency frames.
+static double MeasureErleDb(const std::vector<int16_t>& capture, const std::vector<int16_t>& output, UINT channelCount,
+    size_t begin, size_t end, UINT latency) {
+    double capturePower = 0.0;
+    double outputPower = 0.0;
+    for (size_t i = begin * channelCount; i < end * channelCount; ++i) {
+        capturePower += static_cast<double>(capture[i]) * capture[i];
+        double sample = output[i + latency * channelCount];
+        outputPower += sample * sample;
+    }
+    return 10.0 * log10((capturePower + 1.0) / (outputPower + 1.0));
+}
+
+/// Run echo canceller over captured audio in blocks the size capture delivers.
+/// <param name="canceller">initialized canceller.</param>
+/// <param name="reference">mono playback reference.</param>
+/// <param name="samples">interleaved captured samples, replaced by output.</param>
+/// <param name="channelCount">number of captured channels.</param>
+/// <param name="blockLatency">receives cost of each block.</param>
+static void RunEchoCanceller(EchoCanceller& canceller, const std::vector<int16_t>& reference, std::vector<int16_t>& samples,
+    UINT channelCount, LatencyHistogram& blockLatency) {
+    const UINT frameCount = AudioBlock::MaxSamples;
+
+    for (size_t frame = 0; frame + frameCount <= reference.size(); frame += frameCount) {
+        UINT64 start = GetClockNanoseconds();
+        canceller.Process(&samples[frame * channelCount], &reference[frame], frameCount);
+        blockLatency.Record(GetClockNanoseconds() - start);
+    }
+}
+
+/// Measure how fast the echo canceller converges on a simulated room and how much echo it
+/// removes across block sizes, tail lengths and channel counts, and its cost per channel.
+/// Then check SIMD levels converge like scalar code, and that a tonal reference is cancelled too.
+static HRESULT BenchmarkEcho(FILE* pOutput) {
+    const UINT blockSizes[] = {64, 128, 256};
+    const UINT tailLengths[] = {1024, 2048, 4096};
+    const UINT channelCounts[] = {1, 4};
+
+    // Room response fits in the shortest tail
+    const UINT pathLength = 960;
+
+    // Peak amplitudes of white noise reference and of noise at microphones
+    const int referenceAmplitude = 8000;
+    const int nearNoiseAmplitude = 20;
+
+    // Seconds of audio each configuration runs over, and window convergence is judged in
+    const UINT echoSeconds = 20;
+    const size_t windowFrames = AudioSamplesPerSecond / 10;
+
+    // Last seconds of audio, used to measure steady state enhancement
+    const size_t steadyFrames = 5 * AudioSamplesPerSecond;
+
+    size_t sampleCount = static_cast<size_t>(echoSeconds) * AudioSamplesPerSecond;
+    sampleCount -= sampleCount % AudioBlock::MaxSamples;
+    double audioSeconds = static_cast<double>(sampleCount) / AudioSamplesPerSecond;
+
+    std::vector<int16_t> reference(sampleCount);
+    uint32_t state = 1;
+    for (size_t i = 0; i < sampleCount; ++i) {
+        state = state * 1664525u + 1013904223u;
+        reference[i] = static_cast<int16_t>(static_cast<int>(state >> 16) % (2 * referenceAmplitude + 1) - referenceAmplitude);
+    }
+
+    fprintf(pOutput, "echo: %.0f s of 16 kHz white noise reference through a %u-sample room, cpu supports %s\n",
+        audioSeconds, pathLength, GetSimdLevelName(GetSimdLevel()));
+
+    std::vector<int16_t> capture;
+    std::vector<int16_t> samples;
+    std::vector<float> echo;
+    HRESULT hr = S_OK;
+
+    for (size_t c = 0; c < sizeof(channelCounts) / sizeof(channelCounts[0]); ++c) {
+        UINT channelCount = channelCounts[c];
+        GenerateEcho(reference, channelCount, pathLength, nearNoiseAmplitude, capture, echo);
+
+        for (size_t b = 0; b < sizeof(blockSizes) / sizeof(blockSizes[0]); ++b) {
+            for (size_t t = 0; t < sizeof(tailLengths) / sizeof(tailLengths[0]); ++t) {
+                EchoCanceller canceller;
+                hr = canceller.Initialize(blockSizes[b], tailLengths[t], channelCount, AudioSamplesPerSecond, GetSimdLevel());
+                if (FAILED(hr)) {
+                    return hr;
+                }
+
+                samples = capture;
+                LatencyHistogram blockLatency;
+                RunEchoCanceller(canceller, reference, samples, channelCount, blockLatency);
+
+                // Time at which each window's enhancement first reaches 10 and 20 dB
+                UINT latency = canceller.GetLatency();
+                double converge10 = -1.0;
+                double converge20 = -1.0;
+                for (size_t frame = 0; frame + windowFrames + latency <= sampleCount && converge20 < 0.0; frame += windowFrames) {
+                    double erleDb = MeasureErleDb(capture, samples, channelCount, frame, frame + windowFrames, latency);
+                    double seconds = static_cast<double>(frame + windowFrames) / AudioSamplesPerSecond;
+                    converge10 = (converge10 < 0.0 && erleDb >= 10.0) ? seconds : converge10;
+                    converge20 = (converge20 < 0.0 && erleDb >= 20.0) ? seconds : converge20;
+                }
+
+                double steadyDb = MeasureErleDb(capture, samples, channelCount, sampleCount - steadyFrames - latency, sampleCount - latency, latency);
+                bool bConverges = (steadyDb > 25.0 && converge20 > 0.0);
+                fprintf(pOutput, "  %u ch  block %3u tail %4u (%2u partitions)  10 dB at %4.2f s  20 dB at %4.2f s  steady %4.1f dB  block p50 %6.1f us p99 %6.1f us  %5.1f us/ch  %s\n",
+                    channelCount, blockSizes[b], canceller.GetTailLength(), canceller.GetPartitionCount(),
+                    converge10, converge20, steadyDb,
+                    blockLatency.GetPercentile(50.0) / 1e3,
+                    blockLatency.GetPercentile(99.0) / 1e3,
+                    blockLatency.GetPercentile(50.0) / 1e3 / channelCount,
+                    bConverges ? "ok" : "WEAK");
+
+                if (!bConverges) {
+                    hr = E_FAIL;
+                }
+            }
+        }
+    }
+
+    // Float rounding differs between instruction sets and adaptation feeds it back, so levels
+    // are compared by how much echo they remove rather than sample by sample
+    GenerateEcho(reference, 1, pathLength, nearNoiseAmplitude, capture, echo);
+    double scalarSeconds = 0.0;
+    double scalarDb = 0.0;
+
+    for (int level = SimdLevelScalar; level <= GetSimdLevel(); ++level) {
+        EchoCanceller canceller;
+        hr = canceller.Initialize(EchoCanceller::cDefaultBlockSize, EchoCanceller::cDefaultTailLength, 1, AudioSamplesPerSecond, static_cast<SimdLevel>(level));
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        samples = capture;
+        LatencyHistogram blockLatency;
+        BenchmarkTimer timer;
+        RunEchoCanceller(canceller, reference, samples, 1, blockLatency);
+        double seconds = timer.GetElapsedSeconds();
+
+        UINT latency = canceller.GetLatency();
+        double steadyDb = MeasureErleDb(capture, samples, 1, sampleCount - steadyFrames - latency, sampleCount - latency, latency);
+        if (SimdLevelScalar == level) {
+            scalarSeconds = seconds;
+            scalarDb = steadyDb;
+        }
+
+        bool bMatches = (fabs(steadyDb - scalarDb) < 1.0);
+        fprintf(pOutput, "  aec %-6s block %3u tail %4u  steady %4.1f dB  reported %4.1f dB  %6.0fx real time  %5.2fx scalar  %s\n",
+            GetSimdLevelName(static_cast<SimdLevel>(level)), canceller.GetBlockSize(), canceller.GetTailLength(),
+            steadyDb, canceller.GetEchoReturnLossEnhancementDb(),
+            audioSeconds / seconds, scalarSeconds / seconds,
+            bMatches ? "ok" : "MISMATCH");
+
+        if (!bMatches) {
+            hr = E_FAIL;
+        }
+    }
+
+    // Synthetic tone as reference excites few bins, so only those adapt, but they are all the echo holds
+    std::vector<int16_t> tone;
+    GenerateBenchmarkAudio(echoSeconds, NULL, tone);
+    tone.resize(sampleCount);
+    GenerateEcho(tone, 1, pathLength, nearNoiseAmplitude, capture, echo);
+
+    EchoCanceller canceller;
+    hr = canceller.Initialize(EchoCanceller::cDefaultBlockSize, EchoCanceller::cDefaultTailLength, 1, AudioSamplesPerSecond, GetSimdLevel());
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    samples = capture;
+    LatencyHistogram blockLatency;
+    RunEchoCanceller(canceller, tone, samples, 1, blockLatency);
+
+    UINT latency = canceller.GetLatency();
+    double toneDb = MeasureErleDb(capture, samples, 1, sampleCount - steadyFrames - latency, sampleCount - latency, latency);
+    bool bCancelsTone = (toneDb > 20.0);
+    fprintf(pOutput, "  aec tone reference  steady %4.1f dB  %s\n", toneDb, bCancelsTone ? "ok" : "WEAK");
+
+    if (!bCancelsTone) {
+        hr = E_FAIL;
+    }
+
+    return hr;
+}
+
+/// Compare cost of a binary trace record with formatting the same fields as text,
+/// the way per-block debug output used to be produced.
+static HRESULT BenchmarkTrace(FILE* pOutput) {
+    const char* szTraceFile = "AudioBasics-bench.trace";
+    const uint32_t recordCount = 1000000;
+
+    // Stay below log capacity per drain interval so records are measured, not dropped
+    const uint32_t burstSize = TraceLog::cCapacity / 2;
+
+    TraceLog traceLog;
+    HRESULT hr = traceLog.Open(szTraceFile);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    double writeSeconds = 0.0;
+    for (uint32_t written = 0; written < recordCount; written += burstSize) {
+        BenchmarkTimer timer;
+        for (uint32_t i = 0; i < burstSize; ++i) {
+            traceLog.Write(TraceEventBlockProcessed, written + i, 10.0f, -12.5f, 0.9f, 0.5f);
+        }
+        writeSeconds += timer.GetElapsedSeconds();
+
+        // Give drainer time to empty log before next burst
+        std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    }
+
+    traceLog.Close();
+    uint32_t dropped = traceLog.GetDroppedCount();
+    remove(szTraceFile);
+
+    const uint32_t textCount = recordCount / 10;
+    size_t textLength = 0;
+    BenchmarkTimer textTimer;
+    for (uint32_t i = 0; i < textCount; ++i) {
+        std::wostringstream beam;
+        beam << "Beam Angle: " << 10.0f << "\n";
+        std::wostringstream source;
+        source << "Source Angle: " << -12.5f << "\n";
+        textLength += beam.str().size() + source.str().size();
+    }
+    double textSeconds = textTimer.GetElapsedSeconds();
+
+    uint32_t burstCount = (recordCount + burstSize - 1) / burstSize;
+    fprintf(pOutput, "trace: %u records in bursts of %u\n", burstCount * burstSize, burstSize);
+    fprintf(pOutput, "  binary record  %8.1f ns/record  %u dropped\n", writeSeconds * 1e9 / (burstCount * burstSize), dropped);
+    fprintf(pOutput, "  wostringstream %8.1f ns/record  (formatting only, %u chars)\n", textSeconds * 1e9 / textCount, static_cast<UINT>(textLength / textCount));
+
+    return (0 == dropped) ? S_OK : E_FAIL;
+}
+
+/// State shared between event loop wake-up benchmark's signaling thread and loop callback.
+struct WakeBenchmarkState {
+    EventLoop               eventLoop;
+    LatencyHistogram        wakeLatency;
+
+    // Clock time at which the signal being waited for was sent.
+    std::atomic<UINT64>     signalTimestamp;
+};
+
+/// Callback run by loop for each signal of wake-up benchmark.
+/// <param name="pContext">WakeBenchmarkState of benchmark.</param>
+static void WakeBenchmarkProc(void* pContext) {
+    WakeBenchmarkState* pState = reinterpret_cast<WakeBenchmarkState*>(pContext);
+    pState->wakeLatency.Record(GetClockNanoseconds() - pState->signalTimestamp.load());
+}
+
+/// Measure how long an idle event loop takes to run callback of an event signaled from another
+/// thread, the way capture thread wakes UI thread when audio is ready.
+static HRESULT BenchmarkEventLoop(FILE* pOutput) {
+    const UINT signalCount = 2000;
+    const UINT signalIntervalMicroseconds = 500;
+
+    WakeBenchmarkState state;
+    UINT eventId = 0;
+    HRESULT hr = state.eventLoop.Initialize();
+    if (SUCCEEDED(hr)) {
+        hr = state.eventLoop.AddEvent(WakeBenchmarkProc, &state, &eventId);
+    }
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    // Signals are spaced out so loop is idle, blocked in the kernel, when each one arrives
+    std::thread signaler([&state, eventId, signalCount, signalIntervalMicroseconds]() {
+        for (UINT i = 0; i < signalCount; ++i) {
+            std::this_thread::sleep_for(std::chrono::microseconds(signalIntervalMicroseconds));
+            state.signalTimestamp.store(GetClockNanoseconds());
+            state.eventLoop.Signal(eventId);
+        }
+
+        // Let last callback run before asking loop to exit
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        state.eventLoop.Quit();
+    });
+
+    hr = state.eventLoop.Run();
+    signaler.join();
+
+    char szLatency[160];
+    state.wakeLatency.Format("wake", szLatency, sizeof(szLatency));
+    fprintf(pOutput, "eventloop: %u signals from another thread, %u us apart\n", signalCount, signalIntervalMicroseconds);
+    fprintf(pOutput, "  %s\n", szLatency);
+
+    return hr;
+}
+
+/// Checks results a capture engine delivers for each simulated sensor.
+class EngineBenchmarkSink : public CaptureResultSink {
+public:
+    EngineBenchmarkSink() {
+        for (UINT i = 0; i < CaptureEngine::cMaxSensors; ++i) {
+            m_resultCount[i] = 0;
+            m_nextSequence[i] = 0;
+            m_outOfOrderCount[i] = 0;
+        }
+    }
+
+    /// Called on worker threads; calls for one sensor never overlap, so per-sensor counters need no lock.
+    virtual void OnBlockProcessed(UINT sensorIndex, const AudioPipelineResult& result) {
+        // Sequence numbers of blocks dropped by overruns are skipped, but must never go backwards
+        if (result.sequence < m_nextSequence[sensorIndex]) {
+            ++m_outOfOrderCount[sensorIndex];
+        }
+        m_nextSequence[sensorIndex] = result.sequence + 1;
+        ++m_resultCount[sensorIndex];
+    }
+
+    UINT64                  m_resultCount[CaptureEngine::cMaxSensors];
+    uint32_t                m_nextSequence[CaptureEngine::cMaxSensors];
+    UINT                    m_outOfOrderCount[CaptureEngine::cMaxSensors];
+};
+
+/// Capture from the largest number of simulated sensors an engine supports, half of them raw
+/// microphone arrays, in real time, and check every captured block is processed once, in order.
+static HRESULT BenchmarkEngine(FILE* pOutput) {
+    const UINT sensorCount = CaptureEngine::cMaxSensors;
+    const UINT workerCount = 2;
+    const UINT seconds = 3;
+
+    MicrophoneArrayGeometry geometry = GetKinectArrayGeometry();
+    CaptureEngine engine;
+    for (UINT i = 0; i < sensorCount; ++i) {
+        UINT sensorIndex = 0;
+        HRESULT hr = engine.AddSensor(new SyntheticAudioSource(true, seconds * AudioSamplesPerSecond, (i % 2) ? &geometry : NULL), AudioEnhancementNone, &sensorIndex);
+        if (FAILED(hr)) {
+            return hr;
+        }
+    }
+
+    EngineBenchmarkSink sink;
+    BenchmarkTimer timer;
+    HRESULT hr = engine.Start(workerCount, &sink, NULL);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    UINT runningWorkerCount = engine.GetWorkerCount();
+    while (!engine.IsIdle()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int>(CaptureEngine::cCaptureInterval)));
+    }
+    engine.Stop();
+    double elapsedSeconds = timer.GetElapsedSeconds();
+
+    fprintf(pOutput, "engine: %u simulated sensors, %u workers, %u s of real-time audio in %.2f s\n",
+        sensorCount, runningWorkerCount, seconds, elapsedSeconds);
+
+    for (UINT i = 0; i < sensorCount; ++i) {
+        SensorStatus status;
+        engine.GetSensorStatus(i, &status);
+
+        const LatencyHistogram& captureCallLatency = engine.GetCaptureCallLatency(i);
+        fprintf(pOutput, "  sensor %u  %u ch  captured %4llu  processed %4llu  delivered %4llu  out of order %u  overruns %u  read p99 %.3f ms  beam %6.1f deg\n",
+            i, (i % 2) ? geometry.microphoneCount : 1,
+            static_cast<unsigned long long>(status.blocksCaptured),
+            static_cast<unsigned long long>(status.blocksProcessed),
+            static_cast<unsigned long long>(sink.m_resultCount[i]),
+            sink.m_outOfOrderCount[i],
+            status.overrunCount,
+            captureCallLatency.GetPercentile(99.0) / 1e6,
+            status.beamAngleDegrees);
+
+        if (FAILED(status.captureResult) || 0 != status.overrunCount || 0 != sink.m_outOfOrderCount[i] ||
+            status.blocksProcessed != status.blocksCaptured || sink.m_resultCount[i] != status.blocksCaptured ||
+            status.samplesProcessed != static_cast<UINT64>(seconds) * AudioSamplesPerSecond) {
+            hr = E_FAIL;
+        }
+    }
+
+    return hr;
+}
+
+/// Fill bytes with frames of pseudo-random samples in a capture format. Float samples run a little
+/// beyond full scale, so clipping is exercised too.
+/// <param name="format">format of frames.</param>
+/// <param name="frameCount">number of frames.</param>
+/// <param name="bytes">receives frames.</param>
+static void GenerateFormatFrames(const WAVEFORMATEX& format, UINT frameCount, std::vector<BYTE>& bytes) {
+    const UINT sampleCount = frameCount * format.nChannels;
+    const UINT bytesPerSample = format.wBitsPerSample / 8;
+    bytes.resize(static_cast<size_t>(sampleCount) * bytesPerSample);
+    uint32_t state = 11;
+
+    for (UINT i = 0; i < sampleCount; ++i) {
+        state = state * 1664525u + 1013904223u;
+        BYTE* pSample = &bytes[static_cast<size_t>(i) * bytesPerSample];
+
+        if (WAVE_FORMAT_IEEE_FLOAT == format.wFormatTag) {
+            float value = (static_cast<float>(state >> 8) / (1 << 24) * 2.0f - 1.0f) * 1.1f;
+            memcpy(pSample, &value, sizeof(value));
+        }
+        else if (4 == bytesPerSample) {
+            int32_t value = static_cast<int32_t>(state);
+            memcpy(pSample, &value, sizeof(value));
+        }
+        else {
+            int16_t value = static_cast<int16_t>(state >> 16);
+            memcpy(pSample, &value, sizeof(value));
+        }
+    }
+}
+
+/// Convert captured audio of several formats to 16-bit PCM with the conversion loop instantiated for
+/// each format, and with the generic loop that reads sample type and channel count at run time.
+/// Checks both produce the same samples, and that a format with no loop of its own falls back to generic one.
+static HRESULT BenchmarkSampleFormat(FILE* pOutput) {
+    struct FormatCase {
+        const char*     szName;
+        WORD            formatTag;
+        WORD            channels;
+        DWORD           samplesPerSecond;
+        WORD            bitsPerSample;
+    };
+
+    const FormatCase cases[] = {
+        {"pcm16 x1 16k", WAVE_FORMAT_PCM, 1, 16000, 16},
+        {"pcm16 x2 16k", WAVE_FORMAT_PCM, 2, 16000, 16},
+        {"pcm16 x4 16k", WAVE_FORMAT_PCM, 4, 16000, 16},
+        {"pcm32 x4 16k", WAVE_FORMAT_PCM, 4, 16000, 32},
+        {"float x1 16k", WAVE_FORMAT_IEEE_FLOAT, 1, 16000, 32},
+        {"float x4 16k", WAVE_FORMAT_IEEE_FLOAT, 4, 16000, 32},
+        {"float x4 48k", WAVE_FORMAT_IEEE_FLOAT, 4, 48000, 32},
+    };
+    const UINT frameCount = 10 * AudioSamplesPerSecond;
+    const UINT repetitions = 20;
+    const char* mappingNames[] = {"keep", "mix"};
+
+    fprintf(pOutput, "format: %u frames x %u to 16-bit PCM, specialized and generic conversion loops\n", frameCount, repetitions);
+
+    HRESULT hr = S_OK;
+    for (size_t f = 0; f < sizeof(cases) / sizeof(cases[0]) && SUCCEEDED(hr); ++f) {
+        WAVEFORMATEX format;
+        format.wFormatTag = cases[f].formatTag;
+        format.nChannels = cases[f].channels;
+        format.nSamplesPerSec = cases[f].samplesPerSecond;
+        format.wBitsPerSample = cases[f].bitsPerSample;
+        format.nBlockAlign = static_cast<WORD>(format.nChannels * format.wBitsPerSample / 8);
+        format.nAvgBytesPerSec = format.nSamplesPerSec * format.nBlockAlign;
+        format.cbSize = 0;
+
+        std::vector<BYTE> frames;
+        GenerateFormatFrames(format, frameCount, frames);
+
+        for (int mapping = ChannelMappingKeep; mapping <= ChannelMappingMixDown && SUCCEEDED(hr); ++mapping) {
+            SampleConverter specialized;
+            SampleConverter generic;
+            hr = specialized.Initialize(format, static_cast<ChannelMapping>(mapping), true);
+            if (SUCCEEDED(hr)) {
+                hr = generic.Initialize(format, static_cast<ChannelMapping>(mapping), false);
+            }
+            if (FAILED(hr)) {
+                break;
+            }
+
+            std::vector<int16_t> specializedOutput(static_cast<size_t>(frameCount) * specialized.GetOutputChannelCount());
+            std::vector<int16_t> genericOutput(specializedOutput.size());
+
+            BenchmarkTimer genericTimer;
+            for (UINT r = 0; r < repetitions; ++r) {
+                generic.Convert(&frames[0], frameCount, &genericOutput[0]);
+            }
+            double genericSeconds = genericTimer.GetElapsedSeconds();
+
+            BenchmarkTimer specializedTimer;
+            for (UINT r = 0; r < repetitions; ++r) {
+                specialized.Convert(&frames[0], frameCount, &specializedOutput[0]);
+            }
+            double specializedSeconds = specializedTimer.GetElapsedSeconds();
+
+            // Only 16 kHz formats have loops of their own; others must fall back
+            bool bExpectSpecialized = (AudioSamplesPerSecond == format.nSamplesPerSec);
+            bool bMatches = (specializedOutput == genericOutput) && (bExpectSpecialized == specialized.IsSpecialized());
+            double totalFrames = static_cast<double>(frameCount) * repetitions;
+
+            fprintf(pOutput, "  %-13s %-4s  generic %7.1f Mframes/s  %-11s %7.1f Mframes/s  %5.2fx  %s\n",
+                cases[f].szName, mappingNames[mapping], totalFrames / genericSeconds / 1e6,
+                specialized.IsSpecialized() ? "specialized" : "generic", totalFrames / specializedSeconds / 1e6,
+                genericSeconds / specializedSeconds, bMatches ? "matches generic" : "MISMATCH");
+
+            if (!bMatches) {
+                hr = E_FAIL;
+            }
+        }
+    }
+
+    return hr;
+}
+
+/// Run mono audio through a multi-rate resampler in blocks, appending every output.
+/// <param name="resampler">initialized resampler.</param>
+/// <param name="input">16 kHz mono samples.</param>
+/// <param name="outputs">receive each output's samples, appended.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+static HRESULT RunResampler(MultiRateResampler& resampler, const std::vector<int16_t>& input, std::vector<int16_t>* outputs) {
+    int16_t blockOutputs[MultiRateResampler::cMaxOutputs][4 * AudioBlock::MaxSamples];
+    int16_t* pBlockOutputs[MultiRateResampler::cMaxOutputs];
+    UINT blockCounts[MultiRateResampler::cMaxOutputs];
+    for (UINT o = 0; o < MultiRateResampler::cMaxOutputs; ++o) {
+        pBlockOutputs[o] = blockOutputs[o];
+    }
+
+    for (size_t i = 0; i < input.size(); i += AudioBlock::MaxSamples) {
+        UINT count = static_cast<UINT>((input.size() - i < AudioBlock::MaxSamples) ? input.size() - i : AudioBlock::MaxSamples);
+        HRESULT hr = resampler.Process(&input[i], count, 1, pBlockOutputs, blockCounts);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        for (UINT o = 0; o < resampler.GetOutputCount(); ++o) {
+            outputs[o].insert(outputs[o].end(), blockOutputs[o], blockOutputs[o] + blockCounts[o]);
+        }
+    }
+
+    return S_OK;
+}
+
+/// Time resampling of mono audio in blocks, outputs discarded, taking best of several passes.
+/// <param name="resampler">initialized resampler.</param>
+/// <param name="input">16 kHz mono samples.</param>
+/// <param name="passes">number of times input is resampled.</param>
+/// <returns>seconds taken by fastest pass.</returns>
+static double TimeResampler(MultiRateResampler& resampler, const std::vector<int16_t>& input, UINT passes) {
+    int16_t blockOutputs[MultiRateResampler::cMaxOutputs][4 * AudioBlock::MaxSamples];
+    int16_t* pBlockOutputs[MultiRateResampler::cMaxOutputs];
+    UINT blockCounts[MultiRateResampler::cMaxOutputs];
+    for (UINT o = 0; o < MultiRateResampler::cMaxOutputs; ++o) {
+        pBlockOutputs[o] = blockOutputs[o];
+    }
+
+    double bestSeconds = 0.0;
+    for (UINT p = 0; p < passes; ++p) {
+        resampler.Reset();
+
+        BenchmarkTimer timer;
+        for (size_t i = 0; i < input.size(); i += AudioBlock::MaxSamples) {
+            UINT count = static_cast<UINT>((input.size() - i < AudioBlock::MaxSamples) ? input.size() - i : AudioBlock::MaxSamples);
+            resampler.Process(&input[i], count, 1, pBlockOutputs, blockCounts);
+        }
+        double seconds = timer.GetElapsedSeconds();
+
+        bestSeconds = (0 == p || seconds < bestSeconds) ? seconds : bestSeconds;
+    }
+
+    return bestSeconds;
+}
+
+/// Fit a sinusoid of known frequency to samples by least squares.
+/// <param name="samples">samples to fit.</param>
+/// <param name="begin">first sample fitted.</param>
+/// <param name="frequency">frequency of sinusoid, in cycles per sample.</param>
+/// <param name="pAmplitude">receives amplitude of fitted sinusoid.</param>
+/// <param name="pResidualMeanSquare">receives mean square of what fit leaves unexplained.</param>
+static void FitSinusoid(const std::vector<int16_t>& samples, size_t begin, double frequency, double* pAmplitude, double* pResidualMeanSquare) {
+    double ss = 0.0;
+    double sc = 0.0;
+    double cc = 0.0;
+    double xs = 0.0;
+    double xc = 0.0;
+    for (size_t i = begin; i < samples.size(); ++i) {
+        double s = sin(2.0 * M_PI * frequency * i);
+        double c = cos(2.0 * M_PI * frequency * i);
+        ss += s * s;
+        sc += s * c;
+        cc += c * c;
+        xs += samples[i] * s;
+        xc += samples[i] * c;
+    }
+
+    double determinant = ss * cc - sc * sc;
+    double a = (xs * cc - xc * sc) / determinant;
+    double b = (xc * ss - xs * sc) / determinant;
+    *pAmplitude = sqrt(a * a + b * b);
+
+    double residual = 0.0;
+    for (size_t i = begin; i < samples.size(); ++i) {
+        double error = samples[i] - a * sin(2.0 * M_PI * frequency * i) - b * cos(2.0 * M_PI * frequency * i);
+        residual += error * error;
+    }
+    *pResidualMeanSquare = residual / (samples.size() - begin);
+}
+
+/// Measure gain and purity of tones resampled from 16 kHz to telephony, CD and studio rates at every
+/// quality preset, and rejection of a tone above telephony Nyquist. Then check SIMD output against
+/// scalar output and compare cost of each rate alone with all rates from one shared input.
+static HRESULT BenchmarkResample(FILE* pOutput) {
+    const UINT outputRates[] = {8000, 44100, 48000};
+    const UINT rateCount = sizeof(outputRates) / sizeof(outputRates[0]);
+    const char* qualityNames[] = {"low", "medium", "high"};
+    const UINT toneSeconds = 2;
+    const double toneAmplitude = 16384.0;
+
+    // Passband tone, tone near telephony band edge, and tone telephony output must reject
+    const double toneFrequencies[] = {1000.0, 3000.0, 6000.0};
+    const UINT toneCount = sizeof(toneFrequencies) / sizeof(toneFrequencies[0]);
+
+    fprintf(pOutput, "resample: 16 kHz tones to %u, %u and %u Hz; gain and residual relative to input tone, in dB\n",
+        outputRates[0], outputRates[1], outputRates[2]);
+
+    HRESULT hr = S_OK;
+    for (int quality = ResamplerQualityLow; quality <= ResamplerQualityHigh && SUCCEEDED(hr); ++quality) {
+        for (UINT t = 0; t < toneCount && SUCCEEDED(hr); ++t) {
+            std::vector<int16_t> tone(toneSeconds * AudioSamplesPerSecond);
+            for (size_t i = 0; i < tone.size(); ++i) {
+                tone[i] = static_cast<int16_t>(toneAmplitude * sin(2.0 * M_PI * toneFrequencies[t] * i / AudioSamplesPerSecond));
+            }
+
+            MultiRateResampler resampler;
+            hr = resampler.Initialize(AudioSamplesPerSecond, outputRates, rateCount, static_cast<ResamplerQuality>(quality), AudioBlock::MaxSamples, GetSimdLevel());
+            std::vector<int16_t> outputs[MultiRateResampler::cMaxOutputs];
+            if (SUCCEEDED(hr)) {
+                hr = RunResampler(resampler, tone, outputs);
+            }
+
+            for (UINT r = 0; r < rateCount && SUCCEEDED(hr); ++r) {
+                // Skip start-up transient, which lasts as long as filter
+                size_t skip = 2 * resampler.GetResampler(r).GetLatency() + 1;
+                double inputMeanSquare = toneAmplitude * toneAmplitude / 2.0;
+                double amplitude = 0.0;
+                double residual = 0.0;
+                if (2.0 * toneFrequencies[t] < outputRates[r]) {
+                    FitSinusoid(outputs[r], skip, toneFrequencies[t] / outputRates[r], &amplitude, &residual);
+                    fprintf(pOutput, "  %-6s %5u Hz tone to %5u Hz  gain %6.2f  residual %7.1f\n", qualityNames[quality],
+                        static_cast<UINT>(toneFrequencies[t]), outputRates[r], 20.0 * log10(amplitude / toneAmplitude),
+                        10.0 * log10(residual / inputMeanSquare + 1e-20));
+                }
+                else {
+                    // Whole output is alias of a tone output can't represent
+                    double meanSquare = 0.0;
+                    for (size_t i = skip; i < outputs[r].size(); ++i) {
+                        meanSquare += static_cast<double>(outputs[r][i]) * outputs[r][i];
+                    }
+                    meanSquare /= (outputs[r].size() - skip);
+                    fprintf(pOutput, "  %-6s %5u Hz tone to %5u Hz  rejected %7.1f\n", qualityNames[quality],
+                        static_cast<UINT>(toneFrequencies[t]), outputRates[r], 10.0 * log10(meanSquare / inputMeanSquare + 1e-20));
+                }
+            }
+        }
+    }
+
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    std::vector<int16_t> input;
+    GenerateBenchmarkAudio(cBenchmarkAudioSeconds, NULL, input);
+    double audioSeconds = static_cast<double>(input.size()) / AudioSamplesPerSecond;
+
+    const UINT passes = 5;
+    fprintf(pOutput, "resample: %u s of synthetic audio, medium quality, each rate alone and all together, best of %u passes\n", cBenchmarkAudioSeconds, passes);
+
+    SimdLevel maxLevel = GetSimdLevel();
+    for (int level = SimdLevelScalar; level <= maxLevel && SUCCEEDED(hr); ++level) {
+        double separateSeconds = 0.0;
+
+        for (UINT r = 0; r <= rateCount && SUCCEEDED(hr); ++r) {
+            // Last pass takes every rate at once
+            const UINT* pRates = (r < rateCount) ? &outputRates[r] : outputRates;
+            UINT count = (r < rateCount) ? 1 : rateCount;
+
+            MultiRateResampler scalar;
+            MultiRateResampler resampler;
+            hr = scalar.Initialize(AudioSamplesPerSecond, pRates, count, ResamplerQualityMedium, AudioBlock::MaxSamples, SimdLevelScalar);
+            if (SUCCEEDED(hr)) {
+                hr = resampler.Initialize(AudioSamplesPerSecond, pRates, count, ResamplerQualityMedium, AudioBlock::MaxSamples, static_cast<SimdLevel>(level));
+            }
+
+            std::vector<int16_t> expected[MultiRateResampler::cMaxOutputs];
+            std::vector<int16_t> actual[MultiRateResampler::cMaxOutputs];
+            if (SUCCEEDED(hr)) {
+                hr = RunResampler(scalar, input, expected);
+            }
+            if (SUCCEEDED(hr)) {
+                resampler.Reset();
+                hr = RunResampler(resampler, input, actual);
+            }
+            if (FAILED(hr)) {
+                break;
+            }
+
+            double seconds = TimeResampler(resampler, input, passes);
+
+            // Summation order differs between kernels, which can move rounding by one step
+            int maxDifference = 0;
+            bool bSameLength = true;
+            for (UINT o = 0; o < count; ++o) {
+                bSameLength = bSameLength && (expected[o].size() == actual[o].size());
+                for (size_t i = 0; bSameLength && i < expected[o].size(); ++i) {
+                    int difference = abs(expected[o][i] - actual[o][i]);
+                    maxDifference = (difference > maxDifference) ? difference : maxDifference;
+                }
+            }
+            bool bMatches = bSameLength && maxDifference <= 1;
+
+            if (r < rateCount) {
+                separateSeconds += seconds;
+                fprintf(pOutput, "  %-6s to %5u Hz          %8.1f x real time  max diff %d  %s\n", GetSimdLevelName(static_cast<SimdLevel>(level)),
+                    outputRates[r], audioSeconds / seconds, maxDifference, bMatches ? "matches scalar" : "MISMATCH");
+            }
+            else {
+                fprintf(pOutput, "  %-6s to all together    %8.1f x real time  max diff %d  %s  (%.2fx time of separate runs)\n",
+                    GetSimdLevelName(static_cast<SimdLevel>(level)), audioSeconds / seconds, maxDifference,
+                    bMatches ? "matches scalar" : "MISMATCH", seconds / separateSeconds);
+            }
+
+            if (!bMatches) {
+                hr = E_FAIL;
+            }
+        }
+    }
+
+    return hr;
+}
+
+/// Sample a recorder benchmark writes at a frame and channel, so read back audio can be checked exactly.
+/// <param name="frame">index of frame since start of stream.</param>
+/// <param name="channel">index of channel.</param>
+static int16_t GetRecordedSample(UINT64 frame, UINT channel) {
+    return static_cast<int16_t>((frame * 31 + channel * 7919) & 0xFFFF);
+}
+
+/// Feed blocks of patterned 4-channel audio to a recorder, then close it.
+/// <param name="recorder">open recorder.</param>
+/// <param name="blockCount">number of blocks to append.</param>
+/// <param name="speed">multiple of real time to append blocks at, or 0 to append them as fast as recorder takes them.</param>
+/// <param name="pResult">scratch result carrying each block's position and angles.</param>
+/// <param name="pSeconds">receives time from first append to file being closed.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+static HRESULT RunRecorder(AudioRecorder& recorder, UINT blockCount, double speed, AudioPipelineResult* pResult, double* pSeconds) {
+    const UINT channelCount = AudioBlock::MaxChannels;
+    std::vector<int16_t> samples(AudioBlock::MaxSamples * channelCount);
+
+    AudioBlock block;
+    memset(&block, 0, sizeof(block));
+    block.sampleCount = AudioBlock::MaxSamples;
+    block.channelCount = channelCount;
+    block.pSamples = &samples[0];
+
+    BenchmarkTimer timer;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    HRESULT hr = S_OK;
+    for (UINT b = 0; b < blockCount && SUCCEEDED(hr); ++b) {
+        UINT64 position = static_cast<UINT64>(b) * AudioBlock::MaxSamples;
+        if (speed > 0.0) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<long long>(position * 1e6 / (AudioSamplesPerSecond * speed))));
+        }
+
+        for (UINT i = 0; i < AudioBlock::MaxSamples; ++i) {
+            for (UINT c = 0; c < channelCount; ++c) {
+                samples[i * channelCount + c] = GetRecordedSample(position + i, c);
+            }
+        }
+
+        block.sequence = b;
+        pResult->sequence = b;
+        pResult->samplePosition = position;
+        pResult->sampleCount = AudioBlock::MaxSamples;
+        pResult->beamAngleDegrees = static_cast<float>(b % 100) - 50.0f;
+        hr = recorder.Append(block, *pResult);
+    }
+
+    HRESULT hrClose = recorder.Close();
+    *pSeconds = timer.GetElapsedSeconds();
+
+    return SUCCEEDED(hr) ? hrClose : hr;
+}
+
+/// Read every batch of a recording back and compare it with what RunRecorder appended.
+/// <param name="reader">open reader.</param>
+/// <returns>S_OK if every frame and track record read back matches, otherwise failure code.</returns>
+static HRESULT VerifyRecording(RecordingReader& reader) {
+    std::vector<int16_t> frames;
+    std::vector<RecordingTrackRecord> records;
+
+    for (UINT batch = 0; batch < reader.GetBatchCount(); ++batch) {
+        const RecordingIndexEntry& entry = reader.GetBatch(batch);
+        frames.resize(static_cast<size_t>(entry.frameCount) * reader.GetChannelCount());
+        records.resize(entry.trackCount);
+        if (frames.empty() || records.empty() ||
+            FAILED(reader.ReadFrames(batch, &frames[0])) || FAILED(reader.ReadTracks(batch, &records[0])) ||
+            reader.FindBatch(entry.firstSample + entry.frameCount - 1) != batch) {
+            return E_FAIL;
+        }
+
+        for (UINT i = 0; i < entry.frameCount; ++i) {
+            for (UINT c = 0; c < reader.GetChannelCount(); ++c) {
+                if (frames[i * reader.GetChannelCount() + c] != GetRecordedSample(entry.firstSample + i, c)) {
+                    return E_FAIL;
+                }
+            }
+        }
+
+        if (records[0].samplePosition != entry.firstSample ||
+            records[0].beamAngleDegrees != static_cast<float>(records[0].sequence % 100) - 50.0f) {
+            return E_FAIL;
+        }
+    }
+
+    return S_OK;
+}
+
+/// Copy the start of a file, as if writing it had stopped there.
+/// <param name="szSource">file to copy.</param>
+/// <param name="szDestination">file to create.</param>
+/// <param name="cbCopy">number of bytes to copy.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+static HRESULT CopyFilePrefix(const char* szSource, const char* szDestination, UINT64 cbCopy) {
+    FILE* pSource = fopen(szSource, "rb");
+    FILE* pDestination = fopen(szDestination, "wb");
+    HRESULT hr = (NULL != pSource && NULL != pDestination) ? S_OK : E_FAIL;
+
+    std::vector<BYTE> buffer(65536);
+    while (SUCCEEDED(hr) && cbCopy > 0) {
+        size_t cbChunk = (cbCopy < buffer.size()) ? static_cast<size_t>(cbCopy) : buffer.size();
+        if (1 != fread(&buffer[0], cbChunk, 1, pSource) || 1 != fwrite(&buffer[0], cbChunk, 1, pDestination)) {
+            hr = E_FAIL;
+        }
+        cbCopy -= cbChunk;
+    }
+
+    if (NULL != pSource) {
+        fclose(pSource);
+    }
+    if (NULL != pDestination && 0 != fclose(pDestination)) {
+        hr = E_FAIL;
+    }
+
+    return hr;
+}
+
+/// Measure sustained throughput and tail latency of recorder at several batch lengths, first
+/// waiting for disk at full speed as offline processing does, then paced and dropping blocks
+/// rather than waiting, as live capture does.
+/// Check that recordings read back exactly, and that one cut short mid-batch keeps every
+/// complete batch before the cut.
+static HRESULT BenchmarkRecord(FILE* pOutput) {
+    const char* szRecordFile = "AudioBasics-bench.rec";
+    const char* szTruncatedFile = "AudioBasics-bench-truncated.rec";
+    const UINT batchLengths[] = {250, 1000, 4000};
+    const UINT batchLengthCount = sizeof(batchLengths) / sizeof(batchLengths[0]);
+    const double pacedSpeed = 50.0;
+    const UINT blockCount = cBenchmarkAudioSeconds * AudioSamplesPerSecond / AudioBlock::MaxSamples;
+    double audioSeconds = static_cast<double>(blockCount) * AudioBlock::MaxSamples / AudioSamplesPerSecond;
+
+    AudioPipelineResult* pResult = new AudioPipelineResult();
+    memset(pResult, 0, sizeof(*pResult));
+
+    fprintf(pOutput, "record: %.0f s of %u-channel audio in %u-sample blocks; wait: as fast as recorder takes them, drop: paced at %.0fx real time\n",
+        audioSeconds, AudioBlock::MaxChannels, AudioBlock::MaxSamples, pacedSpeed);
+
+    HRESULT hr = S_OK;
+    for (UINT mode = 0; mode < 2 && SUCCEEDED(hr); ++mode) {
+        bool bWaitWhenFull = (0 == mode);
+        for (UINT l = 0; l < batchLengthCount && SUCCEEDED(hr); ++l) {
+            AudioRecorder recorder;
+            double seconds = 0.0;
+            hr = recorder.Open(szRecordFile, AudioBlock::MaxChannels, AudioSamplesPerSecond, batchLengths[l], bWaitWhenFull);
+            if (SUCCEEDED(hr)) {
+                hr = RunRecorder(recorder, blockCount, bWaitWhenFull ? 0.0 : pacedSpeed, pResult, &seconds);
+            }
+
+            RecordingReader reader;
+            if (SUCCEEDED(hr)) {
+                hr = reader.Open(szRecordFile);
+            }
+            if (SUCCEEDED(hr)) {
+                hr = VerifyRecording(reader);
+            }
+            if (SUCCEEDED(hr) && (reader.IsRecovered() || reader.GetDroppedCount() != recorder.GetDroppedCount() ||
+                reader.GetFrameCount() + static_cast<UINT64>(recorder.GetDroppedCount()) * AudioBlock::MaxSamples != static_cast<UINT64>(blockCount) * AudioBlock::MaxSamples)) {
+                hr = E_FAIL;
+            }
+
+            // Cut waiting recording short partway through its middle batch, as a crash would
+            if (SUCCEEDED(hr) && bWaitWhenFull && reader.GetBatchCount() > 1) {
+                UINT keptBatches = reader.GetBatchCount() / 2;
+                const RecordingIndexEntry& cut = reader.GetBatch(keptBatches);
+                hr = CopyFilePrefix(szRecordFile, szTruncatedFile, cut.pcmOffset + (cut.trackOffset - cut.pcmOffset) / 2);
+
+                RecordingReader truncated;
+                if (SUCCEEDED(hr)) {
+                    hr = truncated.Open(szTruncatedFile);
+                }
+                if (SUCCEEDED(hr)) {
+                    hr = VerifyRecording(truncated);
+                }
+                if (SUCCEEDED(hr) && (!truncated.IsRecovered() || truncated.GetBatchCount() != keptBatches)) {
+                    hr = E_FAIL;
+                }
+                remove(szTruncatedFile);
+            }
+
+            if (SUCCEEDED(hr)) {
+                const LatencyHistogram& append = recorder.GetAppendLatency();
+                const LatencyHistogram& write = recorder.GetWriteLatency();
+                fprintf(pOutput, "  %-4s %4u ms batches  %7.1f MB/s  %6.0fx real time  append p50 %5.2f us p99 %6.2f us max %8.1f us"
+                    "  write p50 %6.2f ms p99 %6.2f ms max %6.2f ms  %u dropped%s\n",
+                    bWaitWhenFull ? "wait" : "drop", batchLengths[l], recorder.GetBytesWritten() / 1e6 / seconds, audioSeconds / seconds,
+                    append.GetPercentile(50.0) / 1e3, append.GetPercentile(99.0) / 1e3, append.GetMax() / 1e3,
+                    write.GetPercentile(50.0) / 1e6, write.GetPercentile(99.0) / 1e6, write.GetMax() / 1e6,
+                    recorder.GetDroppedCount(), bWaitWhenFull ? "  truncated copy recovered" : "");
+            }
+        }
+    }
+
+    remove(szRecordFile);
+    delete pResult;
+
+    return hr;
+}
+
+/// Write a session of patterned 4-channel audio, using same pattern as recorder benchmark.
+/// <param name="szPath">path of file to create.</param>
+/// <param name="blockCount">number of blocks to write.</param>
+/// <param name="pSeconds">receives time taken to write and close file.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+static HRESULT WriteBenchmarkSession(const char* szPath, UINT blockCount, double* pSeconds) {
+    const UINT channelCount = AudioBlock::MaxChannels;
+    std::vector<int16_t> samples(AudioBlock::MaxSamples * channelCount);
+    AudioAngles angles;
+    memset(&angles, 0, sizeof(angles));
+
+    BenchmarkTimer timer;
+    SessionFileWriter writer;
+    HRESULT hr = writer.Open(szPath, channelCount, AudioSamplesPerSecond);
+    for (UINT b = 0; b < blockCount && SUCCEEDED(hr); ++b) {
+        UINT64 position = static_cast<UINT64>(b) * AudioBlock::MaxSamples;
+        for (UINT i = 0; i < AudioBlock::MaxSamples; ++i) {
+            for (UINT c = 0; c < channelCount; ++c) {
+                samples[i * channelCount + c] = GetRecordedSample(position + i, c);
+            }
+        }
+
+        angles.beamAngle = static_cast<double>(b % 100) - 50.0;
+        hr = writer.Write(&samples[0], AudioBlock::MaxSamples, angles, position * 1000000000ull / AudioSamplesPerSecond);
+    }
+
+    HRESULT hrClose = writer.Close();
+    *pSeconds = timer.GetElapsedSeconds();
+
+    return SUCCEEDED(hr) ? hrClose : hr;
+}
+
+/// Check that a block of a session written by WriteBenchmarkSession reads back exactly.
+/// <param name="reader">open reader.</param>
+/// <param name="index">index of block.</param>
+/// <returns>true if block's position, angle and samples are those written.</returns>
+static bool IsSessionBlockIntact(const SessionReader& reader, UINT64 index) {
+    const SessionBlockHeader& header = reader.GetBlockHeader(index);
+    AudioBlock block;
+    reader.GetBlock(index, &block);
+
+    if (header.samplePosition != index * AudioBlock::MaxSamples || block.sampleCount != AudioBlock::MaxSamples ||
+        header.angles.beamAngle != static_cast<double>(index % 100) - 50.0) {
+        return false;
+    }
+
+    for (UINT i = 0; i < block.sampleCount; ++i) {
+        for (UINT c = 0; c < block.channelCount; ++c) {
+            if (block.pSamples[i * block.channelCount + c] != GetRecordedSample(header.samplePosition + i, c)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/// Measure session files at two lengths, ten times apart: time to open one, which should not
+/// grow with its length, latency of seeking to random positions, rate of scanning every
+/// sample through views into mapping, and rate of replaying through the processing pipeline as
+/// fast as possible. Check blocks read back exactly, including from a copy cut short mid-block.
+static HRESULT BenchmarkSession(FILE* pOutput) {
+    const char* szSessionFile = "AudioBasics-bench.ses";
+    const char* szTruncatedFile = "AudioBasics-bench-truncated.ses";
+    const UINT sessionSeconds[] = {cBenchmarkAudioSeconds, cBenchmarkAudioSeconds * 10};
+    const UINT sessionLengthCount = sizeof(sessionSeconds) / sizeof(sessionSeconds[0]);
+    const UINT openCount = 100;
+    const UINT seekCount = 100000;
+
+    fprintf(pOutput, "session: %u-channel audio in %u-sample blocks; open, %u random seeks, scan of every sample through mapping, replay as fast as possible\n",
+        AudioBlock::MaxChannels, AudioBlock::MaxSamples, seekCount);
+
+    HRESULT hr = S_OK;
+    for (UINT l = 0; l < sessionLengthCount && SUCCEEDED(hr); ++l) {
+        UINT blockCount = sessionSeconds[l] * AudioSamplesPerSecond / AudioBlock::MaxSamples;
+        double audioSeconds = static_cast<double>(blockCount) * AudioBlock::MaxSamples / AudioSamplesPerSecond;
+        double writeSeconds = 0.0;
+        hr = WriteBenchmarkSession(szSessionFile, blockCount, &writeSeconds);
+
+        // Open and close repeatedly; first open may also fault in file system metadata
+        double openSeconds = 0.0;
+        for (UINT i = 0; i < openCount && SUCCEEDED(hr); ++i) {
+            SessionReader reader;
+            BenchmarkTimer timer;
+            hr = reader.Open(szSessionFile);
+            openSeconds += timer.GetElapsedSeconds();
+            if (SUCCEEDED(hr) && (reader.IsRecovered() || reader.GetBlockCount() != blockCount)) {
+                hr = E_FAIL;
+            }
+        }
+
+        SessionReader reader;
+        if (SUCCEEDED(hr)) {
+            hr = reader.Open(szSessionFile);
+        }
+
+        // Seek to random sample positions and touch first sample of each block found
+        LatencyHistogram seekLatency;
+        uint32_t state = 12345;
+        UINT64 endPosition = reader.GetEndPosition();
+        int64_t checksum = 0;
+        for (UINT i = 0; i < seekCount && SUCCEEDED(hr); ++i) {
+            state = state * 1664525u + 1013904223u;
+            UINT64 position = (static_cast<UINT64>(state) * endPosition) >> 32;
+
+            UINT64 start = GetClockNanoseconds();
+            UINT64 index = reader.FindBlock(position);
+            AudioBlock block;
+            reader.GetBlock(index, &block);
+            checksum += block.pSamples[0];
+            seekLatency.Record(GetClockNanoseconds() - start);
+
+            if (index != position / AudioBlock::MaxSamples) {
+                hr = E_FAIL;
+            }
+        }
+
+        // Scan every sample in place, as an analysis pass over a session would
+        double scanSeconds = 0.0;
+        if (SUCCEEDED(hr)) {
+            BenchmarkTimer timer;
+            for (UINT64 b = 0; b < reader.GetBlockCount(); ++b) {
+                AudioBlock block;
+                reader.GetBlock(b, &block);
+                for (UINT i = 0; i < block.sampleCount * block.channelCount; ++i) {
+                    checksum += block.pSamples[i];
+                }
+            }
+            scanSeconds = timer.GetElapsedSeconds();
+        }
+
+        for (UINT64 b = 0; b < reader.GetBlockCount() && SUCCEEDED(hr); b += 97) {
+            if (!IsSessionBlockIntact(reader, b)) {
+                hr = E_FAIL;
+            }
+        }
+
+        // Replay through processing pipeline with blocks handed out as views, as headless replay does
+        double replaySeconds = 0.0;
+        if (SUCCEEDED(hr)) {
+            SessionAudioSource source(0.0);
+            AudioPipeline pipeline;
+            AudioPipelineResult* pResult = new AudioPipelineResult();
+            hr = source.Open(szSessionFile);
+            if (SUCCEEDED(hr)) {
+                hr = pipeline.Initialize(source.GetChannelCount(), 0, 1);
+            }
+
+            BenchmarkTimer timer;
+            UINT64 blocksReplayed = 0;
+            while (SUCCEEDED(hr) && !source.IsFinished()) {
+                AudioBlock block;
+                UINT64 position = 0;
+                bool bMoreAvailable = false;
+                hr = source.ReadBlock(&block, &position, &bMoreAvailable);
+                if (S_OK == hr) {
+                    hr = pipeline.ProcessBlock(block, pResult);
+                    ++blocksReplayed;
+                }
+            }
+            replaySeconds = timer.GetElapsedSeconds();
+
+            if (SUCCEEDED(hr) && blocksReplayed != blockCount) {
+                hr = E_FAIL;
+            }
+            delete pResult;
+        }
+
+        // Cut file short partway through a block, as a crash while writing would
+        if (SUCCEEDED(hr)) {
+            UINT64 keptBlocks = reader.GetBlockCount() / 2;
+            const BYTE* pKeptEnd = reinterpret_cast<const BYTE*>(&reader.GetBlockHeader(keptBlocks));
+            const BYTE* pStart = reinterpret_cast<const BYTE*>(&reader.GetBlockHeader(0)) - cSessionHeaderSize;
+            hr = CopyFilePrefix(szSessionFile, szTruncatedFile, (pKeptEnd - pStart) + 100);
+
+            SessionReader truncated;
+            if (SUCCEEDED(hr)) {
+                hr = truncated.Open(szTruncatedFile);
+            }
+            if (SUCCEEDED(hr) && (!truncated.IsRecovered() || truncated.GetBlockCount() != keptBlocks ||
+                !IsSessionBlockIntact(truncated, keptBlocks - 1) || truncated.FindBlock(keptBlocks * AudioBlock::MaxSamples) != keptBlocks - 1)) {
+                hr = E_FAIL;
+            }
+            truncated.Close();
+            remove(szTruncatedFile);
+        }
+
+        if (SUCCEEDED(hr)) {
+            double bytes = static_cast<double>(blockCount) * AudioBlock::MaxSamples * AudioBlock::MaxChannels * sizeof(int16_t);
+            fprintf(pOutput, "  %5.0f s  write %7.1f MB/s  open %6.1f us  seek p50 %5.2f us p99 %5.2f us  scan %5.2f GB/s  replay %7.0fx real time  truncated copy recovered (checksum %lld)\n",
+                audioSeconds, bytes / 1e6 / writeSeconds, openSeconds * 1e6 / openCount,
+                seekLatency.GetPercentile(50.0) / 1e3, seekLatency.GetPercentile(99.0) / 1e3,
+                bytes / 1e9 / scanSeconds, audioSeconds / replaySeconds, static_cast<long long>(checksum));
+        }
+
+        reader.Close();
+        remove(szSessionFile);
+    }
+
+    return hr;
+}
+
+// Bursts the clip benchmark triggers on: one of cClipBurstSeconds every cClipBurstPeriodSeconds,
+// the first after a full period of quiet.
+static const double cClipBurstSeconds = 0.5;
+static const UINT cClipBurstPeriodSeconds = 20;
+
+/// Fill vector with quiet noise broken by short loud harmonic bursts, like a door slam or a shout.
+/// <param name="seconds">length of audio to generate.</param>
+/// <param name="samples">receives mono samples.</param>
+static void GenerateClipBurstAudio(UINT seconds, std::vector<int16_t>& samples) {
+    const double fundamental = 200.0;
+    const int harmonics = 8;
+    const double amplitude = 12000.0;
+    const int noiseAmplitude = 100;
+
+    samples.resize(static_cast<size_t>(seconds) * AudioSamplesPerSecond);
+    uint32_t state = 3;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        double t = static_cast<double>(i) / AudioSamplesPerSecond;
+        double sum = 0.0;
+        if (t >= cClipBurstPeriodSeconds && fmod(t, cClipBurstPeriodSeconds) < cClipBurstSeconds) {
+            for (int h = 1; h <= harmonics; ++h) {
+                sum += amplitude / harmonics * sin(2.0 * M_PI * h * fundamental * t + h);
+            }
+        }
+
+        state = state * 1664525u + 1013904223u;
+        int noise = static_cast<int>(state >> 16) % (2 * noiseAmplitude + 1) - noiseAmplitude;
+        samples[i] = static_cast<int16_t>(floor(sum + noise + 0.5));
+    }
+}
+
+/// Check clips against the audio they were cut from: one per burst, starting a pre-roll ahead of
+/// it, ending a post-roll after it, and holding exactly the samples captured.
+/// <param name="capture">closed clip capture.</param>
+/// <param name="szPrefix">path prefix clips were written with.</param>
+/// <param name="samples">mono audio appended to capture.</param>
+/// <param name="settings">settings capture was opened with.</param>
+/// <returns>S_OK if every clip checks out, otherwise failure code.</returns>
+static HRESULT VerifyClips(const ClipCapture& capture, const char* szPrefix, const std::vector<int16_t>& samples, const ClipCaptureSettings& settings) {
+    const std::vector<ClipInfo>& clips = capture.GetClips();
+    UINT64 burstCount = (samples.size() / AudioSamplesPerSecond - 1) / cClipBurstPeriodSeconds;
+    if (clips.size() != burstCount || capture.GetDroppedCount() != 0 || capture.GetMissedCount() != 0) {
+        return E_FAIL;
+    }
+
+    UINT64 preRoll = static_cast<UINT64>(settings.preRollMilliseconds) * AudioSamplesPerSecond / 1000;
+    UINT64 postRoll = static_cast<UINT64>(settings.postRollMilliseconds) * AudioSamplesPerSecond / 1000;
+    UINT64 burstLength = static_cast<UINT64>(cClipBurstSeconds * AudioSamplesPerSecond);
+    for (size_t c = 0; c < clips.size(); ++c) {
+        const ClipInfo& clip = clips[c];
+        UINT64 onset = (c + 1) * cClipBurstPeriodSeconds * AudioSamplesPerSecond;
+        UINT64 end = clip.firstSample + clip.frameCount;
+
+        // Trigger lands in block holding onset, give or take a block of energy window and detector delay
+        if (clip.triggerSample + 2 * AudioBlock::MaxSamples < onset || clip.triggerSample > onset + AudioBlock::MaxSamples ||
+            clip.firstSample > clip.triggerSample - preRoll || clip.firstSample + preRoll + AudioBlock::MaxSamples < clip.triggerSample ||
+            end < onset + burstLength + postRoll || end > onset + burstLength + postRoll + 4 * AudioBlock::MaxSamples ||
+            0 == (clip.triggers & settings.triggers)) {
+            return E_FAIL;
+        }
+
+        char szPath[1024];
+        snprintf(szPath, sizeof(szPath), "%s%04u.ses", szPrefix, clip.number);
+        SessionReader reader;
+        HRESULT hr = reader.Open(szPath);
+        if (FAILED(hr)) {
+            return hr;
+        }
+        if (reader.IsRecovered() || reader.GetEndPosition() != clip.frameCount) {
+            return E_FAIL;
+        }
+
+        for (UINT64 b = 0; b < reader.GetBlockCount(); ++b) {
+            AudioBlock block;
+            reader.GetBlock(b, &block);
+            UINT64 position = clip.firstSample + reader.GetBlockHeader(b).samplePosition;
+            if (0 != memcmp(block.pSamples, &samples[static_cast<size_t>(position)], block.sampleCount * sizeof(int16_t))) {
+                return E_FAIL;
+            }
+        }
+    }
+
+    return S_OK;
+}
+
+/// Measure cost of keeping a pre-roll and saving clips around loud bursts and voice onsets, first
+/// as fast as the pipeline runs with capture waiting on its writer, as offline processing does,
+/// then paced as live capture is, with writer never waited on. Check one clip per burst, cut
+/// where settings say, holding exactly the audio captured, and that disk use follows bursts
+/// rather than length of audio.
+static HRESULT BenchmarkClips(FILE* pOutput) {
+    const char* szPrefix = "AudioBasics-bench-clip";
+    const double pacedSpeed = 100.0;
+    const UINT seconds = 3 * cBenchmarkAudioSeconds;
+    const UINT blockCount = seconds * AudioSamplesPerSecond / AudioBlock::MaxSamples;
+    double audioSeconds = static_cast<double>(blockCount) * AudioBlock::MaxSamples / AudioSamplesPerSecond;
+
+    std::vector<int16_t> samples;
+    GenerateClipBurstAudio(seconds, samples);
+
+    ClipCaptureSettings settings = ClipCapture::GetDefaultSettings();
+
+    fprintf(pOutput, "clips: %.0f s of mono audio with a %.1f s burst every %u s, %u ms pre-roll, %u ms post-roll; wait: as fast as pipeline runs, drop: paced at %.0fx real time\n",
+        audioSeconds, cClipBurstSeconds, cClipBurstPeriodSeconds, settings.preRollMilliseconds, settings.postRollMilliseconds, pacedSpeed);
+
+    AudioPipelineResult* pResult = new AudioPipelineResult();
+    HRESULT hr = S_OK;
+    for (UINT mode = 0; mode < 2 && SUCCEEDED(hr); ++mode) {
+        bool bWaitWhenBehind = (0 == mode);
+        AudioPipeline pipeline;
+        ClipCapture capture;
+        hr = pipeline.Initialize(1, AudioEnhancementVoiceGate, 1);
+        if (SUCCEEDED(hr)) {
+            hr = capture.Open(szPrefix, 1, AudioSamplesPerSecond, settings, bWaitWhenBehind);
+        }
+
+        AudioBlock block;
+        memset(&block, 0, sizeof(block));
+        block.channelCount = 1;
+        block.sampleCount = AudioBlock::MaxSamples;
+
+        BenchmarkTimer timer;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (UINT b = 0; b < blockCount && SUCCEEDED(hr); ++b) {
+            UINT64 position = static_cast<UINT64>(b) * AudioBlock::MaxSamples;
+            if (!bWaitWhenBehind) {
+                std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<long long>(position * 1e6 / (AudioSamplesPerSecond * pacedSpeed))));
+            }
+
+            block.sequence = b;
+            block.pSamples = &samples[static_cast<size_t>(position)];
+            hr = pipeline.ProcessBlock(block, pResult);
+            if (SUCCEEDED(hr)) {
+                hr = capture.Append(block, *pResult);
+            }
+        }
+
+        HRESULT hrClose = capture.Close();
+        hr = SUCCEEDED(hr) ? hrClose : hr;
+        double elapsedSeconds = timer.GetElapsedSeconds();
+
+        if (SUCCEEDED(hr)) {
+            hr = VerifyClips(capture, szPrefix, samples, settings);
+        }
+
+        if (SUCCEEDED(hr)) {
+            UINT64 clipFrames = 0;
+            for (size_t c = 0; c < capture.GetClips().size(); ++c) {
+                clipFrames += capture.GetClips()[c].frameCount;
+            }
+
+            const LatencyHistogram& append = capture.GetAppendLatency();
+            const LatencyHistogram& write = capture.GetWriteLatency();
+            fprintf(pOutput, "  %-4s %6.0fx real time  %u clips, %4.1f%% of audio saved  append p50 %5.2f us p99 %5.2f us max %7.1f us"
+                "  write p50 %5.2f us p99 %6.2f us  %u dropped\n",
+                bWaitWhenBehind ? "wait" : "drop", audioSeconds / elapsedSeconds, capture.GetClipCount(), 100.0 * clipFrames / samples.size(),
+                append.GetPercentile(50.0) / 1e3, append.GetPercentile(99.0) / 1e3, append.GetMax() / 1e3,
+                write.GetPercentile(50.0) / 1e3, write.GetPercentile(99.0) / 1e3, capture.GetDroppedCount());
+        }
+
+        for (size_t c = 0; c < capture.GetClips().size(); ++c) {
+            char szPath[1024];
+            snprintf(szPath, sizeof(szPath), "%s%04u.ses", szPrefix, capture.GetClips()[c].number);
+            remove(szPath);
+        }
+    }
+
+    delete pResult;
+
+    return hr;
+}
+
+// Number of distinct blocks of audio broadcast benchmark cycles through: prime, so a block read torn
+// from two that share a ring slot never looks whole.
+static const UINT cBroadcastPatternBlocks = 61;
+
+/// Reader thread of broadcast benchmark, and what it saw.
+struct BroadcastBenchmarkReader {
+    BroadcastReader         reader;
+
+    // Time spent on each block, as a slow consumer would, in microseconds.
+    UINT                    delayMicroseconds;
+
+    // Number of first block reader could read, taken when it attached.
+    UINT64                  startPosition;
+
+    // Blocks read intact, blocks missing between numbers read, blocks overwritten while being read,
+    // and blocks EndRead passed whose samples did not match their number.
+    UINT64                  readCount;
+    UINT64                  gapCount;
+    UINT64                  tornCount;
+    UINT64                  corruptCount;
+
+    HRESULT                 hr;
+};
+
+/// Whether a block read from broadcast holds the audio published with its number.
+/// <param name="pInfo">block's info, as read in place.</param>
+/// <param name="pSamples">block's frames, as read in place.</param>
+/// <param name="channelCount">number of channels in channel's blocks.</param>
+static bool IsBroadcastBlockIntact(const BroadcastBlockInfo* pInfo, const int16_t* pSamples, UINT channelCount) {
+    // A block being overwritten can claim any length, so never look beyond slot
+    if (AudioBlock::MaxSamples != pInfo->sampleCount) {
+        return false;
+    }
+
+    UINT64 patternPosition = (pInfo->number % cBroadcastPatternBlocks) * AudioBlock::MaxSamples;
+    for (UINT i = 0; i < AudioBlock::MaxSamples; ++i) {
+        for (UINT c = 0; c < channelCount; ++c) {
+            if (pSamples[i * channelCount + c] != GetRecordedSample(patternPosition + i, c)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/// Read blocks in place until publisher closes channel, checking every sample and counting blocks lost.
+/// <param name="pState">reader to run.</param>
+static void RunBroadcastReader(BroadcastBenchmarkReader* pState) {
+    UINT64 expected = pState->startPosition;
+    for (;;) {
+        HRESULT hr = pState->reader.Wait(1000);
+        if (E_ABORT == hr) {
+            break;
+        }
+        if (S_OK != hr) {
+            // Publisher never pauses for a second, so waiting that long means a wakeup was lost
+            pState->hr = E_FAIL;
+            break;
+        }
+
+        const BroadcastBlockInfo* pInfo = NULL;
+        const int16_t* pSamples = NULL;
+        if (S_OK != pState->reader.BeginRead(&pInfo, &pSamples)) {
+            continue;
+        }
+
+        UINT64 number = pInfo->number;
+        bool bIntact = IsBroadcastBlockIntact(pInfo, pSamples, pState->reader.GetChannelCount());
+        if (S_OK != pState->reader.EndRead()) {
+            ++pState->tornCount;
+            continue;
+        }
+
+        if (!bIntact) {
+            ++pState->corruptCount;
+        }
+        if (number > expected) {
+            pState->gapCount += number - expected;
+        }
+        expected = number + 1;
+        ++pState->readCount;
+
+        if (0 != pState->delayMicroseconds) {
+            std::this_thread::sleep_for(std::chrono::microseconds(pState->delayMicroseconds));
+        }
+    }
+}
+
+/// Publish blocks of patterned 4-channel audio to a broadcast channel, then close it.
+/// <param name="publisher">open publisher.</param>
+/// <param name="blockCount">number of blocks to publish.</param>
+/// <param name="intervalMicroseconds">time between blocks, or 0 to publish as fast as possible.</param>
+/// <param name="pattern">cBroadcastPatternBlocks blocks of frames to cycle through.</param>
+/// <param name="pResult">scratch result carrying each block's position and angles.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+static HRESULT RunBroadcastPublisher(BroadcastPublisher& publisher, UINT blockCount, UINT intervalMicroseconds, const std::vector<int16_t>& pattern, AudioPipelineResult* pResult) {
+    const UINT channelCount = AudioBlock::MaxChannels;
+
+    AudioBlock block;
+    memset(&block, 0, sizeof(block));
+    block.sampleCount = AudioBlock::MaxSamples;
+    block.channelCount = channelCount;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    HRESULT hr = S_OK;
+    for (UINT b = 0; b < blockCount && SUCCEEDED(hr); ++b) {
+        if (0 != intervalMicroseconds) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<long long>(b) * intervalMicroseconds));
+        }
+
+        block.sequence = b;
+        block.captureTimestamp = GetClockNanoseconds();
+        block.pSamples = &pattern[(b % cBroadcastPatternBlocks) * AudioBlock::MaxSamples * channelCount];
+        pResult->sequence = b;
+        pResult->samplePosition = static_cast<UINT64>(b) * AudioBlock::MaxSamples;
+        pResult->beamAngleDegrees = static_cast<float>(b % 100) - 50.0f;
+        hr = publisher.Publish(block, *pResult);
+    }
+
+    publisher.Close();
+
+    return hr;
+}
+
+/// Attach a reader to a broadcast channel from a child process that then exits without detaching, as
+/// a crashed subscriber would, leaving its slot in reader table held by a process that is gone.
+/// <param name="szChannel">channel name. Its reader table must have a free slot.</param>
+/// <param name="publisher">publisher of channel, watched for child attaching.</param>
+/// <returns>S_OK once child attached and exited, otherwise failure code.</returns>
+static HRESULT AbandonBroadcastReader(const char* szChannel, const BroadcastPublisher& publisher) {
+#ifdef _WIN32
+    // Another instance of this program subscribes to channel until it is killed
+    char szPath[MAX_PATH];
+    if (0 == GetModuleFileNameA(NULL, szPath, MAX_PATH)) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    char szCommandLine[MAX_PATH + BroadcastPublisher::cMaxNameLength + 16];
+    snprintf(szCommandLine, sizeof(szCommandLine), "\"%s\" -subscribe %s", szPath, szChannel);
+
+    UINT readerCount = publisher.GetReaderCount();
+    STARTUPINFOA startup;
+    memset(&startup, 0, sizeof(startup));
+    startup.cb = sizeof(startup);
+    PROCESS_INFORMATION process;
+    if (!CreateProcessA(NULL, szCommandLine, NULL, NULL, FALSE, DETACHED_PROCESS, NULL, NULL, &startup, &process)) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    HRESULT hr = E_FAIL;
+    for (UINT i = 0; i < 1000 && FAILED(hr); ++i) {
+        if (readerCount + 1 == publisher.GetReaderCount()) {
+            hr = S_OK;
+        }
+        else if (WAIT_OBJECT_0 == WaitForSingleObject(process.hProcess, 10)) {
+            // Exited without attaching
+            break;
+        }
+    }
+
+    TerminateProcess(process.hProcess, 1);
+    WaitForSingleObject(process.hProcess, INFINITE);
+    CloseHandle(process.hThread);
+    CloseHandle(process.hProcess);
+
+    return hr;
+#else
+    UINT readerCount = publisher.GetReaderCount();
+    pid_t child = fork();
+    if (child < 0) {
+        return HRESULT_FROM_ERRNO(errno);
+    }
+    if (0 == child) {
+        // Exits without running reader's destructor, so slot is never given up
+        BroadcastReader reader;
+        _exit(SUCCEEDED(reader.Open(szChannel)) ? 0 : 1);
+    }
+
+    // Reaped, as a zombie still counts as running
+    int status = 0;
+    if (child != waitpid(child, &status, 0)) {
+        return HRESULT_FROM_ERRNO(errno);
+    }
+
+    return (WIFEXITED(status) && 0 == WEXITSTATUS(status) && readerCount + 1 == publisher.GetReaderCount()) ? S_OK : E_FAIL;
+#endif
+}
+
+/// Open a broadcast channel from a child process that then exits without closing it, as a crashed
+/// publisher would, leaving channel to be taken over by the next publisher of that name.
+/// <param name="szChannel">channel name. No running publisher may have it open.</param>
+/// <returns>S_OK once child opened channel and exited, otherwise failure code.</returns>
+static HRESULT AbandonBroadcastChannel(const char* szChannel) {
+#ifdef _WIN32
+    // Channel goes away with its publisher's process, so nothing is left behind to take over
+    (void)szChannel;
+    return S_OK;
+#else
+    pid_t child = fork();
+    if (child < 0) {
+        return HRESULT_FROM_ERRNO(errno);
+    }
+    if (0 == child) {
+        // Exits without running publisher's destructor, so channel is never closed
+        BroadcastPublisher publisher;
+        _exit(SUCCEEDED(publisher.Open(szChannel, AudioBlock::MaxChannels, AudioSamplesPerSecond, BroadcastPublisher::cDefaultSlotCount)) ? 0 : 1);
+    }
+
+    // Reaped, as a zombie still counts as running
+    int status = 0;
+    if (child != waitpid(child, &status, 0)) {
+        return HRESULT_FROM_ERRNO(errno);
+    }
+
+    return (WIFEXITED(status) && 0 == WEXITSTATUS(status)) ? S_OK : E_FAIL;
+#endif
+}
+
+/// Stream 4-channel blocks through a shared memory broadcast channel to several reader threads, each
+/// reading in place and checking every sample, first as fast as publisher can go, then paced so
+/// readers sleep between blocks and delivery latency is wakeup latency. Then, alongside a reader
+/// that keeps up, run one too slow to, which must see its overruns and lose nothing else, and one
+/// that keeps attaching and detaching, which must start live every time. Last, have readers in child
+/// processes exit without detaching more times than reader table has slots, attaching from this
+/// process after each: every attach must succeed, and publisher must free slots dead readers left.
+/// Finally, have two publishers open a channel left behind by a dead one at once, over and over:
+/// exactly one must open it each time, and readers must attach to that one's channel.
+static HRESULT BenchmarkBroadcast(FILE* pOutput) {
+    const char* szChannel = "bench-broadcast";
+    const UINT channelCount = AudioBlock::MaxChannels;
+    const UINT flatOutBlocks = 200000;
+    const UINT pacedBlocks = 2000;
+    const UINT pacedIntervalMicroseconds = 500;
+    const UINT slowDelayMicroseconds = 2000;
+    const UINT churnAttaches = 20;
+    const UINT churnBlocks = 10;
+    const UINT abandonAttaches = 40;
+    const UINT takeoverAttempts = 200;
+    const UINT readerCounts[] = {1, 4, 8};
+    const UINT maxReaders = 8;
+
+    std::vector<int16_t> pattern(cBroadcastPatternBlocks * AudioBlock::MaxSamples * channelCount);
+    for (UINT i = 0; i < cBroadcastPatternBlocks * AudioBlock::MaxSamples; ++i) {
+        for (UINT c = 0; c < channelCount; ++c) {
+            pattern[i * channelCount + c] = GetRecordedSample(i, c);
+        }
+    }
+
+    fprintf(pOutput, "broadcast: %u-channel blocks of %u frames through a %u-slot ring, every sample checked by every reader; paced: one block every %u us\n",
+        channelCount, AudioBlock::MaxSamples, BroadcastPublisher::cDefaultSlotCount, pacedIntervalMicroseconds);
+
+    AudioPipelineResult* pResult = new AudioPipelineResult();
+    memset(pResult, 0, sizeof(*pResult));
+    BroadcastBenchmarkReader* pReaders = new BroadcastBenchmarkReader[maxReaders];
+    HRESULT hr = S_OK;
+
+    for (UINT mode = 0; mode < 2 && SUCCEEDED(hr); ++mode) {
+        bool bPaced = (1 == mode);
+        UINT blockCount = bPaced ? pacedBlocks : flatOutBlocks;
+        for (UINT r = 0; r < sizeof(readerCounts) / sizeof(readerCounts[0]) && SUCCEEDED(hr); ++r) {
+            UINT readerCount = readerCounts[r];
+            BroadcastPublisher publisher;
+            hr = publisher.Open(szChannel, channelCount, AudioSamplesPerSecond, BroadcastPublisher::cDefaultSlotCount);
+            for (UINT i = 0; i < readerCount && SUCCEEDED(hr); ++i) {
+                BroadcastBenchmarkReader& state = pReaders[i];
+                hr = state.reader.Open(szChannel);
+                state.delayMicroseconds = 0;
+                state.startPosition = state.reader.GetPosition();
+                state.readCount = 0;
+                state.gapCount = 0;
+                state.tornCount = 0;
+                state.corruptCount = 0;
+                state.hr = S_OK;
+            }
+            if (FAILED(hr)) {
+                break;
+            }
+
+            std::vector<std::thread> threads;
+            for (UINT i = 0; i < readerCount; ++i) {
+                threads.push_back(std::thread(RunBroadcastReader, &pReaders[i]));
+            }
+
+            BenchmarkTimer timer;
+            hr = RunBroadcastPublisher(publisher, blockCount, bPaced ? pacedIntervalMicroseconds : 0, pattern, pResult);
+            double publishSeconds = timer.GetElapsedSeconds();
+            for (size_t t = 0; t < threads.size(); ++t) {
+                threads[t].join();
+            }
+
+            UINT64 readTotal = 0;
+            UINT64 lostTotal = 0;
+            UINT64 tornTotal = 0;
+            double deliveryP50 = 0.0;
+            double deliveryP99 = 0.0;
+            for (UINT i = 0; i < readerCount; ++i) {
+                BroadcastBenchmarkReader& state = pReaders[i];
+                const LatencyHistogram& delivery = state.reader.GetDeliveryLatency();
+                readTotal += state.readCount;
+                lostTotal += state.reader.GetOverrunCount();
+                tornTotal += state.tornCount;
+                deliveryP50 = (delivery.GetPercentile(50.0) > deliveryP50) ? delivery.GetPercentile(50.0) : deliveryP50;
+                deliveryP99 = (delivery.GetPercentile(99.0) > deliveryP99) ? delivery.GetPercentile(99.0) : deliveryP99;
+
+                // Every block is either read intact or counted lost, and what passes EndRead is always whole
+                if (FAILED(state.hr) || 0 != state.corruptCount || state.gapCount != state.reader.GetOverrunCount() ||
+                    state.readCount + state.reader.GetOverrunCount() != blockCount - state.startPosition) {
+                    hr = E_FAIL;
+                }
+                if (bPaced && 0 != state.reader.GetOverrunCount()) {
+                    hr = E_FAIL;
+                }
+                state.reader.Close();
+            }
+
+            const LatencyHistogram& publish = publisher.GetPublishLatency();
+            double blocksPerSecond = blockCount / publishSeconds;
+            fprintf(pOutput, "  %-8s %u reader%s  %8.0f blocks/s %5.2f GB/s read  publish p50 %5.2f us p99 %5.2f us  delivery p50 %6.2f us p99 %7.2f us (worst reader)"
+                "  %5.2f%% lost, %llu torn\n",
+                bPaced ? "paced" : "flat out", readerCount, (1 == readerCount) ? " " : "s", blocksPerSecond,
+                readTotal * AudioBlock::MaxSamples * channelCount * sizeof(int16_t) / publishSeconds / 1e9,
+                publish.GetPercentile(50.0) / 1e3, publish.GetPercentile(99.0) / 1e3, deliveryP50 / 1e3, deliveryP99 / 1e3,
+                100.0 * lostTotal / (readTotal + lostTotal), static_cast<unsigned long long>(tornTotal));
+        }
+    }
+
+    // One reader keeping up, one too slow to, and one attaching, reading a few blocks and detaching over and over
+    if (SUCCEEDED(hr)) {
+        BroadcastPublisher publisher;
+        hr = publisher.Open(szChannel, channelCount, AudioSamplesPerSecond, BroadcastPublisher::cDefaultSlotCount);
+        for (UINT i = 0; i < 2 && SUCCEEDED(hr); ++i) {
+            BroadcastBenchmarkReader& state = pReaders[i];
+            hr = state.reader.Open(szChannel);
+            state.delayMicroseconds = (0 == i) ? 0 : slowDelayMicroseconds;
+            state.startPosition = state.reader.GetPosition();
+            state.readCount = 0;
+            state.gapCount = 0;
+            state.tornCount = 0;
+            state.corruptCount = 0;
+            state.hr = S_OK;
+        }
+
+        if (SUCCEEDED(hr)) {
+            std::thread fast(RunBroadcastReader, &pReaders[0]);
+            std::thread slow(RunBroadcastReader, &pReaders[1]);
+
+            UINT churnFailures = 0;
+            UINT churnDone = 0;
+            std::thread churn([&churnFailures, &churnDone, szChannel, churnAttaches, churnBlocks, channelCount]() {
+                for (UINT a = 0; a < churnAttaches; ++a) {
+                    BroadcastReader reader;
+                    if (FAILED(reader.Open(szChannel))) {
+                        ++churnFailures;
+                        break;
+                    }
+
+                    // Live start: first block read is one published after attaching
+                    UINT64 startPosition = reader.GetPosition();
+                    for (UINT b = 0; b < churnBlocks; ++b) {
+                        const BroadcastBlockInfo* pInfo = NULL;
+                        const int16_t* pSamples = NULL;
+                        if (S_OK != reader.Wait(1000) || S_OK != reader.BeginRead(&pInfo, &pSamples)) {
+                            ++churnFailures;
+                            break;
+                        }
+                        UINT64 number = pInfo->number;
+                        bool bIntact = IsBroadcastBlockIntact(pInfo, pSamples, channelCount);
+                        if (S_OK == reader.EndRead() && (!bIntact || (0 == b && number != startPosition))) {
+                            ++churnFailures;
+                        }
+                    }
+                    reader.Close();
+                    ++churnDone;
+                }
+            });
+
+            hr = RunBroadcastPublisher(publisher, pacedBlocks, pacedIntervalMicroseconds, pattern, pResult);
+            fast.join();
+            slow.join();
+            churn.join();
+
+            for (UINT i = 0; i < 2; ++i) {
+                BroadcastBenchmarkReader& state = pReaders[i];
+                if (FAILED(state.hr) || 0 != state.corruptCount || state.gapCount != state.reader.GetOverrunCount() ||
+                    state.readCount + state.reader.GetOverrunCount() != pacedBlocks - state.startPosition) {
+                    hr = E_FAIL;
+                }
+            }
+
+            // Fast reader loses nothing; slow one reads about one block per delay and loses the rest
+            if (0 != pReaders[0].reader.GetOverrunCount() || 0 == pReaders[1].reader.GetOverrunCount() || 0 != churnFailures || churnAttaches != churnDone) {
+                hr = E_FAIL;
+            }
+
+            fprintf(pOutput, "  mixed    fast reader %llu read, %llu lost  slow reader (%u us per block) %llu read, %llu lost, %llu torn  %u attach/detach cycles, all started live\n",
+                static_cast<unsigned long long>(pReaders[0].readCount), static_cast<unsigned long long>(pReaders[0].reader.GetOverrunCount()),
+                slowDelayMicroseconds, static_cast<unsigned long long>(pReaders[1].readCount), static_cast<unsigned long long>(pReaders[1].reader.GetOverrunCount()),
+                static_cast<unsigned long long>(pReaders[1].tornCount), churnDone);
+        }
+
+        pReaders[0].reader.Close();
+        pReaders[1].reader.Close();
+    }
+
+    // Readers that die attached, each followed by an attach that must find a slot, which takes freeing
+    // dead readers' slots once they fill reader table
+    if (SUCCEEDED(hr)) {
+        BroadcastPublisher publisher;
+        hr = publisher.Open(szChannel, channelCount, AudioSamplesPerSecond, BroadcastPublisher::cDefaultSlotCount);
+
+        UINT abandonDone = 0;
+        double slowestAttachMicroseconds = 0.0;
+        for (UINT a = 0; a < abandonAttaches && SUCCEEDED(hr); ++a) {
+            hr = AbandonBroadcastReader(szChannel, publisher);
+            if (SUCCEEDED(hr)) {
+                BroadcastReader reader;
+                BenchmarkTimer timer;
+                hr = reader.Open(szChannel);
+                double attachMicroseconds = timer.GetElapsedSeconds() * 1e6;
+                slowestAttachMicroseconds = (attachMicroseconds > slowestAttachMicroseconds) ? attachMicroseconds : slowestAttachMicroseconds;
+                ++abandonDone;
+            }
+        }
+
+        // Dead readers left since last full table are freed by publisher's first publish
+        UINT deadReaders = 0;
+        if (SUCCEEDED(hr)) {
+            AudioBlock block;
+            memset(&block, 0, sizeof(block));
+            block.sampleCount = AudioBlock::MaxSamples;
+            block.channelCount = channelCount;
+            block.pSamples = &pattern[0];
+            deadReaders = publisher.GetReaderCount();
+            hr = publisher.Publish(block, *pResult);
+        }
+        if (SUCCEEDED(hr) && (0 == deadReaders || 0 != publisher.GetReaderCount())) {
+            hr = E_FAIL;
+        }
+        publisher.Close();
+
+        if (SUCCEEDED(hr)) {
+            fprintf(pOutput, "  abandon  %u readers exited attached, every attach after them succeeded (slowest %.1f us), publisher freed %u dead readers' slots\n",
+                abandonDone, slowestAttachMicroseconds, deadReaders);
+        }
+    }
+
+    // Two publishers racing to take over one channel left behind
+    if (SUCCEEDED(hr)) {
+        UINT takeoversDone = 0;
+        for (UINT a = 0; a < takeoverAttempts && SUCCEEDED(hr); ++a) {
+            hr = AbandonBroadcastChannel(szChannel);
+            if (FAILED(hr)) {
+                break;
+            }
+
+            BroadcastPublisher publishers[2];
+            HRESULT openResults[2] = {E_FAIL, E_FAIL};
+            std::atomic<UINT> readyCount(0);
+            std::thread rival([&publishers, &openResults, &readyCount, szChannel, channelCount]() {
+                readyCount.fetch_add(1);
+                while (readyCount.load() < 2) {
+                    std::this_thread::yield();
+                }
+                openResults[1] = publishers[1].Open(szChannel, channelCount, AudioSamplesPerSecond, BroadcastPublisher::cDefaultSlotCount);
+            });
+            // Both start opening at once, as far as scheduler lets them
+            readyCount.fetch_add(1);
+            while (readyCount.load() < 2) {
+                std::this_thread::yield();
+            }
+            openResults[0] = publishers[0].Open(szChannel, channelCount, AudioSamplesPerSecond, BroadcastPublisher::cDefaultSlotCount);
+            rival.join();
+
+            // Exactly one opened, and its channel is the one name leads to
+            BroadcastReader reader;
+            UINT winner = SUCCEEDED(openResults[0]) ? 0 : 1;
+            if (SUCCEEDED(openResults[0]) == SUCCEEDED(openResults[1]) || FAILED(reader.Open(szChannel)) || 1 != publishers[winner].GetReaderCount()) {
+                hr = E_FAIL;
+            }
+            else {
+                ++takeoversDone;
+            }
+        }
+
+        if (SUCCEEDED(hr)) {
+            fprintf(pOutput, "  takeover %u times two publishers opened a channel left behind at once, and exactly one took it over\n", takeoversDone);
+        }
+    }
+
+    delete[] pReaders;
+    delete pResult;
+
+    return hr;
+}
+
+// Energy values appended to history benchmark per second, and hours of them, as the application keeps.
+static const UINT cHistoryEntriesPerSecond = AudioSamplesPerSecond / EnergyCalculator::cAudioSamplesPerEnergySample;
+static const UINT cHistoryHours = 12;
+
+// Buckets per level and columns queried, as the application uses.
+static const UINT cHistoryBucketsPerLevel = 2048;
+static const UINT cHistoryColumns = 390;
+
+// Finest zooms, as powers of two of entries per column, whose queries are checked entry by entry.
+static const UINT cHistoryCheckedZooms = 11;
+
+/// Energy-like value in [0.0,1.0] interval, or beam-like angle sweeping back and forth over
+/// +/-50 degrees every minute, of an entry of history benchmark. Computed rather than stored,
+/// so queries can be checked against hours of entries.
+/// <param name="series">0 for energy, 1 for angle.</param>
+/// <param name="entry">index of entry.</param>
+/// <returns>value of entry.</returns>
+static float GetHistoryValue(UINT series, UINT64 entry) {
+    if (0 == series) {
+        uint32_t hash = static_cast<uint32_t>(entry * 2654435761u);
+        hash ^= hash >> 15;
+        return (hash & 0xFFFF) / 65535.0f;
+    }
+
+    const UINT64 period = 60 * cHistoryEntriesPerSecond;
+    UINT64 phase = entry % period;
+    float triangle = (phase < period / 2) ? static_cast<float>(phase) / (period / 2) : static_cast<float>(period - phase) / (period / 2);
+    return 100.0f * triangle - 50.0f;
+}
+
+/// Append hours of entries to a history pyramid, then time queries of the latest of them at every
+/// zoom and check the finer zooms against entries themselves, and the whole history for gaps.
+static HRESULT BenchmarkHistory(FILE* pOutput) {
+    const UINT64 entryCount = static_cast<UINT64>(cHistoryHours) * 3600 * cHistoryEntriesPerSecond;
+
+    HistoryPyramid history;
+    HRESULT hr = history.Open(2, cHistoryBucketsPerLevel, entryCount);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    // Values are generated in batches outside timed loop, so only appending is measured
+    const UINT batchSize = 4096;
+    std::vector<float> batch(batchSize * 2);
+    double appendSeconds = 0.0;
+    for (UINT64 entry = 0; entry < entryCount; entry += batchSize) {
+        UINT count = (entryCount - entry < batchSize) ? static_cast<UINT>(entryCount - entry) : batchSize;
+        for (UINT i = 0; i < count; ++i) {
+            batch[2 * i] = GetHistoryValue(0, entry + i);
+            batch[2 * i + 1] = GetHistoryValue(1, entry + i);
+        }
+
+        BenchmarkTimer timer;
+        for (UINT i = 0; i < count; ++i) {
+            history.Append(&batch[2 * i]);
+        }
+        appendSeconds += timer.GetElapsedSeconds();
+    }
+
+    fprintf(pOutput, "history: %u h at %u entries/s (%llu entries), 2 series, %u levels of %u buckets, %.2f MB\n",
+        cHistoryHours, cHistoryEntriesPerSecond, static_cast<unsigned long long>(entryCount), history.GetLevelCount(),
+        cHistoryBucketsPerLevel, history.GetMemorySize() / (1024.0 * 1024.0));
+    fprintf(pOutput, "  append         %8.1f ns/entry\n", appendSeconds * 1e9 / entryCount);
+
+    // Zooms double entries per column until columns span whole history. Entry count is a multiple of
+    // every checked zoom's column, so columns of those fall exactly on buckets and must match entries.
+    std::vector<HistoryColumn> columns(cHistoryColumns * 2);
+    UINT mismatches = 0;
+    const UINT queryPasses = 200;
+    for (UINT zoom = 0; (static_cast<UINT64>(cHistoryColumns) << zoom) / 2 < entryCount; ++zoom) {
+        UINT64 span = static_cast<UINT64>(cHistoryColumns) << zoom;
+        UINT64 firstEntry = (span < entryCount) ? entryCount - span : 0;
+        span = entryCount - firstEntry;
+
+        BenchmarkTimer timer;
+        for (UINT pass = 0; pass < queryPasses && SUCCEEDED(hr); ++pass) {
+            hr = history.Query(0, firstEntry, span, &columns[0], cHistoryColumns);
+            if (SUCCEEDED(hr)) {
+                hr = history.Query(1, firstEntry, span, &columns[cHistoryColumns], cHistoryColumns);
+            }
+        }
+        double querySeconds = timer.GetElapsedSeconds();
+        if (FAILED(hr)) {
+            break;
+        }
+
+        // Every column of whole history must be summarised, if only from coarsest level
+        UINT emptyColumns = 0;
+        for (UINT c = 0; c < 2 * cHistoryColumns; ++c) {
+            const HistoryColumn& column = columns[c];
+            if (0 == column.count || column.minimum > column.mean + 1e-3f || column.mean > column.maximum + 1e-3f) {
+                ++emptyColumns;
+            }
+        }
+        mismatches += emptyColumns;
+
+        if (zoom < cHistoryCheckedZooms) {
+            for (UINT s = 0; s < 2; ++s) {
+                for (UINT c = 0; c < cHistoryColumns; ++c) {
+                    const HistoryColumn& column = columns[s * cHistoryColumns + c];
+                    UINT64 begin = firstEntry + (static_cast<UINT64>(c) << zoom);
+                    UINT64 end = begin + (static_cast<UINT64>(1) << zoom);
+                    float minimum = GetHistoryValue(s, begin);
+                    float maximum = minimum;
+                    double sum = 0.0;
+                    for (UINT64 entry = begin; entry < end; ++entry) {
+                        float value = GetHistoryValue(s, entry);
+                        minimum = (value < minimum) ? value : minimum;
+                        maximum = (value > maximum) ? value : maximum;
+                        sum += value;
+                    }
+
+                    if (column.count != end - begin || column.minimum != minimum || column.maximum != maximum ||
+                        fabs(column.mean - sum / (end - begin)) > 1e-3) {
+                        ++mismatches;
+                    }
+                }
+            }
+        }
+
+        fprintf(pOutput, "  query %10.1f ms/column  %6.1f ns/column%s\n", 1000.0 * span / cHistoryColumns / cHistoryEntriesPerSecond,
+            querySeconds * 1e9 / (queryPasses * 2.0 * cHistoryColumns), (zoom < cHistoryCheckedZooms) ? "  checked" : "");
+    }
+
+    fprintf(pOutput, "  %u columns wrong or empty\n", mismatches);
+
+    history.Close();
+
+    if (SUCCEEDED(hr) && 0 != mismatches) {
+        hr = E_FAIL;
+    }
+
+    return hr;
+}
+
+/// Entry in table of available benchmarks.
+struct BenchmarkEntry {
+    const char*     szName;
+    HRESULT         (*pfnRun)(FILE* pOutput);
+};
+
+static const BenchmarkEntry s_benchmarks[] = {
+    {"energy", BenchmarkEnergy},
+    {"beamformer", BenchmarkBeamformer},
+    {"localizer", BenchmarkLocalizer},
+    {"tracker", BenchmarkTracker},
+    {"srp", BenchmarkSrpMap},
+    {"stft", BenchmarkStft},
+    {"enhance", BenchmarkEnhancement},
+    {"echo", BenchmarkEcho},
+    {"vad", BenchmarkVoiceActivity},
+    {"trace", BenchmarkTrace},
+    {"eventloop", BenchmarkEventLoop},
+    {"engine", BenchmarkEngine},
+    {"format", BenchmarkSampleFormat},
+    {"resample", BenchmarkResample},
+    {"record", BenchmarkRecord},
+    {"session", BenchmarkSession},
+    {"clips", BenchmarkClips},
+    {"broadcast", BenchmarkBroadcast},
+    {"history", BenchmarkHistory},
+};
+
+/// Run a named micro-benchmark and print its results.
+/// <param name="szName">benchmark name, or "all" to run every benchmark.</param>
+/// <param name="pOutput">stream that receives results.</param>
+/// <returns>S_OK on success, E_INVALIDARG if no benchmark has that name, otherwise failure code.</returns>
+HRESULT RunBenchmark(const char* szName, FILE* pOutput) {
+    bool bAll = (0 == strcmp(szName, "all"));
+    HRESULT hr = E_INVALIDARG;
+
+    for (size_t i = 0; i < sizeof(s_benchmarks) / sizeof(s_benchmarks[0]); ++i) {
+        if (bAll || 0 == strcmp(szName, s_benchmarks[i].szName)) {
+            hr = s_benchmarks[i].pfnRun(pOutput);
+            if (FAILED(hr)) {
+                return hr;
+            }
+        }
+    }
+
+    return hr;
+}
+
+/// Print names of available benchmarks, one per line.
+/// <param name="pOutput">stream that receives names.</param>
+void ListBenchmarks(FILE* pOutput) {
+    for (size_t i = 0; i < sizeof(s_benchmarks) / sizeof(s_benchmarks[0]); ++i) {
+        fprintf(pOutput, "  %s\n", s_benchmarks[i].szName);
+    }
+}
@@ -0,0 +1,16 @@
+﻿#pragma once
+
+#include "Platform.h"
+
+// For FILE
+#include <stdio.h>
+
+/// Run a named micro-benchmark and print its results.
+/// <param name="szName">benchmark name, or "all" to run every benchmark.</param>
+/// <param name="pOutput">stream that receives results.</param>
+/// <returns>S_OK on success, E_INVALIDARG if no benchmark has that name, otherwise failure code.</returns>
+HRESULT RunBenchmark(const char* szName, FILE* pOutput);
+
+/// Print names of available benchmarks, one per line.
+/// <param name="pOutput">stream that receives names.</param>
+void ListBenchmarks(FILE* pOutput);
@@ -0,0 +1,52 @@
+﻿#pragma once
+
+#include "Platform.h"
+
+/// Beam and sound source angles reported alongside captured audio.
+struct AudioAngles {
+    // Beam angle, in radians, reported by INuiAudioBeam::GetBeam.
+    double                  beamAngle;
+
+    // Sound source angle, in radians, reported by INuiAudioBeam::GetPosition.
+    double                  sourceAngle;
+
+    // Confidence in sound source angle, in [0.0,1.0] interval.
+    double                  sourceConfidence;
+};
+
+/// Unit of captured audio handed from capture thread to consumers.
+/// Describes PCM produced by one audio source read along with the beam and
+/// sound source angles that were current when it was captured. Multichannel
+/// audio is interleaved, one sample per channel in every frame. Samples are not
+/// copied into the block: they live in a reference counted media buffer, and
+/// whoever holds the block holds one reference to that buffer.
+struct AudioBlock {
+    // Maximum number of sample frames held by a single block (32 ms at 16 kHz).
+    // Capture buffers are sized to hold exactly this many frames of MaxChannels.
+    static const uint32_t   MaxSamples = 512;
+
+    // Maximum number of interleaved channels in a block (raw Kinect microphone array).
+    static const uint32_t   MaxChannels = 4;
+
+    // Number of valid sample frames in pSamples.
+    uint32_t                sampleCount;
+
+    // Number of interleaved channels in each frame; 1 for beamformed mono audio.
+    uint32_t                channelCount;
+
+    // Sequence number of block, incremented by capture thread for every block produced.
+    uint32_t                sequence;
+
+    // Beam and sound source angles current when block was captured.
+    AudioAngles             angles;
+
+    // GetClockNanoseconds when audio source returned block's audio, for measuring latency downstream.
+    UINT64                  captureTimestamp;
+
+    // Captured PCM samples, pointing into pBuffer's memory.
+    const int16_t*          pSamples;
+
+    // Buffer that owns samples, or NULL if samples are owned by caller for the duration of a call.
+    // Holder of block must Release it when done, or AddRef it for every extra consumer it hands block to.
+    IMediaBuffer*           pBuffer;
+};
@@ -0,0 +1,999 @@
+﻿#include "AudioBroadcast.h"
+#include "Clock.h"
+
+// For isalnum
+#include <ctype.h>
+
+// For snprintf
+#include <stdio.h>
+
+#ifndef _WIN32
+// For errno
+#include <errno.h>
+
+// For INT_MAX
+#include <limits.h>
+
+// For shm_open and mmap
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// For kill
+#include <signal.h>
+
+// For flock
+#include <sys/file.h>
+
+// For time
+#include <time.h>
+
+// For futex
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+// For close, ftruncate, getpid and syscall
+#include <unistd.h>
+#endif
+
+// Identifies a channel's shared memory, and version of its layout.
+static const char       cBroadcastMagic[8] = {'K', 'A', 'B', 'C', 'A', 'S', 'T', '1'};
+static const uint32_t   cBroadcastVersion = 2;
+
+// Room platform name of a channel's shared memory or wakeup event takes beyond channel name.
+static const UINT       cPlatformNameLength = 40;
+
+// Time between publisher's looks for slots of readers that exited without detaching, in nanoseconds.
+static const UINT64     cReclaimIntervalNanoseconds = 1000000000;
+
+#ifndef _WIN32
+// Longest a publisher takes between creating a channel's shared memory and writing its header, in seconds.
+static const UINT       cBroadcastSetupSeconds = 5;
+#endif
+
+static_assert(sizeof(BroadcastReaderSlot) == cBroadcastCacheLine, "Reader slot must fill one cache line");
+static_assert(sizeof(BroadcastChannelHeader) == (3 + cBroadcastMaxReaders) * cBroadcastCacheLine, "Channel header layout must not change");
+static_assert(sizeof(BroadcastSlotHeader) <= cBroadcastBlockHeaderSize, "Slot header must fit ahead of frames");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Wake word must be usable as a futex");
+
+/// Whether a channel name can be embedded in shared memory and event names on every platform.
+/// <param name="szName">channel name.</param>
+static bool IsValidChannelName(const char* szName) {
+    size_t length = strlen(szName);
+    if (0 == length || length >= BroadcastPublisher::cMaxNameLength) {
+        return false;
+    }
+
+    for (size_t i = 0; i < length; ++i) {
+        char c = szName[i];
+        if (!isalnum(static_cast<unsigned char>(c)) && '-' != c && '_' != c && '.' != c) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// Number operating system identifies calling process by.
+static uint32_t GetOwnProcessId() {
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return static_cast<uint32_t>(getpid());
+#endif
+}
+
+/// Whether a process has exited. One that can't be looked at, such as one of another user, is taken as
+/// running, and so on Linux is one that exited but whose parent has yet to reap it.
+/// <param name="processId">process ID.</param>
+static bool HasProcessExited(uint32_t processId) {
+#ifdef _WIN32
+    HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, processId);
+    if (NULL == hProcess) {
+        // No process has that ID any more
+        return ERROR_INVALID_PARAMETER == GetLastError();
+    }
+
+    // Process object outlives process while anything still has a handle to it
+    bool bExited = (WAIT_OBJECT_0 == WaitForSingleObject(hProcess, 0));
+    CloseHandle(hProcess);
+
+    return bExited;
+#else
+    return 0 != kill(static_cast<pid_t>(processId), 0) && ESRCH == errno;
+#endif
+}
+
+/// Free slots of a channel's reader table whose readers exited without detaching.
+/// <param name="pHeader">channel's header.</param>
+/// <returns>mask with bit i set if slot i was freed.</returns>
+static uint32_t FreeAbandonedReaderSlots(BroadcastChannelHeader* pHeader) {
+    uint32_t freedSlots = 0;
+    for (UINT i = 0; i < cBroadcastMaxReaders; ++i) {
+        BroadcastReaderSlot& slot = pHeader->readers[i];
+        UINT64 holder = slot.holder.load(std::memory_order_acquire);
+        uint32_t processId = static_cast<uint32_t>(holder >> 32);
+        if (0 == processId || !HasProcessExited(processId)) {
+            continue;
+        }
+
+        // Clearing process ID first lets only one of several processes freeing slot at once reset it, and
+        // keeps slot taken while it is reset, so a reader taking it next never has its waiting flag cleared
+        if (!slot.holder.compare_exchange_strong(holder, holder & 0xFFFFFFFF, std::memory_order_acq_rel)) {
+            continue;
+        }
+
+        slot.overrunBlocks.store(0, std::memory_order_relaxed);
+        slot.bWaiting.store(0, std::memory_order_relaxed);
+        slot.holder.store(0, std::memory_order_release);
+        freedSlots |= 1u << i;
+    }
+
+    return freedSlots;
+}
+
+/// Name operating system knows a channel's shared memory by.
+/// <param name="szName">channel name.</param>
+/// <param name="szBuffer">receives name.</param>
+/// <param name="cchBuffer">size of buffer, in characters.</param>
+static void GetMappingName(const char* szName, char* szBuffer, size_t cchBuffer) {
+#ifdef _WIN32
+    // Session namespace needs no privilege, and keeps channels of different logged on users apart
+    snprintf(szBuffer, cchBuffer, "Local\\AudioBasics.%s", szName);
+#else
+    snprintf(szBuffer, cchBuffer, "/AudioBasics.%s", szName);
+#endif
+}
+
+#ifdef _WIN32
+/// Name of wakeup event of a reader.
+/// <param name="szName">channel name.</param>
+/// <param name="ticket">ticket reader took when it attached.</param>
+/// <param name="szBuffer">receives name.</param>
+/// <param name="cchBuffer">size of buffer, in characters.</param>
+static void GetWakeEventName(const char* szName, uint32_t ticket, char* szBuffer, size_t cchBuffer) {
+    snprintf(szBuffer, cchBuffer, "Local\\AudioBasics.%s.reader%u", szName, ticket);
+}
+#else
+/// Sleep until wake word changes from a value, or a timeout passes.
+/// <param name="pWord">word to sleep on.</param>
+/// <param name="value">value word was seen holding; returns at once if it no longer does.</param>
+/// <param name="nanoseconds">longest time to sleep.</param>
+static void FutexWait(std::atomic<uint32_t>* pWord, uint32_t value, UINT64 nanoseconds) {
+    timespec timeout;
+    timeout.tv_sec = static_cast<time_t>(nanoseconds / 1000000000);
+    timeout.tv_nsec = static_cast<long>(nanoseconds % 1000000000);
+
+    // Not FUTEX_PRIVATE_FLAG: sleepers are in other processes
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(pWord), FUTEX_WAIT, value, &timeout, NULL, 0);
+}
+
+/// Wake every thread sleeping on a word, in any process.
+/// <param name="pWord">word sleepers wait on.</param>
+static void FutexWakeAll(std::atomic<uint32_t>* pWord) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(pWord), FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/// Name of file publishers lock while creating or removing a channel's shared memory. Its prefix is
+/// not one of a channel's shared memory, so no channel name gives both.
+/// <param name="szName">channel name.</param>
+/// <param name="szBuffer">receives name.</param>
+/// <param name="cchBuffer">size of buffer, in characters.</param>
+static void GetLockName(const char* szName, char* szBuffer, size_t cchBuffer) {
+    snprintf(szBuffer, cchBuffer, "/AudioBasics-lock.%s", szName);
+}
+
+/// Lock a channel's name against other publishers creating or removing its shared memory, waiting
+/// for one holding it to finish.
+/// <param name="szLockName">name of lock file.</param>
+/// <returns>descriptor holding lock, to pass to UnlockChannelName, or -1 with errno set on failure.</returns>
+static int LockChannelName(const char* szLockName) {
+    for (;;) {
+        int fd = shm_open(szLockName, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        if (fd < 0) {
+            return -1;
+        }
+
+        int result = flock(fd, LOCK_EX);
+        while (0 != result && EINTR == errno) {
+            result = flock(fd, LOCK_EX);
+        }
+        if (0 != result) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            return -1;
+        }
+
+        // Holder before may have removed file while this waited for it, and locking a removed file excludes nobody
+        struct stat locked;
+        struct stat named;
+        int fdNamed = shm_open(szLockName, O_RDONLY | O_CLOEXEC, 0);
+        bool bCurrent = fdNamed >= 0 && 0 == fstat(fd, &locked) && 0 == fstat(fdNamed, &named) &&
+            locked.st_dev == named.st_dev && locked.st_ino == named.st_ino;
+        int error = errno;
+        if (fdNamed >= 0) {
+            close(fdNamed);
+        }
+        if (bCurrent) {
+            return fd;
+        }
+
+        close(fd);
+        if (fdNamed < 0 && ENOENT != error) {
+            errno = error;
+            return -1;
+        }
+    }
+}
+
+/// Release a channel's name locked by LockChannelName.
+/// <param name="szLockName">name of lock file.</param>
+/// <param name="fd">descriptor holding lock.</param>
+static void UnlockChannelName(const char* szLockName, int fd) {
+    // Removed while still held, so publishers waiting on it start over with a new one, and none is left behind
+    shm_unlink(szLockName);
+    close(fd);
+}
+
+/// Whether shared memory a channel's name refers to was left behind by a publisher that closed channel or
+/// exited without closing it, so name can be taken over. Memory that can't be looked at, or has another
+/// layout, is taken as in use.
+/// <param name="szMappingName">name of channel's shared memory.</param>
+static bool IsAbandonedChannel(const char* szMappingName) {
+    int fd = shm_open(szMappingName, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        // Unlinked meanwhile, so name is free
+        return ENOENT == errno;
+    }
+
+    bool bAbandoned = false;
+    struct stat status;
+    if (0 == fstat(fd, &status)) {
+        // Header is written right after memory is created, so memory left without one for long never gets one
+        bool bSetupOver = (time(NULL) - status.st_mtime > static_cast<time_t>(cBroadcastSetupSeconds));
+        if (static_cast<UINT64>(status.st_size) < sizeof(BroadcastChannelHeader)) {
+            bAbandoned = bSetupOver;
+        }
+        else {
+            void* pMapping = mmap(NULL, sizeof(BroadcastChannelHeader), PROT_READ, MAP_SHARED, fd, 0);
+            if (MAP_FAILED != pMapping) {
+                const BroadcastChannelHeader* pHeader = static_cast<const BroadcastChannelHeader*>(pMapping);
+                uint32_t version = pHeader->version.load(std::memory_order_acquire);
+                if (0 == version) {
+                    bAbandoned = bSetupOver;
+                }
+                else if (cBroadcastVersion == version && 0 == memcmp(pHeader->magic, cBroadcastMagic, sizeof(cBroadcastMagic))) {
+                    bAbandoned = (0 != pHeader->bClosed.load(std::memory_order_acquire)) || HasProcessExited(pHeader->publisherProcessId);
+                }
+                munmap(pMapping, sizeof(BroadcastChannelHeader));
+            }
+        }
+    }
+
+    close(fd);
+
+    return bAbandoned;
+}
+#endif
+
+/// Constructor
+BroadcastPublisher::BroadcastPublisher() :
+    m_pHeader(NULL),
+    m_pSlots(NULL),
+    m_mappingSize(0),
+    m_slotSize(0),
+    m_slotCount(0),
+    m_channelCount(0),
+    m_publishedCount(0),
+    m_nextReclaimTimestamp(0)
+#ifdef _WIN32
+    , m_hMapping(NULL)
+#else
+    , m_mappingDevice(0)
+    , m_mappingInode(0)
+#endif
+{
+    m_szName[0] = '\0';
+
+#ifdef _WIN32
+    for (UINT i = 0; i < cBroadcastMaxReaders; ++i) {
+        m_hReaderEvents[i] = NULL;
+        m_readerTickets[i] = 0;
+    }
+#endif
+}
+
+/// Destructor. Closes channel, if open.
+BroadcastPublisher::~BroadcastPublisher() {
+    Close();
+}
+
+/// Create shared memory of channel and lay out its ring.
+/// On Linux, where shared memory outlives its creator, a channel whose publisher closed it or exited
+/// without closing it is replaced; one whose publisher is still running is not.
+/// <param name="szName">channel name: letters, digits, '-', '_' and '.', shorter than cMaxNameLength.</param>
+/// <param name="channelCount">number of interleaved channels in blocks, from 1 to AudioBlock::MaxChannels.</param>
+/// <param name="sampleRate">sample rate, in Hz.</param>
+/// <param name="slotCount">number of slots in ring, a power of two from cMinSlotCount to cMaxSlotCount.</param>
+/// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range, E_UNEXPECTED if already open,
+/// otherwise failure code, such as when another publisher has channel open.</returns>
+HRESULT BroadcastPublisher::Open(const char* szName, WORD channelCount, UINT sampleRate, UINT slotCount) {
+    if (IsOpen()) {
+        return E_UNEXPECTED;
+    }
+
+    if (!IsValidChannelName(szName) || 0 == channelCount || channelCount > AudioBlock::MaxChannels || 0 == sampleRate ||
+        slotCount < cMinSlotCount || slotCount > cMaxSlotCount || 0 != (slotCount & (slotCount - 1))) {
+        return E_INVALIDARG;
+    }
+
+    UINT slotSize = cBroadcastBlockHeaderSize + AudioBlock::MaxSamples * channelCount * sizeof(int16_t);
+    size_t mappingSize = sizeof(BroadcastChannelHeader) + static_cast<size_t>(slotSize) * slotCount;
+
+    char szMappingName[cMaxNameLength + cPlatformNameLength];
+    GetMappingName(szName, szMappingName, sizeof(szMappingName));
+
+    void* pMapping = NULL;
+#ifdef _WIN32
+    m_hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, static_cast<DWORD>(mappingSize), szMappingName);
+    if (NULL == m_hMapping) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    // Readers keep a closed channel's memory alive, so a name still in use can't be taken over
+    if (ERROR_ALREADY_EXISTS == GetLastError()) {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+        return HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+    }
+
+    pMapping = MapViewOfFile(m_hMapping, FILE_MAP_ALL_ACCESS, 0, 0, mappingSize);
+    if (NULL == pMapping) {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+        return hr;
+    }
+#else
+    // Name is locked from looking at what it refers to until shared memory is created, so two publishers
+    // never both find a channel left behind and each replace it, leaving one with a channel no reader finds
+    char szLockName[cMaxNameLength + cPlatformNameLength];
+    GetLockName(szName, szLockName, sizeof(szLockName));
+    int lockFd = LockChannelName(szLockName);
+    if (lockFd < 0) {
+        return HRESULT_FROM_ERRNO(errno);
+    }
+
+    // As on Windows, a name in use by a running publisher is never taken over
+    HRESULT hr = S_OK;
+    int fd = shm_open(szMappingName, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd < 0 && EEXIST == errno) {
+        if (!IsAbandonedChannel(szMappingName)) {
+            hr = HRESULT_FROM_ERRNO(EEXIST);
+        }
+        else {
+            // Readers still attached to channel left behind keep its memory; readers attaching from now on find this one
+            shm_unlink(szMappingName);
+            fd = shm_open(szMappingName, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        }
+    }
+    if (SUCCEEDED(hr) && fd < 0) {
+        hr = HRESULT_FROM_ERRNO(errno);
+    }
+    if (FAILED(hr)) {
+        UnlockChannelName(szLockName, lockFd);
+        return hr;
+    }
+
+    struct stat status;
+    if (0 != ftruncate(fd, static_cast<off_t>(mappingSize)) || 0 != fstat(fd, &status)) {
+        hr = HRESULT_FROM_ERRNO(errno);
+    }
+    else {
+        pMapping = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (MAP_FAILED == pMapping) {
+            hr = HRESULT_FROM_ERRNO(errno);
+            pMapping = NULL;
+        }
+    }
+
+    // Mapping stays valid without descriptor
+    close(fd);
+    if (FAILED(hr)) {
+        shm_unlink(szMappingName);
+    }
+    UnlockChannelName(szLockName, lockFd);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    m_mappingDevice = static_cast<UINT64>(status.st_dev);
+    m_mappingInode = static_cast<UINT64>(status.st_ino);
+#endif
+
+    // New shared memory is zero filled: every slot is unused, every reader slot free
+    m_pHeader = static_cast<BroadcastChannelHeader*>(pMapping);
+    m_pSlots = static_cast<BYTE*>(pMapping) + sizeof(BroadcastChannelHeader);
+    m_mappingSize = mappingSize;
+    m_slotSize = slotSize;
+    m_slotCount = slotCount;
+    m_channelCount = channelCount;
+    m_publishedCount = 0;
+    m_publishLatency.Reset();
+    m_nextReclaimTimestamp = 0;
+    memcpy(m_szName, szName, strlen(szName) + 1);
+
+    memcpy(m_pHeader->magic, cBroadcastMagic, sizeof(cBroadcastMagic));
+    m_pHeader->headerSize = sizeof(BroadcastChannelHeader);
+    m_pHeader->slotSize = slotSize;
+    m_pHeader->slotCount = slotCount;
+    m_pHeader->channelCount = channelCount;
+    m_pHeader->sampleRate = sampleRate;
+    m_pHeader->publisherProcessId = GetOwnProcessId();
+    m_pHeader->version.store(cBroadcastVersion, std::memory_order_release);
+
+    return S_OK;
+}
+
+/// Copy a processed block into next slot of ring and wake readers waiting for it.
+/// Overwrites oldest block, whether or not every reader has read it.
+/// <param name="block">captured audio block.</param>
+/// <param name="result">pipeline's results for block, giving its stream position, voice and angles.</param>
+/// <returns>S_OK on success, E_INVALIDARG if channel count does not match, E_UNEXPECTED if not open.</returns>
+HRESULT BroadcastPublisher::Publish(const AudioBlock& block, const AudioPipelineResult& result) {
+    if (!IsOpen()) {
+        return E_UNEXPECTED;
+    }
+
+    if (block.channelCount != m_channelCount || block.sampleCount > AudioBlock::MaxSamples) {
+        return E_INVALIDARG;
+    }
+
+    UINT64 publishStart = GetClockNanoseconds();
+    UINT64 number = m_publishedCount;
+    BroadcastSlotHeader* pSlot = reinterpret_cast<BroadcastSlotHeader*>(m_pSlots + static_cast<size_t>(number & (m_slotCount - 1)) * m_slotSize);
+
+    // Odd state tells readers slot is being rewritten; fence keeps block's writes from being seen ahead of it
+    pSlot->state.store(2 * number + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    BroadcastBlockInfo& info = pSlot->info;
+    info.number = number;
+    info.samplePosition = result.samplePosition;
+    info.captureTimestamp = block.captureTimestamp;
+    info.publishTimestamp = publishStart;
+    info.sampleCount = block.sampleCount;
+    info.channelCount = block.channelCount;
+    info.sequence = block.sequence;
+    info.bVoiceActive = result.bVoiceActive ? 1 : 0;
+    info.angles = block.angles;
+    info.beamAngleDegrees = result.beamAngleDegrees;
+    info.sourceAngleDegrees = result.sourceAngleDegrees;
+    info.sourceConfidence = result.sourceConfidence;
+    info.trackedAngleDegrees = result.trackedAngleDegrees;
+    info.energyPeak = result.energyPeak;
+    memcpy(reinterpret_cast<BYTE*>(pSlot) + cBroadcastBlockHeaderSize, block.pSamples, block.sampleCount * block.channelCount * sizeof(int16_t));
+
+    pSlot->state.store(2 * number + 2, std::memory_order_release);
+
+    // Sequentially consistent with readers getting ready to sleep, so each either sees block or is woken
+    m_publishedCount = number + 1;
+    m_pHeader->publishedCount.store(m_publishedCount, std::memory_order_seq_cst);
+    WakeReaders();
+
+    // Readers that exited without detaching never free their slots, so look for them now and then
+    if (publishStart >= m_nextReclaimTimestamp) {
+        ReclaimReaderSlots();
+        m_nextReclaimTimestamp = publishStart + cReclaimIntervalNanoseconds;
+    }
+
+    m_publishLatency.Record(GetClockNanoseconds() - publishStart);
+
+    return S_OK;
+}
+
+/// Mark channel closed, wake every waiting reader, and release shared memory. Readers still attached
+/// can read blocks already published. Does nothing if not open.
+void BroadcastPublisher::Close() {
+    if (!IsOpen()) {
+        return;
+    }
+
+#ifndef _WIN32
+    // No other publisher takes name over while channel is open and its publisher running, so name is unlinked
+    // before channel is marked closed, and only while it still refers to memory this publisher created. Name is
+    // locked meanwhile, as by Open; if it can't be, the next publisher replaces channel once it is marked closed.
+    char szMappingName[cMaxNameLength + cPlatformNameLength];
+    char szLockName[cMaxNameLength + cPlatformNameLength];
+    GetMappingName(m_szName, szMappingName, sizeof(szMappingName));
+    GetLockName(m_szName, szLockName, sizeof(szLockName));
+    int lockFd = LockChannelName(szLockName);
+    if (lockFd >= 0) {
+        int fd = shm_open(szMappingName, O_RDONLY | O_CLOEXEC, 0);
+        if (fd >= 0) {
+            struct stat status;
+            if (0 == fstat(fd, &status) && m_mappingDevice == static_cast<UINT64>(status.st_dev) && m_mappingInode == static_cast<UINT64>(status.st_ino)) {
+                // Attached readers keep their mappings; new ones no longer find channel
+                shm_unlink(szMappingName);
+            }
+            close(fd);
+        }
+        UnlockChannelName(szLockName, lockFd);
+    }
+#endif
+
+    m_pHeader->bClosed.store(1, std::memory_order_seq_cst);
+    WakeReaders();
+
+#ifdef _WIN32
+    for (UINT i = 0; i < cBroadcastMaxReaders; ++i) {
+        if (NULL != m_hReaderEvents[i]) {
+            CloseHandle(m_hReaderEvents[i]);
+            m_hReaderEvents[i] = NULL;
+        }
+        m_readerTickets[i] = 0;
+    }
+
+    // Memory goes away once the last attached reader closes its handle
+    UnmapViewOfFile(m_pHeader);
+    CloseHandle(m_hMapping);
+    m_hMapping = NULL;
+#else
+    munmap(m_pHeader, m_mappingSize);
+    m_mappingDevice = 0;
+    m_mappingInode = 0;
+#endif
+
+    m_pHeader = NULL;
+    m_pSlots = NULL;
+    m_mappingSize = 0;
+}
+
+/// Number of readers attached right now.
+UINT BroadcastPublisher::GetReaderCount() const {
+    UINT readerCount = 0;
+    for (UINT i = 0; IsOpen() && i < cBroadcastMaxReaders; ++i) {
+        if (0 != m_pHeader->readers[i].holder.load(std::memory_order_relaxed)) {
+            ++readerCount;
+        }
+    }
+
+    return readerCount;
+}
+
+/// Number of blocks attached readers have lost to overruns.
+UINT64 BroadcastPublisher::GetOverrunCount() const {
+    UINT64 overrunBlocks = 0;
+    for (UINT i = 0; IsOpen() && i < cBroadcastMaxReaders; ++i) {
+        if (0 != m_pHeader->readers[i].holder.load(std::memory_order_relaxed)) {
+            overrunBlocks += m_pHeader->readers[i].overrunBlocks.load(std::memory_order_relaxed);
+        }
+    }
+
+    return overrunBlocks;
+}
+
+/// Wake readers waiting for a block, after a publish or close.
+void BroadcastPublisher::WakeReaders() {
+#ifdef _WIN32
+    for (UINT i = 0; i < cBroadcastMaxReaders; ++i) {
+        BroadcastReaderSlot& slot = m_pHeader->readers[i];
+        if (0 == slot.bWaiting.load(std::memory_order_seq_cst)) {
+            continue;
+        }
+
+        // Slot changed hands since its event was opened, so open event of reader now holding it
+        uint32_t ticket = static_cast<uint32_t>(slot.holder.load(std::memory_order_relaxed));
+        if (ticket != m_readerTickets[i]) {
+            if (NULL != m_hReaderEvents[i]) {
+                CloseHandle(m_hReaderEvents[i]);
+            }
+
+            char szEventName[cMaxNameLength + cPlatformNameLength];
+            GetWakeEventName(m_szName, ticket, szEventName, sizeof(szEventName));
+            m_hReaderEvents[i] = OpenEventA(EVENT_MODIFY_STATE, FALSE, szEventName);
+            m_readerTickets[i] = ticket;
+        }
+
+        if (NULL != m_hReaderEvents[i]) {
+            SetEvent(m_hReaderEvents[i]);
+        }
+    }
+#else
+    m_pHeader->wakeWord.fetch_add(1, std::memory_order_seq_cst);
+    for (UINT i = 0; i < cBroadcastMaxReaders; ++i) {
+        // One wake reaches every sleeper
+        if (0 != m_pHeader->readers[i].bWaiting.load(std::memory_order_seq_cst)) {
+            FutexWakeAll(&m_pHeader->wakeWord);
+            break;
+        }
+    }
+#endif
+}
+
+/// Free slots of readers that exited without detaching, and stop signalling their wakeup events.
+void BroadcastPublisher::ReclaimReaderSlots() {
+#ifdef _WIN32
+    uint32_t freedSlots = FreeAbandonedReaderSlots(m_pHeader);
+    for (UINT i = 0; i < cBroadcastMaxReaders; ++i) {
+        if (0 != (freedSlots & (1u << i)) && NULL != m_hReaderEvents[i]) {
+            CloseHandle(m_hReaderEvents[i]);
+            m_hReaderEvents[i] = NULL;
+            m_readerTickets[i] = 0;
+        }
+    }
+#else
+    FreeAbandonedReaderSlots(m_pHeader);
+#endif
+}
+
+/// Constructor
+BroadcastReader::BroadcastReader() :
+    m_pHeader(NULL),
+    m_pSlot(NULL),
+    m_pSlots(NULL),
+    m_mappingSize(0),
+    m_slotSize(0),
+    m_slotCount(0),
+    m_sampleRate(0),
+    m_channelCount(0),
+    m_position(0),
+    m_overrunBlocks(0),
+    m_pReading(NULL),
+    m_readTimestamp(0)
+#ifdef _WIN32
+    , m_hMapping(NULL)
+    , m_hWakeEvent(NULL)
+#endif
+{
+}
+
+/// Destructor. Detaches from channel, if attached.
+BroadcastReader::~BroadcastReader() {
+    Close();
+}
+
+/// Attach to a channel and take a slot in its reader table, freeing slots of readers that exited without
+/// detaching if every slot is taken.
+/// <param name="szName">name channel was opened with.</param>
+/// <returns>S_OK on success, E_INVALIDARG if name is invalid or channel is not ready or has another layout,
+/// E_ACCESSDENIED if channel already has cBroadcastMaxReaders running readers, otherwise failure code, such as
+/// when no channel has that name.</returns>
+HRESULT BroadcastReader::Open(const char* szName) {
+    Close();
+
+    if (!IsValidChannelName(szName)) {
+        return E_INVALIDARG;
+    }
+
+    char szMappingName[BroadcastPublisher::cMaxNameLength + cPlatformNameLength];
+    GetMappingName(szName, szMappingName, sizeof(szMappingName));
+
+    void* pMapping = NULL;
+    size_t mappingSize = 0;
+#ifdef _WIN32
+    m_hMapping = OpenFileMappingA(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, szMappingName);
+    if (NULL == m_hMapping) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    pMapping = MapViewOfFile(m_hMapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0);
+    if (NULL == pMapping) {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Close();
+        return hr;
+    }
+
+    MEMORY_BASIC_INFORMATION region;
+    if (0 != VirtualQuery(pMapping, &region, sizeof(region))) {
+        mappingSize = region.RegionSize;
+    }
+#else
+    int fd = shm_open(szMappingName, O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0) {
+        return HRESULT_FROM_ERRNO(errno);
+    }
+
+    HRESULT hr = S_OK;
+    struct stat status;
+    if (0 != fstat(fd, &status)) {
+        hr = HRESULT_FROM_ERRNO(errno);
+    }
+    else if (static_cast<UINT64>(status.st_size) < sizeof(BroadcastChannelHeader)) {
+        // Publisher has yet to size it
+        hr = E_INVALIDARG;
+    }
+    else {
+        mappingSize = static_cast<size_t>(status.st_size);
+        pMapping = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (MAP_FAILED == pMapping) {
+            hr = HRESULT_FROM_ERRNO(errno);
+            pMapping = NULL;
+        }
+    }
+
+    close(fd);
+    if (FAILED(hr)) {
+        return hr;
+    }
+#endif
+
+    m_pHeader = static_cast<BroadcastChannelHeader*>(pMapping);
+    m_mappingSize = mappingSize;
+
+    // Header fields are only read once version says publisher has finished writing them
+    const BroadcastChannelHeader* pHeader = m_pHeader;
+    if (mappingSize < sizeof(BroadcastChannelHeader) || cBroadcastVersion != pHeader->version.load(std::memory_order_acquire) ||
+        0 != memcmp(pHeader->magic, cBroadcastMagic, sizeof(cBroadcastMagic)) || sizeof(BroadcastChannelHeader) != pHeader->headerSize ||
+        0 == pHeader->channelCount || pHeader->channelCount > AudioBlock::MaxChannels ||
+        pHeader->slotSize < cBroadcastBlockHeaderSize + AudioBlock::MaxSamples * pHeader->channelCount * sizeof(int16_t) ||
+        pHeader->slotCount < BroadcastPublisher::cMinSlotCount || pHeader->slotCount > BroadcastPublisher::cMaxSlotCount ||
+        0 != (pHeader->slotCount & (pHeader->slotCount - 1)) ||
+        mappingSize < pHeader->headerSize + static_cast<size_t>(pHeader->slotSize) * pHeader->slotCount) {
+        Close();
+        return E_INVALIDARG;
+    }
+
+    m_pSlots = reinterpret_cast<const BYTE*>(m_pHeader) + pHeader->headerSize;
+    m_slotSize = pHeader->slotSize;
+    m_slotCount = pHeader->slotCount;
+    m_sampleRate = pHeader->sampleRate;
+    m_channelCount = static_cast<WORD>(pHeader->channelCount);
+
+    // Ticket 0 marks a free slot, so is skipped when attach count wraps
+    uint32_t ticket = m_pHeader->attachCount.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (0 == ticket) {
+        ticket = m_pHeader->attachCount.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+#ifdef _WIN32
+    // Created before slot is taken, so publisher always finds it once reader waits
+    char szEventName[BroadcastPublisher::cMaxNameLength + cPlatformNameLength];
+    GetWakeEventName(szName, ticket, szEventName, sizeof(szEventName));
+    m_hWakeEvent = CreateEventA(NULL, FALSE, FALSE, szEventName);
+    if (NULL == m_hWakeEvent) {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Close();
+        return hr;
+    }
+#endif
+
+    // Only once every slot is taken are readers that exited without detaching looked for
+    UINT64 holder = (static_cast<UINT64>(GetOwnProcessId()) << 32) | ticket;
+    for (UINT pass = 0; pass < 2 && NULL == m_pSlot; ++pass) {
+        if (0 != pass) {
+            FreeAbandonedReaderSlots(m_pHeader);
+        }
+
+        for (UINT i = 0; i < cBroadcastMaxReaders && NULL == m_pSlot; ++i) {
+            UINT64 freeHolder = 0;
+            if (m_pHeader->readers[i].holder.compare_exchange_strong(freeHolder, holder, std::memory_order_acq_rel)) {
+                m_pSlot = &m_pHeader->readers[i];
+            }
+        }
+    }
+    if (NULL == m_pSlot) {
+        Close();
+        return E_ACCESSDENIED;
+    }
+
+    // Start live, at next block to be published
+    m_position = m_pHeader->publishedCount.load(std::memory_order_acquire);
+    m_overrunBlocks = 0;
+    m_deliveryLatency.Reset();
+    m_pSlot->position.store(m_position, std::memory_order_relaxed);
+    m_pSlot->overrunBlocks.store(0, std::memory_order_relaxed);
+
+    return S_OK;
+}
+
+/// Give up slot in reader table and detach from channel. Does nothing if not attached.
+void BroadcastReader::Close() {
+    if (NULL != m_pSlot) {
+        m_pSlot->overrunBlocks.store(0, std::memory_order_relaxed);
+        m_pSlot->bWaiting.store(0, std::memory_order_relaxed);
+        m_pSlot->holder.store(0, std::memory_order_release);
+        m_pSlot = NULL;
+    }
+
+#ifdef _WIN32
+    if (NULL != m_hWakeEvent) {
+        CloseHandle(m_hWakeEvent);
+        m_hWakeEvent = NULL;
+    }
+    if (NULL != m_pHeader) {
+        UnmapViewOfFile(m_pHeader);
+    }
+    if (NULL != m_hMapping) {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+    }
+#else
+    if (NULL != m_pHeader) {
+        munmap(m_pHeader, m_mappingSize);
+    }
+#endif
+
+    m_pHeader = NULL;
+    m_pSlots = NULL;
+    m_mappingSize = 0;
+    m_pReading = NULL;
+}
+
+/// Wait until next block has been published.
+/// <param name="timeoutMilliseconds">longest time to wait.</param>
+/// <returns>S_OK if a block can be read, S_FALSE if none was published in time, E_ABORT if publisher
+/// closed channel and every block was read, E_UNEXPECTED if not attached.</returns>
+HRESULT BroadcastReader::Wait(UINT timeoutMilliseconds) {
+    if (!IsOpen()) {
+        return E_UNEXPECTED;
+    }
+
+    UINT64 deadline = GetClockNanoseconds() + static_cast<UINT64>(timeoutMilliseconds) * 1000000;
+    for (;;) {
+#ifndef _WIN32
+        // Read before looking for a block: a publish after that look bumps it, so sleeping on it returns at once
+        uint32_t wakeWord = m_pHeader->wakeWord.load(std::memory_order_seq_cst);
+#endif
+
+        if (m_position < m_pHeader->publishedCount.load(std::memory_order_seq_cst)) {
+            return S_OK;
+        }
+
+        // Channel is closed after its last publish, so blocks published before then are seen once close is
+        if (0 != m_pHeader->bClosed.load(std::memory_order_seq_cst)) {
+            return (m_position < m_pHeader->publishedCount.load(std::memory_order_seq_cst)) ? S_OK : E_ABORT;
+        }
+
+        UINT64 now = GetClockNanoseconds();
+        if (now >= deadline) {
+            return S_FALSE;
+        }
+
+#ifdef _WIN32
+        // Marked waiting before looking again, so publisher either sees reader waiting or reader sees block
+        m_pSlot->bWaiting.store(1, std::memory_order_seq_cst);
+        if (m_position >= m_pHeader->publishedCount.load(std::memory_order_seq_cst) && 0 == m_pHeader->bClosed.load(std::memory_order_seq_cst)) {
+            WaitForSingleObject(m_hWakeEvent, static_cast<DWORD>((deadline - now + 999999) / 1000000));
+        }
+        m_pSlot->bWaiting.store(0, std::memory_order_relaxed);
+#else
+        // Marked waiting before sleeping, so publisher that bumps wake word after this either sees reader waiting or changes word first
+        m_pSlot->bWaiting.store(1, std::memory_order_seq_cst);
+        FutexWait(&m_pHeader->wakeWord, wakeWord, deadline - now);
+        m_pSlot->bWaiting.store(0, std::memory_order_relaxed);
+#endif
+    }
+}
+
+/// Look at next block where it lies in shared memory, without copying it. Skips ahead, counting lost
+/// blocks, if publisher has already overwritten it. Every successful call must be followed by EndRead.
+/// <param name="ppInfo">receives block's stream position, timing and angles.</param>
+/// <param name="ppSamples">receives block's interleaved frames.</param>
+/// <returns>S_OK if a block was handed out, S_FALSE if no block is ready, E_ABORT if publisher closed channel and
+/// every block was read, E_UNEXPECTED if not attached or a block is already handed out.</returns>
+HRESULT BroadcastReader::BeginRead(const BroadcastBlockInfo** ppInfo, const int16_t** ppSamples) {
+    if (!IsOpen() || NULL != m_pReading) {
+        return E_UNEXPECTED;
+    }
+
+    const BroadcastSlotHeader* pSlot = NULL;
+    HRESULT hr = FindNextBlock(&pSlot);
+    if (S_OK != hr) {
+        return hr;
+    }
+
+    m_pReading = pSlot;
+    m_readTimestamp = GetClockNanoseconds();
+    *ppInfo = &pSlot->info;
+    *ppSamples = reinterpret_cast<const int16_t*>(reinterpret_cast<const BYTE*>(pSlot) + cBroadcastBlockHeaderSize);
+
+    return S_OK;
+}
+
+/// Finish with block handed out by BeginRead and move on to next one.
+/// <returns>S_OK if block stayed intact while it was read, S_FALSE if publisher overwrote it meanwhile,
+/// so anything read from it must be discarded, E_UNEXPECTED if no block was handed out.</returns>
+HRESULT BroadcastReader::EndRead() {
+    if (NULL == m_pReading) {
+        return E_UNEXPECTED;
+    }
+
+    UINT64 publishTimestamp = m_pReading->info.publishTimestamp;
+
+    // Everything caller read from block is read before state is checked again
+    std::atomic_thread_fence(std::memory_order_acquire);
+    bool bIntact = (2 * m_position + 2 == m_pReading->state.load(std::memory_order_relaxed));
+    m_pReading = NULL;
+
+    if (!bIntact) {
+        SkipOverrun();
+        return S_FALSE;
+    }
+
+    m_deliveryLatency.Record(m_readTimestamp - publishTimestamp);
+    Advance();
+
+    return S_OK;
+}
+
+/// Copy next block out of shared memory, skipping blocks overwritten before or while they were copied.
+/// <param name="pInfo">receives block's stream position, timing and angles.</param>
+/// <param name="pSamples">receives block's interleaved frames; room for AudioBlock::MaxSamples frames.</param>
+/// <returns>S_OK if a block was copied, S_FALSE if no block is ready, E_ABORT if publisher closed channel and
+/// every block was read, E_UNEXPECTED if not attached.</returns>
+HRESULT BroadcastReader::Read(BroadcastBlockInfo* pInfo, int16_t* pSamples) {
+    if (!IsOpen() || NULL != m_pReading) {
+        return E_UNEXPECTED;
+    }
+
+    for (;;) {
+        const BroadcastSlotHeader* pSlot = NULL;
+        HRESULT hr = FindNextBlock(&pSlot);
+        if (S_OK != hr) {
+            return hr;
+        }
+
+        UINT64 readTimestamp = GetClockNanoseconds();
+        memcpy(pInfo, &pSlot->info, sizeof(*pInfo));
+
+        // A block being overwritten may claim any length; what is copied is checked below either way
+        UINT sampleCount = (pInfo->sampleCount < AudioBlock::MaxSamples) ? pInfo->sampleCount : AudioBlock::MaxSamples;
+        memcpy(pSamples, reinterpret_cast<const BYTE*>(pSlot) + cBroadcastBlockHeaderSize, sampleCount * m_channelCount * sizeof(int16_t));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (2 * m_position + 2 == pSlot->state.load(std::memory_order_relaxed)) {
+            m_deliveryLatency.Record(readTimestamp - pInfo->publishTimestamp);
+            Advance();
+            return S_OK;
+        }
+
+        SkipOverrun();
+    }
+}
+
+/// Find slot of next block, skipping ahead if publisher has overwritten it.
+/// <param name="ppSlot">receives slot of next block.</param>
+/// <returns>S_OK if next block is complete, S_FALSE if it has not been published, E_ABORT if channel is closed and every block was read.</returns>
+HRESULT BroadcastReader::FindNextBlock(const BroadcastSlotHeader** ppSlot) {
+    for (;;) {
+        UINT64 publishedCount = m_pHeader->publishedCount.load(std::memory_order_acquire);
+        if (m_position >= publishedCount) {
+            if (0 != m_pHeader->bClosed.load(std::memory_order_acquire) && m_position >= m_pHeader->publishedCount.load(std::memory_order_acquire)) {
+                return E_ABORT;
+            }
+            return S_FALSE;
+        }
+
+        // Published count was read first, so slot holds next block, or a later one if publisher lapped reader
+        const BroadcastSlotHeader* pSlot = GetSlot(m_position);
+        if (publishedCount - m_position <= m_slotCount && 2 * m_position + 2 == pSlot->state.load(std::memory_order_acquire)) {
+            *ppSlot = pSlot;
+            return S_OK;
+        }
+
+        SkipOverrun();
+    }
+}
+
+/// Skip ahead to half a ring behind publisher, counting blocks lost.
+void BroadcastReader::SkipOverrun() {
+    // Half a ring leaves room to catch up on recent audio before being lapped again
+    UINT64 publishedCount = m_pHeader->publishedCount.load(std::memory_order_acquire);
+    UINT64 resume = (publishedCount > m_slotCount / 2) ? publishedCount - m_slotCount / 2 : 0;
+    if (resume <= m_position) {
+        resume = m_position + 1;
+    }
+
+    m_overrunBlocks += resume - m_position;
+    m_position = resume;
+    m_pSlot->overrunBlocks.store(m_overrunBlocks, std::memory_order_relaxed);
+    m_pSlot->position.store(m_position, std::memory_order_relaxed);
+}
+
+/// Move on to next block, publishing position to reader table.
+void BroadcastReader::Advance() {
+    ++m_position;
+    m_pSlot->position.store(m_position, std::memory_order_relaxed);
+}
@@ -0,0 +1,327 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "AudioBlock.h"
+#include "AudioPipeline.h"
+#include "LatencyHistogram.h"
+
+// For fields shared between publisher and readers
+#include <atomic>
+
+// Most readers one channel can have attached at once.
+static const UINT           cBroadcastMaxReaders = 16;
+
+// Size shared structures are padded to, in bytes, so fields written by different processes never share a cache line.
+static const UINT           cBroadcastCacheLine = 64;
+
+/// A published block's stream position, timing and angles, as readers see it.
+struct BroadcastBlockInfo {
+    // Number of block in broadcast, counting from 0 when publisher opened channel. Gaps mean reader lost blocks.
+    UINT64                  number;
+
+    // Index, since start of stream, of first sample in block.
+    UINT64                  samplePosition;
+
+    // GetClockNanoseconds when block was captured, and when it was published. The clock is system-wide,
+    // so readers in other processes can compare it with their own.
+    UINT64                  captureTimestamp;
+    UINT64                  publishTimestamp;
+
+    // Number of frames in block, and of interleaved channels in each frame.
+    uint32_t                sampleCount;
+    uint32_t                channelCount;
+
+    // Sequence number of block, as captured.
+    uint32_t                sequence;
+
+    // Nonzero if voice was detected in block or shortly before it.
+    uint32_t                bVoiceActive;
+
+    // Beam and sound source angles audio source reported with block.
+    AudioAngles             angles;
+
+    // As in AudioPipelineResult.
+    float                   beamAngleDegrees;
+    float                   sourceAngleDegrees;
+    float                   sourceConfidence;
+    float                   trackedAngleDegrees;
+    float                   energyPeak;
+};
+
+/// Start of every slot of a channel's ring; block's interleaved frames follow at cBroadcastBlockHeaderSize.
+struct BroadcastSlotHeader {
+    // 2 * number + 1 while publisher is writing block number into slot, 2 * number + 2 once block is complete; 0 before first use.
+    std::atomic<UINT64>     state;
+
+    BroadcastBlockInfo      info;
+};
+
+// Offset of frames in a slot, so they start cache line aligned.
+static const UINT           cBroadcastBlockHeaderSize = 2 * cBroadcastCacheLine;
+
+/// Reader's entry in a channel's reader table.
+struct BroadcastReaderSlot {
+    // 0 while slot is free, otherwise ticket of reader holding it in low 32 bits and ID of reader's process in
+    // high 32 bits, so both are taken and given up together. Ticket is a number unique to each attach, which
+    // names reader's wakeup event on Windows and lets publisher notice slot changing hands; process ID lets
+    // slot of a reader that exited without detaching be freed. Process ID is 0 while such a slot is being freed.
+    std::atomic<UINT64>     holder;
+
+    // Number of next block reader will read, and number of blocks it lost to overruns.
+    std::atomic<UINT64>     position;
+    std::atomic<UINT64>     overrunBlocks;
+
+    // Nonzero while reader is blocked waiting for a block.
+    std::atomic<uint32_t>   bWaiting;
+
+    BYTE                    padding[cBroadcastCacheLine - 28];
+};
+
+/// Header at start of a channel's shared memory, followed by its ring of slots.
+struct BroadcastChannelHeader {
+    char                    magic[8];
+
+    // Offset of first slot, size of each slot, and number of slots, a power of two.
+    uint32_t                headerSize;
+    uint32_t                slotSize;
+    uint32_t                slotCount;
+
+    // Format of every block published.
+    uint32_t                channelCount;
+    uint32_t                sampleRate;
+
+    // Set to layout version once publisher has written header, so readers never see it half written.
+    std::atomic<uint32_t>   version;
+
+    // Process that opened channel, so a publisher finding its name taken can tell whether it was left behind.
+    uint32_t                publisherProcessId;
+
+    BYTE                    padding0[cBroadcastCacheLine - 36];
+
+    // Written by publisher: blocks published so far, a word bumped on every publish that Linux readers
+    // sleep on, and whether publisher has closed channel.
+    std::atomic<UINT64>     publishedCount;
+    std::atomic<uint32_t>   wakeWord;
+    std::atomic<uint32_t>   bClosed;
+
+    BYTE                    padding1[cBroadcastCacheLine - 16];
+
+    // Written by readers: number of attaches so far.
+    std::atomic<uint32_t>   attachCount;
+
+    BYTE                    padding2[cBroadcastCacheLine - 4];
+
+    BroadcastReaderSlot     readers[cBroadcastMaxReaders];
+};
+
+/// Publishes processed blocks and their angles to a named shared memory channel, so other processes
+/// on the machine can consume the live stream without opening the sensor, which only one process can.
+/// Channel is a ring of fixed-size slots, each guarded by a sequence number: publisher never waits for
+/// readers, and each reader follows ring at its own pace, reading blocks in place and telling from
+/// sequence numbers when publisher lapped it. Readers asleep waiting for a block are woken through a
+/// futex on the channel's wake word on Linux, and through a named event per reader on Windows; with
+/// nobody waiting, publishing makes no system call, except to look for dead readers about once a second.
+/// Readers attach and detach at any time. Slot of a reader whose process exited without detaching is
+/// freed by that look, or by a reader finding every slot taken. Publish is for one producer thread at a
+/// time and never blocks.
+class BroadcastPublisher {
+public:
+    // Fewest, most and usual number of slots in ring. 256 full blocks hold about 8 seconds of audio.
+    static const UINT       cMinSlotCount = 16;
+    static const UINT       cMaxSlotCount = 4096;
+    static const UINT       cDefaultSlotCount = 256;
+
+    // Longest channel name, including terminator.
+    static const UINT       cMaxNameLength = 64;
+
+    /// Constructor
+    BroadcastPublisher();
+
+    /// Destructor. Closes channel, if open.
+    ~BroadcastPublisher();
+
+    /// Create shared memory of channel and lay out its ring.
+    /// On Linux, where shared memory outlives its creator, a channel whose publisher closed it or exited
+    /// without closing it is replaced; one whose publisher is still running is not.
+    /// <param name="szName">channel name: letters, digits, '-', '_' and '.', shorter than cMaxNameLength.</param>
+    /// <param name="channelCount">number of interleaved channels in blocks, from 1 to AudioBlock::MaxChannels.</param>
+    /// <param name="sampleRate">sample rate, in Hz.</param>
+    /// <param name="slotCount">number of slots in ring, a power of two from cMinSlotCount to cMaxSlotCount.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range, E_UNEXPECTED if already open,
+    /// otherwise failure code, such as when another publisher has channel open.</returns>
+    HRESULT                 Open(const char* szName, WORD channelCount, UINT sampleRate, UINT slotCount);
+
+    /// Copy a processed block into next slot of ring and wake readers waiting for it.
+    /// Overwrites oldest block, whether or not every reader has read it.
+    /// <param name="block">captured audio block.</param>
+    /// <param name="result">pipeline's results for block, giving its stream position, voice and angles.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if channel count does not match, E_UNEXPECTED if not open.</returns>
+    HRESULT                 Publish(const AudioBlock& block, const AudioPipelineResult& result);
+
+    /// Mark channel closed, wake every waiting reader, and release shared memory. Readers still attached
+    /// can read blocks already published. Does nothing if not open.
+    void                    Close();
+
+    /// Whether channel is open.
+    bool                    IsOpen() const { return NULL != m_pHeader; }
+
+    /// Number of blocks published since Open.
+    UINT64                  GetPublishedCount() const { return m_publishedCount; }
+
+    /// Number of readers attached right now.
+    UINT                    GetReaderCount() const;
+
+    /// Number of blocks attached readers have lost to overruns.
+    UINT64                  GetOverrunCount() const;
+
+    /// Duration of each Publish call since Open, recorded by producer.
+    const LatencyHistogram& GetPublishLatency() const { return m_publishLatency; }
+
+private:
+    BroadcastChannelHeader* m_pHeader;
+    BYTE*                   m_pSlots;
+    size_t                  m_mappingSize;
+    UINT                    m_slotSize;
+    UINT                    m_slotCount;
+    WORD                    m_channelCount;
+    UINT64                  m_publishedCount;
+    char                    m_szName[cMaxNameLength];
+    LatencyHistogram        m_publishLatency;
+
+    // GetClockNanoseconds when Publish next looks for slots of readers that exited without detaching.
+    UINT64                  m_nextReclaimTimestamp;
+
+#ifdef _WIN32
+    HANDLE                  m_hMapping;
+
+    // Wakeup event of each reader slot, opened for ticket of reader that last waited in it.
+    HANDLE                  m_hReaderEvents[cBroadcastMaxReaders];
+    uint32_t                m_readerTickets[cBroadcastMaxReaders];
+#else
+    // Identity of shared memory publisher created, so Close only unlinks name while it still refers to it.
+    UINT64                  m_mappingDevice;
+    UINT64                  m_mappingInode;
+#endif
+
+    /// Wake readers waiting for a block, after a publish or close.
+    void                    WakeReaders();
+
+    /// Free slots of readers that exited without detaching, and stop signalling their wakeup events.
+    void                    ReclaimReaderSlots();
+
+    BroadcastPublisher(const BroadcastPublisher&);
+    BroadcastPublisher& operator=(const BroadcastPublisher&);
+};
+
+/// Attaches to a channel opened by a BroadcastPublisher, possibly in another process, and reads its
+/// blocks in order, starting with the first one published after it attached.
+/// Blocks are read in place in shared memory: BeginRead hands out a view of next block, and EndRead
+/// tells whether publisher overwrote it while it was being read. A reader that falls more than a ring
+/// behind skips ahead to half a ring behind publisher, counting blocks it lost, and carries on.
+/// Each reader is for one thread at a time.
+class BroadcastReader {
+public:
+    /// Constructor
+    BroadcastReader();
+
+    /// Destructor. Detaches from channel, if attached.
+    ~BroadcastReader();
+
+    /// Attach to a channel and take a slot in its reader table, freeing slots of readers that exited without
+    /// detaching if every slot is taken.
+    /// <param name="szName">name channel was opened with.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if name is invalid or channel is not ready or has another layout,
+    /// E_ACCESSDENIED if channel already has cBroadcastMaxReaders running readers, otherwise failure code, such as
+    /// when no channel has that name.</returns>
+    HRESULT                 Open(const char* szName);
+
+    /// Give up slot in reader table and detach from channel. Does nothing if not attached.
+    void                    Close();
+
+    /// Whether reader is attached to a channel.
+    bool                    IsOpen() const { return NULL != m_pHeader; }
+
+    /// Wait until next block has been published.
+    /// <param name="timeoutMilliseconds">longest time to wait.</param>
+    /// <returns>S_OK if a block can be read, S_FALSE if none was published in time, E_ABORT if publisher
+    /// closed channel and every block was read, E_UNEXPECTED if not attached.</returns>
+    HRESULT                 Wait(UINT timeoutMilliseconds);
+
+    /// Look at next block where it lies in shared memory, without copying it. Skips ahead, counting lost
+    /// blocks, if publisher has already overwritten it. Every successful call must be followed by EndRead.
+    /// <param name="ppInfo">receives block's stream position, timing and angles.</param>
+    /// <param name="ppSamples">receives block's interleaved frames.</param>
+    /// <returns>S_OK if a block was handed out, S_FALSE if no block is ready, E_ABORT if publisher closed channel and
+    /// every block was read, E_UNEXPECTED if not attached or a block is already handed out.</returns>
+    HRESULT                 BeginRead(const BroadcastBlockInfo** ppInfo, const int16_t** ppSamples);
+
+    /// Finish with block handed out by BeginRead and move on to next one.
+    /// <returns>S_OK if block stayed intact while it was read, S_FALSE if publisher overwrote it meanwhile,
+    /// so anything read from it must be discarded, E_UNEXPECTED if no block was handed out.</returns>
+    HRESULT                 EndRead();
+
+    /// Copy next block out of shared memory, skipping blocks overwritten before or while they were copied.
+    /// <param name="pInfo">receives block's stream position, timing and angles.</param>
+    /// <param name="pSamples">receives block's interleaved frames; room for AudioBlock::MaxSamples frames.</param>
+    /// <returns>S_OK if a block was copied, S_FALSE if no block is ready, E_ABORT if publisher closed channel and
+    /// every block was read, E_UNEXPECTED if not attached.</returns>
+    HRESULT                 Read(BroadcastBlockInfo* pInfo, int16_t* pSamples);
+
+    /// Number of interleaved channels in every block.
+    WORD                    GetChannelCount() const { return m_channelCount; }
+
+    /// Sample rate of every block, in Hz.
+    UINT                    GetSampleRate() const { return m_sampleRate; }
+
+    /// Number of slots in channel's ring.
+    UINT                    GetSlotCount() const { return m_slotCount; }
+
+    /// Number of next block reader will read.
+    UINT64                  GetPosition() const { return m_position; }
+
+    /// Number of blocks lost to publisher lapping reader.
+    UINT64                  GetOverrunCount() const { return m_overrunBlocks; }
+
+    /// Time from each block being published to reader taking it, since Open, recorded by reader.
+    const LatencyHistogram& GetDeliveryLatency() const { return m_deliveryLatency; }
+
+private:
+    BroadcastChannelHeader* m_pHeader;
+    BroadcastReaderSlot*    m_pSlot;
+    const BYTE*             m_pSlots;
+    size_t                  m_mappingSize;
+    UINT                    m_slotSize;
+    UINT                    m_slotCount;
+    UINT                    m_sampleRate;
+    WORD                    m_channelCount;
+    UINT64                  m_position;
+    UINT64                  m_overrunBlocks;
+
+    // Slot handed out by BeginRead and not yet ended, or NULL.
+    const BroadcastSlotHeader* m_pReading;
+    UINT64                  m_readTimestamp;
+    LatencyHistogram        m_deliveryLatency;
+
+#ifdef _WIN32
+    HANDLE                  m_hMapping;
+    HANDLE                  m_hWakeEvent;
+#endif
+
+    /// Slot holding a block.
+    /// <param name="number">number of block.</param>
+    const BroadcastSlotHeader* GetSlot(UINT64 number) const { return reinterpret_cast<const BroadcastSlotHeader*>(m_pSlots + static_cast<size_t>(number & (m_slotCount - 1)) * m_slotSize); }
+
+    /// Find slot of next block, skipping ahead if publisher has overwritten it.
+    /// <param name="ppSlot">receives slot of next block.</param>
+    /// <returns>S_OK if next block is complete, S_FALSE if it has not been published, E_ABORT if channel is closed and every block was read.</returns>
+    HRESULT                 FindNextBlock(const BroadcastSlotHeader** ppSlot);
+
+    /// Skip ahead to half a ring behind publisher, counting blocks lost.
+    void                    SkipOverrun();
+
+    /// Move on to next block, publishing position to reader table.
+    void                    Advance();
+
+    BroadcastReader(const BroadcastReader&);
+    BroadcastReader& operator=(const BroadcastReader&);
+};
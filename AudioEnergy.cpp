@@ -0,0 +1,237 @@
+﻿#include "AudioEnergy.h"
+
+// For log
+#include <math.h>
+
+// For INT_MAX
+#include <limits.h>
+
+/// Scalar sum of squares of consecutive windows.
+static void SumSquaresWindowsScalar(const int16_t* pSamples, UINT windowSize, UINT windowCount, UINT64* pSums) {
+    for (UINT w = 0; w < windowCount; ++w) {
+        UINT64 sum = 0;
+        for (UINT i = 0; i < windowSize; ++i) {
+            int32_t sample = pSamples[i];
+            sum += static_cast<uint32_t>(sample * sample);
+        }
+        pSums[w] = sum;
+        pSamples += windowSize;
+    }
+}
+
+#ifdef AUDIO_SIMD_X86
+
+/// SSE2 sum of squares of consecutive windows.
+/// Pairs of squares are summed by pmaddwd; the largest pair (2 * 32768^2) still fits
+/// an unsigned 32-bit lane, so lanes are zero-extended into 64-bit accumulators.
+AUDIO_TARGET_SSE2
+static void SumSquaresWindowsSse2(const int16_t* pSamples, UINT windowSize, UINT windowCount, UINT64* pSums) {
+    const __m128i zero = _mm_setzero_si128();
+
+    for (UINT w = 0; w < windowCount; ++w) {
+        __m128i acc = _mm_setzero_si128();
+        UINT i = 0;
+
+        for (; i + 8 <= windowSize; i += 8) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSamples + i));
+            __m128i pairs = _mm_madd_epi16(x, x);
+            acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(pairs, zero));
+            acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(pairs, zero));
+        }
+
+        UINT64 lanes[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+        UINT64 sum = lanes[0] + lanes[1];
+
+        for (; i < windowSize; ++i) {
+            int32_t sample = pSamples[i];
+            sum += static_cast<uint32_t>(sample * sample);
+        }
+
+        pSums[w] = sum;
+        pSamples += windowSize;
+    }
+}
+
+/// AVX2 sum of squares of consecutive windows. Same accumulation scheme as SSE2 kernel,
+/// 16 samples at a time.
+AUDIO_TARGET_AVX2
+static void SumSquaresWindowsAvx2(const int16_t* pSamples, UINT windowSize, UINT windowCount, UINT64* pSums) {
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (UINT w = 0; w < windowCount; ++w) {
+        __m256i acc = _mm256_setzero_si256();
+        UINT i = 0;
+
+        for (; i + 16 <= windowSize; i += 16) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSamples + i));
+            __m256i pairs = _mm256_madd_epi16(x, x);
+            acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(pairs, zero));
+            acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(pairs, zero));
+        }
+
+        // Window sizes are rarely a multiple of 16, so finish with one 8-wide step
+        if (i + 8 <= windowSize) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSamples + i));
+            __m128i pairs = _mm_madd_epi16(x, x);
+            acc = _mm256_add_epi64(acc, _mm256_cvtepu32_epi64(pairs));
+            i += 8;
+        }
+
+        UINT64 lanes[4];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+        UINT64 sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+        for (; i < windowSize; ++i) {
+            int32_t sample = pSamples[i];
+            sum += static_cast<uint32_t>(sample * sample);
+        }
+
+        pSums[w] = sum;
+        pSamples += windowSize;
+    }
+}
+
+#endif
+
+/// Sum of squares of consecutive fixed-size windows of 16-bit PCM.
+/// <param name="level">instruction set to use. Must be supported by running CPU.</param>
+/// <param name="pSamples">samples, windowCount * windowSize of them.</param>
+/// <param name="windowSize">number of samples per window.</param>
+/// <param name="windowCount">number of windows.</param>
+/// <param name="pSums">receives one sum of squares per window.</param>
+void SumSquaresWindows(SimdLevel level, const int16_t* pSamples, UINT windowSize, UINT windowCount, UINT64* pSums) {
+#ifdef AUDIO_SIMD_X86
+    if (SimdLevelAvx2 == level) {
+        SumSquaresWindowsAvx2(pSamples, windowSize, windowCount, pSums);
+        return;
+    }
+
+    if (SimdLevelSse2 == level) {
+        SumSquaresWindowsSse2(pSamples, windowSize, windowCount, pSums);
+        return;
+    }
+#else
+    (void)level;
+#endif
+
+    SumSquaresWindowsScalar(pSamples, windowSize, windowCount, pSums);
+}
+
+/// Constructor
+/// <param name="noiseFloor">bottom portion of log-energy, in [0.0,1.0) interval, discarded as noise.</param>
+/// <param name="level">instruction set used by kernel.</param>
+EnergyCalculator::EnergyCalculator(float noiseFloor, SimdLevel level) :
+    m_noiseFloor(noiseFloor),
+    m_logNormalization(1.0f / logf(static_cast<float>(INT_MAX))),
+    m_level(level),
+    m_accumulatedSquareSum(0),
+    m_accumulatedSampleCount(0) {
+}
+
+/// Forget any partially accumulated window.
+void EnergyCalculator::Reset() {
+    m_accumulatedSquareSum = 0;
+    m_accumulatedSampleCount = 0;
+}
+
+/// Convert sum of squares of one window into displayable energy.
+/// <param name="squareSum">sum of squares of cAudioSamplesPerEnergySample samples.</param>
+/// <returns>energy value in [0.0,1.0] interval.</returns>
+float EnergyCalculator::ToEnergy(UINT64 squareSum) const {
+    // Each energy value represents the logarithm of the mean of the squares of a group of samples
+    float meanSquare = static_cast<float>(squareSum) / cAudioSamplesPerEnergySample;
+    if (meanSquare < 1.0f) {
+        return 0.0f;
+    }
+
+    float amplitude = logf(meanSquare) * m_logNormalization;
+
+    // Truncate portion of signal below noise floor
+    float amplitudeAboveNoise = amplitude - m_noiseFloor;
+    if (amplitudeAboveNoise <= 0.0f) {
+        return 0.0f;
+    }
+
+    // Renormalize signal above noise floor to [0,1] range
+    float energy = amplitudeAboveNoise / (1.0f - m_noiseFloor);
+    return (energy < 1.0f) ? energy : 1.0f;
+}
+
+/// Compute energy values for a run of samples.
+/// <param name="pSamples">samples to process.</param>
+/// <param name="sampleCount">number of samples.</param>
+/// <param name="pEnergy">receives energy values. Must hold sampleCount / cAudioSamplesPerEnergySample + 1 values.</param>
+/// <returns>number of energy values produced.</returns>
+UINT EnergyCalculator::Process(const int16_t* pSamples, UINT sampleCount, float* pEnergy) {
+    UINT energyCount = 0;
+
+    // Finish window left over from previous call
+    if (m_accumulatedSampleCount > 0) {
+        while (sampleCount > 0 && m_accumulatedSampleCount < cAudioSamplesPerEnergySample) {
+            int32_t sample = *pSamples++;
+            m_accumulatedSquareSum += static_cast<uint32_t>(sample * sample);
+            ++m_accumulatedSampleCount;
+            --sampleCount;
+        }
+
+        if (m_accumulatedSampleCount < cAudioSamplesPerEnergySample) {
+            return 0;
+        }
+
+        pEnergy[energyCount++] = ToEnergy(m_accumulatedSquareSum);
+        m_accumulatedSquareSum = 0;
+        m_accumulatedSampleCount = 0;
+    }
+
+    // Whole windows go through SIMD kernel in batches
+    UINT windowCount = sampleCount / cAudioSamplesPerEnergySample;
+    while (windowCount > 0) {
+        UINT batch = (windowCount < cMaxWindowsPerBatch) ? windowCount : cMaxWindowsPerBatch;
+        SumSquaresWindows(m_level, pSamples, cAudioSamplesPerEnergySample, batch, m_windowSums);
+
+        for (UINT w = 0; w < batch; ++w) {
+            pEnergy[energyCount++] = ToEnergy(m_windowSums[w]);
+        }
+
+        pSamples += batch * cAudioSamplesPerEnergySample;
+        sampleCount -= batch * cAudioSamplesPerEnergySample;
+        windowCount -= batch;
+    }
+
+    // Keep remainder for next call
+    for (UINT i = 0; i < sampleCount; ++i) {
+        int32_t sample = pSamples[i];
+        m_accumulatedSquareSum += static_cast<uint32_t>(sample * sample);
+    }
+    m_accumulatedSampleCount = sampleCount;
+
+    return energyCount;
+}
+
+/// Constructor
+EnergyHistory::EnergyHistory() :
+    m_writeIndex(0) {
+    memset(m_values, 0, sizeof(m_values));
+}
+
+/// Append energy values, discarding oldest ones once history is full.
+/// <param name="pEnergy">values to append.</param>
+/// <param name="count">number of values.</param>
+void EnergyHistory::Append(const float* pEnergy, UINT count) {
+    for (UINT i = 0; i < count; ++i) {
+        m_values[m_writeIndex] = pEnergy[i];
+        m_writeIndex = (m_writeIndex + 1) % cCapacity;
+    }
+}
+
+/// Copy most recent values, oldest first. Missing history is reported as silence.
+/// <param name="pEnergy">receives values.</param>
+/// <param name="count">number of values to copy, at most cCapacity.</param>
+void EnergyHistory::CopyLatest(float* pEnergy, UINT count) const {
+    UINT readIndex = (m_writeIndex + cCapacity - count) % cCapacity;
+    for (UINT i = 0; i < count; ++i) {
+        pEnergy[i] = m_values[readIndex];
+        readIndex = (readIndex + 1) % cCapacity;
+    }
+}
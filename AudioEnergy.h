@@ -0,0 +1,79 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "Simd.h"
+
+/// Sum of squares of consecutive fixed-size windows of 16-bit PCM.
+/// <param name="level">instruction set to use. Must be supported by running CPU.</param>
+/// <param name="pSamples">samples, windowCount * windowSize of them.</param>
+/// <param name="windowSize">number of samples per window.</param>
+/// <param name="windowCount">number of windows.</param>
+/// <param name="pSums">receives one sum of squares per window.</param>
+void SumSquaresWindows(SimdLevel level, const int16_t* pSamples, UINT windowSize, UINT windowCount, UINT64* pSums);
+
+/// Turns 16-bit PCM into a stream of log-energy values in [0.0,1.0] interval, one per
+/// fixed-size window of samples. Windows may span several calls to Process.
+class EnergyCalculator {
+public:
+    // Number of audio samples that are accumulated into each energy value.
+    static const UINT       cAudioSamplesPerEnergySample = 40;
+
+    /// Constructor
+    /// <param name="noiseFloor">bottom portion of log-energy, in [0.0,1.0) interval, discarded as noise.</param>
+    /// <param name="level">instruction set used by kernel.</param>
+    EnergyCalculator(float noiseFloor, SimdLevel level);
+
+    /// Forget any partially accumulated window.
+    void                    Reset();
+
+    /// Compute energy values for a run of samples.
+    /// <param name="pSamples">samples to process.</param>
+    /// <param name="sampleCount">number of samples.</param>
+    /// <param name="pEnergy">receives energy values. Must hold sampleCount / cAudioSamplesPerEnergySample + 1 values.</param>
+    /// <returns>number of energy values produced.</returns>
+    UINT                    Process(const int16_t* pSamples, UINT sampleCount, float* pEnergy);
+
+private:
+    // Largest number of whole windows handed to kernel at once.
+    static const UINT       cMaxWindowsPerBatch = 64;
+
+    float                   m_noiseFloor;
+    float                   m_logNormalization;
+    SimdLevel               m_level;
+
+    // Sum of squares and sample count of window still being accumulated.
+    UINT64                  m_accumulatedSquareSum;
+    UINT                    m_accumulatedSampleCount;
+
+    // Per-window sums produced by kernel.
+    UINT64                  m_windowSums[cMaxWindowsPerBatch];
+
+    /// Convert sum of squares of one window into displayable energy.
+    /// <param name="squareSum">sum of squares of cAudioSamplesPerEnergySample samples.</param>
+    /// <returns>energy value in [0.0,1.0] interval.</returns>
+    float                   ToEnergy(UINT64 squareSum) const;
+};
+
+/// Fixed-size history of most recent energy values, consumed by oscilloscope display.
+class EnergyHistory {
+public:
+    // Number of energy values retained.
+    static const UINT       cCapacity = 1024;
+
+    /// Constructor
+    EnergyHistory();
+
+    /// Append energy values, discarding oldest ones once history is full.
+    /// <param name="pEnergy">values to append.</param>
+    /// <param name="count">number of values.</param>
+    void                    Append(const float* pEnergy, UINT count);
+
+    /// Copy most recent values, oldest first. Missing history is reported as silence.
+    /// <param name="pEnergy">receives values.</param>
+    /// <param name="count">number of values to copy, at most cCapacity.</param>
+    void                    CopyLatest(float* pEnergy, UINT count) const;
+
+private:
+    float                   m_values[cCapacity];
+    UINT                    m_writeIndex;
+};
@@ -0,0 +1,70 @@
+﻿#pragma once
+
+#include "Platform.h"
+
+/// Compile-time description of a sample type: the WAVEFORMATEX tag and bit depth it is stored as.
+template <typename TSample>
+struct AudioSampleTraits;
+
+template <>
+struct AudioSampleTraits<int16_t> {
+    static const WORD       FormatTag = WAVE_FORMAT_PCM;
+    static const WORD       BitsPerSample = 16;
+};
+
+template <>
+struct AudioSampleTraits<int32_t> {
+    static const WORD       FormatTag = WAVE_FORMAT_PCM;
+    static const WORD       BitsPerSample = 32;
+};
+
+template <>
+struct AudioSampleTraits<float> {
+    static const WORD       FormatTag = WAVE_FORMAT_IEEE_FLOAT;
+    static const WORD       BitsPerSample = 32;
+};
+
+/// Compile-time description of an interleaved audio stream format. Every WAVEFORMATEX field is derived
+/// from sample type, channel count and rate, so buffers and loops sized from a format are sized by the compiler.
+template <typename TSample, WORD TChannels, DWORD TSamplesPerSecond>
+struct AudioStreamFormat {
+    typedef TSample         Sample;
+
+    static const WORD       FormatTag = AudioSampleTraits<TSample>::FormatTag;
+    static const WORD       Channels = TChannels;
+    static const DWORD      SamplesPerSecond = TSamplesPerSecond;
+    static const WORD       BitsPerSample = AudioSampleTraits<TSample>::BitsPerSample;
+    static const WORD       BlockAlign = static_cast<WORD>(TChannels * sizeof(TSample));
+    static const DWORD      AverageBytesPerSecond = static_cast<DWORD>(TSamplesPerSecond * TChannels * sizeof(TSample));
+
+    /// Whether a negotiated format describes this one.
+    /// <param name="format">format, with any WAVE_FORMAT_EXTENSIBLE tag already resolved to its sub-format's tag.</param>
+    static bool Matches(const WAVEFORMATEX& format) {
+        return FormatTag == format.wFormatTag && Channels == format.nChannels &&
+            SamplesPerSecond == format.nSamplesPerSec && BitsPerSample == format.wBitsPerSample;
+    }
+};
+
+// Beamformed mono stream produced by Kinect audio DMO, and taken by every processing stage
+typedef AudioStreamFormat<int16_t, 1, 16000> KinectAudioStreamFormat;
+
+// Raw microphone array stream, as Kinect endpoint delivers it in shared mode
+typedef AudioStreamFormat<float, 4, 16000> KinectArrayStreamFormat;
+
+// Format of Kinect audio stream
+static const WORD       AudioFormat = KinectAudioStreamFormat::FormatTag;
+
+// Number of channels in Kinect audio stream
+static const WORD       AudioChannels = KinectAudioStreamFormat::Channels;
+
+// Samples per second in Kinect audio stream
+static const DWORD      AudioSamplesPerSecond = KinectAudioStreamFormat::SamplesPerSecond;
+
+// Average bytes per second in Kinect audio stream
+static const DWORD      AudioAverageBytesPerSecond = KinectAudioStreamFormat::AverageBytesPerSecond;
+
+// Block alignment in Kinect audio stream
+static const WORD       AudioBlockAlign = KinectAudioStreamFormat::BlockAlign;
+
+// Bits per audio sample in Kinect audio stream
+static const WORD       AudioBitsPerSample = KinectAudioStreamFormat::BitsPerSample;
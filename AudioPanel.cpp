@@ -1,5 +1,81 @@
 ﻿#include "stdafx.h"
 #include "AudioPanel.h"
+#include "Clock.h"
+
+// For M_PI, sinf and cosf
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+// Oscilloscope background and foreground colors, in B8G8R8A8 format.
+static const UINT cEnergyBackgroundColor = 0xFFFFFFFF;
+static const UINT cEnergyForegroundColor = 0xFF8A2BE2;
+
+// Spectrogram colors of loudest level and of level halfway to it. Silence uses oscilloscope background.
+static const UINT cSpectrogramPeakColor = 0xFF1E053C;
+static const UINT cSpectrogramMidColor = cEnergyForegroundColor;
+
+// Timeline colors of energy's mean and of its range up to peak, and of beam angle's mean and of its range.
+static const UINT cTimelineEnergyColor = cEnergyForegroundColor;
+static const UINT cTimelineEnergyRangeColor = 0xFFDCBFF6;
+static const UINT cTimelineAngleColor = 0xFFFF8C00;
+static const UINT cTimelineAngleRangeColor = 0xFFFFDCB2;
+
+// Width of panel outline stroke, in panel coordinates.
+static const float cPanelOutlineWidth = 0.001f;
+
+// Areas of panel covered by oscilloscope, and by spectrogram below it. Outline runs along their left and
+// right edges, so both are inset by half the stroke to keep outline, drawn beneath them, visible.
+static const D2D1_RECT_F cEnergyDisplayRect = {0.13f + cPanelOutlineWidth / 2, 0.0353f, 0.87f - cPanelOutlineWidth / 2, 0.1278f};
+static const D2D1_RECT_F cSpectrogramDisplayRect = {0.13f + cPanelOutlineWidth / 2, 0.1278f, 0.87f - cPanelOutlineWidth / 2, 0.2203f};
+
+// Area of panel covered by timeline, between spectrogram and gauge's inner arc. Outline is drawn around it.
+static const D2D1_RECT_F cTimelineDisplayRect = {0.305f, 0.2303f, 0.695f, 0.2803f};
+
+// Radii of gauge's inner and outer arcs, and angle, in degrees, either side of center that gauge spans.
+// Arcs are centered on top middle of panel.
+static const float cGaugeInnerRadius = 0.35f;
+static const float cGaugeOuterRadius = 0.45f;
+static const float cGaugeHalfAngle = 51.0f;
+
+// Color of each source needle. A source's id picks one, so it keeps its color while it is tracked.
+static const D2D1::ColorF::Enum cSourceNeedleColors[] = {D2D1::ColorF::BlueViolet, D2D1::ColorF::DarkOrange, D2D1::ColorF::SeaGreen};
+
+// Opacity of response plotted along gauge, so needles and gauge show through it.
+static const float cSourceMapOpacity = 0.35f;
+
+/// Timeline row of a beam angle, with positive angles above center and gauge's extent filling height.
+/// <param name="angleDegrees">beam angle, in degrees.</param>
+/// <param name="height">height of timeline, in pixels.</param>
+/// <returns>row, counting from top.</returns>
+static UINT GetTimelineAngleRow(float angleDegrees, UINT height) {
+    float position = (cGaugeHalfAngle - angleDegrees) / (2.0f * cGaugeHalfAngle);
+    position = (position < 0.0f) ? 0.0f : ((position > 1.0f) ? 1.0f : position);
+    return static_cast<UINT>(position * (height - 1) + 0.5f);
+}
+
+/// Point on gauge.
+/// <param name="angleDegrees">angle from center of gauge, in degrees. Positive angles are to the right.</param>
+/// <param name="radius">distance from center of arcs, in panel coordinates.</param>
+/// <returns>point in panel coordinates.</returns>
+static D2D1_POINT_2F GetGaugePoint(float angleDegrees, float radius) {
+    float radians = angleDegrees * static_cast<float>(M_PI) / 180.0f;
+    return D2D1::Point2F(0.5f + radius * sinf(radians), radius * cosf(radians));
+}
+
+/// Blend two B8G8R8A8 colors.
+/// <param name="from">color at weight 0.</param>
+/// <param name="to">color at weight 1.</param>
+/// <param name="weight">blend weight, in [0.0,1.0] interval.</param>
+/// <returns>blended, opaque color.</returns>
+static UINT BlendColor(UINT from, UINT to, float weight) {
+    UINT color = 0xFF000000;
+    for (UINT shift = 0; shift < 24; shift += 8) {
+        float a = static_cast<float>((from >> shift) & 0xFF);
+        float b = static_cast<float>((to >> shift) & 0xFF);
+        color |= static_cast<UINT>(a + (b - a) * weight + 0.5f) << shift;
+    }
+    return color;
+}
 
 /// Constructor
 AudioPanel::AudioPanel() : 
@@ -10,16 +86,73 @@ AudioPanel::AudioPanel() :
     m_pBeamGauge(NULL),
     m_pBeamGaugeFill(NULL),
     m_pBeamNeedle(NULL),
-    m_pBeamNeedleFill(NULL),
-    m_BeamNeedleTransform(D2D1::Matrix3x2F::Identity()),
+    m_pSourceMap(NULL),
+    m_pSourceMapFill(NULL),
     m_pPanelOutline(NULL),
-    m_pPanelOutlineStroke(NULL) {
+    m_pPanelOutlineStroke(NULL),
+    m_pEnergyDisplay(NULL),
+    m_pSpectrogramDisplay(NULL),
+    m_pTimelineDisplay(NULL),
+    m_pStaticLayerTarget(NULL),
+    m_pStaticLayer(NULL),
+    m_pEnergyPixels(NULL),
+    m_pSpectrogramPixels(NULL),
+    m_pTimelinePixels(NULL),
+    m_spectrogramColumn(0),
+    m_spectrogramPendingColumns(0),
+    m_sourceCount(0),
+    m_sourceMapAngleCount(0),
+    m_dirtyFlags(cDirtyBeam | cDirtyEnergy | cDirtyTarget | cDirtySpectrogram | cDirtySourceMap | cDirtyTimeline),
+    m_framesDrawn(0),
+    m_framesSkipped(0),
+    m_beamTimestamp(0),
+    m_presentedBeamTimestamp(0),
+    m_pCaptureToDisplayLatency(NULL),
+    m_pDrawLatency(NULL) {
+    for (UINT i = 0; i < cMaxSourceNeedles; ++i) {
+        m_pBeamNeedleFills[i] = NULL;
+        m_fSourceAngles[i] = 0.0f;
+        m_sourceIds[i] = 0;
+        m_SourceNeedleTransforms[i] = D2D1::Matrix3x2F::Identity();
+    }
+
+    m_pEnergyPixels = new UINT[cEnergySamplesToDisplay * cEnergyDisplayHeight];
+    for (UINT i = 0; i < cEnergySamplesToDisplay * cEnergyDisplayHeight; ++i) {
+        m_pEnergyPixels[i] = cEnergyBackgroundColor;
+    }
+
+    m_pSpectrogramPixels = new UINT[cSpectrogramColumns * cSpectrogramBins];
+    for (UINT i = 0; i < cSpectrogramColumns * cSpectrogramBins; ++i) {
+        m_pSpectrogramPixels[i] = cEnergyBackgroundColor;
+    }
+
+    m_pTimelinePixels = new UINT[cTimelineColumns * cTimelineDisplayHeight];
+    for (UINT i = 0; i < cTimelineColumns * cTimelineDisplayHeight; ++i) {
+        m_pTimelinePixels[i] = cEnergyBackgroundColor;
+    }
+
+    // Lower half of levels fades in from background, upper half darkens towards peak
+    for (UINT level = 0; level < 256; ++level) {
+        float weight = level / 255.0f;
+        m_spectrogramPalette[level] = (weight < 0.5f) ?
+            BlendColor(cEnergyBackgroundColor, cSpectrogramMidColor, 2.0f * weight) :
+            BlendColor(cSpectrogramMidColor, cSpectrogramPeakColor, 2.0f * weight - 1.0f);
+    }
 }
 
 /// Destructor
 AudioPanel::~AudioPanel() {
     DiscardResources();
     SafeRelease(m_pD2DFactory);
+
+    delete [] m_pEnergyPixels;
+    m_pEnergyPixels = NULL;
+
+    delete [] m_pSpectrogramPixels;
+    m_pSpectrogramPixels = NULL;
+
+    delete [] m_pTimelinePixels;
+    m_pTimelinePixels = NULL;
 }
 
 /// Set the window to draw to as well as the video format
@@ -42,7 +175,7 @@ HRESULT AudioPanel::Initialize(const HWND hWnd, ID2D1Factory* pD2DFactory) {
     return S_OK;
 }
 
-/// Draws audio panel.
+/// Draws audio panel, if anything changed since it was last drawn.
 /// <returns>S_OK on success, otherwise failure code.</returns>
 HRESULT AudioPanel::Draw() {
     // create the resources for this draw device. They will be recreated if previously lost.
@@ -51,23 +184,87 @@ HRESULT AudioPanel::Draw() {
     if (FAILED(hr)) {
         return hr;
     }
-    
+
+    // What is on screen is still current, or nobody can see it. Changes stay pending either way.
+    if (0 == m_dirtyFlags || (m_pRenderTarget->CheckWindowState() & D2D1_WINDOW_STATE_OCCLUDED)) {
+        ++m_framesSkipped;
+        return S_OK;
+    }
+
+    UINT64 drawStart = GetClockNanoseconds();
+
     m_pRenderTarget->BeginDraw();
-    m_pRenderTarget->SetTransform(m_RenderTargetTransform);
 
-    m_pRenderTarget->Clear(D2D1::ColorF(D2D1::ColorF::White));
+    // Static layer covers whole target, so no clear is needed
+    m_pRenderTarget->SetTransform(D2D1::Matrix3x2F::Identity());
+    m_pRenderTarget->DrawBitmap(m_pStaticLayer);
 
-    // Draw audio beam gauge
-    m_pRenderTarget->FillGeometry(m_pBeamGauge, m_pBeamGaugeFill, NULL);
-    m_pRenderTarget->SetTransform(m_BeamNeedleTransform * m_RenderTargetTransform);
-    m_pRenderTarget->FillGeometry(m_pBeamNeedle, m_pBeamNeedleFill, NULL);
+    // Draw energy oscilloscope, uploading pixels only if they changed since last frame
     m_pRenderTarget->SetTransform(m_RenderTargetTransform);
+    if (m_dirtyFlags & cDirtyEnergy) {
+        m_pEnergyDisplay->CopyFromMemory(NULL, m_pEnergyPixels, cEnergySamplesToDisplay * sizeof(UINT));
+    }
+    m_pRenderTarget->DrawBitmap(m_pEnergyDisplay, cEnergyDisplayRect);
+
+    // Draw spectrogram. Oldest column sits at m_spectrogramColumn, so ring is drawn in two pieces:
+    // from there to right edge of bitmap, then from left edge of bitmap up to it. Nearest neighbor
+    // sampling keeps either piece from blending in columns across the seam.
+    if (m_dirtyFlags & cDirtySpectrogram) {
+        UploadSpectrogram();
+    }
+
+    float split = cSpectrogramDisplayRect.left + (cSpectrogramDisplayRect.right - cSpectrogramDisplayRect.left) *
+        (cSpectrogramColumns - m_spectrogramColumn) / cSpectrogramColumns;
+    D2D1_RECT_F olderTarget = D2D1::RectF(cSpectrogramDisplayRect.left, cSpectrogramDisplayRect.top, split, cSpectrogramDisplayRect.bottom);
+    D2D1_RECT_F olderSource = D2D1::RectF(static_cast<FLOAT>(m_spectrogramColumn), 0.0f, static_cast<FLOAT>(cSpectrogramColumns), static_cast<FLOAT>(cSpectrogramBins));
+    m_pRenderTarget->DrawBitmap(m_pSpectrogramDisplay, &olderTarget, 1.0f, D2D1_BITMAP_INTERPOLATION_MODE_NEAREST_NEIGHBOR, &olderSource);
+
+    if (m_spectrogramColumn > 0) {
+        D2D1_RECT_F newerTarget = D2D1::RectF(split, cSpectrogramDisplayRect.top, cSpectrogramDisplayRect.right, cSpectrogramDisplayRect.bottom);
+        D2D1_RECT_F newerSource = D2D1::RectF(0.0f, 0.0f, static_cast<FLOAT>(m_spectrogramColumn), static_cast<FLOAT>(cSpectrogramBins));
+        m_pRenderTarget->DrawBitmap(m_pSpectrogramDisplay, &newerTarget, 1.0f, D2D1_BITMAP_INTERPOLATION_MODE_NEAREST_NEIGHBOR, &newerSource);
+    }
+
+    // Draw timeline, uploading pixels only if they changed since last frame
+    if (m_dirtyFlags & cDirtyTimeline) {
+        m_pTimelineDisplay->CopyFromMemory(NULL, m_pTimelinePixels, cTimelineColumns * sizeof(UINT));
+    }
+    m_pRenderTarget->DrawBitmap(m_pTimelineDisplay, cTimelineDisplayRect);
+
+    // Draw response by angle along gauge, rebuilding its outline only when map changed
+    if (m_dirtyFlags & cDirtySourceMap) {
+        hr = UpdateSourceMapGeometry();
+    }
+
+    if (SUCCEEDED(hr) && NULL != m_pSourceMap) {
+        m_pRenderTarget->FillGeometry(m_pSourceMap, m_pSourceMapFill, NULL);
+    }
+
+    // Draw a needle for each source, over map
+    for (UINT i = 0; i < m_sourceCount; ++i) {
+        m_pRenderTarget->SetTransform(m_SourceNeedleTransforms[i] * m_RenderTargetTransform);
+        m_pRenderTarget->FillGeometry(m_pBeamNeedle, m_pBeamNeedleFills[(m_sourceIds[i] - 1) % cMaxSourceNeedles], NULL);
+    }
 
-    // Draw panel outline
-    m_pRenderTarget->DrawGeometry(m_pPanelOutline, m_pPanelOutlineStroke, 0.001f);
-            
     hr = m_pRenderTarget->EndDraw();
 
+    // Frame is presented once EndDraw returns, so this is when the needles became visible
+    UINT64 drawEnd = GetClockNanoseconds();
+    if (SUCCEEDED(hr)) {
+        if (NULL != m_pDrawLatency) {
+            m_pDrawLatency->Record(drawEnd - drawStart);
+        }
+
+        // Only a newly set angle counts; redrawing an old one would measure how long UI sat idle
+        if (NULL != m_pCaptureToDisplayLatency && 0 != m_beamTimestamp && m_beamTimestamp != m_presentedBeamTimestamp) {
+            m_pCaptureToDisplayLatency->Record(drawEnd - m_beamTimestamp);
+        }
+        m_presentedBeamTimestamp = m_beamTimestamp;
+
+        m_dirtyFlags = 0;
+        ++m_framesDrawn;
+    }
+
     // Device lost, need to recreate the render target. We'll dispose it now and retry drawing.
     if (hr == D2DERR_RECREATE_TARGET) {
         hr = S_OK;
@@ -77,12 +274,190 @@ HRESULT AudioPanel::Draw() {
     return hr;
 }
 
-void AudioPanel::SetBeam(const float & beamAngle) {
-    if (m_pRenderTarget == NULL) {
+/// Update the sources shown by gauge needles.
+/// <param name="pAngles">angle of each source, in degrees.</param>
+/// <param name="pIds">id of each source. A source keeps its needle color for as long as its id stays the same.</param>
+/// <param name="count">number of sources. Only the first cMaxSourceNeedles are shown.</param>
+/// <param name="captureTimestamp">GetClockNanoseconds when audio that produced angles was captured.</param>
+void AudioPanel::SetSources(const float* pAngles, const UINT* pIds, UINT count, UINT64 captureTimestamp) {
+    count = (count < cMaxSourceNeedles) ? count : cMaxSourceNeedles;
+
+    // Same sources draw the same needles, and latency is measured to when a change becomes visible
+    bool bChanged = (count != m_sourceCount);
+    for (UINT i = 0; i < count && !bChanged; ++i) {
+        bChanged = (pAngles[i] != m_fSourceAngles[i] || pIds[i] != m_sourceIds[i]);
+    }
+
+    if (!bChanged) {
+        return;
+    }
+
+    m_sourceCount = count;
+    for (UINT i = 0; i < count; ++i) {
+        m_fSourceAngles[i] = pAngles[i];
+        m_sourceIds[i] = pIds[i];
+        m_SourceNeedleTransforms[i] = D2D1::Matrix3x2F::Rotation(-pAngles[i], D2D1::Point2F(0.5f,0.0f));
+    }
+    m_beamTimestamp = captureTimestamp;
+    m_dirtyFlags |= cDirtyBeam;
+}
+
+/// Update response by angle plotted along gauge.
+/// <param name="pMap">response, in [0.0,1.0] interval, at angles spaced evenly from -90 to +90 degrees.</param>
+/// <param name="angleCount">number of angles, from 2 to cMaxSourceMapAngles. 0 clears plot.</param>
+void AudioPanel::SetSourceMap(const float* pMap, UINT angleCount) {
+    if (1 == angleCount || angleCount > cMaxSourceMapAngles) {
+        return;
+    }
+
+    if (angleCount == m_sourceMapAngleCount && 0 == memcmp(pMap, m_sourceMap, angleCount * sizeof(float))) {
+        return;
+    }
+
+    memcpy(m_sourceMap, pMap, angleCount * sizeof(float));
+    m_sourceMapAngleCount = angleCount;
+    m_dirtyFlags |= cDirtySourceMap;
+}
+
+/// Force next Draw to redraw panel, e.g. because window contents were exposed.
+void AudioPanel::Invalidate() {
+    m_dirtyFlags |= cDirtyTarget;
+}
+
+/// Set histograms that Draw records its timings into.
+/// <param name="pCaptureToDisplay">receives time from capture of displayed beam angle to presenting it, or NULL.</param>
+/// <param name="pDrawDuration">receives time taken by each Draw, or NULL.</param>
+void AudioPanel::SetLatencyHistograms(LatencyHistogram* pCaptureToDisplay, LatencyHistogram* pDrawDuration) {
+    m_pCaptureToDisplayLatency = pCaptureToDisplay;
+    m_pDrawLatency = pDrawDuration;
+}
+
+/// Update the energy values displayed by oscilloscope.
+/// <param name="pEnergy">energy values in [0.0,1.0] interval, oldest first.</param>
+/// <param name="cEnergy">number of values. Only the latest cEnergySamplesToDisplay are shown.</param>
+void AudioPanel::UpdateEnergy(const float* pEnergy, UINT cEnergy) {
+    if (cEnergy > cEnergySamplesToDisplay) {
+        pEnergy += cEnergy - cEnergySamplesToDisplay;
+        cEnergy = cEnergySamplesToDisplay;
+    }
+
+    // Newest value is drawn at right edge; columns without a value are left blank
+    UINT firstColumn = cEnergySamplesToDisplay - cEnergy;
+    const UINT center = cEnergyDisplayHeight / 2;
+
+    for (UINT x = 0; x < cEnergySamplesToDisplay; ++x) {
+        UINT halfHeight = 0;
+        if (x >= firstColumn) {
+            float energy = pEnergy[x - firstColumn];
+            energy = (energy < 0.0f) ? 0.0f : ((energy > 1.0f) ? 1.0f : energy);
+            halfHeight = static_cast<UINT>(energy * center);
+        }
+
+        // Each energy value is drawn as a vertical line centered on the middle row
+        UINT* pPixel = m_pEnergyPixels + x;
+        for (UINT y = 0; y < cEnergyDisplayHeight; ++y, pPixel += cEnergySamplesToDisplay) {
+            UINT distance = (y < center) ? (center - y) : (y - center);
+            *pPixel = (distance <= halfHeight) ? cEnergyForegroundColor : cEnergyBackgroundColor;
+        }
+    }
+
+    m_dirtyFlags |= cDirtyEnergy;
+}
+
+/// Append columns to spectrogram, scrolling out the oldest ones.
+/// <param name="pSpectra">columns, oldest first, each holding log power in [0.0,1.0] interval of binCount bins, lowest frequency first.</param>
+/// <param name="cSpectra">number of columns.</param>
+/// <param name="binCount">number of bins in each column. Bins beyond cSpectrogramBins are not shown.</param>
+void AudioPanel::AppendSpectra(const float* pSpectra, UINT cSpectra, UINT binCount) {
+    if (0 == cSpectra) {
         return;
     }
 
-    m_BeamNeedleTransform = D2D1::Matrix3x2F::Rotation(-beamAngle, D2D1::Point2F(0.5f,0.0f));
+    for (UINT s = 0; s < cSpectra; ++s, pSpectra += binCount) {
+        // Each column overwrites oldest one in ring, with highest bin in top row
+        UINT* pPixel = m_pSpectrogramPixels + m_spectrogramColumn;
+        for (UINT row = 0; row < cSpectrogramBins; ++row, pPixel += cSpectrogramColumns) {
+            UINT bin = cSpectrogramBins - 1 - row;
+            float value = (bin < binCount) ? pSpectra[bin] : 0.0f;
+            value = (value < 0.0f) ? 0.0f : ((value > 1.0f) ? 1.0f : value);
+            *pPixel = m_spectrogramPalette[static_cast<UINT>(value * 255.0f + 0.5f)];
+        }
+
+        m_spectrogramColumn = (m_spectrogramColumn + 1) % cSpectrogramColumns;
+        if (m_spectrogramPendingColumns < cSpectrogramColumns) {
+            ++m_spectrogramPendingColumns;
+        }
+    }
+
+    m_dirtyFlags |= cDirtySpectrogram;
+}
+
+/// Update timeline of energy and beam angle.
+/// <param name="pEnergy">energy of each column, in [0.0,1.0] interval, oldest first. Columns summarising no entries are left blank.</param>
+/// <param name="pAngles">beam angle of each column, in degrees, oldest first.</param>
+/// <param name="columnCount">number of columns. Only the latest cTimelineColumns are shown, newest at right edge.</param>
+void AudioPanel::UpdateTimeline(const HistoryColumn* pEnergy, const HistoryColumn* pAngles, UINT columnCount) {
+    if (columnCount > cTimelineColumns) {
+        pEnergy += columnCount - cTimelineColumns;
+        pAngles += columnCount - cTimelineColumns;
+        columnCount = cTimelineColumns;
+    }
+
+    UINT firstColumn = cTimelineColumns - columnCount;
+
+    for (UINT x = 0; x < cTimelineColumns; ++x) {
+        // Energy rises from bottom row: solid up to its mean, lighter up to its peak
+        UINT meanHeight = 0;
+        UINT peakHeight = 0;
+        if (x >= firstColumn && 0 != pEnergy[x - firstColumn].count) {
+            float mean = pEnergy[x - firstColumn].mean;
+            float peak = pEnergy[x - firstColumn].maximum;
+            mean = (mean < 0.0f) ? 0.0f : ((mean > 1.0f) ? 1.0f : mean);
+            peak = (peak < 0.0f) ? 0.0f : ((peak > 1.0f) ? 1.0f : peak);
+            meanHeight = static_cast<UINT>(mean * cTimelineDisplayHeight + 0.5f);
+            peakHeight = static_cast<UINT>(peak * cTimelineDisplayHeight + 0.5f);
+        }
+
+        UINT* pPixel = m_pTimelinePixels + x;
+        for (UINT y = 0; y < cTimelineDisplayHeight; ++y, pPixel += cTimelineColumns) {
+            UINT height = cTimelineDisplayHeight - y;
+            *pPixel = (height <= meanHeight) ? cTimelineEnergyColor : ((height <= peakHeight) ? cTimelineEnergyRangeColor : cEnergyBackgroundColor);
+        }
+
+        // Beam angle's range is drawn where energy left background, its mean over everything
+        if (x >= firstColumn && 0 != pAngles[x - firstColumn].count) {
+            const HistoryColumn& angle = pAngles[x - firstColumn];
+            UINT top = GetTimelineAngleRow(angle.maximum, cTimelineDisplayHeight);
+            UINT bottom = GetTimelineAngleRow(angle.minimum, cTimelineDisplayHeight);
+            for (UINT y = top; y <= bottom; ++y) {
+                UINT& pixel = m_pTimelinePixels[y * cTimelineColumns + x];
+                if (cEnergyBackgroundColor == pixel) {
+                    pixel = cTimelineAngleRangeColor;
+                }
+            }
+            m_pTimelinePixels[GetTimelineAngleRow(angle.mean, cTimelineDisplayHeight) * cTimelineColumns + x] = cTimelineAngleColor;
+        }
+    }
+
+    m_dirtyFlags |= cDirtyTimeline;
+}
+
+/// Upload spectrogram columns appended since last upload.
+void AudioPanel::UploadSpectrogram() {
+    UINT count = m_spectrogramPendingColumns;
+    UINT start = (m_spectrogramColumn + cSpectrogramColumns - count) % cSpectrogramColumns;
+
+    // Pending columns may wrap past right edge of bitmap, in which case they go up in two runs
+    while (count > 0) {
+        UINT end = (start + count > cSpectrogramColumns) ? cSpectrogramColumns : start + count;
+        D2D1_RECT_U columns = D2D1::RectU(start, 0, end, cSpectrogramBins);
+        m_pSpectrogramDisplay->CopyFromMemory(&columns, m_pSpectrogramPixels + start, cSpectrogramColumns * sizeof(UINT));
+
+        count -= end - start;
+        start = 0;
+    }
+
+    m_spectrogramPendingColumns = 0;
 }
 
 /// Dispose of Direct2d resources.
@@ -91,9 +466,18 @@ void AudioPanel::DiscardResources() {
     SafeRelease(m_pBeamGauge);
     SafeRelease(m_pBeamGaugeFill);
     SafeRelease(m_pBeamNeedle);
-    SafeRelease(m_pBeamNeedleFill);
+    for (UINT i = 0; i < cMaxSourceNeedles; ++i) {
+        SafeRelease(m_pBeamNeedleFills[i]);
+    }
+    SafeRelease(m_pSourceMap);
+    SafeRelease(m_pSourceMapFill);
     SafeRelease(m_pPanelOutline);
     SafeRelease(m_pPanelOutlineStroke);
+    SafeRelease(m_pEnergyDisplay);
+    SafeRelease(m_pSpectrogramDisplay);
+    SafeRelease(m_pTimelineDisplay);
+    SafeRelease(m_pStaticLayer);
+    SafeRelease(m_pStaticLayerTarget);
 }
 
 /// Ensure necessary Direct2d resources are created
@@ -128,7 +512,26 @@ HRESULT AudioPanel::EnsureResources() {
             if (SUCCEEDED(hr)) {
                 hr = CreatePanelOutline();
             }
+
+            if (SUCCEEDED(hr)) {
+                hr = CreateEnergyDisplay();
+            }
+
+            if (SUCCEEDED(hr)) {
+                hr = CreateSpectrogramDisplay();
+            }
+
+            if (SUCCEEDED(hr)) {
+                hr = CreateTimelineDisplay();
+            }
+
+            if (SUCCEEDED(hr)) {
+                hr = CreateStaticLayer();
+            }
         }
+
+        // Nothing has been drawn to new target yet, and map geometry was discarded with old one
+        m_dirtyFlags |= cDirtyTarget | cDirtySourceMap;
     }
 
     if (FAILED(hr)) {
@@ -179,9 +582,13 @@ HRESULT AudioPanel::CreateBeamGauge() {
                     hr = m_pRenderTarget->CreateRadialGradientBrush(D2D1::RadialGradientBrushProperties(D2D1::Point2F(0.5f,0.0f), D2D1::Point2F(0.0f,0.0f), 1.0f, 1.0f), pGradientStops, &m_pBeamGaugeFill);
 
                     if (SUCCEEDED(hr)) {
-                        // Create gauge needle shape and fill brush
+                        // Create gauge needle shape and fill brushes
                         hr = CreateBeamGaugeNeedle();
                     }
+
+                    if (SUCCEEDED(hr)) {
+                        hr = m_pRenderTarget->CreateSolidColorBrush(D2D1::ColorF(cSourceNeedleColors[0], cSourceMapOpacity), &m_pSourceMapFill);
+                    }
                 }
 
                 SafeRelease(pGradientStops);
@@ -194,7 +601,7 @@ HRESULT AudioPanel::CreateBeamGauge() {
     return hr;
 }
 
-/// Create gauge needle used to display beam angle.
+/// Create gauge needle used to display source angles, and a fill brush for each needle color.
 /// <returns>S_OK on success, otherwise failure code.</returns>
 HRESULT AudioPanel::CreateBeamGaugeNeedle() {
     HRESULT hr = m_pD2DFactory->CreatePathGeometry(&m_pBeamNeedle);
@@ -211,17 +618,17 @@ HRESULT AudioPanel::CreateBeamGaugeNeedle() {
             pGeometrySink->EndFigure(D2D1_FIGURE_END_CLOSED);
             hr = pGeometrySink->Close();
 
-            // Create gauge needle brush
-            if (SUCCEEDED(hr)) {
+            // Create a gauge needle brush for each needle color
+            for (UINT i = 0; i < cMaxSourceNeedles && SUCCEEDED(hr); ++i) {
                 ID2D1GradientStopCollection *pGradientStops = NULL;
                 D2D1_GRADIENT_STOP gradientStops[4];
                 gradientStops[0].color = D2D1::ColorF(D2D1::ColorF::LightGray, 1);
                 gradientStops[0].position = 0.0f;
                 gradientStops[1].color = D2D1::ColorF(D2D1::ColorF::LightGray, 1);
                 gradientStops[1].position = 0.35f;
-                gradientStops[2].color = D2D1::ColorF(D2D1::ColorF::BlueViolet, 1);
+                gradientStops[2].color = D2D1::ColorF(cSourceNeedleColors[i], 1);
                 gradientStops[2].position = 0.395f;
-                gradientStops[3].color = D2D1::ColorF(D2D1::ColorF::BlueViolet, 1);
+                gradientStops[3].color = D2D1::ColorF(cSourceNeedleColors[i], 1);
                 gradientStops[3].position = 1.0f;
                 hr = m_pRenderTarget->CreateGradientStopCollection(
                     gradientStops,
@@ -230,7 +637,7 @@ HRESULT AudioPanel::CreateBeamGaugeNeedle() {
                    );
 
                 if (SUCCEEDED(hr)) {
-                    hr = m_pRenderTarget->CreateLinearGradientBrush(D2D1::LinearGradientBrushProperties(D2D1::Point2F(0.5f,0.0f), D2D1::Point2F(0.5f,1.0f)), pGradientStops, &m_pBeamNeedleFill);
+                    hr = m_pRenderTarget->CreateLinearGradientBrush(D2D1::LinearGradientBrushProperties(D2D1::Point2F(0.5f,0.0f), D2D1::Point2F(0.5f,1.0f)), pGradientStops, &m_pBeamNeedleFills[i]);
                 }
 
                 SafeRelease(pGradientStops);
@@ -243,6 +650,44 @@ HRESULT AudioPanel::CreateBeamGaugeNeedle() {
     return hr;
 }
 
+/// Rebuild geometry plotting response by angle along gauge from m_sourceMap.
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT AudioPanel::UpdateSourceMapGeometry() {
+    SafeRelease(m_pSourceMap);
+    if (0 == m_sourceMapAngleCount) {
+        return S_OK;
+    }
+
+    HRESULT hr = m_pD2DFactory->CreatePathGeometry(&m_pSourceMap);
+
+    // Response rises from inner arc towards outer one; only angles gauge spans are plotted
+    if (SUCCEEDED(hr)) {
+        ID2D1GeometrySink *pGeometrySink = NULL;
+        hr = m_pSourceMap->Open(&pGeometrySink);
+
+        if (SUCCEEDED(hr)) {
+            const float spacing = 180.0f / (m_sourceMapAngleCount - 1);
+            UINT first = static_cast<UINT>(ceilf((90.0f - cGaugeHalfAngle) / spacing));
+            UINT last = static_cast<UINT>(floorf((90.0f + cGaugeHalfAngle) / spacing));
+
+            pGeometrySink->BeginFigure(GetGaugePoint(-cGaugeHalfAngle, cGaugeInnerRadius), D2D1_FIGURE_BEGIN_FILLED);
+            for (UINT a = first; a <= last; ++a) {
+                float value = m_sourceMap[a];
+                value = (value < 0.0f) ? 0.0f : ((value > 1.0f) ? 1.0f : value);
+                pGeometrySink->AddLine(GetGaugePoint(a * spacing - 90.0f, cGaugeInnerRadius + (cGaugeOuterRadius - cGaugeInnerRadius) * value));
+            }
+            pGeometrySink->AddLine(GetGaugePoint(cGaugeHalfAngle, cGaugeInnerRadius));
+            pGeometrySink->AddArc(D2D1::ArcSegment(GetGaugePoint(-cGaugeHalfAngle, cGaugeInnerRadius), D2D1::SizeF(cGaugeInnerRadius, cGaugeInnerRadius), 2.0f * cGaugeHalfAngle, D2D1_SWEEP_DIRECTION_CLOCKWISE, D2D1_ARC_SIZE_SMALL));
+            pGeometrySink->EndFigure(D2D1_FIGURE_END_CLOSED);
+            hr = pGeometrySink->Close();
+        }
+
+        SafeRelease(pGeometrySink);
+    }
+
+    return hr;
+}
+
 /// Create outline that frames both gauges and energy display into a cohesive panel.
 /// <returns>S_OK on success, otherwise failure code.</returns>
 HRESULT AudioPanel::CreatePanelOutline() {
@@ -287,5 +732,75 @@ HRESULT AudioPanel::CreatePanelOutline() {
         SafeRelease(pGeometrySink);
     }
 
+    return hr;
+}
+
+/// Create bitmap used to display energy oscilloscope.
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT AudioPanel::CreateEnergyDisplay() {
+    D2D1_BITMAP_PROPERTIES bitmapProps = D2D1::BitmapProperties(D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_IGNORE));
+    HRESULT hr = m_pRenderTarget->CreateBitmap(D2D1::SizeU(cEnergySamplesToDisplay, cEnergyDisplayHeight), bitmapProps, &m_pEnergyDisplay);
+
+    // New bitmap is uninitialized, so current pixels must be uploaded on next draw
+    m_dirtyFlags |= cDirtyEnergy;
+
+    return hr;
+}
+
+/// Create bitmap used to display spectrogram.
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT AudioPanel::CreateSpectrogramDisplay() {
+    D2D1_BITMAP_PROPERTIES bitmapProps = D2D1::BitmapProperties(D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_IGNORE));
+    HRESULT hr = m_pRenderTarget->CreateBitmap(D2D1::SizeU(cSpectrogramColumns, cSpectrogramBins), bitmapProps, &m_pSpectrogramDisplay);
+
+    // New bitmap is uninitialized, so every column must be uploaded on next draw
+    m_spectrogramPendingColumns = cSpectrogramColumns;
+    m_dirtyFlags |= cDirtySpectrogram;
+
+    return hr;
+}
+
+/// Create bitmap used to display timeline.
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT AudioPanel::CreateTimelineDisplay() {
+    D2D1_BITMAP_PROPERTIES bitmapProps = D2D1::BitmapProperties(D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_IGNORE));
+    HRESULT hr = m_pRenderTarget->CreateBitmap(D2D1::SizeU(cTimelineColumns, cTimelineDisplayHeight), bitmapProps, &m_pTimelineDisplay);
+
+    // New bitmap is uninitialized, so current pixels must be uploaded on next draw
+    m_dirtyFlags |= cDirtyTimeline;
+
+    return hr;
+}
+
+/// Create cached layer and render parts of panel that never change into it.
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT AudioPanel::CreateStaticLayer() {
+    // Compatible target shares resources with window target, so gauge and outline brushes can be used as they are
+    HRESULT hr = m_pRenderTarget->CreateCompatibleRenderTarget(&m_pStaticLayerTarget);
+
+    if (SUCCEEDED(hr)) {
+        m_pStaticLayerTarget->BeginDraw();
+        m_pStaticLayerTarget->SetTransform(m_RenderTargetTransform);
+
+        m_pStaticLayerTarget->Clear(D2D1::ColorF(D2D1::ColorF::White));
+
+        // Draw audio beam gauge
+        m_pStaticLayerTarget->FillGeometry(m_pBeamGauge, m_pBeamGaugeFill, NULL);
+
+        // Draw panel outline
+        m_pStaticLayerTarget->DrawGeometry(m_pPanelOutline, m_pPanelOutlineStroke, cPanelOutlineWidth);
+
+        // Draw frame around timeline, just outside it so timeline bitmap leaves it visible
+        D2D1_RECT_F timelineFrame = D2D1::RectF(cTimelineDisplayRect.left - cPanelOutlineWidth / 2, cTimelineDisplayRect.top - cPanelOutlineWidth / 2,
+            cTimelineDisplayRect.right + cPanelOutlineWidth / 2, cTimelineDisplayRect.bottom + cPanelOutlineWidth / 2);
+        m_pStaticLayerTarget->DrawRectangle(timelineFrame, m_pPanelOutlineStroke, cPanelOutlineWidth);
+
+        hr = m_pStaticLayerTarget->EndDraw();
+
+        if (SUCCEEDED(hr)) {
+            hr = m_pStaticLayerTarget->GetBitmap(&m_pStaticLayer);
+        }
+    }
+
     return hr;
 }
\ No newline at end of file
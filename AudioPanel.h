@@ -3,12 +3,22 @@
 // Direct2D Header Files
 #include <d2d1.h>
 
+#include "HistoryPyramid.h"
+#include "LatencyHistogram.h"
+
  
-/// Manages the drawing of audio data in audio panel that includes beam angle and
-/// sound source angle gauges, and an oscilloscope visualization of audio data.
+/// Manages the drawing of audio data in audio panel that includes a sound source gauge,
+/// with one needle per tracked source over a plot of response by angle, an oscilloscope
+/// visualization of audio data, and a scrolling spectrogram beneath it.
 /// Note that all panel elements are laid out directly in an {X,Y} coordinate space
 /// where X and Y are both in [0.0,1.0] interval, and whole panel is later re-scaled
 /// to fit available area via a scaling transform.
+/// Panel is retained: gauge and outline are rendered once into a cached layer, and
+/// a frame is only drawn when sources, energy or spectrogram changed since the last one.
+/// Spectrogram bitmap is a ring of columns: each new column overwrites the oldest one, only
+/// new columns are uploaded, and the ring is drawn in two pieces so oldest is at left.
+/// Timeline, inside gauge's inner arc, shows energy and beam angle over columns of any
+/// length, already summarised by a HistoryPyramid; it is redrawn only when they change.
 class AudioPanel {
 public:
     AudioPanel();
@@ -22,15 +32,86 @@ public:
     /// <returns>S_OK on success, otherwise failure code.</returns>
     HRESULT Initialize(const HWND hwnd, ID2D1Factory* pD2DFactory);
      
-    /// Draws audio panel.
+    /// Draws audio panel, if anything changed since it was last drawn.
     /// <returns>S_OK on success, otherwise failure code.</returns>
     HRESULT Draw();
+
+    /// Force next Draw to redraw panel, e.g. because window contents were exposed.
+    void Invalidate();
      
-    /// Update the beam angle being displayed in panel.
-    /// <param name="beamAngle">new beam angle to display.</param>
-    void SetBeam(const float & beamAngle);
+    /// Update the sources shown by gauge needles.
+    /// <param name="pAngles">angle of each source, in degrees.</param>
+    /// <param name="pIds">id of each source. A source keeps its needle color for as long as its id stays the same.</param>
+    /// <param name="count">number of sources. Only the first cMaxSourceNeedles are shown.</param>
+    /// <param name="captureTimestamp">GetClockNanoseconds when audio that produced angles was captured.</param>
+    void SetSources(const float* pAngles, const UINT* pIds, UINT count, UINT64 captureTimestamp);
+
+    /// Update response by angle plotted along gauge.
+    /// <param name="pMap">response, in [0.0,1.0] interval, at angles spaced evenly from -90 to +90 degrees.</param>
+    /// <param name="angleCount">number of angles, from 2 to cMaxSourceMapAngles. 0 clears plot.</param>
+    void SetSourceMap(const float* pMap, UINT angleCount);
+
+    /// Set histograms that Draw records its timings into.
+    /// <param name="pCaptureToDisplay">receives time from capture of displayed source angles to presenting them, or NULL.</param>
+    /// <param name="pDrawDuration">receives time taken by each Draw, or NULL.</param>
+    void SetLatencyHistograms(LatencyHistogram* pCaptureToDisplay, LatencyHistogram* pDrawDuration);
+
+    /// Update the energy values displayed by oscilloscope.
+    /// <param name="pEnergy">energy values in [0.0,1.0] interval, oldest first.</param>
+    /// <param name="cEnergy">number of values. Only the latest cEnergySamplesToDisplay are shown.</param>
+    void UpdateEnergy(const float* pEnergy, UINT cEnergy);
+
+    /// Append columns to spectrogram, scrolling out the oldest ones.
+    /// <param name="pSpectra">columns, oldest first, each holding log power in [0.0,1.0] interval of binCount bins, lowest frequency first.</param>
+    /// <param name="cSpectra">number of columns.</param>
+    /// <param name="binCount">number of bins in each column. Bins beyond cSpectrogramBins are not shown.</param>
+    void AppendSpectra(const float* pSpectra, UINT cSpectra, UINT binCount);
+
+    /// Update timeline of energy and beam angle.
+    /// <param name="pEnergy">energy of each column, in [0.0,1.0] interval, oldest first. Columns summarising no entries are left blank.</param>
+    /// <param name="pAngles">beam angle of each column, in degrees, oldest first.</param>
+    /// <param name="columnCount">number of columns. Only the latest cTimelineColumns are shown, newest at right edge.</param>
+    void UpdateTimeline(const HistoryColumn* pEnergy, const HistoryColumn* pAngles, UINT columnCount);
+
+    /// Number of frames drawn and presented.
+    UINT GetFramesDrawn() const { return m_framesDrawn; }
+
+    /// Number of Draw calls that presented nothing because nothing changed or window was occluded.
+    UINT GetFramesSkipped() const { return m_framesSkipped; }
+
+    // Number of energy samples shown across width of oscilloscope.
+    static const UINT           cEnergySamplesToDisplay = 780;
+
+    // Number of spectrogram columns shown, about as much audio as oscilloscope at 8 ms per column.
+    static const UINT           cSpectrogramColumns = 256;
+
+    // Number of frequency bins shown by spectrogram, one pixel row each, starting at DC.
+    static const UINT           cSpectrogramBins = 128;
+
+    // Number of columns shown across width of timeline, one pixel each.
+    static const UINT           cTimelineColumns = 390;
+
+    // Largest number of source needles shown at once, each in its own color.
+    static const UINT           cMaxSourceNeedles = 3;
+
+    // Largest number of angles in a source map.
+    static const UINT           cMaxSourceMapAngles = 361;
 
 private:
+    // Height, in pixels, of oscilloscope bitmap. Keeps bitmap aspect ratio equal to its display area.
+    static const UINT           cEnergyDisplayHeight = 98;
+
+    // Height, in pixels, of timeline bitmap. Keeps bitmap aspect ratio equal to its display area.
+    static const UINT           cTimelineDisplayHeight = 50;
+
+    // Dirty flags recording which parts of panel changed since last frame was presented.
+    static const UINT           cDirtyBeam = 0x1;
+    static const UINT           cDirtyEnergy = 0x2;
+    static const UINT           cDirtyTarget = 0x4;
+    static const UINT           cDirtySpectrogram = 0x8;
+    static const UINT           cDirtySourceMap = 0x10;
+    static const UINT           cDirtyTimeline = 0x20;
+
     // Main application window
     HWND                        m_hWnd;
 
@@ -41,10 +122,61 @@ private:
     ID2D1PathGeometry*          m_pBeamGauge;
     ID2D1RadialGradientBrush*   m_pBeamGaugeFill;
     ID2D1PathGeometry*          m_pBeamNeedle;
-    ID2D1LinearGradientBrush*   m_pBeamNeedleFill;
-    D2D_MATRIX_3X2_F            m_BeamNeedleTransform;
+    ID2D1LinearGradientBrush*   m_pBeamNeedleFills[cMaxSourceNeedles];
+    ID2D1PathGeometry*          m_pSourceMap;
+    ID2D1SolidColorBrush*       m_pSourceMapFill;
     ID2D1PathGeometry*          m_pPanelOutline;
     ID2D1SolidColorBrush*       m_pPanelOutlineStroke;
+    ID2D1Bitmap*                m_pEnergyDisplay;
+    ID2D1Bitmap*                m_pSpectrogramDisplay;
+    ID2D1Bitmap*                m_pTimelineDisplay;
+
+    // Offscreen target holding static layer (background, gauge and outline), and its bitmap.
+    ID2D1BitmapRenderTarget*    m_pStaticLayerTarget;
+    ID2D1Bitmap*                m_pStaticLayer;
+
+    // Oscilloscope pixels, in B8G8R8A8 format, rendered on CPU and uploaded to m_pEnergyDisplay.
+    UINT*                       m_pEnergyPixels;
+
+    // Spectrogram pixels, in B8G8R8A8 format, laid out like m_pSpectrogramDisplay with highest bin in top row.
+    UINT*                       m_pSpectrogramPixels;
+
+    // Column of spectrogram ring that next appended column overwrites, which is also the oldest column.
+    UINT                        m_spectrogramColumn;
+
+    // Number of columns, ending just before m_spectrogramColumn, not yet uploaded to m_pSpectrogramDisplay.
+    UINT                        m_spectrogramPendingColumns;
+
+    // Timeline pixels, in B8G8R8A8 format, rendered on CPU and uploaded to m_pTimelineDisplay.
+    UINT*                       m_pTimelinePixels;
+
+    // Color of each spectrogram level, from background for silence to darkest for loudest.
+    UINT                        m_spectrogramPalette[256];
+
+    // Sources currently shown by needles: angle in degrees, id, and needle rotation.
+    UINT                        m_sourceCount;
+    float                       m_fSourceAngles[cMaxSourceNeedles];
+    UINT                        m_sourceIds[cMaxSourceNeedles];
+    D2D_MATRIX_3X2_F            m_SourceNeedleTransforms[cMaxSourceNeedles];
+
+    // Response by angle plotted along gauge. m_pSourceMap is rebuilt from it when cDirtySourceMap is set.
+    float                       m_sourceMap[cMaxSourceMapAngles];
+    UINT                        m_sourceMapAngleCount;
+
+    // Combination of cDirty flags. cDirtyEnergy and cDirtyTimeline also mean their pixels need uploading.
+    UINT                        m_dirtyFlags;
+
+    // Frame pacing counters.
+    UINT                        m_framesDrawn;
+    UINT                        m_framesSkipped;
+
+    // Capture time of source angles set most recently, and of source angles last presented.
+    UINT64                      m_beamTimestamp;
+    UINT64                      m_presentedBeamTimestamp;
+
+    // Histograms Draw records timings into, if set.
+    LatencyHistogram*           m_pCaptureToDisplayLatency;
+    LatencyHistogram*           m_pDrawLatency;
 
     /// Dispose of Direct2d resources.
     void DiscardResources( );
@@ -57,11 +189,34 @@ private:
     /// <returns>S_OK on success, otherwise failure code.</returns>
     HRESULT CreateBeamGauge();
 
-    /// Create gauge needle used to display beam angle.
+    /// Create gauge needle used to display source angles, and a fill brush for each needle color.
     /// <returns>S_OK on success, otherwise failure code.</returns>
     HRESULT CreateBeamGaugeNeedle();
+
+    /// Rebuild geometry plotting response by angle along gauge from m_sourceMap.
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT UpdateSourceMapGeometry();
      
     /// Create outline that frames both gauges and energy display into a cohesive panel.
     /// <returns>S_OK on success, otherwise failure code.</returns>
     HRESULT CreatePanelOutline();
+
+    /// Create bitmap used to display energy oscilloscope.
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT CreateEnergyDisplay();
+
+    /// Create bitmap used to display spectrogram.
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT CreateSpectrogramDisplay();
+
+    /// Create bitmap used to display timeline.
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT CreateTimelineDisplay();
+
+    /// Upload spectrogram columns appended since last upload.
+    void UploadSpectrogram();
+
+    /// Create cached layer and render parts of panel that never change into it.
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT CreateStaticLayer();
 };
\ No newline at end of file
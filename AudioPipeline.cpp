@@ -0,0 +1,302 @@
+﻿#include "AudioPipeline.h"
+#include "Clock.h"
+
+// For M_PI
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+// Bottom portion of computed energy signal that will be discarded as noise.
+// Only portion of signal above noise floor will be displayed.
+static const float cEnergyNoiseFloor = 0.2f;
+
+// Largest angle, in degrees, steered to by software beamformer. Matches Kinect beam range.
+static const float cSteeredBeamExtent = 50.0f;
+
+/// Constructor
+AudioPipeline::AudioPipeline() :
+    m_samplesProcessed(0),
+    m_energyCalculator(cEnergyNoiseFloor, GetSimdLevel()),
+    m_channelCount(AudioChannels),
+    m_enhancements(AudioEnhancementNone),
+    m_gainControl(AudioSamplesPerSecond, GetSimdLevel()),
+    m_bSkipping(false),
+    m_localizerOrigin(0),
+    m_angleTracker(AudioSamplesPerSecond),
+    m_sourceTracker(AudioSamplesPerSecond),
+    m_beamAngleDegrees(0.0f) {
+    memset(&m_gateStatistics, 0, sizeof(m_gateStatistics));
+    memset(&m_sourceEstimate, 0, sizeof(m_sourceEstimate));
+    for (UINT b = 0; b < cSteeredBeamCount; ++b) {
+        m_pBeamOutputs[b] = m_beamOutput[b];
+    }
+}
+
+/// Prepare processing stages for audio with given channel count.
+/// Must be called before first block when audio has more than one channel, for spectrogram columns to be
+/// produced, and for enhancement stages to run.
+/// <param name="channelCount">number of interleaved channels in blocks; more than one means raw Kinect microphone array.</param>
+/// <param name="enhancements">combination of AudioEnhancement flags selecting stages to run.</param>
+/// <param name="mapThreadCount">number of threads angular map of multichannel audio is split across, 1 for calling thread only.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT AudioPipeline::Initialize(WORD channelCount, UINT enhancements, UINT mapThreadCount) {
+    m_channelCount = channelCount;
+    m_enhancements = enhancements;
+
+    // Spectrogram is taken of the same mono signal energy is, so it has one channel either way
+    HRESULT hr = m_spectrumAnalyzer.Initialize(AudioPipelineResult::cSpectrumWindowSize, AudioPipelineResult::cSpectrumHopSize, 1, GetSimdLevel());
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    if (0 != (enhancements & AudioEnhancementNoiseSuppression)) {
+        hr = m_noiseSuppressor.Initialize(cNoiseSuppressorFrameSize, AudioSamplesPerSecond, GetSimdLevel());
+        if (FAILED(hr)) {
+            return hr;
+        }
+    }
+
+    if (0 != (enhancements & AudioEnhancementVoiceGate)) {
+        hr = m_voiceDetector.Initialize(AudioSamplesPerSecond, GetSimdLevel());
+        if (FAILED(hr)) {
+            return hr;
+        }
+    }
+
+    Reset();
+
+    if (channelCount <= 1) {
+        return S_OK;
+    }
+
+    MicrophoneArrayGeometry geometry = GetKinectArrayGeometry();
+    if (channelCount != geometry.microphoneCount) {
+        return E_INVALIDARG;
+    }
+
+    // Beams evenly spaced across field of view
+    float beamAngles[cSteeredBeamCount];
+    for (UINT b = 0; b < cSteeredBeamCount; ++b) {
+        beamAngles[b] = -cSteeredBeamExtent + 2.0f * cSteeredBeamExtent * b / (cSteeredBeamCount - 1);
+    }
+
+    hr = m_beamformer.Initialize(geometry, AudioSamplesPerSecond, beamAngles, cSteeredBeamCount, AudioBlock::MaxSamples, GetSimdLevel());
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    hr = m_localizer.Initialize(geometry, AudioSamplesPerSecond);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    return m_localizer.InitializeAngularMap(AudioPipelineResult::cMapAngles, mapThreadCount);
+}
+
+/// Forget all state accumulated from previous blocks.
+void AudioPipeline::Reset() {
+    m_samplesProcessed = 0;
+    m_energyCalculator.Reset();
+    m_spectrumAnalyzer.Reset();
+    m_beamformer.Reset();
+    m_localizer.Reset();
+    m_noiseSuppressor.Reset();
+    m_gainControl.Reset();
+    m_voiceDetector.Reset();
+    m_bSkipping = false;
+    m_localizerOrigin = 0;
+    memset(&m_gateStatistics, 0, sizeof(m_gateStatistics));
+    memset(&m_sourceEstimate, 0, sizeof(m_sourceEstimate));
+    m_angleTracker.Reset();
+    m_sourceTracker.Reset();
+    memset(m_angularMap, 0, sizeof(m_angularMap));
+    m_beamAngleDegrees = 0.0f;
+}
+
+/// Run one captured block through processing stages.
+/// <param name="block">captured audio block.</param>
+/// <param name="pResult">receives processing results for block.</param>
+/// <returns>S_OK on success, E_INVALIDARG if block's channel count does not match Initialize.</returns>
+HRESULT AudioPipeline::ProcessBlock(const AudioBlock& block, AudioPipelineResult* pResult) {
+    if (block.channelCount != m_channelCount || block.sampleCount > AudioBlock::MaxSamples) {
+        return E_INVALIDARG;
+    }
+
+    pResult->sequence = block.sequence;
+    pResult->samplePosition = m_samplesProcessed;
+    pResult->sampleCount = block.sampleCount;
+    pResult->captureTimestamp = block.captureTimestamp;
+
+    // Convert angles to degrees
+    pResult->beamAngleDegrees = static_cast<float>((180.0 * block.angles.beamAngle) / M_PI);
+    pResult->sourceAngleDegrees = static_cast<float>((180.0 * block.angles.sourceAngle) / M_PI);
+    pResult->sourceConfidence = static_cast<float>(block.angles.sourceConfidence);
+
+    // Gate listens to first raw channel, so it costs the same whether or not the block is beamformed
+    pResult->bVoiceActive = true;
+    if (0 != (m_enhancements & AudioEnhancementVoiceGate)) {
+        pResult->bVoiceActive = m_voiceDetector.Process(block.pSamples, block.sampleCount, m_channelCount);
+    }
+    pResult->bAnalysisSkipped = !pResult->bVoiceActive;
+
+    // Beamformer and localizer history would jump across skipped audio, so they start over after it
+    if (pResult->bAnalysisSkipped && !m_bSkipping) {
+        m_beamformer.Reset();
+        m_localizer.Reset();
+    }
+    if (!pResult->bAnalysisSkipped && m_bSkipping) {
+        m_localizerOrigin = m_samplesProcessed;
+    }
+    m_bSkipping = pResult->bAnalysisSkipped;
+
+    UINT64 gatedStart = GetClockNanoseconds();
+
+    const int16_t* pSamples = block.pSamples;
+    pResult->steeredBeamCount = 0;
+    pResult->sourceEstimateCount = 0;
+
+    if (pResult->bAnalysisSkipped) {
+        pResult->sourceConfidence = 0.0f;
+
+        // Energy is still shown, from first channel instead of loudest beam
+        if (m_channelCount > 1) {
+            for (UINT i = 0; i < block.sampleCount; ++i) {
+                m_beamSamples[i] = block.pSamples[i * m_channelCount];
+            }
+            pSamples = m_beamSamples;
+
+            pResult->beamAngleDegrees = m_beamAngleDegrees;
+            pResult->sourceAngleDegrees = m_sourceEstimate.angleDegrees;
+            memset(m_angularMap, 0, sizeof(m_angularMap));
+        }
+    }
+    else if (m_channelCount > 1) {
+        HRESULT hr = m_beamformer.Process(block.pSamples, block.sampleCount, m_pBeamOutputs);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        // Loudest beam points at dominant sound source
+        UINT loudestBeam = 0;
+        for (UINT b = 0; b < cSteeredBeamCount; ++b) {
+            double power = 0.0;
+            for (UINT i = 0; i < block.sampleCount; ++i) {
+                power += m_beamOutput[b][i] * m_beamOutput[b][i];
+            }
+            pResult->steeredBeamPower[b] = (block.sampleCount > 0) ? static_cast<float>(power / block.sampleCount) : 0.0f;
+
+            if (pResult->steeredBeamPower[b] > pResult->steeredBeamPower[loudestBeam]) {
+                loudestBeam = b;
+            }
+        }
+
+        pResult->steeredBeamCount = cSteeredBeamCount;
+        pResult->beamAngleDegrees = m_beamformer.GetBeamAngle(loudestBeam);
+        m_beamAngleDegrees = pResult->beamAngleDegrees;
+
+        for (UINT i = 0; i < block.sampleCount; ++i) {
+            float sample = m_beamOutput[loudestBeam][i];
+            sample = (sample > 32767.0f) ? 32767.0f : ((sample < -32768.0f) ? -32768.0f : sample);
+            m_beamSamples[i] = static_cast<int16_t>(sample);
+        }
+        pSamples = m_beamSamples;
+
+        // Own localizer replaces the sensor's sound source position for raw array audio
+        pResult->sourceEstimateCount = m_localizer.Process(block.pSamples, block.sampleCount, pResult->sourceEstimates, &m_frameMaps[0][0], GccPhatLocalizer::cMaxEstimatesPerBlock);
+        for (UINT i = 0; i < pResult->sourceEstimateCount; ++i) {
+            pResult->sourceEstimates[i].samplePosition += m_localizerOrigin;
+
+            // Every source standing out in frame's map is followed, not just the one estimate settles on
+            AngularPeak peaks[MultiSourceTracker::cMaxTracks + 1];
+            UINT peakCount = m_localizer.GetAngularMap().FindPeaks(m_frameMaps[i], peaks, MultiSourceTracker::cMaxTracks + 1);
+            m_sourceTracker.Update(pResult->sourceEstimates[i].samplePosition, peaks, peakCount);
+        }
+        if (pResult->sourceEstimateCount > 0) {
+            m_sourceEstimate = pResult->sourceEstimates[pResult->sourceEstimateCount - 1];
+            memcpy(m_angularMap, m_frameMaps[pResult->sourceEstimateCount - 1], sizeof(m_angularMap));
+        }
+
+        pResult->sourceAngleDegrees = m_sourceEstimate.angleDegrees;
+        pResult->sourceConfidence = m_sourceEstimate.confidence;
+    }
+
+    UINT64 gatedNanoseconds = GetClockNanoseconds() - gatedStart;
+
+    // Localizer estimates are placed where they were made; a sensor's angles are taken to hold at end of block
+    UINT64 blockEnd = m_samplesProcessed + block.sampleCount;
+    if (pResult->sourceEstimateCount > 0) {
+        for (UINT i = 0; i < pResult->sourceEstimateCount; ++i) {
+            m_angleTracker.Update(pResult->sourceEstimates[i].samplePosition, pResult->sourceEstimates[i].angleDegrees, pResult->sourceEstimates[i].confidence);
+        }
+    }
+    else if (m_channelCount <= 1) {
+        m_angleTracker.Update(blockEnd, pResult->sourceAngleDegrees, pResult->sourceConfidence);
+    }
+    m_angleTracker.Predict(blockEnd);
+
+    pResult->trackedAngleDegrees = m_angleTracker.GetAngleDegrees();
+    pResult->trackedVelocityDegreesPerSecond = m_angleTracker.GetVelocityDegreesPerSecond();
+    pResult->trackedUncertaintyDegrees = m_angleTracker.GetUncertaintyDegrees();
+
+    pResult->mapAngleCount = 0;
+    pResult->trackCount = 0;
+    if (m_channelCount > 1) {
+        m_sourceTracker.Predict(blockEnd);
+        pResult->trackCount = m_sourceTracker.GetTracks(pResult->tracks, MultiSourceTracker::cMaxTracks);
+        pResult->mapAngleCount = AudioPipelineResult::cMapAngles;
+        memcpy(pResult->angularMap, m_angularMap, sizeof(m_angularMap));
+    }
+    else if (m_angleTracker.IsTracking()) {
+        // A sensor reports a single source, which is the only one there is to follow
+        SourceTrack& track = pResult->tracks[pResult->trackCount++];
+        track.id = 1;
+        track.angleDegrees = pResult->trackedAngleDegrees;
+        track.velocityDegreesPerSecond = pResult->trackedVelocityDegreesPerSecond;
+        track.uncertaintyDegrees = pResult->trackedUncertaintyDegrees;
+        track.strength = pResult->sourceConfidence;
+    }
+
+    // Enhancement works on a copy, since block's samples may be shared with other consumers
+    if (AudioEnhancementNone != m_enhancements) {
+        memcpy(m_enhancedSamples, pSamples, block.sampleCount * sizeof(int16_t));
+        pSamples = m_enhancedSamples;
+
+        if (0 != (m_enhancements & AudioEnhancementNoiseSuppression)) {
+            m_noiseSuppressor.Process(m_enhancedSamples, block.sampleCount);
+        }
+
+        if (0 != (m_enhancements & AudioEnhancementAutomaticGain)) {
+            m_gainControl.Process(m_enhancedSamples, block.sampleCount);
+        }
+    }
+
+    // Compute energy of every window completed by this block
+    pResult->energyCount = m_energyCalculator.Process(pSamples, block.sampleCount, pResult->energy);
+
+    pResult->energyPeak = 0.0f;
+    for (UINT i = 0; i < pResult->energyCount; ++i) {
+        pResult->energyPeak = (pResult->energy[i] > pResult->energyPeak) ? pResult->energy[i] : pResult->energyPeak;
+    }
+
+    // Skipped spectra are silent, but history is kept so the display keeps scrolling and resumes cleanly
+    gatedStart = GetClockNanoseconds();
+    if (pResult->bAnalysisSkipped) {
+        pResult->spectrumCount = m_spectrumAnalyzer.Skip(pSamples, block.sampleCount, &pResult->spectra[0][0], AudioPipelineResult::cMaxSpectra);
+    }
+    else {
+        pResult->spectrumCount = m_spectrumAnalyzer.Process(pSamples, block.sampleCount, &pResult->spectra[0][0], AudioPipelineResult::cMaxSpectra);
+    }
+    gatedNanoseconds += GetClockNanoseconds() - gatedStart;
+
+    ++m_gateStatistics.blockCount;
+    if (pResult->bAnalysisSkipped) {
+        ++m_gateStatistics.skippedCount;
+        m_gateStatistics.skippedNanoseconds += gatedNanoseconds;
+    }
+    else {
+        m_gateStatistics.analysisNanoseconds += gatedNanoseconds;
+    }
+
+    m_samplesProcessed += block.sampleCount;
+
+    return S_OK;
+}
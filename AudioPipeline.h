@@ -0,0 +1,227 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "AngleTracker.h"
+#include "AudioBlock.h"
+#include "AudioFormat.h"
+#include "AudioEnergy.h"
+#include "Beamformer.h"
+#include "MultiSourceTracker.h"
+#include "NoiseSuppressor.h"
+#include "SourceLocalizer.h"
+#include "Stft.h"
+#include "VoiceActivityDetector.h"
+
+/// Optional pipeline stages. Noise suppression and gain control enhance the mono signal before
+/// energy and spectrum are taken; the voice gate skips localization and spectral analysis of
+/// blocks in which no voice is detected. Flags may be combined.
+enum AudioEnhancement {
+    AudioEnhancementNone = 0,
+    AudioEnhancementNoiseSuppression = 0x1,
+    AudioEnhancementAutomaticGain = 0x2,
+    AudioEnhancementVoiceGate = 0x4
+};
+
+/// Counts of blocks voice gate let through or skipped, and time they took.
+struct AudioGateStatistics {
+    // Blocks processed, and blocks whose analysis was skipped.
+    UINT64                  blockCount;
+    UINT64                  skippedCount;
+
+    // Time spent in gated stages by blocks that ran them, and by skipped blocks on their cheaper path.
+    UINT64                  analysisNanoseconds;
+    UINT64                  skippedNanoseconds;
+
+    /// Estimate of time skipping saved: what skipped blocks would have cost at the mean cost of analyzed ones, less what they did cost.
+    UINT64 GetSavedNanoseconds() const {
+        UINT64 analyzedCount = blockCount - skippedCount;
+        if (0 == analyzedCount) {
+            return 0;
+        }
+
+        UINT64 wouldHaveCost = analysisNanoseconds / analyzedCount * skippedCount;
+        return (wouldHaveCost > skippedNanoseconds) ? wouldHaveCost - skippedNanoseconds : 0;
+    }
+};
+
+/// Per-block output of processing pipeline, ready for display or logging.
+struct AudioPipelineResult {
+    // Largest number of energy values a single block can produce.
+    static const UINT       cMaxEnergyValues = AudioBlock::MaxSamples / EnergyCalculator::cAudioSamplesPerEnergySample + 1;
+
+    // Window and hop, in samples, of spectrogram columns (16 ms window every 8 ms at 16 kHz).
+    static const UINT       cSpectrumWindowSize = 256;
+    static const UINT       cSpectrumHopSize = 128;
+
+    // Number of frequency bins in each spectrogram column, from DC to Nyquist.
+    static const UINT       cSpectrumBins = cSpectrumWindowSize / 2 + 1;
+
+    // Largest number of spectrogram columns a single block can complete.
+    static const UINT       cMaxSpectra = AudioBlock::MaxSamples / cSpectrumHopSize + 1;
+
+    // Number of angles in angular map, one degree apart from -90 to +90 degrees.
+    static const UINT       cMapAngles = 181;
+
+    // Sequence number of block that produced this result.
+    uint32_t                sequence;
+
+    // Index, since start of stream, of first sample in block.
+    UINT64                  samplePosition;
+
+    // Number of samples in block.
+    uint32_t                sampleCount;
+
+    // Time at which block was captured, carried through to display for latency measurement.
+    UINT64                  captureTimestamp;
+
+    // Beam angle, in degrees. For multichannel blocks, direction of loudest steered beam.
+    float                   beamAngleDegrees;
+
+    // Sound source angle, in degrees. For multichannel blocks, most recent localizer estimate.
+    float                   sourceAngleDegrees;
+
+    // Confidence in sound source angle, in [0.0,1.0] interval.
+    float                   sourceConfidence;
+
+    // Number of sound source estimates made by localizer during block; 0 for mono blocks.
+    UINT                    sourceEstimateCount;
+
+    // Sound source estimates made during block, oldest first.
+    SourceEstimate          sourceEstimates[GccPhatLocalizer::cMaxEstimatesPerBlock];
+
+    // Sound source angle smoothed by tracker, in degrees, at end of block, with its rate of change
+    // in degrees per second and its standard deviation in degrees.
+    float                   trackedAngleDegrees;
+    float                   trackedVelocityDegreesPerSecond;
+    float                   trackedUncertaintyDegrees;
+
+    // Number of valid values in angularMap; 0 for mono blocks.
+    UINT                    mapAngleCount;
+
+    // SRP-PHAT power at each map angle, from -90 degrees up, for latest localizer frame in block. 1 for a
+    // single coherent source. Held from previous block when block completes no frame, 0 when analysis was skipped.
+    float                   angularMap[cMapAngles];
+
+    // Number of sources followed through angular map peaks, and their tracks at end of block, oldest first.
+    // For mono blocks, the sensor's source as smoothed by tracker, once it is being tracked.
+    UINT                    trackCount;
+    SourceTrack             tracks[MultiSourceTracker::cMaxTracks];
+
+    // Number of beams steered by software beamformer; 0 for mono blocks.
+    UINT                    steeredBeamCount;
+
+    // Mean power of each steered beam over block, in order of increasing angle.
+    float                   steeredBeamPower[DelayAndSumBeamformer::MaxBeams];
+
+    // Whether voice was detected in block or shortly before it. Always true when voice gate is off.
+    bool                    bVoiceActive;
+
+    // Whether voice gate skipped localization and spectral analysis of block. Steered beams and
+    // source estimates are then left empty, source confidence is 0 and spectra are silent.
+    bool                    bAnalysisSkipped;
+
+    // Largest value in energy, or 0 if block completed no energy window.
+    float                   energyPeak;
+
+    // Number of valid values in energy.
+    UINT                    energyCount;
+
+    // Log-energy, above noise floor, of each energy window completed by block.
+    // For multichannel blocks, energy of loudest steered beam.
+    float                   energy[cMaxEnergyValues];
+
+    // Number of valid columns in spectra.
+    UINT                    spectrumCount;
+
+    // Log power, in [0.0,1.0] interval, of each frequency bin of every spectrogram column completed by block.
+    // For multichannel blocks, spectrum of loudest steered beam.
+    float                   spectra[cMaxSpectra][cSpectrumBins];
+};
+
+/// Processing applied to every captured audio block, shared by the interactive
+/// application and headless batch processing so both produce identical results.
+/// Multichannel blocks from a raw microphone array are beamformed and localized in software.
+/// Not thread safe; feed blocks from a single consumer thread.
+class AudioPipeline {
+public:
+    // Number of beams steered across field of view for multichannel audio.
+    static const UINT       cSteeredBeamCount = 11;
+
+    // Frame size, in samples, of noise suppressor (16 ms at 16 kHz, which is also its latency).
+    static const UINT       cNoiseSuppressorFrameSize = 256;
+
+    /// Constructor
+    AudioPipeline();
+
+    /// Prepare processing stages for audio with given channel count.
+    /// Must be called before first block when audio has more than one channel, for spectrogram columns to be
+    /// produced, and for enhancement stages to run.
+    /// <param name="channelCount">number of interleaved channels in blocks; more than one means raw Kinect microphone array.</param>
+    /// <param name="enhancements">combination of AudioEnhancement flags selecting stages to run.</param>
+    /// <param name="mapThreadCount">number of threads angular map of multichannel audio is split across, 1 for calling thread only.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 Initialize(WORD channelCount, UINT enhancements, UINT mapThreadCount);
+
+    /// Forget all state accumulated from previous blocks.
+    void                    Reset();
+
+    /// Run one captured block through processing stages.
+    /// <param name="block">captured audio block.</param>
+    /// <param name="pResult">receives processing results for block.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if block's channel count does not match Initialize.</returns>
+    HRESULT                 ProcessBlock(const AudioBlock& block, AudioPipelineResult* pResult);
+
+    /// Number of samples processed since construction or last Reset.
+    UINT64                  GetSamplesProcessed() const { return m_samplesProcessed; }
+
+    /// Blocks voice gate skipped and time spent in gated stages since construction or last Reset.
+    /// Blocks are counted, and timed, whether or not gate is on.
+    const AudioGateStatistics& GetGateStatistics() const { return m_gateStatistics; }
+
+private:
+    UINT64                  m_samplesProcessed;
+    EnergyCalculator        m_energyCalculator;
+    StftAnalyzer            m_spectrumAnalyzer;
+    WORD                    m_channelCount;
+    DelayAndSumBeamformer   m_beamformer;
+    GccPhatLocalizer        m_localizer;
+
+    // Enhancement stages selected by Initialize.
+    UINT                    m_enhancements;
+    NoiseSuppressor         m_noiseSuppressor;
+    AutomaticGainControl    m_gainControl;
+
+    // Voice gate, when selected by Initialize, and whether previous block was skipped by it.
+    VoiceActivityDetector   m_voiceDetector;
+    bool                    m_bSkipping;
+
+    // Stream position of first sample localizer saw since it was last reset, which its estimates count from.
+    UINT64                  m_localizerOrigin;
+    AudioGateStatistics     m_gateStatistics;
+
+    // Most recent localizer estimate, reported until the next one is made.
+    SourceEstimate          m_sourceEstimate;
+
+    // Smooths sensor's or localizer's source angles, weighted by their confidence.
+    AngleTracker            m_angleTracker;
+
+    // Follows every source standing out in localizer's angular maps.
+    MultiSourceTracker      m_sourceTracker;
+
+    // Angular map of each localizer frame in current block, and latest map, held until next frame.
+    float                   m_frameMaps[GccPhatLocalizer::cMaxEstimatesPerBlock][AudioPipelineResult::cMapAngles];
+    float                   m_angularMap[AudioPipelineResult::cMapAngles];
+
+    // Direction of loudest steered beam in most recent analyzed block, held while blocks are skipped.
+    float                   m_beamAngleDegrees;
+
+    // Output of each steered beam for current block.
+    float                   m_beamOutput[cSteeredBeamCount][AudioBlock::MaxSamples];
+    float*                  m_pBeamOutputs[cSteeredBeamCount];
+
+    // Loudest beam converted back to PCM for energy calculation.
+    int16_t                 m_beamSamples[AudioBlock::MaxSamples];
+
+    // Mono signal after enhancement stages, when any are selected.
+    int16_t                 m_enhancedSamples[AudioBlock::MaxSamples];
+};
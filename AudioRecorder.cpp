@@ -0,0 +1,759 @@
+﻿#include "AudioRecorder.h"
+#include "Clock.h"
+
+// Identifies a recording file and its trailer.
+static const char       cRecordingFileMagic[8] = {'K', 'A', 'R', 'E', 'C', '0', '0', '1'};
+static const char       cRecordingTrailerMagic[8] = {'K', 'A', 'R', 'E', 'C', 'E', 'N', 'D'};
+
+// Alignment of every chunk and its payload.
+static const UINT       cChunkAlignment = 8;
+
+// Smallest average number of frames per block a batch holds track records for; batches of
+// smaller blocks are written early.
+static const UINT       cMinTrackFrames = 32;
+
+// Number of seek index entries reserved when recording starts: an hour of one second batches.
+static const UINT       cReservedIndexEntries = 3600;
+
+// Size, in bytes, of buffer used to check chunks that are not read out.
+static const UINT       cScanBufferSize = 4096;
+
+static_assert(sizeof(RecordingChunkHeader) == 32, "Chunk header layout must not change");
+static_assert(sizeof(RecordingTrackRecord) == 32, "Track record layout must not change");
+static_assert(sizeof(RecordingIndexEntry) == 32, "Index entry layout must not change");
+static_assert(sizeof(RecordingTrailer) == 32, "Trailer layout must not change");
+
+/// Round a size up to a multiple of a power of two.
+/// <param name="value">size to round.</param>
+/// <param name="alignment">power of two.</param>
+/// <returns>smallest multiple of alignment not below value.</returns>
+static UINT64 RoundUp(UINT64 value, UINT alignment) {
+    return (value + alignment - 1) & ~static_cast<UINT64>(alignment - 1);
+}
+
+/// Continue an FNV-1a hash over bytes.
+/// <param name="hash">hash of preceding bytes, or 2166136261 to start.</param>
+/// <param name="pData">bytes to hash.</param>
+/// <param name="cbData">number of bytes.</param>
+/// <returns>hash including bytes.</returns>
+static uint32_t HashBytes(uint32_t hash, const BYTE* pData, size_t cbData) {
+    for (size_t i = 0; i < cbData; ++i) {
+        hash = (hash ^ pData[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// FNV-1a hash of no bytes.
+static const uint32_t   cHashSeed = 2166136261u;
+
+/// Move file position to an offset from start of file, beyond 2 GB if need be.
+/// <param name="pFile">file to seek.</param>
+/// <param name="offset">offset, in bytes.</param>
+/// <returns>true on success.</returns>
+static bool SeekFile(FILE* pFile, UINT64 offset) {
+#ifdef _WIN32
+    return 0 == _fseeki64(pFile, static_cast<__int64>(offset), SEEK_SET);
+#else
+    return 0 == fseeko(pFile, static_cast<off_t>(offset), SEEK_SET);
+#endif
+}
+
+/// Size of a file, beyond 2 GB if need be.
+/// <param name="pFile">file to measure. File position is left at end.</param>
+/// <param name="pSize">receives size, in bytes.</param>
+/// <returns>true on success.</returns>
+static bool GetFileSize(FILE* pFile, UINT64* pSize) {
+#ifdef _WIN32
+    if (0 != _fseeki64(pFile, 0, SEEK_END)) {
+        return false;
+    }
+    __int64 size = _ftelli64(pFile);
+#else
+    if (0 != fseeko(pFile, 0, SEEK_END)) {
+        return false;
+    }
+    off_t size = ftello(pFile);
+#endif
+    if (size < 0) {
+        return false;
+    }
+
+    *pSize = static_cast<UINT64>(size);
+    return true;
+}
+
+/// Fill in a chunk header, hashing its payload.
+/// <param name="pHeader">receives header; payload follows it in memory.</param>
+/// <param name="type">one of RecordingChunkType.</param>
+/// <param name="payloadSize">size of payload, in bytes.</param>
+/// <param name="firstSample">first sample chunk covers.</param>
+/// <param name="itemCount">number of items in payload.</param>
+/// <param name="batch">number of batch chunk belongs to.</param>
+static void FillChunkHeader(RecordingChunkHeader* pHeader, uint32_t type, UINT payloadSize, UINT64 firstSample, UINT itemCount, UINT64 batch) {
+    pHeader->type = type;
+    pHeader->payloadSize = payloadSize;
+    pHeader->firstSample = firstSample;
+    pHeader->itemCount = itemCount;
+    pHeader->checksum = HashBytes(cHashSeed, reinterpret_cast<const BYTE*>(pHeader + 1), payloadSize);
+    pHeader->batch = batch;
+}
+
+/// Constructor
+AudioRecorder::AudioRecorder() :
+    m_pFile(NULL),
+    m_bOpen(false),
+    m_bWaitWhenFull(false),
+    m_channelCount(0),
+    m_frameCapacity(0),
+    m_trackCapacity(0),
+    m_trackRegionOffset(0),
+    m_pFilling(NULL),
+    m_nextSample(0),
+    m_nextBatchNumber(0),
+    m_droppedBlocks(0),
+    m_bStopping(false),
+    m_fileOffset(0),
+    m_framesWritten(0),
+    m_writeResult(S_OK),
+    m_bytesWritten(0) {
+    for (UINT i = 0; i < cBatchCount; ++i) {
+        m_batches[i].pAllocation = NULL;
+        m_batches[i].pData = NULL;
+        m_batches[i].state = BatchFree;
+    }
+}
+
+/// Destructor. Closes file, if open.
+AudioRecorder::~AudioRecorder() {
+    Close();
+}
+
+/// Create recording file, write its header and start I/O thread.
+/// <param name="szPath">path of file to create, replacing any existing file.</param>
+/// <param name="channelCount">number of interleaved channels in blocks, from 1 to AudioBlock::MaxChannels.</param>
+/// <param name="sampleRate">sample rate, in Hz.</param>
+/// <param name="batchMilliseconds">span of audio per batch, from cMinBatchMilliseconds to cMaxBatchMilliseconds.</param>
+/// <param name="bWaitWhenFull">true to wait for a free buffer when both are busy; false to drop block.</param>
+/// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range, E_UNEXPECTED if already open, otherwise failure code.</returns>
+HRESULT AudioRecorder::Open(const char* szPath, WORD channelCount, UINT sampleRate, UINT batchMilliseconds, bool bWaitWhenFull) {
+    if (m_bOpen) {
+        return E_UNEXPECTED;
+    }
+
+    if (0 == channelCount || channelCount > AudioBlock::MaxChannels || 0 == sampleRate ||
+        batchMilliseconds < cMinBatchMilliseconds || batchMilliseconds > cMaxBatchMilliseconds) {
+        return E_INVALIDARG;
+    }
+
+    UINT64 frameCapacity = static_cast<UINT64>(sampleRate) * batchMilliseconds / 1000;
+    if (frameCapacity < AudioBlock::MaxSamples) {
+        frameCapacity = AudioBlock::MaxSamples;
+    }
+
+    // Keep every batch, with its chunk headers, well inside 32-bit payload sizes
+    UINT frameSize = channelCount * sizeof(int16_t);
+    if (frameCapacity * frameSize > 0x40000000) {
+        return E_INVALIDARG;
+    }
+
+    m_channelCount = channelCount;
+    m_bWaitWhenFull = bWaitWhenFull;
+    m_frameCapacity = static_cast<UINT>(frameCapacity);
+    m_trackCapacity = m_frameCapacity / cMinTrackFrames + 1;
+
+    // PCM header and frames, then room for track header ahead of track records, so I/O thread only has to
+    // move records up behind PCM; padding chunk fits in what rounding leaves
+    m_trackRegionOffset = static_cast<UINT>(sizeof(RecordingChunkHeader) + RoundUp(static_cast<UINT64>(m_frameCapacity) * frameSize, cChunkAlignment) + sizeof(RecordingChunkHeader));
+    size_t cbBatch = static_cast<size_t>(RoundUp(m_trackRegionOffset + static_cast<UINT64>(m_trackCapacity) * sizeof(RecordingTrackRecord) + sizeof(RecordingChunkHeader), cRecordingAlignment));
+
+    for (UINT i = 0; i < cBatchCount; ++i) {
+        Batch& batch = m_batches[i];
+        batch.pAllocation = new BYTE[cbBatch + cRecordingAlignment];
+        batch.pData = batch.pAllocation + ((cRecordingAlignment - (reinterpret_cast<size_t>(batch.pAllocation) & (cRecordingAlignment - 1))) & (cRecordingAlignment - 1));
+        batch.state = BatchFree;
+        memset(batch.pData, 0, cbBatch);
+    }
+
+    m_pFile = fopen(szPath, "wb");
+    if (NULL == m_pFile) {
+        Release();
+        return E_FAIL;
+    }
+
+    // Each batch goes to disk in one write, so stdio buffering would only add a copy
+    setvbuf(m_pFile, NULL, _IONBF, 0);
+
+    // Header padded to alignment, from a still zeroed batch buffer
+    RecordingFileHeader header;
+    memcpy(header.magic, cRecordingFileMagic, sizeof(header.magic));
+    header.sampleRate = sampleRate;
+    header.channelCount = channelCount;
+    header.bitsPerSample = 16;
+    header.trackRecordSize = sizeof(RecordingTrackRecord);
+    header.indexEntrySize = sizeof(RecordingIndexEntry);
+    memcpy(m_batches[0].pData, &header, sizeof(header));
+
+    if (1 != fwrite(m_batches[0].pData, cRecordingAlignment, 1, m_pFile) || 0 != fflush(m_pFile)) {
+        Release();
+        return E_FAIL;
+    }
+
+    m_pFilling = NULL;
+    m_nextSample = 0;
+    m_nextBatchNumber = 0;
+    m_droppedBlocks = 0;
+    m_appendLatency.Reset();
+    m_bStopping = false;
+    m_index.clear();
+    m_index.reserve(cReservedIndexEntries);
+    m_fileOffset = cRecordingAlignment;
+    m_framesWritten = 0;
+    m_writeLatency.Reset();
+    m_writeResult = S_OK;
+    m_bytesWritten.store(cRecordingAlignment, std::memory_order_relaxed);
+
+    // Thread creation publishes the initialized buffers to the I/O thread
+    m_writer = std::thread(&AudioRecorder::WriteLoop, this);
+    m_bOpen = true;
+
+    return S_OK;
+}
+
+/// Copy a processed block into current batch.
+/// <param name="block">captured audio block.</param>
+/// <param name="result">pipeline's results for block, giving its stream position and angles.</param>
+/// <returns>S_OK if block was recorded, S_FALSE if it was dropped, E_INVALIDARG if channel count does not match, E_UNEXPECTED if not open.</returns>
+HRESULT AudioRecorder::Append(const AudioBlock& block, const AudioPipelineResult& result) {
+    if (!m_bOpen) {
+        return E_UNEXPECTED;
+    }
+
+    if (block.channelCount != m_channelCount || block.sampleCount > m_frameCapacity) {
+        return E_INVALIDARG;
+    }
+
+    UINT64 start = GetClockNanoseconds();
+
+    // A batch holds one unbroken run of samples, so a gap starts a new one
+    if (NULL != m_pFilling &&
+        (result.samplePosition != m_nextSample ||
+         m_pFilling->frameCount + block.sampleCount > m_frameCapacity ||
+         m_pFilling->trackCount == m_trackCapacity)) {
+        SealBatch();
+    }
+
+    if (NULL == m_pFilling) {
+        m_pFilling = BeginBatch();
+        if (NULL == m_pFilling) {
+            ++m_droppedBlocks;
+            m_appendLatency.Record(GetClockNanoseconds() - start);
+            return S_FALSE;
+        }
+
+        m_pFilling->firstSample = result.samplePosition;
+        m_pFilling->frameCount = 0;
+        m_pFilling->trackCount = 0;
+    }
+
+    Batch& batch = *m_pFilling;
+    size_t cbFrames = static_cast<size_t>(block.sampleCount) * m_channelCount * sizeof(int16_t);
+    memcpy(batch.pData + sizeof(RecordingChunkHeader) + static_cast<size_t>(batch.frameCount) * m_channelCount * sizeof(int16_t), block.pSamples, cbFrames);
+
+    RecordingTrackRecord& record = reinterpret_cast<RecordingTrackRecord*>(batch.pData + m_trackRegionOffset)[batch.trackCount];
+    record.samplePosition = result.samplePosition;
+    record.sampleCount = block.sampleCount;
+    record.sequence = result.sequence;
+    record.beamAngleDegrees = result.beamAngleDegrees;
+    record.sourceAngleDegrees = result.sourceAngleDegrees;
+    record.sourceConfidence = result.sourceConfidence;
+    record.trackedAngleDegrees = result.trackedAngleDegrees;
+
+    batch.frameCount += block.sampleCount;
+    ++batch.trackCount;
+    m_nextSample = result.samplePosition + block.sampleCount;
+
+    m_appendLatency.Record(GetClockNanoseconds() - start);
+
+    return S_OK;
+}
+
+/// Write current batch, wait for I/O thread to finish, append seek index and trailer, and close file.
+/// Producer must have stopped. Does nothing if not open.
+/// <returns>S_OK on success, otherwise first write failure.</returns>
+HRESULT AudioRecorder::Close() {
+    if (!m_bOpen) {
+        return S_OK;
+    }
+
+    if (NULL != m_pFilling) {
+        if (m_pFilling->frameCount > 0) {
+            SealBatch();
+        } else {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_pFilling->state = BatchFree;
+            m_pFilling = NULL;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_bStopping = true;
+    }
+    m_batchSealed.notify_one();
+    m_writer.join();
+    m_bOpen = false;
+
+    HRESULT hr = m_writeResult;
+    if (SUCCEEDED(hr)) {
+        // Index chunk, then trailer pointing back at it
+        UINT indexCount = static_cast<UINT>(m_index.size());
+        UINT cbIndex = indexCount * sizeof(RecordingIndexEntry);
+        std::vector<BYTE> chunk(sizeof(RecordingChunkHeader) + cbIndex + sizeof(RecordingTrailer));
+        RecordingChunkHeader* pHeader = reinterpret_cast<RecordingChunkHeader*>(&chunk[0]);
+        if (indexCount > 0) {
+            memcpy(pHeader + 1, &m_index[0], cbIndex);
+        }
+        FillChunkHeader(pHeader, RecordingChunkIndex, cbIndex, 0, indexCount, indexCount);
+
+        RecordingTrailer* pTrailer = reinterpret_cast<RecordingTrailer*>(&chunk[sizeof(RecordingChunkHeader) + cbIndex]);
+        memcpy(pTrailer->magic, cRecordingTrailerMagic, sizeof(pTrailer->magic));
+        pTrailer->indexOffset = m_fileOffset;
+        pTrailer->frameCount = m_framesWritten;
+        pTrailer->batchCount = indexCount;
+        pTrailer->droppedBlocks = m_droppedBlocks;
+
+        if (1 != fwrite(&chunk[0], chunk.size(), 1, m_pFile)) {
+            hr = E_FAIL;
+        } else {
+            m_bytesWritten.fetch_add(chunk.size(), std::memory_order_relaxed);
+        }
+    }
+
+    if (0 != fclose(m_pFile) && SUCCEEDED(hr)) {
+        hr = E_FAIL;
+    }
+    m_pFile = NULL;
+    Release();
+
+    return hr;
+}
+
+/// Take a free batch buffer for producer, waiting for one if recorder was opened to.
+/// <returns>batch now filling, or NULL if none was free.</returns>
+AudioRecorder::Batch* AudioRecorder::BeginBatch() {
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    for (;;) {
+        for (UINT i = 0; i < cBatchCount; ++i) {
+            Batch& batch = m_batches[i];
+            if (BatchFree == batch.state) {
+                batch.state = BatchFilling;
+                batch.number = m_nextBatchNumber++;
+                return &batch;
+            }
+        }
+
+        if (!m_bWaitWhenFull) {
+            return NULL;
+        }
+
+        m_batchFreed.wait(lock);
+    }
+}
+
+/// Hand filling batch to I/O thread.
+void AudioRecorder::SealBatch() {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_pFilling->state = BatchSealed;
+    }
+    m_batchSealed.notify_one();
+    m_pFilling = NULL;
+}
+
+/// Body of I/O thread.
+void AudioRecorder::WriteLoop() {
+    for (;;) {
+        Batch* pBatch = NULL;
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            for (;;) {
+                // Oldest sealed batch first, so file stays in stream order
+                for (UINT i = 0; i < cBatchCount; ++i) {
+                    Batch& batch = m_batches[i];
+                    if (BatchSealed == batch.state && (NULL == pBatch || batch.number < pBatch->number)) {
+                        pBatch = &batch;
+                    }
+                }
+
+                if (NULL != pBatch || m_bStopping) {
+                    break;
+                }
+
+                m_batchSealed.wait(lock);
+            }
+
+            if (NULL == pBatch) {
+                return;
+            }
+
+            pBatch->state = BatchWriting;
+        }
+
+        WriteBatch(pBatch);
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            pBatch->state = BatchFree;
+        }
+        m_batchFreed.notify_one();
+    }
+}
+
+/// Lay out a sealed batch as chunks and write it. I/O thread only.
+/// <param name="pBatch">batch to write.</param>
+void AudioRecorder::WriteBatch(Batch* pBatch) {
+    // After a failure, batches are only released so producer keeps running; Close reports failure
+    if (FAILED(m_writeResult)) {
+        return;
+    }
+
+    UINT64 start = GetClockNanoseconds();
+
+    BYTE* pData = pBatch->pData;
+    UINT cbFrames = pBatch->frameCount * m_channelCount * sizeof(int16_t);
+    UINT cbTracks = pBatch->trackCount * sizeof(RecordingTrackRecord);
+
+    // PCM chunk at start of batch, padded to chunk alignment
+    memset(pData + sizeof(RecordingChunkHeader) + cbFrames, 0, static_cast<size_t>(RoundUp(cbFrames, cChunkAlignment) - cbFrames));
+    FillChunkHeader(reinterpret_cast<RecordingChunkHeader*>(pData), RecordingChunkPcm, cbFrames, pBatch->firstSample, pBatch->frameCount, pBatch->number);
+
+    // Track chunk right behind PCM; records only ever move down, since batch is at most full
+    UINT trackOffset = static_cast<UINT>(sizeof(RecordingChunkHeader) + RoundUp(cbFrames, cChunkAlignment));
+    memmove(pData + trackOffset + sizeof(RecordingChunkHeader), pData + m_trackRegionOffset, cbTracks);
+    FillChunkHeader(reinterpret_cast<RecordingChunkHeader*>(pData + trackOffset), RecordingChunkTracks, cbTracks, pBatch->firstSample, pBatch->trackCount, pBatch->number);
+
+    // Padding chunk out to alignment, so next batch is written at an aligned offset too
+    UINT padOffset = trackOffset + sizeof(RecordingChunkHeader) + cbTracks;
+    UINT cbBatch = static_cast<UINT>(RoundUp(padOffset + sizeof(RecordingChunkHeader), cRecordingAlignment));
+    UINT cbPadding = cbBatch - padOffset - sizeof(RecordingChunkHeader);
+    memset(pData + padOffset + sizeof(RecordingChunkHeader), 0, cbPadding);
+    FillChunkHeader(reinterpret_cast<RecordingChunkHeader*>(pData + padOffset), RecordingChunkPadding, cbPadding, 0, 0, pBatch->number);
+
+    // Flush hands batch to the operating system, so a crash of this process loses at most the batches in memory
+    if (1 != fwrite(pData, cbBatch, 1, m_pFile) || 0 != fflush(m_pFile)) {
+        m_writeResult = E_FAIL;
+        return;
+    }
+
+    RecordingIndexEntry entry;
+    entry.firstSample = pBatch->firstSample;
+    entry.pcmOffset = m_fileOffset;
+    entry.trackOffset = m_fileOffset + trackOffset;
+    entry.frameCount = pBatch->frameCount;
+    entry.trackCount = pBatch->trackCount;
+    m_index.push_back(entry);
+
+    m_fileOffset += cbBatch;
+    m_framesWritten += pBatch->frameCount;
+    m_bytesWritten.fetch_add(cbBatch, std::memory_order_relaxed);
+
+    m_writeLatency.Record(GetClockNanoseconds() - start);
+}
+
+/// Free batch buffers and close file after a failed Open.
+void AudioRecorder::Release() {
+    if (NULL != m_pFile) {
+        fclose(m_pFile);
+        m_pFile = NULL;
+    }
+
+    for (UINT i = 0; i < cBatchCount; ++i) {
+        delete [] m_batches[i].pAllocation;
+        m_batches[i].pAllocation = NULL;
+        m_batches[i].pData = NULL;
+        m_batches[i].state = BatchFree;
+    }
+}
+
+/// Constructor
+RecordingReader::RecordingReader() :
+    m_pFile(NULL),
+    m_fileSize(0),
+    m_channelCount(0),
+    m_sampleRate(0),
+    m_bRecovered(false),
+    m_frameCount(0),
+    m_droppedBlocks(0) {
+}
+
+/// Destructor. Closes file, if open.
+RecordingReader::~RecordingReader() {
+    Close();
+}
+
+/// Open recording file and load or rebuild its seek index.
+/// <param name="szPath">path of recording file.</param>
+/// <returns>S_OK on success, E_INVALIDARG if file is not a recording, otherwise failure code.</returns>
+HRESULT RecordingReader::Open(const char* szPath) {
+    Close();
+
+    m_pFile = fopen(szPath, "rb");
+    if (NULL == m_pFile) {
+        return E_FAIL;
+    }
+
+    RecordingFileHeader header;
+    if (1 != fread(&header, sizeof(header), 1, m_pFile) ||
+        0 != memcmp(header.magic, cRecordingFileMagic, sizeof(header.magic)) ||
+        0 == header.channelCount || header.channelCount > AudioBlock::MaxChannels || 16 != header.bitsPerSample ||
+        sizeof(RecordingTrackRecord) != header.trackRecordSize || sizeof(RecordingIndexEntry) != header.indexEntrySize) {
+        Close();
+        return E_INVALIDARG;
+    }
+
+    if (!GetFileSize(m_pFile, &m_fileSize)) {
+        Close();
+        return E_FAIL;
+    }
+
+    m_channelCount = header.channelCount;
+    m_sampleRate = header.sampleRate;
+
+    if (FAILED(LoadIndex())) {
+        m_bRecovered = true;
+        m_droppedBlocks = 0;
+        ScanBatches();
+    }
+
+    m_frameCount = 0;
+    for (size_t i = 0; i < m_index.size(); ++i) {
+        m_frameCount += m_index[i].frameCount;
+    }
+
+    return S_OK;
+}
+
+/// Close file, if open.
+void RecordingReader::Close() {
+    if (NULL != m_pFile) {
+        fclose(m_pFile);
+        m_pFile = NULL;
+    }
+
+    m_fileSize = 0;
+    m_channelCount = 0;
+    m_sampleRate = 0;
+    m_bRecovered = false;
+    m_frameCount = 0;
+    m_droppedBlocks = 0;
+    m_index.clear();
+}
+
+/// Find batch holding a stream position.
+/// <param name="samplePosition">index, since start of stream, of a sample.</param>
+/// <returns>index of last batch starting at or before position, or GetBatchCount() if there is none.</returns>
+UINT RecordingReader::FindBatch(UINT64 samplePosition) const {
+    UINT low = 0;
+    UINT high = static_cast<UINT>(m_index.size());
+
+    // First batch starting after position
+    while (low < high) {
+        UINT middle = low + (high - low) / 2;
+        if (m_index[middle].firstSample <= samplePosition) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return (0 == low) ? static_cast<UINT>(m_index.size()) : low - 1;
+}
+
+/// Read PCM of a batch.
+/// <param name="batch">index of batch.</param>
+/// <param name="pFrames">receives GetBatch(batch).frameCount interleaved frames.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT RecordingReader::ReadFrames(UINT batch, int16_t* pFrames) {
+    if (batch >= m_index.size()) {
+        return E_INVALIDARG;
+    }
+
+    RecordingChunkHeader header;
+    HRESULT hr = ReadChunk(m_index[batch].pcmOffset, RecordingChunkPcm, m_channelCount * sizeof(int16_t), &header, pFrames);
+    if (SUCCEEDED(hr) && header.itemCount != m_index[batch].frameCount) {
+        hr = E_FAIL;
+    }
+
+    return hr;
+}
+
+/// Read track records of a batch.
+/// <param name="batch">index of batch.</param>
+/// <param name="pRecords">receives GetBatch(batch).trackCount records.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT RecordingReader::ReadTracks(UINT batch, RecordingTrackRecord* pRecords) {
+    if (batch >= m_index.size()) {
+        return E_INVALIDARG;
+    }
+
+    RecordingChunkHeader header;
+    HRESULT hr = ReadChunk(m_index[batch].trackOffset, RecordingChunkTracks, sizeof(RecordingTrackRecord), &header, pRecords);
+    if (SUCCEEDED(hr) && header.itemCount != m_index[batch].trackCount) {
+        hr = E_FAIL;
+    }
+
+    return hr;
+}
+
+/// Load seek index located by trailer.
+/// <returns>S_OK if file has a valid trailer and index, otherwise failure code.</returns>
+HRESULT RecordingReader::LoadIndex() {
+    if (m_fileSize < cRecordingAlignment + sizeof(RecordingChunkHeader) + sizeof(RecordingTrailer)) {
+        return E_FAIL;
+    }
+
+    RecordingTrailer trailer;
+    if (!SeekFile(m_pFile, m_fileSize - sizeof(trailer)) || 1 != fread(&trailer, sizeof(trailer), 1, m_pFile) ||
+        0 != memcmp(trailer.magic, cRecordingTrailerMagic, sizeof(trailer.magic)) ||
+        trailer.indexOffset + sizeof(RecordingChunkHeader) + static_cast<UINT64>(trailer.batchCount) * sizeof(RecordingIndexEntry) + sizeof(trailer) != m_fileSize) {
+        return E_FAIL;
+    }
+
+    m_index.resize(trailer.batchCount);
+    RecordingChunkHeader header;
+    HRESULT hr = ReadChunk(trailer.indexOffset, RecordingChunkIndex, sizeof(RecordingIndexEntry), &header, m_index.empty() ? NULL : &m_index[0]);
+    if (SUCCEEDED(hr) && header.itemCount != trailer.batchCount) {
+        hr = E_FAIL;
+    }
+
+    if (FAILED(hr)) {
+        m_index.clear();
+        return hr;
+    }
+
+    m_droppedBlocks = trailer.droppedBlocks;
+
+    return S_OK;
+}
+
+/// Rebuild seek index from every complete batch, stopping at first torn or missing chunk.
+void RecordingReader::ScanBatches() {
+    m_index.clear();
+
+    UINT64 offset = cRecordingAlignment;
+    for (;;) {
+        RecordingChunkHeader pcmHeader;
+        RecordingChunkHeader trackHeader;
+        RecordingChunkHeader padHeader;
+
+        if (FAILED(ReadChunk(offset, RecordingChunkPcm, m_channelCount * sizeof(int16_t), &pcmHeader, NULL))) {
+            break;
+        }
+
+        UINT64 trackOffset = offset + sizeof(RecordingChunkHeader) + RoundUp(pcmHeader.payloadSize, cChunkAlignment);
+        if (FAILED(ReadChunk(trackOffset, RecordingChunkTracks, sizeof(RecordingTrackRecord), &trackHeader, NULL)) ||
+            trackHeader.batch != pcmHeader.batch || trackHeader.firstSample != pcmHeader.firstSample) {
+            break;
+        }
+
+        UINT64 padOffset = trackOffset + sizeof(RecordingChunkHeader) + RoundUp(trackHeader.payloadSize, cChunkAlignment);
+        if (FAILED(ReadChunk(padOffset, RecordingChunkPadding, 0, &padHeader, NULL)) || padHeader.batch != pcmHeader.batch) {
+            break;
+        }
+
+        RecordingIndexEntry entry;
+        entry.firstSample = pcmHeader.firstSample;
+        entry.pcmOffset = offset;
+        entry.trackOffset = trackOffset;
+        entry.frameCount = pcmHeader.itemCount;
+        entry.trackCount = trackHeader.itemCount;
+        m_index.push_back(entry);
+
+        offset = padOffset + sizeof(RecordingChunkHeader) + RoundUp(padHeader.payloadSize, cChunkAlignment);
+    }
+}
+
+/// Read a chunk's payload and check it against its header.
+/// <param name="offset">file offset of chunk header.</param>
+/// <param name="type">expected chunk type.</param>
+/// <param name="itemSize">size, in bytes, of each item in payload, or 0 if payload is not made of items.</param>
+/// <param name="pHeader">receives chunk header.</param>
+/// <param name="pPayload">receives payload, or NULL to only check it.</param>
+/// <returns>S_OK if chunk is complete and intact, otherwise failure code.</returns>
+HRESULT RecordingReader::ReadChunk(UINT64 offset, uint32_t type, UINT itemSize, RecordingChunkHeader* pHeader, void* pPayload) {
+    if (NULL == m_pFile) {
+        return E_UNEXPECTED;
+    }
+
+    if (offset + sizeof(RecordingChunkHeader) > m_fileSize || !SeekFile(m_pFile, offset) ||
+        1 != fread(pHeader, sizeof(RecordingChunkHeader), 1, m_pFile)) {
+        return E_FAIL;
+    }
+
+    if (type != pHeader->type || offset + sizeof(RecordingChunkHeader) + pHeader->payloadSize > m_fileSize ||
+        (0 != itemSize && static_cast<UINT64>(pHeader->itemCount) * itemSize != pHeader->payloadSize)) {
+        return E_FAIL;
+    }
+
+    uint32_t hash = cHashSeed;
+    if (NULL != pPayload) {
+        if (pHeader->payloadSize > 0 && 1 != fread(pPayload, pHeader->payloadSize, 1, m_pFile)) {
+            return E_FAIL;
+        }
+        hash = HashBytes(hash, static_cast<const BYTE*>(pPayload), pHeader->payloadSize);
+    } else {
+        BYTE buffer[cScanBufferSize];
+        for (UINT remaining = pHeader->payloadSize; remaining > 0;) {
+            UINT cbRead = (remaining < cScanBufferSize) ? remaining : cScanBufferSize;
+            if (1 != fread(buffer, cbRead, 1, m_pFile)) {
+                return E_FAIL;
+            }
+            hash = HashBytes(hash, buffer, cbRead);
+            remaining -= cbRead;
+        }
+    }
+
+    return (hash == pHeader->checksum) ? S_OK : E_FAIL;
+}
+
+/// Convert track records of a recording file into CSV, one line per recorded block.
+/// <param name="szPath">path of recording file.</param>
+/// <param name="pOutput">stream that receives CSV.</param>
+/// <returns>S_OK on success, E_INVALIDARG if file is not a recording, otherwise failure code.</returns>
+HRESULT DecodeRecordingFile(const char* szPath, FILE* pOutput) {
+    RecordingReader reader;
+    HRESULT hr = reader.Open(szPath);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    fprintf(pOutput, "sample_position,sample_count,sequence,beam_deg,source_deg,confidence,tracked_deg\n");
+
+    std::vector<RecordingTrackRecord> records;
+    for (UINT batch = 0; batch < reader.GetBatchCount(); ++batch) {
+        records.resize(reader.GetBatch(batch).trackCount);
+        if (records.empty()) {
+            continue;
+        }
+
+        hr = reader.ReadTracks(batch, &records[0]);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        for (size_t i = 0; i < records.size(); ++i) {
+            const RecordingTrackRecord& record = records[i];
+            fprintf(pOutput, "%llu,%u,%u,%.2f,%.2f,%.3f,%.2f\n",
+                static_cast<unsigned long long>(record.samplePosition),
+                record.sampleCount,
+                record.sequence,
+                record.beamAngleDegrees,
+                record.sourceAngleDegrees,
+                record.sourceConfidence,
+                record.trackedAngleDegrees);
+        }
+    }
+
+    return S_OK;
+}
@@ -0,0 +1,345 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "AudioBlock.h"
+#include "AudioPipeline.h"
+#include "LatencyHistogram.h"
+
+// For FILE
+#include <stdio.h>
+
+// For byte count read while I/O thread writes
+#include <atomic>
+
+// For handing batches to I/O thread
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// For seek index
+#include <vector>
+
+/// Kinds of chunk in a recording file, stored as four character codes.
+enum RecordingChunkType {
+    // Interleaved 16-bit PCM frames. itemCount: number of frames.
+    RecordingChunkPcm = 0x204D4350,         // 'PCM '
+
+    // RecordingTrackRecord per recorded block. itemCount: number of records.
+    RecordingChunkTracks = 0x4B415254,      // 'TRAK'
+
+    // Filler that brings next batch to a multiple of cRecordingAlignment. itemCount: 0.
+    RecordingChunkPadding = 0x20444150,     // 'PAD '
+
+    // RecordingIndexEntry per batch, written when recording is closed. itemCount: number of entries.
+    RecordingChunkIndex = 0x58444E49        // 'INDX'
+};
+
+// File offset and size multiple of every batch written, and offset of first one.
+static const UINT           cRecordingAlignment = 4096;
+
+/// Header at start of a recording file, padded with zeros to cRecordingAlignment.
+struct RecordingFileHeader {
+    char                    magic[8];
+    uint32_t                sampleRate;
+    uint16_t                channelCount;
+    uint16_t                bitsPerSample;
+    uint32_t                trackRecordSize;
+    uint32_t                indexEntrySize;
+};
+
+/// Header of every chunk. Chunks start at multiples of 8 bytes; payload follows header,
+/// padded to a multiple of 8 bytes.
+struct RecordingChunkHeader {
+    // One of RecordingChunkType.
+    uint32_t                type;
+
+    // Size of payload, in bytes, before padding.
+    uint32_t                payloadSize;
+
+    // Index, since start of stream, of first sample chunk covers; 0 for padding and index.
+    UINT64                  firstSample;
+
+    // Number of frames or records in payload.
+    uint32_t                itemCount;
+
+    // FNV-1a hash of payload, so chunks torn by a crash are recognized.
+    uint32_t                checksum;
+
+    // Number of batch chunk belongs to, counting from 0.
+    UINT64                  batch;
+};
+
+/// Angles a recorded block was captured and processed with, time aligned with PCM by sample position.
+struct RecordingTrackRecord {
+    // Index, since start of stream, of first sample in block, and number of samples in block.
+    UINT64                  samplePosition;
+    uint32_t                sampleCount;
+
+    // Sequence number of block.
+    uint32_t                sequence;
+
+    // As in AudioPipelineResult.
+    float                   beamAngleDegrees;
+    float                   sourceAngleDegrees;
+    float                   sourceConfidence;
+    float                   trackedAngleDegrees;
+};
+
+/// Seek index entry locating one batch.
+struct RecordingIndexEntry {
+    // Index, since start of stream, of first frame in batch.
+    UINT64                  firstSample;
+
+    // File offsets of batch's PCM and track chunk headers.
+    UINT64                  pcmOffset;
+    UINT64                  trackOffset;
+
+    // Number of frames and track records in batch.
+    uint32_t                frameCount;
+    uint32_t                trackCount;
+};
+
+/// Last bytes of a recording file closed normally, locating its seek index.
+struct RecordingTrailer {
+    char                    magic[8];
+    UINT64                  indexOffset;
+    UINT64                  frameCount;
+    uint32_t                batchCount;
+    uint32_t                droppedBlocks;
+};
+
+/// Records captured blocks and their angles to a chunked file without blocking its caller on disk.
+/// Blocks are copied into one of two batch buffers, each holding a fixed span of audio; a
+/// full batch is handed to a background I/O thread, which lays it out as a PCM chunk, a track
+/// chunk and padding, and writes it with a single unbuffered write at an aligned offset while
+/// the other buffer fills. When both buffers are busy, blocks are dropped and counted unless
+/// recorder was opened to wait, as suits offline processing.
+/// Every batch is self-describing and checksummed, so a file cut short by a crash can be read
+/// up to its last complete batch; closing recorder appends a seek index and a trailer.
+/// Append is for one producer thread at a time. Buffers are allocated by Open; Append performs
+/// no allocations.
+class AudioRecorder {
+public:
+    // Shortest and longest span of audio, in milliseconds, one batch holds. Shortest still fits largest block.
+    static const UINT       cMinBatchMilliseconds = 50;
+    static const UINT       cMaxBatchMilliseconds = 60000;
+
+    // Batch span Open is usually given: at most about a second of audio is lost in a crash.
+    static const UINT       cDefaultBatchMilliseconds = 1000;
+
+    /// Constructor
+    AudioRecorder();
+
+    /// Destructor. Closes file, if open.
+    ~AudioRecorder();
+
+    /// Create recording file, write its header and start I/O thread.
+    /// <param name="szPath">path of file to create, replacing any existing file.</param>
+    /// <param name="channelCount">number of interleaved channels in blocks, from 1 to AudioBlock::MaxChannels.</param>
+    /// <param name="sampleRate">sample rate, in Hz.</param>
+    /// <param name="batchMilliseconds">span of audio per batch, from cMinBatchMilliseconds to cMaxBatchMilliseconds.</param>
+    /// <param name="bWaitWhenFull">true to wait for a free buffer when both are busy; false to drop block.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range, E_UNEXPECTED if already open, otherwise failure code.</returns>
+    HRESULT                 Open(const char* szPath, WORD channelCount, UINT sampleRate, UINT batchMilliseconds, bool bWaitWhenFull);
+
+    /// Copy a processed block into current batch.
+    /// <param name="block">captured audio block.</param>
+    /// <param name="result">pipeline's results for block, giving its stream position and angles.</param>
+    /// <returns>S_OK if block was recorded, S_FALSE if it was dropped, E_INVALIDARG if channel count does not match, E_UNEXPECTED if not open.</returns>
+    HRESULT                 Append(const AudioBlock& block, const AudioPipelineResult& result);
+
+    /// Write current batch, wait for I/O thread to finish, append seek index and trailer, and close file.
+    /// Producer must have stopped. Does nothing if not open.
+    /// <returns>S_OK on success, otherwise first write failure.</returns>
+    HRESULT                 Close();
+
+    /// Whether a file is open for recording.
+    bool                    IsOpen() const { return m_bOpen; }
+
+    /// Number of blocks dropped because both buffers were busy.
+    uint32_t                GetDroppedCount() const { return m_droppedBlocks; }
+
+    /// Number of bytes written to file, including headers and padding.
+    UINT64                  GetBytesWritten() const { return m_bytesWritten.load(std::memory_order_relaxed); }
+
+    /// Duration of each Append call, recorded by producer.
+    const LatencyHistogram& GetAppendLatency() const { return m_appendLatency; }
+
+    /// Duration of each batch write and flush, recorded by I/O thread.
+    const LatencyHistogram& GetWriteLatency() const { return m_writeLatency; }
+
+private:
+    // Number of batch buffers: one filling while the other is written.
+    static const UINT       cBatchCount = 2;
+
+    /// Who currently owns a batch buffer.
+    enum BatchState {
+        BatchFree,
+        BatchFilling,
+        BatchSealed,
+        BatchWriting
+    };
+
+    /// One batch buffer. PCM is copied in after room for its chunk header, track records into their own
+    /// region further on; I/O thread moves records up behind PCM before writing.
+    struct Batch {
+        BYTE*               pAllocation;
+        BYTE*               pData;
+        BatchState          state;
+        UINT64              number;
+        UINT64              firstSample;
+        UINT                frameCount;
+        UINT                trackCount;
+    };
+
+    FILE*                   m_pFile;
+    bool                    m_bOpen;
+    bool                    m_bWaitWhenFull;
+    WORD                    m_channelCount;
+    UINT                    m_frameCapacity;
+    UINT                    m_trackCapacity;
+
+    // Offset, in batch buffer, of track record region.
+    UINT                    m_trackRegionOffset;
+
+    Batch                   m_batches[cBatchCount];
+
+    // Batch producer is filling, or NULL. Producer only.
+    Batch*                  m_pFilling;
+
+    // Stream position next block must start at to extend filling batch. Producer only.
+    UINT64                  m_nextSample;
+
+    // Number given to next batch started. Producer only.
+    UINT64                  m_nextBatchNumber;
+    uint32_t                m_droppedBlocks;
+    LatencyHistogram        m_appendLatency;
+
+    // Guards batch states and stop flag.
+    std::mutex              m_lock;
+    std::condition_variable m_batchSealed;
+    std::condition_variable m_batchFreed;
+    bool                    m_bStopping;
+    std::thread             m_writer;
+
+    // Written by I/O thread only, until it is joined.
+    std::vector<RecordingIndexEntry> m_index;
+    UINT64                  m_fileOffset;
+    UINT64                  m_framesWritten;
+    LatencyHistogram        m_writeLatency;
+    HRESULT                 m_writeResult;
+    std::atomic<UINT64>     m_bytesWritten;
+
+    /// Take a free batch buffer for producer, waiting for one if recorder was opened to.
+    /// <returns>batch now filling, or NULL if none was free.</returns>
+    Batch*                  BeginBatch();
+
+    /// Hand filling batch to I/O thread.
+    void                    SealBatch();
+
+    /// Body of I/O thread.
+    void                    WriteLoop();
+
+    /// Lay out a sealed batch as chunks and write it. I/O thread only.
+    /// <param name="pBatch">batch to write.</param>
+    void                    WriteBatch(Batch* pBatch);
+
+    /// Free batch buffers and close file after a failed Open.
+    void                    Release();
+
+    AudioRecorder(const AudioRecorder&);
+    AudioRecorder& operator=(const AudioRecorder&);
+};
+
+/// Reads a recording file written by AudioRecorder, using its seek index, or when it has none
+/// because recording was cut short, by scanning its chunks up to the last complete batch.
+class RecordingReader {
+public:
+    /// Constructor
+    RecordingReader();
+
+    /// Destructor. Closes file, if open.
+    ~RecordingReader();
+
+    /// Open recording file and load or rebuild its seek index.
+    /// <param name="szPath">path of recording file.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if file is not a recording, otherwise failure code.</returns>
+    HRESULT                 Open(const char* szPath);
+
+    /// Close file, if open.
+    void                    Close();
+
+    /// Whether index was rebuilt by scanning, because file has no valid trailer.
+    bool                    IsRecovered() const { return m_bRecovered; }
+
+    /// Number of interleaved channels in recorded PCM.
+    WORD                    GetChannelCount() const { return m_channelCount; }
+
+    /// Sample rate of recorded PCM, in Hz.
+    UINT                    GetSampleRate() const { return m_sampleRate; }
+
+    /// Number of complete batches in file.
+    UINT                    GetBatchCount() const { return static_cast<UINT>(m_index.size()); }
+
+    /// Location and size of a batch.
+    /// <param name="batch">index of batch.</param>
+    const RecordingIndexEntry& GetBatch(UINT batch) const { return m_index[batch]; }
+
+    /// Total number of frames in complete batches.
+    UINT64                  GetFrameCount() const { return m_frameCount; }
+
+    /// Number of blocks recorder dropped, as recorded in trailer; 0 for recovered files.
+    uint32_t                GetDroppedCount() const { return m_droppedBlocks; }
+
+    /// Find batch holding a stream position.
+    /// <param name="samplePosition">index, since start of stream, of a sample.</param>
+    /// <returns>index of last batch starting at or before position, or GetBatchCount() if there is none.</returns>
+    UINT                    FindBatch(UINT64 samplePosition) const;
+
+    /// Read PCM of a batch.
+    /// <param name="batch">index of batch.</param>
+    /// <param name="pFrames">receives GetBatch(batch).frameCount interleaved frames.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 ReadFrames(UINT batch, int16_t* pFrames);
+
+    /// Read track records of a batch.
+    /// <param name="batch">index of batch.</param>
+    /// <param name="pRecords">receives GetBatch(batch).trackCount records.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 ReadTracks(UINT batch, RecordingTrackRecord* pRecords);
+
+private:
+    FILE*                   m_pFile;
+    UINT64                  m_fileSize;
+    WORD                    m_channelCount;
+    UINT                    m_sampleRate;
+    bool                    m_bRecovered;
+    UINT64                  m_frameCount;
+    uint32_t                m_droppedBlocks;
+    std::vector<RecordingIndexEntry> m_index;
+
+    /// Load seek index located by trailer.
+    /// <returns>S_OK if file has a valid trailer and index, otherwise failure code.</returns>
+    HRESULT                 LoadIndex();
+
+    /// Rebuild seek index from every complete batch, stopping at first torn or missing chunk.
+    void                    ScanBatches();
+
+    /// Read a chunk's payload and check it against its header.
+    /// <param name="offset">file offset of chunk header.</param>
+    /// <param name="type">expected chunk type.</param>
+    /// <param name="itemSize">size, in bytes, of each item in payload, or 0 if payload is not made of items.</param>
+    /// <param name="pHeader">receives chunk header.</param>
+    /// <param name="pPayload">receives payload, or NULL to only check it.</param>
+    /// <returns>S_OK if chunk is complete and intact, otherwise failure code.</returns>
+    HRESULT                 ReadChunk(UINT64 offset, uint32_t type, UINT itemSize, RecordingChunkHeader* pHeader, void* pPayload);
+
+    RecordingReader(const RecordingReader&);
+    RecordingReader& operator=(const RecordingReader&);
+};
+
+/// Convert track records of a recording file into CSV, one line per recorded block.
+/// <param name="szPath">path of recording file.</param>
+/// <param name="pOutput">stream that receives CSV.</param>
+/// <returns>S_OK on success, E_INVALIDARG if file is not a recording, otherwise failure code.</returns>
+HRESULT DecodeRecordingFile(const char* szPath, FILE* pOutput);
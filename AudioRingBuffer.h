@@ -0,0 +1,112 @@
+﻿#pragma once
+
+// For NULL and size_t
+#include <stddef.h>
+
+// For fixed width integer types
+#include <stdint.h>
+
+// For lock-free head/tail indices
+#include <atomic>
+
+/// Lock-free single-producer/single-consumer ring of fixed capacity.
+/// Exactly one thread may write (BeginWrite/EndWrite) while exactly one other
+/// thread reads (BeginRead/EndRead). Elements are filled and consumed in place
+/// so large audio blocks are never copied through the ring.
+/// Capacity must be a power of two.
+template <class T, uint32_t Capacity>
+class AudioRingBuffer {
+public:
+    AudioRingBuffer() :
+        m_writeIndex(0),
+        m_readIndex(0),
+        m_overrunCount(0),
+        m_underrunCount(0) {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Ring capacity must be a power of two");
+    }
+
+    /// Get the next free slot to fill. Producer thread only.
+    /// <returns>slot to fill, or NULL if ring is full.</returns>
+    T* BeginWrite() {
+        uint32_t writeIndex = m_writeIndex.load(std::memory_order_relaxed);
+        if (writeIndex - m_readIndex.load(std::memory_order_acquire) >= Capacity) {
+            return NULL;
+        }
+
+        return &m_items[writeIndex & (Capacity - 1)];
+    }
+
+    /// Publish the slot previously returned by BeginWrite. Producer thread only.
+    void EndWrite() {
+        m_writeIndex.store(m_writeIndex.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /// Get the oldest published slot. Consumer thread only.
+    /// <returns>slot to consume, or NULL if ring is empty.</returns>
+    T* BeginRead() {
+        uint32_t readIndex = m_readIndex.load(std::memory_order_relaxed);
+        if (readIndex == m_writeIndex.load(std::memory_order_acquire)) {
+            return NULL;
+        }
+
+        return &m_items[readIndex & (Capacity - 1)];
+    }
+
+    /// Release the slot previously returned by BeginRead back to producer. Consumer thread only.
+    void EndRead() {
+        m_readIndex.store(m_readIndex.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /// Record that producer had to drop data because ring was full. Producer thread only.
+    void NoteOverrun() {
+        m_overrunCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Record that consumer wanted data but ring was empty. Consumer thread only.
+    void NoteUnderrun() {
+        m_underrunCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Number of published slots not yet consumed. Safe to call from any thread.
+    uint32_t GetCount() const {
+        return m_writeIndex.load(std::memory_order_acquire) - m_readIndex.load(std::memory_order_acquire);
+    }
+
+    /// Number of slots in ring.
+    uint32_t GetCapacity() const {
+        return Capacity;
+    }
+
+    /// Number of times producer found ring full and had to drop data.
+    uint32_t GetOverrunCount() const {
+        return m_overrunCount.load(std::memory_order_relaxed);
+    }
+
+    /// Number of times consumer found ring empty when it expected data.
+    uint32_t GetUnderrunCount() const {
+        return m_underrunCount.load(std::memory_order_relaxed);
+    }
+
+private:
+    // Size of padding used to keep producer and consumer indices on separate cache lines.
+    static const size_t cCacheLineSize = 64;
+
+    // Storage for ring elements.
+    T                       m_items[Capacity];
+
+    // Index of next slot producer will write. Only ever incremented by producer.
+    std::atomic<uint32_t>   m_writeIndex;
+    char                    m_writePadding[cCacheLineSize - sizeof(std::atomic<uint32_t>)];
+
+    // Index of next slot consumer will read. Only ever incremented by consumer.
+    std::atomic<uint32_t>   m_readIndex;
+    char                    m_readPadding[cCacheLineSize - sizeof(std::atomic<uint32_t>)];
+
+    // Diagnostic counters used to size ring for expected load.
+    std::atomic<uint32_t>   m_overrunCount;
+    std::atomic<uint32_t>   m_underrunCount;
+
+    // Ring is shared between threads by address and must not be copied.
+    AudioRingBuffer(const AudioRingBuffer&);
+    AudioRingBuffer& operator=(const AudioRingBuffer&);
+};
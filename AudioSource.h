@@ -0,0 +1,82 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "AudioBlock.h"
+#include "AudioFormat.h"
+
+// For real-time pacing of replayed sources
+#include <chrono>
+
+/// Producer of PCM audio plus beam/sound source angle samples.
+/// Implementations wrap a live Kinect sensor or a recorded/synthetic stream so
+/// capture and processing code can run without knowing where audio comes from.
+/// All sources produce audio in the format described in AudioFormat.h, except that
+/// raw microphone array sources produce several interleaved channels.
+class AudioSource {
+public:
+    virtual ~AudioSource() {}
+
+    /// Read next available chunk of audio.
+    /// <param name="pBuffer">buffer that receives PCM data. Its length is set to amount of data produced.</param>
+    /// <param name="pAngles">receives angles current at time audio was produced.</param>
+    /// <param name="pbMoreAvailable">set to true if more audio can be read immediately.</param>
+    /// <returns>S_OK if audio was produced, S_FALSE if none is available right now, otherwise failure code.</returns>
+    virtual HRESULT Read(IMediaBuffer* pBuffer, AudioAngles* pAngles, bool* pbMoreAvailable) = 0;
+
+    /// Whether source has reached the end of its stream and will never produce more audio.
+    /// Live sources never finish.
+    virtual bool IsFinished() const = 0;
+
+    /// Number of interleaved channels in every frame produced by Read.
+    virtual WORD GetChannelCount() const { return AudioChannels; }
+
+    /// Let source skip querying beam and sound source angles while nobody is listening for them.
+    /// Sources whose angles cost nothing to produce ignore this.
+    /// <param name="bEnabled">false to let following reads report the last angles queried.</param>
+    virtual void SetAngleQueriesEnabled(bool bEnabled) { (void)bEnabled; }
+};
+
+/// Limits replayed/synthetic sources to real-time rate when they feed an interactive display.
+/// Headless processing leaves pacing disabled so sources run as fast as the CPU allows.
+class AudioSourcePacer {
+public:
+    /// Constructor
+    /// <param name="samplesPerSecond">rate at which samples become due.</param>
+    /// <param name="bEnabled">false to let every sample be due immediately.</param>
+    AudioSourcePacer(DWORD samplesPerSecond, bool bEnabled) :
+        m_samplesPerSecond(samplesPerSecond),
+        m_bEnabled(bEnabled),
+        m_bStarted(false) {
+    }
+
+    /// Number of samples that may be produced now, given how many have been produced so far.
+    /// <param name="samplesProduced">samples already produced by source.</param>
+    /// <param name="samplesWanted">samples source would like to produce.</param>
+    /// <returns>number of samples, at most samplesWanted, that are due.</returns>
+    UINT64 GetSamplesDue(UINT64 samplesProduced, UINT64 samplesWanted) {
+        if (!m_bEnabled) {
+            return samplesWanted;
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (!m_bStarted) {
+            m_start = now;
+            m_bStarted = true;
+        }
+
+        UINT64 elapsedMicroseconds = static_cast<UINT64>(std::chrono::duration_cast<std::chrono::microseconds>(now - m_start).count());
+        UINT64 samplesElapsed = elapsedMicroseconds * m_samplesPerSecond / 1000000;
+        if (samplesElapsed <= samplesProduced) {
+            return 0;
+        }
+
+        UINT64 samplesDue = samplesElapsed - samplesProduced;
+        return (samplesDue < samplesWanted) ? samplesDue : samplesWanted;
+    }
+
+private:
+    DWORD                                   m_samplesPerSecond;
+    bool                                    m_bEnabled;
+    bool                                    m_bStarted;
+    std::chrono::steady_clock::time_point   m_start;
+};
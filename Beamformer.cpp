@@ -0,0 +1,208 @@
+﻿#include "Beamformer.h"
+
+// For M_PI, sin and cos
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+/// Filter one channel and add it to output: pOutput[i] += sum over j of pTaps[j] * pInput[i - j].
+static void FirAccumulateScalar(float* pOutput, const float* pInput, const float* pTaps, UINT tapCount, UINT count) {
+    for (UINT i = 0; i < count; ++i) {
+        float acc = pOutput[i];
+        for (UINT j = 0; j < tapCount; ++j) {
+            acc += pTaps[j] * *(pInput + i - j);
+        }
+        pOutput[i] = acc;
+    }
+}
+
+#ifdef AUDIO_SIMD_X86
+
+/// SSE2 version of FirAccumulateScalar, four outputs at a time.
+AUDIO_TARGET_SSE2
+static void FirAccumulateSse2(float* pOutput, const float* pInput, const float* pTaps, UINT tapCount, UINT count) {
+    UINT i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 acc = _mm_loadu_ps(pOutput + i);
+        for (UINT j = 0; j < tapCount; ++j) {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(pTaps[j]), _mm_loadu_ps(pInput + i - j)));
+        }
+        _mm_storeu_ps(pOutput + i, acc);
+    }
+
+    FirAccumulateScalar(pOutput + i, pInput + i, pTaps, tapCount, count - i);
+}
+
+/// AVX2 version of FirAccumulateScalar, eight outputs at a time with fused multiply-add.
+AUDIO_TARGET_AVX2
+static void FirAccumulateAvx2(float* pOutput, const float* pInput, const float* pTaps, UINT tapCount, UINT count) {
+    UINT i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 acc = _mm256_loadu_ps(pOutput + i);
+        for (UINT j = 0; j < tapCount; ++j) {
+            acc = _mm256_fmadd_ps(_mm256_set1_ps(pTaps[j]), _mm256_loadu_ps(pInput + i - j), acc);
+        }
+        _mm256_storeu_ps(pOutput + i, acc);
+    }
+
+    FirAccumulateScalar(pOutput + i, pInput + i, pTaps, tapCount, count - i);
+}
+
+#endif
+
+/// Filter one channel and add it to output, using requested instruction set.
+static void FirAccumulate(SimdLevel level, float* pOutput, const float* pInput, const float* pTaps, UINT tapCount, UINT count) {
+#ifdef AUDIO_SIMD_X86
+    if (SimdLevelAvx2 == level) {
+        FirAccumulateAvx2(pOutput, pInput, pTaps, tapCount, count);
+        return;
+    }
+
+    if (SimdLevelSse2 == level) {
+        FirAccumulateSse2(pOutput, pInput, pTaps, tapCount, count);
+        return;
+    }
+#else
+    (void)level;
+#endif
+
+    FirAccumulateScalar(pOutput, pInput, pTaps, tapCount, count);
+}
+
+/// Constructor
+DelayAndSumBeamformer::DelayAndSumBeamformer() :
+    m_microphoneCount(0),
+    m_beamCount(0),
+    m_maxBlockFrames(0),
+    m_latencyFrames(0),
+    m_level(SimdLevelScalar),
+    m_historyFrames(0),
+    m_channelStride(0),
+    m_pChannelData(NULL) {
+}
+
+/// Destructor
+DelayAndSumBeamformer::~DelayAndSumBeamformer() {
+    delete [] m_pChannelData;
+}
+
+/// Configure array and beams, and allocate working memory.
+/// <param name="geometry">microphone positions, in capture channel order.</param>
+/// <param name="samplesPerSecond">sample rate of captured audio.</param>
+/// <param name="pBeamAngles">direction of each beam, in degrees.</param>
+/// <param name="beamCount">number of beams, at most MaxBeams.</param>
+/// <param name="maxBlockFrames">largest number of frames that will be passed to Process.</param>
+/// <param name="level">instruction set used by filter kernel.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT DelayAndSumBeamformer::Initialize(const MicrophoneArrayGeometry& geometry, DWORD samplesPerSecond, const float* pBeamAngles, UINT beamCount, UINT maxBlockFrames, SimdLevel level) {
+    if (geometry.microphoneCount < 2 || geometry.microphoneCount > MicrophoneArrayGeometry::MaxMicrophones ||
+        0 == beamCount || beamCount > MaxBeams || 0 == maxBlockFrames || 0 == samplesPerSecond) {
+        return E_INVALIDARG;
+    }
+
+    m_microphoneCount = geometry.microphoneCount;
+    m_beamCount = beamCount;
+    m_maxBlockFrames = maxBlockFrames;
+    m_level = level;
+
+    // Common delay added to every channel so all per-microphone delays stay causal
+    float maxOffset = 0.0f;
+    for (UINT m = 0; m < m_microphoneCount; ++m) {
+        float offset = fabsf(geometry.positions[m]) * samplesPerSecond / SpeedOfSound;
+        maxOffset = (offset > maxOffset) ? offset : maxOffset;
+    }
+
+    const int halfTaps = static_cast<int>(cFilterTaps / 2);
+    float baseDelay = ceilf(maxOffset) + halfTaps;
+    m_latencyFrames = static_cast<UINT>(baseDelay);
+
+    for (UINT b = 0; b < m_beamCount; ++b) {
+        m_beamAngles[b] = pBeamAngles[b];
+        float sinAngle = static_cast<float>(sin(pBeamAngles[b] * M_PI / 180.0));
+
+        for (UINT m = 0; m < m_microphoneCount; ++m) {
+            // Microphones the wavefront reaches early are delayed more, so all channels line up
+            float delay = baseDelay + geometry.positions[m] * sinAngle * samplesPerSecond / SpeedOfSound;
+            float wholeDelay = floorf(delay);
+            float fraction = delay - wholeDelay;
+            m_delayFrames[b][m] = static_cast<UINT>(wholeDelay);
+
+            // Hann-windowed sinc interpolator centered on the fractional delay. Tap j is
+            // applied to the sample (j - halfTaps + 1) frames before the whole-sample delay.
+            float sum = 0.0f;
+            for (UINT j = 0; j < cFilterTaps; ++j) {
+                double t = static_cast<double>(static_cast<int>(j) - halfTaps + 1) - fraction;
+                double sinc = (fabs(t) < 1e-9) ? 1.0 : sin(M_PI * t) / (M_PI * t);
+                double window = 0.5 * (1.0 + cos(M_PI * t / halfTaps));
+                m_taps[b][m][j] = static_cast<float>(sinc * window);
+                sum += m_taps[b][m][j];
+            }
+
+            // Unity gain at DC, then average across microphones
+            for (UINT j = 0; j < cFilterTaps; ++j) {
+                m_taps[b][m][j] /= sum * m_microphoneCount;
+            }
+        }
+    }
+
+    // Oldest sample any filter reaches back to from the first frame of a block
+    m_historyFrames = static_cast<UINT>(ceilf(baseDelay + maxOffset)) + cFilterTaps;
+    m_channelStride = (m_historyFrames + m_maxBlockFrames + 15) & ~15u;
+
+    delete [] m_pChannelData;
+    m_pChannelData = new float[static_cast<size_t>(m_channelStride) * m_microphoneCount];
+    Reset();
+
+    return S_OK;
+}
+
+/// Forget audio history carried between blocks.
+void DelayAndSumBeamformer::Reset() {
+    if (NULL != m_pChannelData) {
+        memset(m_pChannelData, 0, sizeof(float) * m_channelStride * m_microphoneCount);
+    }
+}
+
+/// Steer all beams over a block of interleaved 16-bit PCM.
+/// <param name="pInterleaved">frames holding one sample per microphone.</param>
+/// <param name="frameCount">number of frames, at most maxBlockFrames.</param>
+/// <param name="ppBeamOutputs">one array of frameCount samples per beam that receives its output.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT DelayAndSumBeamformer::Process(const int16_t* pInterleaved, UINT frameCount, float* const* ppBeamOutputs) {
+    if (NULL == m_pChannelData) {
+        return E_UNEXPECTED;
+    }
+
+    if (frameCount > m_maxBlockFrames) {
+        return E_INVALIDARG;
+    }
+
+    // Deinterleave new frames behind each channel's history
+    for (UINT m = 0; m < m_microphoneCount; ++m) {
+        float* pChannel = m_pChannelData + m * m_channelStride + m_historyFrames;
+        const int16_t* pSample = pInterleaved + m;
+        for (UINT i = 0; i < frameCount; ++i, pSample += m_microphoneCount) {
+            pChannel[i] = *pSample;
+        }
+    }
+
+    const UINT halfTaps = cFilterTaps / 2;
+
+    for (UINT b = 0; b < m_beamCount; ++b) {
+        float* pOutput = ppBeamOutputs[b];
+        memset(pOutput, 0, frameCount * sizeof(float));
+
+        for (UINT m = 0; m < m_microphoneCount; ++m) {
+            // Input sample aligned with first output sample for tap 0
+            const float* pInput = m_pChannelData + m * m_channelStride + m_historyFrames - m_delayFrames[b][m] + halfTaps - 1;
+            FirAccumulate(m_level, pOutput, pInput, m_taps[b][m], cFilterTaps, frameCount);
+        }
+    }
+
+    // Keep most recent frames as history for next block
+    for (UINT m = 0; m < m_microphoneCount; ++m) {
+        float* pChannel = m_pChannelData + m * m_channelStride;
+        memmove(pChannel, pChannel + frameCount, m_historyFrames * sizeof(float));
+    }
+
+    return S_OK;
+}
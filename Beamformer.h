@@ -0,0 +1,84 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "MicrophoneArray.h"
+#include "Simd.h"
+
+/// Software delay-and-sum beamformer for a linear microphone array.
+/// Steers several beams at once over raw multichannel capture: every microphone
+/// signal is delayed by a fractional number of samples with a short windowed-sinc
+/// filter so sound from the beam's direction lines up, then the channels are averaged.
+/// All memory is allocated by Initialize; Process performs no allocations.
+class DelayAndSumBeamformer {
+public:
+    // Largest number of beams that can be steered at once.
+    static const UINT       MaxBeams = 16;
+
+    // Number of taps in each fractional delay filter.
+    static const UINT       cFilterTaps = 8;
+
+    /// Constructor
+    DelayAndSumBeamformer();
+
+    /// Destructor
+    ~DelayAndSumBeamformer();
+
+    /// Configure array and beams, and allocate working memory.
+    /// <param name="geometry">microphone positions, in capture channel order.</param>
+    /// <param name="samplesPerSecond">sample rate of captured audio.</param>
+    /// <param name="pBeamAngles">direction of each beam, in degrees.</param>
+    /// <param name="beamCount">number of beams, at most MaxBeams.</param>
+    /// <param name="maxBlockFrames">largest number of frames that will be passed to Process.</param>
+    /// <param name="level">instruction set used by filter kernel.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 Initialize(const MicrophoneArrayGeometry& geometry, DWORD samplesPerSecond, const float* pBeamAngles, UINT beamCount, UINT maxBlockFrames, SimdLevel level);
+
+    /// Forget audio history carried between blocks.
+    void                    Reset();
+
+    /// Steer all beams over a block of interleaved 16-bit PCM.
+    /// <param name="pInterleaved">frames holding one sample per microphone.</param>
+    /// <param name="frameCount">number of frames, at most maxBlockFrames.</param>
+    /// <param name="ppBeamOutputs">one array of frameCount samples per beam that receives its output.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 Process(const int16_t* pInterleaved, UINT frameCount, float* const* ppBeamOutputs);
+
+    /// Number of beams being steered.
+    UINT                    GetBeamCount() const { return m_beamCount; }
+
+    /// Number of microphones expected in each frame.
+    UINT                    GetMicrophoneCount() const { return m_microphoneCount; }
+
+    /// Direction, in degrees, of a beam.
+    float                   GetBeamAngle(UINT beam) const { return m_beamAngles[beam]; }
+
+    /// Number of frames by which beam outputs lag input.
+    UINT                    GetLatencyFrames() const { return m_latencyFrames; }
+
+private:
+    UINT                    m_microphoneCount;
+    UINT                    m_beamCount;
+    UINT                    m_maxBlockFrames;
+    UINT                    m_latencyFrames;
+    SimdLevel               m_level;
+
+    // Number of past frames kept in front of each new block so delayed taps can reach back.
+    UINT                    m_historyFrames;
+
+    // Distance, in floats, between start of consecutive channels in m_pChannelData.
+    UINT                    m_channelStride;
+
+    // Per microphone float samples: history followed by current block.
+    float*                  m_pChannelData;
+
+    // Whole-sample part of each beam/microphone delay.
+    UINT                    m_delayFrames[MaxBeams][MicrophoneArrayGeometry::MaxMicrophones];
+
+    // Fractional delay filter of each beam/microphone, already scaled to average channels.
+    float                   m_taps[MaxBeams][MicrophoneArrayGeometry::MaxMicrophones][cFilterTaps];
+
+    float                   m_beamAngles[MaxBeams];
+
+    DelayAndSumBeamformer(const DelayAndSumBeamformer&);
+    DelayAndSumBeamformer& operator=(const DelayAndSumBeamformer&);
+};
@@ -0,0 +1,70 @@
+﻿#include "BroadcastAudioSource.h"
+
+/// Constructor
+BroadcastAudioSource::BroadcastAudioSource() :
+    m_bFinished(false) {
+}
+
+/// Attach to a channel.
+/// <param name="szName">name channel was opened with.</param>
+/// <returns>S_OK on success, E_INVALIDARG if channel is not at AudioSamplesPerSecond, otherwise failure code from BroadcastReader::Open.</returns>
+HRESULT BroadcastAudioSource::Open(const char* szName) {
+    HRESULT hr = m_reader.Open(szName);
+    if (SUCCEEDED(hr) && AudioSamplesPerSecond != m_reader.GetSampleRate()) {
+        m_reader.Close();
+        hr = E_INVALIDARG;
+    }
+
+    m_bFinished = false;
+
+    return hr;
+}
+
+/// Copy next published block into a buffer.
+/// <param name="pBuffer">buffer that receives PCM data.</param>
+/// <param name="pAngles">receives angles published with block.</param>
+/// <param name="pbMoreAvailable">set to true if another block can be read immediately.</param>
+/// <returns>S_OK if audio was produced, S_FALSE if none is available right now, otherwise failure code.</returns>
+HRESULT BroadcastAudioSource::Read(IMediaBuffer* pBuffer, AudioAngles* pAngles, bool* pbMoreAvailable) {
+    pBuffer->SetLength(0);
+    *pbMoreAvailable = false;
+
+    const BroadcastBlockInfo* pInfo = NULL;
+    const int16_t* pSamples = NULL;
+    HRESULT hr = m_reader.BeginRead(&pInfo, &pSamples);
+    if (E_ABORT == hr) {
+        m_bFinished = true;
+        return S_FALSE;
+    }
+    if (S_OK != hr) {
+        return hr;
+    }
+
+    BYTE* pData = NULL;
+    DWORD cbMax = 0;
+    pBuffer->GetBufferAndLength(&pData, NULL);
+    pBuffer->GetMaxLength(&cbMax);
+
+    // Length is only trusted once EndRead confirms block was not overwritten, but must never overrun buffer
+    UINT sampleCount = (pInfo->sampleCount < AudioBlock::MaxSamples) ? pInfo->sampleCount : AudioBlock::MaxSamples;
+    DWORD cbBlock = sampleCount * m_reader.GetChannelCount() * AudioBlockAlign;
+    if (cbBlock > cbMax) {
+        m_reader.EndRead();
+        return E_INVALIDARG;
+    }
+
+    memcpy(pData, pSamples, cbBlock);
+    AudioAngles angles = pInfo->angles;
+
+    if (S_OK != m_reader.EndRead()) {
+        // Overwritten while it was copied; reader has skipped ahead to blocks still intact
+        *pbMoreAvailable = true;
+        return S_FALSE;
+    }
+
+    pBuffer->SetLength(cbBlock);
+    *pAngles = angles;
+    *pbMoreAvailable = (S_OK == m_reader.Wait(0));
+
+    return S_OK;
+}
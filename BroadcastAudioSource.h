@@ -0,0 +1,41 @@
+﻿#pragma once
+
+#include "AudioSource.h"
+#include "AudioFormat.h"
+#include "AudioBroadcast.h"
+
+/// Audio source that follows a live stream another process publishes through a BroadcastPublisher,
+/// with the angles published alongside its audio. Each block is copied straight from the channel's
+/// shared memory into the caller's buffer. Blocks the publisher overwrote before they were read are
+/// skipped, as a live sensor's are when capture falls behind. Source finishes when publisher closes
+/// channel.
+class BroadcastAudioSource : public AudioSource {
+public:
+    /// Constructor
+    BroadcastAudioSource();
+
+    /// Attach to a channel.
+    /// <param name="szName">name channel was opened with.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if channel is not at AudioSamplesPerSecond, otherwise failure code from BroadcastReader::Open.</returns>
+    HRESULT                 Open(const char* szName);
+
+    /// Copy next published block into a buffer.
+    /// <param name="pBuffer">buffer that receives PCM data.</param>
+    /// <param name="pAngles">receives angles published with block.</param>
+    /// <param name="pbMoreAvailable">set to true if another block can be read immediately.</param>
+    /// <returns>S_OK if audio was produced, S_FALSE if none is available right now, otherwise failure code.</returns>
+    virtual HRESULT         Read(IMediaBuffer* pBuffer, AudioAngles* pAngles, bool* pbMoreAvailable);
+
+    /// Whether publisher closed channel and every block was read.
+    virtual bool            IsFinished() const { return m_bFinished; }
+
+    /// Number of interleaved channels produced by Read.
+    virtual WORD            GetChannelCount() const { return m_reader.GetChannelCount(); }
+
+    /// Reader attached to channel, for its overrun count and delivery latency.
+    const BroadcastReader&  GetReader() const { return m_reader; }
+
+private:
+    BroadcastReader         m_reader;
+    bool                    m_bFinished;
+};
@@ -0,0 +1,474 @@
+﻿#include "CaptureEngine.h"
+
+#ifdef _WIN32
+// For CoInitializeEx
+#include <objbase.h>
+#endif
+
+/// Constructor
+CaptureEngine::CaptureEngine() :
+    m_sensorCount(0),
+    m_pSink(NULL),
+    m_pTraceLog(NULL),
+    m_bStopping(false),
+    m_queueHead(0),
+    m_queueCount(0),
+    m_bStoppingWorkers(false) {
+    for (UINT i = 0; i < cMaxSensors; ++i) {
+        m_pSensors[i] = NULL;
+        m_pQueue[i] = NULL;
+    }
+}
+
+/// Destructor
+CaptureEngine::~CaptureEngine() {
+    RemoveAllSensors();
+}
+
+/// Add a sensor to capture from. Must be called before Start.
+/// <param name="pSource">audio source of sensor. Engine takes ownership, even on failure.</param>
+/// <param name="enhancements">combination of AudioEnhancement flags selecting stages sensor's pipeline runs.</param>
+/// <param name="pSensorIndex">receives index identifying sensor.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT CaptureEngine::AddSensor(AudioSource* pSource, UINT enhancements, UINT* pSensorIndex) {
+    if (NULL == pSource) {
+        return E_POINTER;
+    }
+
+    if (m_sensorCount >= cMaxSensors || !m_workers.empty()) {
+        delete pSource;
+        return (m_sensorCount >= cMaxSensors) ? E_OUTOFMEMORY : E_UNEXPECTED;
+    }
+
+    Sensor* pSensor = new Sensor();
+    pSensor->index = m_sensorCount;
+    pSensor->pSource = pSource;
+    pSensor->pRecorder = NULL;
+    pSensor->pClipCapture = NULL;
+    pSensor->pPublisher = NULL;
+    pSensor->bScheduled.store(false);
+    pSensor->captureSequence = 0;
+    pSensor->blocksCaptured.store(0);
+    pSensor->blocksProcessed.store(0);
+    pSensor->samplesProcessed.store(0);
+    pSensor->blocksSkipped.store(0);
+    pSensor->savedNanoseconds.store(0);
+    pSensor->captureResult.store(S_OK);
+    pSensor->bCaptureFinished.store(false);
+    pSensor->bVoiceActive.store(true);
+    pSensor->beamAngleDegrees = 0.0f;
+    pSensor->sourceAngleDegrees = 0.0f;
+    pSensor->sourceConfidence = 0.0f;
+    pSensor->trackedAngleDegrees = 0.0f;
+    pSensor->trackedUncertaintyDegrees = 0.0f;
+
+    WORD channelCount = pSource->GetChannelCount();
+    // Sensors already spread over worker threads, and a map on the default grid costs a small
+    // fraction of a block, so each sensor computes its own on the worker processing it
+    HRESULT hr = pSensor->pipeline.Initialize(channelCount, enhancements, 1);
+    if (SUCCEEDED(hr)) {
+        hr = pSensor->bufferPool.Initialize(cBuffersPerSensor, AudioBlock::MaxSamples * AudioBlockAlign * channelCount);
+    }
+
+    if (FAILED(hr)) {
+        delete pSource;
+        delete pSensor;
+        return hr;
+    }
+
+    m_pSensors[m_sensorCount] = pSensor;
+    *pSensorIndex = m_sensorCount++;
+
+    return S_OK;
+}
+
+/// Record a sensor's processed blocks. Must be called before Start.
+/// <param name="sensorIndex">index of sensor.</param>
+/// <param name="pRecorder">open recorder whose channel count matches sensor's, or NULL to stop recording.</param>
+/// <returns>S_OK on success, E_INVALIDARG if sensor does not exist, E_UNEXPECTED if engine is running.</returns>
+HRESULT CaptureEngine::SetRecorder(UINT sensorIndex, AudioRecorder* pRecorder) {
+    if (sensorIndex >= m_sensorCount) {
+        return E_INVALIDARG;
+    }
+
+    if (!m_workers.empty()) {
+        return E_UNEXPECTED;
+    }
+
+    m_pSensors[sensorIndex]->pRecorder = pRecorder;
+
+    return S_OK;
+}
+
+/// Save clips around trigger events in a sensor's processed blocks. Must be called before Start.
+/// <param name="sensorIndex">index of sensor.</param>
+/// <param name="pClipCapture">open clip capture whose channel count matches sensor's, or NULL to stop capturing clips.</param>
+/// <returns>S_OK on success, E_INVALIDARG if sensor does not exist, E_UNEXPECTED if engine is running.</returns>
+HRESULT CaptureEngine::SetClipCapture(UINT sensorIndex, ClipCapture* pClipCapture) {
+    if (sensorIndex >= m_sensorCount) {
+        return E_INVALIDARG;
+    }
+
+    if (!m_workers.empty()) {
+        return E_UNEXPECTED;
+    }
+
+    m_pSensors[sensorIndex]->pClipCapture = pClipCapture;
+
+    return S_OK;
+}
+
+/// Publish a sensor's processed blocks to a shared memory channel for other processes. Must be called before Start.
+/// <param name="sensorIndex">index of sensor.</param>
+/// <param name="pPublisher">open publisher whose channel count matches sensor's, or NULL to stop publishing.</param>
+/// <returns>S_OK on success, E_INVALIDARG if sensor does not exist, E_UNEXPECTED if engine is running.</returns>
+HRESULT CaptureEngine::SetPublisher(UINT sensorIndex, BroadcastPublisher* pPublisher) {
+    if (sensorIndex >= m_sensorCount) {
+        return E_INVALIDARG;
+    }
+
+    if (!m_workers.empty()) {
+        return E_UNEXPECTED;
+    }
+
+    m_pSensors[sensorIndex]->pPublisher = pPublisher;
+
+    return S_OK;
+}
+
+/// Start capture threads and worker pool.
+/// <param name="workerCount">number of worker threads, or 0 for one per sensor up to number of processors.</param>
+/// <param name="pSink">receives processing results, or NULL.</param>
+/// <param name="pTraceLog">log that receives capture events, or NULL.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT CaptureEngine::Start(UINT workerCount, CaptureResultSink* pSink, TraceLog* pTraceLog) {
+    if (0 == m_sensorCount || !m_workers.empty()) {
+        return E_UNEXPECTED;
+    }
+
+    if (0 == workerCount) {
+        UINT processorCount = std::thread::hardware_concurrency();
+        workerCount = (processorCount > 0 && processorCount < m_sensorCount) ? processorCount : m_sensorCount;
+    }
+
+    m_pSink = pSink;
+    m_pTraceLog = pTraceLog;
+    m_bStopping = false;
+    m_bStoppingWorkers = false;
+
+    for (UINT i = 0; i < workerCount; ++i) {
+        m_workers.push_back(std::thread(&CaptureEngine::WorkerLoop, this));
+    }
+
+    for (UINT i = 0; i < m_sensorCount; ++i) {
+        m_pSensors[i]->captureThread = std::thread(&CaptureEngine::CaptureLoop, this, m_pSensors[i]);
+    }
+
+    return S_OK;
+}
+
+/// Stop capture threads, process blocks already captured, then stop worker pool.
+void CaptureEngine::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_stopLock);
+        m_bStopping = true;
+    }
+    m_stopRequested.notify_all();
+
+    for (UINT i = 0; i < m_sensorCount; ++i) {
+        if (m_pSensors[i]->captureThread.joinable()) {
+            m_pSensors[i]->captureThread.join();
+        }
+    }
+
+    // Workers exit once queue is empty, so everything scheduled before this point gets processed
+    {
+        std::lock_guard<std::mutex> lock(m_queueLock);
+        m_bStoppingWorkers = true;
+    }
+    m_queueNotEmpty.notify_all();
+
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        m_workers[i].join();
+    }
+    m_workers.clear();
+
+    // Blocks still queued hold references to pooled buffers, which must go back before pools are destroyed
+    for (UINT i = 0; i < m_sensorCount; ++i) {
+        Sensor* pSensor = m_pSensors[i];
+        for (AudioBlock* pBlock = pSensor->ring.BeginRead(); NULL != pBlock; pBlock = pSensor->ring.BeginRead()) {
+            SafeRelease(pBlock->pBuffer);
+            pSensor->ring.EndRead();
+        }
+        pSensor->bScheduled.store(false);
+    }
+}
+
+/// Stop capture and delete every sensor's audio source.
+void CaptureEngine::RemoveAllSensors() {
+    Stop();
+
+    for (UINT i = 0; i < m_sensorCount; ++i) {
+        delete m_pSensors[i]->pSource;
+        delete m_pSensors[i];
+        m_pSensors[i] = NULL;
+    }
+    m_sensorCount = 0;
+}
+
+/// Whether every sensor's source has finished or failed, and all captured audio was processed.
+bool CaptureEngine::IsIdle() const {
+    for (UINT i = 0; i < m_sensorCount; ++i) {
+        const Sensor* pSensor = m_pSensors[i];
+        if (!pSensor->bCaptureFinished.load() || pSensor->bScheduled.load() || 0 != pSensor->ring.GetCount()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// Get latest angles and throughput counters of a sensor. Safe to call from any thread.
+/// <param name="sensorIndex">index of sensor.</param>
+/// <param name="pStatus">receives snapshot.</param>
+void CaptureEngine::GetSensorStatus(UINT sensorIndex, SensorStatus* pStatus) const {
+    const Sensor* pSensor = m_pSensors[sensorIndex];
+
+    {
+        std::lock_guard<std::mutex> lock(pSensor->statusLock);
+        pStatus->beamAngleDegrees = pSensor->beamAngleDegrees;
+        pStatus->sourceAngleDegrees = pSensor->sourceAngleDegrees;
+        pStatus->sourceConfidence = pSensor->sourceConfidence;
+        pStatus->trackedAngleDegrees = pSensor->trackedAngleDegrees;
+        pStatus->trackedUncertaintyDegrees = pSensor->trackedUncertaintyDegrees;
+    }
+
+    pStatus->blocksCaptured = pSensor->blocksCaptured.load(std::memory_order_relaxed);
+    pStatus->blocksProcessed = pSensor->blocksProcessed.load(std::memory_order_relaxed);
+    pStatus->samplesProcessed = pSensor->samplesProcessed.load(std::memory_order_relaxed);
+    pStatus->blocksSkipped = pSensor->blocksSkipped.load(std::memory_order_relaxed);
+    pStatus->savedNanoseconds = pSensor->savedNanoseconds.load(std::memory_order_relaxed);
+    pStatus->overrunCount = pSensor->ring.GetOverrunCount();
+    pStatus->captureResult = pSensor->captureResult.load(std::memory_order_relaxed);
+}
+
+/// Body of a sensor's capture thread.
+/// <param name="pSensor">sensor to capture from.</param>
+void CaptureEngine::CaptureLoop(Sensor* pSensor) {
+    HRESULT hr = S_OK;
+
+#ifdef _WIN32
+    // Kinect DMO lives in the multithreaded apartment, so this thread must join it as well
+    hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+    if (FAILED(hr)) {
+        pSensor->captureResult.store(hr);
+        pSensor->bCaptureFinished.store(true);
+        return;
+    }
+
+    // Capture must keep up even when workers and UI are busy
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_ABOVE_NORMAL);
+#endif
+
+    // Poll audio source until asked to stop, or until a replayed source runs out
+    std::unique_lock<std::mutex> lock(m_stopLock);
+    while (!m_bStopping) {
+        lock.unlock();
+        hr = CaptureAvailable(pSensor);
+        bool bFinished = FAILED(hr) || pSensor->pSource->IsFinished();
+        lock.lock();
+
+        if (bFinished) {
+            break;
+        }
+
+        m_stopRequested.wait_for(lock, std::chrono::milliseconds(static_cast<int>(cCaptureInterval)));
+    }
+    lock.unlock();
+
+    pSensor->captureResult.store(hr);
+    pSensor->bCaptureFinished.store(true);
+
+    if (NULL != m_pSink) {
+        m_pSink->OnCaptureStopped(pSensor->index, hr);
+    }
+
+#ifdef _WIN32
+    CoUninitialize();
+#endif
+}
+
+/// Drain all audio currently available from sensor's source into its capture ring. Capture thread only.
+/// <param name="pSensor">sensor to capture from.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT CaptureEngine::CaptureAvailable(Sensor* pSensor) {
+    bool bMoreAvailable = false;
+    bool bPublished = false;
+    HRESULT hr = S_OK;
+
+    do {
+        // Audio is read straight into a pooled buffer that is handed to workers without copying.
+        // If workers fell behind, audio must still be drained from source, so it is read into
+        // scratch buffer and dropped.
+        AudioBlock* pBlock = pSensor->ring.BeginWrite();
+        CPooledMediaBuffer* pBuffer = (NULL != pBlock) ? pSensor->bufferPool.Acquire() : NULL;
+        IMediaBuffer* pTarget = (NULL != pBuffer) ? static_cast<IMediaBuffer*>(pBuffer) : &pSensor->scratchBuffer;
+
+        // Angles are only wanted while voice gate lets blocks through; the first voiced block after
+        // silence still carries stale angles, as the gate decides on it after it is read
+        pSensor->pSource->SetAngleQueriesEnabled(pSensor->bVoiceActive.load(std::memory_order_relaxed));
+
+        AudioAngles angles;
+        UINT64 readStart = GetClockNanoseconds();
+        hr = pSensor->pSource->Read(pTarget, &angles, &bMoreAvailable);
+        UINT64 captureTimestamp = GetClockNanoseconds();
+        pSensor->captureCallLatency.Record(captureTimestamp - readStart);
+        if (FAILED(hr)) {
+            SafeRelease(pBuffer);
+            break;
+        }
+
+        if (S_FALSE == hr) {
+            SafeRelease(pBuffer);
+            continue;
+        }
+
+        uint32_t sequence = pSensor->captureSequence++;
+
+        if (NULL == pBuffer) {
+            pSensor->ring.NoteOverrun();
+            if (NULL != m_pTraceLog) {
+                m_pTraceLog->Write(TraceEventCaptureOverrun, sequence, static_cast<float>(pSensor->ring.GetOverrunCount()), static_cast<float>(pSensor->index));
+            }
+            continue;
+        }
+
+        BYTE* pProduced = NULL;
+        DWORD cbProduced = 0;
+        pBuffer->GetBufferAndLength(&pProduced, &cbProduced);
+
+        // Block takes over the reference returned by Acquire
+        pBlock->channelCount = pSensor->pSource->GetChannelCount();
+        pBlock->sampleCount = cbProduced / (AudioBlockAlign * pBlock->channelCount);
+        pBlock->sequence = sequence;
+        pBlock->angles = angles;
+        pBlock->captureTimestamp = captureTimestamp;
+        pBlock->pSamples = reinterpret_cast<const int16_t*>(pProduced);
+        pBlock->pBuffer = pBuffer;
+        pSensor->ring.EndWrite();
+        pSensor->blocksCaptured.fetch_add(1, std::memory_order_relaxed);
+        bPublished = true;
+
+        if (NULL != m_pTraceLog) {
+            m_pTraceLog->Write(TraceEventBlockCaptured, sequence, static_cast<float>(pBlock->sampleCount), static_cast<float>(pBlock->channelCount), static_cast<float>(pSensor->index));
+        }
+
+    } while (bMoreAvailable);
+
+    // Hand sensor to a worker once for everything drained, rather than once per block.
+    // Blocks captured before a failure are still processed.
+    if (bPublished) {
+        Schedule(pSensor);
+    }
+
+    return hr;
+}
+
+/// Queue sensor for a worker, unless it is already queued or being processed.
+/// <param name="pSensor">sensor that has captured blocks.</param>
+void CaptureEngine::Schedule(Sensor* pSensor) {
+    // Pairs with fence in ProcessQueued: either worker sees published blocks, or this sees flag cleared
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (pSensor->bScheduled.exchange(true)) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_queueLock);
+        m_pQueue[(m_queueHead + m_queueCount) % cMaxSensors] = pSensor;
+        ++m_queueCount;
+    }
+    m_queueNotEmpty.notify_one();
+}
+
+/// Body of a worker thread.
+void CaptureEngine::WorkerLoop() {
+    for (;;) {
+        Sensor* pSensor = NULL;
+        {
+            std::unique_lock<std::mutex> lock(m_queueLock);
+            while (0 == m_queueCount && !m_bStoppingWorkers) {
+                m_queueNotEmpty.wait(lock);
+            }
+
+            if (0 == m_queueCount) {
+                return;
+            }
+
+            pSensor = m_pQueue[m_queueHead];
+            m_queueHead = (m_queueHead + 1) % cMaxSensors;
+            --m_queueCount;
+        }
+
+        ProcessQueued(pSensor);
+    }
+}
+
+/// Process every block in sensor's capture ring. Worker holding sensor only.
+/// <param name="pSensor">sensor to process.</param>
+void CaptureEngine::ProcessQueued(Sensor* pSensor) {
+    AudioPipelineResult result;
+
+    for (;;) {
+        for (AudioBlock* pBlock = pSensor->ring.BeginRead(); NULL != pBlock; pBlock = pSensor->ring.BeginRead()) {
+            // Take block, along with its buffer reference, out of ring so its slot can be refilled
+            AudioBlock block = *pBlock;
+            pSensor->ring.EndRead();
+
+            HRESULT hr = pSensor->pipeline.ProcessBlock(block, &result);
+
+            // Recorder, clip capture and publisher only copy, so samples are still this worker's; a dropped block is counted by recorder
+            if (SUCCEEDED(hr) && NULL != pSensor->pRecorder) {
+                pSensor->pRecorder->Append(block, result);
+            }
+            if (SUCCEEDED(hr) && NULL != pSensor->pClipCapture) {
+                pSensor->pClipCapture->Append(block, result);
+            }
+            if (SUCCEEDED(hr) && NULL != pSensor->pPublisher) {
+                pSensor->pPublisher->Publish(block, result);
+            }
+            block.pBuffer->Release();
+            if (FAILED(hr)) {
+                continue;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(pSensor->statusLock);
+                pSensor->beamAngleDegrees = result.beamAngleDegrees;
+                pSensor->sourceAngleDegrees = result.sourceAngleDegrees;
+                pSensor->sourceConfidence = result.sourceConfidence;
+                pSensor->trackedAngleDegrees = result.trackedAngleDegrees;
+                pSensor->trackedUncertaintyDegrees = result.trackedUncertaintyDegrees;
+            }
+            pSensor->blocksProcessed.fetch_add(1, std::memory_order_relaxed);
+            pSensor->samplesProcessed.fetch_add(result.sampleCount, std::memory_order_relaxed);
+
+            const AudioGateStatistics& gate = pSensor->pipeline.GetGateStatistics();
+            pSensor->bVoiceActive.store(result.bVoiceActive, std::memory_order_relaxed);
+            pSensor->blocksSkipped.store(gate.skippedCount, std::memory_order_relaxed);
+            pSensor->savedNanoseconds.store(gate.GetSavedNanoseconds(), std::memory_order_relaxed);
+
+            if (NULL != m_pSink) {
+                m_pSink->OnBlockProcessed(pSensor->index, result);
+            }
+        }
+
+        // Capture thread skips scheduling while flag is set, so blocks it published after ring
+        // looked empty but before flag was cleared must be picked up here
+        pSensor->bScheduled.store(false);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (0 == pSensor->ring.GetCount() || pSensor->bScheduled.exchange(true)) {
+            return;
+        }
+    }
+}
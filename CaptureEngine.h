@@ -0,0 +1,250 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "AudioBlock.h"
+#include "AudioBroadcast.h"
+#include "AudioPipeline.h"
+#include "AudioRecorder.h"
+#include "ClipCapture.h"
+#include "AudioRingBuffer.h"
+#include "AudioSource.h"
+#include "LatencyHistogram.h"
+#include "MediaBuffer.h"
+#include "MediaBufferPool.h"
+#include "TraceLog.h"
+
+// For counters and scheduling flags shared between threads
+#include <atomic>
+
+// For waking capture threads and workers
+#include <condition_variable>
+#include <mutex>
+
+// For capture threads and worker pool
+#include <thread>
+#include <vector>
+
+/// Snapshot of one sensor in capture engine's merged view.
+struct SensorStatus {
+    // Beam angle, sound source angle and confidence from most recently processed block.
+    float                   beamAngleDegrees;
+    float                   sourceAngleDegrees;
+    float                   sourceConfidence;
+
+    // Source angle smoothed by pipeline's tracker, and its standard deviation, in degrees.
+    float                   trackedAngleDegrees;
+    float                   trackedUncertaintyDegrees;
+
+    // Number of blocks published by capture thread, and processed by workers.
+    UINT64                  blocksCaptured;
+    UINT64                  blocksProcessed;
+
+    // Number of samples processed by sensor's pipeline.
+    UINT64                  samplesProcessed;
+
+    // Number of processed blocks whose analysis voice gate skipped, and estimate of processing time that saved.
+    UINT64                  blocksSkipped;
+    UINT64                  savedNanoseconds;
+
+    // Number of blocks dropped because workers fell behind.
+    uint32_t                overrunCount;
+
+    // S_OK while capture is running or finished normally, otherwise failure that stopped capture thread.
+    HRESULT                 captureResult;
+};
+
+/// Receives results of processing captured audio.
+/// OnBlockProcessed is called on worker threads. Calls for any one sensor never overlap
+/// and arrive in capture order.
+class CaptureResultSink {
+public:
+    virtual ~CaptureResultSink() {}
+
+    /// Called after a sensor's block has been run through its pipeline.
+    /// <param name="sensorIndex">index of sensor, as returned by AddSensor.</param>
+    /// <param name="result">processing results for block.</param>
+    virtual void            OnBlockProcessed(UINT sensorIndex, const AudioPipelineResult& result) = 0;
+
+    /// Called on a sensor's capture thread when it stops capturing. Blocks it already captured may still be processing.
+    /// <param name="sensorIndex">index of sensor, as returned by AddSensor.</param>
+    /// <param name="hr">S_OK if source finished or engine was stopped, otherwise failure that stopped capture.</param>
+    virtual void            OnCaptureStopped(UINT sensorIndex, HRESULT hr) { (void)sensorIndex; (void)hr; }
+};
+
+/// Captures audio from several sensors at once.
+/// Every sensor gets its own capture thread, capture ring, buffer pool and processing
+/// pipeline, so one slow or failing sensor can't stall the others. Captured blocks are
+/// processed by a shared pool of worker threads; a sensor is scheduled on at most one
+/// worker at a time, so its pipeline sees blocks in order from one thread at a time.
+class CaptureEngine {
+public:
+    // Maximum number of sensors one engine captures from.
+    static const UINT       cMaxSensors = 8;
+
+    // Time interval, in milliseconds, between capture thread polls of audio source.
+    static const UINT       cCaptureInterval = 10;
+
+    // Number of audio blocks each sensor's capture ring can hold (about 4 seconds of audio).
+    static const uint32_t   cRingCapacity = 128;
+
+    // Number of pooled capture buffers per sensor. Enough to fill capture ring, plus headroom
+    // for blocks consumers are still holding after taking them out of ring.
+    static const UINT       cBuffersPerSensor = cRingCapacity + 64;
+
+    /// Constructor
+    CaptureEngine();
+
+    /// Destructor
+    ~CaptureEngine();
+
+    /// Add a sensor to capture from. Must be called before Start.
+    /// <param name="pSource">audio source of sensor. Engine takes ownership, even on failure.</param>
+    /// <param name="enhancements">combination of AudioEnhancement flags selecting stages sensor's pipeline runs.</param>
+    /// <param name="pSensorIndex">receives index identifying sensor.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 AddSensor(AudioSource* pSource, UINT enhancements, UINT* pSensorIndex);
+
+    /// Record a sensor's processed blocks. Must be called before Start.
+    /// <param name="sensorIndex">index of sensor.</param>
+    /// <param name="pRecorder">open recorder whose channel count matches sensor's, or NULL to stop recording.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if sensor does not exist, E_UNEXPECTED if engine is running.</returns>
+    HRESULT                 SetRecorder(UINT sensorIndex, AudioRecorder* pRecorder);
+
+    /// Save clips around trigger events in a sensor's processed blocks. Must be called before Start.
+    /// <param name="sensorIndex">index of sensor.</param>
+    /// <param name="pClipCapture">open clip capture whose channel count matches sensor's, or NULL to stop capturing clips.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if sensor does not exist, E_UNEXPECTED if engine is running.</returns>
+    HRESULT                 SetClipCapture(UINT sensorIndex, ClipCapture* pClipCapture);
+
+    /// Publish a sensor's processed blocks to a shared memory channel for other processes. Must be called before Start.
+    /// <param name="sensorIndex">index of sensor.</param>
+    /// <param name="pPublisher">open publisher whose channel count matches sensor's, or NULL to stop publishing.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if sensor does not exist, E_UNEXPECTED if engine is running.</returns>
+    HRESULT                 SetPublisher(UINT sensorIndex, BroadcastPublisher* pPublisher);
+
+    /// Start capture threads and worker pool.
+    /// <param name="workerCount">number of worker threads, or 0 for one per sensor up to number of processors.</param>
+    /// <param name="pSink">receives processing results, or NULL.</param>
+    /// <param name="pTraceLog">log that receives capture events, or NULL.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 Start(UINT workerCount, CaptureResultSink* pSink, TraceLog* pTraceLog);
+
+    /// Stop capture threads, process blocks already captured, then stop worker pool.
+    void                    Stop();
+
+    /// Stop capture and delete every sensor's audio source.
+    void                    RemoveAllSensors();
+
+    /// Number of sensors added.
+    UINT                    GetSensorCount() const { return m_sensorCount; }
+
+    /// Number of worker threads running.
+    UINT                    GetWorkerCount() const { return static_cast<UINT>(m_workers.size()); }
+
+    /// Whether every sensor's source has finished or failed, and all captured audio was processed.
+    bool                    IsIdle() const;
+
+    /// Get latest angles and throughput counters of a sensor. Safe to call from any thread.
+    /// <param name="sensorIndex">index of sensor.</param>
+    /// <param name="pStatus">receives snapshot.</param>
+    void                    GetSensorStatus(UINT sensorIndex, SensorStatus* pStatus) const;
+
+    /// Number of interleaved channels a sensor captures.
+    /// <param name="sensorIndex">index of sensor.</param>
+    WORD                    GetSensorChannelCount(UINT sensorIndex) const { return m_pSensors[sensorIndex]->pSource->GetChannelCount(); }
+
+    /// Duration of each audio source Read call made by a sensor's capture thread.
+    /// <param name="sensorIndex">index of sensor.</param>
+    const LatencyHistogram& GetCaptureCallLatency(UINT sensorIndex) const { return m_pSensors[sensorIndex]->captureCallLatency; }
+
+private:
+    /// Everything owned by one sensor.
+    struct Sensor {
+        UINT                        index;
+        AudioSource*                pSource;
+        std::thread                 captureThread;
+
+        // Audio is read into pooled buffers handed to workers, or into scratch buffer when workers fell behind.
+        AudioRingBuffer<AudioBlock, cRingCapacity> ring;
+        CMediaBufferPool            bufferPool;
+        CStaticMediaBuffer          scratchBuffer;
+
+        // Used only by worker currently holding sensor.
+        AudioPipeline               pipeline;
+        AudioRecorder*              pRecorder;
+        ClipCapture*                pClipCapture;
+        BroadcastPublisher*         pPublisher;
+
+        // Set while sensor is queued for, or held by, a worker.
+        std::atomic<bool>           bScheduled;
+
+        // Sequence number assigned to next captured block. Capture thread only.
+        uint32_t                    captureSequence;
+
+        // Recorded by capture thread only.
+        LatencyHistogram            captureCallLatency;
+
+        std::atomic<UINT64>         blocksCaptured;
+        std::atomic<UINT64>         blocksProcessed;
+        std::atomic<UINT64>         samplesProcessed;
+        std::atomic<UINT64>         blocksSkipped;
+        std::atomic<UINT64>         savedNanoseconds;
+        std::atomic<int32_t>        captureResult;
+        std::atomic<bool>           bCaptureFinished;
+
+        // Voice gate decision of most recently processed block. Capture thread stops querying
+        // source's angles while it is false.
+        std::atomic<bool>           bVoiceActive;
+
+        // Guards latest angles, which are written by workers and read by any thread.
+        mutable std::mutex          statusLock;
+        float                       beamAngleDegrees;
+        float                       sourceAngleDegrees;
+        float                       sourceConfidence;
+        float                       trackedAngleDegrees;
+        float                       trackedUncertaintyDegrees;
+    };
+
+    Sensor*                 m_pSensors[cMaxSensors];
+    UINT                    m_sensorCount;
+
+    CaptureResultSink*      m_pSink;
+    TraceLog*               m_pTraceLog;
+
+    // Capture threads wait on this between polls, so Stop can wake them at once.
+    std::mutex              m_stopLock;
+    std::condition_variable m_stopRequested;
+    bool                    m_bStopping;
+
+    // Sensors waiting for a worker, in order they were scheduled. Each is queued at most once.
+    std::vector<std::thread> m_workers;
+    std::mutex              m_queueLock;
+    std::condition_variable m_queueNotEmpty;
+    Sensor*                 m_pQueue[cMaxSensors];
+    UINT                    m_queueHead;
+    UINT                    m_queueCount;
+    bool                    m_bStoppingWorkers;
+
+    /// Body of a sensor's capture thread.
+    /// <param name="pSensor">sensor to capture from.</param>
+    void                    CaptureLoop(Sensor* pSensor);
+
+    /// Drain all audio currently available from sensor's source into its capture ring. Capture thread only.
+    /// <param name="pSensor">sensor to capture from.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 CaptureAvailable(Sensor* pSensor);
+
+    /// Queue sensor for a worker, unless it is already queued or being processed.
+    /// <param name="pSensor">sensor that has captured blocks.</param>
+    void                    Schedule(Sensor* pSensor);
+
+    /// Body of a worker thread.
+    void                    WorkerLoop();
+
+    /// Process every block in sensor's capture ring. Worker holding sensor only.
+    /// <param name="pSensor">sensor to process.</param>
+    void                    ProcessQueued(Sensor* pSensor);
+
+    CaptureEngine(const CaptureEngine&);
+    CaptureEngine& operator=(const CaptureEngine&);
+};
@@ -0,0 +1,462 @@
+﻿#include "ClipCapture.h"
+#include "Clock.h"
+
+// For fabs
+#include <math.h>
+
+// For snprintf
+#include <stdio.h>
+
+// Room clip file name takes after prefix: clip number of up to 10 digits, ".ses" and terminator.
+static const UINT       cClipNameLength = 15;
+
+/// Settings clip capture is usually opened with: clips of loud events and voice onsets, with 3 seconds
+/// of pre-roll and 2 of post-roll, at most 30 seconds long. Angle change triggers at 20 degrees, if added.
+ClipCaptureSettings ClipCapture::GetDefaultSettings() {
+    ClipCaptureSettings settings;
+    settings.triggers = ClipTriggerEnergy | ClipTriggerVoiceOnset;
+
+    // Well above room noise and ordinary speech at a few meters
+    settings.energyThreshold = 0.6f;
+    settings.angleChangeDegrees = 20.0f;
+    settings.preRollMilliseconds = 3000;
+    settings.postRollMilliseconds = 2000;
+    settings.maxClipMilliseconds = 30000;
+    return settings;
+}
+
+/// Constructor
+ClipCapture::ClipCapture() :
+    m_bOpen(false),
+    m_bWaitWhenBehind(false),
+    m_channelCount(0),
+    m_sampleRate(0),
+    m_preRollFrames(0),
+    m_postRollFrames(0),
+    m_maxClipFrames(0),
+    m_ringFrames(0),
+    m_blockCapacity(0),
+    m_bWasVoiceActive(true),
+    m_bHaveReferenceAngle(false),
+    m_referenceAngleDegrees(0.0f),
+    m_missedTriggers(0),
+    m_nextClipNumber(0),
+    m_bStopping(false),
+    m_frameCount(0),
+    m_blockCount(0),
+    m_oldestBlock(0),
+    m_pendingHead(0),
+    m_pendingTail(0),
+    m_lastClipEndBlock(0),
+    m_writeResult(S_OK),
+    m_clipCount(0),
+    m_droppedBlocks(0) {
+    m_szPathPrefix[0] = '\0';
+    memset(&m_settings, 0, sizeof(m_settings));
+}
+
+/// Destructor. Closes capture, if open.
+ClipCapture::~ClipCapture() {
+    Close();
+}
+
+/// Allocate pre-roll ring and start writer thread.
+/// <param name="szPathPrefix">prefix of clip file paths, each followed by 4-digit clip number and ".ses".</param>
+/// <param name="channelCount">number of interleaved channels in blocks, from 1 to AudioBlock::MaxChannels.</param>
+/// <param name="sampleRate">sample rate, in Hz.</param>
+/// <param name="settings">triggers, at least one, and clip lengths. Pre-roll is at most cMaxPreRollMilliseconds and
+/// longest clip is not 0.</param>
+/// <param name="bWaitWhenBehind">true for Append to wait for writer rather than overwrite blocks it has yet to write.</param>
+/// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range, E_UNEXPECTED if already open.</returns>
+HRESULT ClipCapture::Open(const char* szPathPrefix, WORD channelCount, UINT sampleRate, const ClipCaptureSettings& settings, bool bWaitWhenBehind) {
+    if (m_bOpen) {
+        return E_UNEXPECTED;
+    }
+
+    if (0 == channelCount || channelCount > AudioBlock::MaxChannels || 0 == sampleRate ||
+        ClipTriggerNone == (settings.triggers & (ClipTriggerEnergy | ClipTriggerVoiceOnset | ClipTriggerAngleChange)) ||
+        settings.preRollMilliseconds > cMaxPreRollMilliseconds || 0 == settings.maxClipMilliseconds ||
+        strlen(szPathPrefix) + cClipNameLength > cMaxPathLength) {
+        return E_INVALIDARG;
+    }
+
+    memcpy(m_szPathPrefix, szPathPrefix, strlen(szPathPrefix) + 1);
+    m_channelCount = channelCount;
+    m_sampleRate = sampleRate;
+    m_settings = settings;
+    m_bWaitWhenBehind = bWaitWhenBehind;
+    m_preRollFrames = static_cast<UINT64>(sampleRate) * settings.preRollMilliseconds / 1000;
+    m_postRollFrames = static_cast<UINT64>(sampleRate) * settings.postRollMilliseconds / 1000;
+    m_maxClipFrames = static_cast<UINT64>(sampleRate) * settings.maxClipMilliseconds / 1000;
+
+    // Pre-roll plus headroom, and a block more so pre-roll survives appending the block that triggers
+    m_ringFrames = m_preRollFrames + static_cast<UINT64>(sampleRate) * cWriterHeadroomMilliseconds / 1000 + AudioBlock::MaxSamples;
+    m_blockCapacity = m_ringFrames / cMinBlockFrames + 1;
+    m_ring.assign(static_cast<size_t>(m_ringFrames) * channelCount, 0);
+    m_blocks.assign(static_cast<size_t>(m_blockCapacity), BlockRecord());
+    m_stagingFrames.assign(cStagingBlocks * AudioBlock::MaxSamples * channelCount, 0);
+    m_stagingRecords.assign(cStagingBlocks, BlockRecord());
+
+    m_bWasVoiceActive = true;
+    m_bHaveReferenceAngle = false;
+    m_referenceAngleDegrees = 0.0f;
+    m_missedTriggers = 0;
+    m_nextClipNumber = 0;
+    m_appendLatency.Reset();
+    m_bStopping = false;
+    m_frameCount = 0;
+    m_blockCount = 0;
+    m_oldestBlock = 0;
+    m_pendingHead = 0;
+    m_pendingTail = 0;
+    m_lastClipEndBlock = 0;
+    m_clips.clear();
+    m_writeLatency.Reset();
+    m_writeResult = S_OK;
+    m_clipCount.store(0, std::memory_order_relaxed);
+    m_droppedBlocks.store(0, std::memory_order_relaxed);
+
+    // Thread creation publishes the initialized ring to the writer thread
+    m_writer = std::thread(&ClipCapture::WriteLoop, this);
+    m_bOpen = true;
+
+    return S_OK;
+}
+
+/// Copy a processed block into pre-roll ring and check it against triggers.
+/// <param name="block">captured audio block.</param>
+/// <param name="result">pipeline's results for block, giving its stream position, energy, voice and angles.</param>
+/// <returns>S_OK on success, E_INVALIDARG if channel count does not match or block is too long, E_UNEXPECTED if not open.</returns>
+HRESULT ClipCapture::Append(const AudioBlock& block, const AudioPipelineResult& result) {
+    if (!m_bOpen) {
+        return E_UNEXPECTED;
+    }
+
+    if (block.channelCount != m_channelCount || block.sampleCount > AudioBlock::MaxSamples) {
+        return E_INVALIDARG;
+    }
+
+    UINT64 start = GetClockNanoseconds();
+    UINT triggers = CheckTriggers(result);
+    bool bClipPending = false;
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+
+        if (m_bWaitWhenBehind) {
+            while (IsWriterBehind(block.sampleCount)) {
+                m_blocksTaken.wait(lock);
+            }
+        }
+        RetireBlocks(block.sampleCount);
+
+        // Frames go in at end of ring, wrapping round to its start
+        size_t offset = static_cast<size_t>(m_frameCount % m_ringFrames);
+        size_t firstFrames = (block.sampleCount < m_ringFrames - offset) ? block.sampleCount : static_cast<size_t>(m_ringFrames - offset);
+        memcpy(&m_ring[offset * m_channelCount], block.pSamples, firstFrames * m_channelCount * sizeof(int16_t));
+        if (firstFrames < block.sampleCount) {
+            memcpy(&m_ring[0], block.pSamples + firstFrames * m_channelCount, (block.sampleCount - firstFrames) * m_channelCount * sizeof(int16_t));
+        }
+
+        BlockRecord& record = GetRecord(m_blockCount);
+        record.ringFrame = m_frameCount;
+        record.samplePosition = result.samplePosition;
+        record.captureTimestamp = block.captureTimestamp;
+        record.angles = block.angles;
+        record.sampleCount = block.sampleCount;
+
+        m_frameCount += block.sampleCount;
+        ++m_blockCount;
+
+        UpdateClips(triggers, result.samplePosition);
+        bClipPending = (m_pendingHead != m_pendingTail);
+    }
+
+    // Writer only needs waking while it has a clip to follow
+    if (bClipPending) {
+        m_blocksAppended.notify_one();
+    }
+
+    m_appendLatency.Record(GetClockNanoseconds() - start);
+
+    return S_OK;
+}
+
+/// End open clip, wait for writer thread to finish every clip, and stop it.
+/// Producer must have stopped. Does nothing if not open.
+/// <returns>S_OK on success, otherwise first failure creating or writing a clip file.</returns>
+HRESULT ClipCapture::Close() {
+    if (!m_bOpen) {
+        return S_OK;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_pendingTail != m_pendingHead) {
+            PendingClip& last = m_pending[(m_pendingTail - 1) % cMaxPendingClips];
+            last.bClosed = true;
+        }
+        m_bStopping = true;
+    }
+    m_blocksAppended.notify_one();
+    m_writer.join();
+    m_bOpen = false;
+
+    std::vector<int16_t>().swap(m_ring);
+    std::vector<BlockRecord>().swap(m_blocks);
+
+    return m_writeResult;
+}
+
+/// Check a processed block against triggers. Producer only.
+/// <param name="result">pipeline's results for block.</param>
+/// <returns>combination of ClipTrigger flags block trips.</returns>
+UINT ClipCapture::CheckTriggers(const AudioPipelineResult& result) {
+    UINT triggers = ClipTriggerNone;
+
+    if ((m_settings.triggers & ClipTriggerEnergy) && result.energyPeak >= m_settings.energyThreshold) {
+        triggers |= ClipTriggerEnergy;
+    }
+
+    if ((m_settings.triggers & ClipTriggerVoiceOnset) && result.bVoiceActive && !m_bWasVoiceActive) {
+        triggers |= ClipTriggerVoiceOnset;
+    }
+    m_bWasVoiceActive = result.bVoiceActive;
+
+    // Angle only counts once tracker is surer of it than the change looked for, so its settling does not trigger
+    if ((m_settings.triggers & ClipTriggerAngleChange) && result.trackedUncertaintyDegrees <= m_settings.angleChangeDegrees) {
+        if (!m_bHaveReferenceAngle) {
+            m_referenceAngleDegrees = result.trackedAngleDegrees;
+            m_bHaveReferenceAngle = true;
+        }
+        else if (fabs(result.trackedAngleDegrees - m_referenceAngleDegrees) >= m_settings.angleChangeDegrees) {
+            triggers |= ClipTriggerAngleChange;
+            m_referenceAngleDegrees = result.trackedAngleDegrees;
+        }
+    }
+
+    return triggers;
+}
+
+/// Find oldest block that would still be in ring after appending frames.
+/// <param name="frameCount">number of frames about to be appended.</param>
+/// <returns>count of blocks appended before that block.</returns>
+UINT64 ClipCapture::GetOldestBlockAfter(UINT64 frameCount) {
+    // The new block's record takes the slot of the block a capacity before it; its frames overwrite
+    // every frame more than a ring before the end of them
+    UINT64 oldest = m_oldestBlock;
+    while (oldest < m_blockCount &&
+           (oldest + m_blockCapacity <= m_blockCount || GetRecord(oldest).ringFrame + m_ringFrames < m_frameCount + frameCount)) {
+        ++oldest;
+    }
+    return oldest;
+}
+
+/// Whether appending frames would overwrite a block some pending clip has yet to write. Lock must be held.
+/// <param name="frameCount">number of frames about to be appended.</param>
+bool ClipCapture::IsWriterBehind(UINT64 frameCount) {
+    UINT64 oldest = GetOldestBlockAfter(frameCount);
+    for (UINT64 i = m_pendingHead; i < m_pendingTail; ++i) {
+        const PendingClip& clip = m_pending[i % cMaxPendingClips];
+        if (clip.nextBlock < oldest && clip.nextBlock < clip.endBlock) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Retire blocks appending frames overwrites, moving pending clips past any they lose. Lock must be held.
+/// <param name="frameCount">number of frames about to be appended.</param>
+void ClipCapture::RetireBlocks(UINT64 frameCount) {
+    UINT64 oldest = GetOldestBlockAfter(frameCount);
+    for (UINT64 i = m_pendingHead; i < m_pendingTail; ++i) {
+        PendingClip& clip = m_pending[i % cMaxPendingClips];
+        UINT64 lostEnd = (oldest < clip.endBlock) ? oldest : clip.endBlock;
+        if (clip.nextBlock < lostEnd) {
+            uint32_t lost = static_cast<uint32_t>(lostEnd - clip.nextBlock);
+            clip.info.droppedBlocks += lost;
+            m_droppedBlocks.fetch_add(lost, std::memory_order_relaxed);
+            clip.nextBlock = lostEnd;
+        }
+    }
+    m_oldestBlock = oldest;
+}
+
+/// Extend, close or open a clip after a block was appended. Lock must be held.
+/// <param name="triggers">ClipTrigger flags block tripped.</param>
+/// <param name="samplePosition">stream position of block.</param>
+void ClipCapture::UpdateClips(UINT triggers, UINT64 samplePosition) {
+    if (m_pendingTail != m_pendingHead) {
+        PendingClip& last = m_pending[(m_pendingTail - 1) % cMaxPendingClips];
+        if (!last.bClosed) {
+            last.endBlock = m_blockCount;
+            if (ClipTriggerNone != triggers) {
+                last.info.triggers |= triggers;
+                UINT64 closeFrame = (m_frameCount + m_postRollFrames < last.limitFrame) ? m_frameCount + m_postRollFrames : last.limitFrame;
+                if (closeFrame > last.closeFrame) {
+                    last.closeFrame = closeFrame;
+                }
+            }
+
+            if (m_frameCount >= last.closeFrame) {
+                last.bClosed = true;
+                m_lastClipEndBlock = m_blockCount;
+            }
+            return;
+        }
+    }
+
+    if (ClipTriggerNone == triggers) {
+        return;
+    }
+
+    if (m_pendingTail - m_pendingHead == cMaxPendingClips) {
+        ++m_missedTriggers;
+        return;
+    }
+
+    // Clip starts with block holding first pre-roll frame, or as far back as ring and previous clip allow
+    UINT64 triggerBlock = m_blockCount - 1;
+    UINT64 triggerFrame = GetRecord(triggerBlock).ringFrame;
+    UINT64 preRollFrame = (triggerFrame > m_preRollFrames) ? triggerFrame - m_preRollFrames : 0;
+    UINT64 earliestBlock = (m_oldestBlock > m_lastClipEndBlock) ? m_oldestBlock : m_lastClipEndBlock;
+    UINT64 firstBlock = triggerBlock;
+    while (firstBlock > earliestBlock && GetRecord(firstBlock).ringFrame > preRollFrame) {
+        --firstBlock;
+    }
+
+    PendingClip& clip = m_pending[m_pendingTail % cMaxPendingClips];
+    clip.info.number = m_nextClipNumber++;
+    clip.info.firstSample = GetRecord(firstBlock).samplePosition;
+    clip.info.triggerSample = samplePosition;
+    clip.info.frameCount = 0;
+    clip.info.triggers = triggers;
+    clip.info.droppedBlocks = 0;
+    clip.firstBlock = firstBlock;
+    clip.nextBlock = firstBlock;
+    clip.endBlock = m_blockCount;
+
+    UINT64 limitFrame = GetRecord(firstBlock).ringFrame + m_maxClipFrames;
+    clip.limitFrame = (limitFrame > m_frameCount) ? limitFrame : m_frameCount;
+    clip.closeFrame = (m_frameCount + m_postRollFrames < clip.limitFrame) ? m_frameCount + m_postRollFrames : clip.limitFrame;
+    clip.bClosed = (m_frameCount >= clip.closeFrame);
+    if (clip.bClosed) {
+        m_lastClipEndBlock = m_blockCount;
+    }
+
+    ++m_pendingTail;
+}
+
+/// Body of writer thread.
+void ClipCapture::WriteLoop() {
+    bool bClipStarted = false;
+    bool bFileOpen = false;
+    UINT64 firstWrittenSample = 0;
+    UINT64 framesWritten = 0;
+
+    for (;;) {
+        UINT stagedCount = 0;
+        bool bFinished = false;
+        ClipInfo info;
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            for (;;) {
+                if (m_pendingHead != m_pendingTail) {
+                    const PendingClip& head = m_pending[m_pendingHead % cMaxPendingClips];
+                    if (head.nextBlock < head.endBlock || head.bClosed) {
+                        break;
+                    }
+                }
+                else if (m_bStopping) {
+                    return;
+                }
+
+                m_blocksAppended.wait(lock);
+            }
+
+            PendingClip& clip = m_pending[m_pendingHead % cMaxPendingClips];
+            stagedCount = StageBlocks(clip);
+            info = clip.info;
+            if (clip.bClosed && clip.nextBlock == clip.endBlock) {
+                bFinished = true;
+                ++m_pendingHead;
+            }
+        }
+        m_blocksTaken.notify_one();
+
+        // After a failure, clips are only taken off ring so producer keeps running; Close reports failure
+        if (!bClipStarted) {
+            bClipStarted = true;
+            if (SUCCEEDED(m_writeResult)) {
+                char szPath[cMaxPathLength + cClipNameLength];
+                snprintf(szPath, sizeof(szPath), "%s%04u.ses", m_szPathPrefix, info.number);
+                m_writeResult = m_clipWriter.Open(szPath, m_channelCount, m_sampleRate);
+                bFileOpen = SUCCEEDED(m_writeResult);
+            }
+        }
+
+        UINT64 start = GetClockNanoseconds();
+        for (UINT i = 0; i < stagedCount; ++i) {
+            const BlockRecord& record = m_stagingRecords[i];
+            if (bFileOpen) {
+                HRESULT hr = m_clipWriter.Write(&m_stagingFrames[i * AudioBlock::MaxSamples * m_channelCount], record.sampleCount, record.angles, record.captureTimestamp);
+                if (FAILED(hr)) {
+                    m_writeResult = hr;
+                    m_clipWriter.Close();
+                    bFileOpen = false;
+                }
+            }
+
+            if (0 == framesWritten) {
+                firstWrittenSample = record.samplePosition;
+            }
+            framesWritten += record.sampleCount;
+        }
+        if (stagedCount > 0) {
+            m_writeLatency.Record(GetClockNanoseconds() - start);
+        }
+
+        if (bFinished) {
+            if (bFileOpen) {
+                HRESULT hr = m_clipWriter.Close();
+                if (FAILED(hr)) {
+                    m_writeResult = hr;
+                }
+                bFileOpen = false;
+            }
+
+            // Clip starts later than planned if writer lost its first blocks
+            if (framesWritten > 0) {
+                info.firstSample = firstWrittenSample;
+            }
+            info.frameCount = framesWritten;
+            m_clips.push_back(info);
+            m_clipCount.fetch_add(1, std::memory_order_relaxed);
+
+            bClipStarted = false;
+            framesWritten = 0;
+        }
+    }
+}
+
+/// Copy blocks of a clip out of ring to staging. Lock must be held.
+/// <param name="clip">clip at head of queue.</param>
+/// <returns>number of blocks copied.</returns>
+UINT ClipCapture::StageBlocks(PendingClip& clip) {
+    UINT count = 0;
+    while (count < cStagingBlocks && clip.nextBlock < clip.endBlock) {
+        const BlockRecord& record = GetRecord(clip.nextBlock);
+        int16_t* pDestination = &m_stagingFrames[count * AudioBlock::MaxSamples * m_channelCount];
+
+        size_t offset = static_cast<size_t>(record.ringFrame % m_ringFrames);
+        size_t firstFrames = (record.sampleCount < m_ringFrames - offset) ? record.sampleCount : static_cast<size_t>(m_ringFrames - offset);
+        memcpy(pDestination, &m_ring[offset * m_channelCount], firstFrames * m_channelCount * sizeof(int16_t));
+        if (firstFrames < record.sampleCount) {
+            memcpy(pDestination + firstFrames * m_channelCount, &m_ring[0], (record.sampleCount - firstFrames) * m_channelCount * sizeof(int16_t));
+        }
+
+        m_stagingRecords[count] = record;
+        ++count;
+        ++clip.nextBlock;
+    }
+    return count;
+}
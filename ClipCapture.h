@@ -0,0 +1,271 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "AudioBlock.h"
+#include "AudioPipeline.h"
+#include "LatencyHistogram.h"
+#include "SessionFile.h"
+
+// For clip count read while writer thread finishes clips
+#include <atomic>
+
+// For handing clips to writer thread
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// For pre-roll ring and finished clips
+#include <vector>
+
+/// Conditions on a processed block that start a clip, or keep an open clip from ending.
+enum ClipTrigger {
+    ClipTriggerNone = 0,
+
+    // Block's energy peak reaches energy threshold.
+    ClipTriggerEnergy = 0x1,
+
+    // Voice detected in a block after one without voice. Needs pipeline's voice gate, without which every block has voice.
+    ClipTriggerVoiceOnset = 0x2,
+
+    // Tracked source angle, once known to within angle threshold, moves that far from where it last triggered.
+    ClipTriggerAngleChange = 0x4
+};
+
+/// Triggers and lengths a ClipCapture is opened with.
+struct ClipCaptureSettings {
+    // Combination of ClipTrigger flags.
+    UINT                    triggers;
+
+    // Energy peak, in [0.0,1.0] interval as in AudioPipelineResult, that triggers a clip.
+    float                   energyThreshold;
+
+    // Change in tracked angle, in degrees, that triggers a clip.
+    float                   angleChangeDegrees;
+
+    // Audio kept from before first trigger, and after last trigger, in milliseconds.
+    UINT                    preRollMilliseconds;
+    UINT                    postRollMilliseconds;
+
+    // Longest clip, in milliseconds; triggers still firing when a clip reaches it start the next one.
+    UINT                    maxClipMilliseconds;
+};
+
+/// Clip written by ClipCapture.
+struct ClipInfo {
+    // Number in clip's file name, counting from 0.
+    UINT                    number;
+
+    // Stream position of clip's first sample, and of first sample of block that started clip.
+    UINT64                  firstSample;
+    UINT64                  triggerSample;
+
+    // Number of frames written to clip file.
+    UINT64                  frameCount;
+
+    // ClipTrigger flags of every trigger that started or extended clip.
+    UINT                    triggers;
+
+    // Blocks left out because they were overwritten in ring before writer reached them.
+    uint32_t                droppedBlocks;
+};
+
+/// Keeps the last few seconds of processed blocks and their angles in a fixed-size ring and,
+/// when a block trips one of the configured triggers, saves a clip of pre-roll, the triggering
+/// audio and post-roll as a session file named by prefix and clip number. Triggers firing while
+/// a clip is open extend it.
+/// Append only copies a block into the ring and checks its results against the triggers; a
+/// background writer thread follows each clip through the ring as it grows and streams it to
+/// disk, so capture never waits on a file unless opened to, as suits offline processing.
+/// A writer that falls a whole ring behind loses the oldest blocks of its clip instead.
+/// Memory is fixed by Open, and disk and writer time are only spent on clips.
+/// Append is for one producer thread at a time and performs no allocations.
+class ClipCapture {
+public:
+    // Longest pre-roll, in milliseconds.
+    static const UINT       cMaxPreRollMilliseconds = 60000;
+
+    // Number of clips that can be open or waiting to be written at once; triggers beyond them are missed.
+    static const UINT       cMaxPendingClips = 8;
+
+    /// Settings clip capture is usually opened with: clips of loud events and voice onsets, with 3 seconds
+    /// of pre-roll and 2 of post-roll, at most 30 seconds long. Angle change triggers at 20 degrees, if added.
+    static ClipCaptureSettings GetDefaultSettings();
+
+    /// Constructor
+    ClipCapture();
+
+    /// Destructor. Closes capture, if open.
+    ~ClipCapture();
+
+    /// Allocate pre-roll ring and start writer thread.
+    /// <param name="szPathPrefix">prefix of clip file paths, each followed by 4-digit clip number and ".ses".</param>
+    /// <param name="channelCount">number of interleaved channels in blocks, from 1 to AudioBlock::MaxChannels.</param>
+    /// <param name="sampleRate">sample rate, in Hz.</param>
+    /// <param name="settings">triggers, at least one, and clip lengths. Pre-roll is at most cMaxPreRollMilliseconds and
+    /// longest clip is not 0.</param>
+    /// <param name="bWaitWhenBehind">true for Append to wait for writer rather than overwrite blocks it has yet to write.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range, E_UNEXPECTED if already open.</returns>
+    HRESULT                 Open(const char* szPathPrefix, WORD channelCount, UINT sampleRate, const ClipCaptureSettings& settings, bool bWaitWhenBehind);
+
+    /// Copy a processed block into pre-roll ring and check it against triggers.
+    /// <param name="block">captured audio block.</param>
+    /// <param name="result">pipeline's results for block, giving its stream position, energy, voice and angles.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if channel count does not match or block is too long, E_UNEXPECTED if not open.</returns>
+    HRESULT                 Append(const AudioBlock& block, const AudioPipelineResult& result);
+
+    /// End open clip, wait for writer thread to finish every clip, and stop it.
+    /// Producer must have stopped. Does nothing if not open.
+    /// <returns>S_OK on success, otherwise first failure creating or writing a clip file.</returns>
+    HRESULT                 Close();
+
+    /// Whether capture is open.
+    bool                    IsOpen() const { return m_bOpen; }
+
+    /// Number of clips written to disk so far.
+    UINT                    GetClipCount() const { return m_clipCount.load(std::memory_order_relaxed); }
+
+    /// Clips written, in order. Complete once Close returns; not to be read while capture is open.
+    const std::vector<ClipInfo>& GetClips() const { return m_clips; }
+
+    /// Number of triggers that found cMaxPendingClips clips already waiting, so started none.
+    uint32_t                GetMissedCount() const { return m_missedTriggers; }
+
+    /// Number of blocks clips lost to writer falling behind.
+    uint32_t                GetDroppedCount() const { return m_droppedBlocks.load(std::memory_order_relaxed); }
+
+    /// Duration of each Append call, recorded by producer.
+    const LatencyHistogram& GetAppendLatency() const { return m_appendLatency; }
+
+    /// Duration of each write of blocks to a clip file, recorded by writer thread.
+    const LatencyHistogram& GetWriteLatency() const { return m_writeLatency; }
+
+private:
+    // Audio ring keeps beyond pre-roll, in milliseconds, for writer to fall behind by before blocks are lost.
+    static const UINT       cWriterHeadroomMilliseconds = 2000;
+
+    // Smallest average number of frames per block the ring keeps records for; shorter blocks shorten pre-roll.
+    static const UINT       cMinBlockFrames = 32;
+
+    // Most blocks writer copies out of ring at a time, holding lock that Append takes.
+    static const UINT       cStagingBlocks = 16;
+
+    // Longest clip file path, including number, extension and terminator.
+    static const UINT       cMaxPathLength = 260;
+
+    /// Where a block sits in ring, and what it was captured with.
+    struct BlockRecord {
+        // Count of frames appended before block, locating its frames in ring.
+        UINT64              ringFrame;
+        UINT64              samplePosition;
+        UINT64              captureTimestamp;
+        AudioAngles         angles;
+        UINT                sampleCount;
+    };
+
+    /// Clip open or waiting to be written, as a run of appended blocks.
+    struct PendingClip {
+        ClipInfo            info;
+
+        // Count of blocks appended before clip's first block, before next block writer takes, and after clip's last block.
+        UINT64              firstBlock;
+        UINT64              nextBlock;
+        UINT64              endBlock;
+
+        // Ring frame count at which open clip ends, and beyond which triggers cannot extend it.
+        UINT64              closeFrame;
+        UINT64              limitFrame;
+        bool                bClosed;
+    };
+
+    bool                    m_bOpen;
+    bool                    m_bWaitWhenBehind;
+    char                    m_szPathPrefix[cMaxPathLength];
+    WORD                    m_channelCount;
+    UINT                    m_sampleRate;
+    ClipCaptureSettings     m_settings;
+    UINT64                  m_preRollFrames;
+    UINT64                  m_postRollFrames;
+    UINT64                  m_maxClipFrames;
+
+    // Pre-roll ring of interleaved frames, and of records of blocks they came in.
+    std::vector<int16_t>    m_ring;
+    UINT64                  m_ringFrames;
+    std::vector<BlockRecord> m_blocks;
+    UINT64                  m_blockCapacity;
+
+    // Trigger state carried from block to block. Producer only.
+    bool                    m_bWasVoiceActive;
+    bool                    m_bHaveReferenceAngle;
+    float                   m_referenceAngleDegrees;
+    uint32_t                m_missedTriggers;
+    UINT                    m_nextClipNumber;
+    LatencyHistogram        m_appendLatency;
+
+    // Guards ring contents, counts and pending clips, and stop flag.
+    std::mutex              m_lock;
+    std::condition_variable m_blocksAppended;
+    std::condition_variable m_blocksTaken;
+    bool                    m_bStopping;
+    std::thread             m_writer;
+
+    // Frames and blocks appended since Open, and oldest block still in ring.
+    UINT64                  m_frameCount;
+    UINT64                  m_blockCount;
+    UINT64                  m_oldestBlock;
+
+    // Queue of pending clips: producer opens them at tail, writer finishes them at head.
+    PendingClip             m_pending[cMaxPendingClips];
+    UINT64                  m_pendingHead;
+    UINT64                  m_pendingTail;
+
+    // Block after last block of most recent clip, so clips do not overlap.
+    UINT64                  m_lastClipEndBlock;
+
+    // Written by writer thread only, until it is joined.
+    std::vector<ClipInfo>   m_clips;
+    std::vector<int16_t>    m_stagingFrames;
+    std::vector<BlockRecord> m_stagingRecords;
+    SessionFileWriter       m_clipWriter;
+    LatencyHistogram        m_writeLatency;
+    HRESULT                 m_writeResult;
+    std::atomic<UINT>       m_clipCount;
+    std::atomic<uint32_t>   m_droppedBlocks;
+
+    /// Record of an appended block still in ring.
+    /// <param name="block">count of blocks appended before it.</param>
+    BlockRecord&            GetRecord(UINT64 block) { return m_blocks[static_cast<size_t>(block % m_blockCapacity)]; }
+
+    /// Check a processed block against triggers. Producer only.
+    /// <param name="result">pipeline's results for block.</param>
+    /// <returns>combination of ClipTrigger flags block trips.</returns>
+    UINT                    CheckTriggers(const AudioPipelineResult& result);
+
+    /// Find oldest block that would still be in ring after appending frames.
+    /// <param name="frameCount">number of frames about to be appended.</param>
+    /// <returns>count of blocks appended before that block.</returns>
+    UINT64                  GetOldestBlockAfter(UINT64 frameCount);
+
+    /// Whether appending frames would overwrite a block some pending clip has yet to write. Lock must be held.
+    /// <param name="frameCount">number of frames about to be appended.</param>
+    bool                    IsWriterBehind(UINT64 frameCount);
+
+    /// Retire blocks appending frames overwrites, moving pending clips past any they lose. Lock must be held.
+    /// <param name="frameCount">number of frames about to be appended.</param>
+    void                    RetireBlocks(UINT64 frameCount);
+
+    /// Extend, close or open a clip after a block was appended. Lock must be held.
+    /// <param name="triggers">ClipTrigger flags block tripped.</param>
+    /// <param name="samplePosition">stream position of block.</param>
+    void                    UpdateClips(UINT triggers, UINT64 samplePosition);
+
+    /// Body of writer thread.
+    void                    WriteLoop();
+
+    /// Copy blocks of a clip out of ring to staging. Lock must be held.
+    /// <param name="clip">clip at head of queue.</param>
+    /// <returns>number of blocks copied.</returns>
+    UINT                    StageBlocks(PendingClip& clip);
+
+    ClipCapture(const ClipCapture&);
+    ClipCapture& operator=(const ClipCapture&);
+};
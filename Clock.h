@@ -0,0 +1,33 @@
+﻿#pragma once
+
+#include "Platform.h"
+
+#ifndef _WIN32
+// For clock_gettime
+#include <time.h>
+#endif
+
+/// Read a monotonic, high resolution clock.
+/// Uses QueryPerformanceCounter on Windows, since steady_clock in the VS2013 runtime
+/// only ticks at system timer resolution.
+/// <returns>nanoseconds since an arbitrary fixed point.</returns>
+inline UINT64 GetClockNanoseconds() {
+#ifdef _WIN32
+    // Constant initialized, so concurrent first calls at worst both query the same frequency
+    static LARGE_INTEGER frequency = {0};
+    if (0 == frequency.QuadPart) {
+        QueryPerformanceFrequency(&frequency);
+    }
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+
+    UINT64 seconds = counter.QuadPart / frequency.QuadPart;
+    UINT64 remainder = counter.QuadPart % frequency.QuadPart;
+    return seconds * 1000000000 + remainder * 1000000000 / frequency.QuadPart;
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<UINT64>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#endif
+}
@@ -0,0 +1,512 @@
+﻿#include "EchoCanceller.h"
+#include "Stft.h"
+
+// For exp and log10
+#include <math.h>
+
+// Normalized step size of filter adaptation, in (0.0,1.0) interval. Larger converges faster
+// but leaves more misadjustment noise behind.
+static const float cStepSize = 0.5f;
+
+// Time constant, in seconds, of levels used for echo return loss enhancement.
+static const float cLevelSmoothingSeconds = 0.5f;
+
+// Fraction of reference power averaged over all bins added to each bin's power before it
+// normalizes that bin's step. Tonal references leak into neighboring bins, which then get
+// steps so large that adaptation diverges; this keeps their steps in proportion.
+static const float cSpectralRegularization = 0.05f;
+
+// RMS reference level, in 16-bit sample units, below which adaptation slows down rather
+// than chasing noise (about -60 dB below full scale).
+static const float cReferenceFloorRms = 32.0f;
+
+/// Multiply-accumulate interleaved complex spectra: pAccumulator += pA * pB, bin by bin.
+/// <param name="pAccumulator">spectrum accumulated into.</param>
+/// <param name="pA">first factor.</param>
+/// <param name="pB">second factor.</param>
+/// <param name="count">number of floats in each spectrum, even.</param>
+static void MultiplyAccumulateScalar(float* pAccumulator, const float* pA, const float* pB, UINT count) {
+    for (UINT i = 0; i < count; i += 2) {
+        pAccumulator[i] += pA[i] * pB[i] - pA[i + 1] * pB[i + 1];
+        pAccumulator[i + 1] += pA[i] * pB[i + 1] + pA[i + 1] * pB[i];
+    }
+}
+
+/// Multiply-accumulate with first factor conjugated: pAccumulator += conj(pA) * pB, bin by bin.
+static void ConjugateMultiplyAccumulateScalar(float* pAccumulator, const float* pA, const float* pB, UINT count) {
+    for (UINT i = 0; i < count; i += 2) {
+        pAccumulator[i] += pA[i] * pB[i] + pA[i + 1] * pB[i + 1];
+        pAccumulator[i + 1] += pA[i] * pB[i + 1] - pA[i + 1] * pB[i];
+    }
+}
+
+/// Slide each reference bin's power, summed over all partitions, by one block and derive its
+/// normalized step size. Power and step are stored twice per bin, matching interleaved spectrum.
+/// <param name="pStepSizes">receives step size of each bin.</param>
+/// <param name="pPower">power of each bin summed over partitions, updated.</param>
+/// <param name="pNewest">spectrum entering filter.</param>
+/// <param name="pOldest">spectrum leaving filter.</param>
+/// <param name="count">number of floats in each array, even.</param>
+/// <param name="floor">regularization added to power.</param>
+static void UpdateStepSizesScalar(float* pStepSizes, float* pPower, const float* pNewest, const float* pOldest, UINT count, float floor) {
+    for (UINT i = 0; i < count; i += 2) {
+        float power = pPower[i]
+            + pNewest[i] * pNewest[i] + pNewest[i + 1] * pNewest[i + 1]
+            - pOldest[i] * pOldest[i] - pOldest[i + 1] * pOldest[i + 1];
+
+        // Rounding left over from loud audio that has since left must not go negative
+        power = (power > 0.0f) ? power : 0.0f;
+
+        pPower[i] = pPower[i + 1] = power;
+        pStepSizes[i] = pStepSizes[i + 1] = cStepSize / (power + floor);
+    }
+}
+
+#ifdef AUDIO_SIMD_X86
+
+/// SSE2 version of MultiplyAccumulateScalar, two bins at a time.
+/// Real and imaginary parts of B are broadcast across each bin, A is swapped within each bin,
+/// and the sign of the imaginary product's real half is flipped with xor.
+AUDIO_TARGET_SSE2
+static void MultiplyAccumulateSse2(float* pAccumulator, const float* pA, const float* pB, UINT count) {
+    const __m128 negateReal = _mm_castsi128_ps(_mm_setr_epi32(0x80000000, 0, 0x80000000, 0));
+
+    UINT i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 a = _mm_loadu_ps(pA + i);
+        __m128 b = _mm_loadu_ps(pB + i);
+        __m128 bReal = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 0, 0));
+        __m128 bImag = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 1, 1));
+        __m128 aSwapped = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+
+        __m128 product = _mm_add_ps(_mm_mul_ps(a, bReal), _mm_xor_ps(_mm_mul_ps(aSwapped, bImag), negateReal));
+        _mm_storeu_ps(pAccumulator + i, _mm_add_ps(_mm_loadu_ps(pAccumulator + i), product));
+    }
+
+    MultiplyAccumulateScalar(pAccumulator + i, pA + i, pB + i, count - i);
+}
+
+/// SSE2 version of ConjugateMultiplyAccumulateScalar, two bins at a time.
+AUDIO_TARGET_SSE2
+static void ConjugateMultiplyAccumulateSse2(float* pAccumulator, const float* pA, const float* pB, UINT count) {
+    const __m128 negateImag = _mm_castsi128_ps(_mm_setr_epi32(0, 0x80000000, 0, 0x80000000));
+
+    UINT i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 a = _mm_loadu_ps(pA + i);
+        __m128 b = _mm_loadu_ps(pB + i);
+        __m128 aReal = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 0, 0));
+        __m128 aImag = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 1, 1));
+        __m128 bSwapped = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1));
+
+        __m128 product = _mm_add_ps(_mm_mul_ps(aReal, b), _mm_xor_ps(_mm_mul_ps(aImag, bSwapped), negateImag));
+        _mm_storeu_ps(pAccumulator + i, _mm_add_ps(_mm_loadu_ps(pAccumulator + i), product));
+    }
+
+    ConjugateMultiplyAccumulateScalar(pAccumulator + i, pA + i, pB + i, count - i);
+}
+
+/// SSE2 version of UpdateStepSizesScalar, two bins at a time. Squares are added to their
+/// swapped copy so each lane holds its bin's power, as in NoiseSuppressor.
+AUDIO_TARGET_SSE2
+static void UpdateStepSizesSse2(float* pStepSizes, float* pPower, const float* pNewest, const float* pOldest, UINT count, float floor) {
+    const __m128 powerFloor = _mm_set1_ps(floor);
+    const __m128 stepSize = _mm_set1_ps(cStepSize);
+    const __m128 zero = _mm_setzero_ps();
+
+    UINT i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 newest = _mm_loadu_ps(pNewest + i);
+        __m128 oldest = _mm_loadu_ps(pOldest + i);
+        __m128 change = _mm_sub_ps(_mm_mul_ps(newest, newest), _mm_mul_ps(oldest, oldest));
+        change = _mm_add_ps(change, _mm_shuffle_ps(change, change, _MM_SHUFFLE(2, 3, 0, 1)));
+
+        __m128 power = _mm_max_ps(_mm_add_ps(_mm_loadu_ps(pPower + i), change), zero);
+        _mm_storeu_ps(pPower + i, power);
+        _mm_storeu_ps(pStepSizes + i, _mm_div_ps(stepSize, _mm_add_ps(power, powerFloor)));
+    }
+
+    UpdateStepSizesScalar(pStepSizes + i, pPower + i, pNewest + i, pOldest + i, count - i, floor);
+}
+
+/// AVX2 version of MultiplyAccumulateScalar, four bins at a time. fmaddsub subtracts the
+/// imaginary product from real lanes and adds it to imaginary ones.
+AUDIO_TARGET_AVX2
+static void MultiplyAccumulateAvx2(float* pAccumulator, const float* pA, const float* pB, UINT count) {
+    UINT i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 a = _mm256_loadu_ps(pA + i);
+        __m256 b = _mm256_loadu_ps(pB + i);
+        __m256 bReal = _mm256_moveldup_ps(b);
+        __m256 bImag = _mm256_movehdup_ps(b);
+        __m256 aSwapped = _mm256_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1));
+
+        __m256 product = _mm256_fmaddsub_ps(a, bReal, _mm256_mul_ps(aSwapped, bImag));
+        _mm256_storeu_ps(pAccumulator + i, _mm256_add_ps(_mm256_loadu_ps(pAccumulator + i), product));
+    }
+
+    // Tail is called, not inlined, so upper halves are cleared first as in NoiseSuppressor
+    _mm256_zeroupper();
+
+    MultiplyAccumulateScalar(pAccumulator + i, pA + i, pB + i, count - i);
+}
+
+/// AVX2 version of ConjugateMultiplyAccumulateScalar, four bins at a time. fmsubadd adds the
+/// cross product to real lanes and subtracts it from imaginary ones.
+AUDIO_TARGET_AVX2
+static void ConjugateMultiplyAccumulateAvx2(float* pAccumulator, const float* pA, const float* pB, UINT count) {
+    UINT i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 a = _mm256_loadu_ps(pA + i);
+        __m256 b = _mm256_loadu_ps(pB + i);
+        __m256 aReal = _mm256_moveldup_ps(a);
+        __m256 aImag = _mm256_movehdup_ps(a);
+        __m256 bSwapped = _mm256_permute_ps(b, _MM_SHUFFLE(2, 3, 0, 1));
+
+        __m256 product = _mm256_fmsubadd_ps(aReal, b, _mm256_mul_ps(aImag, bSwapped));
+        _mm256_storeu_ps(pAccumulator + i, _mm256_add_ps(_mm256_loadu_ps(pAccumulator + i), product));
+    }
+
+    _mm256_zeroupper();
+
+    ConjugateMultiplyAccumulateScalar(pAccumulator + i, pA + i, pB + i, count - i);
+}
+
+/// AVX2 version of UpdateStepSizesScalar, four bins at a time.
+AUDIO_TARGET_AVX2
+static void UpdateStepSizesAvx2(float* pStepSizes, float* pPower, const float* pNewest, const float* pOldest, UINT count, float floor) {
+    const __m256 powerFloor = _mm256_set1_ps(floor);
+    const __m256 stepSize = _mm256_set1_ps(cStepSize);
+    const __m256 zero = _mm256_setzero_ps();
+
+    UINT i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 newest = _mm256_loadu_ps(pNewest + i);
+        __m256 oldest = _mm256_loadu_ps(pOldest + i);
+        __m256 change = _mm256_fmsub_ps(newest, newest, _mm256_mul_ps(oldest, oldest));
+        change = _mm256_add_ps(change, _mm256_permute_ps(change, _MM_SHUFFLE(2, 3, 0, 1)));
+
+        __m256 power = _mm256_max_ps(_mm256_add_ps(_mm256_loadu_ps(pPower + i), change), zero);
+        _mm256_storeu_ps(pPower + i, power);
+        _mm256_storeu_ps(pStepSizes + i, _mm256_div_ps(stepSize, _mm256_add_ps(power, powerFloor)));
+    }
+
+    _mm256_zeroupper();
+
+    UpdateStepSizesScalar(pStepSizes + i, pPower + i, pNewest + i, pOldest + i, count - i, floor);
+}
+
+#endif
+
+/// Multiply-accumulate interleaved complex spectra, using requested instruction set.
+static void MultiplyAccumulate(SimdLevel level, float* pAccumulator, const float* pA, const float* pB, UINT count) {
+#ifdef AUDIO_SIMD_X86
+    if (SimdLevelAvx2 == level) {
+        MultiplyAccumulateAvx2(pAccumulator, pA, pB, count);
+        return;
+    }
+
+    if (SimdLevelSse2 == level) {
+        MultiplyAccumulateSse2(pAccumulator, pA, pB, count);
+        return;
+    }
+#else
+    (void)level;
+#endif
+
+    MultiplyAccumulateScalar(pAccumulator, pA, pB, count);
+}
+
+/// Multiply-accumulate with first factor conjugated, using requested instruction set.
+static void ConjugateMultiplyAccumulate(SimdLevel level, float* pAccumulator, const float* pA, const float* pB, UINT count) {
+#ifdef AUDIO_SIMD_X86
+    if (SimdLevelAvx2 == level) {
+        ConjugateMultiplyAccumulateAvx2(pAccumulator, pA, pB, count);
+        return;
+    }
+
+    if (SimdLevelSse2 == level) {
+        ConjugateMultiplyAccumulateSse2(pAccumulator, pA, pB, count);
+        return;
+    }
+#else
+    (void)level;
+#endif
+
+    ConjugateMultiplyAccumulateScalar(pAccumulator, pA, pB, count);
+}
+
+/// Slide reference power and update step sizes, using requested instruction set.
+static void UpdateStepSizes(SimdLevel level, float* pStepSizes, float* pPower, const float* pNewest, const float* pOldest, UINT count, float floor) {
+#ifdef AUDIO_SIMD_X86
+    if (SimdLevelAvx2 == level) {
+        UpdateStepSizesAvx2(pStepSizes, pPower, pNewest, pOldest, count, floor);
+        return;
+    }
+
+    if (SimdLevelSse2 == level) {
+        UpdateStepSizesSse2(pStepSizes, pPower, pNewest, pOldest, count, floor);
+        return;
+    }
+#else
+    (void)level;
+#endif
+
+    UpdateStepSizesScalar(pStepSizes, pPower, pNewest, pOldest, count, floor);
+}
+
+/// Constructor
+EchoCanceller::EchoCanceller() :
+    m_blockSize(0),
+    m_partitionCount(0),
+    m_channelCount(0),
+    m_level(SimdLevelScalar),
+    m_spectrumLength(0),
+    m_pReferenceHistory(NULL),
+    m_pReferenceSpectra(NULL),
+    m_newestSpectrum(0),
+    m_pReferencePower(NULL),
+    m_pStepSizes(NULL),
+    m_meanReferencePower(0.0f),
+    m_pWeights(NULL),
+    m_pCaptureBlock(NULL),
+    m_pOutputBlock(NULL),
+    m_blockPosition(0),
+    m_pFrame(NULL),
+    m_constrainedPartition(0),
+    m_pCapturePower(NULL),
+    m_pOutputPower(NULL),
+    m_levelSmoothing(0.0f),
+    m_powerFloor(0.0f) {
+}
+
+/// Destructor
+EchoCanceller::~EchoCanceller() {
+    delete [] m_pReferenceHistory;
+    delete [] m_pReferenceSpectra;
+    delete [] m_pReferencePower;
+    delete [] m_pStepSizes;
+    delete [] m_pWeights;
+    delete [] m_pCaptureBlock;
+    delete [] m_pOutputBlock;
+    delete [] m_pFrame;
+    delete [] m_pCapturePower;
+    delete [] m_pOutputPower;
+}
+
+/// Configure filter and allocate history, filters and workspaces.
+/// <param name="blockSize">samples per block, a power of two from cMinBlockSize to cMaxBlockSize.
+/// Sets latency; smaller blocks need more partitions for the same tail.</param>
+/// <param name="tailLength">longest echo path to model, in samples, up to cMaxTailLength. Rounded up to whole blocks.</param>
+/// <param name="channelCount">number of interleaved captured channels, each with its own filter.</param>
+/// <param name="sampleRate">sample rate of audio, in Hz, used to scale time constants.</param>
+/// <param name="level">instruction set used by FFT and spectrum kernels.</param>
+/// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range.</returns>
+HRESULT EchoCanceller::Initialize(UINT blockSize, UINT tailLength, UINT channelCount, UINT sampleRate, SimdLevel level) {
+    if (blockSize < cMinBlockSize || blockSize > cMaxBlockSize || 0 == tailLength || tailLength > cMaxTailLength || 0 == channelCount || 0 == sampleRate) {
+        return E_INVALIDARG;
+    }
+
+    // Each block is transformed with the one before it, so linear convolution fits without wrapping
+    HRESULT hr = m_plan.Initialize(2 * blockSize, level);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    delete [] m_pReferenceHistory;
+    delete [] m_pReferenceSpectra;
+    delete [] m_pReferencePower;
+    delete [] m_pStepSizes;
+    delete [] m_pWeights;
+    delete [] m_pCaptureBlock;
+    delete [] m_pOutputBlock;
+    delete [] m_pFrame;
+    delete [] m_pCapturePower;
+    delete [] m_pOutputPower;
+
+    m_blockSize = blockSize;
+    m_partitionCount = (tailLength + blockSize - 1) / blockSize;
+    m_channelCount = channelCount;
+    m_level = level;
+    m_spectrumLength = 2 * blockSize + 2;
+
+    m_pReferenceHistory = new float[2 * blockSize];
+    m_pReferenceSpectra = new float[m_partitionCount * m_spectrumLength];
+    m_pReferencePower = new float[m_spectrumLength];
+    m_pStepSizes = new float[m_spectrumLength];
+    m_pWeights = new float[channelCount * m_partitionCount * m_spectrumLength];
+    m_pCaptureBlock = new float[channelCount * blockSize];
+    m_pOutputBlock = new float[channelCount * blockSize];
+    m_pFrame = new float[m_spectrumLength];
+    m_pCapturePower = new float[channelCount];
+    m_pOutputPower = new float[channelCount];
+
+    double blockSeconds = static_cast<double>(blockSize) / sampleRate;
+    m_levelSmoothing = static_cast<float>(exp(-blockSeconds / cLevelSmoothingSeconds));
+
+    // A transform of 2 * blockSize samples of white noise has expected bin power 2 * blockSize
+    // times its variance, and power is summed over every partition
+    m_powerFloor = 2.0f * blockSize * m_partitionCount * cReferenceFloorRms * cReferenceFloorRms;
+
+    Reset();
+
+    return S_OK;
+}
+
+/// Forget audio carried between calls and return filters to zero. Output restarts with one block of silence.
+void EchoCanceller::Reset() {
+    if (NULL == m_pWeights) {
+        return;
+    }
+
+    memset(m_pReferenceHistory, 0, 2 * m_blockSize * sizeof(float));
+    memset(m_pReferenceSpectra, 0, m_partitionCount * m_spectrumLength * sizeof(float));
+    memset(m_pReferencePower, 0, m_spectrumLength * sizeof(float));
+    memset(m_pStepSizes, 0, m_spectrumLength * sizeof(float));
+    memset(m_pWeights, 0, m_channelCount * m_partitionCount * m_spectrumLength * sizeof(float));
+    memset(m_pCaptureBlock, 0, m_channelCount * m_blockSize * sizeof(float));
+    memset(m_pOutputBlock, 0, m_channelCount * m_blockSize * sizeof(float));
+    memset(m_pCapturePower, 0, m_channelCount * sizeof(float));
+    memset(m_pOutputPower, 0, m_channelCount * sizeof(float));
+
+    m_newestSpectrum = 0;
+    m_meanReferencePower = 0.0f;
+    m_blockPosition = 0;
+    m_constrainedPartition = 0;
+}
+
+/// Remove echo of reference from captured audio, in place. Does nothing before Initialize.
+/// <param name="pCapture">interleaved captured frames; receives output delayed by GetLatency frames.</param>
+/// <param name="pReference">mono playback reference, one sample per captured frame, time aligned with capture.</param>
+/// <param name="frameCount">number of frames.</param>
+void EchoCanceller::Process(int16_t* pCapture, const int16_t* pReference, UINT frameCount) {
+    if (0 == m_blockSize) {
+        return;
+    }
+
+    while (frameCount > 0) {
+        UINT count = m_blockSize - m_blockPosition;
+        count = (frameCount < count) ? frameCount : count;
+
+        float* pReferenceBlock = m_pReferenceHistory + m_blockSize + m_blockPosition;
+        for (UINT i = 0; i < count; ++i) {
+            pReferenceBlock[i] = static_cast<float>(pReference[i]);
+        }
+
+        // Each captured sample is replaced by completed output of its channel
+        for (UINT c = 0; c < m_channelCount; ++c) {
+            float* pCaptureBlock = m_pCaptureBlock + c * m_blockSize + m_blockPosition;
+            const float* pOutputBlock = m_pOutputBlock + c * m_blockSize + m_blockPosition;
+            int16_t* pSample = pCapture + c;
+
+            for (UINT i = 0; i < count; ++i, pSample += m_channelCount) {
+                pCaptureBlock[i] = static_cast<float>(*pSample);
+
+                float output = pOutputBlock[i];
+                output = (output > 32767.0f) ? 32767.0f : ((output < -32768.0f) ? -32768.0f : output);
+                *pSample = static_cast<int16_t>(floorf(output + 0.5f));
+            }
+        }
+
+        m_blockPosition += count;
+        pCapture += count * m_channelCount;
+        pReference += count;
+        frameCount -= count;
+
+        if (m_blockPosition == m_blockSize) {
+            m_blockPosition = 0;
+            ProcessBlock();
+        }
+    }
+}
+
+/// Echo return loss enhancement averaged over channels, in dB: how far captured power
+/// has been pushed down, smoothed over recent blocks.
+float EchoCanceller::GetEchoReturnLossEnhancementDb() const {
+    if (0 == m_channelCount) {
+        return 0.0f;
+    }
+
+    float sum = 0.0f;
+    for (UINT c = 0; c < m_channelCount; ++c) {
+        // Tiny offsets keep silence at 0 dB rather than undefined
+        sum += 10.0f * log10f((m_pCapturePower[c] + 1e-3f) / (m_pOutputPower[c] + 1e-3f));
+    }
+
+    return sum / m_channelCount;
+}
+
+/// Cancel echo in completed block of every channel and adapt filters.
+void EchoCanceller::ProcessBlock() {
+    const UINT length = m_spectrumLength;
+
+    // Newest reference spectrum replaces oldest one in ring, once oldest's power is taken out of step sizes.
+    // Filter input spans every partition, so each step is normalized by power summed over all of them.
+    memcpy(m_pFrame, m_pReferenceHistory, 2 * m_blockSize * sizeof(float));
+    m_plan.Forward(m_pFrame);
+    memcpy(m_pReferenceHistory, m_pReferenceHistory + m_blockSize, m_blockSize * sizeof(float));
+
+    m_newestSpectrum = (0 == m_newestSpectrum) ? m_partitionCount - 1 : m_newestSpectrum - 1;
+    float* pNewest = m_pReferenceSpectra + m_newestSpectrum * length;
+    UpdateStepSizes(m_level, m_pStepSizes, m_pReferencePower, m_pFrame, pNewest, length,
+        m_powerFloor + cSpectralRegularization * m_meanReferencePower);
+    memcpy(pNewest, m_pFrame, length * sizeof(float));
+
+    // Average is taken after steps are updated, so it regularizes next block's steps
+    float powerSum = 0.0f;
+    for (UINT i = 0; i < length; i += 2) {
+        powerSum += m_pReferencePower[i];
+    }
+    m_meanReferencePower = powerSum / (length / 2);
+
+    for (UINT c = 0; c < m_channelCount; ++c) {
+        float* pWeights = m_pWeights + c * m_partitionCount * length;
+
+        // Echo estimate: partition p filters reference spectrum p blocks old
+        memset(m_pFrame, 0, length * sizeof(float));
+        for (UINT p = 0; p < m_partitionCount; ++p) {
+            const float* pSpectrum = m_pReferenceSpectra + ((m_newestSpectrum + p) % m_partitionCount) * length;
+            MultiplyAccumulate(m_level, m_pFrame, pWeights + p * length, pSpectrum, length);
+        }
+        m_plan.Inverse(m_pFrame);
+
+        // Second half of overlap-save output is free of wrap-around; error is what estimate misses
+        const float* pCaptureBlock = m_pCaptureBlock + c * m_blockSize;
+        float* pOutputBlock = m_pOutputBlock + c * m_blockSize;
+        float capturePower = 0.0f;
+        float outputPower = 0.0f;
+        for (UINT i = 0; i < m_blockSize; ++i) {
+            float error = pCaptureBlock[i] - m_pFrame[m_blockSize + i];
+            pOutputBlock[i] = error;
+            capturePower += pCaptureBlock[i] * pCaptureBlock[i];
+            outputPower += error * error;
+        }
+        m_pCapturePower[c] = m_pCapturePower[c] * m_levelSmoothing + capturePower / m_blockSize * (1.0f - m_levelSmoothing);
+        m_pOutputPower[c] = m_pOutputPower[c] * m_levelSmoothing + outputPower / m_blockSize * (1.0f - m_levelSmoothing);
+
+        // Error spectrum, zero padded in front so it lines up with second half of reference window
+        memset(m_pFrame, 0, m_blockSize * sizeof(float));
+        memcpy(m_pFrame + m_blockSize, pOutputBlock, m_blockSize * sizeof(float));
+        m_plan.Forward(m_pFrame);
+        ApplyWindow(m_level, m_pFrame, m_pFrame, m_pStepSizes, length);
+
+        for (UINT p = 0; p < m_partitionCount; ++p) {
+            const float* pSpectrum = m_pReferenceSpectra + ((m_newestSpectrum + p) % m_partitionCount) * length;
+            ConjugateMultiplyAccumulate(m_level, pWeights + p * length, pSpectrum, m_pFrame, length);
+        }
+
+        ConstrainPartition(pWeights + m_constrainedPartition * length);
+    }
+
+    m_constrainedPartition = (m_constrainedPartition + 1) % m_partitionCount;
+}
+
+/// Remove non-causal half of a filter partition's impulse response.
+/// <param name="pWeights">spectrum of partition, constrained in place.</param>
+void EchoCanceller::ConstrainPartition(float* pWeights) {
+    memcpy(m_pFrame, pWeights, m_spectrumLength * sizeof(float));
+    m_plan.Inverse(m_pFrame);
+    memset(m_pFrame + m_blockSize, 0, m_blockSize * sizeof(float));
+    m_plan.Forward(m_pFrame);
+    memcpy(pWeights, m_pFrame, m_spectrumLength * sizeof(float));
+}
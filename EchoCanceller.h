@@ -0,0 +1,134 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "Fft.h"
+#include "Simd.h"
+
+/// Acoustic echo canceller for 16-bit PCM, using a partitioned block frequency domain
+/// adaptive filter (multidelay filter).
+/// The echo path from a playback reference to each captured channel is modeled by a filter
+/// split into partitions one block long. Every block, the reference's newest spectrum is
+/// added to a ring of recent spectra, the echo estimate is the sum over partitions of
+/// filter times reference spectrum, and each partition adapts by normalized LMS toward
+/// the remaining error, each bin's step scaled down by its reference power summed over
+/// partitions. The gradient constraint, which keeps partitions causal, costs two
+/// transforms per partition, so only one partition is constrained per block, in turn.
+/// Reference transforms and step sizes are shared by all captured channels.
+/// Output lags input by exactly one block, whatever block sizes are fed.
+/// Memory is allocated by Initialize; Process performs no allocations.
+class EchoCanceller {
+public:
+    // Smallest and largest supported block, in samples.
+    static const UINT       cMinBlockSize = 8;
+    static const UINT       cMaxBlockSize = 2048;
+
+    // Longest supported echo tail, in samples (1 s at 16 kHz).
+    static const UINT       cMaxTailLength = 16000;
+
+    // Block and tail used when caller has no preference (8 ms latency, 128 ms tail at 16 kHz).
+    static const UINT       cDefaultBlockSize = 128;
+    static const UINT       cDefaultTailLength = 2048;
+
+    /// Constructor
+    EchoCanceller();
+
+    /// Destructor
+    ~EchoCanceller();
+
+    /// Configure filter and allocate history, filters and workspaces.
+    /// <param name="blockSize">samples per block, a power of two from cMinBlockSize to cMaxBlockSize.
+    /// Sets latency; smaller blocks need more partitions for the same tail.</param>
+    /// <param name="tailLength">longest echo path to model, in samples, up to cMaxTailLength. Rounded up to whole blocks.</param>
+    /// <param name="channelCount">number of interleaved captured channels, each with its own filter.</param>
+    /// <param name="sampleRate">sample rate of audio, in Hz, used to scale time constants.</param>
+    /// <param name="level">instruction set used by FFT and spectrum kernels.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range.</returns>
+    HRESULT                 Initialize(UINT blockSize, UINT tailLength, UINT channelCount, UINT sampleRate, SimdLevel level);
+
+    /// Forget audio carried between calls and return filters to zero. Output restarts with one block of silence.
+    void                    Reset();
+
+    /// Remove echo of reference from captured audio, in place. Does nothing before Initialize.
+    /// <param name="pCapture">interleaved captured frames; receives output delayed by GetLatency frames.</param>
+    /// <param name="pReference">mono playback reference, one sample per captured frame, time aligned with capture.</param>
+    /// <param name="frameCount">number of frames.</param>
+    void                    Process(int16_t* pCapture, const int16_t* pReference, UINT frameCount);
+
+    /// Samples per block.
+    UINT                    GetBlockSize() const { return m_blockSize; }
+
+    /// Number of filter partitions, each one block long.
+    UINT                    GetPartitionCount() const { return m_partitionCount; }
+
+    /// Length of echo tail modeled, in samples.
+    UINT                    GetTailLength() const { return m_partitionCount * m_blockSize; }
+
+    /// Delay, in samples, between input and output.
+    UINT                    GetLatency() const { return m_blockSize; }
+
+    /// Echo return loss enhancement averaged over channels, in dB: how far captured power
+    /// has been pushed down, smoothed over recent blocks.
+    float                   GetEchoReturnLossEnhancementDb() const;
+
+private:
+    UINT                    m_blockSize;
+    UINT                    m_partitionCount;
+    UINT                    m_channelCount;
+    SimdLevel               m_level;
+
+    // Floats in each spectrum: blockSize + 1 interleaved complex bins of a 2 * blockSize transform.
+    UINT                    m_spectrumLength;
+
+    RealFftPlan             m_plan;
+
+    // Previous and current block of reference, transformed together each block. 2 * blockSize floats.
+    float*                  m_pReferenceHistory;
+
+    // Ring of partitionCount most recent reference spectra, and slot holding newest.
+    float*                  m_pReferenceSpectra;
+    UINT                    m_newestSpectrum;
+
+    // Power of each reference bin summed over spectra in ring, and step size derived from it,
+    // stored twice so they line up with interleaved spectra.
+    float*                  m_pReferencePower;
+    float*                  m_pStepSizes;
+
+    // Reference power averaged over bins, as of previous block.
+    float                   m_meanReferencePower;
+
+    // Per channel filter, partitionCount spectra each, newest partition first.
+    float*                  m_pWeights;
+
+    // Per channel captured samples of current block, and completed output written out while it fills.
+    float*                  m_pCaptureBlock;
+    float*                  m_pOutputBlock;
+
+    // Samples of current block already read from input and written to output.
+    UINT                    m_blockPosition;
+
+    // Transform workspace. spectrumLength floats.
+    float*                  m_pFrame;
+
+    // Partition whose gradient constraint is applied next.
+    UINT                    m_constrainedPartition;
+
+    // Per channel smoothed power of captured audio and of output, for echo return loss enhancement.
+    float*                  m_pCapturePower;
+    float*                  m_pOutputPower;
+
+    // Weight of previous levels each block.
+    float                   m_levelSmoothing;
+
+    // Regularization added to reference power, so silent bins don't get huge steps.
+    float                   m_powerFloor;
+
+    /// Cancel echo in completed block of every channel and adapt filters.
+    void                    ProcessBlock();
+
+    /// Remove non-causal half of a filter partition's impulse response.
+    /// <param name="pWeights">spectrum of partition, constrained in place.</param>
+    void                    ConstrainPartition(float* pWeights);
+
+    EchoCanceller(const EchoCanceller&);
+    EchoCanceller& operator=(const EchoCanceller&);
+};
@@ -0,0 +1,100 @@
+﻿#include "EchoCancellingAudioSource.h"
+
+/// Constructor
+/// <param name="pCaptureSource">source whose audio has echo removed. Takes ownership.</param>
+/// <param name="pReferenceSource">mono source of audio played through speakers. Takes ownership.</param>
+EchoCancellingAudioSource::EchoCancellingAudioSource(AudioSource* pCaptureSource, AudioSource* pReferenceSource) :
+    m_pCaptureSource(pCaptureSource),
+    m_pReferenceSource(pReferenceSource),
+    m_referenceCount(0) {
+}
+
+/// Destructor
+EchoCancellingAudioSource::~EchoCancellingAudioSource() {
+    delete m_pCaptureSource;
+    delete m_pReferenceSource;
+}
+
+/// Configure echo canceller for capture source's channels.
+/// <param name="blockSize">samples per canceller block, a power of two. Sets latency.</param>
+/// <param name="tailLength">longest echo path to model, in samples.</param>
+/// <param name="level">instruction set used by canceller.</param>
+/// <returns>S_OK on success, E_INVALIDARG if reference has more than one channel or a parameter is out of range.</returns>
+HRESULT EchoCancellingAudioSource::Initialize(UINT blockSize, UINT tailLength, SimdLevel level) {
+    if (AudioChannels != m_pReferenceSource->GetChannelCount()) {
+        return E_INVALIDARG;
+    }
+
+    m_referenceCount = 0;
+
+    return m_canceller.Initialize(blockSize, tailLength, m_pCaptureSource->GetChannelCount(), AudioSamplesPerSecond, level);
+}
+
+/// Read next chunk of capture source's audio, with echo removed.
+/// <param name="pBuffer">buffer that receives PCM data. Its length is set to amount of data produced.</param>
+/// <param name="pAngles">receives angles reported by capture source.</param>
+/// <param name="pbMoreAvailable">set to true if more audio can be read immediately.</param>
+/// <returns>S_OK if audio was produced, S_FALSE if none is available right now, otherwise failure code.</returns>
+HRESULT EchoCancellingAudioSource::Read(IMediaBuffer* pBuffer, AudioAngles* pAngles, bool* pbMoreAvailable) {
+    HRESULT hr = m_pCaptureSource->Read(pBuffer, pAngles, pbMoreAvailable);
+    if (S_OK != hr) {
+        return hr;
+    }
+
+    BYTE* pData = NULL;
+    DWORD cbData = 0;
+    pBuffer->GetBufferAndLength(&pData, &cbData);
+
+    // Capture may hand over at most a second of audio at once, which is all the reference buffer holds
+    UINT frameCount = cbData / (AudioBlockAlign * GetChannelCount());
+    if (frameCount > AudioSamplesPerSecond) {
+        return E_UNEXPECTED;
+    }
+
+    hr = FillReference(frameCount);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    m_canceller.Process(reinterpret_cast<int16_t*>(pData), m_reference, frameCount);
+
+    m_referenceCount -= frameCount;
+    memmove(m_reference, m_reference + frameCount, m_referenceCount * sizeof(int16_t));
+
+    return S_OK;
+}
+
+/// Read reference until it holds at least frameCount samples, padding with silence once it runs out.
+/// <param name="frameCount">number of samples needed, at most AudioSamplesPerSecond.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT EchoCancellingAudioSource::FillReference(UINT frameCount) {
+    while (m_referenceCount < frameCount && !m_pReferenceSource->IsFinished()) {
+        AudioAngles angles;
+        bool bMoreAvailable = false;
+        HRESULT hr = m_pReferenceSource->Read(&m_referenceBuffer, &angles, &bMoreAvailable);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        // Reference that has nothing ready is treated as silent rather than holding capture back
+        if (S_FALSE == hr) {
+            break;
+        }
+
+        BYTE* pData = NULL;
+        DWORD cbData = 0;
+        m_referenceBuffer.GetBufferAndLength(&pData, &cbData);
+
+        UINT count = cbData / AudioBlockAlign;
+        count = (count < cMaxReferenceSamples - m_referenceCount) ? count : cMaxReferenceSamples - m_referenceCount;
+        memcpy(m_reference + m_referenceCount, pData, count * sizeof(int16_t));
+        m_referenceCount += count;
+    }
+
+    if (m_referenceCount < frameCount) {
+        memset(m_reference + m_referenceCount, 0, (frameCount - m_referenceCount) * sizeof(int16_t));
+        m_referenceCount = frameCount;
+    }
+
+    return S_OK;
+}
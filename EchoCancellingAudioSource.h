@@ -0,0 +1,72 @@
+﻿#pragma once
+
+#include "AudioSource.h"
+#include "EchoCanceller.h"
+#include "MediaBuffer.h"
+
+/// Audio source that removes echo of a playback reference from another source's audio.
+/// Wraps a capture source, such as a Kinect sensor, and a mono source of what the
+/// speakers play, such as a loopback recording. Every Read of the capture source is
+/// matched by reading the same number of frames from the reference, which is treated as
+/// time aligned with capture; a reference that runs out is taken to be silence.
+/// Output lags capture by the canceller's block size.
+class EchoCancellingAudioSource : public AudioSource {
+public:
+    /// Constructor
+    /// <param name="pCaptureSource">source whose audio has echo removed. Takes ownership.</param>
+    /// <param name="pReferenceSource">mono source of audio played through speakers. Takes ownership.
+    /// Should not pace itself, since it is read as fast as capture demands.</param>
+    EchoCancellingAudioSource(AudioSource* pCaptureSource, AudioSource* pReferenceSource);
+
+    /// Destructor
+    virtual ~EchoCancellingAudioSource();
+
+    /// Configure echo canceller for capture source's channels.
+    /// <param name="blockSize">samples per canceller block, a power of two. Sets latency.</param>
+    /// <param name="tailLength">longest echo path to model, in samples.</param>
+    /// <param name="level">instruction set used by canceller.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if reference has more than one channel or a parameter is out of range.</returns>
+    HRESULT                 Initialize(UINT blockSize, UINT tailLength, SimdLevel level);
+
+    /// Read next chunk of capture source's audio, with echo removed.
+    /// <param name="pBuffer">buffer that receives PCM data. Its length is set to amount of data produced.</param>
+    /// <param name="pAngles">receives angles reported by capture source.</param>
+    /// <param name="pbMoreAvailable">set to true if more audio can be read immediately.</param>
+    /// <returns>S_OK if audio was produced, S_FALSE if none is available right now, otherwise failure code.</returns>
+    virtual HRESULT         Read(IMediaBuffer* pBuffer, AudioAngles* pAngles, bool* pbMoreAvailable);
+
+    /// Whether capture source has finished. Reference running out does not end the stream.
+    virtual bool            IsFinished() const { return m_pCaptureSource->IsFinished(); }
+
+    /// Number of interleaved channels produced by capture source.
+    virtual WORD            GetChannelCount() const { return m_pCaptureSource->GetChannelCount(); }
+
+    /// Pass angle query setting on to capture source, which reports the angles.
+    virtual void            SetAngleQueriesEnabled(bool bEnabled) { m_pCaptureSource->SetAngleQueriesEnabled(bEnabled); }
+
+    /// Echo return loss enhancement reached so far, in dB.
+    float                   GetEchoReturnLossEnhancementDb() const { return m_canceller.GetEchoReturnLossEnhancementDb(); }
+
+private:
+    // Reference samples that may be waiting: a full media buffer of capture plus one overshooting reference read.
+    static const UINT       cMaxReferenceSamples = AudioSamplesPerSecond + AudioBlock::MaxSamples;
+
+    AudioSource*            m_pCaptureSource;
+    AudioSource*            m_pReferenceSource;
+    EchoCanceller           m_canceller;
+
+    // Buffer reference source reads into.
+    CStaticMediaBuffer      m_referenceBuffer;
+
+    // Reference samples read but not yet matched with capture.
+    int16_t                 m_reference[cMaxReferenceSamples];
+    UINT                    m_referenceCount;
+
+    /// Read reference until it holds at least frameCount samples, padding with silence once it runs out.
+    /// <param name="frameCount">number of samples needed, at most AudioSamplesPerSecond.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 FillReference(UINT frameCount);
+
+    EchoCancellingAudioSource(const EchoCancellingAudioSource&);
+    EchoCancellingAudioSource& operator=(const EchoCancellingAudioSource&);
+};
@@ -0,0 +1,321 @@
+﻿#include "EventLoop.h"
+
+#ifndef _WIN32
+// For errno
+#include <errno.h>
+
+// For epoll, eventfd and timerfd
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+// For read, write and close
+#include <unistd.h>
+#endif
+
+/// Constructor
+EventLoop::EventLoop() :
+    m_sourceCount(0),
+    m_quitEventId(0),
+    m_bQuit(false),
+    m_exitCode(0)
+#ifdef _WIN32
+    , m_hDialog(NULL)
+#else
+    , m_epollFd(-1)
+#endif
+{
+}
+
+/// Destructor
+EventLoop::~EventLoop() {
+    Close();
+}
+
+/// Create kernel objects used for waiting.
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT EventLoop::Initialize() {
+    if (0 != m_sourceCount) {
+        return E_UNEXPECTED;
+    }
+
+#ifndef _WIN32
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epollFd < 0) {
+        return HRESULT_FROM_ERRNO(errno);
+    }
+#endif
+
+    // Quit event has no callback; Run checks quit flag whenever it wakes
+    HRESULT hr = AddEvent(NULL, NULL, &m_quitEventId);
+    if (FAILED(hr)) {
+        Close();
+    }
+
+    return hr;
+}
+
+/// Add an auto-reset event that invokes callback on loop thread each time it is signaled.
+/// Signals that arrive before callback runs are coalesced into one call.
+/// <param name="pfnCallback">function to call.</param>
+/// <param name="pContext">context passed to callback.</param>
+/// <param name="pEventId">receives ID to pass to Signal.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT EventLoop::AddEvent(EventLoopCallback pfnCallback, void* pContext, UINT* pEventId) {
+    Source source;
+    source.pfnCallback = pfnCallback;
+    source.pContext = pContext;
+
+#ifdef _WIN32
+    source.hHandle = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (NULL == source.hHandle) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+#else
+    source.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (source.fd < 0) {
+        return HRESULT_FROM_ERRNO(errno);
+    }
+#endif
+
+    return AddSource(source, pEventId);
+}
+
+/// Add a periodic timer that invokes callback on loop thread each time it expires.
+/// Expirations missed while loop was busy are coalesced into one call.
+/// <param name="intervalMilliseconds">timer period.</param>
+/// <param name="pfnCallback">function to call.</param>
+/// <param name="pContext">context passed to callback.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT EventLoop::AddTimer(UINT intervalMilliseconds, EventLoopCallback pfnCallback, void* pContext) {
+    if (0 == intervalMilliseconds || NULL == pfnCallback) {
+        return E_INVALIDARG;
+    }
+
+    Source source;
+    source.pfnCallback = pfnCallback;
+    source.pContext = pContext;
+
+#ifdef _WIN32
+    source.hHandle = CreateWaitableTimerW(NULL, FALSE, NULL);
+    if (NULL == source.hHandle) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    // Negative due time is relative, in 100 ns units
+    LARGE_INTEGER dueTime;
+    dueTime.QuadPart = -10000LL * intervalMilliseconds;
+    if (!SetWaitableTimer(source.hHandle, &dueTime, intervalMilliseconds, NULL, NULL, FALSE)) {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        CloseHandle(source.hHandle);
+        return hr;
+    }
+#else
+    source.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (source.fd < 0) {
+        return HRESULT_FROM_ERRNO(errno);
+    }
+
+    struct itimerspec period;
+    period.it_interval.tv_sec = intervalMilliseconds / 1000;
+    period.it_interval.tv_nsec = (intervalMilliseconds % 1000) * 1000000L;
+    period.it_value = period.it_interval;
+    if (0 != timerfd_settime(source.fd, 0, &period, NULL)) {
+        HRESULT hr = HRESULT_FROM_ERRNO(errno);
+        close(source.fd);
+        return hr;
+    }
+#endif
+
+    UINT timerId = 0;
+    return AddSource(source, &timerId);
+}
+
+/// Add a kernel object to the set loop waits on. Takes ownership of object, even on failure.
+/// <param name="source">object and callback.</param>
+/// <param name="pSourceId">receives index of source.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT EventLoop::AddSource(const Source& source, UINT* pSourceId) {
+    HRESULT hr = S_OK;
+
+#ifdef _WIN32
+    if (m_sourceCount >= cMaxSources) {
+        CloseHandle(source.hHandle);
+        return E_OUTOFMEMORY;
+    }
+
+    m_handles[m_sourceCount] = source.hHandle;
+#else
+    if (m_sourceCount >= cMaxSources || m_epollFd < 0) {
+        close(source.fd);
+        return (m_epollFd < 0) ? E_UNEXPECTED : E_OUTOFMEMORY;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u32 = m_sourceCount;
+    if (0 != epoll_ctl(m_epollFd, EPOLL_CTL_ADD, source.fd, &event)) {
+        hr = HRESULT_FROM_ERRNO(errno);
+        close(source.fd);
+        return hr;
+    }
+#endif
+
+    *pSourceId = m_sourceCount;
+    m_sources[m_sourceCount++] = source;
+
+    return hr;
+}
+
+/// Wake loop to run callback of an event. Safe to call from any thread.
+/// <param name="eventId">ID returned by AddEvent.</param>
+void EventLoop::Signal(UINT eventId) {
+    if (eventId >= m_sourceCount) {
+        return;
+    }
+
+#ifdef _WIN32
+    SetEvent(m_sources[eventId].hHandle);
+#else
+    // Counter only saturates after 2^64 unconsumed signals, so a failed write can't lose a wakeup
+    uint64_t increment = 1;
+    ssize_t written = write(m_sources[eventId].fd, &increment, sizeof(increment));
+    (void)written;
+#endif
+}
+
+/// Ask Run to return once the current callback finishes. Safe to call from any thread.
+void EventLoop::Quit() {
+    m_bQuit.store(true);
+    Signal(m_quitEventId);
+}
+
+#ifdef _WIN32
+
+/// Dispatch callbacks and window messages until Quit is called or WM_QUIT is received.
+/// <returns>S_OK when loop was asked to exit, otherwise failure code.</returns>
+HRESULT EventLoop::Run() {
+    if (0 == m_sourceCount) {
+        return E_UNEXPECTED;
+    }
+
+    // Messages already in queue must be handled before first wait, which only reports new ones
+    if (DispatchMessages()) {
+        return S_OK;
+    }
+
+    while (!m_bQuit.load()) {
+        DWORD result = MsgWaitForMultipleObjectsEx(m_sourceCount, m_handles, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+        if (WAIT_FAILED == result) {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        if (WAIT_OBJECT_0 + m_sourceCount == result) {
+            if (DispatchMessages()) {
+                return S_OK;
+            }
+            continue;
+        }
+
+        UINT first = result - WAIT_OBJECT_0;
+        if (first >= m_sourceCount) {
+            continue;
+        }
+
+        // Only lowest signaled handle is reported, so poll later ones too so they can't be starved
+        for (UINT i = first; i < m_sourceCount && !m_bQuit.load(); ++i) {
+            if (i != first && WAIT_OBJECT_0 != WaitForSingleObject(m_handles[i], 0)) {
+                continue;
+            }
+
+            if (NULL != m_sources[i].pfnCallback) {
+                m_sources[i].pfnCallback(m_sources[i].pContext);
+            }
+        }
+    }
+
+    return S_OK;
+}
+
+/// Dispatch all window messages in thread's queue.
+/// <returns>true if WM_QUIT was received.</returns>
+bool EventLoop::DispatchMessages() {
+    MSG msg;
+    while (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE)) {
+        if (WM_QUIT == msg.message) {
+            m_exitCode = static_cast<int>(msg.wParam);
+            return true;
+        }
+
+        // If a dialog message will be taken care of by the dialog proc
+        if ((m_hDialog != NULL) && IsDialogMessageW(m_hDialog, &msg)) {
+            continue;
+        }
+
+        TranslateMessage(&msg);
+        DispatchMessageW(&msg);
+    }
+
+    return false;
+}
+
+/// Close all kernel objects.
+void EventLoop::Close() {
+    for (UINT i = 0; i < m_sourceCount; ++i) {
+        CloseHandle(m_sources[i].hHandle);
+    }
+    m_sourceCount = 0;
+}
+
+#else
+
+/// Dispatch callbacks until Quit is called.
+/// <returns>S_OK when loop was asked to exit, otherwise failure code.</returns>
+HRESULT EventLoop::Run() {
+    if (0 == m_sourceCount) {
+        return E_UNEXPECTED;
+    }
+
+    struct epoll_event events[cMaxSources];
+
+    while (!m_bQuit.load()) {
+        int ready = epoll_wait(m_epollFd, events, cMaxSources, -1);
+        if (ready < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return HRESULT_FROM_ERRNO(errno);
+        }
+
+        for (int i = 0; i < ready && !m_bQuit.load(); ++i) {
+            const Source& source = m_sources[events[i].data.u32];
+
+            // Reading resets eventfd counter or timerfd expiration count, coalescing pending signals
+            uint64_t count = 0;
+            if (read(source.fd, &count, sizeof(count)) != static_cast<ssize_t>(sizeof(count))) {
+                continue;
+            }
+
+            if (NULL != source.pfnCallback) {
+                source.pfnCallback(source.pContext);
+            }
+        }
+    }
+
+    return S_OK;
+}
+
+/// Close all kernel objects.
+void EventLoop::Close() {
+    for (UINT i = 0; i < m_sourceCount; ++i) {
+        close(m_sources[i].fd);
+    }
+    m_sourceCount = 0;
+
+    if (m_epollFd >= 0) {
+        close(m_epollFd);
+        m_epollFd = -1;
+    }
+}
+
+#endif
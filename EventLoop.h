@@ -0,0 +1,113 @@
+﻿#pragma once
+
+#include "Platform.h"
+
+// For quit flag set from other threads
+#include <atomic>
+
+/// Function called by EventLoop when an event is signaled or a timer expires.
+/// <param name="pContext">context pointer given when event or timer was added.</param>
+typedef void (*EventLoopCallback)(void* pContext);
+
+/// Single-threaded scheduler that blocks until there is work to do.
+/// Dispatches callbacks for events signaled from any thread and for periodic timers, and
+/// on Windows also dispatches the thread's window messages. Waiting is done in the kernel
+/// (MsgWaitForMultipleObjectsEx on Windows, epoll over eventfd/timerfd descriptors on
+/// Linux), so an idle loop uses no CPU and a signaled event wakes it immediately.
+/// Events and timers must be added before Run is called, from the thread that runs loop.
+class EventLoop {
+public:
+    // Maximum number of events and timers that can be added, including the internal quit event.
+    // Must stay below MAXIMUM_WAIT_OBJECTS on Windows.
+    static const UINT       cMaxSources = 16;
+
+    /// Constructor
+    EventLoop();
+
+    /// Destructor
+    ~EventLoop();
+
+    /// Create kernel objects used for waiting.
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 Initialize();
+
+    /// Add an auto-reset event that invokes callback on loop thread each time it is signaled.
+    /// Signals that arrive before callback runs are coalesced into one call.
+    /// <param name="pfnCallback">function to call.</param>
+    /// <param name="pContext">context passed to callback.</param>
+    /// <param name="pEventId">receives ID to pass to Signal.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 AddEvent(EventLoopCallback pfnCallback, void* pContext, UINT* pEventId);
+
+    /// Add a periodic timer that invokes callback on loop thread each time it expires.
+    /// Expirations missed while loop was busy are coalesced into one call.
+    /// <param name="intervalMilliseconds">timer period.</param>
+    /// <param name="pfnCallback">function to call.</param>
+    /// <param name="pContext">context passed to callback.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 AddTimer(UINT intervalMilliseconds, EventLoopCallback pfnCallback, void* pContext);
+
+    /// Wake loop to run callback of an event. Safe to call from any thread.
+    /// <param name="eventId">ID returned by AddEvent.</param>
+    void                    Signal(UINT eventId);
+
+    /// Dispatch callbacks (and window messages on Windows) until Quit is called or WM_QUIT is received.
+    /// <returns>S_OK when loop was asked to exit, otherwise failure code.</returns>
+    HRESULT                 Run();
+
+    /// Ask Run to return once the current callback finishes. Safe to call from any thread.
+    void                    Quit();
+
+    /// Exit code carried by WM_QUIT, or 0 if loop exited because of Quit.
+    int                     GetExitCode() const { return m_exitCode; }
+
+#ifdef _WIN32
+    /// Set modeless dialog whose keyboard navigation messages are routed through IsDialogMessage.
+    /// <param name="hDialog">dialog window, or NULL.</param>
+    void                    SetDialogWindow(HWND hDialog) { m_hDialog = hDialog; }
+#endif
+
+private:
+    /// Event or timer that loop waits on.
+    struct Source {
+        EventLoopCallback   pfnCallback;
+        void*               pContext;
+#ifdef _WIN32
+        HANDLE              hHandle;
+#else
+        int                 fd;
+#endif
+    };
+
+    Source                  m_sources[cMaxSources];
+    UINT                    m_sourceCount;
+
+    // ID of internal event used to wake loop when Quit is called.
+    UINT                    m_quitEventId;
+    std::atomic<bool>       m_bQuit;
+
+    int                     m_exitCode;
+
+#ifdef _WIN32
+    HANDLE                  m_handles[cMaxSources];
+    HWND                    m_hDialog;
+
+    /// Dispatch all window messages in thread's queue.
+    /// <returns>true if WM_QUIT was received.</returns>
+    bool                    DispatchMessages();
+#else
+    int                     m_epollFd;
+#endif
+
+    /// Add a kernel object to the set loop waits on. Takes ownership of object, even on failure.
+    /// <param name="source">object and callback.</param>
+    /// <param name="pSourceId">receives index of source.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 AddSource(const Source& source, UINT* pSourceId);
+
+    /// Close all kernel objects.
+    void                    Close();
+
+    EventLoop(const EventLoop&);
+    EventLoop& operator=(const EventLoop&);
+};
@@ -0,0 +1,336 @@
+﻿#include "Fft.h"
+
+// For M_PI, sin and cos
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+/// Scalar butterflies of one pass: combine pairs of transforms of half elements into transforms of 2 * half.
+/// <param name="pData">size interleaved complex elements.</param>
+/// <param name="size">number of complex elements.</param>
+/// <param name="half">size of transforms being combined.</param>
+/// <param name="pTwiddles">exp(-2*pi*i*k/size) for k in [0, size/2), interleaved.</param>
+/// <param name="sign">1 for forward transform, -1 for inverse.</param>
+static void ButterflyPassScalar(float* pData, UINT size, UINT half, const float* pTwiddles, float sign) {
+    UINT span = 2 * half;
+    UINT twiddleStep = size / span;
+
+    for (UINT start = 0; start < size; start += span) {
+        for (UINT k = 0; k < half; ++k) {
+            float wr = pTwiddles[2 * k * twiddleStep];
+            float wi = sign * pTwiddles[2 * k * twiddleStep + 1];
+
+            float* pTop = pData + 2 * (start + k);
+            float* pBottom = pData + 2 * (start + k + half);
+
+            float tr = wr * pBottom[0] - wi * pBottom[1];
+            float ti = wr * pBottom[1] + wi * pBottom[0];
+
+            pBottom[0] = pTop[0] - tr;
+            pBottom[1] = pTop[1] - ti;
+            pTop[0] += tr;
+            pTop[1] += ti;
+        }
+    }
+}
+
+#ifdef AUDIO_SIMD_X86
+
+/// SSE2 version of ButterflyPassScalar, two complex elements at a time. Half must be at least 2.
+/// Complex product is formed as b * (wr wr) + swap(b) * (-wi wi), so interleaved data needs no shuffling
+/// beyond swapping real and imaginary parts.
+/// <param name="pPassTwiddles">twiddles of pass, duplicated real parts followed by sign-alternating imaginary parts.</param>
+/// <param name="bInverse">true to conjugate twiddles.</param>
+AUDIO_TARGET_SSE2
+static void ButterflyPassSse2(float* pData, UINT size, UINT half, const float* pPassTwiddles, bool bInverse) {
+    const __m128 conjugate = _mm_set1_ps(bInverse ? -0.0f : 0.0f);
+    const float* pReal = pPassTwiddles;
+    const float* pImag = pPassTwiddles + 2 * half;
+
+    for (UINT start = 0; start < size; start += 2 * half) {
+        float* pTop = pData + 2 * start;
+        float* pBottom = pTop + 2 * half;
+
+        for (UINT k = 0; k < 2 * half; k += 4) {
+            __m128 bottom = _mm_loadu_ps(pBottom + k);
+            __m128 swapped = _mm_shuffle_ps(bottom, bottom, _MM_SHUFFLE(2, 3, 0, 1));
+            __m128 wr = _mm_loadu_ps(pReal + k);
+            __m128 wi = _mm_xor_ps(_mm_loadu_ps(pImag + k), conjugate);
+            __m128 t = _mm_add_ps(_mm_mul_ps(bottom, wr), _mm_mul_ps(swapped, wi));
+
+            __m128 top = _mm_loadu_ps(pTop + k);
+            _mm_storeu_ps(pBottom + k, _mm_sub_ps(top, t));
+            _mm_storeu_ps(pTop + k, _mm_add_ps(top, t));
+        }
+    }
+}
+
+/// AVX2 version of ButterflyPassSse2, four complex elements at a time with fused multiply-add.
+/// Half must be at least 4.
+AUDIO_TARGET_AVX2
+static void ButterflyPassAvx2(float* pData, UINT size, UINT half, const float* pPassTwiddles, bool bInverse) {
+    const __m256 conjugate = _mm256_set1_ps(bInverse ? -0.0f : 0.0f);
+    const float* pReal = pPassTwiddles;
+    const float* pImag = pPassTwiddles + 2 * half;
+
+    for (UINT start = 0; start < size; start += 2 * half) {
+        float* pTop = pData + 2 * start;
+        float* pBottom = pTop + 2 * half;
+
+        for (UINT k = 0; k < 2 * half; k += 8) {
+            __m256 bottom = _mm256_loadu_ps(pBottom + k);
+            __m256 swapped = _mm256_permute_ps(bottom, _MM_SHUFFLE(2, 3, 0, 1));
+            __m256 wr = _mm256_loadu_ps(pReal + k);
+            __m256 wi = _mm256_xor_ps(_mm256_loadu_ps(pImag + k), conjugate);
+            __m256 t = _mm256_fmadd_ps(swapped, wi, _mm256_mul_ps(bottom, wr));
+
+            __m256 top = _mm256_loadu_ps(pTop + k);
+            _mm256_storeu_ps(pBottom + k, _mm256_sub_ps(top, t));
+            _mm256_storeu_ps(pTop + k, _mm256_add_ps(top, t));
+        }
+    }
+}
+
+#endif
+
+/// Constructor
+FftPlan::FftPlan() :
+    m_size(0),
+    m_level(SimdLevelScalar),
+    m_pBitReverse(NULL),
+    m_pTwiddles(NULL),
+    m_pPassTwiddles(NULL) {
+}
+
+/// Destructor
+FftPlan::~FftPlan() {
+    delete [] m_pBitReverse;
+    delete [] m_pTwiddles;
+    delete [] m_pPassTwiddles;
+}
+
+/// Build tables for transforms of given size.
+/// <param name="size">number of complex elements transformed, a power of two.</param>
+/// <param name="level">instruction set used by butterfly kernels.</param>
+/// <returns>S_OK on success, E_INVALIDARG if size is not a power of two.</returns>
+HRESULT FftPlan::Initialize(UINT size, SimdLevel level) {
+    if (size < 2 || 0 != (size & (size - 1))) {
+        return E_INVALIDARG;
+    }
+
+    delete [] m_pBitReverse;
+    delete [] m_pTwiddles;
+    delete [] m_pPassTwiddles;
+
+    m_size = size;
+    m_level = level;
+    m_pBitReverse = new UINT[size];
+    m_pTwiddles = new float[size];
+    m_pPassTwiddles = new float[4 * size];
+
+    UINT bits = 0;
+    while ((1u << bits) < size) {
+        ++bits;
+    }
+
+    for (UINT i = 0; i < size; ++i) {
+        UINT reversed = 0;
+        for (UINT b = 0; b < bits; ++b) {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        m_pBitReverse[i] = reversed;
+    }
+
+    for (UINT k = 0; k < size / 2; ++k) {
+        double angle = -2.0 * M_PI * k / size;
+        m_pTwiddles[2 * k] = static_cast<float>(cos(angle));
+        m_pTwiddles[2 * k + 1] = static_cast<float>(sin(angle));
+    }
+
+    for (UINT half = 2; half < size; half <<= 1) {
+        float* pReal = m_pPassTwiddles + 4 * (half - 2);
+        float* pImag = pReal + 2 * half;
+        UINT twiddleStep = size / (2 * half);
+
+        for (UINT k = 0; k < half; ++k) {
+            float wr = m_pTwiddles[2 * k * twiddleStep];
+            float wi = m_pTwiddles[2 * k * twiddleStep + 1];
+            pReal[2 * k] = wr;
+            pReal[2 * k + 1] = wr;
+            pImag[2 * k] = -wi;
+            pImag[2 * k + 1] = wi;
+        }
+    }
+
+    return S_OK;
+}
+
+/// Forward transform, in place.
+/// <param name="pData">size interleaved complex elements.</param>
+void FftPlan::Forward(float* pData) const {
+    Transform(pData, false);
+}
+
+/// Inverse transform, in place, scaled by 1/size so Inverse(Forward(x)) is x.
+/// <param name="pData">size interleaved complex elements.</param>
+void FftPlan::Inverse(float* pData) const {
+    Transform(pData, true);
+
+    float scale = 1.0f / m_size;
+    for (UINT i = 0; i < 2 * m_size; ++i) {
+        pData[i] *= scale;
+    }
+}
+
+/// Shared body of forward and inverse transforms.
+/// <param name="pData">size interleaved complex elements.</param>
+/// <param name="bInverse">true to use conjugate twiddles.</param>
+void FftPlan::Transform(float* pData, bool bInverse) const {
+    for (UINT i = 0; i < m_size; ++i) {
+        UINT j = m_pBitReverse[i];
+        if (j > i) {
+            float re = pData[2 * i];
+            float im = pData[2 * i + 1];
+            pData[2 * i] = pData[2 * j];
+            pData[2 * i + 1] = pData[2 * j + 1];
+            pData[2 * j] = re;
+            pData[2 * j + 1] = im;
+        }
+    }
+
+    const float sign = bInverse ? -1.0f : 1.0f;
+
+    // Iterative Cooley-Tukey butterflies, doubling span each pass. Early passes are too
+    // narrow for a vector register, so they stay scalar.
+    for (UINT half = 1; half < m_size; half <<= 1) {
+#ifdef AUDIO_SIMD_X86
+        if (SimdLevelAvx2 == m_level && half >= 4) {
+            ButterflyPassAvx2(pData, m_size, half, m_pPassTwiddles + 4 * (half - 2), bInverse);
+            continue;
+        }
+
+        if (SimdLevelScalar != m_level && half >= 2) {
+            ButterflyPassSse2(pData, m_size, half, m_pPassTwiddles + 4 * (half - 2), bInverse);
+            continue;
+        }
+#endif
+
+        ButterflyPassScalar(pData, m_size, half, m_pTwiddles, sign);
+    }
+}
+
+/// Constructor
+RealFftPlan::RealFftPlan() :
+    m_size(0),
+    m_pTwiddles(NULL) {
+}
+
+/// Destructor
+RealFftPlan::~RealFftPlan() {
+    delete [] m_pTwiddles;
+}
+
+/// Build tables for transforms of given size.
+/// <param name="size">number of real samples transformed, a power of two of at least 4.</param>
+/// <param name="level">instruction set used by butterfly kernels.</param>
+/// <returns>S_OK on success, E_INVALIDARG if size is not a power of two of at least 4.</returns>
+HRESULT RealFftPlan::Initialize(UINT size, SimdLevel level) {
+    if (size < 4 || 0 != (size & (size - 1))) {
+        return E_INVALIDARG;
+    }
+
+    HRESULT hr = m_halfPlan.Initialize(size / 2, level);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    delete [] m_pTwiddles;
+
+    m_size = size;
+    m_pTwiddles = new float[2 * (size / 4 + 1)];
+
+    for (UINT k = 0; k <= size / 4; ++k) {
+        double angle = -2.0 * M_PI * k / size;
+        m_pTwiddles[2 * k] = static_cast<float>(cos(angle));
+        m_pTwiddles[2 * k + 1] = static_cast<float>(sin(angle));
+    }
+
+    return S_OK;
+}
+
+/// Forward transform, in place.
+/// <param name="pData">size real samples followed by room for 2 more floats. Receives GetBinCount interleaved complex bins.</param>
+void RealFftPlan::Forward(float* pData) const {
+    const UINT half = m_size / 2;
+
+    // Z = FFT of z[n] = x[2n] + i*x[2n+1], which is how real input is already laid out
+    m_halfPlan.Forward(pData);
+
+    // DC and Nyquist bins are both real, and come from Z[0] alone
+    float z0r = pData[0];
+    float z0i = pData[1];
+    pData[0] = z0r + z0i;
+    pData[1] = 0.0f;
+    pData[2 * half] = z0r - z0i;
+    pData[2 * half + 1] = 0.0f;
+
+    // Bins k and half - k depend on the same pair of Z values, so both are produced together:
+    //   E = (Z[k] + conj(Z[half-k])) / 2, O = -i * (Z[k] - conj(Z[half-k])) / 2
+    //   X[k] = E + W^k * O, X[half-k] = conj(E - W^k * O)
+    for (UINT k = 1; k <= half / 2; ++k) {
+        float* pLow = pData + 2 * k;
+        float* pHigh = pData + 2 * (half - k);
+
+        float evenReal = 0.5f * (pLow[0] + pHigh[0]);
+        float evenImag = 0.5f * (pLow[1] - pHigh[1]);
+        float oddReal = 0.5f * (pLow[1] + pHigh[1]);
+        float oddImag = -0.5f * (pLow[0] - pHigh[0]);
+
+        float wr = m_pTwiddles[2 * k];
+        float wi = m_pTwiddles[2 * k + 1];
+        float tr = wr * oddReal - wi * oddImag;
+        float ti = wr * oddImag + wi * oddReal;
+
+        pLow[0] = evenReal + tr;
+        pLow[1] = evenImag + ti;
+        pHigh[0] = evenReal - tr;
+        pHigh[1] = ti - evenImag;
+    }
+}
+
+/// Inverse transform, in place, scaled by 1/size so Inverse(Forward(x)) is x.
+/// <param name="pData">GetBinCount interleaved complex bins. Receives size real samples.</param>
+void RealFftPlan::Inverse(float* pData) const {
+    const UINT half = m_size / 2;
+
+    // Undo split pass of Forward, rebuilding Z[k] = E + i*O from bins k and half - k:
+    //   E = (X[k] + conj(X[half-k])) / 2, O = (X[k] - conj(X[half-k])) * conj(W^k) / 2
+    //   Z[k] = E + i*O, Z[half-k] = conj(E) + i*conj(O)
+    float dc = pData[0];
+    float nyquist = pData[2 * half];
+    pData[0] = 0.5f * (dc + nyquist);
+    pData[1] = 0.5f * (dc - nyquist);
+
+    for (UINT k = 1; k <= half / 2; ++k) {
+        float* pLow = pData + 2 * k;
+        float* pHigh = pData + 2 * (half - k);
+
+        float evenReal = 0.5f * (pLow[0] + pHigh[0]);
+        float evenImag = 0.5f * (pLow[1] - pHigh[1]);
+        float differenceReal = 0.5f * (pLow[0] - pHigh[0]);
+        float differenceImag = 0.5f * (pLow[1] + pHigh[1]);
+
+        // Multiply difference by conj(W^k)
+        float wr = m_pTwiddles[2 * k];
+        float wi = m_pTwiddles[2 * k + 1];
+        float oddReal = differenceReal * wr + differenceImag * wi;
+        float oddImag = differenceImag * wr - differenceReal * wi;
+
+        pLow[0] = evenReal - oddImag;
+        pLow[1] = evenImag + oddReal;
+        pHigh[0] = evenReal + oddImag;
+        pHigh[1] = oddReal - evenImag;
+    }
+
+    // Inverse of half size transform is scaled by 2/size, leaving x[2n] + i*x[2n+1] in place
+    m_halfPlan.Inverse(pData);
+}
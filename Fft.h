@@ -0,0 +1,100 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "Simd.h"
+
+/// Precomputed tables for an in-place radix-2 complex FFT of one size.
+/// Complex data is stored interleaved: real part of element k at index 2k and
+/// imaginary part at 2k+1. Plans are built once, then reused for every transform,
+/// so transforms never allocate. Butterflies of every pass wide enough for a vector
+/// register run in SIMD kernels, with twiddles laid out contiguously per pass.
+class FftPlan {
+public:
+    /// Constructor
+    FftPlan();
+
+    /// Destructor
+    ~FftPlan();
+
+    /// Build tables for transforms of given size.
+    /// <param name="size">number of complex elements transformed, a power of two.</param>
+    /// <param name="level">instruction set used by butterfly kernels.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if size is not a power of two.</returns>
+    HRESULT                 Initialize(UINT size, SimdLevel level);
+
+    /// Number of complex elements transformed.
+    UINT                    GetSize() const { return m_size; }
+
+    /// Forward transform, in place.
+    /// <param name="pData">size interleaved complex elements.</param>
+    void                    Forward(float* pData) const;
+
+    /// Inverse transform, in place, scaled by 1/size so Inverse(Forward(x)) is x.
+    /// <param name="pData">size interleaved complex elements.</param>
+    void                    Inverse(float* pData) const;
+
+private:
+    UINT                    m_size;
+    SimdLevel               m_level;
+
+    // Index each element moves to in bit-reversed order.
+    UINT*                   m_pBitReverse;
+
+    // exp(-2*pi*i*k/size) for k in [0, size/2), interleaved.
+    float*                  m_pTwiddles;
+
+    // Twiddles of each pass with half span of 2 or more, in SIMD friendly layout. Pass with
+    // half span h starts at float 4 * (h - 2): real parts duplicated (wr0 wr0 wr1 wr1 ...),
+    // then imaginary parts with alternating sign (-wi0 wi0 -wi1 wi1 ...), 2 * h floats each.
+    float*                  m_pPassTwiddles;
+
+    /// Shared body of forward and inverse transforms.
+    void                    Transform(float* pData, bool bInverse) const;
+
+    FftPlan(const FftPlan&);
+    FftPlan& operator=(const FftPlan&);
+};
+
+/// Forward FFT of real input, computed with a complex FFT of half the size.
+/// Even and odd samples are treated as real and imaginary parts of half as many complex
+/// elements, so input is transformed in place without repacking; a final pass separates
+/// the two interleaved spectra. Only non-negative frequencies are produced, since the
+/// rest mirror them. Inverse runs the same steps backwards.
+class RealFftPlan {
+public:
+    /// Constructor
+    RealFftPlan();
+
+    /// Destructor
+    ~RealFftPlan();
+
+    /// Build tables for transforms of given size.
+    /// <param name="size">number of real samples transformed, a power of two of at least 4.</param>
+    /// <param name="level">instruction set used by butterfly kernels.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if size is not a power of two of at least 4.</returns>
+    HRESULT                 Initialize(UINT size, SimdLevel level);
+
+    /// Number of real samples transformed.
+    UINT                    GetSize() const { return m_size; }
+
+    /// Number of frequency bins produced, size / 2 + 1.
+    UINT                    GetBinCount() const { return m_size / 2 + 1; }
+
+    /// Forward transform, in place.
+    /// <param name="pData">size real samples followed by room for 2 more floats. Receives GetBinCount interleaved complex bins.</param>
+    void                    Forward(float* pData) const;
+
+    /// Inverse transform, in place, scaled by 1/size so Inverse(Forward(x)) is x.
+    /// <param name="pData">GetBinCount interleaved complex bins. Receives size real samples.</param>
+    void                    Inverse(float* pData) const;
+
+private:
+    UINT                    m_size;
+    FftPlan                 m_halfPlan;
+
+    // exp(-2*pi*i*k/size) for k in [0, size/4], interleaved.
+    float*                  m_pTwiddles;
+
+    RealFftPlan(const RealFftPlan&);
+    RealFftPlan& operator=(const RealFftPlan&);
+};
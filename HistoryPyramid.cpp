@@ -0,0 +1,228 @@
+﻿#include "HistoryPyramid.h"
+
+/// Constructor
+HistoryPyramid::HistoryPyramid() :
+    m_seriesCount(0),
+    m_bucketsPerLevel(0),
+    m_levelCount(0),
+    m_entryCount(0) {
+}
+
+/// Allocate levels, with as many as it takes to retain given number of entries.
+/// <param name="seriesCount">number of values in each entry, from 1 to cMaxSeries.</param>
+/// <param name="bucketsPerLevel">number of buckets each level keeps, from cMinBucketsPerLevel to cMaxBucketsPerLevel.
+/// Level 0 keeps that many most recent entries at full resolution.</param>
+/// <param name="retainedEntries">number of most recent entries top level must reach back over.</param>
+/// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range or retention needs more than cMaxLevels,
+/// E_UNEXPECTED if already open.</returns>
+HRESULT HistoryPyramid::Open(UINT seriesCount, UINT bucketsPerLevel, UINT64 retainedEntries) {
+    if (IsOpen()) {
+        return E_UNEXPECTED;
+    }
+
+    if (0 == seriesCount || seriesCount > cMaxSeries || bucketsPerLevel < cMinBucketsPerLevel || bucketsPerLevel > cMaxBucketsPerLevel ||
+        0 == retainedEntries) {
+        return E_INVALIDARG;
+    }
+
+    // Each level reaches cDecimation times as far back as the one below
+    UINT levelCount = 1;
+    while ((static_cast<UINT64>(bucketsPerLevel) << ((levelCount - 1) * cDecimationShift)) < retainedEntries) {
+        if (cMaxLevels == levelCount) {
+            return E_INVALIDARG;
+        }
+        ++levelCount;
+    }
+
+    m_buckets.assign(static_cast<size_t>(levelCount) * bucketsPerLevel * seriesCount, Bucket());
+    m_seriesCount = seriesCount;
+    m_bucketsPerLevel = bucketsPerLevel;
+    m_levelCount = levelCount;
+    m_entryCount = 0;
+
+    return S_OK;
+}
+
+/// Append an entry, merging buckets into levels above as they complete.
+/// <param name="pValues">one value of each series.</param>
+/// <returns>S_OK on success, E_UNEXPECTED if not open.</returns>
+HRESULT HistoryPyramid::Append(const float* pValues) {
+    if (!IsOpen()) {
+        return E_UNEXPECTED;
+    }
+
+    Bucket* pEntry = &m_buckets[GetBucketIndex(0, m_entryCount)];
+    for (UINT s = 0; s < m_seriesCount; ++s) {
+        pEntry[s].minimum = pValues[s];
+        pEntry[s].maximum = pValues[s];
+        pEntry[s].sum = pValues[s];
+        pEntry[s].count = 1;
+    }
+
+    // Completing last bucket of a group completes the bucket above it, which may complete one further up
+    UINT64 bucket = m_entryCount;
+    for (UINT level = 1; level < m_levelCount && cDecimation - 1 == (bucket & (cDecimation - 1)); ++level) {
+        bucket >>= cDecimationShift;
+
+        Bucket* pParent = &m_buckets[GetBucketIndex(level, bucket)];
+        for (UINT s = 0; s < m_seriesCount; ++s) {
+            pParent[s].count = 0;
+        }
+
+        for (UINT64 child = bucket << cDecimationShift; child < (bucket + 1) << cDecimationShift; ++child) {
+            const Bucket* pChild = &m_buckets[GetBucketIndex(level - 1, child)];
+            for (UINT s = 0; s < m_seriesCount; ++s) {
+                Merge(&pParent[s], pChild[s]);
+            }
+        }
+    }
+
+    ++m_entryCount;
+
+    return S_OK;
+}
+
+/// Summarise a run of entries of one series into evenly spaced columns.
+/// Column boundaries are rounded down to buckets of level summarised from, which are never longer than a column.
+/// Columns older than finer levels reach back are summarised from coarser levels, with buckets that may reach beyond them.
+/// <param name="series">index of series.</param>
+/// <param name="firstEntry">index, counting from first entry appended, of first entry of first column.</param>
+/// <param name="entryCount">number of entries spanned by all columns.</param>
+/// <param name="pColumns">receives columns, oldest first.</param>
+/// <param name="columnCount">number of columns.</param>
+/// <returns>S_OK on success, E_INVALIDARG if series is out of range or there are no columns, E_UNEXPECTED if not open.</returns>
+HRESULT HistoryPyramid::Query(UINT series, UINT64 firstEntry, UINT64 entryCount, HistoryColumn* pColumns, UINT columnCount) const {
+    if (!IsOpen()) {
+        return E_UNEXPECTED;
+    }
+
+    if (series >= m_seriesCount || NULL == pColumns || 0 == columnCount) {
+        return E_INVALIDARG;
+    }
+
+    // Coarsest level whose buckets fit in a column, so each column merges at most cDecimation of them
+    UINT64 columnEntries = entryCount / columnCount;
+    UINT64 remainder = entryCount % columnCount;
+    UINT level = 0;
+    while (level + 1 < m_levelCount && (static_cast<UINT64>(1) << ((level + 1) * cDecimationShift)) <= columnEntries) {
+        ++level;
+    }
+    const UINT shift = level * cDecimationShift;
+
+    // Boundaries between columns fall on buckets of that level, except for entries not yet merged into one,
+    // so neighboring columns share none. Column entries are counted in two parts to keep products in range.
+    UINT64 begin = firstEntry;
+    begin = (begin >= m_entryCount) ? m_entryCount : ((begin >> shift) << shift);
+    for (UINT c = 0; c < columnCount; ++c) {
+        UINT64 end = firstEntry + columnEntries * (c + 1) + remainder * (c + 1) / columnCount;
+        end = (end >= m_entryCount) ? m_entryCount : ((end >> shift) << shift);
+
+        Bucket total;
+        total.count = 0;
+        if (begin < end) {
+            Accumulate(series, level, begin, end, &total);
+        }
+
+        HistoryColumn& column = pColumns[c];
+        if (0 == total.count) {
+            column.minimum = 0.0f;
+            column.maximum = 0.0f;
+            column.mean = 0.0f;
+        } else {
+            column.minimum = total.minimum;
+            column.maximum = total.maximum;
+            column.mean = total.sum / total.count;
+        }
+        column.count = total.count;
+
+        begin = end;
+    }
+
+    return S_OK;
+}
+
+/// Free levels and forget every entry.
+void HistoryPyramid::Close() {
+    std::vector<Bucket>().swap(m_buckets);
+    m_seriesCount = 0;
+    m_bucketsPerLevel = 0;
+    m_levelCount = 0;
+    m_entryCount = 0;
+}
+
+/// Index of oldest entry top level still summarises.
+UINT64 HistoryPyramid::GetOldestEntry() const {
+    if (!IsOpen()) {
+        return 0;
+    }
+
+    UINT top = m_levelCount - 1;
+    return GetOldestBucket(top) << (top * cDecimationShift);
+}
+
+/// Position in m_buckets of a bucket's summary of first series, followed by those of the others.
+/// <param name="level">level of bucket.</param>
+/// <param name="bucket">index of bucket in its level, counting from first one completed.</param>
+size_t HistoryPyramid::GetBucketIndex(UINT level, UINT64 bucket) const {
+    return (static_cast<size_t>(level) * m_bucketsPerLevel + static_cast<size_t>(bucket % m_bucketsPerLevel)) * m_seriesCount;
+}
+
+/// Index of oldest bucket a level still keeps.
+/// <param name="level">level.</param>
+UINT64 HistoryPyramid::GetOldestBucket(UINT level) const {
+    UINT64 completed = m_entryCount >> (level * cDecimationShift);
+    return (completed > m_bucketsPerLevel) ? completed - m_bucketsPerLevel : 0;
+}
+
+/// Merge a summary into a total.
+/// <param name="pTotal">summary merged into. Taken as empty while its count is 0.</param>
+/// <param name="bucket">summary to merge.</param>
+void HistoryPyramid::Merge(Bucket* pTotal, const Bucket& bucket) {
+    if (0 == pTotal->count) {
+        *pTotal = bucket;
+        return;
+    }
+
+    pTotal->minimum = (bucket.minimum < pTotal->minimum) ? bucket.minimum : pTotal->minimum;
+    pTotal->maximum = (bucket.maximum > pTotal->maximum) ? bucket.maximum : pTotal->maximum;
+    pTotal->sum += bucket.sum;
+    pTotal->count += bucket.count;
+}
+
+/// Merge summaries of a run of entries of one series into a total, from given level where it keeps
+/// them, from finer levels where they are too new for it and from coarser ones where they are too old.
+/// <param name="series">index of series.</param>
+/// <param name="level">level to summarise from.</param>
+/// <param name="begin">index of first entry.</param>
+/// <param name="end">index of entry after last one.</param>
+/// <param name="pTotal">summary merged into.</param>
+void HistoryPyramid::Accumulate(UINT series, UINT level, UINT64 begin, UINT64 end, Bucket* pTotal) const {
+    const UINT shift = level * cDecimationShift;
+
+    // Entries after level's last completed bucket are still only in finer levels. Those are fewer than
+    // cDecimation buckets of each finer level, all still kept.
+    UINT64 completedEnd = (m_entryCount >> shift) << shift;
+    if (end > completedEnd && level > 0) {
+        Accumulate(series, level - 1, (begin > completedEnd) ? begin : completedEnd, end, pTotal);
+    }
+    end = (end < completedEnd) ? end : completedEnd;
+
+    // Entries level no longer keeps are taken from coarser level, up to one of its bucket boundaries. Level
+    // keeps several of those buckets, so boundary falls on one coarser level has completed.
+    UINT64 oldestEntry = GetOldestBucket(level) << shift;
+    if (begin < oldestEntry && begin < end) {
+        if (level + 1 < m_levelCount) {
+            const UINT coarserShift = shift + cDecimationShift;
+            UINT64 boundary = ((oldestEntry + (static_cast<UINT64>(1) << coarserShift) - 1) >> coarserShift) << coarserShift;
+            boundary = (boundary < end) ? boundary : end;
+            Accumulate(series, level + 1, begin, boundary, pTotal);
+            begin = boundary;
+        } else {
+            begin = oldestEntry;
+        }
+    }
+
+    for (UINT64 bucket = begin >> shift; (bucket << shift) < end; ++bucket) {
+        Merge(pTotal, m_buckets[GetBucketIndex(level, bucket) + series]);
+    }
+}
@@ -0,0 +1,132 @@
+﻿#pragma once
+
+#include "Platform.h"
+
+// For bucket storage
+#include <vector>
+
+/// Minimum, maximum and mean of one series over a run of entries, as drawn in one timeline column.
+struct HistoryColumn {
+    float                   minimum;
+    float                   maximum;
+    float                   mean;
+
+    // Number of entries summarised; 0 if column lies before first entry, after last, or beyond retention.
+    UINT                    count;
+};
+
+/// Keeps minimum, maximum and mean of a few series of values, such as energy and beam angle,
+/// appended at a fixed rate over hours, at every resolution a timeline may be zoomed to.
+/// Level 0 holds one bucket per entry; each bucket of a level above summarises cDecimation
+/// consecutive buckets of the level below, and is computed once, when the last of them is
+/// complete, so appending costs O(1) amortized. Every level is a ring of the same number of
+/// buckets, so coarser levels reach further back and memory is fixed by Open.
+/// Query summarises each column from the coarsest level whose buckets are no longer than
+/// a column, taking newest entries from finer levels and oldest from coarser ones, so its
+/// cost depends on number of columns and not on how many entries they span.
+/// Not thread safe; Append and Query are for one thread.
+class HistoryPyramid {
+public:
+    // Buckets of a level merged into each bucket of level above, as a power of two.
+    static const UINT       cDecimationShift = 2;
+    static const UINT       cDecimation = 1 << cDecimationShift;
+
+    // Largest number of series appended together.
+    static const UINT       cMaxSeries = 4;
+
+    // Largest number of levels, with level 0 holding one entry per bucket.
+    static const UINT       cMaxLevels = 16;
+
+    // Range of number of buckets each level keeps. Queries rely on a level keeping several times cDecimation.
+    static const UINT       cMinBucketsPerLevel = 16;
+    static const UINT       cMaxBucketsPerLevel = 1 << 20;
+
+    /// Constructor
+    HistoryPyramid();
+
+    /// Allocate levels, with as many as it takes to retain given number of entries.
+    /// <param name="seriesCount">number of values in each entry, from 1 to cMaxSeries.</param>
+    /// <param name="bucketsPerLevel">number of buckets each level keeps, from cMinBucketsPerLevel to cMaxBucketsPerLevel.
+    /// Level 0 keeps that many most recent entries at full resolution.</param>
+    /// <param name="retainedEntries">number of most recent entries top level must reach back over.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range or retention needs more than cMaxLevels,
+    /// E_UNEXPECTED if already open.</returns>
+    HRESULT                 Open(UINT seriesCount, UINT bucketsPerLevel, UINT64 retainedEntries);
+
+    /// Append an entry, merging buckets into levels above as they complete.
+    /// <param name="pValues">one value of each series.</param>
+    /// <returns>S_OK on success, E_UNEXPECTED if not open.</returns>
+    HRESULT                 Append(const float* pValues);
+
+    /// Summarise a run of entries of one series into evenly spaced columns.
+    /// Column boundaries are rounded down to buckets of level summarised from, which are never longer than a column.
+    /// Columns older than finer levels reach back are summarised from coarser levels, with buckets that may reach beyond them.
+    /// <param name="series">index of series.</param>
+    /// <param name="firstEntry">index, counting from first entry appended, of first entry of first column.</param>
+    /// <param name="entryCount">number of entries spanned by all columns.</param>
+    /// <param name="pColumns">receives columns, oldest first.</param>
+    /// <param name="columnCount">number of columns.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if series is out of range or there are no columns, E_UNEXPECTED if not open.</returns>
+    HRESULT                 Query(UINT series, UINT64 firstEntry, UINT64 entryCount, HistoryColumn* pColumns, UINT columnCount) const;
+
+    /// Free levels and forget every entry.
+    void                    Close();
+
+    /// Whether pyramid is open.
+    bool                    IsOpen() const { return 0 != m_levelCount; }
+
+    /// Number of entries appended since Open.
+    UINT64                  GetEntryCount() const { return m_entryCount; }
+
+    /// Index of oldest entry top level still summarises.
+    UINT64                  GetOldestEntry() const;
+
+    /// Number of levels, including level 0.
+    UINT                    GetLevelCount() const { return m_levelCount; }
+
+    /// Number of bytes of bucket storage.
+    size_t                  GetMemorySize() const { return m_buckets.size() * sizeof(Bucket); }
+
+private:
+    /// Summary of one series over the entries of a bucket, or of a column being queried.
+    struct Bucket {
+        float               minimum;
+        float               maximum;
+        float               sum;
+        UINT                count;
+    };
+
+    UINT                    m_seriesCount;
+    UINT                    m_bucketsPerLevel;
+    UINT                    m_levelCount;
+    UINT64                  m_entryCount;
+
+    // Rings of buckets, level after level, each bucket holding one summary per series.
+    std::vector<Bucket>     m_buckets;
+
+    /// Position in m_buckets of a bucket's summary of first series, followed by those of the others.
+    /// <param name="level">level of bucket.</param>
+    /// <param name="bucket">index of bucket in its level, counting from first one completed.</param>
+    size_t                  GetBucketIndex(UINT level, UINT64 bucket) const;
+
+    /// Index of oldest bucket a level still keeps.
+    /// <param name="level">level.</param>
+    UINT64                  GetOldestBucket(UINT level) const;
+
+    /// Merge a summary into a total.
+    /// <param name="pTotal">summary merged into. Taken as empty while its count is 0.</param>
+    /// <param name="bucket">summary to merge.</param>
+    static void             Merge(Bucket* pTotal, const Bucket& bucket);
+
+    /// Merge summaries of a run of entries of one series into a total, from given level where it keeps
+    /// them, from finer levels where they are too new for it and from coarser ones where they are too old.
+    /// <param name="series">index of series.</param>
+    /// <param name="level">level to summarise from.</param>
+    /// <param name="begin">index of first entry.</param>
+    /// <param name="end">index of entry after last one.</param>
+    /// <param name="pTotal">summary merged into.</param>
+    void                    Accumulate(UINT series, UINT level, UINT64 begin, UINT64 end, Bucket* pTotal) const;
+
+    HistoryPyramid(const HistoryPyramid&);
+    HistoryPyramid& operator=(const HistoryPyramid&);
+};
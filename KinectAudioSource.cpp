@@ -0,0 +1,121 @@
+﻿#include "stdafx.h"
+#include "KinectAudioSource.h"
+
+/// Constructor
+KinectAudioSource::KinectAudioSource() :
+    m_pNuiAudioSource(NULL),
+    m_pDMO(NULL),
+    m_pPropertyStore(NULL),
+    m_bAngleQueriesEnabled(true) {
+    memset(&m_angles, 0, sizeof(m_angles));
+}
+
+/// Destructor
+KinectAudioSource::~KinectAudioSource() {
+    SafeRelease(m_pNuiAudioSource);
+    SafeRelease(m_pDMO);
+    SafeRelease(m_pPropertyStore);
+}
+
+/// Initialize Kinect audio capture/control objects.
+/// <param name="pNuiSensor">sensor already initialized with NUI_INITIALIZE_FLAG_USES_AUDIO.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT KinectAudioSource::Initialize(INuiSensor* pNuiSensor) {
+    if (NULL == pNuiSensor) {
+        return E_INVALIDARG;
+    }
+
+    // Get the audio source
+    HRESULT hr = pNuiSensor->NuiGetAudioSource(&m_pNuiAudioSource);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    hr = m_pNuiAudioSource->QueryInterface(IID_IMediaObject, (void**)&m_pDMO);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    hr = m_pNuiAudioSource->QueryInterface(IID_IPropertyStore, (void**)&m_pPropertyStore);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    // Set AEC-MicArray DMO system mode. This must be set for the DMO to work properly.
+    // Possible values are:
+    //   SINGLE_CHANNEL_AEC = 0
+    //   OPTIBEAM_ARRAY_ONLY = 2
+    //   OPTIBEAM_ARRAY_AND_AEC = 4
+    //   SINGLE_CHANNEL_NSAGC = 5
+    // Noise suppression and gain control are left to AudioPipeline's enhancement stages (-ns, -agc),
+    // which also work on raw microphone array audio and can be switched independently.
+    // Echo of speakers is cancelled by EchoCanceller against a playback reference (-reference) rather than
+    // OPTIBEAM_ARRAY_AND_AEC, which adds too much latency for installations whose speakers are always playing.
+    PROPVARIANT pvSysMode;
+    PropVariantInit(&pvSysMode);
+    pvSysMode.vt = VT_I4;
+    pvSysMode.lVal = (LONG)(2); // Use OPTIBEAM_ARRAY_ONLY setting.
+    m_pPropertyStore->SetValue(MFPKEY_WMAAECMA_SYSTEM_MODE, pvSysMode);
+    PropVariantClear(&pvSysMode);
+
+    // Set DMO output format
+    WAVEFORMATEX wfxOut = {AudioFormat, AudioChannels, AudioSamplesPerSecond, AudioAverageBytesPerSecond, AudioBlockAlign, AudioBitsPerSample, 0};
+    DMO_MEDIA_TYPE mt = {0};
+    hr = MoInitMediaType(&mt, sizeof(WAVEFORMATEX));
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    mt.majortype = MEDIATYPE_Audio;
+    mt.subtype = MEDIASUBTYPE_PCM;
+    mt.lSampleSize = 0;
+    mt.bFixedSizeSamples = TRUE;
+    mt.bTemporalCompression = FALSE;
+    mt.formattype = FORMAT_WaveFormatEx;
+    memcpy_s(mt.pbFormat, sizeof(WAVEFORMATEX), &wfxOut, sizeof(WAVEFORMATEX));
+
+    hr = m_pDMO->SetOutputType(0, &mt, 0);
+    MoFreeMediaType(&mt);
+
+    return hr;
+}
+
+/// Read next available chunk of audio from DMO.
+/// <param name="pBuffer">buffer that receives PCM data.</param>
+/// <param name="pAngles">receives beam and sound source angles.</param>
+/// <param name="pbMoreAvailable">set to true if DMO has more audio ready.</param>
+/// <returns>S_OK if audio was produced, S_FALSE if none is available right now, otherwise failure code.</returns>
+HRESULT KinectAudioSource::Read(IMediaBuffer* pBuffer, AudioAngles* pAngles, bool* pbMoreAvailable) {
+    DWORD dwStatus = 0;
+    DMO_OUTPUT_DATA_BUFFER outputBuffer = {0};
+    outputBuffer.pBuffer = pBuffer;
+
+    *pbMoreAvailable = false;
+    pBuffer->SetLength(0);
+
+    HRESULT hr = m_pDMO->ProcessOutput(0, 1, &outputBuffer, &dwStatus);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    *pbMoreAvailable = (0 != (outputBuffer.dwStatus & DMO_OUTPUT_DATA_BUFFERF_INCOMPLETE));
+
+    DWORD cbProduced = 0;
+    if (S_OK == hr) {
+        pBuffer->GetBufferAndLength(NULL, &cbProduced);
+    }
+
+    if (0 == cbProduced) {
+        return S_FALSE;
+    }
+
+    // Obtain beam angle from INuiAudioBeam afforded by microphone array. Each query is a call into
+    // the sensor driver, so silent stretches reuse the last answer
+    if (m_bAngleQueriesEnabled) {
+        m_pNuiAudioSource->GetBeam(&m_angles.beamAngle);
+        m_pNuiAudioSource->GetPosition(&m_angles.sourceAngle, &m_angles.sourceConfidence);
+    }
+    *pAngles = m_angles;
+
+    return S_OK;
+}
@@ -0,0 +1,63 @@
+﻿#pragma once
+
+#include "AudioSource.h"
+#include "AudioFormat.h"
+
+// For IMediaObject and related interfaces
+#include <dmo.h>
+
+// For configuring DMO properties
+#include <wmcodecdsp.h>
+
+// For WAVEFORMATEX
+#include <mmreg.h>
+
+// For FORMAT_WaveFormatEx and such
+#include <uuids.h>
+
+// For Kinect SDK APIs
+#include <NuiApi.h>
+
+/// Audio source that captures beamformed audio from a Kinect sensor through
+/// the AEC-MicArray DMO, and queries beam and sound source angles from INuiAudioBeam.
+class KinectAudioSource : public AudioSource {
+public:
+    /// Constructor
+    KinectAudioSource();
+
+    /// Destructor
+    virtual ~KinectAudioSource();
+
+    /// Initialize Kinect audio capture/control objects.
+    /// <param name="pNuiSensor">sensor already initialized with NUI_INITIALIZE_FLAG_USES_AUDIO.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 Initialize(INuiSensor* pNuiSensor);
+
+    /// Read next available chunk of audio from DMO.
+    /// <param name="pBuffer">buffer that receives PCM data.</param>
+    /// <param name="pAngles">receives beam and sound source angles.</param>
+    /// <param name="pbMoreAvailable">set to true if DMO has more audio ready.</param>
+    /// <returns>S_OK if audio was produced, S_FALSE if none is available right now, otherwise failure code.</returns>
+    virtual HRESULT         Read(IMediaBuffer* pBuffer, AudioAngles* pAngles, bool* pbMoreAvailable);
+
+    /// Live sensors never finish.
+    virtual bool            IsFinished() const { return false; }
+
+    /// Stop or resume querying INuiAudioBeam on every read.
+    /// <param name="bEnabled">false to report the last angles queried instead.</param>
+    virtual void            SetAngleQueriesEnabled(bool bEnabled) { m_bAngleQueriesEnabled = bEnabled; }
+
+private:
+    // Audio source used to query Kinect audio beam and sound source angles.
+    INuiAudioBeam*          m_pNuiAudioSource;
+
+    // Media object from which Kinect audio stream is captured.
+    IMediaObject*           m_pDMO;
+
+    // Property store used to configure Kinect audio properties.
+    IPropertyStore*         m_pPropertyStore;
+
+    // Whether angles are queried on every read, and the angles last queried.
+    bool                    m_bAngleQueriesEnabled;
+    AudioAngles             m_angles;
+};
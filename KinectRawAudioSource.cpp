@@ -0,0 +1,198 @@
+﻿#include "stdafx.h"
+#include "KinectRawAudioSource.h"
+
+// For KSDATAFORMAT_SUBTYPE_IEEE_FLOAT
+#include <ksmedia.h>
+
+// Size, in 100ns units, of shared mode endpoint buffer. Sized for capture thread polling interval with plenty of slack.
+static const REFERENCE_TIME cEndpointBufferDuration = 1000000;
+
+/// Constructor
+KinectRawAudioSource::KinectRawAudioSource() :
+    m_pAudioClient(NULL),
+    m_pCaptureClient(NULL),
+    m_pStaging(NULL),
+    m_stagingCapacity(0),
+    m_stagingFrames(0),
+    m_stagingOffset(0) {
+}
+
+/// Destructor
+KinectRawAudioSource::~KinectRawAudioSource() {
+    if (NULL != m_pAudioClient) {
+        m_pAudioClient->Stop();
+    }
+
+    SafeRelease(m_pCaptureClient);
+    SafeRelease(m_pAudioClient);
+
+    delete [] m_pStaging;
+}
+
+/// Open and start capture endpoint of sensor's microphone array.
+/// <param name="pNuiSensor">sensor already initialized with NUI_INITIALIZE_FLAG_USES_AUDIO.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT KinectRawAudioSource::Initialize(INuiSensor* pNuiSensor) {
+    if (NULL == pNuiSensor) {
+        return E_INVALIDARG;
+    }
+
+    // Find capture endpoint belonging to this sensor
+    NUI_MICROPHONE_ARRAY_DEVICE devices[8];
+    int iDeviceCount = 0;
+    HRESULT hr = NuiGetMicrophoneArrayDevices(devices, _countof(devices), &iDeviceCount);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    const NUI_MICROPHONE_ARRAY_DEVICE* pDevice = NULL;
+    for (int i = 0; i < iDeviceCount && i < _countof(devices); ++i) {
+        if (devices[i].iDeviceIndex == pNuiSensor->NuiInstanceIndex()) {
+            pDevice = &devices[i];
+            break;
+        }
+    }
+
+    if (NULL == pDevice) {
+        return E_FAIL;
+    }
+
+    IMMDeviceEnumerator* pEnumerator = NULL;
+    hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL, CLSCTX_ALL, __uuidof(IMMDeviceEnumerator), (void**)&pEnumerator);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    IMMDevice* pEndpoint = NULL;
+    hr = pEnumerator->GetDevice(pDevice->szDeviceID, &pEndpoint);
+    SafeRelease(pEnumerator);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    hr = pEndpoint->Activate(__uuidof(IAudioClient), CLSCTX_ALL, NULL, (void**)&m_pAudioClient);
+    SafeRelease(pEndpoint);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    // Shared mode runs at the endpoint's own format, which for the Kinect array is 16 kHz, four channels
+    WAVEFORMATEX* pFormat = NULL;
+    hr = m_pAudioClient->GetMixFormat(&pFormat);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    WORD formatTag = pFormat->wFormatTag;
+    if (WAVE_FORMAT_EXTENSIBLE == formatTag) {
+        const WAVEFORMATEXTENSIBLE* pExtensible = reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(pFormat);
+        formatTag = (KSDATAFORMAT_SUBTYPE_IEEE_FLOAT == pExtensible->SubFormat) ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
+    }
+
+    // Conversion loop is picked for the format endpoint negotiated, normally KinectArrayStreamFormat
+    WAVEFORMATEX sampleFormat = *pFormat;
+    sampleFormat.wFormatTag = formatTag;
+    if ((cChannels != pFormat->nChannels) || (AudioSamplesPerSecond != pFormat->nSamplesPerSec) ||
+        FAILED(m_converter.Initialize(sampleFormat, ChannelMappingKeep, true))) {
+        CoTaskMemFree(pFormat);
+        return AUDCLNT_E_UNSUPPORTED_FORMAT;
+    }
+
+    hr = m_pAudioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, 0, cEndpointBufferDuration, 0, pFormat, NULL);
+    CoTaskMemFree(pFormat);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    // No packet can be larger than the endpoint buffer, so staging sized to it holds any packet
+    hr = m_pAudioClient->GetBufferSize(&m_stagingCapacity);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    m_pStaging = new int16_t[m_stagingCapacity * cChannels];
+
+    hr = m_pAudioClient->GetService(__uuidof(IAudioCaptureClient), (void**)&m_pCaptureClient);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    return m_pAudioClient->Start();
+}
+
+/// Move next endpoint packet, if any, into staging buffer.
+/// <returns>S_OK if a packet was staged, S_FALSE if none is ready, otherwise failure code.</returns>
+HRESULT KinectRawAudioSource::StagePacket() {
+    BYTE* pData = NULL;
+    UINT32 frames = 0;
+    DWORD dwFlags = 0;
+
+    HRESULT hr = m_pCaptureClient->GetBuffer(&pData, &frames, &dwFlags, NULL, NULL);
+    if (AUDCLNT_S_BUFFER_EMPTY == hr) {
+        return S_FALSE;
+    }
+
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    frames = (frames < m_stagingCapacity) ? frames : m_stagingCapacity;
+    UINT32 count = frames * cChannels;
+
+    if (dwFlags & AUDCLNT_BUFFERFLAGS_SILENT) {
+        memset(m_pStaging, 0, count * sizeof(int16_t));
+    }
+    else {
+        m_converter.Convert(pData, frames, m_pStaging);
+    }
+
+    m_stagingFrames = frames;
+    m_stagingOffset = 0;
+
+    return m_pCaptureClient->ReleaseBuffer(frames);
+}
+
+/// Read next captured packet as interleaved 16-bit PCM.
+/// <param name="pBuffer">buffer that receives PCM data.</param>
+/// <param name="pAngles">receives zero angles.</param>
+/// <param name="pbMoreAvailable">set to true if more audio can be read immediately.</param>
+/// <returns>S_OK if audio was produced, S_FALSE if none is available right now, otherwise failure code.</returns>
+HRESULT KinectRawAudioSource::Read(IMediaBuffer* pBuffer, AudioAngles* pAngles, bool* pbMoreAvailable) {
+    *pbMoreAvailable = false;
+    pBuffer->SetLength(0);
+
+    if (NULL == m_pCaptureClient) {
+        return E_UNEXPECTED;
+    }
+
+    if (m_stagingOffset >= m_stagingFrames) {
+        HRESULT hr = StagePacket();
+        if (S_OK != hr) {
+            return hr;
+        }
+    }
+
+    BYTE* pData = NULL;
+    DWORD cbMax = 0;
+    pBuffer->GetBufferAndLength(&pData, NULL);
+    pBuffer->GetMaxLength(&cbMax);
+
+    UINT32 frames = m_stagingFrames - m_stagingOffset;
+    DWORD maxFrames = cbMax / (AudioBlockAlign * cChannels);
+    frames = (frames < maxFrames) ? frames : maxFrames;
+
+    memcpy(pData, m_pStaging + m_stagingOffset * cChannels, frames * AudioBlockAlign * cChannels);
+    m_stagingOffset += frames;
+
+    pAngles->beamAngle = 0.0;
+    pAngles->sourceAngle = 0.0;
+    pAngles->sourceConfidence = 0.0;
+
+    UINT32 nextPacketFrames = 0;
+    *pbMoreAvailable = (m_stagingOffset < m_stagingFrames) ||
+                       (SUCCEEDED(m_pCaptureClient->GetNextPacketSize(&nextPacketFrames)) && nextPacketFrames > 0);
+
+    pBuffer->SetLength(frames * AudioBlockAlign * cChannels);
+
+    return (frames > 0) ? S_OK : S_FALSE;
+}
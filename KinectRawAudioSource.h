@@ -0,0 +1,65 @@
+﻿#pragma once
+
+#include "AudioSource.h"
+#include "AudioFormat.h"
+#include "SampleConverter.h"
+
+// For IMMDeviceEnumerator
+#include <mmdeviceapi.h>
+
+// For IAudioClient and IAudioCaptureClient
+#include <audioclient.h>
+
+// For Kinect SDK APIs
+#include <NuiApi.h>
+
+/// Audio source that captures the four raw, unprocessed channels of a Kinect
+/// microphone array straight from its WASAPI capture endpoint, bypassing the
+/// AEC-MicArray DMO so beams can be steered in software. Raw capture carries no
+/// beam or sound source angles, so all angles are reported as zero.
+class KinectRawAudioSource : public AudioSource {
+public:
+    // Number of microphones in Kinect array.
+    static const WORD       cChannels = 4;
+
+    /// Constructor
+    KinectRawAudioSource();
+
+    /// Destructor
+    virtual ~KinectRawAudioSource();
+
+    /// Open and start capture endpoint of sensor's microphone array.
+    /// <param name="pNuiSensor">sensor already initialized with NUI_INITIALIZE_FLAG_USES_AUDIO.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 Initialize(INuiSensor* pNuiSensor);
+
+    /// Read next captured packet as interleaved 16-bit PCM.
+    /// <param name="pBuffer">buffer that receives PCM data.</param>
+    /// <param name="pAngles">receives zero angles.</param>
+    /// <param name="pbMoreAvailable">set to true if more audio can be read immediately.</param>
+    /// <returns>S_OK if audio was produced, S_FALSE if none is available right now, otherwise failure code.</returns>
+    virtual HRESULT         Read(IMediaBuffer* pBuffer, AudioAngles* pAngles, bool* pbMoreAvailable);
+
+    /// Live sensors never finish.
+    virtual bool            IsFinished() const { return false; }
+
+    /// Number of interleaved channels produced by Read.
+    virtual WORD            GetChannelCount() const { return cChannels; }
+
+private:
+    IAudioClient*           m_pAudioClient;
+    IAudioCaptureClient*    m_pCaptureClient;
+
+    // Converts endpoint's packets, in whichever format it runs at, to 16-bit PCM.
+    SampleConverter         m_converter;
+
+    // Packet converted to 16-bit PCM, served across Read calls when it does not fit caller's buffer.
+    int16_t*                m_pStaging;
+    UINT32                  m_stagingCapacity;
+    UINT32                  m_stagingFrames;
+    UINT32                  m_stagingOffset;
+
+    /// Move next endpoint packet, if any, into staging buffer.
+    /// <returns>S_OK if a packet was staged, S_FALSE if none is ready, otherwise failure code.</returns>
+    HRESULT                 StagePacket();
+};
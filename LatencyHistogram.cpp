@@ -0,0 +1,127 @@
+﻿#include "LatencyHistogram.h"
+
+// For snprintf
+#include <stdio.h>
+
+#ifdef _MSC_VER
+// For _BitScanReverse64
+#include <intrin.h>
+#endif
+
+/// Index of highest set bit of a non-zero value.
+static UINT GetHighestBit(UINT64 value) {
+#ifdef _MSC_VER
+    unsigned long index = 0;
+#ifdef _WIN64
+    _BitScanReverse64(&index, value);
+#else
+    if (_BitScanReverse(&index, static_cast<unsigned long>(value >> 32))) {
+        return index + 32;
+    }
+    _BitScanReverse(&index, static_cast<unsigned long>(value));
+#endif
+    return index;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+/// Constructor
+LatencyHistogram::LatencyHistogram() {
+    Reset();
+}
+
+/// Bucket that holds a value.
+/// <param name="value">value to look up.</param>
+/// <returns>bucket index.</returns>
+UINT LatencyHistogram::GetBucketIndex(UINT64 value) {
+    if (value < cSubBucketCount) {
+        return static_cast<UINT>(value);
+    }
+
+    // Magnitude 1 covers [16,32), magnitude 2 covers [32,64), and so on
+    UINT magnitude = GetHighestBit(value) - cSubBucketBits + 1;
+    UINT subBucket = static_cast<UINT>(value >> (magnitude - 1)) & (cSubBucketCount - 1);
+    return magnitude * cSubBucketCount + subBucket;
+}
+
+/// Largest value held by a bucket.
+/// <param name="index">bucket index.</param>
+/// <returns>upper bound of bucket.</returns>
+UINT64 LatencyHistogram::GetBucketUpperBound(UINT index) {
+    UINT magnitude = index / cSubBucketCount;
+    UINT64 subBucket = index % cSubBucketCount;
+    if (0 == magnitude) {
+        return subBucket;
+    }
+
+    UINT64 lowerBound = (cSubBucketCount + subBucket) << (magnitude - 1);
+    return lowerBound + (static_cast<UINT64>(1) << (magnitude - 1)) - 1;
+}
+
+/// Add a duration. Single writer thread only.
+/// <param name="nanoseconds">duration to record.</param>
+void LatencyHistogram::Record(UINT64 nanoseconds) {
+    std::atomic<uint32_t>& count = m_counts[GetBucketIndex(nanoseconds)];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    if (nanoseconds > m_max.load(std::memory_order_relaxed)) {
+        m_max.store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+/// Forget all recorded durations. Must not run concurrently with Record.
+void LatencyHistogram::Reset() {
+    for (UINT i = 0; i < cBucketCount; ++i) {
+        m_counts[i].store(0, std::memory_order_relaxed);
+    }
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+/// Number of durations recorded.
+UINT64 LatencyHistogram::GetCount() const {
+    UINT64 total = 0;
+    for (UINT i = 0; i < cBucketCount; ++i) {
+        total += m_counts[i].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+/// Duration below which given share of recorded durations fall.
+/// <param name="percentile">percentile, in [0.0,100.0] interval.</param>
+/// <returns>upper bound, in nanoseconds, of bucket holding percentile, or 0 if histogram is empty.</returns>
+UINT64 LatencyHistogram::GetPercentile(double percentile) const {
+    UINT64 total = GetCount();
+    if (0 == total) {
+        return 0;
+    }
+
+    // Rank of value at percentile, counting from 1
+    UINT64 rank = static_cast<UINT64>(percentile / 100.0 * total + 0.5);
+    rank = (rank < 1) ? 1 : ((rank > total) ? total : rank);
+
+    UINT64 seen = 0;
+    for (UINT i = 0; i < cBucketCount; ++i) {
+        seen += m_counts[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // Bucket bound can overshoot largest value actually recorded
+            UINT64 upperBound = GetBucketUpperBound(i);
+            return (upperBound < GetMax()) ? upperBound : GetMax();
+        }
+    }
+
+    return GetMax();
+}
+
+/// Format one line summary: count, p50, p99 and max in milliseconds.
+/// <param name="szName">label of histogram.</param>
+/// <param name="szBuffer">buffer that receives summary.</param>
+/// <param name="cchBuffer">size of buffer, in characters.</param>
+void LatencyHistogram::Format(const char* szName, char* szBuffer, size_t cchBuffer) const {
+    snprintf(szBuffer, cchBuffer, "%s: n=%llu p50=%.3f ms p99=%.3f ms max=%.3f ms",
+        szName,
+        static_cast<unsigned long long>(GetCount()),
+        GetPercentile(50.0) / 1e6,
+        GetPercentile(99.0) / 1e6,
+        GetMax() / 1e6);
+}
@@ -0,0 +1,62 @@
+﻿#pragma once
+
+#include "Platform.h"
+
+// For counters readable while another thread records
+#include <atomic>
+
+/// Fixed-memory log-linear histogram of durations, in nanoseconds.
+/// Every power of two is split into cSubBucketCount equal buckets, so any recorded
+/// value is reported within 1/cSubBucketCount of its true value, from nanoseconds up
+/// to centuries, in a few kilobytes. One thread may Record while others read.
+class LatencyHistogram {
+public:
+    // Number of bits of each value kept below its leading bit.
+    static const UINT       cSubBucketBits = 4;
+
+    // Number of buckets each power of two is split into.
+    static const UINT       cSubBucketCount = 1 << cSubBucketBits;
+
+    // Total number of buckets needed to cover every 64-bit value.
+    static const UINT       cBucketCount = (64 - cSubBucketBits + 1) * cSubBucketCount;
+
+    /// Constructor
+    LatencyHistogram();
+
+    /// Add a duration. Single writer thread only.
+    /// <param name="nanoseconds">duration to record.</param>
+    void                    Record(UINT64 nanoseconds);
+
+    /// Forget all recorded durations. Must not run concurrently with Record.
+    void                    Reset();
+
+    /// Number of durations recorded.
+    UINT64                  GetCount() const;
+
+    /// Largest duration recorded.
+    UINT64                  GetMax() const { return m_max.load(std::memory_order_relaxed); }
+
+    /// Duration below which given share of recorded durations fall.
+    /// <param name="percentile">percentile, in [0.0,100.0] interval.</param>
+    /// <returns>upper bound, in nanoseconds, of bucket holding percentile, or 0 if histogram is empty.</returns>
+    UINT64                  GetPercentile(double percentile) const;
+
+    /// Format one line summary: count, p50, p99 and max in milliseconds.
+    /// <param name="szName">label of histogram.</param>
+    /// <param name="szBuffer">buffer that receives summary.</param>
+    /// <param name="cchBuffer">size of buffer, in characters.</param>
+    void                    Format(const char* szName, char* szBuffer, size_t cchBuffer) const;
+
+private:
+    std::atomic<uint32_t>   m_counts[cBucketCount];
+    std::atomic<UINT64>     m_max;
+
+    /// Bucket that holds a value.
+    static UINT             GetBucketIndex(UINT64 value);
+
+    /// Largest value held by a bucket.
+    static UINT64           GetBucketUpperBound(UINT index);
+
+    LatencyHistogram(const LatencyHistogram&);
+    LatencyHistogram& operator=(const LatencyHistogram&);
+};
@@ -0,0 +1,124 @@
+﻿#include "MappedFile.h"
+
+#ifndef _WIN32
+// For errno
+#include <errno.h>
+
+// For open, fstat and mmap
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// For close
+#include <unistd.h>
+#endif
+
+/// Constructor
+MappedFile::MappedFile() :
+    m_pData(NULL),
+    m_size(0)
+#ifdef _WIN32
+    , m_hFile(INVALID_HANDLE_VALUE)
+    , m_hMapping(NULL)
+#else
+    , m_fd(-1)
+#endif
+{
+}
+
+/// Destructor. Unmaps file, if mapped.
+MappedFile::~MappedFile() {
+    Close();
+}
+
+/// Map a file for reading.
+/// <param name="szPath">path of file to map.</param>
+/// <returns>S_OK on success, E_INVALIDARG if file is empty, E_OUTOFMEMORY if it does not fit in address space, otherwise failure code.</returns>
+HRESULT MappedFile::Open(const char* szPath) {
+    Close();
+
+#ifdef _WIN32
+    m_hFile = CreateFileA(szPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == m_hFile) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_hFile, &size)) {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Close();
+        return hr;
+    }
+    m_size = static_cast<UINT64>(size.QuadPart);
+#else
+    m_fd = open(szPath, O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0) {
+        return HRESULT_FROM_ERRNO(errno);
+    }
+
+    struct stat status;
+    if (0 != fstat(m_fd, &status)) {
+        HRESULT hr = HRESULT_FROM_ERRNO(errno);
+        Close();
+        return hr;
+    }
+    m_size = static_cast<UINT64>(status.st_size);
+#endif
+
+    // Empty files can't be mapped, and files larger than address space can't be mapped whole
+    if (0 == m_size || m_size > SIZE_MAX) {
+        HRESULT hr = (0 == m_size) ? E_INVALIDARG : E_OUTOFMEMORY;
+        Close();
+        return hr;
+    }
+
+#ifdef _WIN32
+    m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (NULL != m_hMapping) {
+        m_pData = static_cast<const BYTE*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+    }
+    if (NULL == m_pData) {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Close();
+        return hr;
+    }
+#else
+    void* pData = mmap(NULL, static_cast<size_t>(m_size), PROT_READ, MAP_SHARED, m_fd, 0);
+    if (MAP_FAILED == pData) {
+        HRESULT hr = HRESULT_FROM_ERRNO(errno);
+        Close();
+        return hr;
+    }
+    m_pData = static_cast<const BYTE*>(pData);
+#endif
+
+    return S_OK;
+}
+
+/// Unmap file, if mapped. Pointers into mapping become invalid.
+void MappedFile::Close() {
+#ifdef _WIN32
+    if (NULL != m_pData) {
+        UnmapViewOfFile(m_pData);
+    }
+    if (NULL != m_hMapping) {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+    }
+    if (INVALID_HANDLE_VALUE != m_hFile) {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (NULL != m_pData) {
+        munmap(const_cast<BYTE*>(m_pData), static_cast<size_t>(m_size));
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+#endif
+
+    m_pData = NULL;
+    m_size = 0;
+}
@@ -0,0 +1,45 @@
+﻿#pragma once
+
+#include "Platform.h"
+
+/// Read-only view of a whole file mapped into memory.
+/// Mapping costs the same however long the file is: pages are read from disk only when
+/// first touched, and the operating system's cache can drop them again under memory
+/// pressure, so multi-hour files are opened instantly and never held in memory whole.
+/// 32-bit builds can only map files that fit in their address space.
+class MappedFile {
+public:
+    /// Constructor
+    MappedFile();
+
+    /// Destructor. Unmaps file, if mapped.
+    ~MappedFile();
+
+    /// Map a file for reading.
+    /// <param name="szPath">path of file to map.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if file is empty, E_OUTOFMEMORY if it does not fit in address space, otherwise failure code.</returns>
+    HRESULT                 Open(const char* szPath);
+
+    /// Unmap file, if mapped. Pointers into mapping become invalid.
+    void                    Close();
+
+    /// First byte of file, or NULL if no file is mapped.
+    const BYTE*             GetData() const { return m_pData; }
+
+    /// Size of file, in bytes.
+    UINT64                  GetSize() const { return m_size; }
+
+private:
+    const BYTE*             m_pData;
+    UINT64                  m_size;
+
+#ifdef _WIN32
+    HANDLE                  m_hFile;
+    HANDLE                  m_hMapping;
+#else
+    int                     m_fd;
+#endif
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
@@ -0,0 +1,58 @@
+﻿#pragma once
+
+#include "AudioFormat.h"
+
+/// IMediaBuffer implementation for a statically allocated buffer holding one second of audio.
+/// <typeparam name="TFormat">AudioStreamFormat buffer is sized for.</typeparam>
+template <class TFormat>
+class CStaticMediaBufferT : public IMediaBuffer {
+public:
+    // Constructor
+    CStaticMediaBufferT() : m_dataLength(0) {}
+
+    // IUnknown methods
+    STDMETHODIMP_(ULONG) AddRef() { return 2; }
+    STDMETHODIMP_(ULONG) Release() { return 1; }
+    STDMETHODIMP QueryInterface(REFIID riid, void **ppv)
+    {
+        if (riid == IID_IUnknown) {
+            AddRef();
+            *ppv = (IUnknown*)this;
+            return NOERROR;
+        }
+        else if (riid == IID_IMediaBuffer) {
+            AddRef();
+            *ppv = (IMediaBuffer*)this;
+            return NOERROR;
+        }
+        else {
+            return E_NOINTERFACE;
+        }
+    }
+
+    // IMediaBuffer methods
+    STDMETHODIMP SetLength(DWORD length) {m_dataLength = length; return NOERROR;}
+    STDMETHODIMP GetMaxLength(DWORD *pMaxLength) {*pMaxLength = sizeof(m_pData); return NOERROR;}
+    STDMETHODIMP GetBufferAndLength(BYTE **ppBuffer, DWORD *pLength) {
+        if (ppBuffer) {
+            *ppBuffer = m_pData;
+        }
+        if (pLength) {
+            *pLength = m_dataLength;
+        }
+        return NOERROR;
+    }
+    void Init(ULONG ulData) {
+        m_dataLength = ulData;
+    }
+
+protected:
+    // Statically allocated buffer used to hold audio data returned by IMediaObject
+    BYTE m_pData[TFormat::AverageBytesPerSecond];
+
+    // Amount of data currently being held in m_pData
+    ULONG m_dataLength;
+};
+
+// Buffer for a second of beamformed Kinect audio, which also holds any capture-sized block of raw array audio
+typedef CStaticMediaBufferT<KinectAudioStreamFormat> CStaticMediaBuffer;
@@ -0,0 +1,160 @@
+﻿#include "MediaBufferPool.h"
+
+// Alignment of each buffer's memory, so SIMD kernels can work on captured data directly.
+static const DWORD cBufferAlignment = 64;
+
+CPooledMediaBuffer::CPooledMediaBuffer() :
+    m_pPool(NULL),
+    m_pData(NULL),
+    m_maxLength(0),
+    m_dataLength(0),
+    m_refCount(0),
+    m_nextFree(0) {
+}
+
+STDMETHODIMP_(ULONG) CPooledMediaBuffer::AddRef() {
+    return m_refCount.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+STDMETHODIMP_(ULONG) CPooledMediaBuffer::Release() {
+    // Release ordering makes every consumer's reads complete before buffer can be reused
+    ULONG refCount = m_refCount.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    if (0 == refCount) {
+        m_pPool->Return(this);
+    }
+
+    return refCount;
+}
+
+STDMETHODIMP CPooledMediaBuffer::QueryInterface(REFIID riid, void **ppv) {
+    if (riid == IID_IUnknown) {
+        AddRef();
+        *ppv = (IUnknown*)this;
+        return NOERROR;
+    }
+    else if (riid == IID_IMediaBuffer) {
+        AddRef();
+        *ppv = (IMediaBuffer*)this;
+        return NOERROR;
+    }
+    else {
+        return E_NOINTERFACE;
+    }
+}
+
+STDMETHODIMP CPooledMediaBuffer::SetLength(DWORD length) {
+    if (length > m_maxLength) {
+        return E_INVALIDARG;
+    }
+
+    m_dataLength = length;
+    return NOERROR;
+}
+
+STDMETHODIMP CPooledMediaBuffer::GetMaxLength(DWORD *pMaxLength) {
+    *pMaxLength = m_maxLength;
+    return NOERROR;
+}
+
+STDMETHODIMP CPooledMediaBuffer::GetBufferAndLength(BYTE **ppBuffer, DWORD *pLength) {
+    if (ppBuffer) {
+        *ppBuffer = m_pData;
+    }
+    if (pLength) {
+        *pLength = m_dataLength;
+    }
+    return NOERROR;
+}
+
+/// Constructor
+CMediaBufferPool::CMediaBufferPool() :
+    m_pBuffers(NULL),
+    m_pStorage(NULL),
+    m_bufferCount(0),
+    m_freeHead(cEndOfList),
+    m_exhaustedCount(0) {
+}
+
+/// Destructor
+CMediaBufferPool::~CMediaBufferPool() {
+    delete [] m_pBuffers;
+    delete [] m_pStorage;
+}
+
+/// Allocate buffers.
+/// <param name="bufferCount">number of buffers in pool.</param>
+/// <param name="cbBuffer">capacity, in bytes, of each buffer.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT CMediaBufferPool::Initialize(UINT bufferCount, DWORD cbBuffer) {
+    if (NULL != m_pBuffers) {
+        return E_UNEXPECTED;
+    }
+
+    if (0 == bufferCount || 0 == cbBuffer) {
+        return E_INVALIDARG;
+    }
+
+    // Round each buffer up to alignment so every one starts on an aligned address
+    DWORD cbStride = (cbBuffer + cBufferAlignment - 1) & ~(cBufferAlignment - 1);
+
+    m_pBuffers = new CPooledMediaBuffer[bufferCount];
+    m_pStorage = new BYTE[static_cast<size_t>(cbStride) * bufferCount + cBufferAlignment];
+    m_bufferCount = bufferCount;
+
+    BYTE* pAligned = m_pStorage + ((cBufferAlignment - (reinterpret_cast<size_t>(m_pStorage) & (cBufferAlignment - 1))) & (cBufferAlignment - 1));
+
+    // Chain every buffer onto free list in index order
+    for (UINT i = 0; i < bufferCount; ++i) {
+        CPooledMediaBuffer& buffer = m_pBuffers[i];
+        buffer.m_pPool = this;
+        buffer.m_pData = pAligned + static_cast<size_t>(cbStride) * i;
+        buffer.m_maxLength = cbBuffer;
+        buffer.m_nextFree.store((i + 1 < bufferCount) ? i + 2 : cEndOfList, std::memory_order_relaxed);
+    }
+
+    m_freeHead.store(1, std::memory_order_release);
+
+    return S_OK;
+}
+
+/// Take a free buffer out of pool.
+/// <returns>buffer holding a single reference and no data, or NULL if pool is exhausted.</returns>
+CPooledMediaBuffer* CMediaBufferPool::Acquire() {
+    uint64_t head = m_freeHead.load(std::memory_order_acquire);
+
+    for (;;) {
+        uint32_t link = static_cast<uint32_t>(head);
+        if (cEndOfList == link) {
+            m_exhaustedCount.fetch_add(1, std::memory_order_relaxed);
+            return NULL;
+        }
+
+        CPooledMediaBuffer* pBuffer = &m_pBuffers[link - 1];
+        uint64_t tag = (head >> 32) + 1;
+        uint64_t newHead = (tag << 32) | pBuffer->m_nextFree.load(std::memory_order_relaxed);
+
+        if (m_freeHead.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire)) {
+            pBuffer->m_dataLength = 0;
+            pBuffer->m_refCount.store(1, std::memory_order_relaxed);
+            return pBuffer;
+        }
+    }
+}
+
+/// Put buffer back on free list. Called when its last reference is released.
+/// <param name="pBuffer">buffer to return.</param>
+void CMediaBufferPool::Return(CPooledMediaBuffer* pBuffer) {
+    uint32_t link = static_cast<uint32_t>(pBuffer - m_pBuffers) + 1;
+    uint64_t head = m_freeHead.load(std::memory_order_relaxed);
+
+    for (;;) {
+        pBuffer->m_nextFree.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+
+        uint64_t tag = (head >> 32) + 1;
+        uint64_t newHead = (tag << 32) | link;
+
+        if (m_freeHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed)) {
+            return;
+        }
+    }
+}
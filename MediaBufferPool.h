@@ -0,0 +1,102 @@
+﻿#pragma once
+
+#include "Platform.h"
+
+// For reference counts and lock-free free list
+#include <atomic>
+
+class CMediaBufferPool;
+
+/// IMediaBuffer implementation whose memory belongs to a CMediaBufferPool.
+/// Reference counting is real: every consumer that keeps the data holds a
+/// reference, and the buffer goes back to its pool when the last one is released.
+class CPooledMediaBuffer : public IMediaBuffer {
+public:
+    // IUnknown methods
+    STDMETHODIMP_(ULONG) AddRef();
+    STDMETHODIMP_(ULONG) Release();
+    STDMETHODIMP QueryInterface(REFIID riid, void **ppv);
+
+    // IMediaBuffer methods
+    STDMETHODIMP SetLength(DWORD length);
+    STDMETHODIMP GetMaxLength(DWORD *pMaxLength);
+    STDMETHODIMP GetBufferAndLength(BYTE **ppBuffer, DWORD *pLength);
+
+private:
+    friend class CMediaBufferPool;
+
+    CPooledMediaBuffer();
+
+    // Pool that owns buffer memory and receives buffer back on final release.
+    CMediaBufferPool*       m_pPool;
+
+    // Buffer memory, owned by pool.
+    BYTE*                   m_pData;
+
+    // Capacity of m_pData.
+    DWORD                   m_maxLength;
+
+    // Amount of data currently being held in m_pData.
+    DWORD                   m_dataLength;
+
+    // Number of outstanding references. Zero while buffer sits in pool.
+    std::atomic<ULONG>      m_refCount;
+
+    // Index of next buffer in pool's free list.
+    std::atomic<uint32_t>   m_nextFree;
+
+    CPooledMediaBuffer(const CPooledMediaBuffer&);
+    CPooledMediaBuffer& operator=(const CPooledMediaBuffer&);
+};
+
+/// Fixed set of preallocated media buffers shared between capture and consumers.
+/// All memory is allocated by Initialize, so steady-state capture performs no heap
+/// allocations. Acquire and buffer release are lock-free and may be called from any
+/// thread. Pool must outlive every buffer acquired from it.
+class CMediaBufferPool {
+public:
+    /// Constructor
+    CMediaBufferPool();
+
+    /// Destructor
+    ~CMediaBufferPool();
+
+    /// Allocate buffers.
+    /// <param name="bufferCount">number of buffers in pool.</param>
+    /// <param name="cbBuffer">capacity, in bytes, of each buffer.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 Initialize(UINT bufferCount, DWORD cbBuffer);
+
+    /// Take a free buffer out of pool.
+    /// <returns>buffer holding a single reference and no data, or NULL if pool is exhausted.</returns>
+    CPooledMediaBuffer*     Acquire();
+
+    /// Number of buffers in pool.
+    UINT                    GetBufferCount() const { return m_bufferCount; }
+
+    /// Number of times Acquire found no free buffer.
+    uint32_t                GetExhaustedCount() const { return m_exhaustedCount.load(std::memory_order_relaxed); }
+
+private:
+    friend class CPooledMediaBuffer;
+
+    // Marks end of free list. Free list links hold buffer index + 1 so zero can mean empty.
+    static const uint32_t   cEndOfList = 0;
+
+    CPooledMediaBuffer*     m_pBuffers;
+    BYTE*                   m_pStorage;
+    UINT                    m_bufferCount;
+
+    // Head of free list: low 32 bits hold buffer index + 1, high 32 bits a tag that
+    // changes on every update so a stale compare-exchange can't succeed (ABA problem).
+    std::atomic<uint64_t>   m_freeHead;
+
+    std::atomic<uint32_t>   m_exhaustedCount;
+
+    /// Put buffer back on free list. Called when its last reference is released.
+    /// <param name="pBuffer">buffer to return.</param>
+    void                    Return(CPooledMediaBuffer* pBuffer);
+
+    CMediaBufferPool(const CMediaBufferPool&);
+    CMediaBufferPool& operator=(const CMediaBufferPool&);
+};
@@ -0,0 +1,28 @@
+﻿#pragma once
+
+#include "Platform.h"
+
+// Speed of sound, in meters per second, at room temperature.
+static const float SpeedOfSound = 343.0f;
+
+/// Positions of microphones in a linear array. Microphones lie along the X axis, and
+/// angles are measured from broadside (straight ahead of array), positive towards +X.
+/// A plane wave arriving from angle theta reaches microphone m
+/// positions[m] * sin(theta) / SpeedOfSound seconds before it reaches the array origin.
+struct MicrophoneArrayGeometry {
+    // Largest number of microphones supported.
+    static const UINT       MaxMicrophones = 8;
+
+    // Number of microphones in array.
+    UINT                    microphoneCount;
+
+    // Position of each microphone along X axis, in meters, in capture channel order.
+    float                   positions[MaxMicrophones];
+};
+
+/// Geometry of the Kinect for Windows microphone array, as documented by the Kinect SDK.
+/// <returns>four microphone geometry, in the channel order of the raw capture endpoint.</returns>
+inline MicrophoneArrayGeometry GetKinectArrayGeometry() {
+    MicrophoneArrayGeometry geometry = {4, {-0.113f, 0.036f, 0.076f, 0.113f}};
+    return geometry;
+}
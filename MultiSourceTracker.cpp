@@ -0,0 +1,205 @@
+﻿#include "MultiSourceTracker.h"
+
+// For fabsf
+#include <math.h>
+
+// Smallest distance, in degrees, from a track's predicted angle within which a peak is assigned to it.
+static const float cMinAssociationDegrees = 8.0f;
+
+// Distance, in standard deviations of a track's angle, within which a peak is assigned to it,
+// when that is wider than cMinAssociationDegrees.
+static const float cAssociationDeviations = 3.0f;
+
+// Weakest peak that starts a new track. Weaker peaks only feed tracks that already exist.
+static const float cMinBirthStrength = 0.2f;
+
+// Weakest smoothed strength a track may fall to. Where two sources' responses overlap, the map
+// can show a weak ghost peak between them, which starts a track but never keeps it strong.
+static const float cMinTrackStrength = 0.15f;
+
+// Time, in seconds, a track lives on without being assigned a peak. Long enough to carry a
+// talker across pauses between phrases, and turns taken by others.
+static const float cDropSeconds = 2.0f;
+
+// Distance, in degrees, at which two tracks are taken to follow the same source, and the younger ends.
+static const float cMergeDegrees = 5.0f;
+
+// Weight given to a track's strength so far when a new peak is assigned to it.
+static const float cStrengthSmoothing = 0.8f;
+
+/// Constructor
+/// <param name="sampleRate">sample rate of stream map frames are positioned in, in Hz.</param>
+MultiSourceTracker::MultiSourceTracker(UINT sampleRate) :
+    m_dropSamples(static_cast<UINT64>(cDropSeconds * sampleRate)),
+    m_nextId(1) {
+    for (UINT t = 0; t < cMaxTracks; ++t) {
+        m_slots[t].pTracker = new AngleTracker(sampleRate);
+    }
+
+    Reset();
+}
+
+/// Destructor
+MultiSourceTracker::~MultiSourceTracker() {
+    for (UINT t = 0; t < cMaxTracks; ++t) {
+        delete m_slots[t].pTracker;
+        m_slots[t].pTracker = NULL;
+    }
+}
+
+/// End every track. Track ids keep counting.
+void MultiSourceTracker::Reset() {
+    for (UINT t = 0; t < cMaxTracks; ++t) {
+        m_slots[t].pTracker->Reset();
+        m_slots[t].bActive = false;
+        m_slots[t].id = 0;
+        m_slots[t].hitCount = 0;
+        m_slots[t].lastHitPosition = 0;
+        m_slots[t].strength = 0.0f;
+    }
+}
+
+/// Assign one map frame's peaks to tracks, starting and ending tracks as needed.
+/// <param name="samplePosition">index, since start of stream, of sample at end of map frame.</param>
+/// <param name="pPeaks">peaks of frame, strongest first, as found by SrpPhatMap::FindPeaks.</param>
+/// <param name="peakCount">number of peaks.</param>
+void MultiSourceTracker::Update(UINT64 samplePosition, const AngularPeak* pPeaks, UINT peakCount) {
+    for (UINT t = 0; t < cMaxTracks; ++t) {
+        if (m_slots[t].bActive) {
+            m_slots[t].pTracker->Predict(samplePosition);
+        }
+    }
+
+    // Each track takes at most one peak per frame, so two sources never collapse onto one track
+    bool bAssigned[cMaxTracks] = {false};
+
+    for (UINT i = 0; i < peakCount; ++i) {
+        UINT nearest = cMaxTracks;
+        float nearestDistance = 0.0f;
+
+        for (UINT t = 0; t < cMaxTracks; ++t) {
+            if (!m_slots[t].bActive || bAssigned[t]) {
+                continue;
+            }
+
+            float gate = cAssociationDeviations * m_slots[t].pTracker->GetUncertaintyDegrees();
+            gate = (gate > cMinAssociationDegrees) ? gate : cMinAssociationDegrees;
+
+            float distance = fabsf(pPeaks[i].angleDegrees - m_slots[t].pTracker->GetAngleDegrees());
+            if (distance <= gate && (cMaxTracks == nearest || distance < nearestDistance)) {
+                nearest = t;
+                nearestDistance = distance;
+            }
+        }
+
+        if (cMaxTracks != nearest) {
+            Slot& slot = m_slots[nearest];
+            slot.pTracker->Update(samplePosition, pPeaks[i].angleDegrees, pPeaks[i].strength);
+            slot.strength = cStrengthSmoothing * slot.strength + (1.0f - cStrengthSmoothing) * pPeaks[i].strength;
+            slot.lastHitPosition = samplePosition;
+            ++slot.hitCount;
+            bAssigned[nearest] = true;
+            continue;
+        }
+
+        // Unclaimed peak starts a track in a free slot, if it is strong enough to be a source
+        if (pPeaks[i].strength < cMinBirthStrength) {
+            continue;
+        }
+
+        for (UINT t = 0; t < cMaxTracks; ++t) {
+            if (m_slots[t].bActive) {
+                continue;
+            }
+
+            Slot& slot = m_slots[t];
+            slot.pTracker->Reset();
+            slot.pTracker->Update(samplePosition, pPeaks[i].angleDegrees, pPeaks[i].strength);
+            slot.bActive = true;
+            slot.id = m_nextId++;
+            slot.hitCount = 1;
+            slot.lastHitPosition = samplePosition;
+            slot.strength = pPeaks[i].strength;
+            bAssigned[t] = true;
+            break;
+        }
+    }
+
+    DropStale(samplePosition);
+}
+
+/// Advance every track to a later point in stream without measuring, ending those left unheard too long.
+/// <param name="samplePosition">index, since start of stream, of sample to advance to.</param>
+void MultiSourceTracker::Predict(UINT64 samplePosition) {
+    for (UINT t = 0; t < cMaxTracks; ++t) {
+        if (m_slots[t].bActive) {
+            m_slots[t].pTracker->Predict(samplePosition);
+        }
+    }
+
+    DropStale(samplePosition);
+}
+
+/// Copy out confirmed tracks, oldest first.
+/// <param name="pTracks">receives tracks.</param>
+/// <param name="maxTracks">capacity of pTracks.</param>
+/// <returns>number of tracks written to pTracks.</returns>
+UINT MultiSourceTracker::GetTracks(SourceTrack* pTracks, UINT maxTracks) const {
+    UINT trackCount = 0;
+
+    // Ids grow with age, so repeatedly taking the smallest id not yet taken gives oldest first
+    UINT previousId = 0;
+    while (trackCount < maxTracks) {
+        const Slot* pOldest = NULL;
+        for (UINT t = 0; t < cMaxTracks; ++t) {
+            const Slot& slot = m_slots[t];
+            if (slot.bActive && slot.hitCount >= cConfirmationHits && slot.id > previousId && (NULL == pOldest || slot.id < pOldest->id)) {
+                pOldest = &slot;
+            }
+        }
+
+        if (NULL == pOldest) {
+            break;
+        }
+
+        SourceTrack& track = pTracks[trackCount++];
+        track.id = pOldest->id;
+        track.angleDegrees = pOldest->pTracker->GetAngleDegrees();
+        track.velocityDegreesPerSecond = pOldest->pTracker->GetVelocityDegreesPerSecond();
+        track.uncertaintyDegrees = pOldest->pTracker->GetUncertaintyDegrees();
+        track.strength = pOldest->strength;
+        previousId = pOldest->id;
+    }
+
+    return trackCount;
+}
+
+/// End tracks left unheard too long, grown too weak, dropped by their tracker, or merged into an older track.
+/// <param name="samplePosition">current stream position.</param>
+void MultiSourceTracker::DropStale(UINT64 samplePosition) {
+    for (UINT t = 0; t < cMaxTracks; ++t) {
+        Slot& slot = m_slots[t];
+        if (slot.bActive && (!slot.pTracker->IsTracking() || slot.strength < cMinTrackStrength ||
+            samplePosition > slot.lastHitPosition + m_dropSamples)) {
+            slot.bActive = false;
+        }
+    }
+
+    for (UINT t = 0; t < cMaxTracks; ++t) {
+        for (UINT u = t + 1; u < cMaxTracks; ++u) {
+            Slot& first = m_slots[t];
+            Slot& second = m_slots[u];
+            if (!first.bActive || !second.bActive ||
+                fabsf(first.pTracker->GetAngleDegrees() - second.pTracker->GetAngleDegrees()) > cMergeDegrees) {
+                continue;
+            }
+
+            if (first.id > second.id) {
+                first.bActive = false;
+            }
+            else {
+                second.bActive = false;
+            }
+        }
+    }
+}
@@ -0,0 +1,86 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "AngleTracker.h"
+#include "SrpPhatMap.h"
+
+/// One sound source followed by MultiSourceTracker.
+struct SourceTrack {
+    // Identifies track for as long as it lives. Every new track gets a new one, counting from 1.
+    UINT                    id;
+
+    // Smoothed angle, in degrees, its rate of change in degrees per second, and its standard deviation in degrees.
+    float                   angleDegrees;
+    float                   velocityDegreesPerSecond;
+    float                   uncertaintyDegrees;
+
+    // Smoothed strength of map peaks assigned to track, in [0.0,1.0] interval.
+    float                   strength;
+};
+
+/// Follows several sound sources at once through the peaks of successive angular maps.
+/// Each frame's peaks are assigned, strongest first, to the nearest track whose predicted
+/// angle is close enough; each track smooths its peaks with its own AngleTracker. A peak
+/// no track claims starts a tentative track, which is reported once it has been seen in
+/// several frames. Tracks that get no peak for a while, whose peaks stay weak, or that
+/// drift onto another, end.
+/// Every call is O(peaks * tracks) and nothing is allocated after construction.
+class MultiSourceTracker {
+public:
+    // Largest number of sources followed at once.
+    static const UINT       cMaxTracks = 3;
+
+    // Number of frames a track must be assigned a peak in before it is reported.
+    static const UINT       cConfirmationHits = 3;
+
+    /// Constructor
+    /// <param name="sampleRate">sample rate of stream map frames are positioned in, in Hz.</param>
+    explicit MultiSourceTracker(UINT sampleRate);
+
+    /// Destructor
+    ~MultiSourceTracker();
+
+    /// End every track. Track ids keep counting.
+    void                    Reset();
+
+    /// Assign one map frame's peaks to tracks, starting and ending tracks as needed.
+    /// <param name="samplePosition">index, since start of stream, of sample at end of map frame.</param>
+    /// <param name="pPeaks">peaks of frame, strongest first, as found by SrpPhatMap::FindPeaks.</param>
+    /// <param name="peakCount">number of peaks.</param>
+    void                    Update(UINT64 samplePosition, const AngularPeak* pPeaks, UINT peakCount);
+
+    /// Advance every track to a later point in stream without measuring, ending those left unheard too long.
+    /// <param name="samplePosition">index, since start of stream, of sample to advance to.</param>
+    void                    Predict(UINT64 samplePosition);
+
+    /// Copy out confirmed tracks, oldest first.
+    /// <param name="pTracks">receives tracks.</param>
+    /// <param name="maxTracks">capacity of pTracks.</param>
+    /// <returns>number of tracks written to pTracks.</returns>
+    UINT                    GetTracks(SourceTrack* pTracks, UINT maxTracks) const;
+
+private:
+    /// State of one track slot.
+    struct Slot {
+        AngleTracker*       pTracker;
+        bool                bActive;
+        UINT                id;
+        UINT                hitCount;
+        UINT64              lastHitPosition;
+        float               strength;
+    };
+
+    Slot                    m_slots[cMaxTracks];
+
+    // Time, in samples, a track lives on without being assigned a peak.
+    UINT64                  m_dropSamples;
+
+    UINT                    m_nextId;
+
+    /// End tracks left unheard too long, grown too weak, dropped by their tracker, or merged into an older track.
+    /// <param name="samplePosition">current stream position.</param>
+    void                    DropStale(UINT64 samplePosition);
+
+    MultiSourceTracker(const MultiSourceTracker&);
+    MultiSourceTracker& operator=(const MultiSourceTracker&);
+};
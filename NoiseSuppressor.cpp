@@ -0,0 +1,539 @@
+﻿#include "NoiseSuppressor.h"
+#include "AudioEnergy.h"
+#include "Stft.h"
+
+// For M_PI, cos, exp, log10, pow and sqrt
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+// Time constant, in seconds, of each bin's power smoothing.
+static const float cPowerSmoothingSeconds = 0.03f;
+
+// Shortest power smoothing time constant, in hops. Long frames have few hops per second, and
+// smoothing over fewer than this leaves power too ragged for its minimum to track noise.
+static const float cMinPowerSmoothingHops = 4.0f;
+
+// Rate, in dB per second, at which a bin's noise floor may rise toward its smoothed power.
+static const float cNoiseRiseDbPerSecond = 5.0f;
+
+// Multiple of noise floor subtracted from smoothed power when choosing gain. Minimum
+// tracking settles below mean noise power, so this also makes up for that bias.
+static const float cOverSubtraction = 2.5f;
+
+// Initial noise floor, far above any real power so first frame sets it.
+static const float cUnknownNoisePower = 1e30f;
+
+// Level, in dB relative to a full scale square wave, automatic gain control aims for.
+static const float cTargetLevelDb = -20.0f;
+
+// Level, in dB relative to a full scale square wave, below which gain is held.
+static const float cGateLevelDb = -50.0f;
+
+// Range of gain, in dB, automatic gain control may apply.
+static const float cMinGainDb = -20.0f;
+static const float cMaxGainDb = 30.0f;
+
+// Time constants, in seconds, of level envelope rising and falling.
+static const float cAttackSeconds = 0.01f;
+static const float cReleaseSeconds = 0.3f;
+
+// Rate, in dB per second, at which gain may rise.
+static const float cGainRiseDbPerSecond = 10.0f;
+
+/// Per-hop constants shared by every bin.
+struct SuppressionParameters {
+    float                   powerSmoothing;
+    float                   noiseRise;
+    float                   overSubtraction;
+    float                   gainFloor;
+};
+
+/// Update smoothed power and noise floor of each bin, then scale bin by its gain.
+/// Bins are interleaved complex values; state holds each bin's value twice, matching them.
+/// <param name="pSpectrum">bins to scale, count / 2 of them.</param>
+/// <param name="pSmoothedPower">smoothed power of each bin, updated.</param>
+/// <param name="pNoisePower">noise floor of each bin, updated.</param>
+/// <param name="count">number of floats in each array, even.</param>
+/// <param name="params">smoothing, noise floor and gain constants.</param>
+static void SuppressBinsScalar(float* pSpectrum, float* pSmoothedPower, float* pNoisePower, UINT count, const SuppressionParameters& params) {
+    for (UINT i = 0; i < count; i += 2) {
+        float power = pSpectrum[i] * pSpectrum[i] + pSpectrum[i + 1] * pSpectrum[i + 1];
+        float smoothed = pSmoothedPower[i] * params.powerSmoothing + power * (1.0f - params.powerSmoothing);
+        float risen = pNoisePower[i] * params.noiseRise;
+        float noise = (smoothed < risen) ? smoothed : risen;
+
+        // Tiny offset keeps a silent bin's ratio finite; it then gets floor gain
+        float gain = 1.0f - params.overSubtraction * noise / (smoothed + 1e-20f);
+        gain = (gain > params.gainFloor) ? gain : params.gainFloor;
+
+        pSmoothedPower[i] = pSmoothedPower[i + 1] = smoothed;
+        pNoisePower[i] = pNoisePower[i + 1] = noise;
+        pSpectrum[i] *= gain;
+        pSpectrum[i + 1] *= gain;
+    }
+}
+
+/// Overlap-add a synthesized frame: pOverlap[i] += pFrame[i] * pWindow[i].
+static void OverlapAddScalar(float* pOverlap, const float* pFrame, const float* pWindow, UINT count) {
+    for (UINT i = 0; i < count; ++i) {
+        pOverlap[i] += pFrame[i] * pWindow[i];
+    }
+}
+
+/// Scale samples by a gain ramping linearly from gain by step per sample, rounding and saturating.
+static void ApplyGainRampScalar(int16_t* pSamples, UINT count, float gain, float step) {
+    for (UINT i = 0; i < count; ++i) {
+        float sample = pSamples[i] * (gain + step * i);
+        sample = (sample > 32767.0f) ? 32767.0f : ((sample < -32768.0f) ? -32768.0f : sample);
+        pSamples[i] = static_cast<int16_t>(floorf(sample + 0.5f));
+    }
+}
+
+#ifdef AUDIO_SIMD_X86
+
+/// SSE2 version of SuppressBinsScalar, two bins at a time.
+/// Squares of each bin's real and imaginary parts are added to their swapped copy,
+/// giving every lane its bin's power, so no deinterleaving is needed.
+AUDIO_TARGET_SSE2
+static void SuppressBinsSse2(float* pSpectrum, float* pSmoothedPower, float* pNoisePower, UINT count, const SuppressionParameters& params) {
+    const __m128 smoothing = _mm_set1_ps(params.powerSmoothing);
+    const __m128 blend = _mm_set1_ps(1.0f - params.powerSmoothing);
+    const __m128 rise = _mm_set1_ps(params.noiseRise);
+    const __m128 overSubtraction = _mm_set1_ps(params.overSubtraction);
+    const __m128 gainFloor = _mm_set1_ps(params.gainFloor);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 tiny = _mm_set1_ps(1e-20f);
+
+    UINT i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 bins = _mm_loadu_ps(pSpectrum + i);
+        __m128 squares = _mm_mul_ps(bins, bins);
+        __m128 power = _mm_add_ps(squares, _mm_shuffle_ps(squares, squares, _MM_SHUFFLE(2, 3, 0, 1)));
+
+        __m128 smoothed = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pSmoothedPower + i), smoothing), _mm_mul_ps(power, blend));
+        __m128 noise = _mm_min_ps(smoothed, _mm_mul_ps(_mm_loadu_ps(pNoisePower + i), rise));
+        __m128 ratio = _mm_div_ps(_mm_mul_ps(overSubtraction, noise), _mm_add_ps(smoothed, tiny));
+        __m128 gain = _mm_max_ps(_mm_sub_ps(one, ratio), gainFloor);
+
+        _mm_storeu_ps(pSmoothedPower + i, smoothed);
+        _mm_storeu_ps(pNoisePower + i, noise);
+        _mm_storeu_ps(pSpectrum + i, _mm_mul_ps(bins, gain));
+    }
+
+    SuppressBinsScalar(pSpectrum + i, pSmoothedPower + i, pNoisePower + i, count - i, params);
+}
+
+/// SSE2 version of OverlapAddScalar, four samples at a time.
+AUDIO_TARGET_SSE2
+static void OverlapAddSse2(float* pOverlap, const float* pFrame, const float* pWindow, UINT count) {
+    UINT i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 product = _mm_mul_ps(_mm_loadu_ps(pFrame + i), _mm_loadu_ps(pWindow + i));
+        _mm_storeu_ps(pOverlap + i, _mm_add_ps(_mm_loadu_ps(pOverlap + i), product));
+    }
+
+    OverlapAddScalar(pOverlap + i, pFrame + i, pWindow + i, count - i);
+}
+
+/// SSE2 version of ApplyGainRampScalar, eight samples at a time.
+/// Samples are widened by unpacking into the high half of 32-bit lanes and shifting back,
+/// and narrowed by packssdw, which saturates.
+AUDIO_TARGET_SSE2
+static void ApplyGainRampSse2(int16_t* pSamples, UINT count, float gain, float step) {
+    __m128 gainLow = _mm_add_ps(_mm_set1_ps(gain), _mm_mul_ps(_mm_set1_ps(step), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f)));
+    __m128 gainHigh = _mm_add_ps(gainLow, _mm_set1_ps(4.0f * step));
+    const __m128 advance = _mm_set1_ps(8.0f * step);
+
+    UINT i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSamples + i));
+        __m128 low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+        __m128 high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+
+        __m128i scaledLow = _mm_cvtps_epi32(_mm_mul_ps(low, gainLow));
+        __m128i scaledHigh = _mm_cvtps_epi32(_mm_mul_ps(high, gainHigh));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pSamples + i), _mm_packs_epi32(scaledLow, scaledHigh));
+
+        gainLow = _mm_add_ps(gainLow, advance);
+        gainHigh = _mm_add_ps(gainHigh, advance);
+    }
+
+    ApplyGainRampScalar(pSamples + i, count - i, gain + step * i, step);
+}
+
+/// AVX2 version of SuppressBinsScalar, four bins at a time.
+AUDIO_TARGET_AVX2
+static void SuppressBinsAvx2(float* pSpectrum, float* pSmoothedPower, float* pNoisePower, UINT count, const SuppressionParameters& params) {
+    const __m256 smoothing = _mm256_set1_ps(params.powerSmoothing);
+    const __m256 blend = _mm256_set1_ps(1.0f - params.powerSmoothing);
+    const __m256 rise = _mm256_set1_ps(params.noiseRise);
+    const __m256 overSubtraction = _mm256_set1_ps(params.overSubtraction);
+    const __m256 gainFloor = _mm256_set1_ps(params.gainFloor);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 tiny = _mm256_set1_ps(1e-20f);
+
+    UINT i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 bins = _mm256_loadu_ps(pSpectrum + i);
+        __m256 squares = _mm256_mul_ps(bins, bins);
+        __m256 power = _mm256_add_ps(squares, _mm256_permute_ps(squares, _MM_SHUFFLE(2, 3, 0, 1)));
+
+        __m256 smoothed = _mm256_fmadd_ps(_mm256_loadu_ps(pSmoothedPower + i), smoothing, _mm256_mul_ps(power, blend));
+        __m256 noise = _mm256_min_ps(smoothed, _mm256_mul_ps(_mm256_loadu_ps(pNoisePower + i), rise));
+        __m256 ratio = _mm256_div_ps(_mm256_mul_ps(overSubtraction, noise), _mm256_add_ps(smoothed, tiny));
+        __m256 gain = _mm256_max_ps(_mm256_sub_ps(one, ratio), gainFloor);
+
+        _mm256_storeu_ps(pSmoothedPower + i, smoothed);
+        _mm256_storeu_ps(pNoisePower + i, noise);
+        _mm256_storeu_ps(pSpectrum + i, _mm256_mul_ps(bins, gain));
+    }
+
+    // Tail is called, not inlined, so upper halves are cleared first as in ApplyGainRampAvx2
+    _mm256_zeroupper();
+
+    SuppressBinsScalar(pSpectrum + i, pSmoothedPower + i, pNoisePower + i, count - i, params);
+}
+
+/// AVX2 version of OverlapAddScalar, eight samples at a time.
+AUDIO_TARGET_AVX2
+static void OverlapAddAvx2(float* pOverlap, const float* pFrame, const float* pWindow, UINT count) {
+    UINT i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 sum = _mm256_fmadd_ps(_mm256_loadu_ps(pFrame + i), _mm256_loadu_ps(pWindow + i), _mm256_loadu_ps(pOverlap + i));
+        _mm256_storeu_ps(pOverlap + i, sum);
+    }
+
+    OverlapAddScalar(pOverlap + i, pFrame + i, pWindow + i, count - i);
+}
+
+/// AVX2 version of ApplyGainRampScalar, sixteen samples at a time.
+/// packssdw works within 128-bit lanes, so packed quadwords are put back in order afterwards.
+AUDIO_TARGET_AVX2
+static void ApplyGainRampAvx2(int16_t* pSamples, UINT count, float gain, float step) {
+    __m256 gainLow = _mm256_add_ps(_mm256_set1_ps(gain), _mm256_mul_ps(_mm256_set1_ps(step), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f)));
+    __m256 gainHigh = _mm256_add_ps(gainLow, _mm256_set1_ps(8.0f * step));
+    const __m256 advance = _mm256_set1_ps(16.0f * step);
+
+    UINT i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i lowSamples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSamples + i));
+        __m128i highSamples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSamples + i + 8));
+        __m256 low = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(lowSamples));
+        __m256 high = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(highSamples));
+
+        __m256i scaledLow = _mm256_cvtps_epi32(_mm256_mul_ps(low, gainLow));
+        __m256i scaledHigh = _mm256_cvtps_epi32(_mm256_mul_ps(high, gainHigh));
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(scaledLow, scaledHigh), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pSamples + i), packed);
+
+        gainLow = _mm256_add_ps(gainLow, advance);
+        gainHigh = _mm256_add_ps(gainHigh, advance);
+    }
+
+    // GCC doesn't clear upper halves before a tail call, so non-VEX code run after it pays an
+    // AVX transition penalty; with one call per short update interval that cost dominated.
+    _mm256_zeroupper();
+
+    ApplyGainRampScalar(pSamples + i, count - i, gain + step * i, step);
+}
+
+#endif
+
+/// Update noise estimates and scale bins, using requested instruction set.
+static void SuppressBins(SimdLevel level, float* pSpectrum, float* pSmoothedPower, float* pNoisePower, UINT count, const SuppressionParameters& params) {
+#ifdef AUDIO_SIMD_X86
+    if (SimdLevelAvx2 == level) {
+        SuppressBinsAvx2(pSpectrum, pSmoothedPower, pNoisePower, count, params);
+        return;
+    }
+
+    if (SimdLevelSse2 == level) {
+        SuppressBinsSse2(pSpectrum, pSmoothedPower, pNoisePower, count, params);
+        return;
+    }
+#else
+    (void)level;
+#endif
+
+    SuppressBinsScalar(pSpectrum, pSmoothedPower, pNoisePower, count, params);
+}
+
+/// Overlap-add a synthesized frame, using requested instruction set.
+static void OverlapAdd(SimdLevel level, float* pOverlap, const float* pFrame, const float* pWindow, UINT count) {
+#ifdef AUDIO_SIMD_X86
+    if (SimdLevelAvx2 == level) {
+        OverlapAddAvx2(pOverlap, pFrame, pWindow, count);
+        return;
+    }
+
+    if (SimdLevelSse2 == level) {
+        OverlapAddSse2(pOverlap, pFrame, pWindow, count);
+        return;
+    }
+#else
+    (void)level;
+#endif
+
+    OverlapAddScalar(pOverlap, pFrame, pWindow, count);
+}
+
+/// Scale samples by a ramping gain, using requested instruction set.
+static void ApplyGainRamp(SimdLevel level, int16_t* pSamples, UINT count, float gain, float step) {
+#ifdef AUDIO_SIMD_X86
+    if (SimdLevelAvx2 == level) {
+        ApplyGainRampAvx2(pSamples, count, gain, step);
+        return;
+    }
+
+    if (SimdLevelSse2 == level) {
+        ApplyGainRampSse2(pSamples, count, gain, step);
+        return;
+    }
+#else
+    (void)level;
+#endif
+
+    ApplyGainRampScalar(pSamples, count, gain, step);
+}
+
+/// Constructor
+NoiseSuppressor::NoiseSuppressor() :
+    m_frameSize(0),
+    m_hopSize(0),
+    m_level(SimdLevelScalar),
+    m_pWindow(NULL),
+    m_pHistory(NULL),
+    m_writeIndex(0),
+    m_hopPosition(0),
+    m_pOverlap(NULL),
+    m_pOutput(NULL),
+    m_pFrame(NULL),
+    m_pSmoothedPower(NULL),
+    m_pNoisePower(NULL),
+    m_powerSmoothing(0.0f),
+    m_noiseRise(1.0f),
+    m_gainFloor(1.0f),
+    m_bPrimed(false) {
+}
+
+/// Destructor
+NoiseSuppressor::~NoiseSuppressor() {
+    delete [] m_pWindow;
+    delete [] m_pHistory;
+    delete [] m_pOverlap;
+    delete [] m_pOutput;
+    delete [] m_pFrame;
+    delete [] m_pSmoothedPower;
+    delete [] m_pNoisePower;
+}
+
+/// Configure frame size and allocate history and workspaces.
+/// <param name="frameSize">samples per frame, a power of two from cMinFrameSize to cMaxFrameSize.
+/// Larger frames resolve frequency better at the cost of latency.</param>
+/// <param name="sampleRate">sample rate of audio, in Hz, used to scale time constants.</param>
+/// <param name="level">instruction set used by FFT and per-bin kernels.</param>
+/// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range.</returns>
+HRESULT NoiseSuppressor::Initialize(UINT frameSize, UINT sampleRate, SimdLevel level) {
+    if (frameSize < cMinFrameSize || frameSize > cMaxFrameSize || 0 == sampleRate) {
+        return E_INVALIDARG;
+    }
+
+    HRESULT hr = m_plan.Initialize(frameSize, level);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    delete [] m_pWindow;
+    delete [] m_pHistory;
+    delete [] m_pOverlap;
+    delete [] m_pOutput;
+    delete [] m_pFrame;
+    delete [] m_pSmoothedPower;
+    delete [] m_pNoisePower;
+
+    m_frameSize = frameSize;
+    m_hopSize = frameSize / 2;
+    m_level = level;
+    m_pWindow = new float[frameSize];
+    m_pHistory = new float[2 * frameSize];
+    m_pOverlap = new float[frameSize];
+    m_pOutput = new float[m_hopSize];
+    m_pFrame = new float[frameSize + 2];
+    m_pSmoothedPower = new float[frameSize + 2];
+    m_pNoisePower = new float[frameSize + 2];
+
+    for (UINT i = 0; i < frameSize; ++i) {
+        m_pWindow[i] = static_cast<float>(sqrt(0.5 - 0.5 * cos(2.0 * M_PI * i / frameSize)));
+    }
+
+    double hopSeconds = static_cast<double>(m_hopSize) / sampleRate;
+    double smoothingSeconds = (cPowerSmoothingSeconds > cMinPowerSmoothingHops * hopSeconds) ? cPowerSmoothingSeconds : cMinPowerSmoothingHops * hopSeconds;
+    m_powerSmoothing = static_cast<float>(exp(-hopSeconds / smoothingSeconds));
+    m_noiseRise = static_cast<float>(pow(10.0, cNoiseRiseDbPerSecond * hopSeconds / 10.0));
+    m_gainFloor = static_cast<float>(pow(10.0, -static_cast<double>(cMaxAttenuationDb) / 20.0));
+
+    Reset();
+
+    return S_OK;
+}
+
+/// Forget audio and noise estimates carried between calls. Output restarts with one frame of silence.
+void NoiseSuppressor::Reset() {
+    if (NULL == m_pHistory) {
+        return;
+    }
+
+    memset(m_pHistory, 0, 2 * m_frameSize * sizeof(float));
+    memset(m_pOverlap, 0, m_frameSize * sizeof(float));
+    memset(m_pOutput, 0, m_hopSize * sizeof(float));
+    memset(m_pSmoothedPower, 0, (m_frameSize + 2) * sizeof(float));
+    for (UINT i = 0; i < m_frameSize + 2; ++i) {
+        m_pNoisePower[i] = cUnknownNoisePower;
+    }
+
+    m_writeIndex = 0;
+    m_hopPosition = 0;
+    m_bPrimed = false;
+}
+
+/// Suppress noise in a run of samples, in place. Does nothing before Initialize.
+/// <param name="pSamples">samples to process; receives output delayed by GetLatency samples.</param>
+/// <param name="sampleCount">number of samples.</param>
+void NoiseSuppressor::Process(int16_t* pSamples, UINT sampleCount) {
+    if (0 == m_frameSize) {
+        return;
+    }
+
+    while (sampleCount > 0) {
+        UINT count = m_hopSize - m_hopPosition;
+        count = (sampleCount < count) ? sampleCount : count;
+
+        // Each input sample goes to both of its mirrored ring positions, and is replaced by completed output
+        const float* pOutput = m_pOutput + m_hopPosition;
+        UINT index = m_writeIndex;
+        for (UINT i = 0; i < count; ++i) {
+            float sample = static_cast<float>(pSamples[i]);
+            m_pHistory[index] = sample;
+            m_pHistory[index + m_frameSize] = sample;
+            if (++index == m_frameSize) {
+                index = 0;
+            }
+
+            float output = pOutput[i];
+            output = (output > 32767.0f) ? 32767.0f : ((output < -32768.0f) ? -32768.0f : output);
+            pSamples[i] = static_cast<int16_t>(floorf(output + 0.5f));
+        }
+
+        m_writeIndex = index;
+        m_hopPosition += count;
+        pSamples += count;
+        sampleCount -= count;
+
+        if (m_hopPosition == m_hopSize) {
+            m_hopPosition = 0;
+            ProcessHop();
+        }
+    }
+}
+
+/// Analyze most recent frame, suppress noise and overlap-add result into output.
+void NoiseSuppressor::ProcessHop() {
+    // Write index points at oldest sample, and mirroring makes the frame behind it contiguous
+    ApplyWindow(m_level, m_pFrame, m_pHistory + m_writeIndex, m_pWindow, m_frameSize);
+    m_plan.Forward(m_pFrame);
+
+    // First frame seeds smoothed power, so noise floor doesn't have to climb out of silence
+    SuppressionParameters params;
+    params.powerSmoothing = m_bPrimed ? m_powerSmoothing : 0.0f;
+    params.noiseRise = m_noiseRise;
+    params.overSubtraction = cOverSubtraction;
+    params.gainFloor = m_gainFloor;
+    SuppressBins(m_level, m_pFrame, m_pSmoothedPower, m_pNoisePower, m_frameSize + 2, params);
+    m_bPrimed = true;
+
+    m_plan.Inverse(m_pFrame);
+    OverlapAdd(m_level, m_pOverlap, m_pFrame, m_pWindow, m_frameSize);
+
+    // First half now has every frame overlapping it; second half becomes the start of the next sum
+    memcpy(m_pOutput, m_pOverlap, m_hopSize * sizeof(float));
+    memcpy(m_pOverlap, m_pOverlap + m_hopSize, m_hopSize * sizeof(float));
+    memset(m_pOverlap + m_hopSize, 0, m_hopSize * sizeof(float));
+}
+
+/// Constructor
+/// <param name="sampleRate">sample rate of audio, in Hz, used to scale time constants.</param>
+/// <param name="level">instruction set used by kernels.</param>
+AutomaticGainControl::AutomaticGainControl(UINT sampleRate, SimdLevel level) :
+    m_level(level),
+    m_gain(1.0f),
+    m_envelope(0.0f) {
+    double intervalSeconds = static_cast<double>(cUpdateInterval) / sampleRate;
+    m_attack = static_cast<float>(exp(-intervalSeconds / cAttackSeconds));
+    m_release = static_cast<float>(exp(-intervalSeconds / cReleaseSeconds));
+    m_maxRise = static_cast<float>(pow(10.0, cGainRiseDbPerSecond * intervalSeconds / 20.0));
+
+    // Levels are relative to a full scale square wave, whose mean square is 32768^2
+    const double fullScale = 32768.0 * 32768.0;
+    m_gateLevel = static_cast<float>(fullScale * pow(10.0, cGateLevelDb / 10.0));
+    m_targetLevel = static_cast<float>(fullScale * pow(10.0, cTargetLevelDb / 10.0));
+    m_minGain = static_cast<float>(pow(10.0, cMinGainDb / 20.0));
+    m_maxGain = static_cast<float>(pow(10.0, cMaxGainDb / 20.0));
+}
+
+/// Return to unity gain and forget measured level.
+void AutomaticGainControl::Reset() {
+    m_gain = 1.0f;
+    m_envelope = 0.0f;
+}
+
+/// Apply gain to a run of samples, in place, saturating at full scale.
+/// <param name="pSamples">samples to process.</param>
+/// <param name="sampleCount">number of samples.</param>
+void AutomaticGainControl::Process(int16_t* pSamples, UINT sampleCount) {
+    while (sampleCount > 0) {
+        UINT count = (sampleCount < cUpdateInterval) ? sampleCount : cUpdateInterval;
+        ProcessInterval(pSamples, count);
+        pSamples += count;
+        sampleCount -= count;
+    }
+}
+
+/// Gain applied to most recent sample, in dB.
+float AutomaticGainControl::GetGainDb() const {
+    return 20.0f * log10f(m_gain);
+}
+
+/// Measure level of an update interval, pick gain and apply it.
+/// <param name="pSamples">samples to process.</param>
+/// <param name="sampleCount">number of samples, at most cUpdateInterval.</param>
+void AutomaticGainControl::ProcessInterval(int16_t* pSamples, UINT sampleCount) {
+    UINT64 squareSum = 0;
+    SumSquaresWindows(m_level, pSamples, sampleCount, 1, &squareSum);
+    float meanSquare = static_cast<float>(squareSum) / sampleCount;
+
+    // Weights are for a whole interval; a short one at the end of a block scales them to its length
+    float attack = m_attack;
+    float release = m_release;
+    float maxRise = m_maxRise;
+    if (sampleCount < cUpdateInterval) {
+        float fraction = static_cast<float>(sampleCount) / cUpdateInterval;
+        attack = powf(attack, fraction);
+        release = powf(release, fraction);
+        maxRise = powf(maxRise, fraction);
+    }
+
+    float weight = (meanSquare > m_envelope) ? attack : release;
+    m_envelope = m_envelope * weight + meanSquare * (1.0f - weight);
+
+    float targetGain = m_gain;
+    if (m_envelope > m_gateLevel) {
+        targetGain = sqrtf(m_targetLevel / m_envelope);
+        targetGain = (targetGain < m_minGain) ? m_minGain : ((targetGain > m_maxGain) ? m_maxGain : targetGain);
+    }
+
+    // Falls happen at once so loud onsets aren't clipped for long; rises are rate limited
+    float gain = (targetGain > m_gain * maxRise) ? m_gain * maxRise : targetGain;
+
+    ApplyGainRamp(m_level, pSamples, sampleCount, m_gain, (gain - m_gain) / sampleCount);
+    m_gain = gain;
+}
@@ -0,0 +1,150 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "Fft.h"
+#include "Simd.h"
+
+/// Streaming spectral noise suppressor for 16-bit PCM mono audio.
+/// Audio is cut into frames overlapping by half, weighted by a square root Hann window and
+/// transformed with a real FFT. Each bin's noise floor is tracked as the minimum of its
+/// smoothed power, allowed to creep upward slowly so it follows rising noise, and bins are
+/// scaled by a Wiener-style gain that falls toward a floor as power approaches the noise
+/// floor. Frames are transformed back, weighted again and overlap-added.
+/// Output lags input by exactly one frame, whatever block sizes are fed.
+/// Memory is allocated by Initialize; Process performs no allocations.
+class NoiseSuppressor {
+public:
+    // Smallest and largest supported frame, in samples.
+    static const UINT       cMinFrameSize = 16;
+    static const UINT       cMaxFrameSize = 4096;
+
+    // Attenuation, in dB, of bins holding only noise.
+    static const UINT       cMaxAttenuationDb = 15;
+
+    /// Constructor
+    NoiseSuppressor();
+
+    /// Destructor
+    ~NoiseSuppressor();
+
+    /// Configure frame size and allocate history and workspaces.
+    /// <param name="frameSize">samples per frame, a power of two from cMinFrameSize to cMaxFrameSize.
+    /// Larger frames resolve frequency better at the cost of latency.</param>
+    /// <param name="sampleRate">sample rate of audio, in Hz, used to scale time constants.</param>
+    /// <param name="level">instruction set used by FFT and per-bin kernels.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range.</returns>
+    HRESULT                 Initialize(UINT frameSize, UINT sampleRate, SimdLevel level);
+
+    /// Forget audio and noise estimates carried between calls. Output restarts with one frame of silence.
+    void                    Reset();
+
+    /// Suppress noise in a run of samples, in place. Does nothing before Initialize.
+    /// <param name="pSamples">samples to process; receives output delayed by GetLatency samples.</param>
+    /// <param name="sampleCount">number of samples.</param>
+    void                    Process(int16_t* pSamples, UINT sampleCount);
+
+    /// Samples per frame.
+    UINT                    GetFrameSize() const { return m_frameSize; }
+
+    /// Delay, in samples, between input and output.
+    UINT                    GetLatency() const { return m_frameSize; }
+
+private:
+    UINT                    m_frameSize;
+    UINT                    m_hopSize;
+    SimdLevel               m_level;
+
+    RealFftPlan             m_plan;
+
+    // Square root of periodic Hann window, used for analysis and synthesis. Squares of overlapping halves sum to one.
+    float*                  m_pWindow;
+
+    // Mirrored ring of 2 * frameSize input samples, as in StftAnalyzer.
+    float*                  m_pHistory;
+
+    // Position in ring where next sample is written, in [0, frameSize).
+    UINT                    m_writeIndex;
+
+    // Samples of current hop already read from input and written to output.
+    UINT                    m_hopPosition;
+
+    // Sum of synthesized frames overlapping samples not yet complete. frameSize floats.
+    float*                  m_pOverlap;
+
+    // Completed output hop, written out while next hop of input is read. hopSize floats.
+    float*                  m_pOutput;
+
+    // Windowed frame, transformed in place. frameSize + 2 floats.
+    float*                  m_pFrame;
+
+    // Smoothed power and noise floor of each bin, stored twice so they line up with interleaved spectrum.
+    float*                  m_pSmoothedPower;
+    float*                  m_pNoisePower;
+
+    // Weight of previous smoothed power, and factor noise floor may rise by, each hop.
+    float                   m_powerSmoothing;
+    float                   m_noiseRise;
+
+    // Gain of bins holding only noise.
+    float                   m_gainFloor;
+
+    // Whether a frame was analyzed since Reset; first one seeds smoothed power.
+    bool                    m_bPrimed;
+
+    /// Analyze most recent frame, suppress noise and overlap-add result into output.
+    void                    ProcessHop();
+
+    NoiseSuppressor(const NoiseSuppressor&);
+    NoiseSuppressor& operator=(const NoiseSuppressor&);
+};
+
+/// Automatic gain control for 16-bit PCM mono audio.
+/// Level is measured every cUpdateInterval samples with a fast attack, slow release
+/// envelope follower, and gain moves toward the value bringing it to a target level:
+/// at once when it must fall, at a limited rate when it may rise. Gain is held while
+/// level is below a gate, so silence isn't amplified into noise. Gain changes are
+/// ramped across each interval so they don't click.
+class AutomaticGainControl {
+public:
+    // Samples between gain updates (5 ms at 16 kHz).
+    static const UINT       cUpdateInterval = 80;
+
+    /// Constructor
+    /// <param name="sampleRate">sample rate of audio, in Hz, used to scale time constants.</param>
+    /// <param name="level">instruction set used by kernels.</param>
+    AutomaticGainControl(UINT sampleRate, SimdLevel level);
+
+    /// Return to unity gain and forget measured level.
+    void                    Reset();
+
+    /// Apply gain to a run of samples, in place, saturating at full scale.
+    /// <param name="pSamples">samples to process.</param>
+    /// <param name="sampleCount">number of samples.</param>
+    void                    Process(int16_t* pSamples, UINT sampleCount);
+
+    /// Gain applied to most recent sample, in dB.
+    float                   GetGainDb() const;
+
+private:
+    SimdLevel               m_level;
+
+    // Current linear gain, and mean square level measured by envelope follower.
+    float                   m_gain;
+    float                   m_envelope;
+
+    // Envelope weights and largest gain rise for a whole update interval.
+    float                   m_attack;
+    float                   m_release;
+    float                   m_maxRise;
+
+    // Mean square levels of gate and target, and range of linear gain.
+    float                   m_gateLevel;
+    float                   m_targetLevel;
+    float                   m_minGain;
+    float                   m_maxGain;
+
+    /// Measure level of an update interval, pick gain and apply it.
+    /// <param name="pSamples">samples to process.</param>
+    /// <param name="sampleCount">number of samples, at most cUpdateInterval.</param>
+    void                    ProcessInterval(int16_t* pSamples, UINT sampleCount);
+};
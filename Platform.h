@@ -0,0 +1,144 @@
+﻿#pragma once
+
+// Portable code (audio sources, processing stages, headless tools) includes this header
+// instead of stdafx.h. On Windows it pulls in the real SDK headers; elsewhere it supplies
+// the handful of Windows/COM definitions that code relies on, so HRESULT-based error
+// handling and IMediaBuffer can be used unchanged on Linux.
+
+// For fixed width integer types
+#include <stdint.h>
+
+// For NULL and size_t
+#include <stddef.h>
+
+// For memcmp/memcpy
+#include <string.h>
+
+#ifdef _WIN32
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+// Windows Header Files
+#include <windows.h>
+
+// For IMediaBuffer
+#include <dmo.h>
+
+// For WAVE_FORMAT_PCM
+#include <mmreg.h>
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+// For _snprintf_s
+#include <stdio.h>
+
+// VS2013 runtime has no C99 snprintf; this truncates and terminates the same way
+#define snprintf(szBuffer, cchBuffer, ...) _snprintf_s(szBuffer, cchBuffer, _TRUNCATE, __VA_ARGS__)
+#endif
+
+#else
+
+typedef int32_t         HRESULT;
+typedef uint8_t         BYTE;
+typedef uint16_t        WORD;
+typedef uint32_t        DWORD;
+typedef int32_t         LONG;
+typedef uint32_t        ULONG;
+typedef uint32_t        UINT;
+typedef int32_t         BOOL;
+typedef uint64_t        UINT64;
+typedef wchar_t         WCHAR;
+
+#define S_OK            ((HRESULT)0L)
+#define S_FALSE         ((HRESULT)1L)
+#define NOERROR         S_OK
+#define E_NOTIMPL       ((HRESULT)0x80004001L)
+#define E_NOINTERFACE   ((HRESULT)0x80004002L)
+#define E_POINTER       ((HRESULT)0x80004003L)
+#define E_ABORT         ((HRESULT)0x80004004L)
+#define E_FAIL          ((HRESULT)0x80004005L)
+#define E_UNEXPECTED    ((HRESULT)0x8000FFFFL)
+#define E_ACCESSDENIED  ((HRESULT)0x80070005L)
+#define E_OUTOFMEMORY   ((HRESULT)0x8007000EL)
+#define E_INVALIDARG    ((HRESULT)0x80070057L)
+
+#define SUCCEEDED(hr)   (((HRESULT)(hr)) >= 0)
+#define FAILED(hr)      (((HRESULT)(hr)) < 0)
+
+// Map an errno value to an HRESULT the same way HRESULT_FROM_WIN32 maps Win32 error codes.
+#define HRESULT_FROM_ERRNO(e) ((HRESULT)(((e) & 0x0000FFFF) | 0x80070000))
+
+#define TRUE            1
+#define FALSE           0
+
+#define WAVE_FORMAT_PCM         1
+#define WAVE_FORMAT_IEEE_FLOAT  3
+#define WAVE_FORMAT_EXTENSIBLE  0xFFFE
+
+#pragma pack(push, 1)
+
+/// Same layout as WAVEFORMATEX declared in mmreg.h.
+struct WAVEFORMATEX {
+    WORD        wFormatTag;
+    WORD        nChannels;
+    DWORD       nSamplesPerSec;
+    DWORD       nAvgBytesPerSec;
+    WORD        nBlockAlign;
+    WORD        wBitsPerSample;
+    WORD        cbSize;
+};
+
+#pragma pack(pop)
+
+#define STDMETHODCALLTYPE
+#define STDMETHODIMP            HRESULT STDMETHODCALLTYPE
+#define STDMETHODIMP_(type)     type STDMETHODCALLTYPE
+
+struct GUID {
+    uint32_t    Data1;
+    uint16_t    Data2;
+    uint16_t    Data3;
+    uint8_t     Data4[8];
+};
+
+typedef GUID            IID;
+typedef const IID&      REFIID;
+
+inline bool operator==(const GUID& left, const GUID& right) {
+    return 0 == memcmp(&left, &right, sizeof(GUID));
+}
+
+inline bool operator!=(const GUID& left, const GUID& right) {
+    return !(left == right);
+}
+
+static const IID IID_IUnknown       = {0x00000000, 0x0000, 0x0000, {0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46}};
+static const IID IID_IMediaBuffer   = {0x59eff8b9, 0x938c, 0x4a26, {0x82, 0xf2, 0x95, 0xcb, 0x84, 0xcd, 0xc8, 0x37}};
+
+/// Subset of IUnknown needed by portable COM-style objects.
+struct IUnknown {
+    virtual STDMETHODIMP QueryInterface(REFIID riid, void **ppv) = 0;
+    virtual STDMETHODIMP_(ULONG) AddRef() = 0;
+    virtual STDMETHODIMP_(ULONG) Release() = 0;
+};
+
+/// Same contract as the DMO IMediaBuffer interface declared in mediaobj.h.
+struct IMediaBuffer : public IUnknown {
+    virtual STDMETHODIMP SetLength(DWORD cbLength) = 0;
+    virtual STDMETHODIMP GetMaxLength(DWORD *pcbMaxLength) = 0;
+    virtual STDMETHODIMP GetBufferAndLength(BYTE **ppBuffer, DWORD *pcbLength) = 0;
+};
+
+#endif
+
+// Safe release for interfaces
+template<class Interface>
+inline void SafeRelease( Interface *& pInterfaceToRelease )
+{
+    if ( pInterfaceToRelease != NULL )
+    {
+        pInterfaceToRelease->Release();
+        pInterfaceToRelease = NULL;
+    }
+}
@@ -0,0 +1,431 @@
+﻿#include "Resampler.h"
+
+// For sin, sqrt and lrintf
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+/// Filter length, window and bandwidth of a quality preset.
+struct QualityPreset {
+    // Taps per phase when output rate is at least input rate. Multiple of 16, so kernels need no tail.
+    UINT                    tapCount;
+
+    // Kaiser window shape parameter; larger trades transition width for stopband attenuation.
+    float                   kaiserBeta;
+
+    // Cutoff as a fraction of lower rate's Nyquist frequency, at middle of transition band.
+    float                   cutoff;
+};
+
+// Indexed by ResamplerQuality. Cutoffs leave transition band straddling little or none of lower rate's Nyquist frequency.
+static const QualityPreset s_qualityPresets[] = {
+    {16, 5.0f, 0.80f},
+    {32, 7.0f, 0.86f},
+    {64, 9.0f, 0.91f},
+};
+
+/// Greatest common divisor.
+/// <param name="a">first value.</param>
+/// <param name="b">second value.</param>
+/// <returns>largest value dividing both.</returns>
+static UINT GreatestCommonDivisor(UINT a, UINT b) {
+    while (0 != b) {
+        UINT remainder = a % b;
+        a = b;
+        b = remainder;
+    }
+    return a;
+}
+
+/// Zeroth order modified Bessel function of the first kind, from its power series.
+/// <param name="x">argument.</param>
+/// <returns>I0(x).</returns>
+static double BesselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 64 && term > 1e-12 * sum; ++k) {
+        double factor = x / (2.0 * k);
+        term *= factor * factor;
+        sum += term;
+    }
+    return sum;
+}
+
+/// Round a filtered sample to nearest 16-bit value, clipping anything beyond.
+/// <param name="sample">filtered sample.</param>
+/// <returns>16-bit sample.</returns>
+static inline int16_t RoundToPcm16(float sample) {
+    sample = (sample > 32767.0f) ? 32767.0f : ((sample < -32768.0f) ? -32768.0f : sample);
+    return static_cast<int16_t>(lrintf(sample));
+}
+
+/// Filter bank and phase stepping tables a kernel runs over.
+struct PhaseTable {
+    const float*            pBank;
+    const UINT*             pAdvance;
+    const UINT*             pNextPhase;
+    UINT                    tapCount;
+};
+
+/// Produce every output sample ending in a run of input, stepping phase and input position.
+/// <param name="table">filter bank and stepping tables.</param>
+/// <param name="pInput">input, preceded by tapCount - 1 samples of history.</param>
+/// <param name="inputCount">number of input samples.</param>
+/// <param name="pInputIndex">input sample next output ends at; receives it relative to end of input.</param>
+/// <param name="pPhase">phase of next output; receives phase after last output.</param>
+/// <param name="pOutput">receives output samples.</param>
+/// <returns>number of output samples written.</returns>
+static UINT FilterScalar(const PhaseTable& table, const float* pInput, UINT inputCount, UINT* pInputIndex, UINT* pPhase, int16_t* pOutput) {
+    const float* pOldest = pInput - (table.tapCount - 1);
+    UINT index = *pInputIndex;
+    UINT phase = *pPhase;
+    UINT count = 0;
+
+    while (index < inputCount) {
+        const float* pTaps = table.pBank + phase * table.tapCount;
+        const float* pSamples = pOldest + index;
+
+        float acc = 0.0f;
+        for (UINT j = 0; j < table.tapCount; ++j) {
+            acc += pTaps[j] * pSamples[j];
+        }
+        pOutput[count++] = RoundToPcm16(acc);
+
+        index += table.pAdvance[phase];
+        phase = table.pNextPhase[phase];
+    }
+
+    *pInputIndex = index - inputCount;
+    *pPhase = phase;
+    return count;
+}
+
+#ifdef AUDIO_SIMD_X86
+
+/// SSE2 version of FilterScalar, eight taps at a time into two accumulators.
+AUDIO_TARGET_SSE2
+static UINT FilterSse2(const PhaseTable& table, const float* pInput, UINT inputCount, UINT* pInputIndex, UINT* pPhase, int16_t* pOutput) {
+    const float* pOldest = pInput - (table.tapCount - 1);
+    const __m128 maxSample = _mm_set_ss(32767.0f);
+    const __m128 minSample = _mm_set_ss(-32768.0f);
+    UINT index = *pInputIndex;
+    UINT phase = *pPhase;
+    UINT count = 0;
+
+    while (index < inputCount) {
+        const float* pTaps = table.pBank + phase * table.tapCount;
+        const float* pSamples = pOldest + index;
+
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+        for (UINT j = 0; j < table.tapCount; j += 8) {
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(pTaps + j), _mm_loadu_ps(pSamples + j)));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(pTaps + j + 4), _mm_loadu_ps(pSamples + j + 4)));
+        }
+
+        // Horizontal sum of both accumulators
+        __m128 sum = _mm_add_ps(acc0, acc1);
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        sum = _mm_max_ss(_mm_min_ss(sum, maxSample), minSample);
+        pOutput[count++] = static_cast<int16_t>(_mm_cvtss_si32(sum));
+
+        index += table.pAdvance[phase];
+        phase = table.pNextPhase[phase];
+    }
+
+    *pInputIndex = index - inputCount;
+    *pPhase = phase;
+    return count;
+}
+
+/// AVX2 version of FilterScalar, sixteen taps at a time into two accumulators with fused multiply-add.
+AUDIO_TARGET_AVX2
+static UINT FilterAvx2(const PhaseTable& table, const float* pInput, UINT inputCount, UINT* pInputIndex, UINT* pPhase, int16_t* pOutput) {
+    const float* pOldest = pInput - (table.tapCount - 1);
+    const __m128 maxSample = _mm_set_ss(32767.0f);
+    const __m128 minSample = _mm_set_ss(-32768.0f);
+    UINT index = *pInputIndex;
+    UINT phase = *pPhase;
+    UINT count = 0;
+
+    while (index < inputCount) {
+        const float* pTaps = table.pBank + phase * table.tapCount;
+        const float* pSamples = pOldest + index;
+
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        for (UINT j = 0; j < table.tapCount; j += 16) {
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(pTaps + j), _mm256_loadu_ps(pSamples + j), acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(pTaps + j + 8), _mm256_loadu_ps(pSamples + j + 8), acc1);
+        }
+
+        // Horizontal sum of both accumulators
+        __m256 wide = _mm256_add_ps(acc0, acc1);
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(wide), _mm256_extractf128_ps(wide, 1));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        sum = _mm_max_ss(_mm_min_ss(sum, maxSample), minSample);
+        pOutput[count++] = static_cast<int16_t>(_mm_cvtss_si32(sum));
+
+        index += table.pAdvance[phase];
+        phase = table.pNextPhase[phase];
+    }
+
+    // Caller goes on to non-VEX code, as in ApplyGainRampAvx2
+    _mm256_zeroupper();
+
+    *pInputIndex = index - inputCount;
+    *pPhase = phase;
+    return count;
+}
+
+#endif
+
+/// Produce every output sample ending in a run of input, using requested instruction set.
+static UINT Filter(SimdLevel level, const PhaseTable& table, const float* pInput, UINT inputCount, UINT* pInputIndex, UINT* pPhase, int16_t* pOutput) {
+#ifdef AUDIO_SIMD_X86
+    if (SimdLevelAvx2 == level) {
+        return FilterAvx2(table, pInput, inputCount, pInputIndex, pPhase, pOutput);
+    }
+
+    if (SimdLevelSse2 == level) {
+        return FilterSse2(table, pInput, inputCount, pInputIndex, pPhase, pOutput);
+    }
+#else
+    (void)level;
+#endif
+
+    return FilterScalar(table, pInput, inputCount, pInputIndex, pPhase, pOutput);
+}
+
+/// Constructor
+PolyphaseResampler::PolyphaseResampler() :
+    m_inputRate(0),
+    m_outputRate(0),
+    m_interpolation(1),
+    m_decimation(1),
+    m_tapCount(1),
+    m_level(SimdLevelScalar),
+    m_pBank(NULL),
+    m_pAdvance(NULL),
+    m_pNextPhase(NULL),
+    m_inputIndex(0),
+    m_phase(0) {
+}
+
+/// Destructor
+PolyphaseResampler::~PolyphaseResampler() {
+    delete[] m_pBank;
+    delete[] m_pAdvance;
+    delete[] m_pNextPhase;
+}
+
+/// Design filter bank for a pair of rates.
+/// <param name="inputRate">input sample rate, in Hz, from cMinSampleRate to cMaxSampleRate.</param>
+/// <param name="outputRate">output sample rate, in Hz, from cMinSampleRate to cMaxSampleRate. Equal to input rate copies samples.</param>
+/// <param name="quality">filter length preset.</param>
+/// <param name="level">instruction set used by filter kernel.</param>
+/// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range or ratio needs more than cMaxPhases phases.</returns>
+HRESULT PolyphaseResampler::Initialize(UINT inputRate, UINT outputRate, ResamplerQuality quality, SimdLevel level) {
+    if (inputRate < cMinSampleRate || inputRate > cMaxSampleRate || outputRate < cMinSampleRate || outputRate > cMaxSampleRate ||
+        static_cast<UINT>(quality) >= sizeof(s_qualityPresets) / sizeof(s_qualityPresets[0])) {
+        return E_INVALIDARG;
+    }
+
+    UINT divisor = GreatestCommonDivisor(inputRate, outputRate);
+    UINT interpolation = outputRate / divisor;
+    UINT decimation = inputRate / divisor;
+
+    // Lowpass narrows with output rate when decimating, so it spans proportionally more input
+    const QualityPreset& preset = s_qualityPresets[quality];
+    UINT tapCount = preset.tapCount * ((decimation + interpolation - 1) / interpolation);
+    if (interpolation > cMaxPhases || tapCount > cMaxTapCount) {
+        return E_INVALIDARG;
+    }
+
+    delete[] m_pBank;
+    delete[] m_pAdvance;
+    delete[] m_pNextPhase;
+    m_pBank = NULL;
+    m_pAdvance = NULL;
+    m_pNextPhase = NULL;
+
+    m_inputRate = inputRate;
+    m_outputRate = outputRate;
+    m_interpolation = interpolation;
+    m_decimation = decimation;
+    m_level = level;
+
+    if (inputRate == outputRate) {
+        m_tapCount = 1;
+        Reset();
+        return S_OK;
+    }
+
+    m_tapCount = tapCount;
+    m_pBank = new float[interpolation * tapCount];
+    m_pAdvance = new UINT[interpolation];
+    m_pNextPhase = new UINT[interpolation];
+
+    for (UINT p = 0; p < interpolation; ++p) {
+        m_pAdvance[p] = (p + decimation) / interpolation;
+        m_pNextPhase[p] = (p + decimation) % interpolation;
+    }
+
+    // Prototype lowpass at interpolated rate, Kaiser windowed, scaled so every phase passes DC at unit gain on average
+    UINT length = interpolation * tapCount;
+    double cutoff = 0.5 * preset.cutoff / ((interpolation > decimation) ? interpolation : decimation);
+    double center = 0.5 * (length - 1);
+    double windowScale = 1.0 / BesselI0(preset.kaiserBeta);
+    double sum = 0.0;
+
+    for (UINT n = 0; n < length; ++n) {
+        double t = n - center;
+        double sinc = (0.0 == t) ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * t) / (M_PI * t);
+        double position = t / center;
+        double window = BesselI0(preset.kaiserBeta * sqrt(1.0 - position * position)) * windowScale;
+        double tap = sinc * window;
+
+        // Phase p holds taps p, p + L, p + 2L..., newest input sample meeting tap p
+        UINT phase = n % interpolation;
+        UINT age = n / interpolation;
+        m_pBank[phase * tapCount + (tapCount - 1 - age)] = static_cast<float>(tap);
+        sum += tap;
+    }
+
+    float gain = static_cast<float>(interpolation / sum);
+    for (UINT i = 0; i < length; ++i) {
+        m_pBank[i] *= gain;
+    }
+
+    Reset();
+    return S_OK;
+}
+
+/// Restart output at first sample of input, as if history were silent.
+void PolyphaseResampler::Reset() {
+    m_inputIndex = 0;
+    m_phase = 0;
+}
+
+/// Produce every output sample whose newest input sample is in a run of input.
+/// <param name="pInput">input samples, preceded in memory by GetTapCount() - 1 earlier samples.</param>
+/// <param name="inputCount">number of input samples.</param>
+/// <param name="pOutput">receives up to GetMaxOutputCount(inputCount) output samples, clipped to 16 bits.</param>
+/// <returns>number of output samples written.</returns>
+UINT PolyphaseResampler::Process(const float* pInput, UINT inputCount, int16_t* pOutput) {
+    if (NULL == m_pBank) {
+        for (UINT i = 0; i < inputCount; ++i) {
+            pOutput[i] = RoundToPcm16(pInput[i]);
+        }
+        return inputCount;
+    }
+
+    PhaseTable table;
+    table.pBank = m_pBank;
+    table.pAdvance = m_pAdvance;
+    table.pNextPhase = m_pNextPhase;
+    table.tapCount = m_tapCount;
+
+    return Filter(m_level, table, pInput, inputCount, &m_inputIndex, &m_phase, pOutput);
+}
+
+/// Constructor
+MultiRateResampler::MultiRateResampler() :
+    m_outputCount(0),
+    m_maxInputCount(0),
+    m_historyCount(0),
+    m_pInput(NULL) {
+}
+
+/// Destructor
+MultiRateResampler::~MultiRateResampler() {
+    delete[] m_pInput;
+}
+
+/// Design filter banks and allocate shared input buffer.
+/// <param name="inputRate">input sample rate, in Hz.</param>
+/// <param name="pOutputRates">sample rate, in Hz, of each output. Rates must differ from one another.</param>
+/// <param name="outputCount">number of outputs, from 1 to cMaxOutputs.</param>
+/// <param name="quality">filter length preset shared by all outputs.</param>
+/// <param name="maxInputCount">largest number of input samples per channel passed to Process.</param>
+/// <param name="level">instruction set used by filter kernels.</param>
+/// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range or rates repeat.</returns>
+HRESULT MultiRateResampler::Initialize(UINT inputRate, const UINT* pOutputRates, UINT outputCount, ResamplerQuality quality, UINT maxInputCount, SimdLevel level) {
+    if (0 == outputCount || outputCount > cMaxOutputs || 0 == maxInputCount) {
+        return E_INVALIDARG;
+    }
+
+    // A repeated rate would only compute the same output twice
+    for (UINT o = 0; o < outputCount; ++o) {
+        for (UINT p = o + 1; p < outputCount; ++p) {
+            if (pOutputRates[o] == pOutputRates[p]) {
+                return E_INVALIDARG;
+            }
+        }
+    }
+
+    UINT historyCount = 0;
+    for (UINT o = 0; o < outputCount; ++o) {
+        HRESULT hr = m_resamplers[o].Initialize(inputRate, pOutputRates[o], quality, level);
+        if (FAILED(hr)) {
+            m_outputCount = 0;
+            return hr;
+        }
+
+        UINT tapHistory = m_resamplers[o].GetTapCount() - 1;
+        historyCount = (tapHistory > historyCount) ? tapHistory : historyCount;
+    }
+
+    delete[] m_pInput;
+    m_pInput = new float[historyCount + maxInputCount];
+
+    m_outputCount = outputCount;
+    m_maxInputCount = maxInputCount;
+    m_historyCount = historyCount;
+
+    Reset();
+    return S_OK;
+}
+
+/// Forget input history. Every output restarts as if input before next block were silent.
+void MultiRateResampler::Reset() {
+    if (NULL != m_pInput) {
+        memset(m_pInput, 0, m_historyCount * sizeof(float));
+    }
+
+    for (UINT o = 0; o < m_outputCount; ++o) {
+        m_resamplers[o].Reset();
+    }
+}
+
+/// Resample a run of input to every output rate.
+/// <param name="pSamples">interleaved input samples.</param>
+/// <param name="sampleCount">number of samples per channel, at most maxInputCount passed to Initialize.</param>
+/// <param name="channelCount">number of interleaved channels; first is resampled.</param>
+/// <param name="ppOutputs">receive each output's samples; output i can receive up to GetMaxOutputCount(i) samples.</param>
+/// <param name="pOutputCounts">receive number of samples written to each output.</param>
+/// <returns>S_OK on success, E_INVALIDARG if run is longer than maxInputCount, E_UNEXPECTED before Initialize.</returns>
+HRESULT MultiRateResampler::Process(const int16_t* pSamples, UINT sampleCount, UINT channelCount, int16_t* const* ppOutputs, UINT* pOutputCounts) {
+    if (0 == m_outputCount) {
+        return E_UNEXPECTED;
+    }
+    if (sampleCount > m_maxInputCount) {
+        return E_INVALIDARG;
+    }
+
+    // Converted once, for every output to read
+    float* pBlock = m_pInput + m_historyCount;
+    for (UINT i = 0; i < sampleCount; ++i) {
+        pBlock[i] = pSamples[i * channelCount];
+    }
+
+    for (UINT o = 0; o < m_outputCount; ++o) {
+        pOutputCounts[o] = m_resamplers[o].Process(pBlock, sampleCount, ppOutputs[o]);
+    }
+
+    // Newest samples become history of next block
+    memmove(m_pInput, m_pInput + sampleCount, m_historyCount * sizeof(float));
+
+    return S_OK;
+}
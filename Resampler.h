@@ -0,0 +1,170 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "Simd.h"
+
+/// Filter length presets for resampling. Longer filters keep more of the passband and reject
+/// images and aliases better, at proportionally higher cost per output sample.
+enum ResamplerQuality {
+    // 16 taps per phase; about 55 dB of image and alias rejection, cut off at 80% of lower rate's Nyquist frequency
+    ResamplerQualityLow = 0,
+
+    // 32 taps per phase; about 70 dB of rejection, cut off at 86%
+    ResamplerQualityMedium = 1,
+
+    // 64 taps per phase; about 90 dB of rejection, cut off at 91%
+    ResamplerQualityHigh = 2
+};
+
+/// Streaming polyphase resampler from one sample rate to another by a rational ratio L/M.
+/// A single windowed-sinc lowpass, cut off below the Nyquist frequency of the lower rate, is
+/// designed at L times the input rate and split into L phases of equal length. Each output
+/// sample is a dot product of one phase with the most recent input samples, so only the
+/// output samples that are kept are ever computed, whatever L and M are.
+/// Input is read from a float buffer preceded by GetTapCount() - 1 samples of history, which
+/// lets several resamplers read the same converted input; see MultiRateResampler. Position in
+/// input is carried between calls, so any block sizes may be fed.
+/// Filter bank is built by Initialize; Process performs no allocations.
+class PolyphaseResampler {
+public:
+    // Lowest and highest supported sample rate, in Hz.
+    static const UINT       cMinSampleRate = 1000;
+    static const UINT       cMaxSampleRate = 192000;
+
+    // Largest number of filter phases, which is the output rate divided by the greatest common
+    // divisor of both rates. Covers 44.1 kHz and 48 kHz families to and from Kinect's 16 kHz.
+    static const UINT       cMaxPhases = 1024;
+
+    // Largest number of input samples any output sample reads.
+    static const UINT       cMaxTapCount = 512;
+
+    /// Constructor
+    PolyphaseResampler();
+
+    /// Destructor
+    ~PolyphaseResampler();
+
+    /// Design filter bank for a pair of rates.
+    /// <param name="inputRate">input sample rate, in Hz, from cMinSampleRate to cMaxSampleRate.</param>
+    /// <param name="outputRate">output sample rate, in Hz, from cMinSampleRate to cMaxSampleRate. Equal to input rate copies samples.</param>
+    /// <param name="quality">filter length preset.</param>
+    /// <param name="level">instruction set used by filter kernel.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range or ratio needs more than cMaxPhases phases.</returns>
+    HRESULT                 Initialize(UINT inputRate, UINT outputRate, ResamplerQuality quality, SimdLevel level);
+
+    /// Restart output at first sample of input, as if history were silent.
+    void                    Reset();
+
+    /// Produce every output sample whose newest input sample is in a run of input.
+    /// <param name="pInput">input samples, preceded in memory by GetTapCount() - 1 earlier samples.</param>
+    /// <param name="inputCount">number of input samples.</param>
+    /// <param name="pOutput">receives up to GetMaxOutputCount(inputCount) output samples, clipped to 16 bits.</param>
+    /// <returns>number of output samples written.</returns>
+    UINT                    Process(const float* pInput, UINT inputCount, int16_t* pOutput);
+
+    /// Largest number of output samples a run of input can produce.
+    /// <param name="inputCount">number of input samples.</param>
+    UINT                    GetMaxOutputCount(UINT inputCount) const { return static_cast<UINT>((static_cast<UINT64>(inputCount) * m_interpolation + m_decimation - 1) / m_decimation); }
+
+    /// Number of input samples each output sample reads.
+    UINT                    GetTapCount() const { return m_tapCount; }
+
+    /// Delay, in output samples rounded down, filter adds between input and output.
+    UINT                    GetLatency() const { return (m_tapCount * m_interpolation - 1) / (2 * m_decimation); }
+
+    /// Input sample rate, in Hz; 0 before Initialize.
+    UINT                    GetInputRate() const { return m_inputRate; }
+
+    /// Output sample rate, in Hz; 0 before Initialize.
+    UINT                    GetOutputRate() const { return m_outputRate; }
+
+private:
+    UINT                    m_inputRate;
+    UINT                    m_outputRate;
+
+    // Rate ratio in lowest terms: output rate is input rate times m_interpolation over m_decimation.
+    UINT                    m_interpolation;
+    UINT                    m_decimation;
+    UINT                    m_tapCount;
+    SimdLevel               m_level;
+
+    // Filter phases, one after another, each holding m_tapCount coefficients in order of increasing input
+    // time so they line up with input in memory. NULL when rates are equal.
+    float*                  m_pBank;
+
+    // Per phase: input samples to step over, and phase, for next output sample.
+    UINT*                   m_pAdvance;
+    UINT*                   m_pNextPhase;
+
+    // Input sample, relative to start of next call's input, that next output sample ends at, and its phase.
+    UINT                    m_inputIndex;
+    UINT                    m_phase;
+
+    PolyphaseResampler(const PolyphaseResampler&);
+    PolyphaseResampler& operator=(const PolyphaseResampler&);
+};
+
+/// Resamples one channel of a 16-bit PCM stream to several output rates at once.
+/// Input is converted to float and kept with its history once per block, and every output
+/// rate's PolyphaseResampler reads that shared buffer; an output at the input rate is a copy.
+/// Channel taken from interleaved input is the first, as for VoiceActivityDetector.
+/// Buffers are allocated by Initialize; Process performs no allocations.
+class MultiRateResampler {
+public:
+    // Largest number of output rates.
+    static const UINT       cMaxOutputs = 4;
+
+    /// Constructor
+    MultiRateResampler();
+
+    /// Destructor
+    ~MultiRateResampler();
+
+    /// Design filter banks and allocate shared input buffer.
+    /// <param name="inputRate">input sample rate, in Hz.</param>
+    /// <param name="pOutputRates">sample rate, in Hz, of each output. Rates must differ from one another.</param>
+    /// <param name="outputCount">number of outputs, from 1 to cMaxOutputs.</param>
+    /// <param name="quality">filter length preset shared by all outputs.</param>
+    /// <param name="maxInputCount">largest number of input samples per channel passed to Process.</param>
+    /// <param name="level">instruction set used by filter kernels.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range or rates repeat.</returns>
+    HRESULT                 Initialize(UINT inputRate, const UINT* pOutputRates, UINT outputCount, ResamplerQuality quality, UINT maxInputCount, SimdLevel level);
+
+    /// Forget input history. Every output restarts as if input before next block were silent.
+    void                    Reset();
+
+    /// Resample a run of input to every output rate.
+    /// <param name="pSamples">interleaved input samples.</param>
+    /// <param name="sampleCount">number of samples per channel, at most maxInputCount passed to Initialize.</param>
+    /// <param name="channelCount">number of interleaved channels; first is resampled.</param>
+    /// <param name="ppOutputs">receive each output's samples; output i can receive up to GetMaxOutputCount(i) samples.</param>
+    /// <param name="pOutputCounts">receive number of samples written to each output.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if run is longer than maxInputCount, E_UNEXPECTED before Initialize.</returns>
+    HRESULT                 Process(const int16_t* pSamples, UINT sampleCount, UINT channelCount, int16_t* const* ppOutputs, UINT* pOutputCounts);
+
+    /// Number of outputs; 0 before Initialize.
+    UINT                    GetOutputCount() const { return m_outputCount; }
+
+    /// Largest number of samples an output receives from one call to Process.
+    /// <param name="output">index of output.</param>
+    UINT                    GetMaxOutputCount(UINT output) const { return m_resamplers[output].GetMaxOutputCount(m_maxInputCount); }
+
+    /// Resampler of an output, for its rate and latency.
+    /// <param name="output">index of output.</param>
+    const PolyphaseResampler& GetResampler(UINT output) const { return m_resamplers[output]; }
+
+private:
+    UINT                    m_outputCount;
+    UINT                    m_maxInputCount;
+
+    // History samples kept ahead of each block: enough for the longest filter.
+    UINT                    m_historyCount;
+
+    // History followed by current block, converted to float.
+    float*                  m_pInput;
+
+    PolyphaseResampler      m_resamplers[cMaxOutputs];
+
+    MultiRateResampler(const MultiRateResampler&);
+    MultiRateResampler& operator=(const MultiRateResampler&);
+};
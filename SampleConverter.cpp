@@ -0,0 +1,173 @@
+﻿#include "SampleConverter.h"
+
+/// Convert one 16-bit PCM sample.
+/// <param name="sample">sample.</param>
+/// <returns>same sample.</returns>
+static inline int16_t ToPcm16(int16_t sample) {
+    return sample;
+}
+
+/// Convert one 32-bit PCM sample by dropping its low 16 bits.
+/// <param name="sample">sample.</param>
+/// <returns>16-bit sample.</returns>
+static inline int16_t ToPcm16(int32_t sample) {
+    return static_cast<int16_t>(sample >> 16);
+}
+
+/// Convert one float sample in [-1.0,1.0] interval, clipping anything beyond.
+/// <param name="sample">sample.</param>
+/// <returns>16-bit sample.</returns>
+static inline int16_t ToPcm16(float sample) {
+    float scaled = sample * 32768.0f;
+    scaled = (scaled > 32767.0f) ? 32767.0f : ((scaled < -32768.0f) ? -32768.0f : scaled);
+    return static_cast<int16_t>(scaled);
+}
+
+/// Conversion loop for one format. Frames are copied out whole, so source need not be aligned
+/// for sample type; channel count is a constant, so inner loop is unrolled.
+/// <typeparam name="TFormat">AudioStreamFormat of source.</typeparam>
+/// <typeparam name="TMixDown">true to average channels into one, false to keep them.</typeparam>
+/// <param name="pSource">frames in TFormat.</param>
+/// <param name="frameCount">number of frames.</param>
+/// <param name="pDestination">receives converted samples.</param>
+template <class TFormat, bool TMixDown>
+static void ConvertFrames(const BYTE* pSource, UINT frameCount, int16_t* pDestination) {
+    typename TFormat::Sample frame[TFormat::Channels];
+
+    for (UINT i = 0; i < frameCount; ++i, pSource += TFormat::BlockAlign) {
+        memcpy(frame, pSource, TFormat::BlockAlign);
+
+        if (TMixDown) {
+            int sum = 0;
+            for (UINT c = 0; c < TFormat::Channels; ++c) {
+                sum += ToPcm16(frame[c]);
+            }
+            pDestination[i] = static_cast<int16_t>(sum / static_cast<int>(TFormat::Channels));
+        }
+        else {
+            for (UINT c = 0; c < TFormat::Channels; ++c) {
+                pDestination[i * TFormat::Channels + c] = ToPcm16(frame[c]);
+            }
+        }
+    }
+}
+
+/// Format with its own conversion loops.
+struct SpecializedFormat {
+    bool                    (*pfnMatches)(const WAVEFORMATEX& format);
+    SampleConverter::ConvertFunction pfnKeep;
+    SampleConverter::ConvertFunction pfnMixDown;
+};
+
+// Recordings of Kinect audio, as stored in WAV files by common tools
+typedef AudioStreamFormat<int16_t, 2, 16000> StereoPcm16Format;
+typedef AudioStreamFormat<int16_t, 4, 16000> ArrayPcm16Format;
+typedef AudioStreamFormat<float, 1, 16000> MonoFloatFormat;
+typedef AudioStreamFormat<float, 2, 16000> StereoFloatFormat;
+typedef AudioStreamFormat<int32_t, 1, 16000> MonoPcm32Format;
+typedef AudioStreamFormat<int32_t, 2, 16000> StereoPcm32Format;
+typedef AudioStreamFormat<int32_t, 4, 16000> ArrayPcm32Format;
+
+// Kinect DMO and endpoint formats, then recordings replayed in their place. A format at another
+// rate takes generic loop until it is listed here.
+static const SpecializedFormat s_specializedFormats[] = {
+    {&KinectAudioStreamFormat::Matches, &ConvertFrames<KinectAudioStreamFormat, false>, &ConvertFrames<KinectAudioStreamFormat, true>},
+    {&KinectArrayStreamFormat::Matches, &ConvertFrames<KinectArrayStreamFormat, false>, &ConvertFrames<KinectArrayStreamFormat, true>},
+    {&StereoPcm16Format::Matches, &ConvertFrames<StereoPcm16Format, false>, &ConvertFrames<StereoPcm16Format, true>},
+    {&ArrayPcm16Format::Matches, &ConvertFrames<ArrayPcm16Format, false>, &ConvertFrames<ArrayPcm16Format, true>},
+    {&MonoFloatFormat::Matches, &ConvertFrames<MonoFloatFormat, false>, &ConvertFrames<MonoFloatFormat, true>},
+    {&StereoFloatFormat::Matches, &ConvertFrames<StereoFloatFormat, false>, &ConvertFrames<StereoFloatFormat, true>},
+    {&MonoPcm32Format::Matches, &ConvertFrames<MonoPcm32Format, false>, &ConvertFrames<MonoPcm32Format, true>},
+    {&StereoPcm32Format::Matches, &ConvertFrames<StereoPcm32Format, false>, &ConvertFrames<StereoPcm32Format, true>},
+    {&ArrayPcm32Format::Matches, &ConvertFrames<ArrayPcm32Format, false>, &ConvertFrames<ArrayPcm32Format, true>},
+};
+
+/// Constructor
+SampleConverter::SampleConverter() :
+    m_channels(0),
+    m_bytesPerSample(0),
+    m_blockAlign(0),
+    m_bFloat(false),
+    m_mapping(ChannelMappingKeep),
+    m_pfnConvert(NULL) {
+}
+
+/// Select conversion loop for a format.
+/// <param name="format">negotiated format, with any WAVE_FORMAT_EXTENSIBLE tag resolved to its sub-format's tag.</param>
+/// <param name="mapping">whether channels are kept or mixed down to one.</param>
+/// <param name="bSpecialize">true to use format's own loop, if it has one; false to always use generic loop.</param>
+/// <returns>S_OK on success, E_INVALIDARG if format is not supported.</returns>
+HRESULT SampleConverter::Initialize(const WAVEFORMATEX& format, ChannelMapping mapping, bool bSpecialize) {
+    bool bFloat = (WAVE_FORMAT_IEEE_FLOAT == format.wFormatTag) && (32 == format.wBitsPerSample);
+    bool bPcm = (WAVE_FORMAT_PCM == format.wFormatTag) && (16 == format.wBitsPerSample || 32 == format.wBitsPerSample);
+    if (!(bFloat || bPcm) || 0 == format.nChannels || format.nChannels > cMaxChannels) {
+        return E_INVALIDARG;
+    }
+
+    m_channels = format.nChannels;
+    m_bytesPerSample = static_cast<WORD>(format.wBitsPerSample / 8);
+    m_blockAlign = static_cast<WORD>(m_channels * m_bytesPerSample);
+    m_bFloat = bFloat;
+    m_mapping = mapping;
+    m_pfnConvert = NULL;
+
+    for (size_t i = 0; bSpecialize && i < sizeof(s_specializedFormats) / sizeof(s_specializedFormats[0]); ++i) {
+        if (s_specializedFormats[i].pfnMatches(format)) {
+            m_pfnConvert = (ChannelMappingMixDown == mapping) ? s_specializedFormats[i].pfnMixDown : s_specializedFormats[i].pfnKeep;
+            break;
+        }
+    }
+
+    return S_OK;
+}
+
+/// Convert interleaved frames to 16-bit PCM.
+/// <param name="pSource">frames in format passed to Initialize. Need not be aligned.</param>
+/// <param name="frameCount">number of frames.</param>
+/// <param name="pDestination">receives frameCount * GetOutputChannelCount samples.</param>
+void SampleConverter::Convert(const BYTE* pSource, UINT frameCount, int16_t* pDestination) const {
+    if (NULL != m_pfnConvert) {
+        m_pfnConvert(pSource, frameCount, pDestination);
+    }
+    else {
+        ConvertGeneric(pSource, frameCount, pDestination);
+    }
+}
+
+/// Convert with channel count and sample type read at run time.
+/// <param name="pSource">frames in format passed to Initialize.</param>
+/// <param name="frameCount">number of frames.</param>
+/// <param name="pDestination">receives converted samples.</param>
+void SampleConverter::ConvertGeneric(const BYTE* pSource, UINT frameCount, int16_t* pDestination) const {
+    for (UINT i = 0; i < frameCount; ++i) {
+        int sum = 0;
+
+        for (UINT c = 0; c < m_channels; ++c, pSource += m_bytesPerSample) {
+            int16_t sample;
+            if (m_bFloat) {
+                float value;
+                memcpy(&value, pSource, sizeof(value));
+                sample = ToPcm16(value);
+            }
+            else if (4 == m_bytesPerSample) {
+                int32_t value;
+                memcpy(&value, pSource, sizeof(value));
+                sample = ToPcm16(value);
+            }
+            else {
+                memcpy(&sample, pSource, sizeof(sample));
+            }
+
+            if (ChannelMappingMixDown == m_mapping) {
+                sum += sample;
+            }
+            else {
+                pDestination[i * m_channels + c] = sample;
+            }
+        }
+
+        if (ChannelMappingMixDown == m_mapping) {
+            pDestination[i] = static_cast<int16_t>(sum / static_cast<int>(m_channels));
+        }
+    }
+}
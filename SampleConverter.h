@@ -0,0 +1,72 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "AudioFormat.h"
+
+/// How SampleConverter lays captured channels out in converted audio.
+enum ChannelMapping {
+    // Every channel is kept, interleaved as captured
+    ChannelMappingKeep = 0,
+
+    // Channels are averaged into a single one
+    ChannelMappingMixDown = 1
+};
+
+/// Converts interleaved audio in a negotiated capture format into interleaved 16-bit PCM, the one
+/// sample format processing stages take. 16-bit PCM, 32-bit PCM and 32-bit float samples are
+/// supported at up to cMaxChannels channels.
+/// Formats Kinect delivers, and recordings of it are stored in, each have their own conversion
+/// loop: a template instantiated for an AudioStreamFormat, so channel count and sample type are
+/// known to the compiler, which unrolls the channel loop and inlines sample conversion. Initialize
+/// picks the instantiation matching the WAVEFORMATEX that was negotiated; any other supported
+/// format is converted by a generic loop reading sample width and channel count at run time.
+/// Convert performs no allocations.
+class SampleConverter {
+public:
+    // Largest number of channels converted.
+    static const WORD       cMaxChannels = 8;
+
+    /// Constructor
+    SampleConverter();
+
+    /// Select conversion loop for a format.
+    /// <param name="format">negotiated format, with any WAVE_FORMAT_EXTENSIBLE tag resolved to its sub-format's tag.</param>
+    /// <param name="mapping">whether channels are kept or mixed down to one.</param>
+    /// <param name="bSpecialize">true to use format's own loop, if it has one; false to always use generic loop.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if format is not supported.</returns>
+    HRESULT                 Initialize(const WAVEFORMATEX& format, ChannelMapping mapping, bool bSpecialize);
+
+    /// Convert interleaved frames to 16-bit PCM.
+    /// <param name="pSource">frames in format passed to Initialize. Need not be aligned.</param>
+    /// <param name="frameCount">number of frames.</param>
+    /// <param name="pDestination">receives frameCount * GetOutputChannelCount samples.</param>
+    void                    Convert(const BYTE* pSource, UINT frameCount, int16_t* pDestination) const;
+
+    /// Size, in bytes, of one frame of captured audio; 0 before Initialize.
+    WORD                    GetInputBlockAlign() const { return m_blockAlign; }
+
+    /// Number of interleaved channels in converted audio.
+    WORD                    GetOutputChannelCount() const { return (ChannelMappingMixDown == m_mapping) ? 1 : m_channels; }
+
+    /// Whether format has its own conversion loop, rather than taking generic one.
+    bool                    IsSpecialized() const { return NULL != m_pfnConvert; }
+
+    /// Conversion loop instantiated for one format and channel mapping.
+    typedef void (*ConvertFunction)(const BYTE* pSource, UINT frameCount, int16_t* pDestination);
+
+private:
+    WORD                    m_channels;
+    WORD                    m_bytesPerSample;
+    WORD                    m_blockAlign;
+    bool                    m_bFloat;
+    ChannelMapping          m_mapping;
+
+    // Format's own conversion loop, or NULL for generic loop.
+    ConvertFunction         m_pfnConvert;
+
+    /// Convert with channel count and sample type read at run time.
+    /// <param name="pSource">frames in format passed to Initialize.</param>
+    /// <param name="frameCount">number of frames.</param>
+    /// <param name="pDestination">receives converted samples.</param>
+    void                    ConvertGeneric(const BYTE* pSource, UINT frameCount, int16_t* pDestination) const;
+};
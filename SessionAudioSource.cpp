@@ -0,0 +1,102 @@
+﻿#include "SessionAudioSource.h"
+
+/// Constructor
+/// <param name="speed">multiple of real time to replay at, or 0 to replay as fast as possible.</param>
+SessionAudioSource::SessionAudioSource(double speed) :
+    m_nextBlock(0),
+    m_samplesReplayed(0),
+    m_speed(speed),
+    m_pacer(static_cast<DWORD>(AudioSamplesPerSecond * speed + 0.5), speed > 0.0) {
+}
+
+/// Open session file and position replay at its first block.
+/// <param name="szPath">path of file to replay.</param>
+/// <returns>S_OK on success, E_INVALIDARG if file is not a session file at AudioSamplesPerSecond, otherwise failure code.</returns>
+HRESULT SessionAudioSource::Open(const char* szPath) {
+    HRESULT hr = m_reader.Open(szPath);
+    if (SUCCEEDED(hr) && AudioSamplesPerSecond != m_reader.GetSampleRate()) {
+        m_reader.Close();
+        hr = E_INVALIDARG;
+    }
+
+    m_nextBlock = 0;
+    m_samplesReplayed = 0;
+    m_pacer = AudioSourcePacer(static_cast<DWORD>(AudioSamplesPerSecond * m_speed + 0.5), m_speed > 0.0);
+
+    return hr;
+}
+
+/// Move replay to block holding a sample position.
+/// <param name="samplePosition">index, since start of session, of sample to replay from.</param>
+void SessionAudioSource::Seek(UINT64 samplePosition) {
+    m_nextBlock = (samplePosition < m_reader.GetEndPosition()) ? m_reader.FindBlock(samplePosition) : m_reader.GetBlockCount();
+
+    // Pacing restarts from seek point
+    m_samplesReplayed = 0;
+    m_pacer = AudioSourcePacer(static_cast<DWORD>(AudioSamplesPerSecond * m_speed + 0.5), m_speed > 0.0);
+}
+
+/// Copy next block into a buffer.
+/// <param name="pBuffer">buffer that receives PCM data.</param>
+/// <param name="pAngles">receives angles captured with block.</param>
+/// <param name="pbMoreAvailable">set to true if another block can be read immediately.</param>
+/// <returns>S_OK if audio was produced, S_FALSE if none is available right now, otherwise failure code.</returns>
+HRESULT SessionAudioSource::Read(IMediaBuffer* pBuffer, AudioAngles* pAngles, bool* pbMoreAvailable) {
+    pBuffer->SetLength(0);
+
+    AudioBlock block;
+    UINT64 samplePosition = 0;
+    HRESULT hr = ReadBlock(&block, &samplePosition, pbMoreAvailable);
+    if (S_OK != hr) {
+        return hr;
+    }
+
+    BYTE* pData = NULL;
+    DWORD cbMax = 0;
+    pBuffer->GetBufferAndLength(&pData, NULL);
+    pBuffer->GetMaxLength(&cbMax);
+
+    DWORD cbBlock = block.sampleCount * block.channelCount * AudioBlockAlign;
+    if (cbBlock > cbMax) {
+        return E_INVALIDARG;
+    }
+
+    memcpy(pData, block.pSamples, cbBlock);
+    pBuffer->SetLength(cbBlock);
+    *pAngles = block.angles;
+
+    return S_OK;
+}
+
+/// Hand out next block as a view into mapping.
+/// <param name="pBlock">receives block, whose samples stay valid while source is open.</param>
+/// <param name="pSamplePosition">receives index, since start of session, of block's first sample.</param>
+/// <param name="pbMoreAvailable">set to true if another block can be read immediately.</param>
+/// <returns>S_OK if a block was produced, S_FALSE if none is due right now, E_UNEXPECTED if not open.</returns>
+HRESULT SessionAudioSource::ReadBlock(AudioBlock* pBlock, UINT64* pSamplePosition, bool* pbMoreAvailable) {
+    *pbMoreAvailable = false;
+
+    if (0 == m_reader.GetChannelCount()) {
+        return E_UNEXPECTED;
+    }
+
+    if (IsFinished() || !IsNextBlockDue()) {
+        return S_FALSE;
+    }
+
+    m_reader.GetBlock(m_nextBlock, pBlock);
+    *pSamplePosition = m_reader.GetBlockHeader(m_nextBlock).samplePosition;
+    ++m_nextBlock;
+    m_samplesReplayed += pBlock->sampleCount;
+
+    *pbMoreAvailable = !IsFinished() && IsNextBlockDue();
+
+    return S_OK;
+}
+
+/// Whether next block is due, given replay speed.
+bool SessionAudioSource::IsNextBlockDue() {
+    // Paced on frames ReadBlock will actually replay, so a damaged header cannot stall replay
+    UINT sampleCount = m_reader.GetBlockSampleCount(m_nextBlock);
+    return m_pacer.GetSamplesDue(m_samplesReplayed, sampleCount) == sampleCount;
+}
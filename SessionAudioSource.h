@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include "AudioSource.h"
+#include "AudioFormat.h"
+#include "SessionFile.h"
+
+/// Audio source that replays a session file, with the angles captured alongside its audio.
+/// Replay runs at a chosen multiple of real time, or as fast as possible, from any point
+/// in session. Besides copying blocks out through Read, as every source does, it hands
+/// out blocks as views into the file's memory mapping, so a replay driver can feed them
+/// to processing without copying a sample.
+class SessionAudioSource : public AudioSource {
+public:
+    /// Constructor
+    /// <param name="speed">multiple of real time to replay at, or 0 to replay as fast as possible.</param>
+    SessionAudioSource(double speed);
+
+    /// Open session file and position replay at its first block.
+    /// <param name="szPath">path of file to replay.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if file is not a session file at AudioSamplesPerSecond, otherwise failure code.</returns>
+    HRESULT                 Open(const char* szPath);
+
+    /// Move replay to block holding a sample position.
+    /// <param name="samplePosition">index, since start of session, of sample to replay from.</param>
+    void                    Seek(UINT64 samplePosition);
+
+    /// Copy next block into a buffer.
+    /// <param name="pBuffer">buffer that receives PCM data.</param>
+    /// <param name="pAngles">receives angles captured with block.</param>
+    /// <param name="pbMoreAvailable">set to true if another block can be read immediately.</param>
+    /// <returns>S_OK if audio was produced, S_FALSE if none is available right now, otherwise failure code.</returns>
+    virtual HRESULT         Read(IMediaBuffer* pBuffer, AudioAngles* pAngles, bool* pbMoreAvailable);
+
+    /// Hand out next block as a view into mapping.
+    /// <param name="pBlock">receives block, whose samples stay valid while source is open.</param>
+    /// <param name="pSamplePosition">receives index, since start of session, of block's first sample.</param>
+    /// <param name="pbMoreAvailable">set to true if another block can be read immediately.</param>
+    /// <returns>S_OK if a block was produced, S_FALSE if none is due right now, E_UNEXPECTED if not open.</returns>
+    HRESULT                 ReadBlock(AudioBlock* pBlock, UINT64* pSamplePosition, bool* pbMoreAvailable);
+
+    /// Whether every block from start or seek point has been replayed.
+    virtual bool            IsFinished() const { return m_nextBlock >= m_reader.GetBlockCount(); }
+
+    /// Number of interleaved channels produced by Read.
+    virtual WORD            GetChannelCount() const { return m_reader.GetChannelCount(); }
+
+    /// Index, since start of session, of first sample of next block replayed.
+    UINT64                  GetPosition() const { return IsFinished() ? m_reader.GetEndPosition() : m_reader.GetBlockHeader(m_nextBlock).samplePosition; }
+
+    /// Reader of session file, for its length and block headers.
+    const SessionReader&    GetReader() const { return m_reader; }
+
+private:
+    SessionReader           m_reader;
+    UINT64                  m_nextBlock;
+
+    // Samples replayed since open or seek, which pacer measures against.
+    UINT64                  m_samplesReplayed;
+    double                  m_speed;
+    AudioSourcePacer        m_pacer;
+
+    /// Whether next block is due, given replay speed.
+    bool                    IsNextBlockDue();
+};
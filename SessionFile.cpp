@@ -0,0 +1,271 @@
+﻿#include "SessionFile.h"
+
+// Identifies a session file and its layout.
+static const char       cSessionFileMagic[8] = {'K', 'A', 'S', 'E', 'S', 'S', '0', '1'};
+
+// Alignment of block stride, so every block's samples start cache line aligned.
+static const UINT       cBlockAlignment = 64;
+
+static_assert(sizeof(SessionFileHeader) <= cSessionHeaderSize, "Session header must fit in its padding");
+static_assert(sizeof(SessionBlockHeader) == 64, "Block header layout must not change");
+
+/// Constructor
+SessionFileWriter::SessionFileWriter() :
+    m_pFile(NULL),
+    m_firstTimestamp(0) {
+    memset(&m_header, 0, sizeof(m_header));
+}
+
+/// Destructor. Closes file, if open.
+SessionFileWriter::~SessionFileWriter() {
+    Close();
+}
+
+/// Create session file and write its header.
+/// <param name="szPath">path of file to create, replacing any existing file.</param>
+/// <param name="channelCount">number of interleaved channels, from 1 to AudioBlock::MaxChannels.</param>
+/// <param name="sampleRate">sample rate, in Hz.</param>
+/// <returns>S_OK on success, E_INVALIDARG if channel count is out of range, otherwise failure code.</returns>
+HRESULT SessionFileWriter::Open(const char* szPath, WORD channelCount, UINT sampleRate) {
+    Close();
+
+    if (0 == channelCount || channelCount > AudioBlock::MaxChannels) {
+        return E_INVALIDARG;
+    }
+
+    m_pFile = fopen(szPath, "wb");
+    if (NULL == m_pFile) {
+        return E_FAIL;
+    }
+
+    // Counts stay zero until Close, so a file cut short is recognized as such
+    memset(&m_header, 0, sizeof(m_header));
+    memcpy(m_header.magic, cSessionFileMagic, sizeof(m_header.magic));
+    m_header.headerSize = cSessionHeaderSize;
+    m_header.blockStride = (sizeof(SessionBlockHeader) + AudioBlock::MaxSamples * channelCount * sizeof(int16_t) + cBlockAlignment - 1) & ~(cBlockAlignment - 1);
+    m_header.sampleRate = sampleRate;
+    m_header.channelCount = channelCount;
+    m_header.blockFrames = AudioBlock::MaxSamples;
+    m_header.indexInterval = cIndexInterval;
+
+    m_index.clear();
+    m_block.assign(m_header.blockStride > cSessionHeaderSize ? m_header.blockStride : cSessionHeaderSize, 0);
+    m_firstTimestamp = 0;
+
+    memcpy(&m_block[0], &m_header, sizeof(m_header));
+    if (1 != fwrite(&m_block[0], cSessionHeaderSize, 1, m_pFile)) {
+        fclose(m_pFile);
+        m_pFile = NULL;
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+/// Append audio, split into blocks of at most AudioBlock::MaxSamples frames.
+/// <param name="pSamples">interleaved frames.</param>
+/// <param name="frameCount">number of frames.</param>
+/// <param name="angles">angles reported with audio.</param>
+/// <param name="captureTimestamp">GetClockNanoseconds when audio was captured.</param>
+/// <returns>S_OK on success, E_UNEXPECTED if file is not open, otherwise failure code.</returns>
+HRESULT SessionFileWriter::Write(const int16_t* pSamples, UINT frameCount, const AudioAngles& angles, UINT64 captureTimestamp) {
+    if (NULL == m_pFile) {
+        return E_UNEXPECTED;
+    }
+
+    if (0 == m_header.blockCount) {
+        m_firstTimestamp = captureTimestamp;
+    }
+
+    while (frameCount > 0) {
+        UINT blockFrames = (frameCount < AudioBlock::MaxSamples) ? frameCount : AudioBlock::MaxSamples;
+        size_t cbFrames = static_cast<size_t>(blockFrames) * m_header.channelCount * sizeof(int16_t);
+
+        SessionBlockHeader* pHeader = reinterpret_cast<SessionBlockHeader*>(&m_block[0]);
+        memset(pHeader, 0, sizeof(*pHeader));
+        pHeader->samplePosition = m_header.frameCount;
+        pHeader->captureTimestamp = captureTimestamp - m_firstTimestamp;
+        pHeader->sequence = static_cast<uint32_t>(m_header.blockCount);
+        pHeader->sampleCount = blockFrames;
+        pHeader->angles = angles;
+
+        // Short blocks are padded with silence, so every block is a whole stride
+        memcpy(pHeader + 1, pSamples, cbFrames);
+        memset(reinterpret_cast<BYTE*>(pHeader + 1) + cbFrames, 0, m_header.blockStride - sizeof(*pHeader) - cbFrames);
+
+        if (1 != fwrite(pHeader, m_header.blockStride, 1, m_pFile)) {
+            return E_FAIL;
+        }
+
+        if (0 == m_header.blockCount % cIndexInterval) {
+            m_index.push_back(m_header.frameCount);
+        }
+
+        ++m_header.blockCount;
+        m_header.frameCount += blockFrames;
+        pSamples += blockFrames * m_header.channelCount;
+        frameCount -= blockFrames;
+    }
+
+    return S_OK;
+}
+
+/// Write time index, fill in header and close file. Does nothing if file is not open.
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT SessionFileWriter::Close() {
+    if (NULL == m_pFile) {
+        return S_OK;
+    }
+
+    m_header.indexOffset = m_header.headerSize + m_header.blockCount * m_header.blockStride;
+    m_header.indexCount = static_cast<uint32_t>(m_index.size());
+
+    HRESULT hr = S_OK;
+    if ((!m_index.empty() && m_index.size() != fwrite(&m_index[0], sizeof(UINT64), m_index.size(), m_pFile)) ||
+        0 != fseek(m_pFile, 0, SEEK_SET) || 1 != fwrite(&m_header, sizeof(m_header), 1, m_pFile)) {
+        hr = E_FAIL;
+    }
+
+    if (0 != fclose(m_pFile)) {
+        hr = E_FAIL;
+    }
+    m_pFile = NULL;
+
+    return hr;
+}
+
+/// Constructor
+SessionReader::SessionReader() :
+    m_blockCount(0),
+    m_bRecovered(false),
+    m_pIndex(NULL) {
+    memset(&m_header, 0, sizeof(m_header));
+}
+
+/// Open and map a session file.
+/// <param name="szPath">path of session file.</param>
+/// <returns>S_OK on success, E_INVALIDARG if file is not a session file, otherwise failure code.</returns>
+HRESULT SessionReader::Open(const char* szPath) {
+    Close();
+
+    HRESULT hr = m_file.Open(szPath);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    UINT64 size = m_file.GetSize();
+    if (size < cSessionHeaderSize) {
+        Close();
+        return E_INVALIDARG;
+    }
+
+    memcpy(&m_header, m_file.GetData(), sizeof(m_header));
+    if (0 != memcmp(m_header.magic, cSessionFileMagic, sizeof(m_header.magic)) ||
+        m_header.headerSize < sizeof(m_header) || m_header.headerSize > size ||
+        0 == m_header.channelCount || m_header.channelCount > AudioBlock::MaxChannels ||
+        m_header.blockFrames > AudioBlock::MaxSamples || 0 == m_header.indexInterval ||
+        m_header.blockStride < sizeof(SessionBlockHeader) + static_cast<UINT>(m_header.blockFrames) * m_header.channelCount * sizeof(int16_t)) {
+        Close();
+        return E_INVALIDARG;
+    }
+
+    // Index must lie right behind the blocks it indexes; otherwise file was never closed and blocks are counted from its size
+    UINT64 blocksEnd = m_header.headerSize + m_header.blockCount * m_header.blockStride;
+    if (0 != m_header.indexOffset && blocksEnd == m_header.indexOffset &&
+        m_header.indexCount == (m_header.blockCount + m_header.indexInterval - 1) / m_header.indexInterval &&
+        m_header.indexOffset + static_cast<UINT64>(m_header.indexCount) * sizeof(UINT64) <= size) {
+        m_blockCount = m_header.blockCount;
+        m_pIndex = reinterpret_cast<const UINT64*>(m_file.GetData() + m_header.indexOffset);
+        m_bRecovered = false;
+    }
+    else {
+        m_blockCount = (size - m_header.headerSize) / m_header.blockStride;
+        m_pIndex = NULL;
+        m_bRecovered = true;
+    }
+
+    return S_OK;
+}
+
+/// Unmap file. Views handed out become invalid.
+void SessionReader::Close() {
+    m_file.Close();
+    memset(&m_header, 0, sizeof(m_header));
+    m_blockCount = 0;
+    m_bRecovered = false;
+    m_pIndex = NULL;
+}
+
+/// Index, since start of session, of sample following last block.
+UINT64 SessionReader::GetEndPosition() const {
+    if (0 == m_blockCount) {
+        return 0;
+    }
+
+    return GetBlockHeader(m_blockCount - 1).samplePosition + GetBlockSampleCount(m_blockCount - 1);
+}
+
+/// Number of frames of a block GetBlock hands out: its header's count, limited to what block stride holds.
+/// <param name="block">index of block, below GetBlockCount().</param>
+UINT SessionReader::GetBlockSampleCount(UINT64 block) const {
+    // A torn block could claim more frames than stride holds
+    UINT sampleCount = GetBlockHeader(block).sampleCount;
+    return (sampleCount < m_header.blockFrames) ? sampleCount : m_header.blockFrames;
+}
+
+/// Make a block into an AudioBlock whose samples point into mapping. No samples are copied or read.
+/// <param name="block">index of block, below GetBlockCount().</param>
+/// <param name="pBlock">receives view of block. Its pBuffer is NULL; samples stay valid until reader is closed.</param>
+void SessionReader::GetBlock(UINT64 block, AudioBlock* pBlock) const {
+    const SessionBlockHeader& header = GetBlockHeader(block);
+
+    pBlock->sampleCount = GetBlockSampleCount(block);
+    pBlock->channelCount = m_header.channelCount;
+    pBlock->sequence = header.sequence;
+    pBlock->angles = header.angles;
+    pBlock->captureTimestamp = header.captureTimestamp;
+    pBlock->pSamples = reinterpret_cast<const int16_t*>(&header + 1);
+    pBlock->pBuffer = NULL;
+}
+
+/// Find block holding a sample position, using time index to narrow search to a few block headers.
+/// <param name="samplePosition">index, since start of session, of a sample.</param>
+/// <returns>index of last block starting at or before position, or 0 if position precedes every block.</returns>
+UINT64 SessionReader::FindBlock(UINT64 samplePosition) const {
+    UINT64 low = 0;
+    UINT64 high = m_blockCount;
+
+    if (NULL != m_pIndex) {
+        // First index entry starting after position bounds range of blocks to search
+        UINT entryLow = 0;
+        UINT entryHigh = m_header.indexCount;
+        while (entryLow < entryHigh) {
+            UINT middle = entryLow + (entryHigh - entryLow) / 2;
+            if (m_pIndex[middle] <= samplePosition) {
+                entryLow = middle + 1;
+            } else {
+                entryHigh = middle;
+            }
+        }
+
+        if (0 == entryLow) {
+            return 0;
+        }
+
+        low = static_cast<UINT64>(entryLow - 1) * m_header.indexInterval;
+        UINT64 end = static_cast<UINT64>(entryLow) * m_header.indexInterval;
+        high = (end < m_blockCount) ? end : m_blockCount;
+    }
+
+    // First block in range starting after position
+    while (low < high) {
+        UINT64 middle = low + (high - low) / 2;
+        if (GetBlockHeader(middle).samplePosition <= samplePosition) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return (0 == low) ? 0 : low - 1;
+}
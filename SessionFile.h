@@ -0,0 +1,170 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "AudioBlock.h"
+#include "MappedFile.h"
+
+// For FILE
+#include <stdio.h>
+
+// For time index kept until file is closed
+#include <vector>
+
+/// Header at start of a session file, padded with zeros to cSessionHeaderSize.
+/// Blocks follow it back to back, each blockStride bytes long, then time index.
+struct SessionFileHeader {
+    char                    magic[8];
+    uint32_t                headerSize;
+    uint32_t                blockStride;
+    uint32_t                sampleRate;
+    uint16_t                channelCount;
+    uint16_t                blockFrames;
+
+    // Number of blocks and frames in file, and file offset of time index; all 0 until file is closed.
+    UINT64                  blockCount;
+    UINT64                  frameCount;
+    UINT64                  indexOffset;
+
+    // Number of blocks between time index entries, and number of entries.
+    uint32_t                indexInterval;
+    uint32_t                indexCount;
+};
+
+/// Header of every block in a session file, followed by room for blockFrames interleaved frames.
+struct SessionBlockHeader {
+    // Index, since start of session, of first sample in block.
+    UINT64                  samplePosition;
+
+    // Nanoseconds from capture of first block to capture of this one.
+    UINT64                  captureTimestamp;
+
+    // Sequence number of block, and number of valid frames in it.
+    uint32_t                sequence;
+    uint32_t                sampleCount;
+
+    // Beam and sound source angles audio source reported with block.
+    AudioAngles             angles;
+
+    uint32_t                reserved[4];
+};
+
+// File offset of first block, so blocks and their samples start page aligned.
+static const UINT           cSessionHeaderSize = 4096;
+
+/// Writes audio blocks and the angles captured with them to a session file.
+/// Every block takes the same space in file whatever its length, so readers find any
+/// block by arithmetic, and a sparse time index written on close finds the block holding
+/// any sample position. Blocks are streamed to disk as they arrive.
+class SessionFileWriter {
+public:
+    // Number of blocks between time index entries: about 2 seconds of audio.
+    static const UINT       cIndexInterval = 64;
+
+    /// Constructor
+    SessionFileWriter();
+
+    /// Destructor. Closes file, if open.
+    ~SessionFileWriter();
+
+    /// Create session file and write its header.
+    /// <param name="szPath">path of file to create, replacing any existing file.</param>
+    /// <param name="channelCount">number of interleaved channels, from 1 to AudioBlock::MaxChannels.</param>
+    /// <param name="sampleRate">sample rate, in Hz.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if channel count is out of range, otherwise failure code.</returns>
+    HRESULT                 Open(const char* szPath, WORD channelCount, UINT sampleRate);
+
+    /// Append audio, split into blocks of at most AudioBlock::MaxSamples frames.
+    /// <param name="pSamples">interleaved frames.</param>
+    /// <param name="frameCount">number of frames.</param>
+    /// <param name="angles">angles reported with audio.</param>
+    /// <param name="captureTimestamp">GetClockNanoseconds when audio was captured.</param>
+    /// <returns>S_OK on success, E_UNEXPECTED if file is not open, otherwise failure code.</returns>
+    HRESULT                 Write(const int16_t* pSamples, UINT frameCount, const AudioAngles& angles, UINT64 captureTimestamp);
+
+    /// Write time index, fill in header and close file. Does nothing if file is not open.
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 Close();
+
+    /// Number of blocks written since Open.
+    UINT64                  GetBlockCount() const { return m_header.blockCount; }
+
+private:
+    FILE*                   m_pFile;
+    SessionFileHeader       m_header;
+    UINT64                  m_firstTimestamp;
+
+    // First sample position of every cIndexInterval-th block.
+    std::vector<UINT64>     m_index;
+
+    // One block as written: header, frames and padding to stride.
+    std::vector<BYTE>       m_block;
+
+    SessionFileWriter(const SessionFileWriter&);
+    SessionFileWriter& operator=(const SessionFileWriter&);
+};
+
+/// Gives random access to the blocks of a session file through a memory mapping.
+/// Opening maps file and checks its header only, so it takes the same time for a session
+/// of seconds or hours. Blocks are handed out as views into mapping, valid until reader
+/// is closed. A file that was never closed, because writing it was cut short, is still
+/// readable: its blocks are counted from its size and searched through their headers.
+class SessionReader {
+public:
+    /// Constructor
+    SessionReader();
+
+    /// Open and map a session file.
+    /// <param name="szPath">path of session file.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if file is not a session file, otherwise failure code.</returns>
+    HRESULT                 Open(const char* szPath);
+
+    /// Unmap file. Views handed out become invalid.
+    void                    Close();
+
+    /// Whether file has no time index, because writing it was cut short.
+    bool                    IsRecovered() const { return m_bRecovered; }
+
+    /// Number of blocks in file.
+    UINT64                  GetBlockCount() const { return m_blockCount; }
+
+    /// Number of interleaved channels in every block.
+    WORD                    GetChannelCount() const { return m_header.channelCount; }
+
+    /// Sample rate, in Hz.
+    UINT                    GetSampleRate() const { return m_header.sampleRate; }
+
+    /// Index, since start of session, of sample following last block.
+    UINT64                  GetEndPosition() const;
+
+    /// Header of a block.
+    /// <param name="block">index of block, below GetBlockCount().</param>
+    const SessionBlockHeader& GetBlockHeader(UINT64 block) const {
+        return *reinterpret_cast<const SessionBlockHeader*>(m_file.GetData() + m_header.headerSize + block * m_header.blockStride);
+    }
+
+    /// Number of frames of a block GetBlock hands out: its header's count, limited to what block stride holds.
+    /// <param name="block">index of block, below GetBlockCount().</param>
+    UINT                    GetBlockSampleCount(UINT64 block) const;
+
+    /// Make a block into an AudioBlock whose samples point into mapping. No samples are copied or read.
+    /// <param name="block">index of block, below GetBlockCount().</param>
+    /// <param name="pBlock">receives view of block. Its pBuffer is NULL; samples stay valid until reader is closed.</param>
+    void                    GetBlock(UINT64 block, AudioBlock* pBlock) const;
+
+    /// Find block holding a sample position, using time index to narrow search to a few block headers.
+    /// <param name="samplePosition">index, since start of session, of a sample.</param>
+    /// <returns>index of last block starting at or before position, or 0 if position precedes every block.</returns>
+    UINT64                  FindBlock(UINT64 samplePosition) const;
+
+private:
+    MappedFile              m_file;
+    SessionFileHeader       m_header;
+    UINT64                  m_blockCount;
+    bool                    m_bRecovered;
+
+    // Time index in mapping, or NULL when recovered.
+    const UINT64*           m_pIndex;
+
+    SessionReader(const SessionReader&);
+    SessionReader& operator=(const SessionReader&);
+};
@@ -0,0 +1,64 @@
+﻿#include "Simd.h"
+
+#if defined(_MSC_VER) && defined(AUDIO_SIMD_X86)
+// For __cpuid and _xgetbv
+#include <intrin.h>
+#endif
+
+/// Query CPU and OS support for SIMD instruction sets.
+/// <returns>most capable supported SIMD level.</returns>
+static SimdLevel DetectSimdLevel() {
+#if defined(_MSC_VER) && defined(AUDIO_SIMD_X86)
+    int info[4] = {0};
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    bool bSse2 = (0 != (info[3] & (1 << 26)));
+    bool bOsXsave = (0 != (info[2] & (1 << 27)));
+    bool bAvx = (0 != (info[2] & (1 << 28)));
+    bool bFma = (0 != (info[2] & (1 << 12)));
+
+    if (bOsXsave && bAvx && bFma && maxLeaf >= 7) {
+        // OS must save YMM registers on context switch for AVX to be usable
+        if (6 == (_xgetbv(0) & 6)) {
+            __cpuidex(info, 7, 0);
+            if (0 != (info[1] & (1 << 5))) {
+                return SimdLevelAvx2;
+            }
+        }
+    }
+
+    return bSse2 ? SimdLevelSse2 : SimdLevelScalar;
+#elif defined(__GNUC__) && defined(AUDIO_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return SimdLevelAvx2;
+    }
+
+    return __builtin_cpu_supports("sse2") ? SimdLevelSse2 : SimdLevelScalar;
+#else
+    return SimdLevelScalar;
+#endif
+}
+
+/// Most capable instruction set supported by the running CPU and operating system.
+/// <returns>detected SIMD level.</returns>
+SimdLevel GetSimdLevel() {
+    static const SimdLevel level = DetectSimdLevel();
+    return level;
+}
+
+/// Human readable name of a SIMD level.
+/// <param name="level">SIMD level.</param>
+/// <returns>name such as "avx2".</returns>
+const char* GetSimdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevelSse2:
+            return "sse2";
+        case SimdLevelAvx2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
@@ -0,0 +1,38 @@
+﻿#pragma once
+
+// Shared definitions for SIMD kernels. Kernels are compiled for every instruction set
+// the compiler can target and the best one supported by the running CPU is picked at
+// runtime, so a single binary runs everywhere.
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define AUDIO_SIMD_X86 1
+
+// For SSE2 and AVX2 intrinsics
+#include <immintrin.h>
+#endif
+
+// GCC and Clang only emit instructions beyond the baseline for functions that ask for them.
+// MSVC emits any intrinsic it is given, so these expand to nothing there.
+#if defined(__GNUC__) && defined(AUDIO_SIMD_X86)
+#define AUDIO_TARGET_SSE2   __attribute__((target("sse2")))
+#define AUDIO_TARGET_AVX2   __attribute__((target("avx2,fma")))
+#else
+#define AUDIO_TARGET_SSE2
+#define AUDIO_TARGET_AVX2
+#endif
+
+/// Instruction sets SIMD kernels are specialized for, in increasing order of capability.
+enum SimdLevel {
+    SimdLevelScalar = 0,
+    SimdLevelSse2,
+    SimdLevelAvx2
+};
+
+/// Most capable instruction set supported by the running CPU and operating system.
+/// <returns>detected SIMD level.</returns>
+SimdLevel GetSimdLevel();
+
+/// Human readable name of a SIMD level.
+/// <param name="level">SIMD level.</param>
+/// <returns>name such as "avx2".</returns>
+const char* GetSimdLevelName(SimdLevel level);
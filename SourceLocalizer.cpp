@@ -0,0 +1,315 @@
+﻿#include "SourceLocalizer.h"
+
+// For M_PI, sin, cos, sqrt, asin and floor
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+// Lowest and highest frequencies, in Hz, used for localization. Below this range
+// room rumble dominates; above it Kinect microphones pick up mostly self noise.
+static const float cLowestFrequency = 100.0f;
+static const float cHighestFrequency = 7000.0f;
+
+// Weight given to smoothed cross-spectra of previous frames when a new frame is added.
+// Higher values give steadier angles at the cost of following moving sources more slowly.
+static const float cCrossSpectrumSmoothing = 0.6f;
+
+/// Constructor
+GccPhatLocalizer::GccPhatLocalizer() :
+    m_microphoneCount(0),
+    m_pairCount(0),
+    m_firstBin(0),
+    m_lastBin(0),
+    m_coherentPeak(1.0f),
+    m_pWindow(NULL),
+    m_pFrames(NULL),
+    m_frameFill(0),
+    m_pSpectra(NULL),
+    m_pCrossSpectra(NULL),
+    m_pWorkspace(NULL),
+    m_samplePosition(0) {
+}
+
+/// Destructor
+GccPhatLocalizer::~GccPhatLocalizer() {
+    delete [] m_pWindow;
+    delete [] m_pFrames;
+    delete [] m_pSpectra;
+    delete [] m_pCrossSpectra;
+    delete [] m_pWorkspace;
+}
+
+/// Configure array and allocate FFT plan and workspaces.
+/// <param name="geometry">microphone positions, in capture channel order.</param>
+/// <param name="samplesPerSecond">sample rate of captured audio.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT GccPhatLocalizer::Initialize(const MicrophoneArrayGeometry& geometry, DWORD samplesPerSecond) {
+    if (geometry.microphoneCount < 2 || geometry.microphoneCount > MicrophoneArrayGeometry::MaxMicrophones || 0 == samplesPerSecond) {
+        return E_INVALIDARG;
+    }
+
+    HRESULT hr = m_plan.Initialize(cFftSize, GetSimdLevel());
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    m_microphoneCount = geometry.microphoneCount;
+    m_pairCount = 0;
+
+    for (UINT i = 0; i < m_microphoneCount; ++i) {
+        for (UINT j = i + 1; j < m_microphoneCount; ++j) {
+            float delayPerSine = (geometry.positions[j] - geometry.positions[i]) * samplesPerSecond / SpeedOfSound;
+
+            m_pairFirst[m_pairCount] = i;
+            m_pairSecond[m_pairCount] = j;
+            m_pairDelayPerSine[m_pairCount] = delayPerSine;
+            m_pairMaxLag[m_pairCount] = static_cast<int>(ceilf(fabsf(delayPerSine))) + 1;
+            ++m_pairCount;
+        }
+    }
+
+    m_firstBin = static_cast<UINT>(ceilf(cLowestFrequency * cFftSize / samplesPerSecond));
+    m_lastBin = static_cast<UINT>(cHighestFrequency * cFftSize / samplesPerSecond);
+    m_lastBin = (m_lastBin < cFftSize / 2) ? m_lastBin : cFftSize / 2 - 1;
+    m_firstBin = (m_firstBin > 0) ? m_firstBin : 1;
+
+    // A coherent source leaves every used bin, and its mirror image, at unit magnitude
+    m_coherentPeak = 2.0f * (m_lastBin - m_firstBin + 1) / cFftSize;
+
+    const UINT bins = cFftSize / 2 + 1;
+
+    delete [] m_pWindow;
+    delete [] m_pFrames;
+    delete [] m_pSpectra;
+    delete [] m_pCrossSpectra;
+    delete [] m_pWorkspace;
+
+    m_pWindow = new float[cFrameSize];
+    m_pFrames = new float[cFrameSize * m_microphoneCount];
+    m_pSpectra = new float[2 * bins * m_microphoneCount];
+    m_pCrossSpectra = new float[2 * bins * m_pairCount];
+    m_pWorkspace = new float[2 * cFftSize];
+
+    for (UINT n = 0; n < cFrameSize; ++n) {
+        m_pWindow[n] = static_cast<float>(0.5 - 0.5 * cos(2.0 * M_PI * n / cFrameSize));
+    }
+
+    Reset();
+
+    return S_OK;
+}
+
+/// Compute an angular power map of every analysis frame, alongside its estimate. Call after Initialize.
+/// <param name="angleCount">number of angles in map grid, from -90 to +90 degrees.</param>
+/// <param name="threadCount">number of threads map grid is split across, 1 for calling thread only.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT GccPhatLocalizer::InitializeAngularMap(UINT angleCount, UINT threadCount) {
+    if (0 == m_pairCount) {
+        return E_UNEXPECTED;
+    }
+
+    return m_map.Initialize(m_pairDelayPerSine, m_pairCount, cFftSize, m_firstBin, m_lastBin, angleCount, threadCount, GetSimdLevel());
+}
+
+/// Forget audio and smoothed cross-spectra carried between blocks.
+void GccPhatLocalizer::Reset() {
+    if (NULL == m_pFrames) {
+        return;
+    }
+
+    memset(m_pFrames, 0, sizeof(float) * cFrameSize * m_microphoneCount);
+    memset(m_pCrossSpectra, 0, sizeof(float) * 2 * (cFftSize / 2 + 1) * m_pairCount);
+    m_frameFill = 0;
+    m_samplePosition = 0;
+}
+
+/// Feed a block of audio and produce an estimate for every analysis frame it completes.
+/// <param name="pInterleaved">frames holding one sample per microphone.</param>
+/// <param name="frameCount">number of frames.</param>
+/// <param name="pEstimates">receives estimates, oldest first.</param>
+/// <param name="pMaps">receives angular map of every estimate's frame, one after another, or NULL.
+/// Ignored unless InitializeAngularMap was called.</param>
+/// <param name="maxEstimates">capacity of pEstimates, and of pMaps in maps; frames beyond it are analyzed but not reported.</param>
+/// <returns>number of estimates written to pEstimates.</returns>
+UINT GccPhatLocalizer::Process(const int16_t* pInterleaved, UINT frameCount, SourceEstimate* pEstimates, float* pMaps, UINT maxEstimates) {
+    if (NULL == m_pFrames) {
+        return 0;
+    }
+
+    UINT estimateCount = 0;
+
+    for (UINT i = 0; i < frameCount; ) {
+        UINT take = cFrameSize - m_frameFill;
+        take = (take < frameCount - i) ? take : frameCount - i;
+
+        // Deinterleave into each microphone's frame
+        for (UINT m = 0; m < m_microphoneCount; ++m) {
+            float* pFrame = m_pFrames + m * cFrameSize + m_frameFill;
+            const int16_t* pSample = pInterleaved + i * m_microphoneCount + m;
+            for (UINT n = 0; n < take; ++n, pSample += m_microphoneCount) {
+                pFrame[n] = *pSample;
+            }
+        }
+
+        m_frameFill += take;
+        m_samplePosition += take;
+        i += take;
+
+        if (cFrameSize == m_frameFill) {
+            SourceEstimate estimate;
+            AnalyzeFrame(&estimate);
+            if (estimateCount < maxEstimates) {
+                // Map is only worth computing for frames that are reported
+                if (NULL != pMaps && m_map.GetAngleCount() > 0) {
+                    m_map.Compute(m_pCrossSpectra, pMaps + estimateCount * m_map.GetAngleCount());
+                }
+                pEstimates[estimateCount++] = estimate;
+            }
+
+            // Slide frames along by one hop; overlap is analyzed again with next hop
+            for (UINT m = 0; m < m_microphoneCount; ++m) {
+                float* pFrame = m_pFrames + m * cFrameSize;
+                memmove(pFrame, pFrame + cHopSize, (cFrameSize - cHopSize) * sizeof(float));
+            }
+            m_frameFill = cFrameSize - cHopSize;
+        }
+    }
+
+    return estimateCount;
+}
+
+/// Analyze frame held in m_pFrames.
+/// <param name="pEstimate">receives estimate.</param>
+void GccPhatLocalizer::AnalyzeFrame(SourceEstimate* pEstimate) {
+    const UINT bins = cFftSize / 2 + 1;
+
+    // Spectra of two microphones per transform: one frame as real part, the other as imaginary
+    // part, separated afterwards using the symmetry of real signals' spectra
+    for (UINT m = 0; m < m_microphoneCount; m += 2) {
+        const float* pFirst = m_pFrames + m * cFrameSize;
+        const float* pSecond = (m + 1 < m_microphoneCount) ? pFirst + cFrameSize : NULL;
+
+        for (UINT n = 0; n < cFrameSize; ++n) {
+            m_pWorkspace[2 * n] = m_pWindow[n] * pFirst[n];
+            m_pWorkspace[2 * n + 1] = (NULL != pSecond) ? m_pWindow[n] * pSecond[n] : 0.0f;
+        }
+        memset(m_pWorkspace + 2 * cFrameSize, 0, sizeof(float) * 2 * (cFftSize - cFrameSize));
+
+        m_plan.Forward(m_pWorkspace);
+
+        float* pFirstSpectrum = m_pSpectra + 2 * bins * m;
+        float* pSecondSpectrum = pFirstSpectrum + 2 * bins;
+        for (UINT k = 0; k < bins; ++k) {
+            UINT mirror = (cFftSize - k) & (cFftSize - 1);
+            float zr = m_pWorkspace[2 * k];
+            float zi = m_pWorkspace[2 * k + 1];
+            float mr = m_pWorkspace[2 * mirror];
+            float mi = m_pWorkspace[2 * mirror + 1];
+
+            pFirstSpectrum[2 * k] = 0.5f * (zr + mr);
+            pFirstSpectrum[2 * k + 1] = 0.5f * (zi - mi);
+            if (NULL != pSecond) {
+                pSecondSpectrum[2 * k] = 0.5f * (zi + mi);
+                pSecondSpectrum[2 * k + 1] = -0.5f * (zr - mr);
+            }
+        }
+    }
+
+    // Whiten each pair's cross-spectrum so every frequency votes equally, then smooth over frames
+    for (UINT p = 0; p < m_pairCount; ++p) {
+        const float* pX = m_pSpectra + 2 * bins * m_pairFirst[p];
+        const float* pY = m_pSpectra + 2 * bins * m_pairSecond[p];
+        float* pCross = m_pCrossSpectra + 2 * bins * p;
+
+        for (UINT k = m_firstBin; k <= m_lastBin; ++k) {
+            float gr = pX[2 * k] * pY[2 * k] + pX[2 * k + 1] * pY[2 * k + 1];
+            float gi = pX[2 * k + 1] * pY[2 * k] - pX[2 * k] * pY[2 * k + 1];
+            float magnitude = sqrtf(gr * gr + gi * gi);
+            float scale = (magnitude > 1e-20f) ? (1.0f - cCrossSpectrumSmoothing) / magnitude : 0.0f;
+
+            pCross[2 * k] = cCrossSpectrumSmoothing * pCross[2 * k] + scale * gr;
+            pCross[2 * k + 1] = cCrossSpectrumSmoothing * pCross[2 * k + 1] + scale * gi;
+        }
+    }
+
+    // Correlations of two pairs per inverse transform. Both are real, so one is carried in the
+    // real part of the result and the other in the imaginary part.
+    float pairLag[cMaxPairs];
+    float pairPeak[cMaxPairs];
+
+    for (UINT p = 0; p < m_pairCount; p += 2) {
+        const float* pFirst = m_pCrossSpectra + 2 * bins * p;
+        const float* pSecond = (p + 1 < m_pairCount) ? pFirst + 2 * bins : NULL;
+
+        memset(m_pWorkspace, 0, sizeof(float) * 2 * cFftSize);
+        for (UINT k = m_firstBin; k <= m_lastBin; ++k) {
+            float ar = pFirst[2 * k];
+            float ai = pFirst[2 * k + 1];
+            float br = (NULL != pSecond) ? pSecond[2 * k] : 0.0f;
+            float bi = (NULL != pSecond) ? pSecond[2 * k + 1] : 0.0f;
+
+            // A + iB at positive frequencies, conj(A) + i*conj(B) at their mirror images
+            m_pWorkspace[2 * k] = ar - bi;
+            m_pWorkspace[2 * k + 1] = ai + br;
+            m_pWorkspace[2 * (cFftSize - k)] = ar + bi;
+            m_pWorkspace[2 * (cFftSize - k) + 1] = br - ai;
+        }
+
+        m_plan.Inverse(m_pWorkspace);
+
+        pairPeak[p] = FindPeak(m_pWorkspace, m_pairMaxLag[p], &pairLag[p]);
+        if (NULL != pSecond) {
+            pairPeak[p + 1] = FindPeak(m_pWorkspace + 1, m_pairMaxLag[p + 1], &pairLag[p + 1]);
+        }
+    }
+
+    // Weighted least squares fit of sin(angle) to pair delays, trusting pairs with sharper peaks more
+    double numerator = 0.0;
+    double denominator = 0.0;
+    double peakSum = 0.0;
+    for (UINT p = 0; p < m_pairCount; ++p) {
+        double weight = (pairPeak[p] > 0.0f) ? pairPeak[p] : 0.0;
+        numerator += weight * m_pairDelayPerSine[p] * pairLag[p];
+        denominator += weight * m_pairDelayPerSine[p] * m_pairDelayPerSine[p];
+        peakSum += pairPeak[p];
+    }
+
+    double sine = (denominator > 0.0) ? numerator / denominator : 0.0;
+    sine = (sine > 1.0) ? 1.0 : ((sine < -1.0) ? -1.0 : sine);
+
+    double confidence = peakSum / m_pairCount / m_coherentPeak;
+    confidence = (confidence > 1.0) ? 1.0 : ((confidence < 0.0) ? 0.0 : confidence);
+
+    pEstimate->samplePosition = m_samplePosition;
+    pEstimate->angleDegrees = static_cast<float>(asin(sine) * 180.0 / M_PI);
+    pEstimate->confidence = static_cast<float>(confidence);
+}
+
+/// Find correlation peak within physically possible lags.
+/// <param name="pCorrelation">correlation of pair, indexed by circular lag, stride 2.</param>
+/// <param name="maxLag">largest lag searched in either direction.</param>
+/// <param name="pLag">receives interpolated lag of peak, in samples.</param>
+/// <returns>height of peak.</returns>
+float GccPhatLocalizer::FindPeak(const float* pCorrelation, int maxLag, float* pLag) {
+    const int mask = cFftSize - 1;
+
+    int bestLag = 0;
+    float bestValue = pCorrelation[0];
+    for (int lag = -maxLag; lag <= maxLag; ++lag) {
+        float value = pCorrelation[2 * (lag & mask)];
+        if (value > bestValue) {
+            bestValue = value;
+            bestLag = lag;
+        }
+    }
+
+    // Fit parabola through peak and its neighbours for sub-sample resolution
+    float left = pCorrelation[2 * ((bestLag - 1) & mask)];
+    float right = pCorrelation[2 * ((bestLag + 1) & mask)];
+    float curvature = left - 2.0f * bestValue + right;
+    float offset = (curvature < 0.0f) ? 0.5f * (left - right) / curvature : 0.0f;
+    offset = (offset > 0.5f) ? 0.5f : ((offset < -0.5f) ? -0.5f : offset);
+
+    *pLag = bestLag + offset;
+
+    return bestValue;
+}
@@ -0,0 +1,135 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "AudioBlock.h"
+#include "Fft.h"
+#include "MicrophoneArray.h"
+#include "SrpPhatMap.h"
+
+/// Direction of dominant sound source at one point in the stream.
+struct SourceEstimate {
+    // Index, since start of stream, of sample frame at end of analysis frame.
+    UINT64                  samplePosition;
+
+    // Sound source angle, in degrees from broadside.
+    float                   angleDegrees;
+
+    // Confidence in angle, in [0.0,1.0] interval.
+    float                   confidence;
+};
+
+/// Sound source localization by generalized cross-correlation with phase transform
+/// (GCC-PHAT) across every microphone pair of a linear array.
+/// Audio is analyzed in overlapping frames: each frame's cross-spectra are whitened,
+/// smoothed over time, and transformed back into correlations whose peaks give the
+/// delay between microphones. Pair delays are fitted to a single arrival angle.
+/// Optionally the same cross-spectra are steered over a grid of angles into an SRP-PHAT
+/// map, which shows every source rather than the single angle the fit settles on.
+/// FFT plans and workspaces are allocated by Initialize; Process performs no allocations.
+class GccPhatLocalizer {
+public:
+    // Number of sample frames in each analysis frame.
+    static const UINT       cFrameSize = 512;
+
+    // Number of sample frames between consecutive estimates (16 ms at 16 kHz).
+    static const UINT       cHopSize = 256;
+
+    // Transform size. Frames are zero padded to twice their length so correlation does not wrap.
+    static const UINT       cFftSize = 2 * cFrameSize;
+
+    // Largest number of estimates a single block can produce.
+    static const UINT       cMaxEstimatesPerBlock = AudioBlock::MaxSamples / cHopSize + 1;
+
+    /// Constructor
+    GccPhatLocalizer();
+
+    /// Destructor
+    ~GccPhatLocalizer();
+
+    /// Configure array and allocate FFT plan and workspaces.
+    /// <param name="geometry">microphone positions, in capture channel order.</param>
+    /// <param name="samplesPerSecond">sample rate of captured audio.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 Initialize(const MicrophoneArrayGeometry& geometry, DWORD samplesPerSecond);
+
+    /// Compute an angular power map of every analysis frame, alongside its estimate. Call after Initialize.
+    /// <param name="angleCount">number of angles in map grid, from -90 to +90 degrees.</param>
+    /// <param name="threadCount">number of threads map grid is split across, 1 for calling thread only.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 InitializeAngularMap(UINT angleCount, UINT threadCount);
+
+    /// Forget audio and smoothed cross-spectra carried between blocks.
+    void                    Reset();
+
+    /// Feed a block of audio and produce an estimate for every analysis frame it completes.
+    /// <param name="pInterleaved">frames holding one sample per microphone.</param>
+    /// <param name="frameCount">number of frames.</param>
+    /// <param name="pEstimates">receives estimates, oldest first.</param>
+    /// <param name="pMaps">receives angular map of every estimate's frame, one after another, or NULL.
+    /// Ignored unless InitializeAngularMap was called.</param>
+    /// <param name="maxEstimates">capacity of pEstimates, and of pMaps in maps; frames beyond it are analyzed but not reported.</param>
+    /// <returns>number of estimates written to pEstimates.</returns>
+    UINT                    Process(const int16_t* pInterleaved, UINT frameCount, SourceEstimate* pEstimates, float* pMaps, UINT maxEstimates);
+
+    /// Angular map grid and peak finder, set up by InitializeAngularMap.
+    const SrpPhatMap&       GetAngularMap() const { return m_map; }
+
+private:
+    // Largest number of microphone pairs.
+    static const UINT       cMaxPairs = MicrophoneArrayGeometry::MaxMicrophones * (MicrophoneArrayGeometry::MaxMicrophones - 1) / 2;
+
+    UINT                    m_microphoneCount;
+    UINT                    m_pairCount;
+    UINT                    m_pairFirst[cMaxPairs];
+    UINT                    m_pairSecond[cMaxPairs];
+
+    // Delay, in samples, of pair's second microphone relative to its first, per unit sin(angle).
+    float                   m_pairDelayPerSine[cMaxPairs];
+
+    // Largest physically possible delay, in whole samples, between pair's microphones.
+    int                     m_pairMaxLag[cMaxPairs];
+
+    // Range of FFT bins used; bins outside it carry mostly noise.
+    UINT                    m_firstBin;
+    UINT                    m_lastBin;
+
+    // Correlation peak height of a perfectly coherent source, for normalizing confidence.
+    float                   m_coherentPeak;
+
+    FftPlan                 m_plan;
+
+    // Analysis window applied to every frame.
+    float*                  m_pWindow;
+
+    // Per microphone samples of frame being assembled.
+    float*                  m_pFrames;
+    UINT                    m_frameFill;
+
+    // Per microphone spectra of current frame, bins 0..cFftSize/2, interleaved complex.
+    float*                  m_pSpectra;
+
+    // Per pair whitened cross-spectra smoothed over frames, bins 0..cFftSize/2, interleaved complex.
+    float*                  m_pCrossSpectra;
+
+    // FFT workspace, cFftSize interleaved complex.
+    float*                  m_pWorkspace;
+
+    UINT64                  m_samplePosition;
+
+    // Angular map, computed only once InitializeAngularMap has set it up.
+    SrpPhatMap              m_map;
+
+    /// Analyze frame held in m_pFrames.
+    /// <param name="pEstimate">receives estimate.</param>
+    void                    AnalyzeFrame(SourceEstimate* pEstimate);
+
+    /// Find correlation peak within physically possible lags.
+    /// <param name="pCorrelation">correlation of pair, indexed by circular lag, stride 2.</param>
+    /// <param name="maxLag">largest lag searched in either direction.</param>
+    /// <param name="pLag">receives interpolated lag of peak, in samples.</param>
+    /// <returns>height of peak.</returns>
+    static float            FindPeak(const float* pCorrelation, int maxLag, float* pLag);
+
+    GccPhatLocalizer(const GccPhatLocalizer&);
+    GccPhatLocalizer& operator=(const GccPhatLocalizer&);
+};
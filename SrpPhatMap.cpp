@@ -0,0 +1,393 @@
+﻿#include "SrpPhatMap.h"
+
+// For M_PI, sin, cos and fabs
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+// Weakest peak reported, as a fraction of a single coherent source's response.
+static const float cMinPeakStrength = 0.1f;
+
+// Weakest peak reported, as a fraction of the map's strongest peak. Sidelobes of a strong
+// source rise well above the floor of an empty map, so a fixed threshold alone is not enough.
+static const float cMinRelativePeakStrength = 0.35f;
+
+// Closest, in degrees, two reported peaks may be. The weaker of two closer peaks is taken to
+// be a ripple on the stronger one.
+static const float cMinPeakSeparationDegrees = 12.0f;
+
+/// Add response of a run of angles to one pair's cross-spectrum: for every angle, the real part
+/// of each bin times that angle's phasor for the bin. Phasors are advanced from bin to bin by
+/// complex multiplication, so no sines are evaluated here.
+/// <param name="pCross">first summed bin of cross-spectrum, interleaved complex.</param>
+/// <param name="binCount">number of bins summed.</param>
+/// <param name="pStartCos">cosine of each angle's phasor at first bin.</param>
+/// <param name="pStartSin">sine of each angle's phasor at first bin.</param>
+/// <param name="pStepCos">cosine of each angle's phase step between bins.</param>
+/// <param name="pStepSin">sine of each angle's phase step between bins.</param>
+/// <param name="pPower">summed response of each angle, added to.</param>
+/// <param name="angleCount">number of angles.</param>
+static void SteerScalar(const float* pCross, UINT binCount, const float* pStartCos, const float* pStartSin,
+    const float* pStepCos, const float* pStepSin, float* pPower, UINT angleCount) {
+    for (UINT a = 0; a < angleCount; ++a) {
+        float c = pStartCos[a];
+        float s = pStartSin[a];
+        float acc = 0.0f;
+
+        for (UINT k = 0; k < binCount; ++k) {
+            acc += pCross[2 * k] * c - pCross[2 * k + 1] * s;
+
+            float next = c * pStepCos[a] - s * pStepSin[a];
+            s = c * pStepSin[a] + s * pStepCos[a];
+            c = next;
+        }
+
+        pPower[a] += acc;
+    }
+}
+
+#ifdef AUDIO_SIMD_X86
+
+/// SSE2 version of SteerScalar, eight angles at a time in two independent sets of four, so one
+/// set's phasor update overlaps the other's. Angle count must be a multiple of eight.
+AUDIO_TARGET_SSE2
+static void SteerSse2(const float* pCross, UINT binCount, const float* pStartCos, const float* pStartSin,
+    const float* pStepCos, const float* pStepSin, float* pPower, UINT angleCount) {
+    for (UINT a = 0; a < angleCount; a += 8) {
+        __m128 c0 = _mm_loadu_ps(pStartCos + a);
+        __m128 s0 = _mm_loadu_ps(pStartSin + a);
+        __m128 c1 = _mm_loadu_ps(pStartCos + a + 4);
+        __m128 s1 = _mm_loadu_ps(pStartSin + a + 4);
+        __m128 stepCos0 = _mm_loadu_ps(pStepCos + a);
+        __m128 stepSin0 = _mm_loadu_ps(pStepSin + a);
+        __m128 stepCos1 = _mm_loadu_ps(pStepCos + a + 4);
+        __m128 stepSin1 = _mm_loadu_ps(pStepSin + a + 4);
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+
+        for (UINT k = 0; k < binCount; ++k) {
+            __m128 real = _mm_set1_ps(pCross[2 * k]);
+            __m128 imag = _mm_set1_ps(pCross[2 * k + 1]);
+            acc0 = _mm_add_ps(acc0, _mm_sub_ps(_mm_mul_ps(real, c0), _mm_mul_ps(imag, s0)));
+            acc1 = _mm_add_ps(acc1, _mm_sub_ps(_mm_mul_ps(real, c1), _mm_mul_ps(imag, s1)));
+
+            __m128 next0 = _mm_sub_ps(_mm_mul_ps(c0, stepCos0), _mm_mul_ps(s0, stepSin0));
+            __m128 next1 = _mm_sub_ps(_mm_mul_ps(c1, stepCos1), _mm_mul_ps(s1, stepSin1));
+            s0 = _mm_add_ps(_mm_mul_ps(c0, stepSin0), _mm_mul_ps(s0, stepCos0));
+            s1 = _mm_add_ps(_mm_mul_ps(c1, stepSin1), _mm_mul_ps(s1, stepCos1));
+            c0 = next0;
+            c1 = next1;
+        }
+
+        _mm_storeu_ps(pPower + a, _mm_add_ps(_mm_loadu_ps(pPower + a), acc0));
+        _mm_storeu_ps(pPower + a + 4, _mm_add_ps(_mm_loadu_ps(pPower + a + 4), acc1));
+    }
+}
+
+/// AVX2 version of SteerScalar, sixteen angles at a time in two independent sets of eight. Real and
+/// imaginary products go to separate sums, so no chain of dependent operations is longer than one
+/// phasor update per bin. Angle count must be a multiple of sixteen.
+AUDIO_TARGET_AVX2
+static void SteerAvx2(const float* pCross, UINT binCount, const float* pStartCos, const float* pStartSin,
+    const float* pStepCos, const float* pStepSin, float* pPower, UINT angleCount) {
+    for (UINT a = 0; a < angleCount; a += 16) {
+        __m256 c0 = _mm256_loadu_ps(pStartCos + a);
+        __m256 s0 = _mm256_loadu_ps(pStartSin + a);
+        __m256 c1 = _mm256_loadu_ps(pStartCos + a + 8);
+        __m256 s1 = _mm256_loadu_ps(pStartSin + a + 8);
+        __m256 stepCos0 = _mm256_loadu_ps(pStepCos + a);
+        __m256 stepSin0 = _mm256_loadu_ps(pStepSin + a);
+        __m256 stepCos1 = _mm256_loadu_ps(pStepCos + a + 8);
+        __m256 stepSin1 = _mm256_loadu_ps(pStepSin + a + 8);
+        __m256 real0 = _mm256_setzero_ps();
+        __m256 imag0 = _mm256_setzero_ps();
+        __m256 real1 = _mm256_setzero_ps();
+        __m256 imag1 = _mm256_setzero_ps();
+
+        for (UINT k = 0; k < binCount; ++k) {
+            __m256 real = _mm256_set1_ps(pCross[2 * k]);
+            __m256 imag = _mm256_set1_ps(pCross[2 * k + 1]);
+            real0 = _mm256_fmadd_ps(real, c0, real0);
+            imag0 = _mm256_fmadd_ps(imag, s0, imag0);
+            real1 = _mm256_fmadd_ps(real, c1, real1);
+            imag1 = _mm256_fmadd_ps(imag, s1, imag1);
+
+            __m256 next0 = _mm256_fmsub_ps(c0, stepCos0, _mm256_mul_ps(s0, stepSin0));
+            __m256 next1 = _mm256_fmsub_ps(c1, stepCos1, _mm256_mul_ps(s1, stepSin1));
+            s0 = _mm256_fmadd_ps(c0, stepSin0, _mm256_mul_ps(s0, stepCos0));
+            s1 = _mm256_fmadd_ps(c1, stepSin1, _mm256_mul_ps(s1, stepCos1));
+            c0 = next0;
+            c1 = next1;
+        }
+
+        _mm256_storeu_ps(pPower + a, _mm256_add_ps(_mm256_loadu_ps(pPower + a), _mm256_sub_ps(real0, imag0)));
+        _mm256_storeu_ps(pPower + a + 8, _mm256_add_ps(_mm256_loadu_ps(pPower + a + 8), _mm256_sub_ps(real1, imag1)));
+    }
+}
+
+#endif
+
+/// Constructor
+SrpPhatMap::SrpPhatMap() :
+    m_pairCount(0),
+    m_binStride(0),
+    m_firstBin(0),
+    m_binCount(0),
+    m_angleCount(0),
+    m_paddedAngleCount(0),
+    m_level(SimdLevelScalar),
+    m_pSteering(NULL),
+    m_pPower(NULL),
+    m_pCrossSpectra(NULL),
+    m_threadCount(1),
+    m_groupsPerThread(0),
+    m_generation(0),
+    m_pending(0),
+    m_bStopping(false) {
+}
+
+/// Destructor. Stops helper threads.
+SrpPhatMap::~SrpPhatMap() {
+    StopHelpers();
+
+    delete [] m_pSteering;
+    delete [] m_pPower;
+}
+
+/// Build steering tables for a set of microphone pairs, and start helper threads.
+/// <param name="pPairDelayPerSine">delay, in samples, of each pair's second microphone relative to its first, per unit sin(angle).</param>
+/// <param name="pairCount">number of microphone pairs.</param>
+/// <param name="fftSize">transform size cross-spectra were computed with.</param>
+/// <param name="firstBin">lowest bin summed.</param>
+/// <param name="lastBin">highest bin summed, below fftSize / 2.</param>
+/// <param name="angleCount">number of grid angles, from 2 to cMaxAngles.</param>
+/// <param name="threadCount">number of threads to split grid across, from 1 to cMaxThreads. 1 computes on calling thread only.</param>
+/// <param name="level">instruction set used by steering kernel.</param>
+/// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range.</returns>
+HRESULT SrpPhatMap::Initialize(const float* pPairDelayPerSine, UINT pairCount, UINT fftSize, UINT firstBin, UINT lastBin, UINT angleCount, UINT threadCount, SimdLevel level) {
+    if (0 == pairCount || firstBin > lastBin || lastBin >= fftSize / 2 ||
+        angleCount < 2 || angleCount > cMaxAngles || 0 == threadCount || threadCount > cMaxThreads) {
+        return E_INVALIDARG;
+    }
+
+    StopHelpers();
+
+    delete [] m_pSteering;
+    delete [] m_pPower;
+
+    m_pairCount = pairCount;
+    m_binStride = fftSize / 2 + 1;
+    m_firstBin = firstBin;
+    m_binCount = lastBin - firstBin + 1;
+    m_angleCount = angleCount;
+    m_paddedAngleCount = (angleCount + cAngleGroup - 1) / cAngleGroup * cAngleGroup;
+    m_level = level;
+
+    // Padding angles start from a zero phasor, so they add nothing
+    const UINT planeSize = pairCount * m_paddedAngleCount;
+    m_pSteering = new float[4 * planeSize];
+    m_pPower = new float[m_paddedAngleCount];
+    memset(m_pSteering, 0, 4 * planeSize * sizeof(float));
+
+    for (UINT p = 0; p < pairCount; ++p) {
+        for (UINT a = 0; a < angleCount; ++a) {
+            // Delaying second microphone by tau samples rotates bin k of cross-spectrum by -2*pi*k*tau/fftSize,
+            // which the phasor undoes for sound arriving from this angle
+            double delay = pPairDelayPerSine[p] * sin(GetAngleDegrees(a) * M_PI / 180.0);
+            double step = 2.0 * M_PI * delay / fftSize;
+            UINT index = p * m_paddedAngleCount + a;
+
+            m_pSteering[index] = static_cast<float>(cos(step * firstBin));
+            m_pSteering[planeSize + index] = static_cast<float>(sin(step * firstBin));
+            m_pSteering[2 * planeSize + index] = static_cast<float>(cos(step));
+            m_pSteering[3 * planeSize + index] = static_cast<float>(sin(step));
+        }
+    }
+
+    // Each thread takes an equal run of whole angle groups
+    UINT groupCount = m_paddedAngleCount / cAngleGroup;
+    m_threadCount = threadCount;
+    m_groupsPerThread = (groupCount + threadCount - 1) / threadCount;
+
+    m_bStopping = false;
+    m_generation = 0;
+    m_pending = 0;
+    for (UINT t = 1; t < threadCount; ++t) {
+        m_helpers.push_back(std::thread(&SrpPhatMap::HelperLoop, this, t));
+    }
+
+    return S_OK;
+}
+
+/// Compute map from one frame's cross-spectra.
+/// <param name="pCrossSpectra">whitened cross-spectrum of every pair, one after another, each fftSize / 2 + 1 interleaved complex bins.</param>
+/// <param name="pMap">receives GetAngleCount values, in order of increasing angle.</param>
+void SrpPhatMap::Compute(const float* pCrossSpectra, float* pMap) {
+    if (NULL == m_pPower) {
+        return;
+    }
+
+    m_pCrossSpectra = pCrossSpectra;
+
+    if (!m_helpers.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_pending = static_cast<UINT>(m_helpers.size());
+            ++m_generation;
+        }
+        m_workReady.notify_all();
+    }
+
+    ComputeRun(0);
+
+    if (!m_helpers.empty()) {
+        std::unique_lock<std::mutex> lock(m_lock);
+        while (m_pending > 0) {
+            m_workDone.wait(lock);
+        }
+    }
+
+    // A coherent source leaves every pair's whitened bins at unit magnitude, all in phase at its angle
+    float scale = 1.0f / (m_pairCount * m_binCount);
+    for (UINT a = 0; a < m_angleCount; ++a) {
+        pMap[a] = m_pPower[a] * scale;
+    }
+}
+
+/// Find strongest local maxima of a map, at least a minimum separation apart.
+/// <param name="pMap">map produced by Compute.</param>
+/// <param name="pPeaks">receives peaks, strongest first.</param>
+/// <param name="maxPeaks">capacity of pPeaks.</param>
+/// <returns>number of peaks written to pPeaks.</returns>
+UINT SrpPhatMap::FindPeaks(const float* pMap, AngularPeak* pPeaks, UINT maxPeaks) const {
+    UINT peakCount = 0;
+    float threshold = cMinPeakStrength;
+
+    // Strongest remaining local maximum clear of those already taken, until none is left
+    while (peakCount < maxPeaks) {
+        UINT best = m_angleCount;
+
+        for (UINT a = 0; a < m_angleCount; ++a) {
+            bool bRising = (0 == a) || pMap[a] >= pMap[a - 1];
+            bool bFalling = (m_angleCount - 1 == a) || pMap[a] > pMap[a + 1];
+            if (!bRising || !bFalling || pMap[a] < threshold || (best < m_angleCount && pMap[a] <= pMap[best])) {
+                continue;
+            }
+
+            bool bClear = true;
+            for (UINT i = 0; i < peakCount && bClear; ++i) {
+                bClear = fabsf(GetAngleDegrees(a) - pPeaks[i].angleDegrees) >= cMinPeakSeparationDegrees;
+            }
+
+            if (bClear) {
+                best = a;
+            }
+        }
+
+        if (best == m_angleCount) {
+            break;
+        }
+
+        // Fit parabola through peak and its neighbours for resolution finer than grid
+        float offset = 0.0f;
+        float strength = pMap[best];
+        if (best > 0 && best + 1 < m_angleCount) {
+            float left = pMap[best - 1];
+            float right = pMap[best + 1];
+            float curvature = left - 2.0f * strength + right;
+            offset = (curvature < 0.0f) ? 0.5f * (left - right) / curvature : 0.0f;
+            offset = (offset > 0.5f) ? 0.5f : ((offset < -0.5f) ? -0.5f : offset);
+            strength -= 0.25f * (left - right) * offset;
+        }
+
+        pPeaks[peakCount].angleDegrees = GetAngleDegrees(best) + offset * 180.0f / (m_angleCount - 1);
+        pPeaks[peakCount].strength = strength;
+
+        if (0 == peakCount) {
+            threshold = (cMinRelativePeakStrength * strength > threshold) ? cMinRelativePeakStrength * strength : threshold;
+        }
+        ++peakCount;
+    }
+
+    return peakCount;
+}
+
+/// Compute summed response of a run of angle groups into m_pPower.
+/// <param name="thread">index of thread whose run to compute, 0 for calling thread.</param>
+void SrpPhatMap::ComputeRun(UINT thread) {
+    UINT begin = thread * m_groupsPerThread * cAngleGroup;
+    UINT end = begin + m_groupsPerThread * cAngleGroup;
+    end = (end < m_paddedAngleCount) ? end : m_paddedAngleCount;
+    if (begin >= end) {
+        return;
+    }
+
+    memset(m_pPower + begin, 0, (end - begin) * sizeof(float));
+
+    const UINT planeSize = m_pairCount * m_paddedAngleCount;
+    for (UINT p = 0; p < m_pairCount; ++p) {
+        const float* pCross = m_pCrossSpectra + 2 * (p * m_binStride + m_firstBin);
+        const float* pStartCos = m_pSteering + p * m_paddedAngleCount + begin;
+        const float* pStartSin = pStartCos + planeSize;
+        const float* pStepCos = pStartSin + planeSize;
+        const float* pStepSin = pStepCos + planeSize;
+
+#ifdef AUDIO_SIMD_X86
+        if (SimdLevelAvx2 == m_level) {
+            SteerAvx2(pCross, m_binCount, pStartCos, pStartSin, pStepCos, pStepSin, m_pPower + begin, end - begin);
+            continue;
+        }
+
+        if (SimdLevelSse2 == m_level) {
+            SteerSse2(pCross, m_binCount, pStartCos, pStartSin, pStepCos, pStepSin, m_pPower + begin, end - begin);
+            continue;
+        }
+#endif
+
+        SteerScalar(pCross, m_binCount, pStartCos, pStartSin, pStepCos, pStepSin, m_pPower + begin, end - begin);
+    }
+}
+
+/// Body of a helper thread.
+/// <param name="thread">index of thread, from 1.</param>
+void SrpPhatMap::HelperLoop(UINT thread) {
+    UINT64 generation = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            while (!m_bStopping && m_generation == generation) {
+                m_workReady.wait(lock);
+            }
+
+            if (m_bStopping) {
+                return;
+            }
+            generation = m_generation;
+        }
+
+        ComputeRun(thread);
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (0 == --m_pending) {
+            m_workDone.notify_one();
+        }
+    }
+}
+
+/// Stop and join helper threads.
+void SrpPhatMap::StopHelpers() {
+    if (m_helpers.empty()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_bStopping = true;
+    }
+    m_workReady.notify_all();
+
+    for (size_t i = 0; i < m_helpers.size(); ++i) {
+        m_helpers[i].join();
+    }
+    m_helpers.clear();
+}
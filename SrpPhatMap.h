@@ -0,0 +1,122 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "Simd.h"
+
+// For helper threads that share map computation
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Local maximum of an angular power map.
+struct AngularPeak {
+    // Direction of peak, in degrees from broadside, interpolated between grid angles.
+    float                   angleDegrees;
+
+    // Map value at peak. 1 for a single coherent source, less when sources share the frame.
+    float                   strength;
+};
+
+/// Steered response power with phase transform (SRP-PHAT) over a grid of candidate angles.
+/// Every microphone pair's whitened cross-spectrum is phase shifted by the delay the pair
+/// would see from each angle and summed over frequency, so the map peaks in the direction
+/// of every source that is coherent across the array, not just the loudest one.
+/// Angles are spaced evenly from -90 to +90 degrees. The grid can be split across helper
+/// threads, each computing a contiguous run of angles; the calling thread takes the first run.
+/// Steering tables and helper threads are set up by Initialize; Compute performs no allocations.
+class SrpPhatMap {
+public:
+    // Largest number of grid angles.
+    static const UINT       cMaxAngles = 1441;
+
+    // Largest number of threads, including the calling one, a map is computed on.
+    static const UINT       cMaxThreads = 8;
+
+    /// Constructor
+    SrpPhatMap();
+
+    /// Destructor. Stops helper threads.
+    ~SrpPhatMap();
+
+    /// Build steering tables for a set of microphone pairs, and start helper threads.
+    /// <param name="pPairDelayPerSine">delay, in samples, of each pair's second microphone relative to its first, per unit sin(angle).</param>
+    /// <param name="pairCount">number of microphone pairs.</param>
+    /// <param name="fftSize">transform size cross-spectra were computed with.</param>
+    /// <param name="firstBin">lowest bin summed.</param>
+    /// <param name="lastBin">highest bin summed, below fftSize / 2.</param>
+    /// <param name="angleCount">number of grid angles, from 2 to cMaxAngles.</param>
+    /// <param name="threadCount">number of threads to split grid across, from 1 to cMaxThreads. 1 computes on calling thread only.</param>
+    /// <param name="level">instruction set used by steering kernel.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range.</returns>
+    HRESULT                 Initialize(const float* pPairDelayPerSine, UINT pairCount, UINT fftSize, UINT firstBin, UINT lastBin, UINT angleCount, UINT threadCount, SimdLevel level);
+
+    /// Compute map from one frame's cross-spectra.
+    /// <param name="pCrossSpectra">whitened cross-spectrum of every pair, one after another, each fftSize / 2 + 1 interleaved complex bins.</param>
+    /// <param name="pMap">receives GetAngleCount values, in order of increasing angle.</param>
+    void                    Compute(const float* pCrossSpectra, float* pMap);
+
+    /// Find strongest local maxima of a map, at least a minimum separation apart.
+    /// <param name="pMap">map produced by Compute.</param>
+    /// <param name="pPeaks">receives peaks, strongest first.</param>
+    /// <param name="maxPeaks">capacity of pPeaks.</param>
+    /// <returns>number of peaks written to pPeaks.</returns>
+    UINT                    FindPeaks(const float* pMap, AngularPeak* pPeaks, UINT maxPeaks) const;
+
+    /// Number of grid angles; 0 before Initialize.
+    UINT                    GetAngleCount() const { return m_angleCount; }
+
+    /// Direction, in degrees, of a grid angle.
+    /// <param name="index">index of grid angle.</param>
+    float                   GetAngleDegrees(UINT index) const { return -90.0f + 180.0f * index / (m_angleCount - 1); }
+
+    /// Number of threads map is computed on, including calling thread.
+    UINT                    GetThreadCount() const { return m_threadCount; }
+
+private:
+    // Number of angles steering kernels process at once. Grid is padded to a multiple of it.
+    static const UINT       cAngleGroup = 16;
+
+    UINT                    m_pairCount;
+    UINT                    m_binStride;
+    UINT                    m_firstBin;
+    UINT                    m_binCount;
+    UINT                    m_angleCount;
+    UINT                    m_paddedAngleCount;
+    SimdLevel               m_level;
+
+    // Per pair and padded angle: phasor of first summed bin, and phasor step from one bin to the next,
+    // as four planes of cosines and sines.
+    float*                  m_pSteering;
+
+    // Summed response per padded angle.
+    float*                  m_pPower;
+
+    // Cross-spectra of frame being computed, for helper threads.
+    const float*            m_pCrossSpectra;
+
+    // Helper threads, each owning the run of angle groups after the calling thread's.
+    UINT                    m_threadCount;
+    UINT                    m_groupsPerThread;
+    std::vector<std::thread> m_helpers;
+    std::mutex              m_lock;
+    std::condition_variable m_workReady;
+    std::condition_variable m_workDone;
+    UINT64                  m_generation;
+    UINT                    m_pending;
+    bool                    m_bStopping;
+
+    /// Compute summed response of a run of angle groups into m_pPower.
+    /// <param name="thread">index of thread whose run to compute, 0 for calling thread.</param>
+    void                    ComputeRun(UINT thread);
+
+    /// Body of a helper thread.
+    /// <param name="thread">index of thread, from 1.</param>
+    void                    HelperLoop(UINT thread);
+
+    /// Stop and join helper threads.
+    void                    StopHelpers();
+
+    SrpPhatMap(const SrpPhatMap&);
+    SrpPhatMap& operator=(const SrpPhatMap&);
+};
@@ -0,0 +1,239 @@
+﻿#include "Stft.h"
+
+// For M_PI, cos and log
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+/// Multiply samples by window weights: pOutput[i] = pSamples[i] * pWindow[i].
+static void ApplyWindowScalar(float* pOutput, const float* pSamples, const float* pWindow, UINT count) {
+    for (UINT i = 0; i < count; ++i) {
+        pOutput[i] = pSamples[i] * pWindow[i];
+    }
+}
+
+#ifdef AUDIO_SIMD_X86
+
+/// SSE2 version of ApplyWindowScalar, four samples at a time.
+AUDIO_TARGET_SSE2
+static void ApplyWindowSse2(float* pOutput, const float* pSamples, const float* pWindow, UINT count) {
+    UINT i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(pOutput + i, _mm_mul_ps(_mm_loadu_ps(pSamples + i), _mm_loadu_ps(pWindow + i)));
+    }
+
+    ApplyWindowScalar(pOutput + i, pSamples + i, pWindow + i, count - i);
+}
+
+/// AVX2 version of ApplyWindowScalar, eight samples at a time.
+AUDIO_TARGET_AVX2
+static void ApplyWindowAvx2(float* pOutput, const float* pSamples, const float* pWindow, UINT count) {
+    UINT i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(pOutput + i, _mm256_mul_ps(_mm256_loadu_ps(pSamples + i), _mm256_loadu_ps(pWindow + i)));
+    }
+
+    ApplyWindowScalar(pOutput + i, pSamples + i, pWindow + i, count - i);
+}
+
+#endif
+
+/// Multiply samples by window weights: pOutput[i] = pSamples[i] * pWindow[i].
+/// <param name="level">instruction set to use. Must be supported by running CPU.</param>
+/// <param name="pOutput">receives weighted samples. May be pSamples.</param>
+/// <param name="pSamples">samples to weight.</param>
+/// <param name="pWindow">weight of each sample.</param>
+/// <param name="count">number of samples.</param>
+void ApplyWindow(SimdLevel level, float* pOutput, const float* pSamples, const float* pWindow, UINT count) {
+#ifdef AUDIO_SIMD_X86
+    if (SimdLevelAvx2 == level) {
+        ApplyWindowAvx2(pOutput, pSamples, pWindow, count);
+        return;
+    }
+
+    if (SimdLevelSse2 == level) {
+        ApplyWindowSse2(pOutput, pSamples, pWindow, count);
+        return;
+    }
+#else
+    (void)level;
+#endif
+
+    ApplyWindowScalar(pOutput, pSamples, pWindow, count);
+}
+
+/// Constructor
+StftAnalyzer::StftAnalyzer() :
+    m_windowSize(0),
+    m_hopSize(0),
+    m_channelCount(0),
+    m_level(SimdLevelScalar),
+    m_pWindow(NULL),
+    m_pHistory(NULL),
+    m_writeIndex(0),
+    m_hopRemaining(0),
+    m_pFrame(NULL),
+    m_logFullScale(0.0f),
+    m_logScale(0.0f) {
+}
+
+/// Destructor
+StftAnalyzer::~StftAnalyzer() {
+    delete [] m_pWindow;
+    delete [] m_pHistory;
+    delete [] m_pFrame;
+}
+
+/// Configure transform and allocate history and workspaces.
+/// <param name="windowSize">samples per analysis window, a power of two from 4 to cMaxWindowSize.</param>
+/// <param name="hopSize">samples between consecutive windows, from 1 to windowSize.</param>
+/// <param name="channelCount">number of interleaved channels in input.</param>
+/// <param name="level">instruction set used by FFT and windowing kernels.</param>
+/// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range.</returns>
+HRESULT StftAnalyzer::Initialize(UINT windowSize, UINT hopSize, UINT channelCount, SimdLevel level) {
+    if (windowSize > cMaxWindowSize || 0 == hopSize || hopSize > windowSize || 0 == channelCount) {
+        return E_INVALIDARG;
+    }
+
+    HRESULT hr = m_plan.Initialize(windowSize, level);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    delete [] m_pWindow;
+    delete [] m_pHistory;
+    delete [] m_pFrame;
+
+    m_windowSize = windowSize;
+    m_hopSize = hopSize;
+    m_channelCount = channelCount;
+    m_level = level;
+    m_pWindow = new float[windowSize];
+    m_pHistory = new float[2 * windowSize * channelCount];
+    m_pFrame = new float[windowSize + 2];
+
+    // Periodic Hann window, so overlapping windows at half-window hops sum to a constant
+    for (UINT i = 0; i < windowSize; ++i) {
+        m_pWindow[i] = static_cast<float>((0.5 - 0.5 * cos(2.0 * M_PI * i / windowSize)) / 32768.0);
+    }
+
+    // Full scale sine puts half of window's sum, which is windowSize / 2, into its bin
+    double fullScaleMagnitude = windowSize / 4.0;
+    m_logFullScale = static_cast<float>(log(fullScaleMagnitude * fullScaleMagnitude));
+    m_logScale = static_cast<float>(10.0 / log(10.0) / cDynamicRangeDb);
+
+    Reset();
+
+    return S_OK;
+}
+
+/// Forget audio carried between calls. Following windows start over a silent history.
+void StftAnalyzer::Reset() {
+    if (NULL != m_pHistory) {
+        memset(m_pHistory, 0, 2 * m_windowSize * m_channelCount * sizeof(float));
+    }
+
+    m_writeIndex = 0;
+    m_hopRemaining = m_hopSize;
+}
+
+/// Feed frames and produce spectra for every hop they complete.
+/// <param name="pInterleaved">frames holding one sample per channel.</param>
+/// <param name="frameCount">number of frames.</param>
+/// <param name="pSpectra">receives, for each completed hop, oldest first, one spectrum of GetBinCount values
+/// per channel. Values are log power in [0.0,1.0] interval, lowest frequency first.</param>
+/// <param name="maxHops">capacity of pSpectra, in hops; hops beyond it are skipped.</param>
+/// <returns>number of hops written to pSpectra.</returns>
+UINT StftAnalyzer::Process(const int16_t* pInterleaved, UINT frameCount, float* pSpectra, UINT maxHops) {
+    return Feed(pInterleaved, frameCount, pSpectra, maxHops, true);
+}
+
+/// Feed frames without transforming them, producing silent spectra for every hop they complete.
+/// History is still kept, so windows analyzed by a later Process span these frames correctly.
+/// <param name="pInterleaved">frames holding one sample per channel.</param>
+/// <param name="frameCount">number of frames.</param>
+/// <param name="pSpectra">receives one spectrum of zeros per channel for each completed hop.</param>
+/// <param name="maxHops">capacity of pSpectra, in hops; hops beyond it are skipped.</param>
+/// <returns>number of hops written to pSpectra.</returns>
+UINT StftAnalyzer::Skip(const int16_t* pInterleaved, UINT frameCount, float* pSpectra, UINT maxHops) {
+    return Feed(pInterleaved, frameCount, pSpectra, maxHops, false);
+}
+
+/// Write frames into history and produce spectra for every hop they complete.
+/// <param name="pInterleaved">frames holding one sample per channel.</param>
+/// <param name="frameCount">number of frames.</param>
+/// <param name="pSpectra">receives one spectrum per channel for each completed hop.</param>
+/// <param name="maxHops">capacity of pSpectra, in hops.</param>
+/// <param name="bAnalyze">false to write silent spectra instead of transforming windows.</param>
+/// <returns>number of hops written to pSpectra.</returns>
+UINT StftAnalyzer::Feed(const int16_t* pInterleaved, UINT frameCount, float* pSpectra, UINT maxHops, bool bAnalyze) {
+    UINT hopCount = 0;
+
+    // Nothing to fill before Initialize
+    if (0 == m_windowSize) {
+        return 0;
+    }
+
+    while (frameCount > 0) {
+        UINT count = (frameCount < m_hopRemaining) ? frameCount : m_hopRemaining;
+
+        // Deinterleave into each channel's ring, writing every sample at both of its mirrored positions
+        for (UINT c = 0; c < m_channelCount; ++c) {
+            float* pRing = m_pHistory + 2 * m_windowSize * c;
+            const int16_t* pSample = pInterleaved + c;
+            UINT index = m_writeIndex;
+
+            for (UINT i = 0; i < count; ++i, pSample += m_channelCount) {
+                float sample = static_cast<float>(*pSample);
+                pRing[index] = sample;
+                pRing[index + m_windowSize] = sample;
+                if (++index == m_windowSize) {
+                    index = 0;
+                }
+            }
+        }
+
+        m_writeIndex = (m_writeIndex + count) % m_windowSize;
+        m_hopRemaining -= count;
+        pInterleaved += count * m_channelCount;
+        frameCount -= count;
+
+        if (0 == m_hopRemaining) {
+            m_hopRemaining = m_hopSize;
+
+            if (hopCount < maxHops) {
+                float* pHopSpectra = pSpectra + hopCount * m_channelCount * GetBinCount();
+                if (bAnalyze) {
+                    AnalyzeHop(pHopSpectra);
+                }
+                else {
+                    memset(pHopSpectra, 0, m_channelCount * GetBinCount() * sizeof(float));
+                }
+                ++hopCount;
+            }
+        }
+    }
+
+    return hopCount;
+}
+
+/// Transform most recent window of every channel.
+/// <param name="pSpectra">receives one spectrum per channel.</param>
+void StftAnalyzer::AnalyzeHop(float* pSpectra) {
+    const UINT binCount = GetBinCount();
+
+    for (UINT c = 0; c < m_channelCount; ++c) {
+        // Write index points at oldest sample, and mirroring makes the window behind it contiguous
+        const float* pWindowStart = m_pHistory + 2 * m_windowSize * c + m_writeIndex;
+        ApplyWindow(m_level, m_pFrame, pWindowStart, m_pWindow, m_windowSize);
+        m_plan.Forward(m_pFrame);
+
+        float* pSpectrum = pSpectra + c * binCount;
+        for (UINT k = 0; k < binCount; ++k) {
+            float power = m_pFrame[2 * k] * m_pFrame[2 * k] + m_pFrame[2 * k + 1] * m_pFrame[2 * k + 1];
+
+            // Tiny offset keeps log of a silent bin finite; it lands far below dynamic range anyway
+            float value = 1.0f + (logf(power + 1e-20f) - m_logFullScale) * m_logScale;
+            pSpectrum[k] = (value < 0.0f) ? 0.0f : ((value > 1.0f) ? 1.0f : value);
+        }
+    }
+}
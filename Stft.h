@@ -0,0 +1,119 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "Fft.h"
+#include "Simd.h"
+
+/// Multiply samples by window weights: pOutput[i] = pSamples[i] * pWindow[i].
+/// <param name="level">instruction set to use. Must be supported by running CPU.</param>
+/// <param name="pOutput">receives weighted samples. May be pSamples.</param>
+/// <param name="pSamples">samples to weight.</param>
+/// <param name="pWindow">weight of each sample.</param>
+/// <param name="count">number of samples.</param>
+void ApplyWindow(SimdLevel level, float* pOutput, const float* pSamples, const float* pWindow, UINT count);
+
+/// Streaming short-time Fourier transform of interleaved 16-bit PCM, producing one
+/// log-power spectrum per channel every hop.
+/// Each channel's most recent window of samples is kept in a mirrored ring (every sample
+/// is stored twice, one window apart), so the overlap between consecutive windows is
+/// carried across calls without shifting and any window can be read contiguously.
+/// Blocks of any size can be fed. Windows are Hann weighted and transformed with a real FFT.
+/// Memory is allocated by Initialize; Process performs no allocations.
+class StftAnalyzer {
+public:
+    // Largest supported window, in samples.
+    static const UINT       cMaxWindowSize = 4096;
+
+    // Dynamic range, in dB below a full scale sine, mapped onto [0.0,1.0] output interval.
+    static const UINT       cDynamicRangeDb = 90;
+
+    /// Constructor
+    StftAnalyzer();
+
+    /// Destructor
+    ~StftAnalyzer();
+
+    /// Configure transform and allocate history and workspaces.
+    /// <param name="windowSize">samples per analysis window, a power of two from 4 to cMaxWindowSize.</param>
+    /// <param name="hopSize">samples between consecutive windows, from 1 to windowSize.</param>
+    /// <param name="channelCount">number of interleaved channels in input.</param>
+    /// <param name="level">instruction set used by FFT and windowing kernels.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if a parameter is out of range.</returns>
+    HRESULT                 Initialize(UINT windowSize, UINT hopSize, UINT channelCount, SimdLevel level);
+
+    /// Forget audio carried between calls. Following windows start over a silent history.
+    void                    Reset();
+
+    /// Feed frames and produce spectra for every hop they complete.
+    /// <param name="pInterleaved">frames holding one sample per channel.</param>
+    /// <param name="frameCount">number of frames.</param>
+    /// <param name="pSpectra">receives, for each completed hop, oldest first, one spectrum of GetBinCount values
+    /// per channel. Values are log power in [0.0,1.0] interval, lowest frequency first.</param>
+    /// <param name="maxHops">capacity of pSpectra, in hops; hops beyond it are skipped.</param>
+    /// <returns>number of hops written to pSpectra.</returns>
+    UINT                    Process(const int16_t* pInterleaved, UINT frameCount, float* pSpectra, UINT maxHops);
+
+    /// Feed frames without transforming them, producing silent spectra for every hop they complete.
+    /// History is still kept, so windows analyzed by a later Process span these frames correctly.
+    /// <param name="pInterleaved">frames holding one sample per channel.</param>
+    /// <param name="frameCount">number of frames.</param>
+    /// <param name="pSpectra">receives one spectrum of zeros per channel for each completed hop.</param>
+    /// <param name="maxHops">capacity of pSpectra, in hops; hops beyond it are skipped.</param>
+    /// <returns>number of hops written to pSpectra.</returns>
+    UINT                    Skip(const int16_t* pInterleaved, UINT frameCount, float* pSpectra, UINT maxHops);
+
+    /// Number of frequency bins in each spectrum, from DC to Nyquist.
+    UINT                    GetBinCount() const { return m_windowSize / 2 + 1; }
+
+    /// Samples per analysis window.
+    UINT                    GetWindowSize() const { return m_windowSize; }
+
+    /// Samples between consecutive windows.
+    UINT                    GetHopSize() const { return m_hopSize; }
+
+    /// Number of interleaved channels expected in input.
+    UINT                    GetChannelCount() const { return m_channelCount; }
+
+private:
+    UINT                    m_windowSize;
+    UINT                    m_hopSize;
+    UINT                    m_channelCount;
+    SimdLevel               m_level;
+
+    RealFftPlan             m_plan;
+
+    // Hann window, with conversion from 16-bit PCM to [-1.0,1.0) folded in.
+    float*                  m_pWindow;
+
+    // Per channel mirrored ring of 2 * windowSize samples.
+    float*                  m_pHistory;
+
+    // Position in rings where next sample is written, in [0, windowSize).
+    UINT                    m_writeIndex;
+
+    // Samples still needed to complete current hop.
+    UINT                    m_hopRemaining;
+
+    // Windowed samples of one channel, transformed in place. windowSize + 2 floats.
+    float*                  m_pFrame;
+
+    // Natural log of power of a full scale sine's bin, and scale turning log power into output value.
+    float                   m_logFullScale;
+    float                   m_logScale;
+
+    /// Write frames into history and produce spectra for every hop they complete.
+    /// <param name="pInterleaved">frames holding one sample per channel.</param>
+    /// <param name="frameCount">number of frames.</param>
+    /// <param name="pSpectra">receives one spectrum per channel for each completed hop.</param>
+    /// <param name="maxHops">capacity of pSpectra, in hops.</param>
+    /// <param name="bAnalyze">false to write silent spectra instead of transforming windows.</param>
+    /// <returns>number of hops written to pSpectra.</returns>
+    UINT                    Feed(const int16_t* pInterleaved, UINT frameCount, float* pSpectra, UINT maxHops, bool bAnalyze);
+
+    /// Transform most recent window of every channel.
+    /// <param name="pSpectra">receives one spectrum per channel.</param>
+    void                    AnalyzeHop(float* pSpectra);
+
+    StftAnalyzer(const StftAnalyzer&);
+    StftAnalyzer& operator=(const StftAnalyzer&);
+};
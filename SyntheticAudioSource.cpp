@@ -0,0 +1,164 @@
+﻿#include "SyntheticAudioSource.h"
+
+// For M_PI, sin, cos and floor
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+// Fundamental frequency, in Hz, of generated tone.
+static const double cToneFrequency = 440.0;
+
+// Number of harmonics, including fundamental, in generated tone. Harmonics spread
+// energy across the speech band so array processing has more than one frequency to work with.
+static const int    cToneHarmonics = 7;
+
+// Peak amplitude of generated tone.
+static const double cToneAmplitude = 8000.0;
+
+// Peak amplitude of background noise.
+static const int    cNoiseAmplitude = 200;
+
+// Time, in seconds, for source to sweep from one side of field of view and back.
+static const double cSweepPeriod = 8.0;
+
+// Largest source angle, in degrees, reached by sweep. Matches Kinect beam range.
+static const double cSweepExtent = 50.0;
+
+// Spacing, in degrees, of beams Kinect can steer to.
+static const double cBeamStep = 10.0;
+
+// Time, in seconds, of each tone burst and of the silence that follows it.
+static const double cBurstOnTime = 1.5;
+static const double cBurstOffTime = 0.5;
+
+/// Constructor
+/// <param name="bRealTime">true to pace generation at real-time rate, false to generate as fast as possible.</param>
+/// <param name="durationSamples">number of samples to generate before finishing, or 0 to never finish.</param>
+/// <param name="pGeometry">microphone array to simulate, or NULL to generate mono audio.</param>
+SyntheticAudioSource::SyntheticAudioSource(bool bRealTime, UINT64 durationSamples, const MicrophoneArrayGeometry* pGeometry) :
+    m_durationSamples(durationSamples),
+    m_samplesProduced(0),
+    m_noiseState(1),
+    m_pacer(AudioSamplesPerSecond, bRealTime) {
+    if (NULL != pGeometry && pGeometry->microphoneCount <= AudioBlock::MaxChannels) {
+        m_geometry = *pGeometry;
+    }
+    else {
+        // Mono audio is what a single microphone at the array origin would hear
+        m_geometry.microphoneCount = AudioChannels;
+        m_geometry.positions[0] = 0.0f;
+    }
+}
+
+/// Harmonic tone, normalized to peak amplitude of about 1, at a given phase of its fundamental.
+/// <param name="phase">fundamental phase, in radians.</param>
+/// <returns>tone sample.</returns>
+static double ToneAt(double phase) {
+    // sin(k*phase) by Chebyshev recurrence, so only one sin/cos pair is needed per sample
+    double twoCos = 2.0 * cos(phase);
+    double previous = 0.0;
+    double current = sin(phase);
+    double sum = 0.0;
+    double norm = 0.0;
+
+    for (int k = 1; k <= cToneHarmonics; ++k) {
+        sum += current / k;
+        norm += 1.0 / k;
+
+        double next = twoCos * current - previous;
+        previous = current;
+        current = next;
+    }
+
+    return sum / norm;
+}
+
+/// Simulated sound source angle, in radians, at a given sample position.
+/// <param name="samplePosition">sample index since start of stream.</param>
+/// <returns>source angle in radians.</returns>
+double SyntheticAudioSource::GetSourceAngle(UINT64 samplePosition) {
+    double seconds = static_cast<double>(samplePosition) / AudioSamplesPerSecond;
+    double degrees = cSweepExtent * sin(2.0 * M_PI * seconds / cSweepPeriod);
+    return degrees * M_PI / 180.0;
+}
+
+/// Whether the tone burst is sounding at a given sample position.
+/// <param name="samplePosition">sample index since start of stream.</param>
+/// <returns>true while tone is on.</returns>
+bool SyntheticAudioSource::IsToneOn(UINT64 samplePosition) {
+    double seconds = static_cast<double>(samplePosition) / AudioSamplesPerSecond;
+    return fmod(seconds, cBurstOnTime + cBurstOffTime) < cBurstOnTime;
+}
+
+/// Generate next block of samples.
+/// <param name="pBuffer">buffer that receives PCM data.</param>
+/// <param name="pAngles">receives simulated beam and sound source angles.</param>
+/// <param name="pbMoreAvailable">set to true if another block can be generated immediately.</param>
+/// <returns>S_OK if audio was produced, S_FALSE if none is available right now, otherwise failure code.</returns>
+HRESULT SyntheticAudioSource::Read(IMediaBuffer* pBuffer, AudioAngles* pAngles, bool* pbMoreAvailable) {
+    *pbMoreAvailable = false;
+    pBuffer->SetLength(0);
+
+    if (IsFinished()) {
+        return S_FALSE;
+    }
+
+    BYTE* pData = NULL;
+    DWORD cbMax = 0;
+    pBuffer->GetBufferAndLength(&pData, NULL);
+    pBuffer->GetMaxLength(&cbMax);
+
+    UINT64 samplesWanted = cBlockSamples;
+    if (0 != m_durationSamples && samplesWanted > m_durationSamples - m_samplesProduced) {
+        samplesWanted = m_durationSamples - m_samplesProduced;
+    }
+    const UINT channels = m_geometry.microphoneCount;
+    if (samplesWanted > cbMax / (AudioBlockAlign * channels)) {
+        samplesWanted = cbMax / (AudioBlockAlign * channels);
+    }
+
+    UINT samplesDue = static_cast<UINT>(m_pacer.GetSamplesDue(m_samplesProduced, samplesWanted));
+    if (0 == samplesDue) {
+        return S_FALSE;
+    }
+
+    // Angles and burst state are sampled once per block, like the sensor reports them
+    bool bToneOn = IsToneOn(m_samplesProduced);
+    double sourceAngle = GetSourceAngle(m_samplesProduced);
+    double beamStep = cBeamStep * M_PI / 180.0;
+
+    pAngles->sourceAngle = sourceAngle;
+    pAngles->sourceConfidence = bToneOn ? 0.9 : 0.0;
+    pAngles->beamAngle = beamStep * floor(sourceAngle / beamStep + 0.5);
+
+    // Sound reaches each microphone positions[c] * sin(angle) / SpeedOfSound seconds before
+    // it reaches the array origin, so each channel hears the tone that much further along
+    double channelAdvance[MicrophoneArrayGeometry::MaxMicrophones];
+    for (UINT c = 0; c < channels; ++c) {
+        channelAdvance[c] = m_geometry.positions[c] * sin(sourceAngle) / SpeedOfSound;
+    }
+
+    const double amplitude = bToneOn ? cToneAmplitude : 0.0;
+
+    int16_t* pSamples = reinterpret_cast<int16_t*>(pData);
+    for (UINT i = 0; i < samplesDue; ++i) {
+        double seconds = static_cast<double>(m_samplesProduced + i) / AudioSamplesPerSecond;
+
+        for (UINT c = 0; c < channels; ++c) {
+            // Linear congruential generator gives cheap, repeatable noise, independent per microphone
+            m_noiseState = m_noiseState * 1664525u + 1013904223u;
+            int noise = static_cast<int>(m_noiseState >> 16) % (2 * cNoiseAmplitude + 1) - cNoiseAmplitude;
+
+            double cycles = cToneFrequency * (seconds + channelAdvance[c]);
+            double phase = 2.0 * M_PI * (cycles - floor(cycles));
+
+            *pSamples++ = static_cast<int16_t>(amplitude * ToneAt(phase) + noise);
+        }
+    }
+
+    m_samplesProduced += samplesDue;
+
+    pBuffer->SetLength(samplesDue * AudioBlockAlign * channels);
+    *pbMoreAvailable = (samplesDue == samplesWanted) && !IsFinished();
+
+    return S_OK;
+}
@@ -0,0 +1,53 @@
+﻿#pragma once
+
+#include "AudioSource.h"
+#include "AudioFormat.h"
+#include "MicrophoneArray.h"
+
+/// Audio source that generates a tone burst whose position sweeps back and forth
+/// across the sensor's field of view, plus a little background noise.
+/// Reported angles follow the simulated position, so downstream stages can be
+/// exercised deterministically without a sensor. Given a microphone array geometry,
+/// it produces one interleaved channel per microphone, each delayed according to the
+/// simulated position, as a raw array capture would.
+class SyntheticAudioSource : public AudioSource {
+public:
+    /// Constructor
+    /// <param name="bRealTime">true to pace generation at real-time rate, false to generate as fast as possible.</param>
+    /// <param name="durationSamples">number of samples to generate before finishing, or 0 to never finish.</param>
+    /// <param name="pGeometry">microphone array to simulate, or NULL to generate mono audio.</param>
+    SyntheticAudioSource(bool bRealTime, UINT64 durationSamples, const MicrophoneArrayGeometry* pGeometry);
+
+    /// Generate next block of samples.
+    /// <param name="pBuffer">buffer that receives PCM data.</param>
+    /// <param name="pAngles">receives simulated beam and sound source angles.</param>
+    /// <param name="pbMoreAvailable">set to true if another block can be generated immediately.</param>
+    /// <returns>S_OK if audio was produced, S_FALSE if none is available right now, otherwise failure code.</returns>
+    virtual HRESULT         Read(IMediaBuffer* pBuffer, AudioAngles* pAngles, bool* pbMoreAvailable);
+
+    /// Whether requested duration has been generated.
+    virtual bool            IsFinished() const { return (0 != m_durationSamples) && (m_samplesProduced >= m_durationSamples); }
+
+    /// Number of interleaved channels produced by Read.
+    virtual WORD            GetChannelCount() const { return static_cast<WORD>(m_geometry.microphoneCount); }
+
+    /// Simulated sound source angle, in radians, at a given sample position.
+    /// <param name="samplePosition">sample index since start of stream.</param>
+    /// <returns>source angle in radians.</returns>
+    static double           GetSourceAngle(UINT64 samplePosition);
+
+    /// Whether the tone burst is sounding at a given sample position.
+    /// <param name="samplePosition">sample index since start of stream.</param>
+    /// <returns>true while tone is on.</returns>
+    static bool             IsToneOn(UINT64 samplePosition);
+
+private:
+    // Number of samples produced by each Read.
+    static const UINT       cBlockSamples = AudioBlock::MaxSamples;
+
+    UINT64                  m_durationSamples;
+    UINT64                  m_samplesProduced;
+    MicrophoneArrayGeometry m_geometry;
+    uint32_t                m_noiseState;
+    AudioSourcePacer        m_pacer;
+};
@@ -0,0 +1,198 @@
+﻿#include "TraceLog.h"
+
+// For sleeping between drains
+#include <chrono>
+
+// Identifies a binary trace file and its layout.
+static const char       cTraceFileMagic[8] = {'K', 'A', 'T', 'R', 'A', 'C', 'E', '1'};
+
+// Interval, in milliseconds, between drains of log to file.
+static const int        cDrainInterval = 20;
+
+// Number of records written to file with each fwrite.
+static const uint32_t   cDrainBatchSize = 256;
+
+/// Header at start of binary trace file.
+struct TraceFileHeader {
+    char                    magic[8];
+    uint32_t                recordSize;
+    uint32_t                reserved;
+};
+
+/// Constructor
+TraceLog::TraceLog() :
+    m_pSlots(NULL),
+    m_bOpen(false),
+    m_startNanoseconds(0),
+    m_writePosition(0),
+    m_readPosition(0),
+    m_droppedCount(0),
+    m_bStopDrainer(false),
+    m_pFile(NULL) {
+    static_assert((cCapacity & (cCapacity - 1)) == 0, "Trace log capacity must be a power of two");
+}
+
+/// Destructor
+TraceLog::~TraceLog() {
+    Close();
+    delete [] m_pSlots;
+}
+
+/// Create trace file and start draining records to it.
+/// <param name="szPath">path of binary trace file to create.</param>
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT TraceLog::Open(const char* szPath) {
+    if (m_bOpen) {
+        return E_UNEXPECTED;
+    }
+
+    m_pFile = fopen(szPath, "wb");
+    if (NULL == m_pFile) {
+        return E_FAIL;
+    }
+
+    TraceFileHeader header;
+    memcpy(header.magic, cTraceFileMagic, sizeof(header.magic));
+    header.recordSize = sizeof(TraceRecord);
+    header.reserved = 0;
+    fwrite(&header, sizeof(header), 1, m_pFile);
+
+    if (NULL == m_pSlots) {
+        m_pSlots = new Slot[cCapacity];
+    }
+
+    // Slot i is free for the writer claiming position i
+    for (uint32_t i = 0; i < cCapacity; ++i) {
+        m_pSlots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    m_writePosition.store(0, std::memory_order_relaxed);
+    m_readPosition = 0;
+    m_droppedCount.store(0, std::memory_order_relaxed);
+    m_bStopDrainer.store(false, std::memory_order_relaxed);
+    m_startNanoseconds = GetClockNanoseconds();
+
+    // Thread creation publishes the initialized slots to the drainer
+    m_drainer = std::thread(&TraceLog::DrainLoop, this);
+    m_bOpen = true;
+
+    return S_OK;
+}
+
+/// Stop drainer after writing all published records, and close trace file.
+/// Writers must have stopped before Close is called.
+void TraceLog::Close() {
+    if (!m_bOpen) {
+        return;
+    }
+
+    Write(TraceEventLogClosed, GetDroppedCount());
+    m_bOpen = false;
+
+    m_bStopDrainer.store(true, std::memory_order_release);
+    m_drainer.join();
+
+    fclose(m_pFile);
+    m_pFile = NULL;
+}
+
+/// Body of drainer thread.
+void TraceLog::DrainLoop() {
+    while (!m_bStopDrainer.load(std::memory_order_acquire)) {
+        Drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(cDrainInterval));
+    }
+
+    // Pick up everything written before Close
+    Drain();
+    fflush(m_pFile);
+}
+
+/// Write all published records to file.
+void TraceLog::Drain() {
+    TraceRecord batch[cDrainBatchSize];
+    uint32_t batchCount = 0;
+
+    for (;;) {
+        Slot& slot = m_pSlots[m_readPosition & (cCapacity - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != m_readPosition + 1) {
+            break;
+        }
+
+        batch[batchCount++] = slot.record;
+
+        // Hand slot back to writers one lap ahead
+        slot.sequence.store(m_readPosition + cCapacity, std::memory_order_release);
+        ++m_readPosition;
+
+        if (cDrainBatchSize == batchCount) {
+            fwrite(batch, sizeof(TraceRecord), batchCount, m_pFile);
+            batchCount = 0;
+        }
+    }
+
+    if (batchCount > 0) {
+        fwrite(batch, sizeof(TraceRecord), batchCount, m_pFile);
+    }
+}
+
+/// Name of a trace event, as written by DecodeTraceFile.
+/// <param name="eventId">one of TraceEvent.</param>
+/// <returns>event name, or "unknown".</returns>
+const char* GetTraceEventName(uint32_t eventId) {
+    switch (eventId) {
+    case TraceEventBlockCaptured:
+        return "block_captured";
+    case TraceEventCaptureOverrun:
+        return "capture_overrun";
+    case TraceEventBlockProcessed:
+        return "block_processed";
+    case TraceEventSourceEstimate:
+        return "source_estimate";
+    case TraceEventLogClosed:
+        return "log_closed";
+    case TraceEventSourceTracked:
+        return "source_tracked";
+    case TraceEventSourceTrack:
+        return "source_track";
+    default:
+        return "unknown";
+    }
+}
+
+/// Convert binary trace file written by TraceLog into CSV, one line per record.
+/// <param name="szPath">path of binary trace file.</param>
+/// <param name="pOutput">stream that receives CSV.</param>
+/// <returns>S_OK on success, E_INVALIDARG if file is not a trace file, otherwise failure code.</returns>
+HRESULT DecodeTraceFile(const char* szPath, FILE* pOutput) {
+    FILE* pFile = fopen(szPath, "rb");
+    if (NULL == pFile) {
+        return E_FAIL;
+    }
+
+    TraceFileHeader header;
+    if (1 != fread(&header, sizeof(header), 1, pFile) ||
+        0 != memcmp(header.magic, cTraceFileMagic, sizeof(header.magic)) ||
+        sizeof(TraceRecord) != header.recordSize) {
+        fclose(pFile);
+        return E_INVALIDARG;
+    }
+
+    fprintf(pOutput, "time_s,event,arg,value0,value1,value2,value3\n");
+
+    TraceRecord record;
+    while (1 == fread(&record, sizeof(record), 1, pFile)) {
+        fprintf(pOutput, "%.6f,%s,%u,%g,%g,%g,%g\n",
+            record.timestamp / 1e9,
+            GetTraceEventName(record.eventId),
+            record.arg,
+            record.values[0],
+            record.values[1],
+            record.values[2],
+            record.values[3]);
+    }
+
+    fclose(pFile);
+
+    return S_OK;
+}
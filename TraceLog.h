@@ -0,0 +1,176 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "Clock.h"
+
+// For FILE
+#include <stdio.h>
+
+// For lock-free record slots
+#include <atomic>
+
+// For background drainer
+#include <thread>
+
+/// Identifies what a trace record describes and how its fields are interpreted.
+enum TraceEvent {
+    // Capture thread published a block. arg: block sequence; values: frames, channels, sensor index.
+    TraceEventBlockCaptured = 1,
+
+    // Capture thread dropped a block because consumers fell behind. arg: block sequence; values: overrun count, sensor index.
+    TraceEventCaptureOverrun = 2,
+
+    // Pipeline processed a block. arg: block sequence; values: beam angle, source angle, confidence, peak energy.
+    TraceEventBlockProcessed = 3,
+
+    // Localizer made a sound source estimate. arg: low 32 bits of sample position; values: angle, confidence.
+    TraceEventSourceEstimate = 4,
+
+    // Log was closed. arg: number of records dropped because log was full.
+    TraceEventLogClosed = 5,
+
+    // Pipeline's tracker smoothed source angle at end of a block. arg: block sequence; values: angle, velocity, uncertainty.
+    TraceEventSourceTracked = 6,
+
+    // One of several sources followed through angular map was at an angle at end of a block.
+    // arg: track id; values: angle, velocity, uncertainty, strength.
+    TraceEventSourceTrack = 7,
+};
+
+/// Fixed size binary trace record.
+struct TraceRecord {
+    // Nanoseconds since log was opened.
+    UINT64                  timestamp;
+
+    // One of TraceEvent.
+    uint32_t                eventId;
+
+    // Integer field, usually a block sequence number.
+    uint32_t                arg;
+
+    // Numeric fields, meaning depends on eventId.
+    float                   values[4];
+};
+
+/// Preallocated, lock-free binary event log for hot paths.
+/// Any number of threads may Write concurrently; a write claims a slot with a single
+/// compare-and-swap and never allocates, blocks or enters the kernel. A background
+/// thread drains published records to a binary file, which DecodeTraceFile turns into CSV.
+/// When writers outpace the drainer, new records are dropped and counted.
+class TraceLog {
+public:
+    // Number of records log can hold before drainer catches up. Must be a power of two.
+    static const uint32_t   cCapacity = 16384;
+
+    /// Constructor
+    TraceLog();
+
+    /// Destructor
+    ~TraceLog();
+
+    /// Create trace file and start draining records to it.
+    /// <param name="szPath">path of binary trace file to create.</param>
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 Open(const char* szPath);
+
+    /// Stop drainer after writing all published records, and close trace file.
+    /// Writers must have stopped before Close is called.
+    void                    Close();
+
+    /// Whether log is open and recording.
+    bool                    IsOpen() const { return m_bOpen; }
+
+    /// Append a record. Does nothing when log is not open.
+    /// <param name="eventId">one of TraceEvent.</param>
+    /// <param name="arg">integer field.</param>
+    /// <param name="value0">first numeric field.</param>
+    /// <param name="value1">second numeric field.</param>
+    /// <param name="value2">third numeric field.</param>
+    /// <param name="value3">fourth numeric field.</param>
+    void                    Write(uint32_t eventId, uint32_t arg, float value0 = 0.0f, float value1 = 0.0f, float value2 = 0.0f, float value3 = 0.0f) {
+        if (!m_bOpen) {
+            return;
+        }
+
+        // Claim a slot: it is free when its sequence equals the position being claimed
+        uint32_t position = m_writePosition.load(std::memory_order_relaxed);
+        for (;;) {
+            uint32_t sequence = m_pSlots[position & (cCapacity - 1)].sequence.load(std::memory_order_acquire);
+            int32_t difference = static_cast<int32_t>(sequence - position);
+
+            if (0 == difference) {
+                if (m_writePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (difference < 0) {
+                m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            else {
+                position = m_writePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        Slot& slot = m_pSlots[position & (cCapacity - 1)];
+        slot.record.timestamp = GetClockNanoseconds() - m_startNanoseconds;
+        slot.record.eventId = eventId;
+        slot.record.arg = arg;
+        slot.record.values[0] = value0;
+        slot.record.values[1] = value1;
+        slot.record.values[2] = value2;
+        slot.record.values[3] = value3;
+
+        // Publish to drainer
+        slot.sequence.store(position + 1, std::memory_order_release);
+    }
+
+    /// Number of records dropped because log was full.
+    uint32_t                GetDroppedCount() const { return m_droppedCount.load(std::memory_order_relaxed); }
+
+private:
+    // Size of padding used to keep write position on its own cache line.
+    static const size_t     cCacheLineSize = 64;
+
+    /// Record plus sequence number that tells writers and drainer who owns it.
+    struct Slot {
+        std::atomic<uint32_t>   sequence;
+        TraceRecord             record;
+    };
+
+    Slot*                   m_pSlots;
+    bool                    m_bOpen;
+    UINT64                  m_startNanoseconds;
+
+    // Next position writers will claim. Shared by all writers.
+    std::atomic<uint32_t>   m_writePosition;
+    char                    m_writePadding[cCacheLineSize - sizeof(std::atomic<uint32_t>)];
+
+    // Next position drainer will read. Drainer thread only.
+    uint32_t                m_readPosition;
+
+    std::atomic<uint32_t>   m_droppedCount;
+    std::atomic<bool>       m_bStopDrainer;
+    std::thread             m_drainer;
+    FILE*                   m_pFile;
+
+    /// Body of drainer thread.
+    void                    DrainLoop();
+
+    /// Write all published records to file.
+    void                    Drain();
+
+    TraceLog(const TraceLog&);
+    TraceLog& operator=(const TraceLog&);
+};
+
+/// Name of a trace event, as written by DecodeTraceFile.
+/// <param name="eventId">one of TraceEvent.</param>
+/// <returns>event name, or "unknown".</returns>
+const char* GetTraceEventName(uint32_t eventId);
+
+/// Convert binary trace file written by TraceLog into CSV, one line per record.
+/// <param name="szPath">path of binary trace file.</param>
+/// <param name="pOutput">stream that receives CSV.</param>
+/// <returns>S_OK on success, E_INVALIDARG if file is not a trace file, otherwise failure code.</returns>
+HRESULT DecodeTraceFile(const char* szPath, FILE* pOutput);
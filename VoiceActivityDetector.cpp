@@ -0,0 +1,164 @@
+﻿#include "VoiceActivityDetector.h"
+#include "Stft.h"
+
+// For M_PI, cos, exp, log and log10
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+// Band, in Hz, holding most of speech's energy and harmonics. Flatness is judged over it.
+static const float cSpeechLowHz = 300.0f;
+static const float cSpeechHighHz = 4000.0f;
+
+// Margin, in dB, above noise floor a frame needs to count as voice when its spectrum is
+// not flat, and margin at which it counts whatever its shape.
+static const float cVoicedMarginDb = 6.0f;
+static const float cLoudMarginDb = 15.0f;
+
+// Largest spectral flatness of a voiced frame. White noise sits near 0.56, harmonics far below.
+static const float cMaxVoicedFlatness = 0.3f;
+
+// Level, in dB relative to full scale, below which no frame counts as voice.
+static const float cMinVoiceLevelDb = -70.0f;
+
+// Rate, in dB per second, at which noise floor may rise toward frame level. Falls at once.
+static const float cNoiseRiseDbPerSecond = 3.0f;
+
+// Time activity is held after last voiced frame, in seconds.
+static const float cHangoverSeconds = 0.3f;
+
+/// Constructor
+VoiceActivityDetector::VoiceActivityDetector() :
+    m_level(SimdLevelScalar),
+    m_pWindow(NULL),
+    m_pFrame(NULL),
+    m_framePosition(0),
+    m_firstBin(0),
+    m_endBin(0),
+    m_hangoverFrames(0),
+    m_hangoverRemaining(0),
+    m_noiseRiseDb(0.0f),
+    m_levelDb(0.0f),
+    m_flatness(1.0f),
+    m_noiseFloorDb(0.0f),
+    m_bPrimed(false) {
+}
+
+/// Destructor
+VoiceActivityDetector::~VoiceActivityDetector() {
+    delete [] m_pWindow;
+    delete [] m_pFrame;
+}
+
+/// Allocate frame and transform, and scale time constants to sample rate.
+/// <param name="sampleRate">sample rate of audio, in Hz.</param>
+/// <param name="level">instruction set used by FFT and windowing kernels.</param>
+/// <returns>S_OK on success, E_INVALIDARG if sample rate is out of range.</returns>
+HRESULT VoiceActivityDetector::Initialize(UINT sampleRate, SimdLevel level) {
+    // Speech band must fit below Nyquist
+    if (sampleRate < 2 * cSpeechHighHz) {
+        return E_INVALIDARG;
+    }
+
+    HRESULT hr = m_plan.Initialize(cFrameSize, level);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    delete [] m_pWindow;
+    delete [] m_pFrame;
+
+    m_level = level;
+    m_pWindow = new float[cFrameSize];
+    m_pFrame = new float[cFrameSize + 2];
+
+    for (UINT i = 0; i < cFrameSize; ++i) {
+        m_pWindow[i] = static_cast<float>((0.5 - 0.5 * cos(2.0 * M_PI * i / cFrameSize)) / 32768.0);
+    }
+
+    double binHz = static_cast<double>(sampleRate) / cFrameSize;
+    m_firstBin = static_cast<UINT>(ceil(cSpeechLowHz / binHz));
+    m_endBin = static_cast<UINT>(cSpeechHighHz / binHz) + 1;
+
+    double frameSeconds = static_cast<double>(cFrameSize) / sampleRate;
+    m_hangoverFrames = static_cast<UINT>(ceil(cHangoverSeconds / frameSeconds));
+    m_noiseRiseDb = static_cast<float>(cNoiseRiseDbPerSecond * frameSeconds);
+
+    Reset();
+
+    return S_OK;
+}
+
+/// Forget noise floor and activity. Detector starts inactive.
+void VoiceActivityDetector::Reset() {
+    m_framePosition = 0;
+    m_hangoverRemaining = 0;
+    m_levelDb = 0.0f;
+    m_flatness = 1.0f;
+    m_noiseFloorDb = 0.0f;
+    m_bPrimed = false;
+}
+
+/// Feed a run of samples, classifying every frame they complete.
+/// <param name="pSamples">first sample of run.</param>
+/// <param name="sampleCount">number of samples.</param>
+/// <param name="stride">distance between consecutive samples, so one channel of interleaved audio can be read.</param>
+/// <returns>whether voice was active at end of run, as IsActive.</returns>
+bool VoiceActivityDetector::Process(const int16_t* pSamples, UINT sampleCount, UINT stride) {
+    if (NULL == m_pFrame) {
+        return false;
+    }
+
+    for (UINT i = 0; i < sampleCount; ++i, pSamples += stride) {
+        m_pFrame[m_framePosition] = static_cast<float>(*pSamples);
+
+        if (++m_framePosition == cFrameSize) {
+            m_framePosition = 0;
+            ProcessFrame();
+        }
+    }
+
+    return IsActive();
+}
+
+/// Measure completed frame and update activity.
+void VoiceActivityDetector::ProcessFrame() {
+    ApplyWindow(m_level, m_pFrame, m_pFrame, m_pWindow, cFrameSize);
+    m_plan.Forward(m_pFrame);
+
+    // Flatness is ratio of geometric to arithmetic mean of bin power
+    double powerSum = 0.0;
+    double logPowerSum = 0.0;
+    for (UINT k = m_firstBin; k < m_endBin; ++k) {
+        // Tiny offset keeps log of a silent bin finite
+        float power = m_pFrame[2 * k] * m_pFrame[2 * k] + m_pFrame[2 * k + 1] * m_pFrame[2 * k + 1] + 1e-20f;
+        powerSum += power;
+        logPowerSum += log(power);
+    }
+
+    double binCount = m_endBin - m_firstBin;
+    double meanPower = powerSum / binCount;
+    m_flatness = static_cast<float>(exp(logPowerSum / binCount) / meanPower);
+
+    // Full scale sine puts a quarter of frame size into its bin's magnitude, and its band power is shared by the band's bins
+    double fullScalePower = (cFrameSize / 4.0) * (cFrameSize / 4.0) / binCount;
+    m_levelDb = static_cast<float>(10.0 * log10(meanPower / fullScalePower));
+
+    if (!m_bPrimed || m_levelDb < m_noiseFloorDb) {
+        m_noiseFloorDb = m_levelDb;
+        m_bPrimed = true;
+    }
+    else {
+        m_noiseFloorDb += m_noiseRiseDb;
+    }
+
+    float marginDb = m_levelDb - m_noiseFloorDb;
+    bool bVoiced = (m_levelDb > cMinVoiceLevelDb) &&
+        ((marginDb > cVoicedMarginDb && m_flatness < cMaxVoicedFlatness) || marginDb > cLoudMarginDb);
+
+    if (bVoiced) {
+        m_hangoverRemaining = m_hangoverFrames;
+    }
+    else if (m_hangoverRemaining > 0) {
+        --m_hangoverRemaining;
+    }
+}
@@ -0,0 +1,84 @@
+﻿#pragma once
+
+#include "Platform.h"
+#include "Fft.h"
+#include "Simd.h"
+
+/// Streaming voice activity detector for 16-bit PCM.
+/// Audio is cut into back-to-back frames. A frame counts as voice when its level stands
+/// above a tracked noise floor and its spectrum, over the speech band, is far from flat,
+/// as voiced sounds are; a frame far louder than the floor counts whatever its shape,
+/// so unvoiced consonants are not lost. Activity is held for a hangover after the last
+/// voiced frame, so word endings and short pauses are not cut off.
+/// Memory is allocated by Initialize; Process performs no allocations.
+class VoiceActivityDetector {
+public:
+    // Samples per analysis frame (16 ms at 16 kHz).
+    static const UINT       cFrameSize = 256;
+
+    /// Constructor
+    VoiceActivityDetector();
+
+    /// Destructor
+    ~VoiceActivityDetector();
+
+    /// Allocate frame and transform, and scale time constants to sample rate.
+    /// <param name="sampleRate">sample rate of audio, in Hz.</param>
+    /// <param name="level">instruction set used by FFT and windowing kernels.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if sample rate is out of range.</returns>
+    HRESULT                 Initialize(UINT sampleRate, SimdLevel level);
+
+    /// Forget noise floor and activity. Detector starts inactive.
+    void                    Reset();
+
+    /// Feed a run of samples, classifying every frame they complete.
+    /// <param name="pSamples">first sample of run.</param>
+    /// <param name="sampleCount">number of samples.</param>
+    /// <param name="stride">distance between consecutive samples, so one channel of interleaved audio can be read.</param>
+    /// <returns>whether voice was active at end of run, as IsActive.</returns>
+    bool                    Process(const int16_t* pSamples, UINT sampleCount, UINT stride);
+
+    /// Whether most recent frame was voiced, or followed one within hangover. False before Initialize.
+    bool                    IsActive() const { return m_hangoverRemaining > 0; }
+
+    /// Level of most recent frame and tracked noise floor, in dB relative to full scale.
+    float                   GetLevelDb() const { return m_levelDb; }
+    float                   GetNoiseFloorDb() const { return m_noiseFloorDb; }
+
+    /// Spectral flatness of most recent frame over speech band, in (0.0,1.0] interval; near 0.56 for white noise.
+    float                   GetFlatness() const { return m_flatness; }
+
+private:
+    SimdLevel               m_level;
+    RealFftPlan             m_plan;
+
+    // Hann window, with conversion from 16-bit PCM to [-1.0,1.0) folded in.
+    float*                  m_pWindow;
+
+    // Samples of current frame, then its spectrum. cFrameSize + 2 floats.
+    float*                  m_pFrame;
+    UINT                    m_framePosition;
+
+    // First and one past last bin of speech band.
+    UINT                    m_firstBin;
+    UINT                    m_endBin;
+
+    // Frames activity is held for after last voiced frame, and frames still left.
+    UINT                    m_hangoverFrames;
+    UINT                    m_hangoverRemaining;
+
+    // Amount noise floor may rise each frame, in dB.
+    float                   m_noiseRiseDb;
+
+    // Measurements of most recent frame, and noise floor. Floor is unknown until first frame.
+    float                   m_levelDb;
+    float                   m_flatness;
+    float                   m_noiseFloorDb;
+    bool                    m_bPrimed;
+
+    /// Measure completed frame and update activity.
+    void                    ProcessFrame();
+
+    VoiceActivityDetector(const VoiceActivityDetector&);
+    VoiceActivityDetector& operator=(const VoiceActivityDetector&);
+};
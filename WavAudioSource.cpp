@@ -0,0 +1,171 @@
+﻿#include "WavAudioSource.h"
+
+/// Constructor
+/// <param name="bRealTime">true to pace replay at real-time rate, false to replay as fast as possible.</param>
+/// <param name="bKeepChannels">true to replay up to AudioBlock::MaxChannels channels interleaved instead of mixing down.</param>
+WavAudioSource::WavAudioSource(bool bRealTime, bool bKeepChannels) :
+    m_pFile(NULL),
+    m_outputChannels(AudioChannels),
+    m_bKeepChannels(bKeepChannels),
+    m_bConvert(false),
+    m_samplesTotal(0),
+    m_samplesRead(0),
+    m_pacer(AudioSamplesPerSecond, bRealTime) {
+}
+
+/// Destructor
+WavAudioSource::~WavAudioSource() {
+    Close();
+}
+
+/// Close file, if open.
+void WavAudioSource::Close() {
+    if (NULL != m_pFile) {
+        fclose(m_pFile);
+        m_pFile = NULL;
+    }
+}
+
+/// Open WAV file and position replay at its first sample.
+/// <param name="szPath">path of file to replay.</param>
+/// <returns>S_OK on success, E_INVALIDARG if file format is unsupported, otherwise failure code.</returns>
+HRESULT WavAudioSource::Open(const char* szPath) {
+    Close();
+    m_samplesTotal = 0;
+    m_samplesRead = 0;
+
+    m_pFile = fopen(szPath, "rb");
+    if (NULL == m_pFile) {
+        return E_FAIL;
+    }
+
+    BYTE riffHeader[12];
+    if (sizeof(riffHeader) != fread(riffHeader, 1, sizeof(riffHeader), m_pFile) ||
+        0 != memcmp(riffHeader, "RIFF", 4) ||
+        0 != memcmp(riffHeader + 8, "WAVE", 4)) {
+        Close();
+        return E_INVALIDARG;
+    }
+
+    // Walk chunks until data chunk is found, validating format chunk on the way
+    bool bFormatOk = false;
+    for (;;) {
+        BYTE chunkHeader[8];
+        if (sizeof(chunkHeader) != fread(chunkHeader, 1, sizeof(chunkHeader), m_pFile)) {
+            break;
+        }
+
+        DWORD cbChunk = chunkHeader[4] | (chunkHeader[5] << 8) | (chunkHeader[6] << 16) | (static_cast<DWORD>(chunkHeader[7]) << 24);
+
+        if (0 == memcmp(chunkHeader, "fmt ", 4)) {
+            // Basic format, then for WAVE_FORMAT_EXTENSIBLE its extension, ending with sub-format GUID
+            BYTE format[40];
+            const DWORD cbBasic = 16;
+            DWORD cbFormat = (cbChunk < sizeof(format)) ? cbChunk : static_cast<DWORD>(sizeof(format));
+            if (cbChunk < cbBasic || cbFormat != fread(format, 1, cbFormat, m_pFile)) {
+                break;
+            }
+
+            WAVEFORMATEX waveFormat;
+            waveFormat.wFormatTag = format[0] | (format[1] << 8);
+            waveFormat.nChannels = format[2] | (format[3] << 8);
+            waveFormat.nSamplesPerSec = format[4] | (format[5] << 8) | (format[6] << 16) | (static_cast<DWORD>(format[7]) << 24);
+            waveFormat.nAvgBytesPerSec = 0;
+            waveFormat.nBlockAlign = format[12] | (format[13] << 8);
+            waveFormat.wBitsPerSample = format[14] | (format[15] << 8);
+            waveFormat.cbSize = 0;
+
+            // Sub-format GUID starts with the tag it stands for
+            if (WAVE_FORMAT_EXTENSIBLE == waveFormat.wFormatTag) {
+                waveFormat.wFormatTag = (sizeof(format) == cbFormat) ? static_cast<WORD>(format[24] | (format[25] << 8)) : 0;
+            }
+
+            m_outputChannels = (m_bKeepChannels && waveFormat.nChannels <= AudioBlock::MaxChannels) ? waveFormat.nChannels : AudioChannels;
+            ChannelMapping mapping = (m_outputChannels == waveFormat.nChannels) ? ChannelMappingKeep : ChannelMappingMixDown;
+
+            bFormatOk = (AudioSamplesPerSecond == waveFormat.nSamplesPerSec) &&
+                        SUCCEEDED(m_converter.Initialize(waveFormat, mapping, true)) &&
+                        (m_converter.GetInputBlockAlign() == waveFormat.nBlockAlign);
+            m_bConvert = !(ChannelMappingKeep == mapping && WAVE_FORMAT_PCM == waveFormat.wFormatTag && AudioBitsPerSample == waveFormat.wBitsPerSample);
+
+            // Skip rest of format extension plus pad byte
+            fseek(m_pFile, (cbChunk - cbFormat) + (cbChunk & 1), SEEK_CUR);
+        }
+        else if (0 == memcmp(chunkHeader, "data", 4)) {
+            if (bFormatOk) {
+                m_samplesTotal = cbChunk / m_converter.GetInputBlockAlign();
+                return S_OK;
+            }
+            break;
+        }
+        else {
+            fseek(m_pFile, cbChunk + (cbChunk & 1), SEEK_CUR);
+        }
+    }
+
+    Close();
+    return E_INVALIDARG;
+}
+
+/// Read next block of samples from file.
+/// <param name="pBuffer">buffer that receives PCM data.</param>
+/// <param name="pAngles">receives zero angles.</param>
+/// <param name="pbMoreAvailable">set to true if another block can be read immediately.</param>
+/// <returns>S_OK if audio was produced, S_FALSE if none is available right now, otherwise failure code.</returns>
+HRESULT WavAudioSource::Read(IMediaBuffer* pBuffer, AudioAngles* pAngles, bool* pbMoreAvailable) {
+    *pbMoreAvailable = false;
+    pBuffer->SetLength(0);
+
+    if (NULL == m_pFile) {
+        return E_UNEXPECTED;
+    }
+
+    BYTE* pData = NULL;
+    DWORD cbMax = 0;
+    pBuffer->GetBufferAndLength(&pData, NULL);
+    pBuffer->GetMaxLength(&cbMax);
+
+    UINT64 samplesWanted = m_samplesTotal - m_samplesRead;
+    if (samplesWanted > cBlockSamples) {
+        samplesWanted = cBlockSamples;
+    }
+    if (samplesWanted > cbMax / (AudioBlockAlign * m_outputChannels)) {
+        samplesWanted = cbMax / (AudioBlockAlign * m_outputChannels);
+    }
+
+    UINT samplesDue = static_cast<UINT>(m_pacer.GetSamplesDue(m_samplesRead, samplesWanted));
+    if (0 == samplesDue) {
+        return S_FALSE;
+    }
+
+    int16_t* pSamples = reinterpret_cast<int16_t*>(pData);
+    size_t samplesRead = 0;
+
+    if (!m_bConvert) {
+        samplesRead = fread(pSamples, m_converter.GetInputBlockAlign(), samplesDue, m_pFile);
+    }
+    else {
+        samplesRead = fread(m_scratch, m_converter.GetInputBlockAlign(), samplesDue, m_pFile);
+        m_converter.Convert(m_scratch, static_cast<UINT>(samplesRead), pSamples);
+    }
+
+    // A short read means the file is truncated, so end replay where the data ends
+    if (samplesRead < samplesDue) {
+        m_samplesTotal = m_samplesRead + samplesRead;
+    }
+
+    m_samplesRead += samplesRead;
+
+    if (0 == samplesRead) {
+        return S_FALSE;
+    }
+
+    pAngles->beamAngle = 0.0;
+    pAngles->sourceAngle = 0.0;
+    pAngles->sourceConfidence = 0.0;
+
+    pBuffer->SetLength(static_cast<DWORD>(samplesRead * AudioBlockAlign * m_outputChannels));
+    *pbMoreAvailable = (samplesDue == samplesWanted) && !IsFinished();
+
+    return S_OK;
+}
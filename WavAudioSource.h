@@ -0,0 +1,73 @@
+﻿#pragma once
+
+#include "AudioSource.h"
+#include "AudioFormat.h"
+#include "SampleConverter.h"
+
+// For FILE
+#include <stdio.h>
+
+/// Audio source that replays PCM from a WAV file.
+/// File must hold 16-bit PCM, 32-bit PCM or 32-bit float samples at AudioSamplesPerSecond,
+/// which are converted to 16-bit PCM as they are read. Multichannel files are mixed
+/// down to mono unless caller asks to keep channels, as when replaying raw microphone
+/// array recordings. WAV files carry no angle information, so all angles are reported
+/// as zero with zero confidence.
+class WavAudioSource : public AudioSource {
+public:
+    /// Constructor
+    /// <param name="bRealTime">true to pace replay at real-time rate, false to replay as fast as possible.</param>
+    /// <param name="bKeepChannels">true to replay up to AudioBlock::MaxChannels channels interleaved instead of mixing down.</param>
+    WavAudioSource(bool bRealTime, bool bKeepChannels);
+
+    /// Destructor
+    virtual ~WavAudioSource();
+
+    /// Open WAV file and position replay at its first sample.
+    /// <param name="szPath">path of file to replay.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if file format is unsupported, otherwise failure code.</returns>
+    HRESULT                 Open(const char* szPath);
+
+    /// Read next block of samples from file.
+    /// <param name="pBuffer">buffer that receives PCM data.</param>
+    /// <param name="pAngles">receives zero angles.</param>
+    /// <param name="pbMoreAvailable">set to true if another block can be read immediately.</param>
+    /// <returns>S_OK if audio was produced, S_FALSE if none is available right now, otherwise failure code.</returns>
+    virtual HRESULT         Read(IMediaBuffer* pBuffer, AudioAngles* pAngles, bool* pbMoreAvailable);
+
+    /// Whether all samples in file have been replayed.
+    virtual bool            IsFinished() const { return m_samplesRead >= m_samplesTotal; }
+
+    /// Number of interleaved channels produced by Read.
+    virtual WORD            GetChannelCount() const { return m_outputChannels; }
+
+    /// Total number of sample frames in file.
+    UINT64                  GetTotalSamples() const { return m_samplesTotal; }
+
+private:
+    // Number of sample frames produced by each Read.
+    static const UINT       cBlockSamples = AudioBlock::MaxSamples;
+
+    // Largest channel count that will be mixed down.
+    static const WORD       cMaxChannels = SampleConverter::cMaxChannels;
+
+    // Largest size, in bytes, of a sample in file.
+    static const UINT       cMaxBytesPerSample = 4;
+
+    FILE*                   m_pFile;
+    WORD                    m_outputChannels;
+    bool                    m_bKeepChannels;
+
+    // Converts file's frames to 16-bit PCM. Files already holding 16-bit PCM with channels kept are read as they are.
+    SampleConverter         m_converter;
+    bool                    m_bConvert;
+    UINT64                  m_samplesTotal;
+    UINT64                  m_samplesRead;
+    AudioSourcePacer        m_pacer;
+
+    // Frames read from file before conversion.
+    BYTE                    m_scratch[cBlockSamples * cMaxChannels * cMaxBytesPerSample];
+
+    /// Close file, if open.
+    void                    Close();
+};
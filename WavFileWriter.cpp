@@ -0,0 +1,125 @@
+﻿#include "WavFileWriter.h"
+
+// Size, in bytes, of RIFF header, format chunk and data chunk header written ahead of samples.
+static const UINT cHeaderSize = 44;
+
+/// Store a 16-bit value little endian.
+/// <param name="pDestination">receives 2 bytes.</param>
+/// <param name="value">value to store.</param>
+static void StoreWord(BYTE* pDestination, WORD value) {
+    pDestination[0] = static_cast<BYTE>(value);
+    pDestination[1] = static_cast<BYTE>(value >> 8);
+}
+
+/// Store a 32-bit value little endian.
+/// <param name="pDestination">receives 4 bytes.</param>
+/// <param name="value">value to store.</param>
+static void StoreDword(BYTE* pDestination, DWORD value) {
+    StoreWord(pDestination, static_cast<WORD>(value));
+    StoreWord(pDestination + 2, static_cast<WORD>(value >> 16));
+}
+
+/// Constructor
+WavFileWriter::WavFileWriter() :
+    m_pFile(NULL),
+    m_channelCount(0),
+    m_framesWritten(0) {
+}
+
+/// Destructor. Closes file, if open.
+WavFileWriter::~WavFileWriter() {
+    Close();
+}
+
+/// Create file and write its header.
+/// <param name="szPath">path of file to create, replacing any existing file.</param>
+/// <param name="channelCount">number of interleaved channels.</param>
+/// <param name="sampleRate">sample rate, in Hz.</param>
+/// <returns>S_OK on success, E_INVALIDARG if channel count is 0, otherwise failure code.</returns>
+HRESULT WavFileWriter::Open(const char* szPath, WORD channelCount, UINT sampleRate) {
+    Close();
+
+    if (0 == channelCount) {
+        return E_INVALIDARG;
+    }
+
+    m_pFile = fopen(szPath, "wb");
+    if (NULL == m_pFile) {
+        return E_FAIL;
+    }
+
+    m_channelCount = channelCount;
+    m_framesWritten = 0;
+
+    // Lengths are left zero until Close knows them
+    WORD blockAlign = static_cast<WORD>(channelCount * sizeof(int16_t));
+    BYTE header[cHeaderSize];
+    memset(header, 0, sizeof(header));
+    memcpy(header, "RIFF", 4);
+    memcpy(header + 8, "WAVE", 4);
+    memcpy(header + 12, "fmt ", 4);
+    StoreDword(header + 16, 16);
+    StoreWord(header + 20, WAVE_FORMAT_PCM);
+    StoreWord(header + 22, channelCount);
+    StoreDword(header + 24, sampleRate);
+    StoreDword(header + 28, sampleRate * blockAlign);
+    StoreWord(header + 32, blockAlign);
+    StoreWord(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+
+    if (sizeof(header) != fwrite(header, 1, sizeof(header), m_pFile)) {
+        fclose(m_pFile);
+        m_pFile = NULL;
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+/// Append interleaved frames.
+/// <param name="pSamples">samples, frameCount * channelCount of them.</param>
+/// <param name="frameCount">number of frames.</param>
+/// <returns>S_OK on success, E_UNEXPECTED if file is not open, otherwise failure code.</returns>
+HRESULT WavFileWriter::Write(const int16_t* pSamples, UINT frameCount) {
+    if (NULL == m_pFile) {
+        return E_UNEXPECTED;
+    }
+
+    size_t sampleCount = static_cast<size_t>(frameCount) * m_channelCount;
+    if (sampleCount != fwrite(pSamples, sizeof(int16_t), sampleCount, m_pFile)) {
+        return E_FAIL;
+    }
+
+    m_framesWritten += frameCount;
+    return S_OK;
+}
+
+/// Patch header with lengths of audio written and close file. Does nothing if file is not open.
+/// <returns>S_OK on success, otherwise failure code.</returns>
+HRESULT WavFileWriter::Close() {
+    if (NULL == m_pFile) {
+        return S_OK;
+    }
+
+    // RIFF lengths are 32 bits; longer recordings keep their samples but report the largest length that fits
+    UINT64 dataSize = m_framesWritten * m_channelCount * sizeof(int16_t);
+    DWORD cbData = (dataSize > 0xFFFFFFFFull - cHeaderSize) ? (0xFFFFFFFF - cHeaderSize) & ~1u : static_cast<DWORD>(dataSize);
+
+    BYTE riffSize[4];
+    BYTE dataChunkSize[4];
+    StoreDword(riffSize, cHeaderSize - 8 + cbData);
+    StoreDword(dataChunkSize, cbData);
+
+    HRESULT hr = S_OK;
+    if (0 != fseek(m_pFile, 4, SEEK_SET) || sizeof(riffSize) != fwrite(riffSize, 1, sizeof(riffSize), m_pFile) ||
+        0 != fseek(m_pFile, cHeaderSize - 4, SEEK_SET) || sizeof(dataChunkSize) != fwrite(dataChunkSize, 1, sizeof(dataChunkSize), m_pFile)) {
+        hr = E_FAIL;
+    }
+
+    if (0 != fclose(m_pFile)) {
+        hr = E_FAIL;
+    }
+    m_pFile = NULL;
+
+    return hr;
+}
@@ -0,0 +1,46 @@
+﻿#pragma once
+
+#include "Platform.h"
+
+// For FILE
+#include <stdio.h>
+
+/// Writes 16-bit PCM to a WAV file. Header is written with zero lengths when file is
+/// opened and patched with actual lengths when it is closed, so samples are streamed
+/// straight to disk without being held in memory.
+class WavFileWriter {
+public:
+    /// Constructor
+    WavFileWriter();
+
+    /// Destructor. Closes file, if open.
+    ~WavFileWriter();
+
+    /// Create file and write its header.
+    /// <param name="szPath">path of file to create, replacing any existing file.</param>
+    /// <param name="channelCount">number of interleaved channels.</param>
+    /// <param name="sampleRate">sample rate, in Hz.</param>
+    /// <returns>S_OK on success, E_INVALIDARG if channel count is 0, otherwise failure code.</returns>
+    HRESULT                 Open(const char* szPath, WORD channelCount, UINT sampleRate);
+
+    /// Append interleaved frames.
+    /// <param name="pSamples">samples, frameCount * channelCount of them.</param>
+    /// <param name="frameCount">number of frames.</param>
+    /// <returns>S_OK on success, E_UNEXPECTED if file is not open, otherwise failure code.</returns>
+    HRESULT                 Write(const int16_t* pSamples, UINT frameCount);
+
+    /// Patch header with lengths of audio written and close file. Does nothing if file is not open.
+    /// <returns>S_OK on success, otherwise failure code.</returns>
+    HRESULT                 Close();
+
+    /// Number of frames written since Open.
+    UINT64                  GetFramesWritten() const { return m_framesWritten; }
+
+private:
+    FILE*                   m_pFile;
+    WORD                    m_channelCount;
+    UINT64                  m_framesWritten;
+
+    WavFileWriter(const WavFileWriter&);
+    WavFileWriter& operator=(const WavFileWriter&);
+};
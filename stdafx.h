@@ -27,13 +27,5 @@
 #endif
 #endif
 
-// Safe release for interfaces
-template<class Interface>
-inline void SafeRelease( Interface *& pInterfaceToRelease )
-{
-    if ( pInterfaceToRelease != NULL )
-    {
-        pInterfaceToRelease->Release();
-        pInterfaceToRelease = NULL;
-    }
-}
\ No newline at end of file
+// SafeRelease and other definitions shared with portable code
+#include "Platform.h"
\ No newline at end of file